@@ -0,0 +1,272 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include "Common/CollectiveSchedule.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// The mask of the two nodes of a pair. Each pair encrypts its slices with the
+// keys derived for this mask as a kMeshKeyPair, apart from the keys of the
+// node mask it may also be.
+inline uint64_t
+all_to_all_pair_mask(uint32_t a, uint32_t b)
+{
+	return (1ull << a) | (1ull << b);
+}
+
+// How the nodes are paired up in each of the N - 1 rounds of an all-to-all.
+// In every round each node sends one slice and receives one, so no node has
+// more than one slice in flight in either direction.
+enum AllToAllPairing : uint32_t {
+	// Node i sends to i + r and receives from i - r.
+	kAllToAllShift = 0,
+	// Node i exchanges with i ^ r, only for powers of two. Round r only
+	// crosses the links the bits of r select, e.g. stays in the chassis first.
+	kAllToAllXor,
+	kAllToAllPairingCount,
+};
+
+inline const char *
+all_to_all_pairing_name(AllToAllPairing pairing)
+{
+	switch (pairing) {
+	case kAllToAllShift:
+		return "shift";
+	case kAllToAllXor:
+		return "xor";
+	case kAllToAllPairingCount:
+		break;
+	}
+	return "unknown";
+}
+
+inline bool
+all_to_all_pairing_fits(AllToAllPairing pairing, uint32_t nodeCount)
+{
+	if (nodeCount < 2 || nodeCount > kMaxCollectiveNodes) {
+		return false;
+	}
+	return pairing == kAllToAllShift || (pairing == kAllToAllXor && (nodeCount & (nodeCount - 1)) == 0);
+}
+
+// The node that node sends its slice to in a round, 1 <= round < nodeCount.
+inline uint32_t
+all_to_all_send_peer(AllToAllPairing pairing, uint32_t nodeCount, uint32_t node, uint32_t round)
+{
+	return pairing == kAllToAllXor ? node ^ round : (node + round) % nodeCount;
+}
+
+inline uint32_t
+all_to_all_receive_peer(AllToAllPairing pairing, uint32_t nodeCount, uint32_t node, uint32_t round)
+{
+	return pairing == kAllToAllXor ? node ^ round : (node + nodeCount - round) % nodeCount;
+}
+
+/**
+ * Builds the rounds of an all-to-all as the steps of a schedule, where every
+ * transfer carries the one slice of its sender for its receiver (so it does
+ * not pass validate_collective_schedule, which expects all-gathers). Returns
+ * false if the pairing does not fit the node count.
+ */
+inline bool
+build_all_to_all_schedule(AllToAllPairing pairing, const CollectiveTopology & topology, CollectiveSchedule * schedule)
+{
+	const uint32_t nodeCount = topology.nodeCount;
+	memset(schedule, 0, sizeof(*schedule));
+	if (!all_to_all_pairing_fits(pairing, nodeCount)) {
+		return false;
+	}
+	schedule->algorithm = kCollectiveDirect;
+	schedule->nodeCount = nodeCount;
+	for (uint32_t round = 1; round < nodeCount; round++) {
+		if (!schedule->add_step()) {
+			return false;
+		}
+		for (uint32_t node = 0; node < nodeCount; node++) {
+			if (!schedule->add_transfer(node, all_to_all_send_peer(pairing, nodeCount, node, round), 1ull << node)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Picks the pairing whose rounds load the busiest link the least for slices
+ * of sliceSize, as estimated by the link model. The schedule is scratch space
+ * and holds the rounds of the last pairing tried on return.
+ */
+inline AllToAllPairing
+select_all_to_all_pairing(const CollectiveTopology & topology,
+                          uint64_t sliceSize,
+                          CollectiveSchedule * schedule,
+                          const CollectiveLinkModel & model = kDefaultCollectiveLinkModel)
+{
+	AllToAllPairing best = kAllToAllShift;
+	double bestTime      = 0;
+	for (uint32_t i = 0; i < kAllToAllPairingCount; i++) {
+		if (!build_all_to_all_schedule((AllToAllPairing)i, topology, schedule)) {
+			continue;
+		}
+		const double time = estimate_collective_time(*schedule, topology, sliceSize, model);
+		if (i == kAllToAllShift || time < bestTime) {
+			best     = (AllToAllPairing)i;
+			bestTime = time;
+		}
+	}
+	return best;
+}
+
+/**
+ * What an all-to-all computes: slice dst of the input of node src lands in
+ * slot src of the output of node dst.
+ */
+inline void
+all_to_all_reference(uint32_t nodeCount, uint64_t sliceSize, const uint8_t * const * inputs, uint8_t * const * outputs)
+{
+	for (uint32_t src = 0; src < nodeCount; src++) {
+		for (uint32_t dst = 0; dst < nodeCount; dst++) {
+			memcpy(outputs[dst] + src * sliceSize, inputs[src] + dst * sliceSize, sliceSize);
+		}
+	}
+}
+
+// Moves the ciphertext of one slice to or from a peer. Returns false if the
+// link failed.
+typedef bool (*AllToAllSendFn)(void * context, uint32_t peer, const void * data, uint64_t size);
+typedef bool (*AllToAllReceiveFn)(void * context, uint32_t peer, void * data, uint64_t size);
+
+// Encrypts (seal) or decrypts (open) the slice from node src to node dst with
+// the keys of the pair. Returns false if the slice does not authenticate.
+typedef bool (*AllToAllCryptFn)(void * context, uint32_t src, uint32_t dst, const void * in, void * out, uint64_t size);
+
+struct AllToAllOps {
+	AllToAllSendFn send;
+	AllToAllReceiveFn receive;
+	AllToAllCryptFn seal;
+	AllToAllCryptFn open;
+	void * context;
+};
+
+// One node of an all-to-all exchange between nodeCount nodes.
+//
+// The input holds a slice of sliceSize bytes for every node and the output a
+// slot for every node. The ciphertext of the slice from node src to node dst
+// is staged at (src * nodeCount + dst) * slotSize, so a staging buffer can
+// double as the shared memory of a mesh buffer. run() sends the rounds from a
+// thread of its own and receives them on the calling thread, so a node does
+// not wait for its own receives before sending the next slice.
+class AllToAllExchange
+{
+	const uint32_t _nodeCount;
+	const uint32_t _node;
+	const AllToAllPairing _pairing;
+	const uint64_t _sliceSize;
+	const uint64_t _slotSize;
+	const uint8_t * _input;
+	uint8_t * _output;
+	uint8_t * _staging;
+	const AllToAllOps _ops;
+
+	static void *
+	sendThread(void * arg)
+	{
+		AllToAllExchange * exchange = (AllToAllExchange *)arg;
+		return exchange->send() ? exchange : nullptr;
+	}
+
+	uint8_t *
+	staged(uint32_t src, uint32_t dst) const
+	{
+		return _staging + ((uint64_t)src * _nodeCount + dst) * _slotSize;
+	}
+
+  public:
+	AllToAllExchange(uint32_t nodeCount,
+	                 uint32_t node,
+	                 AllToAllPairing pairing,
+	                 uint64_t sliceSize,
+	                 uint64_t slotSize,
+	                 const uint8_t * input,
+	                 uint8_t * output,
+	                 uint8_t * staging,
+	                 const AllToAllOps & ops)
+	    : _nodeCount(nodeCount), _node(node), _pairing(pairing), _sliceSize(sliceSize), _slotSize(slotSize), _input(input),
+	      _output(output), _staging(staging), _ops(ops)
+	{
+	}
+
+	AllToAllExchange(const AllToAllExchange &)             = delete;
+	AllToAllExchange & operator=(const AllToAllExchange &) = delete;
+
+	/**
+	 * Runs the whole exchange. Returns false if a link or a slice failed, in
+	 * which case the output is only partially filled.
+	 */
+	bool
+	run()
+	{
+		if (!all_to_all_pairing_fits(_pairing, _nodeCount) || _node >= _nodeCount || _slotSize < _sliceSize) {
+			return false;
+		}
+		memcpy(_output + _node * _sliceSize, _input + _node * _sliceSize, _sliceSize);
+
+		pthread_t sender;
+		if (pthread_create(&sender, nullptr, sendThread, this) != 0) {
+			return false;
+		}
+		const bool received = receive();
+		void * sent         = nullptr;
+		pthread_join(sender, &sent);
+		return received && sent == this;
+	}
+
+	bool
+	send()
+	{
+		for (uint32_t round = 1; round < _nodeCount; round++) {
+			const uint32_t peer = all_to_all_send_peer(_pairing, _nodeCount, _node, round);
+			uint8_t * slice     = staged(_node, peer);
+			if (!_ops.seal(_ops.context, _node, peer, _input + peer * _sliceSize, slice, _sliceSize) ||
+			    !_ops.send(_ops.context, peer, slice, _sliceSize)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool
+	receive()
+	{
+		for (uint32_t round = 1; round < _nodeCount; round++) {
+			const uint32_t peer = all_to_all_receive_peer(_pairing, _nodeCount, _node, round);
+			uint8_t * slice     = staged(peer, _node);
+			if (!_ops.receive(_ops.context, peer, slice, _sliceSize) ||
+			    !_ops.open(_ops.context, peer, _node, slice, _output + peer * _sliceSize, _sliceSize)) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
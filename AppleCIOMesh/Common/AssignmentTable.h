@@ -0,0 +1,280 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// What the assignment maps of the driver and VirtMesh are built from, so the
+// number of assignments a buffer can have is no longer fixed up front.
+//
+// Allocator provides
+//   template <typename U> static U * allocate(uint32_t count);
+//   template <typename U> static void deallocate(U * memory, uint32_t count);
+// and must return zero-filled memory.
+
+// An array that grows a segment of kSegmentSize entries at a time, up to
+// kMaxSegments segments. Entries never move, so an index or a reference
+// stays good for as long as the array isn't cleared.
+//
+// append is not thread safe. Readers on other threads may use any index below
+// count(), the entry is written before count() covers it.
+template <typename T, uint32_t kSegmentSize, uint32_t kMaxSegments, typename Allocator> class SegmentedArray
+{
+	static_assert(kSegmentSize > 0 && kMaxSegments > 0, "The array needs room for something");
+
+	T * _segments[kMaxSegments];
+	uint32_t _segmentCount;
+	uint32_t _count;
+
+  public:
+	static constexpr uint32_t kMaxEntries = kSegmentSize * kMaxSegments;
+
+	SegmentedArray() : _segments(), _segmentCount(0), _count(0) {}
+	~SegmentedArray() { reset(); }
+
+	SegmentedArray(const SegmentedArray &)             = delete;
+	SegmentedArray & operator=(const SegmentedArray &) = delete;
+
+	/**
+	 * Makes sure the next extra appends can't fail. Returns false if that
+	 * would go past kMaxEntries or a segment can't be allocated, the segments
+	 * allocated so far are kept.
+	 */
+	bool
+	reserve(uint32_t extra)
+	{
+		if (extra > kMaxEntries - _count) {
+			return false;
+		}
+		while (_count + extra > _segmentCount * kSegmentSize) {
+			T * segment = Allocator::template allocate<T>(kSegmentSize);
+			if (segment == nullptr) {
+				return false;
+			}
+			__atomic_store_n(&_segments[_segmentCount], segment, __ATOMIC_RELEASE);
+			_segmentCount++;
+		}
+		return true;
+	}
+
+	/**
+	 * Adds value at index count(). Returns false if reserve would have.
+	 */
+	bool
+	append(const T & value)
+	{
+		if (!reserve(1)) {
+			return false;
+		}
+		(*this)[_count] = value;
+		__atomic_store_n(&_count, _count + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	T &
+	operator[](uint32_t index) const
+	{
+		return __atomic_load_n(&_segments[index / kSegmentSize], __ATOMIC_ACQUIRE)[index % kSegmentSize];
+	}
+
+	uint32_t
+	count() const
+	{
+		return __atomic_load_n(&_count, __ATOMIC_ACQUIRE);
+	}
+
+	/**
+	 * Empties the array but keeps the segments. Entries are not zeroed, nobody
+	 * may be reading.
+	 */
+	void
+	clear()
+	{
+		_count = 0;
+	}
+
+	/**
+	 * Empties the array and frees every segment. Nobody may be reading.
+	 */
+	void
+	reset()
+	{
+		_count = 0;
+		while (_segmentCount > 0) {
+			_segmentCount--;
+			Allocator::template deallocate<T>(_segments[_segmentCount], kSegmentSize);
+			_segments[_segmentCount] = nullptr;
+		}
+	}
+};
+
+// What OffsetIndex::find returns for an offset with no assignment.
+constexpr uint32_t kAssignmentNotFound = 0xFFFFFFFF;
+
+// An open addressing map from an assignment's offset to the index of its
+// first entry in an assignment map. Offsets are never negative. It is only
+// used by whoever builds the map, so none of it is thread safe.
+template <typename Allocator> class OffsetIndex
+{
+	struct Slot {
+		// The offset plus one, zero is an empty slot.
+		int64_t key;
+		uint32_t index;
+	};
+
+	Slot * _slots;
+	uint32_t _capacity;
+	uint32_t _count;
+
+	static uint32_t
+	slotOf(int64_t key, uint32_t capacity)
+	{
+		return (uint32_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> (64 - __builtin_ctz(capacity)));
+	}
+
+	static void
+	place(Slot * slots, uint32_t capacity, int64_t key, uint32_t index)
+	{
+		for (uint32_t slot = slotOf(key, capacity);; slot = (slot + 1) & (capacity - 1)) {
+			if (slots[slot].key == 0) {
+				slots[slot].key   = key;
+				slots[slot].index = index;
+				return;
+			}
+		}
+	}
+
+	bool
+	grow(uint32_t capacity)
+	{
+		Slot * slots = Allocator::template allocate<Slot>(capacity);
+		if (slots == nullptr) {
+			return false;
+		}
+		for (uint32_t i = 0; i < _capacity; i++) {
+			if (_slots[i].key != 0) {
+				place(slots, capacity, _slots[i].key, _slots[i].index);
+			}
+		}
+		if (_slots != nullptr) {
+			Allocator::template deallocate<Slot>(_slots, _capacity);
+		}
+		_slots    = slots;
+		_capacity = capacity;
+		return true;
+	}
+
+  public:
+	static constexpr uint32_t kMinCapacity = 64;
+	static constexpr uint32_t kMaxCapacity = 1u << 24;
+
+	OffsetIndex() : _slots(nullptr), _capacity(0), _count(0) {}
+	~OffsetIndex() { reset(); }
+
+	OffsetIndex(const OffsetIndex &)             = delete;
+	OffsetIndex & operator=(const OffsetIndex &) = delete;
+
+	/**
+	 * Makes sure the next extra inserts can't fail.
+	 */
+	bool
+	reserve(uint32_t extra)
+	{
+		uint32_t capacity = _capacity == 0 ? kMinCapacity : _capacity;
+		// Stay under three quarters full so probes stay short and always end.
+		while ((uint64_t)(_count + extra) * 4 > (uint64_t)capacity * 3) {
+			if (capacity == kMaxCapacity) {
+				return false;
+			}
+			capacity *= 2;
+		}
+		return capacity == _capacity || grow(capacity);
+	}
+
+	/**
+	 * Maps offset to index unless it is already mapped, the first index for an
+	 * offset is the one that stays. Returns false if the offset is negative or
+	 * the map can't grow.
+	 */
+	bool
+	insert(int64_t offset, uint32_t index)
+	{
+		if (offset < 0) {
+			return false;
+		}
+		if (find(offset) != kAssignmentNotFound) {
+			return true;
+		}
+		if (!reserve(1)) {
+			return false;
+		}
+		place(_slots, _capacity, offset + 1, index);
+		_count++;
+		return true;
+	}
+
+	uint32_t
+	find(int64_t offset) const
+	{
+		if (_capacity == 0 || offset < 0) {
+			return kAssignmentNotFound;
+		}
+		const int64_t key = offset + 1;
+		for (uint32_t slot = slotOf(key, _capacity);; slot = (slot + 1) & (_capacity - 1)) {
+			if (_slots[slot].key == 0) {
+				return kAssignmentNotFound;
+			}
+			if (_slots[slot].key == key) {
+				return _slots[slot].index;
+			}
+		}
+	}
+
+	uint32_t
+	count() const
+	{
+		return _count;
+	}
+
+	/**
+	 * Forgets every offset but keeps the slots.
+	 */
+	void
+	clear()
+	{
+		for (uint32_t i = 0; i < _capacity; i++) {
+			_slots[i].key = 0;
+		}
+		_count = 0;
+	}
+
+	void
+	reset()
+	{
+		if (_slots != nullptr) {
+			Allocator::template deallocate<Slot>(_slots, _capacity);
+		}
+		_slots    = nullptr;
+		_capacity = 0;
+		_count    = 0;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,365 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// An open addressing index from a buffer id to a T *, so looking up a buffer
+// costs the same however many are allocated.
+//
+// Writers (insert, remove, removeAll) must be serialized by the caller. Any
+// number of readers may call find alongside them without a lock:
+//  - A slot's key is published after its value and, once set, only ever goes
+//    to kTombstone. Tombstones are not reused in place, so a reader that saw
+//    a key can trust the value it loads next, or see it gone.
+//  - When tombstones pile up or the table fills, a writer builds a new table
+//    and publishes it. The old one is retired, not freed, until a writer sees
+//    no reader inside find, RCU style.
+//
+// Keys 0 (an empty slot) and kTombstone can't be inserted, nor can nullptr.
+//
+// Allocator provides
+//   template <typename U> static U * allocate(uint32_t count);
+//   template <typename U> static void deallocate(U * memory, uint32_t count);
+// and must return zero-filled memory.
+template <typename T, typename Allocator> class BufferIndex
+{
+  public:
+	static constexpr int64_t kTombstone    = -1;
+	static constexpr uint32_t kMinCapacity = 16;
+	static constexpr uint32_t kMaxCapacity = 1u << 24;
+
+  private:
+	struct Slot {
+		int64_t key;
+		T * value;
+	};
+
+	struct Table {
+		Slot * slots;
+		uint32_t capacity;
+		uint32_t shift;
+		Table * retired;
+	};
+
+	Table * _table;
+	Table * _retired;
+	uint32_t _live;
+	// Live keys plus tombstones, what a probe may have to walk past.
+	uint32_t _used;
+	uint32_t _rebuilds;
+	mutable uint32_t _readers;
+
+	static uint32_t
+	slotOf(const Table * table, int64_t key)
+	{
+		// Fibonacci hashing, buffer ids tend to be consecutive.
+		return (uint32_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> table->shift);
+	}
+
+	static Table *
+	allocateTable(uint32_t capacity)
+	{
+		Table * table = Allocator::template allocate<Table>(1);
+		if (table == nullptr) {
+			return nullptr;
+		}
+		table->slots = Allocator::template allocate<Slot>(capacity);
+		if (table->slots == nullptr) {
+			Allocator::template deallocate<Table>(table, 1);
+			return nullptr;
+		}
+		table->capacity = capacity;
+		table->shift    = 64 - (uint32_t)__builtin_ctz(capacity);
+		return table;
+	}
+
+	static void
+	freeTable(Table * table)
+	{
+		Allocator::template deallocate<Slot>(table->slots, table->capacity);
+		Allocator::template deallocate<Table>(table, 1);
+	}
+
+	/**
+	 * Places a key that isn't in the table into the first empty slot of its
+	 * probe. The value goes out before the key so readers never see a key
+	 * without its value.
+	 */
+	static void
+	place(Table * table, int64_t key, T * value)
+	{
+		const uint32_t mask = table->capacity - 1;
+		for (uint32_t slot = slotOf(table, key);; slot = (slot + 1) & mask) {
+			Slot * s = &table->slots[slot];
+			if (__atomic_load_n(&s->key, __ATOMIC_RELAXED) == 0) {
+				__atomic_store_n(&s->value, value, __ATOMIC_RELAXED);
+				__atomic_store_n(&s->key, key, __ATOMIC_RELEASE);
+				return;
+			}
+		}
+	}
+
+	Slot *
+	findSlot(int64_t key) const
+	{
+		if (_table == nullptr) {
+			return nullptr;
+		}
+		const uint32_t mask = _table->capacity - 1;
+		uint32_t slot       = slotOf(_table, key);
+		for (uint32_t probes = 0; probes < _table->capacity; probes++, slot = (slot + 1) & mask) {
+			Slot * s = &_table->slots[slot];
+			if (s->key == 0) {
+				return nullptr;
+			}
+			if (s->key == key) {
+				return s;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Moves the live keys into a table with room for at least one more at
+	 * half load, dropping the tombstones.
+	 */
+	bool
+	rebuild()
+	{
+		uint32_t capacity = kMinCapacity;
+		while (capacity < (_live + 1) * 2) {
+			if (capacity == kMaxCapacity) {
+				return false;
+			}
+			capacity *= 2;
+		}
+
+		Table * table = allocateTable(capacity);
+		if (table == nullptr) {
+			return false;
+		}
+		if (_table != nullptr) {
+			for (uint32_t i = 0; i < _table->capacity; i++) {
+				const Slot & s = _table->slots[i];
+				if (s.key != 0 && s.key != kTombstone) {
+					place(table, s.key, s.value);
+				}
+			}
+		}
+
+		Table * old = _table;
+		__atomic_store_n(&_table, table, __ATOMIC_SEQ_CST);
+		_used = _live;
+		_rebuilds++;
+		if (old != nullptr) {
+			old->retired = _retired;
+			_retired     = old;
+		}
+		reclaim();
+		return true;
+	}
+
+  public:
+	BufferIndex() : _table(nullptr), _retired(nullptr), _live(0), _used(0), _rebuilds(0), _readers(0) {}
+	~BufferIndex() { reset(); }
+
+	BufferIndex(const BufferIndex &)             = delete;
+	BufferIndex & operator=(const BufferIndex &) = delete;
+
+	/**
+	 * Returns the value for key, or nullptr. Safe from any thread.
+	 */
+	T *
+	find(int64_t key) const
+	{
+		T * value = nullptr;
+
+		enterReader();
+		const Table * table = __atomic_load_n(&_table, __ATOMIC_SEQ_CST);
+		if (table != nullptr && key != 0 && key != kTombstone) {
+			const uint32_t mask = table->capacity - 1;
+			uint32_t slot       = slotOf(table, key);
+			for (uint32_t probes = 0; probes < table->capacity; probes++, slot = (slot + 1) & mask) {
+				const Slot * s      = &table->slots[slot];
+				const int64_t found = __atomic_load_n(&s->key, __ATOMIC_ACQUIRE);
+				if (found == 0) {
+					break;
+				}
+				if (found == key) {
+					// A key removed and inserted again lives further along.
+					value = __atomic_load_n(&s->value, __ATOMIC_ACQUIRE);
+					if (value != nullptr) {
+						break;
+					}
+				}
+			}
+		}
+		exitReader();
+
+		return value;
+	}
+
+	/**
+	 * find enters and exits by itself. A caller may stay entered across
+	 * several finds, no retired table is freed until it exits.
+	 */
+	void
+	enterReader() const
+	{
+		// Pairs with the writer publishing a table and then checking for
+		// readers, one of the two sees the other.
+		__atomic_fetch_add(&_readers, 1, __ATOMIC_SEQ_CST);
+	}
+
+	void
+	exitReader() const
+	{
+		__atomic_fetch_sub(&_readers, 1, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * Adds key. Returns false if it is reserved or already there, or if a
+	 * bigger table is needed and can't be allocated.
+	 */
+	bool
+	insert(int64_t key, T * value)
+	{
+		if (key == 0 || key == kTombstone || value == nullptr || findSlot(key) != nullptr) {
+			return false;
+		}
+
+		// Keep at least a quarter of the slots empty so probes stay short and
+		// always end.
+		if (_table == nullptr || (_used + 1) * 4 > _table->capacity * 3) {
+			if (!rebuild()) {
+				return false;
+			}
+		}
+
+		place(_table, key, value);
+		_live++;
+		_used++;
+		return true;
+	}
+
+	/**
+	 * Removes key and returns its value, or nullptr if it wasn't there.
+	 */
+	T *
+	remove(int64_t key)
+	{
+		Slot * s = findSlot(key);
+		if (s == nullptr) {
+			return nullptr;
+		}
+
+		T * value = s->value;
+		__atomic_store_n(&s->value, (T *)nullptr, __ATOMIC_RELEASE);
+		__atomic_store_n(&s->key, kTombstone, __ATOMIC_RELEASE);
+		_live--;
+		reclaim();
+		return value;
+	}
+
+	/**
+	 * Removes every key, keeping the table.
+	 */
+	void
+	removeAll()
+	{
+		if (_table != nullptr) {
+			for (uint32_t i = 0; i < _table->capacity; i++) {
+				Slot * s = &_table->slots[i];
+				if (s->key != 0 && s->key != kTombstone) {
+					__atomic_store_n(&s->value, (T *)nullptr, __ATOMIC_RELEASE);
+					__atomic_store_n(&s->key, kTombstone, __ATOMIC_RELEASE);
+				}
+			}
+		}
+		_live = 0;
+		reclaim();
+	}
+
+	/**
+	 * Frees the retired tables if no reader can still be looking at them.
+	 * Writers call this as they go, it only needs calling to free them sooner.
+	 */
+	void
+	reclaim()
+	{
+		if (_retired == nullptr || __atomic_load_n(&_readers, __ATOMIC_SEQ_CST) != 0) {
+			return;
+		}
+		while (_retired != nullptr) {
+			Table * table = _retired;
+			_retired      = table->retired;
+			freeTable(table);
+		}
+	}
+
+	/**
+	 * Frees every table. Nobody may be reading.
+	 */
+	void
+	reset()
+	{
+		if (_table != nullptr) {
+			freeTable(_table);
+			_table = nullptr;
+		}
+		reclaim();
+		_live     = 0;
+		_used     = 0;
+		_rebuilds = 0;
+	}
+
+	uint32_t
+	count() const
+	{
+		return _live;
+	}
+
+	uint32_t
+	capacity() const
+	{
+		return _table == nullptr ? 0 : _table->capacity;
+	}
+
+	/**
+	 * How many times a new table has been built, for tests and stats.
+	 */
+	uint32_t
+	rebuilds() const
+	{
+		return _rebuilds;
+	}
+
+	/**
+	 * Whether retired tables are still waiting for readers to leave.
+	 */
+	bool
+	hasRetired() const
+	{
+		return _retired != nullptr;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
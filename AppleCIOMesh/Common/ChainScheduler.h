@@ -0,0 +1,190 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Which pending forward chain gets to run next when the active one stops.
+enum ChainSchedulingPolicy : uint8_t {
+	// The start that has waited the longest, i.e. the oldest pending sync.
+	kChainDeadline = 0,
+	// The lowest chain id, the order the chains were set up in.
+	kChainDiscoveryOrder = 1,
+};
+
+// A start that is waiting for the active chain to stop. chain is whatever
+// the owner uses to identify a chain, elements is how many elements to
+// start it with and deadline is when the start was asked for, in whatever
+// clock the owner uses.
+struct PendingChainStart {
+	uint32_t chain;
+	uint32_t elements;
+	uint64_t deadline;
+	uint64_t sequence;
+};
+
+// Only one forward chain runs at a time. The starts that arrive while one is
+// running wait here and are handed out one at a time by policy. It is a
+// binary heap so that submit and next are O(log n) no matter how many chains
+// are set up. Not thread safe, the owner serializes access.
+template <uint32_t kMaxPending> class ForwardChainScheduler
+{
+	PendingChainStart _pending[kMaxPending];
+	uint32_t _count;
+	uint64_t _sequence;
+	ChainSchedulingPolicy _policy;
+
+	bool
+	before(const PendingChainStart & a, const PendingChainStart & b) const
+	{
+		if (_policy == kChainDiscoveryOrder) {
+			if (a.chain != b.chain) {
+				return a.chain < b.chain;
+			}
+		} else if (a.deadline != b.deadline) {
+			return a.deadline < b.deadline;
+		}
+		// Ties go to whoever asked first so that equal starts stay in order.
+		return a.sequence < b.sequence;
+	}
+
+	void
+	swap(uint32_t a, uint32_t b)
+	{
+		PendingChainStart tmp = _pending[a];
+		_pending[a]           = _pending[b];
+		_pending[b]           = tmp;
+	}
+
+	void
+	siftUp(uint32_t index)
+	{
+		while (index > 0 && before(_pending[index], _pending[(index - 1) / 2])) {
+			swap(index, (index - 1) / 2);
+			index = (index - 1) / 2;
+		}
+	}
+
+	void
+	siftDown(uint32_t index)
+	{
+		for (;;) {
+			uint32_t first = index;
+			for (uint32_t child = 2 * index + 1; child <= 2 * index + 2 && child < _count; child++) {
+				if (before(_pending[child], _pending[first])) {
+					first = child;
+				}
+			}
+			if (first == index) {
+				return;
+			}
+			swap(index, first);
+			index = first;
+		}
+	}
+
+	void
+	rebuild()
+	{
+		for (uint32_t i = _count / 2; i-- > 0;) {
+			siftDown(i);
+		}
+	}
+
+  public:
+	ForwardChainScheduler() : _count(0), _sequence(0), _policy(kChainDeadline) {}
+
+	void
+	setPolicy(ChainSchedulingPolicy policy)
+	{
+		_policy = policy;
+		rebuild();
+	}
+
+	ChainSchedulingPolicy
+	policy() const
+	{
+		return _policy;
+	}
+
+	/**
+	 * Queues a start. Returns false if kMaxPending starts are already waiting.
+	 */
+	bool
+	submit(uint32_t chain, uint32_t elements, uint64_t deadline)
+	{
+		if (_count == kMaxPending) {
+			return false;
+		}
+		_pending[_count] = {chain, elements, deadline, _sequence++};
+		siftUp(_count);
+		_count++;
+		return true;
+	}
+
+	/**
+	 * Takes the start that should run next. Returns false if nothing is waiting.
+	 */
+	bool
+	next(PendingChainStart * start)
+	{
+		if (_count == 0) {
+			return false;
+		}
+		*start = _pending[0];
+		_count--;
+		_pending[0] = _pending[_count];
+		siftDown(0);
+		return true;
+	}
+
+	/**
+	 * Drops every pending start of a chain that is going away. Returns how many
+	 * were dropped.
+	 */
+	uint32_t
+	removeChain(uint32_t chain)
+	{
+		uint32_t kept = 0;
+		for (uint32_t i = 0; i < _count; i++) {
+			if (_pending[i].chain != chain) {
+				_pending[kept++] = _pending[i];
+			}
+		}
+		uint32_t removed = _count - kept;
+		_count           = kept;
+		rebuild();
+		return removed;
+	}
+
+	uint32_t
+	count() const
+	{
+		return _count;
+	}
+
+	void
+	clear()
+	{
+		_count = 0;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
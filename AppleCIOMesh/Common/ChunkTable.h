@@ -0,0 +1,373 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace AppleCIOMeshUtils
+{
+
+constexpr uint32_t kMaxChunkTableEntries = 256;
+// Blocks are never split in more chunks than this, it has to be a power of two.
+constexpr uint32_t kMaxChunksPerBlock = 64;
+
+// Returns the number of chunks blocks were split in before they were tuned:
+// the values were determined through experiments looking at performance with
+// llmsim. For smaller block sizes there is too much overhead per chunk to make
+// it worth splitting things up, only above 256k is it worth having 4 chunks.
+inline uint32_t
+default_chunk_count(uint64_t blockSize)
+{
+	if (blockSize <= 128 * 1024) {
+		return 1;
+	}
+	if (blockSize <= 256 * 1024) {
+		return 2;
+	}
+	return 4;
+}
+
+/**
+ * Returns the size of the chunks when blockSize is split in chunkCount
+ * chunks. The count is halved until it divides the block evenly and doubled
+ * until the chunks are no larger than maxChunkSize. Returns 0 if that takes
+ * more than kMaxChunksPerBlock chunks.
+ */
+inline uint64_t
+chunk_size_for_count(uint64_t blockSize, uint32_t chunkCount, uint64_t maxChunkSize)
+{
+	if (chunkCount == 0 || chunkCount > kMaxChunksPerBlock) {
+		chunkCount = default_chunk_count(blockSize);
+	}
+	while (chunkCount > 1 && blockSize % chunkCount != 0) {
+		chunkCount /= 2;
+	}
+	while (blockSize / chunkCount > maxChunkSize) {
+		chunkCount *= 2;
+		if (chunkCount > kMaxChunksPerBlock) {
+			return 0;
+		}
+	}
+	return blockSize / chunkCount;
+}
+
+struct ChunkTableEntry {
+	uint32_t nodeCount;
+	// The largest block size the entry is used for.
+	uint64_t blockSize;
+	uint32_t chunkCount;
+};
+
+// The number of chunks to split blocks in, by the number of nodes in the mesh
+// and the block size, as measured by the chunk tuner. Each entry is used for
+// the block sizes up to its own that no smaller entry covers, and the largest
+// entry for everything above it. Meshes of a node count not in the table use
+// the closest one.
+//
+// The chunks are sent and expected by every node, so all the nodes of a mesh
+// have to use the same table.
+//
+// Stored as text, one entry per line, with # starting a comment:
+//   # nodes block-size chunks
+//   8 131072 1
+//   8 262144 2
+//   8 16777216 4
+class ChunkTable
+{
+	ChunkTableEntry _entries[kMaxChunkTableEntries];
+	uint32_t _count;
+
+  public:
+	ChunkTable() : _count(0)
+	{
+	}
+
+	uint32_t
+	count() const
+	{
+		return _count;
+	}
+
+	const ChunkTableEntry &
+	entry(uint32_t index) const
+	{
+		return _entries[index];
+	}
+
+	void
+	clear()
+	{
+		_count = 0;
+	}
+
+	/**
+	 * Sets the chunk count for blocks up to blockSize on meshes of nodeCount
+	 * nodes, keeping the entries sorted. Returns false if the count is not a
+	 * power of two up to kMaxChunksPerBlock or the table is full.
+	 */
+	bool
+	set(uint32_t nodeCount, uint64_t blockSize, uint32_t chunkCount)
+	{
+		if (nodeCount == 0 || blockSize == 0 || chunkCount == 0 || chunkCount > kMaxChunksPerBlock ||
+		    (chunkCount & (chunkCount - 1)) != 0) {
+			return false;
+		}
+		uint32_t index = 0;
+		while (index < _count && (_entries[index].nodeCount < nodeCount ||
+		                          (_entries[index].nodeCount == nodeCount && _entries[index].blockSize < blockSize))) {
+			index++;
+		}
+		if (index < _count && _entries[index].nodeCount == nodeCount && _entries[index].blockSize == blockSize) {
+			_entries[index].chunkCount = chunkCount;
+			return true;
+		}
+		if (_count == kMaxChunkTableEntries) {
+			return false;
+		}
+		memmove(&_entries[index + 1], &_entries[index], (_count - index) * sizeof(_entries[0]));
+		_entries[index] = {nodeCount, blockSize, chunkCount};
+		_count++;
+		return true;
+	}
+
+	/**
+	 * Returns the chunk count for blocks of blockSize on meshes of nodeCount
+	 * nodes, or 0 if the table is empty.
+	 */
+	uint32_t
+	chunk_count(uint64_t blockSize, uint32_t nodeCount) const
+	{
+		if (_count == 0) {
+			return 0;
+		}
+		// The closest node count, the smaller one on a tie.
+		uint32_t closest = _entries[0].nodeCount;
+		for (uint32_t i = 1; i < _count; i++) {
+			const uint32_t candidate = _entries[i].nodeCount;
+			const uint32_t distance  = candidate > nodeCount ? candidate - nodeCount : nodeCount - candidate;
+			const uint32_t best      = closest > nodeCount ? closest - nodeCount : nodeCount - closest;
+			if (distance < best) {
+				closest = candidate;
+			}
+		}
+
+		uint32_t chunkCount = 0;
+		for (uint32_t i = 0; i < _count; i++) {
+			if (_entries[i].nodeCount != closest) {
+				continue;
+			}
+			chunkCount = _entries[i].chunkCount;
+			if (_entries[i].blockSize >= blockSize) {
+				break;
+			}
+		}
+		return chunkCount;
+	}
+
+	/**
+	 * Drops the entries that make no difference: those with the same chunk
+	 * count as the next larger block size of the same node count.
+	 */
+	void
+	compact()
+	{
+		uint32_t kept = 0;
+		for (uint32_t i = 0; i < _count; i++) {
+			const bool last = i + 1 == _count || _entries[i + 1].nodeCount != _entries[i].nodeCount;
+			if (last || _entries[i + 1].chunkCount != _entries[i].chunkCount) {
+				_entries[kept++] = _entries[i];
+			}
+		}
+		_count = kept;
+	}
+
+	/**
+	 * Parses the text form of a table, replacing the entries. Returns false if
+	 * a line is malformed or an entry invalid, leaving the table empty.
+	 */
+	bool
+	parse(const char * text)
+	{
+		clear();
+		const char * line = text;
+		while (*line) {
+			const char * next = strchr(line, '\n');
+			const size_t size = next ? (size_t)(next - line) : strlen(line);
+			char buffer[128];
+			if (size >= sizeof(buffer)) {
+				clear();
+				return false;
+			}
+			memcpy(buffer, line, size);
+			buffer[size] = '\0';
+			char * comment = strchr(buffer, '#');
+			if (comment) {
+				*comment = '\0';
+			}
+
+			unsigned long long blockSize;
+			unsigned int nodeCount, chunkCount;
+			char extra;
+			const int fields = sscanf(buffer, "%u %llu %u %c", &nodeCount, &blockSize, &chunkCount, &extra);
+			if (fields == 3) {
+				if (!set(nodeCount, blockSize, chunkCount)) {
+					clear();
+					return false;
+				}
+			} else if (fields != EOF) {
+				clear();
+				return false;
+			}
+			line = next ? next + 1 : line + size;
+		}
+		return true;
+	}
+
+	/**
+	 * Writes the text form of the table to file. Returns 0 on success or an
+	 * errno.
+	 */
+	int
+	write(FILE * file) const
+	{
+		fprintf(file, "# nodes block-size chunks\n");
+		for (uint32_t i = 0; i < _count; i++) {
+			fprintf(file, "%u %llu %u\n", _entries[i].nodeCount, (unsigned long long)_entries[i].blockSize,
+			        _entries[i].chunkCount);
+		}
+		return fflush(file) == 0 && !ferror(file) ? 0 : EIO;
+	}
+
+	/**
+	 * Replaces the entries with the table stored at path. Returns 0 on
+	 * success, EINVAL if it is malformed, EFBIG if it is too large or the
+	 * error opening it.
+	 */
+	int
+	load(const char * path)
+	{
+		FILE * file = fopen(path, "r");
+		if (file == nullptr) {
+			return errno;
+		}
+		static constexpr size_t kMaxSize = 64 * 1024;
+		char * text                      = (char *)malloc(kMaxSize + 1);
+		if (text == nullptr) {
+			fclose(file);
+			return ENOMEM;
+		}
+		const size_t size = fread(text, 1, kMaxSize + 1, file);
+		const bool failed = ferror(file);
+		fclose(file);
+		int error = 0;
+		if (failed) {
+			error = EIO;
+		} else if (size > kMaxSize) {
+			error = EFBIG;
+		} else {
+			text[size] = '\0';
+			error      = parse(text) ? 0 : EINVAL;
+		}
+		free(text);
+		return error;
+	}
+
+	/**
+	 * Stores the table at path. Returns 0 on success or an errno.
+	 */
+	int
+	save(const char * path) const
+	{
+		FILE * file = fopen(path, "w");
+		if (file == nullptr) {
+			return errno;
+		}
+		int error = write(file);
+		if (fclose(file) != 0 && error == 0) {
+			error = errno;
+		}
+		return error;
+	}
+};
+
+// Measures one sync of blocks of blockSize split in chunkCount chunks on a
+// mesh of nodeCount nodes. Returns the time it took in any unit, or a negative
+// value if the count can not be used.
+typedef double (*ChunkMeasureFn)(void * context, uint32_t nodeCount, uint64_t blockSize, uint32_t chunkCount);
+
+/**
+ * Finds the best number of chunks for blocks of blockSize by measuring every
+ * power of two count up to maxChunkCount repetitions times and comparing the
+ * medians. A larger count has to be better by more than minImprovement (e.g.
+ * 0.03 for 3%) to be picked over a smaller one, so noise does not add chunks
+ * and their overhead. Returns 0 if no count could be measured.
+ */
+inline uint32_t
+tune_chunk_count(ChunkMeasureFn measure,
+                 void * context,
+                 uint32_t nodeCount,
+                 uint64_t blockSize,
+                 uint32_t maxChunkCount,
+                 uint32_t repetitions,
+                 double minImprovement)
+{
+	static constexpr uint32_t kMaxRepetitions = 64;
+	if (repetitions == 0) {
+		repetitions = 1;
+	}
+	if (repetitions > kMaxRepetitions) {
+		repetitions = kMaxRepetitions;
+	}
+	if (maxChunkCount > kMaxChunksPerBlock) {
+		maxChunkCount = kMaxChunksPerBlock;
+	}
+
+	uint32_t best     = 0;
+	double bestMedian = 0;
+	for (uint32_t chunkCount = 1; chunkCount <= maxChunkCount && blockSize % chunkCount == 0; chunkCount *= 2) {
+		double times[kMaxRepetitions];
+		bool usable = true;
+		for (uint32_t i = 0; i < repetitions && usable; i++) {
+			times[i] = measure(context, nodeCount, blockSize, chunkCount);
+			usable   = times[i] >= 0;
+		}
+		if (!usable) {
+			continue;
+		}
+		// Insertion sort, there are only a few.
+		for (uint32_t i = 1; i < repetitions; i++) {
+			const double time = times[i];
+			uint32_t j        = i;
+			for (; j > 0 && times[j - 1] > time; j--) {
+				times[j] = times[j - 1];
+			}
+			times[j] = time;
+		}
+		const double median = times[repetitions / 2];
+		if (best == 0 || median < bestMedian * (1.0 - minImprovement)) {
+			best       = chunkCount;
+			bestMedian = median;
+		}
+	}
+	return best;
+}
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,495 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// How a data path's NHI ring is set up: its size and how many descriptors
+// complete between interrupts, both in descriptors (frames).
+struct RingSizing {
+	uint32_t ringSize;
+	uint32_t interruptStride;
+};
+
+inline bool
+operator==(const RingSizing & a, const RingSizing & b)
+{
+	return a.ringSize == b.ringSize && a.interruptStride == b.interruptStride;
+}
+
+inline bool
+operator!=(const RingSizing & a, const RingSizing & b)
+{
+	return !(a == b);
+}
+
+// What a CoalescingPolicy works with. Times are in whatever clock the owner
+// passes to record(), sizes in frames unless they say bytes.
+//
+// The ring never shrinks below chunkBytes, the largest single transfer the
+// owner puts on it, or below minRingSize. Everything else about its size comes
+// from the traffic it carried.
+//
+// Traffic is looked at one window at a time. A window with no traffic in it
+// changes nothing. The policy keeps at most maxInterrupts interrupts per
+// window and wants the ring to hold ringCover worth of traffic. A new sizing
+// is only taken once it has come out the same switchWindows windows in a row.
+// Until then, and for a link that never carried traffic, it is defaults.
+struct CoalescingPolicyConfig {
+	uint32_t frameBytes;
+	uint32_t minRingSize;
+	uint32_t maxRingSize;
+	uint64_t chunkBytes;
+	uint32_t minStride;
+	uint32_t maxStride;
+	uint64_t window;
+	uint32_t maxInterrupts;
+	uint64_t ringCover;
+	uint32_t switchWindows;
+	RingSizing defaults;
+};
+
+// The kext's policy (see Common/Config.h) in nsec, for the tools and tests.
+static constexpr CoalescingPolicyConfig kDefaultCoalescingPolicy = {
+    4096, 256, 4096, 15 * 1024 * 1024 / 2, 1, 512, 1'000'000, 50, 2'000'000, 8, {4096, 128},
+};
+
+// Counters for dumping a policy's state.
+struct CoalescingStats {
+	uint64_t messages;
+	uint64_t bytes;
+	uint64_t windows;
+	uint64_t changes;
+	// Frames per window, smoothed.
+	uint64_t frameRate;
+	bool bulk;
+};
+
+// Chooses a data path's ring size and interrupt stride from the traffic it
+// recently carried, a little like NAPI switches between interrupts and
+// polling.
+//
+// Latency sensitive traffic, e.g. the small blocks of a sync, wants an
+// interrupt at least once per message so it is noticed as soon as it lands:
+// the stride is the size of the smallest quarter of the messages. Once that
+// would have taken more than maxInterrupts for switchWindows windows in a row
+// the link counts as bulk, e.g. a send to all, and the stride grows to the median
+// message or to whatever keeps the interrupts in budget. It goes back once
+// the small stride fits in half the budget for as many windows.
+//
+// The ring holds ringCover of the recent rate and at least two of the largest
+// messages and four strides, rounded up to a power of two. Strides are powers
+// of two no larger than the messages they are for, so a run of same sized
+// messages ends each message on a stride.
+//
+// Message sizes are kept in a log2 histogram of frames that decays by a
+// quarter every window, the rate is smoothed the same way.
+//
+// Any number of threads may record at once without a lock. Counting a message
+// is a few atomic adds, and whichever thread first notices a window has ended
+// closes it while the others carry on counting. Any thread may read sizing()
+// and stats().
+class CoalescingPolicy
+{
+	static constexpr uint32_t kBuckets = 32;
+
+	CoalescingPolicyConfig _config;
+
+	// Set while a thread closes windows, only that thread touches what is
+	// below the window counters.
+	bool _closing;
+	uint64_t _windowStart;
+	uint32_t _windowMessages[kBuckets];
+	uint64_t _windowFrames;
+
+	// Sixteenths of a message per bucket.
+	uint64_t _histogram[kBuckets];
+	uint64_t _frameRate;
+	bool _bulk;
+	uint32_t _overBudget;
+	uint32_t _underBudget;
+
+	RingSizing _candidate;
+	uint32_t _candidateWindows;
+	uint64_t _sizing;
+
+	CoalescingStats _stats;
+
+	static uint32_t
+	_bucket(uint64_t frames)
+	{
+		uint32_t bucket = 0;
+		while (bucket + 1 < kBuckets && (2ull << bucket) <= frames) {
+			bucket++;
+		}
+		return bucket;
+	}
+
+	static uint64_t
+	_roundUp(uint64_t value)
+	{
+		uint64_t power = 1;
+		while (power < value && power < (1ull << 62)) {
+			power <<= 1;
+		}
+		return power;
+	}
+
+	static uint64_t
+	_clamp(uint64_t value, uint64_t low, uint64_t high)
+	{
+		return value < low ? low : (value > high ? high : value);
+	}
+
+	// The bucket fraction/16 of the messages are in or below, the largest
+	// message's if fraction is 16. Bucket i holds messages of 2^i frames up to
+	// just under 2^(i + 1).
+	uint32_t
+	_percentile(uint32_t fraction) const
+	{
+		uint64_t total = 0;
+		for (uint32_t i = 0; i < kBuckets; i++) {
+			total += _histogram[i];
+		}
+
+		uint64_t seen = 0;
+		for (uint32_t i = 0; i < kBuckets; i++) {
+			seen += _histogram[i];
+			if (_histogram[i] != 0 && seen * 16 >= total * fraction) {
+				return i;
+			}
+		}
+		return 0;
+	}
+
+	// The smallest ring that still holds a chunkBytes transfer, as far as
+	// maxRingSize allows.
+	uint64_t
+	_minRingSize() const
+	{
+		uint64_t ring = _roundUp((_config.chunkBytes + _config.frameBytes - 1) / _config.frameBytes);
+		ring          = ring > _config.minRingSize ? ring : _config.minRingSize;
+		return ring < _config.maxRingSize ? ring : _config.maxRingSize;
+	}
+
+	static uint64_t
+	_pack(const RingSizing & sizing)
+	{
+		return ((uint64_t)sizing.ringSize << 32) | sizing.interruptStride;
+	}
+
+	// A message counted while this runs lands in this window or the next.
+	void
+	_closeWindow()
+	{
+		uint32_t messages[kBuckets];
+		bool traffic = false;
+		for (uint32_t i = 0; i < kBuckets; i++) {
+			messages[i] = __atomic_exchange_n(&_windowMessages[i], 0, __ATOMIC_RELAXED);
+			traffic |= messages[i] != 0;
+		}
+		if (!traffic) {
+			return;
+		}
+
+		const uint64_t windows = __atomic_add_fetch(&_stats.windows, 1, __ATOMIC_RELAXED);
+		for (uint32_t i = 0; i < kBuckets; i++) {
+			_histogram[i] = _histogram[i] - (_histogram[i] >> 2) + ((uint64_t)messages[i] << 4);
+		}
+		const uint64_t frames = __atomic_exchange_n(&_windowFrames, 0, __ATOMIC_RELAXED);
+		uint64_t frameRate    = __atomic_load_n(&_frameRate, __ATOMIC_RELAXED);
+		if (windows == 1) {
+			frameRate = frames;
+		} else {
+			frameRate = (uint64_t)((int64_t)frameRate + (((int64_t)frames - (int64_t)frameRate) >> 2));
+		}
+		__atomic_store_n(&_frameRate, frameRate, __ATOMIC_RELAXED);
+
+		// The small stride, and how many interrupts it took this window.
+		const uint64_t small  = 1ull << _percentile(4);
+		const uint64_t demand = (frames + small - 1) / small;
+		if (demand > _config.maxInterrupts) {
+			_underBudget = 0;
+			if (++_overBudget >= _config.switchWindows) {
+				__atomic_store_n(&_bulk, true, __ATOMIC_RELAXED);
+			}
+		} else if (demand * 2 < _config.maxInterrupts) {
+			_overBudget = 0;
+			if (++_underBudget >= _config.switchWindows) {
+				__atomic_store_n(&_bulk, false, __ATOMIC_RELAXED);
+			}
+		} else {
+			_overBudget  = 0;
+			_underBudget = 0;
+		}
+
+		uint64_t stride = small;
+		if (_bulk) {
+			const uint64_t median     = 1ull << _percentile(8);
+			const uint64_t rateStride = _roundUp((frameRate + _config.maxInterrupts - 1) / _config.maxInterrupts);
+			stride                    = median > rateStride ? median : rateStride;
+		}
+
+		stride                 = _clamp(stride, _config.minStride, _config.maxStride);
+		uint64_t ring          = _config.window != 0 ? frameRate * _config.ringCover / _config.window : 0;
+		const uint64_t large   = 4ull << _percentile(16);
+		const uint64_t strides = 4 * stride;
+		ring                   = ring > large ? ring : large;
+		ring                   = ring > strides ? ring : strides;
+		ring                   = _clamp(_roundUp(ring), _minRingSize(), _config.maxRingSize);
+		if (stride > ring / 4) {
+			stride = ring / 4 > _config.minStride ? ring / 4 : _config.minStride;
+		}
+
+		const RingSizing candidate = {(uint32_t)ring, (uint32_t)stride};
+		if (candidate == _candidate) {
+			_candidateWindows++;
+		} else {
+			_candidate        = candidate;
+			_candidateWindows = 1;
+		}
+		if (_candidateWindows >= _config.switchWindows && candidate != sizing()) {
+			__atomic_store_n(&_sizing, _pack(candidate), __ATOMIC_RELAXED);
+			__atomic_add_fetch(&_stats.changes, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+  public:
+	/**
+	 * Sets the config and forgets all traffic seen so far.
+	 */
+	void
+	init(const CoalescingPolicyConfig & config)
+	{
+		_config      = config;
+		_closing     = false;
+		_windowStart = 0;
+		for (uint32_t i = 0; i < kBuckets; i++) {
+			_windowMessages[i] = 0;
+			_histogram[i]      = 0;
+		}
+		_windowFrames     = 0;
+		_frameRate        = 0;
+		_bulk             = false;
+		_overBudget       = 0;
+		_underBudget      = 0;
+		_candidate        = config.defaults;
+		_candidateWindows = 0;
+		_stats            = {};
+		__atomic_store_n(&_sizing, _pack(config.defaults), __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * Closes the windows that ended by now. Does nothing if another thread is
+	 * already closing them, or if now is before the current window, which a
+	 * thread that read the clock just before another closed it may see.
+	 */
+	void
+	advance(uint64_t now)
+	{
+		if (_config.window == 0) {
+			return;
+		}
+		const uint64_t start = __atomic_load_n(&_windowStart, __ATOMIC_RELAXED);
+		if (start != 0 && (now < start || now - start < _config.window)) {
+			return;
+		}
+		if (__atomic_exchange_n(&_closing, true, __ATOMIC_ACQUIRE)) {
+			return;
+		}
+
+		if (_windowStart == 0) {
+			__atomic_store_n(&_windowStart, now, __ATOMIC_RELAXED);
+		} else if (now >= _windowStart && now - _windowStart >= _config.window) {
+			_closeWindow();
+			// Empty windows in between change nothing.
+			__atomic_store_n(&_windowStart, now - (now - _windowStart) % _config.window, __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&_closing, false, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * A message of bytes finished on the ring at now.
+	 */
+	void
+	record(uint64_t now, uint64_t bytes)
+	{
+		advance(now);
+
+		const uint64_t frames = bytes == 0 ? 1 : (bytes + _config.frameBytes - 1) / _config.frameBytes;
+		__atomic_add_fetch(&_windowMessages[_bucket(frames)], 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&_windowFrames, frames, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&_stats.messages, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&_stats.bytes, bytes, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * The ring size and interrupt stride to set up the data path with.
+	 */
+	RingSizing
+	sizing() const
+	{
+		const uint64_t packed = __atomic_load_n(&_sizing, __ATOMIC_RELAXED);
+		return RingSizing{(uint32_t)(packed >> 32), (uint32_t)packed};
+	}
+
+	CoalescingStats
+	stats() const
+	{
+		CoalescingStats stats;
+		stats.messages  = __atomic_load_n(&_stats.messages, __ATOMIC_RELAXED);
+		stats.bytes     = __atomic_load_n(&_stats.bytes, __ATOMIC_RELAXED);
+		stats.windows   = __atomic_load_n(&_stats.windows, __ATOMIC_RELAXED);
+		stats.changes   = __atomic_load_n(&_stats.changes, __ATOMIC_RELAXED);
+		stats.frameRate = __atomic_load_n(&_frameRate, __ATOMIC_RELAXED);
+		stats.bulk      = __atomic_load_n(&_bulk, __ATOMIC_RELAXED);
+		return stats;
+	}
+};
+
+// What a ring sizing costs on a stream of messages, to compare sizings on a
+// recorded trace.
+//
+// The NHI raises an interrupt every interruptStride frames, so a message that
+// does not end on a stride is only noticed once the messages after it fill
+// the stride up. If nothing comes for flushAfter the completion is picked up
+// anyway, standing in for the next poll. Messages start where the last one
+// ended on the ring.
+class CoalescingReplay
+{
+	uint32_t _frameBytes;
+	uint32_t _stride;
+	uint64_t _flushAfter;
+
+	uint64_t _position;
+	// Messages that completed since the last interrupt.
+	uint64_t _waiting;
+	uint64_t _firstWaiting;
+	uint64_t _waitingSum;
+
+	uint64_t _messages;
+	uint64_t _interrupts;
+	uint64_t _waitTotal;
+	uint64_t _waitMax;
+
+	void
+	_notice(uint64_t now)
+	{
+		if (_waiting == 0) {
+			return;
+		}
+		_waitTotal += _waiting * now - _waitingSum;
+		if (now - _firstWaiting > _waitMax) {
+			_waitMax = now - _firstWaiting;
+		}
+		_waiting    = 0;
+		_waitingSum = 0;
+	}
+
+  public:
+	void
+	init(uint32_t frameBytes, const RingSizing & sizing, uint64_t flushAfter)
+	{
+		_frameBytes   = frameBytes;
+		_stride       = sizing.interruptStride == 0 ? 1 : sizing.interruptStride;
+		_flushAfter   = flushAfter;
+		_position     = 0;
+		_waiting      = 0;
+		_firstWaiting = 0;
+		_waitingSum   = 0;
+		_messages     = 0;
+		_interrupts   = 0;
+		_waitTotal    = 0;
+		_waitMax      = 0;
+	}
+
+	/**
+	 * A message of bytes finished at now. Messages have to come in order.
+	 */
+	void
+	message(uint64_t now, uint64_t bytes)
+	{
+		if (_waiting != 0 && now - _firstWaiting >= _flushAfter) {
+			_interrupts++;
+			_notice(_firstWaiting + _flushAfter);
+		}
+
+		const uint64_t frames  = bytes == 0 ? 1 : (bytes + _frameBytes - 1) / _frameBytes;
+		const uint64_t end     = _position + frames;
+		const uint64_t strides = end / _stride - _position / _stride;
+		_position              = end;
+		_messages++;
+
+		// The interrupts on the way pick up the messages before this one.
+		if (strides != 0) {
+			_interrupts += strides;
+			_notice(now);
+		}
+		// Unless it ends on a stride this one waits for the next.
+		if (end % _stride != 0) {
+			if (_waiting == 0) {
+				_firstWaiting = now;
+			}
+			_waiting++;
+			_waitingSum += now;
+		}
+	}
+
+	/**
+	 * Ends the stream, whatever is still waiting is flushed.
+	 */
+	void
+	finish()
+	{
+		if (_waiting != 0) {
+			_interrupts++;
+			_notice(_firstWaiting + _flushAfter);
+		}
+	}
+
+	uint64_t
+	messages() const
+	{
+		return _messages;
+	}
+
+	uint64_t
+	interrupts() const
+	{
+		return _interrupts;
+	}
+
+	/**
+	 * Summed over all messages, how long each completed before it was noticed.
+	 */
+	uint64_t
+	waitTotal() const
+	{
+		return _waitTotal;
+	}
+
+	uint64_t
+	waitMax() const
+	{
+		return _waitMax;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,670 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include "Common/MultiPathRoutes.h"
+#include <stdint.h>
+#include <string.h>
+
+namespace AppleCIOMeshUtils
+{
+
+constexpr uint32_t kMaxCollectiveNodes = 32;
+constexpr uint32_t kMaxCollectiveSteps = kMaxCollectiveNodes;
+// Enough for every node to send to every other node.
+constexpr uint32_t kMaxCollectiveTransfers = kMaxCollectiveNodes * (kMaxCollectiveNodes - 1);
+
+// Route costs of the ensemble map, these match cost_t.
+constexpr uint32_t kCollectiveCioHop     = 10;
+constexpr uint32_t kCollectiveNetworkHop = 100;
+
+// Nodes per chassis and per partition (the nodes connected with CIO).
+constexpr uint32_t kCollectiveChassisNodes   = 4;
+constexpr uint32_t kCollectivePartitionNodes = 8;
+
+/**
+ * Returns the cost of a route from src to dst in an ensemble of nodeCount
+ * nodes: a CIO hop to the nodes of the same chassis and to the node in the
+ * same position of the other chassis of the partition, two hops to the rest
+ * of the partition. Each node has a network peer in the same position of
+ * every other partition, nodes of other partitions cost a network hop plus
+ * the CIO hops from that peer.
+ */
+inline uint32_t
+ensemble_route_cost(uint32_t nodeCount, uint32_t src, uint32_t dst)
+{
+	if (src == dst || src >= nodeCount || dst >= nodeCount) {
+		return 0;
+	}
+	const uint32_t dstPartition = dst / kCollectivePartitionNodes;
+	if (src / kCollectivePartitionNodes != dstPartition) {
+		const uint32_t peer = dstPartition * kCollectivePartitionNodes + src % kCollectivePartitionNodes;
+		return kCollectiveNetworkHop + ensemble_route_cost(nodeCount, peer, dst);
+	}
+	if (src / kCollectiveChassisNodes == dst / kCollectiveChassisNodes ||
+	    src % kCollectiveChassisNodes == dst % kCollectiveChassisNodes) {
+		return kCollectiveCioHop;
+	}
+	return 2 * kCollectiveCioHop;
+}
+
+enum CollectiveAlgorithm : uint32_t {
+	// Every node sends its block to every other node at once.
+	kCollectiveDirect = 0,
+	// Blocks go around a ring of the nodes, ordered to keep neighbours close.
+	kCollectiveRing,
+	// Nodes exchange everything they have with a partner at doubling
+	// distances, the closest first.
+	kCollectiveRecursiveDoubling,
+	// Each node exchanges its own block with its network peers, then all the
+	// blocks across the chassis of the partition, then within the chassis.
+	kCollectiveHierarchical,
+	kCollectiveAlgorithmCount,
+};
+
+inline const char *
+collective_algorithm_name(CollectiveAlgorithm algorithm)
+{
+	switch (algorithm) {
+	case kCollectiveDirect:
+		return "direct";
+	case kCollectiveRing:
+		return "ring";
+	case kCollectiveRecursiveDoubling:
+		return "recursive-doubling";
+	case kCollectiveHierarchical:
+		return "hierarchical";
+	case kCollectiveAlgorithmCount:
+		break;
+	}
+	return "unknown";
+}
+
+inline bool
+parse_collective_algorithm(const char * name, CollectiveAlgorithm * algorithm)
+{
+	for (uint32_t i = 0; i < kCollectiveAlgorithmCount; i++) {
+		if (strcmp(name, collective_algorithm_name((CollectiveAlgorithm)i)) == 0) {
+			*algorithm = (CollectiveAlgorithm)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// The costs of the routes between the nodes, as in MeshEnsembleMap_t.
+struct CollectiveTopology {
+	uint32_t nodeCount;
+	uint32_t routeCost[kMaxCollectiveNodes * kMaxCollectiveNodes];
+
+	uint32_t
+	cost(uint32_t src, uint32_t dst) const
+	{
+		return routeCost[src * nodeCount + dst];
+	}
+};
+
+inline bool
+make_ensemble_topology(uint32_t nodeCount, CollectiveTopology * topology)
+{
+	if (nodeCount == 0 || nodeCount > kMaxCollectiveNodes) {
+		return false;
+	}
+	topology->nodeCount = nodeCount;
+	for (uint32_t src = 0; src < nodeCount; src++) {
+		for (uint32_t dst = 0; dst < nodeCount; dst++) {
+			topology->routeCost[src * nodeCount + dst] = ensemble_route_cost(nodeCount, src, dst);
+		}
+	}
+	return true;
+}
+
+// One node sending the blocks of the nodes in the mask to another.
+struct CollectiveTransfer {
+	uint8_t src;
+	uint8_t dst;
+	uint64_t blocks;
+};
+
+// The steps of an all-gather (broadcast and gather): the transfers of a step
+// run at the same time, and a step starts when the previous one is done.
+struct CollectiveSchedule {
+	CollectiveAlgorithm algorithm;
+	uint32_t nodeCount;
+	uint32_t stepCount;
+	// The transfers of step s are [stepEnd[s - 1], stepEnd[s]).
+	uint32_t stepEnd[kMaxCollectiveSteps];
+	CollectiveTransfer transfers[kMaxCollectiveTransfers];
+
+	uint32_t
+	step_begin(uint32_t step) const
+	{
+		return step == 0 ? 0 : stepEnd[step - 1];
+	}
+
+	bool
+	add_step()
+	{
+		if (stepCount == kMaxCollectiveSteps) {
+			return false;
+		}
+		stepEnd[stepCount] = step_begin(stepCount);
+		stepCount++;
+		return true;
+	}
+
+	bool
+	add_transfer(uint32_t src, uint32_t dst, uint64_t blocks)
+	{
+		if (stepCount == 0 || stepEnd[stepCount - 1] == kMaxCollectiveTransfers) {
+			return false;
+		}
+		transfers[stepEnd[stepCount - 1]++] = {(uint8_t)src, (uint8_t)dst, blocks};
+		return true;
+	}
+};
+
+/**
+ * Splits the nodes in groups whose routes all cost at most maxCost, taking
+ * the nodes in rank order. Fills groupOf with the group of each node and
+ * returns the number of groups.
+ */
+inline uint32_t
+collective_groups(const CollectiveTopology & topology, uint32_t maxCost, uint32_t groupOf[kMaxCollectiveNodes])
+{
+	uint32_t groupCount                = 0;
+	bool assigned[kMaxCollectiveNodes] = {};
+	for (uint32_t first = 0; first < topology.nodeCount; first++) {
+		if (assigned[first]) {
+			continue;
+		}
+		uint32_t members[kMaxCollectiveNodes];
+		uint32_t memberCount = 0;
+		for (uint32_t node = first; node < topology.nodeCount; node++) {
+			bool fits = !assigned[node];
+			for (uint32_t m = 0; m < memberCount && fits; m++) {
+				fits = topology.cost(members[m], node) <= maxCost && topology.cost(node, members[m]) <= maxCost;
+			}
+			if (fits) {
+				members[memberCount++] = node;
+				assigned[node]         = true;
+				groupOf[node]          = groupCount;
+			}
+		}
+		groupCount++;
+	}
+	return groupCount;
+}
+
+inline bool
+build_direct_schedule(const CollectiveTopology & topology, CollectiveSchedule * schedule)
+{
+	if (!schedule->add_step()) {
+		return false;
+	}
+	for (uint32_t src = 0; src < topology.nodeCount; src++) {
+		for (uint32_t dst = 0; dst < topology.nodeCount; dst++) {
+			if (src != dst && !schedule->add_transfer(src, dst, 1ull << src)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Orders the nodes in a ring starting at node 0, each node followed by the
+ * closest node left, so the ring crosses the expensive routes as few times as
+ * it can.
+ */
+inline void
+collective_ring_order(const CollectiveTopology & topology, uint32_t ring[kMaxCollectiveNodes])
+{
+	const uint32_t nodeCount       = topology.nodeCount;
+	bool used[kMaxCollectiveNodes] = {};
+	ring[0]                        = 0;
+	used[0]                        = true;
+	for (uint32_t i = 1; i < nodeCount; i++) {
+		uint32_t next = nodeCount;
+		for (uint32_t node = 0; node < nodeCount; node++) {
+			if (!used[node] && (next == nodeCount || topology.cost(ring[i - 1], node) < topology.cost(ring[i - 1], next))) {
+				next = node;
+			}
+		}
+		ring[i]    = next;
+		used[next] = true;
+	}
+}
+
+inline bool
+build_ring_schedule(const CollectiveTopology & topology, CollectiveSchedule * schedule)
+{
+	const uint32_t nodeCount = topology.nodeCount;
+	uint32_t ring[kMaxCollectiveNodes];
+	collective_ring_order(topology, ring);
+
+	// In step s the node at position i passes on the block that started at
+	// position i - s.
+	for (uint32_t step = 0; step + 1 < nodeCount; step++) {
+		if (!schedule->add_step()) {
+			return false;
+		}
+		for (uint32_t i = 0; i < nodeCount; i++) {
+			const uint32_t origin = ring[(i + nodeCount - step) % nodeCount];
+			if (!schedule->add_transfer(ring[i], ring[(i + 1) % nodeCount], 1ull << origin)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+inline bool
+build_recursive_doubling_schedule(const CollectiveTopology & topology, CollectiveSchedule * schedule)
+{
+	const uint32_t nodeCount = topology.nodeCount;
+	if ((nodeCount & (nodeCount - 1)) != 0) {
+		return false;
+	}
+	// Ranks that differ in the low bits are the closest in the ensemble, so
+	// the small first exchanges stay in the chassis and the last, largest
+	// one crosses the network.
+	for (uint32_t distance = 1; distance < nodeCount; distance *= 2) {
+		if (!schedule->add_step()) {
+			return false;
+		}
+		for (uint32_t node = 0; node < nodeCount; node++) {
+			// Before this step a node has the blocks of its aligned group of
+			// distance nodes.
+			const uint32_t first = node & ~(distance - 1);
+			const uint64_t have  = ((1ull << distance) - 1) << first;
+			if (!schedule->add_transfer(node, node ^ distance, have)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+inline bool
+build_hierarchical_schedule(const CollectiveTopology & topology, CollectiveSchedule * schedule)
+{
+	const uint32_t nodeCount = topology.nodeCount;
+	// The chassis are the groups of nodes one CIO hop from each other and the
+	// partitions the groups connected with CIO only.
+	uint32_t chassisOf[kMaxCollectiveNodes], partitionOf[kMaxCollectiveNodes];
+	collective_groups(topology, kCollectiveCioHop, chassisOf);
+	collective_groups(topology, kCollectiveNetworkHop - 1, partitionOf);
+
+	// The position of each node in its chassis and of its chassis in its
+	// partition, which have to be the same shape everywhere.
+	uint32_t indexInChassis[kMaxCollectiveNodes], chassisInPartition[kMaxCollectiveNodes];
+	uint32_t chassisSize = 0, chassisPerPartition = 0;
+	for (uint32_t node = 0; node < nodeCount; node++) {
+		bool earlierChassis[kMaxCollectiveNodes] = {};
+		uint32_t index = 0, chassisIndex = 0;
+		for (uint32_t other = 0; other < nodeCount; other++) {
+			if (other < node && chassisOf[other] == chassisOf[node]) {
+				index++;
+			}
+			if (partitionOf[other] == partitionOf[node] && chassisOf[other] < chassisOf[node] &&
+			    !earlierChassis[chassisOf[other]]) {
+				earlierChassis[chassisOf[other]] = true;
+				chassisIndex++;
+			}
+		}
+		indexInChassis[node]     = index;
+		chassisInPartition[node] = chassisIndex;
+		chassisSize              = index + 1 > chassisSize ? index + 1 : chassisSize;
+		chassisPerPartition      = chassisIndex + 1 > chassisPerPartition ? chassisIndex + 1 : chassisPerPartition;
+	}
+	uint32_t chassisNodes[kMaxCollectiveNodes] = {}, partitionNodes[kMaxCollectiveNodes] = {};
+	for (uint32_t node = 0; node < nodeCount; node++) {
+		chassisNodes[chassisOf[node]]++;
+		partitionNodes[partitionOf[node]]++;
+	}
+	for (uint32_t node = 0; node < nodeCount; node++) {
+		if (chassisNodes[chassisOf[node]] != chassisSize ||
+		    partitionNodes[partitionOf[node]] != chassisSize * chassisPerPartition) {
+			return false;
+		}
+	}
+
+	// Counterparts are in the same position of a different group.
+	auto samePosition = [&](uint32_t a, uint32_t b) { return indexInChassis[a] == indexInChassis[b]; };
+	uint64_t have[kMaxCollectiveNodes];
+	for (uint32_t node = 0; node < nodeCount; node++) {
+		have[node] = 1ull << node;
+	}
+	uint64_t next[kMaxCollectiveNodes];
+
+	// Each level is one step exchanging what the node has with its
+	// counterparts: across partitions, across the chassis of the partition,
+	// and within the chassis.
+	for (uint32_t level = 0; level < 3; level++) {
+		bool stepAdded = false;
+		memcpy(next, have, sizeof(uint64_t) * nodeCount);
+		for (uint32_t src = 0; src < nodeCount; src++) {
+			for (uint32_t dst = 0; dst < nodeCount; dst++) {
+				bool counterpart;
+				if (level == 0) {
+					counterpart = partitionOf[src] != partitionOf[dst] && samePosition(src, dst) &&
+					              chassisInPartition[src] == chassisInPartition[dst];
+				} else if (level == 1) {
+					counterpart = partitionOf[src] == partitionOf[dst] && chassisOf[src] != chassisOf[dst] &&
+					              samePosition(src, dst);
+				} else {
+					counterpart = src != dst && chassisOf[src] == chassisOf[dst];
+				}
+				if (!counterpart) {
+					continue;
+				}
+				if (!stepAdded && !schedule->add_step()) {
+					return false;
+				}
+				stepAdded = true;
+				if (!schedule->add_transfer(src, dst, have[src])) {
+					return false;
+				}
+				next[dst] |= have[src];
+			}
+		}
+		memcpy(have, next, sizeof(uint64_t) * nodeCount);
+	}
+	return true;
+}
+
+/**
+ * Builds the schedule of an algorithm for the topology. Returns false if the
+ * algorithm does not work for it (recursive doubling needs a power of two
+ * nodes, hierarchical equally sized chassis and partitions).
+ */
+inline bool
+build_collective_schedule(CollectiveAlgorithm algorithm, const CollectiveTopology & topology, CollectiveSchedule * schedule)
+{
+	schedule->algorithm = algorithm;
+	schedule->nodeCount = topology.nodeCount;
+	schedule->stepCount = 0;
+	if (topology.nodeCount < 2 || topology.nodeCount > kMaxCollectiveNodes) {
+		return false;
+	}
+	switch (algorithm) {
+	case kCollectiveDirect:
+		return build_direct_schedule(topology, schedule);
+	case kCollectiveRing:
+		return build_ring_schedule(topology, schedule);
+	case kCollectiveRecursiveDoubling:
+		return build_recursive_doubling_schedule(topology, schedule);
+	case kCollectiveHierarchical:
+		return build_hierarchical_schedule(topology, schedule);
+	case kCollectiveAlgorithmCount:
+		break;
+	}
+	return false;
+}
+
+/**
+ * Checks that a schedule only has nodes send blocks they already have (from
+ * before the step) and that every node ends up with every block.
+ */
+inline bool
+validate_collective_schedule(const CollectiveSchedule & schedule)
+{
+	const uint32_t nodeCount = schedule.nodeCount;
+	uint64_t have[kMaxCollectiveNodes], next[kMaxCollectiveNodes];
+	for (uint32_t node = 0; node < nodeCount; node++) {
+		have[node] = 1ull << node;
+	}
+	for (uint32_t step = 0; step < schedule.stepCount; step++) {
+		memcpy(next, have, sizeof(uint64_t) * nodeCount);
+		for (uint32_t t = schedule.step_begin(step); t < schedule.stepEnd[step]; t++) {
+			const CollectiveTransfer & transfer = schedule.transfers[t];
+			if (transfer.src >= nodeCount || transfer.dst >= nodeCount || transfer.src == transfer.dst ||
+			    transfer.blocks == 0 || (transfer.blocks & ~have[transfer.src]) != 0) {
+				return false;
+			}
+			next[transfer.dst] |= transfer.blocks;
+		}
+		memcpy(have, next, sizeof(uint64_t) * nodeCount);
+	}
+	const uint64_t all = (1ull << nodeCount) - 1;
+	for (uint32_t node = 0; node < nodeCount; node++) {
+		if (have[node] != all) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Collects the nodes src can hand a transfer to dst to so it travels the
+ * cheapest route: dst itself when they share a link, otherwise every
+ * neighbour of src the cheapest route continues from, lowest first. Returns
+ * how many.
+ */
+inline uint32_t
+collective_forwarders(const CollectiveTopology & topology,
+                      uint32_t src,
+                      uint32_t dst,
+                      uint32_t forwarders[kMaxRoutesPerDestination])
+{
+	const uint32_t cost = topology.cost(src, dst);
+	if (cost == kCollectiveCioHop || cost == kCollectiveNetworkHop) {
+		forwarders[0] = dst;
+		return 1;
+	}
+	uint32_t count = 0;
+	for (uint32_t hop = 0; hop < topology.nodeCount && count < kMaxRoutesPerDestination; hop++) {
+		const uint32_t first = topology.cost(src, hop);
+		if (hop != src && hop != dst && (first == kCollectiveCioHop || first == kCollectiveNetworkHop) &&
+		    first + topology.cost(hop, dst) == cost) {
+			forwarders[count++] = hop;
+		}
+	}
+	return count;
+}
+
+/**
+ * Returns the first node on the cheapest route from src to dst: dst itself
+ * when they share a link, otherwise the neighbour the route continues from.
+ * Traffic between partitions only crosses the network between peers, so a
+ * transfer to any other node of a partition is forwarded by the peer.
+ */
+inline uint32_t
+collective_next_hop(const CollectiveTopology & topology, uint32_t src, uint32_t dst)
+{
+	uint32_t forwarders[kMaxRoutesPerDestination];
+	return collective_forwarders(topology, src, dst, forwarders) > 0 ? forwarders[0] : dst;
+}
+
+/**
+ * Picks the first hop of the transfer between every pair of nodes, like
+ * collective_next_hop, but spreads the two hop transfers over all of their
+ * cheapest routes so every node relays about as many as the others. hops is
+ * indexed src * nodeCount + dst. It only depends on the topology, so every
+ * node picks the same hops.
+ */
+inline void
+collective_balanced_hops(const CollectiveTopology & topology, uint32_t hops[kMaxCollectiveNodes * kMaxCollectiveNodes])
+{
+	const uint32_t nodeCount            = topology.nodeCount;
+	uint32_t loads[kMaxCollectiveNodes] = {};
+	uint32_t forwarders[kMaxRoutesPerDestination];
+
+	// Hand every transfer to the least loaded of its relays first, then move
+	// transfers while that lowers the busiest relay. Every move shrinks the
+	// sum of the squared loads, so this ends.
+	for (uint32_t src = 0; src < nodeCount; src++) {
+		for (uint32_t dst = 0; dst < nodeCount; dst++) {
+			const uint32_t count = src == dst ? 0 : collective_forwarders(topology, src, dst, forwarders);
+			uint32_t hop         = count > 0 ? forwarders[0] : dst;
+			for (uint32_t i = 1; i < count; i++) {
+				hop = loads[forwarders[i]] < loads[hop] ? forwarders[i] : hop;
+			}
+			hops[src * nodeCount + dst] = hop;
+			loads[hop] += hop != dst;
+		}
+	}
+	for (bool moved = true; moved;) {
+		moved = false;
+		for (uint32_t src = 0; src < nodeCount; src++) {
+			for (uint32_t dst = 0; dst < nodeCount; dst++) {
+				uint32_t & hop = hops[src * nodeCount + dst];
+				if (hop == dst) {
+					continue;
+				}
+				const uint32_t count = collective_forwarders(topology, src, dst, forwarders);
+				for (uint32_t i = 0; i < count; i++) {
+					if (loads[forwarders[i]] + 1 < loads[hop]) {
+						loads[hop]--;
+						hop = forwarders[i];
+						loads[hop]++;
+						moved = true;
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Counts the chunks every node forwards for the others when every node
+ * sends chunksPerPair chunks to every other, each source splitting its chunks
+ * over up to maxRoutes of the cheapest routes. With one route this is what
+ * collective_next_hop routing does.
+ */
+inline void
+mesh_forward_loads(const CollectiveTopology & topology,
+                   uint32_t chunksPerPair,
+                   uint32_t maxRoutes,
+                   uint64_t loads[kMaxCollectiveNodes])
+{
+	for (uint32_t node = 0; node < topology.nodeCount; node++) {
+		loads[node] = 0;
+	}
+	// One source at a time, the channels are named after the neighbour they
+	// lead to.
+	MultiPathRoutes<kMaxCollectiveNodes, kMaxCollectiveNodes> routes = {};
+	for (uint32_t src = 0; src < topology.nodeCount; src++) {
+		routes.clear();
+		for (uint32_t dst = 0; dst < topology.nodeCount; dst++) {
+			uint32_t forwarders[kMaxRoutesPerDestination];
+			const uint32_t count = dst == src ? 0 : collective_forwarders(topology, src, dst, forwarders);
+			for (uint32_t i = 0; i < count && i < maxRoutes; i++) {
+				routes.addRoute(dst, (int32_t)forwarders[i], forwarders[i]);
+			}
+		}
+		for (uint32_t dst = 0; dst < topology.nodeCount; dst++) {
+			for (uint32_t chunk = 0; chunk < chunksPerPair && routes.routeCount(dst) > 0; chunk++) {
+				const uint32_t forwarder = routes.route(dst, (uint32_t)routes.routeForChunk(dst, chunk)).forwarder;
+				if (forwarder != dst) {
+					loads[forwarder]++;
+				}
+			}
+		}
+	}
+}
+
+// A rough model of the links: every CIO link between two neighbours and the
+// network port of every node move data at these rates, and each transfer
+// waits for the latency of every hop on its route.
+struct CollectiveLinkModel {
+	double cioBytesPerSecond;
+	double networkBytesPerSecond;
+	double cioHopLatency;
+	double networkLatency;
+};
+
+// Two CIO links per neighbour and a 100Gb network port.
+constexpr CollectiveLinkModel kDefaultCollectiveLinkModel = {10e9, 12.5e9, 2e-6, 15e-6};
+
+/**
+ * Estimates the seconds a schedule takes with blocks of blockSize. Every
+ * transfer is charged to each CIO link and network port along its route, and
+ * a step takes as long as its busiest link plus its longest route latency.
+ */
+inline double
+estimate_collective_time(const CollectiveSchedule & schedule,
+                         const CollectiveTopology & topology,
+                         uint64_t blockSize,
+                         const CollectiveLinkModel & model = kDefaultCollectiveLinkModel)
+{
+	static_assert(kMaxCollectiveNodes <= 32, "link loads are kept on the stack");
+	double total = 0;
+	for (uint32_t step = 0; step < schedule.stepCount; step++) {
+		double cio[kMaxCollectiveNodes][kMaxCollectiveNodes] = {};
+		double netOut[kMaxCollectiveNodes] = {}, netIn[kMaxCollectiveNodes] = {};
+		double latency = 0;
+		for (uint32_t t = schedule.step_begin(step); t < schedule.stepEnd[step]; t++) {
+			const CollectiveTransfer & transfer = schedule.transfers[t];
+			const double bytes                  = (double)blockSize * __builtin_popcountll(transfer.blocks);
+			double routeLatency                 = 0;
+			for (uint32_t at = transfer.src, hops = 0; at != transfer.dst && hops < schedule.nodeCount; hops++) {
+				const uint32_t next = collective_next_hop(topology, at, transfer.dst);
+				if (topology.cost(at, next) >= kCollectiveNetworkHop) {
+					netOut[at] += bytes;
+					netIn[next] += bytes;
+					routeLatency += model.networkLatency;
+				} else {
+					cio[at][next] += bytes;
+					routeLatency += model.cioHopLatency;
+				}
+				at = next;
+			}
+			latency = routeLatency > latency ? routeLatency : latency;
+		}
+		double busiest = 0;
+		for (uint32_t node = 0; node < schedule.nodeCount; node++) {
+			const double net = (netOut[node] > netIn[node] ? netOut[node] : netIn[node]) / model.networkBytesPerSecond;
+			busiest          = net > busiest ? net : busiest;
+			for (uint32_t peer = 0; peer < schedule.nodeCount; peer++) {
+				const double link = cio[node][peer] / model.cioBytesPerSecond;
+				busiest           = link > busiest ? link : busiest;
+			}
+		}
+		total += busiest + latency;
+	}
+	return total;
+}
+
+/**
+ * Picks the algorithm with the lowest estimated time for blocks of blockSize
+ * and leaves its schedule in schedule. Returns false if none works for the
+ * topology.
+ */
+inline bool
+select_collective_algorithm(const CollectiveTopology & topology,
+                            uint64_t blockSize,
+                            CollectiveSchedule * schedule,
+                            const CollectiveLinkModel & model = kDefaultCollectiveLinkModel)
+{
+	CollectiveAlgorithm best = kCollectiveAlgorithmCount;
+	double bestTime          = 0;
+	for (uint32_t i = 0; i < kCollectiveAlgorithmCount; i++) {
+		if (!build_collective_schedule((CollectiveAlgorithm)i, topology, schedule)) {
+			continue;
+		}
+		const double time = estimate_collective_time(*schedule, topology, blockSize, model);
+		if (best == kCollectiveAlgorithmCount || time < bestTime) {
+			best     = (CollectiveAlgorithm)i;
+			bestTime = time;
+		}
+	}
+	return best != kCollectiveAlgorithmCount && build_collective_schedule(best, topology, schedule);
+}
+
+} // namespace AppleCIOMeshUtils
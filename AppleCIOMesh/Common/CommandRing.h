@@ -0,0 +1,376 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// What a command asks the driver to do. The values are shared with user space,
+// only ever add to the end.
+enum MeshCommandOp : uint8_t {
+	// Sends the assignment at sendBufferId/sendOffset, like Trap::SendAssignedData.
+	kMeshCommandSend = 1,
+	// Prepares the assignment at prepareBufferId/prepareOffset, like
+	// Trap::PrepareChunk.
+	kMeshCommandPrepare = 2,
+	// Sends and then prepares, like Trap::SendAndPrepareChunk.
+	kMeshCommandSendAndPrepare = 3,
+};
+
+// Room for one tag per link of a channel.
+static constexpr uint32_t kMeshCommandTagBytes = 32;
+
+// The most entries a ring can have, each side keeps its own copy of the size
+// so this only bounds what the driver agrees to map.
+static constexpr uint32_t kMaxCommandRingEntries = 4096;
+
+// One entry of the submission ring. userData is handed back untouched in the
+// completion.
+struct MeshCommand {
+	uint64_t userData;
+	int64_t sendBufferId;
+	int64_t sendOffset;
+	int64_t prepareBufferId;
+	int64_t prepareOffset;
+	uint8_t op;
+	uint8_t reserved[7];
+	char tags[kMeshCommandTagBytes];
+};
+
+// The command was not run because an earlier one in the same submission
+// failed.
+static constexpr uint32_t kMeshCompletionSkipped = 0x1;
+
+// One entry of the completion ring. status is what the command returned, 0
+// on success.
+struct MeshCompletion {
+	uint64_t userData;
+	int32_t status;
+	uint32_t flags;
+};
+
+// The start of the ring memory. Each side only writes its own line, the
+// submitter the submission tail and completion head, the driver the
+// submission head and completion tail.
+struct CommandRingHeader {
+	uint32_t entries;
+	uint32_t reserved0[15];
+	uint32_t sqTail;
+	uint32_t cqHead;
+	uint32_t reserved1[14];
+	uint32_t sqHead;
+	uint32_t cqTail;
+	uint32_t reserved2[14];
+};
+
+static_assert(sizeof(MeshCommand) == 80, "MeshCommand is shared with the driver");
+static_assert(sizeof(MeshCompletion) == 16, "MeshCompletion is shared with the driver");
+static_assert(sizeof(CommandRingHeader) == 192, "CommandRingHeader is shared with the driver");
+
+/**
+ * How many bytes a ring of this many entries takes: the header, then the
+ * submission entries, then the completion entries.
+ */
+inline uint64_t
+command_ring_size(uint32_t entries)
+{
+	return sizeof(CommandRingHeader) + (uint64_t)entries * (sizeof(MeshCommand) + sizeof(MeshCompletion));
+}
+
+// What CommandRing::drain did.
+struct CommandRingDrainResult {
+	// Commands taken off the submission ring and completed, skipped or not.
+	uint32_t completed;
+	// The status of the first command that failed, 0 if none did.
+	int32_t status;
+	// The completion ring filled up, what is left stays submitted.
+	bool full;
+	// The submission tail is further ahead than the ring is long.
+	bool corrupt;
+};
+
+// A submission ring and a completion ring in one block of memory shared by a
+// submitter and the driver, so a whole sync's commands go in with a single
+// doorbell and their results come back without another crossing. Both rings
+// are single producer, single consumer and have the same number of entries,
+// a power of two. The indices run freely and are masked on use.
+//
+// The submitter calls init, submit and reap, the driver calls attach, take,
+// complete and drain. Each side keeps its own indices and size and only reads
+// the other side's index out of the shared memory, which it checks before
+// trusting, so nothing the other side writes can make it step outside the
+// rings.
+class CommandRing
+{
+	CommandRingHeader * _header;
+	MeshCommand * _commands;
+	MeshCompletion * _completions;
+	uint32_t _entries;
+	// The submitter's indices.
+	uint32_t _sqTail;
+	uint32_t _cqHead;
+	// The driver's indices.
+	uint32_t _sqHead;
+	uint32_t _cqTail;
+
+	bool
+	setup(void * memory, uint64_t size, uint32_t entries)
+	{
+		if (memory == nullptr || !validEntries(entries) || size < command_ring_size(entries)) {
+			return false;
+		}
+		_header      = (CommandRingHeader *)memory;
+		_commands    = (MeshCommand *)(_header + 1);
+		_completions = (MeshCompletion *)(_commands + entries);
+		_entries     = entries;
+		_sqTail      = 0;
+		_cqHead      = 0;
+		_sqHead      = 0;
+		_cqTail      = 0;
+		return true;
+	}
+
+  public:
+	CommandRing()
+	    : _header(nullptr), _commands(nullptr), _completions(nullptr), _entries(0), _sqTail(0), _cqHead(0), _sqHead(0),
+	      _cqTail(0)
+	{
+	}
+
+	static bool
+	validEntries(uint32_t entries)
+	{
+		return entries != 0 && entries <= kMaxCommandRingEntries && (entries & (entries - 1)) == 0;
+	}
+
+	/**
+	 * Lays out an empty ring in memory. Called by the submitter before handing
+	 * the memory to the driver.
+	 */
+	bool
+	init(void * memory, uint64_t size, uint32_t entries)
+	{
+		if (!setup(memory, size, entries)) {
+			return false;
+		}
+		memset(memory, 0, sizeof(CommandRingHeader));
+		_header->entries = entries;
+		return true;
+	}
+
+	/**
+	 * Takes over the driver's side of a ring the submitter laid out with
+	 * init. entries is what the submitter asked for, not what the header says.
+	 */
+	bool
+	attach(void * memory, uint64_t size, uint32_t entries)
+	{
+		if (!setup(memory, size, entries)) {
+			return false;
+		}
+		__atomic_store_n(&_header->sqHead, 0, __ATOMIC_RELEASE);
+		__atomic_store_n(&_header->cqTail, 0, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	void
+	detach()
+	{
+		_header      = nullptr;
+		_commands    = nullptr;
+		_completions = nullptr;
+		_entries     = 0;
+	}
+
+	bool
+	isAttached() const
+	{
+		return _header != nullptr;
+	}
+
+	uint32_t
+	entries() const
+	{
+		return _entries;
+	}
+
+	// MARK: - Submitter
+
+	/**
+	 * How many commands can be submitted before the driver takes some.
+	 */
+	uint32_t
+	submissionSpace() const
+	{
+		return _entries - (_sqTail - __atomic_load_n(&_header->sqHead, __ATOMIC_ACQUIRE));
+	}
+
+	/**
+	 * Queues as many of the commands as fit and makes them visible to the
+	 * driver at once. Returns how many were queued.
+	 */
+	uint32_t
+	submit(const MeshCommand * commands, uint32_t count)
+	{
+		const uint32_t space = submissionSpace();
+		if (count > space) {
+			count = space;
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			_commands[(_sqTail + i) & (_entries - 1)] = commands[i];
+		}
+		_sqTail += count;
+		__atomic_store_n(&_header->sqTail, _sqTail, __ATOMIC_RELEASE);
+		return count;
+	}
+
+	/**
+	 * Commands submitted that the driver has not completed yet.
+	 */
+	uint32_t
+	inFlight() const
+	{
+		return _sqTail - __atomic_load_n(&_header->cqTail, __ATOMIC_ACQUIRE);
+	}
+
+	/**
+	 * Copies out up to max completions in the order the commands were
+	 * submitted and frees their entries. Returns how many were copied.
+	 */
+	uint32_t
+	reap(MeshCompletion * completions, uint32_t max)
+	{
+		const uint32_t tail = __atomic_load_n(&_header->cqTail, __ATOMIC_ACQUIRE);
+		uint32_t count      = tail - _cqHead;
+		if (count > max) {
+			count = max;
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			completions[i] = _completions[(_cqHead + i) & (_entries - 1)];
+		}
+		_cqHead += count;
+		__atomic_store_n(&_header->cqHead, _cqHead, __ATOMIC_RELEASE);
+		return count;
+	}
+
+	// MARK: - Driver
+
+	/**
+	 * How many commands are waiting. Returns false if the submitter's tail
+	 * makes no sense, in which case nothing should be taken.
+	 */
+	bool
+	pending(uint32_t * count) const
+	{
+		const uint32_t waiting = __atomic_load_n(&_header->sqTail, __ATOMIC_ACQUIRE) - _sqHead;
+		if (waiting > _entries) {
+			*count = 0;
+			return false;
+		}
+		*count = waiting;
+		return true;
+	}
+
+	/**
+	 * How many completions can be posted before the submitter reaps some. A
+	 * head that makes no sense leaves no room.
+	 */
+	uint32_t
+	completionSpace() const
+	{
+		const uint32_t used = _cqTail - __atomic_load_n(&_header->cqHead, __ATOMIC_ACQUIRE);
+		return used > _entries ? 0 : _entries - used;
+	}
+
+	/**
+	 * Copies the next command out of the ring. The copy is what gets checked
+	 * and run, the submitter can't change it afterwards. The entry is only
+	 * given back to the submitter once its completion is posted.
+	 */
+	bool
+	take(MeshCommand * command)
+	{
+		uint32_t count;
+		if (!pending(&count) || count == 0) {
+			return false;
+		}
+		*command = _commands[_sqHead & (_entries - 1)];
+		return true;
+	}
+
+	/**
+	 * Posts the completion of the command take returned and retires it.
+	 * Returns false if the completion ring is full, the command stays put.
+	 */
+	bool
+	complete(uint64_t userData, int32_t status, uint32_t flags)
+	{
+		if (completionSpace() == 0) {
+			return false;
+		}
+		_completions[_cqTail & (_entries - 1)] = {userData, status, flags};
+		_cqTail++;
+		_sqHead++;
+		__atomic_store_n(&_header->cqTail, _cqTail, __ATOMIC_RELEASE);
+		__atomic_store_n(&_header->sqHead, _sqHead, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/**
+	 * Runs every submitted command through execute, oldest first, and posts a
+	 * completion for each. execute returns 0 for success. The commands of a
+	 * submission depend on each other, so once one fails the rest are
+	 * completed with skippedStatus and kMeshCompletionSkipped without being
+	 * run. Stops early if the completion ring is full.
+	 */
+	template <typename Execute>
+	CommandRingDrainResult
+	drain(Execute && execute, int32_t skippedStatus)
+	{
+		CommandRingDrainResult result = {0, 0, false, false};
+		uint32_t count;
+		if (!pending(&count)) {
+			result.corrupt = true;
+			return result;
+		}
+
+		for (uint32_t i = 0; i < count; i++) {
+			if (completionSpace() == 0) {
+				result.full = true;
+				break;
+			}
+			MeshCommand command;
+			if (!take(&command)) {
+				break;
+			}
+			if (result.status != 0) {
+				complete(command.userData, skippedStatus, kMeshCompletionSkipped);
+			} else {
+				const int32_t status = execute(command);
+				complete(command.userData, status, 0);
+				result.status = status;
+			}
+			result.completed++;
+		}
+		return result;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,341 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// What a CommandeerWork asks the commandeer thread to do.
+enum CommandeerWorkType : uint8_t {
+	// Send object (a shared memory) at offset on the second link and tell
+	// owner (the user client) once it is out. tags holds tagSize bytes.
+	kCommandeerSend = 1,
+	// Drip prepare all of object (a shared memory) once other (the shared
+	// memory being sent) has received everything. offset says how much.
+	kCommandeerDripPrepare = 2,
+	// Prepare object (an assignment) on link for other (its node's assignment
+	// map). offset is when the prepare was asked for.
+	kCommandeerBulkPrepare = 3,
+	// Prepare object (a forward chain element).
+	kCommandeerForwardPrepare = 5,
+};
+
+// Room for a send's tags, they are copied so the sender's copy may go away.
+static constexpr uint32_t kCommandeerTagBytes = 32;
+
+// One piece of work for the commandeer thread. Only the fields its type
+// mentions mean anything, the owner decides what the pointers are.
+struct CommandeerWork {
+	uintptr_t object;
+	uintptr_t other;
+	uintptr_t owner;
+	int64_t offset;
+	uint32_t tagSize;
+	uint8_t type;
+	uint8_t link;
+	char tags[kCommandeerTagBytes];
+};
+
+// How the commandeer drains its queue.
+//
+// While a send, drip prepare or forward help is in progress the commandeer
+// goes back to it after every busyBatch items so that its latency doesn't
+// depend on how much is queued. Otherwise it takes up to idleBatch at a time.
+// Once there has been nothing to do for spinBeforePark (in whatever clock
+// the owner uses) it parks until a producer wakes it.
+struct CommandeerPolicy {
+	uint32_t busyBatch;
+	uint32_t idleBatch;
+	uint64_t spinBeforePark;
+};
+
+// Counters for dumping the commandeer's state.
+struct CommandeerStats {
+	uint64_t pushed;
+	uint64_t full;
+	uint64_t popped;
+	uint64_t batches;
+	uint64_t parks;
+	uint64_t wakeups;
+};
+
+// The commandeer's work queue. Any number of producers push, the commandeer
+// thread is the only one that pops. It is a bounded queue with a sequence
+// number per cell, so a push is one compare and swap and a pop is plain
+// loads and stores.
+//
+// Parking, with whatever sleep/wakeup the owner has:
+//   commandeer                           producer
+//     beginPark()                          push(work)
+//     if (empty() && nothing else)         if (needsWake())
+//         sleep                                wakeup
+//     endPark()
+// Either the commandeer sees the work or the producer sees it parked. The
+// owner's sleep must not miss a wakeup that comes between the check and the
+// sleep, e.g. by holding the lock the wakeup takes.
+//
+// Allocator provides
+//   template <typename U> static U * allocate(uint32_t count);
+//   template <typename U> static void deallocate(U * memory, uint32_t count);
+template <typename Allocator> class CommandeerQueue
+{
+	struct Cell {
+		uint64_t sequence;
+		CommandeerWork work;
+	};
+
+	// Producers and the commandeer each get their own line.
+	alignas(64) uint64_t _enqueue;
+	alignas(64) uint64_t _dequeue;
+	uint64_t _idleSince;
+	alignas(64) uint32_t _parked;
+
+	Cell * _cells;
+	uint32_t _entries;
+	CommandeerPolicy _policy;
+	CommandeerStats _stats;
+
+  public:
+	static constexpr uint32_t kMinEntries = 2;
+	static constexpr uint32_t kMaxEntries = 1u << 20;
+
+	static bool
+	validEntries(uint32_t entries)
+	{
+		return entries >= kMinEntries && entries <= kMaxEntries && (entries & (entries - 1)) == 0;
+	}
+
+	CommandeerQueue() : _enqueue(0), _dequeue(0), _idleSince(0), _parked(0), _cells(nullptr), _entries(0), _policy(), _stats()
+	{
+	}
+	~CommandeerQueue() { reset(); }
+
+	CommandeerQueue(const CommandeerQueue &)             = delete;
+	CommandeerQueue & operator=(const CommandeerQueue &) = delete;
+
+	/**
+	 * Allocates room for entries items, a power of two. Returns false if
+	 * entries is invalid or the cells can't be allocated.
+	 */
+	bool
+	init(uint32_t entries, const CommandeerPolicy & policy)
+	{
+		if (_cells != nullptr || !validEntries(entries) || policy.busyBatch == 0 || policy.idleBatch == 0) {
+			return false;
+		}
+		_cells = Allocator::template allocate<Cell>(entries);
+		if (_cells == nullptr) {
+			return false;
+		}
+		for (uint32_t i = 0; i < entries; i++) {
+			_cells[i].sequence = i;
+		}
+		_entries   = entries;
+		_policy    = policy;
+		_enqueue   = 0;
+		_dequeue   = 0;
+		_idleSince = 0;
+		_parked    = 0;
+		_stats     = CommandeerStats();
+		return true;
+	}
+
+	/**
+	 * Frees the cells. Nobody may be pushing or popping.
+	 */
+	void
+	reset()
+	{
+		if (_cells != nullptr) {
+			Allocator::template deallocate<Cell>(_cells, _entries);
+		}
+		_cells   = nullptr;
+		_entries = 0;
+	}
+
+	uint32_t
+	entries() const
+	{
+		return _entries;
+	}
+
+	const CommandeerPolicy &
+	policy() const
+	{
+		return _policy;
+	}
+
+	/**
+	 * Queues work. Returns false if the queue is full, the work is not queued.
+	 * Safe from any thread.
+	 */
+	bool
+	push(const CommandeerWork & work)
+	{
+		const uint64_t mask = _entries - 1;
+		uint64_t position   = __atomic_load_n(&_enqueue, __ATOMIC_RELAXED);
+		Cell * cell;
+
+		for (;;) {
+			cell                    = &_cells[position & mask];
+			const uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+			const int64_t diff      = (int64_t)(sequence - position);
+			if (diff == 0) {
+				if (__atomic_compare_exchange_n(&_enqueue, &position, position + 1, true, __ATOMIC_RELAXED,
+				                                __ATOMIC_RELAXED)) {
+					break;
+				}
+			} else if (diff < 0) {
+				// The commandeer hasn't taken this cell's last item yet.
+				__atomic_fetch_add(&_stats.full, 1, __ATOMIC_RELAXED);
+				return false;
+			} else {
+				position = __atomic_load_n(&_enqueue, __ATOMIC_RELAXED);
+			}
+		}
+
+		cell->work = work;
+		// Sequentially consistent so that it and the load in needsWake can't
+		// pass the store and load in beginPark and empty.
+		__atomic_store_n(&cell->sequence, position + 1, __ATOMIC_SEQ_CST);
+		__atomic_fetch_add(&_stats.pushed, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	/**
+	 * Whether the producer that just pushed has to wake the commandeer.
+	 */
+	bool
+	needsWake()
+	{
+		if (__atomic_load_n(&_parked, __ATOMIC_SEQ_CST) == 0) {
+			return false;
+		}
+		__atomic_fetch_add(&_stats.wakeups, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	/**
+	 * How many items the commandeer should take next, see CommandeerPolicy.
+	 */
+	uint32_t
+	batchLimit(bool busy) const
+	{
+		return busy ? _policy.busyBatch : _policy.idleBatch;
+	}
+
+	/**
+	 * Takes up to max items in the order they were pushed. Only the commandeer
+	 * may call this. A push that is still being written ends the batch early.
+	 */
+	uint32_t
+	pop(CommandeerWork * out, uint32_t max)
+	{
+		const uint64_t mask = _entries - 1;
+		uint32_t count      = 0;
+
+		while (count < max) {
+			Cell * cell = &_cells[_dequeue & mask];
+			if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != _dequeue + 1) {
+				break;
+			}
+			out[count++] = cell->work;
+			__atomic_store_n(&cell->sequence, _dequeue + _entries, __ATOMIC_RELEASE);
+			_dequeue++;
+		}
+
+		if (count > 0) {
+			__atomic_store_n(&_stats.popped, _stats.popped + count, __ATOMIC_RELAXED);
+			__atomic_store_n(&_stats.batches, _stats.batches + 1, __ATOMIC_RELAXED);
+		}
+		return count;
+	}
+
+	/**
+	 * Whether there is nothing to pop. Only the commandeer may call this.
+	 */
+	bool
+	empty() const
+	{
+		return __atomic_load_n(&_cells[_dequeue & (_entries - 1)].sequence, __ATOMIC_SEQ_CST) != _dequeue + 1;
+	}
+
+	/**
+	 * Called by the commandeer once per pass with whether it did anything.
+	 * Returns true once it has been idle for spinBeforePark.
+	 */
+	bool
+	shouldPark(bool idle, uint64_t now)
+	{
+		if (!idle) {
+			_idleSince = 0;
+			return false;
+		}
+		// Kept one ahead of now so that zero means not idle.
+		if (_idleSince == 0) {
+			_idleSince = now + 1;
+			return false;
+		}
+		return now + 1 - _idleSince >= _policy.spinBeforePark;
+	}
+
+	/**
+	 * The commandeer is about to check for work one last time and sleep.
+	 */
+	void
+	beginPark()
+	{
+		__atomic_store_n(&_parked, 1, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&_stats.parks, _stats.parks + 1, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * The commandeer is awake again, or decided not to sleep after all.
+	 */
+	void
+	endPark()
+	{
+		__atomic_store_n(&_parked, 0, __ATOMIC_RELAXED);
+		_idleSince = 0;
+	}
+
+	bool
+	parked() const
+	{
+		return __atomic_load_n(&_parked, __ATOMIC_RELAXED) != 0;
+	}
+
+	/**
+	 * A snapshot of the counters, they are not read atomically together.
+	 */
+	CommandeerStats
+	stats() const
+	{
+		CommandeerStats stats;
+		stats.pushed  = __atomic_load_n(&_stats.pushed, __ATOMIC_RELAXED);
+		stats.full    = __atomic_load_n(&_stats.full, __ATOMIC_RELAXED);
+		stats.popped  = __atomic_load_n(&_stats.popped, __ATOMIC_RELAXED);
+		stats.batches = __atomic_load_n(&_stats.batches, __ATOMIC_RELAXED);
+		stats.parks   = __atomic_load_n(&_stats.parks, __ATOMIC_RELAXED);
+		stats.wakeups = __atomic_load_n(&_stats.wakeups, __ATOMIC_RELAXED);
+		return stats;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -33,8 +33,14 @@ const uint32_t kControlInterruptStride = 32;
 const size_t kCIOPageAlignmentLeadingZeroBits  = 14;
 const size_t kCIOFrameAlignmentLeadingZeroBits = 12;
 
+// How many tags SendAllAssignedChunks takes, one per assignment.
 const size_t kMaxAssignmentCount = 512;
 
+// Assignment maps grow kAssignmentSegmentSize entries at a time, up to
+// kMaxAssignmentSegments segments.
+const uint32_t kAssignmentSegmentSize = 256;
+const uint32_t kMaxAssignmentSegments = 64;
+
 // The real trailer size.
 const uint32_t kTrailerSize = 256;
 // The trailer size in frames to avoid double buffering in NHI.
@@ -63,8 +69,39 @@ const uint32_t kCommandMessageDataSize = kCommandBufferSize - kCommandSize;
 const uint32_t kSOF                    = 1;
 const uint32_t kEOF                    = 2;
 
-const uint32_t kNumBulkPrepare         = 0xFF;
-const uint64_t kMaxCommandeerWaitCount = 100'000'000;
+// The commandeer's work queue, see Common/CommandeerQueue.h. It holds what the
+// bulk, pending and forward prepare queues used to, and the sends and drip
+// prepares callers used to spin for.
+const uint32_t kCommandeerQueueEntries     = 2048;
+const uint32_t kCommandeerBusyBatch        = 4;
+const uint32_t kCommandeerIdleBatch        = 32;
+const uint64_t kCommandeerSpinBeforeParkNs = 50'000;
+const uint32_t kCommandeerParkTimeoutMs    = 100;
+
+// How far ahead of each link a runtime prepared buffer is prepared, see
+// Common/DripPrepareController.h. The link's queue budget still caps it, and a
+// completion asks for at most kDripPrepareMaxBatch prepares at once.
+const uint32_t kDripPrepareMinDepth    = 2;
+const uint32_t kDripPrepareMaxBoost    = 64;
+const uint32_t kDripPrepareCalmReadies = 128;
+const uint64_t kDripPrepareIdleGapNs   = 10'000'000;
+const uint32_t kDripPrepareMaxBatch    = 8;
+
+// How each link's data path rings are sized from the traffic they carried,
+// see Common/CoalescingPolicy.h. Rings never grow past kTxRingSize and
+// kRxRingSize, and never shrink below one kMaxChunkSizePerLink chunk. Runtime
+// prepare, prepare ahead and the forwarder queue at most what the link's rings
+// hold, and never more than kMaxNHIQueueByteSize, see
+// AppleCIOMeshLink::getQueueBytes. A new sizing applies when the link's data
+// paths are next created, and the ring size and interrupt stride boot-args
+// still win.
+const uint32_t kCoalescingMinRingSize   = 256;
+const uint32_t kCoalescingMinStride     = 1;
+const uint32_t kCoalescingMaxStride     = 512;
+const uint64_t kCoalescingWindowNs      = 1'000'000;
+const uint32_t kCoalescingMaxInterrupts = 50;
+const uint64_t kCoalescingRingCoverNs   = 2'000'000;
+const uint32_t kCoalescingSwitchWindows = 8;
 
 const uint32_t kLinkEventSize     = 32;
 const uint32_t kLinkEventDataSize = kLinkEventSize - 4;
@@ -78,20 +115,25 @@ const uint32_t kMaxCIOMeshNodes = 8;
 const uint32_t kMaxExtendedMeshNodes = 32;
 #define MAX_NODES_DEFINED 1
 
-const uint32_t kForwardNodeCount       = 3;
-const uint32_t kMaxForwardAction       = 3072;
-const uint32_t kMaxForwardChainElement = kMaxForwardAction / kForwardNodeCount;
-const uint32_t kForwardQueueCount      = 0xFF;
+const uint32_t kForwardNodeCount = 3;
+// Forward actions, chain elements and chain groups are allocated a slab at a
+// time as buffers are set up, for as long as there is memory for them.
+const uint32_t kForwardActionSlabSize       = 128 * kForwardNodeCount;
+const uint32_t kForwardChainElementSlabSize = 128;
+const uint32_t kForwardChainGroupSlabSize   = 16;
+const uint32_t kForwardQueueCount           = 0xFF;
 
 // note: if this ever changes, also go update AppleCIOMeshAPIPrivate.h
-const uint32_t kMaxPartitions            = 4;
-const uint32_t kMaxForwardElementActions = 256 * kMaxPartitions; // 128 Chunks/Block * 2 Links/Channel is the max.
-const uint32_t kMaxForwardChainGroup     = kMaxForwardChainElement;
+const uint32_t kMaxPartitions = 4;
 
-const uint32_t kMaxForwardChains = 128;
+// Every ForwardChainId.
+const uint32_t kMaxForwardChains = 256;
 
 const uint32_t kTagSize = 16;
 
+// Commands a handle's command ring holds before it has to be submitted.
+const uint32_t kMeshCommandRingEntries = 256;
+
 const uint64_t kMaxSecondsPerCryptoKey = 86400;
 const uint64_t kMaxBuffersPerCryptoKey = 1000000;
 
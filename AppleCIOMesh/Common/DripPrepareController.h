@@ -0,0 +1,239 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// What depth() returns before the controller has seen enough to size it. The
+// caller's own limit (the NHI queue size) is all that applies then.
+static constexpr uint32_t kDripPrepareUnbounded = UINT32_MAX;
+
+// How a DripPrepareController sizes the prepare-ahead depth.
+//
+// minDepth is the least it keeps prepared ahead of the link, two keeps one
+// step on the ring while the next is prepared. A step that completes with
+// nothing prepared behind it grows a boost on top of the estimate, up to
+// maxBoost steps, and calmReadies steps in a row that did not starve take
+// one step off it again. Gaps between ready steps longer than idleGap (in
+// whatever clock the owner uses) are not traffic and do not count towards
+// the arrival rate.
+struct DripPreparePolicy {
+	uint32_t minDepth;
+	uint32_t maxBoost;
+	uint32_t calmReadies;
+	uint64_t idleGap;
+};
+
+// Counters for dumping a controller's state.
+struct DripPrepareStats {
+	uint64_t readies;
+	uint64_t starved;
+	uint64_t prepares;
+	uint64_t interval;
+	uint64_t lead;
+	uint32_t boost;
+};
+
+// Sizes how far ahead of a link the steps of a runtime prepared buffer (an
+// assignment's chunks on one link) are prepared.
+//
+// The link needs its next step prepared by the time the current one is done,
+// and a prepare requested when a step completes takes the lead time to land.
+// Keeping depth steps ahead leaves (depth - 1) steps on the ring when one
+// completes, so
+//     depth = 1 + (lead + 4 * leadDeviation) / interval + boost
+// where interval is how often steps complete and lead and its deviation are
+// smoothed like a round trip time. Preparing further ahead only ties up ring
+// slots and NHI queue space.
+//
+// recordReady is called where a step completes and recordPrepared where its
+// replacement has been prepared, these may be different threads. Either may
+// call depth() and canPrepare().
+class DripPrepareController
+{
+	DripPreparePolicy _policy;
+
+	// Owned by recordReady.
+	uint64_t _lastReady;
+	bool _lastStarved;
+	uint32_t _calm;
+	uint64_t _readies;
+	uint64_t _starved;
+
+	// Owned by recordPrepared.
+	uint64_t _prepares;
+
+	// Read by depth() from any thread.
+	uint64_t _interval;
+	uint64_t _lead;
+	uint64_t _leadDeviation;
+	uint32_t _boost;
+
+	static uint64_t
+	_load(const uint64_t & value)
+	{
+		return __atomic_load_n(&value, __ATOMIC_RELAXED);
+	}
+
+	static void
+	_store(uint64_t & value, uint64_t newValue)
+	{
+		__atomic_store_n(&value, newValue, __ATOMIC_RELAXED);
+	}
+
+	// Moves average 1/2^shift of the way to sample.
+	static uint64_t
+	_smooth(uint64_t average, uint64_t sample, uint32_t shift)
+	{
+		if (average == 0) {
+			return sample;
+		}
+		return (uint64_t)((int64_t)average + (((int64_t)sample - (int64_t)average) >> shift));
+	}
+
+  public:
+	/**
+	 * Sets the policy and forgets everything learned so far.
+	 */
+	void
+	init(const DripPreparePolicy & policy)
+	{
+		_policy      = policy;
+		_lastReady   = 0;
+		_lastStarved = false;
+		_calm        = 0;
+		_readies     = 0;
+		_starved     = 0;
+		_prepares    = 0;
+		_store(_interval, 0);
+		_store(_lead, 0);
+		_store(_leadDeviation, 0);
+		__atomic_store_n(&_boost, 0, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * Starts another run of the buffer. What was learned is kept, the time
+	 * between the runs is not an arrival gap.
+	 */
+	void
+	restart()
+	{
+		_lastReady   = 0;
+		_lastStarved = false;
+	}
+
+	/**
+	 * A step completed at now. starved says nothing was prepared behind it, so
+	 * the link waits for a prepare.
+	 */
+	void
+	recordReady(uint64_t now, bool starved)
+	{
+		_readies++;
+
+		// A gap that ends a starved step includes the wait for the prepare,
+		// it says nothing about how fast the link goes.
+		if (_lastReady != 0 && !_lastStarved && now > _lastReady && now - _lastReady <= _policy.idleGap) {
+			_store(_interval, _smooth(_load(_interval), now - _lastReady, 3));
+		}
+		_lastReady   = now;
+		_lastStarved = starved;
+
+		uint32_t boost = __atomic_load_n(&_boost, __ATOMIC_RELAXED);
+		if (starved) {
+			_starved++;
+			_calm = 0;
+			boost = boost * 2 + 1;
+			if (boost > _policy.maxBoost) {
+				boost = _policy.maxBoost;
+			}
+		} else if (++_calm >= _policy.calmReadies) {
+			_calm = 0;
+			if (boost > 0) {
+				boost--;
+			}
+		}
+		__atomic_store_n(&_boost, boost, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * A prepare requested lead ago has landed.
+	 */
+	void
+	recordPrepared(uint64_t lead)
+	{
+		_prepares++;
+
+		const uint64_t average = _load(_lead);
+		if (average != 0) {
+			const uint64_t error = lead > average ? lead - average : average - lead;
+			_store(_leadDeviation, _smooth(_load(_leadDeviation), error, 2));
+		} else {
+			_store(_leadDeviation, lead / 2);
+		}
+		_store(_lead, _smooth(average, lead, 3));
+	}
+
+	/**
+	 * How many steps to keep prepared ahead of the link.
+	 */
+	uint32_t
+	depth() const
+	{
+		const uint64_t interval = _load(_interval);
+		const uint64_t lead     = _load(_lead);
+		if (interval == 0 || lead == 0) {
+			return kDripPrepareUnbounded;
+		}
+
+		const uint64_t cover = lead + 4 * _load(_leadDeviation);
+		uint64_t depth       = 1 + (cover + interval - 1) / interval + __atomic_load_n(&_boost, __ATOMIC_RELAXED);
+		if (depth < _policy.minDepth) {
+			depth = _policy.minDepth;
+		}
+		return depth < kDripPrepareUnbounded ? (uint32_t)depth : kDripPrepareUnbounded - 1;
+	}
+
+	/**
+	 * Whether another step should be prepared with ahead steps already
+	 * prepared and not yet completed. With none ahead the link would stall, so
+	 * that is always yes.
+	 */
+	bool
+	canPrepare(uint32_t ahead) const
+	{
+		return ahead == 0 || ahead < depth();
+	}
+
+	DripPrepareStats
+	stats() const
+	{
+		DripPrepareStats stats;
+		stats.readies  = _readies;
+		stats.starved  = _starved;
+		stats.prepares = _prepares;
+		stats.interval = _load(_interval);
+		stats.lead     = _load(_lead);
+		stats.boost    = __atomic_load_n(&_boost, __ATOMIC_RELAXED);
+		return stats;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,266 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include "Common/DripPrepareController.h"
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Steps a simulated run can have requested and not yet prepared, which is
+// as far ahead as the NHI queue lets a link get with the smallest steps.
+static constexpr uint32_t kMaxSimulatedPrepares = 4096;
+
+struct DripPrepareSimulationConfig {
+	// Steps (an assignment's chunks on one link) in the buffer and their size.
+	uint32_t steps;
+	uint64_t stepBytes;
+	// How many bytes may be prepared ahead of the link at once, the NHI
+	// queue size.
+	uint64_t maxAheadBytes;
+	double linkBytesPerSecond;
+	// Each step takes up to this fraction longer than the link rate says.
+	double linkJitter;
+	// A prepare waits prepareLatency, up to prepareJitter of that longer, for
+	// the commandeer to get to it and then takes prepareCost. The commandeer
+	// does one at a time. Every stallEvery prepares it is first busy with
+	// something else for stallTime.
+	double prepareLatency;
+	double prepareJitter;
+	double prepareCost;
+	uint32_t stallEvery;
+	double stallTime;
+	// How many prepares a completion may ask for at once.
+	uint32_t maxBatch;
+	// Whether the controller sizes the depth, otherwise it is only bounded by
+	// maxAheadBytes like before the controller.
+	bool adaptive;
+	DripPreparePolicy policy;
+	uint32_t seed;
+};
+
+// A 1 MB step on a 5 GB/s link with a commandeer that takes 20us to get to a
+// prepare and is held up for half a millisecond now and then.
+static constexpr DripPrepareSimulationConfig kDefaultDripPrepareSimulation = {
+    512, 1024 * 1024, 15 * 1024 * 1024, 5e9, 0.1, 20e-6, 0.5, 10e-6, 64, 500e-6, 8, true, {2, 64, 128, 10'000'000}, 1,
+};
+
+struct DripPrepareSimulationResult {
+	// From the first prepare to the last step completing.
+	double seconds;
+	// Steps that completed with the next one not prepared yet, and how long
+	// the link sat waiting for prepares after its first step.
+	uint64_t starved;
+	double waitSeconds;
+	// Steps requested and not yet completed, over time and at most.
+	double meanAhead;
+	uint32_t maxAhead;
+	uint32_t finalDepth;
+	// Something did not fit the simulator.
+	bool failed;
+
+	double
+	meanAheadBytes(uint64_t stepBytes) const
+	{
+		return meanAhead * (double)stepBytes;
+	}
+};
+
+// A deterministic discrete-event simulation of one link of a runtime
+// prepared buffer. The buffer's first steps are prepared up front, then
+// every completed step asks for more the way the kext's pending check does,
+// as far as the controller lets it. The controller is kept from one run to
+// the next, like an assignment map keeps it for its buffer.
+class DripPrepareSimulator
+{
+	DripPrepareController _controller;
+	DripPrepareSimulationConfig _config;
+
+	// When each requested and not yet prepared step was asked for and will
+	// be prepared, in order.
+	double _requestedAt[kMaxSimulatedPrepares];
+	double _preparedAt[kMaxSimulatedPrepares];
+	uint32_t _pendingHead;
+	uint32_t _pendingCount;
+	double _commandeerFree;
+	uint32_t _prepareCount;
+	uint32_t _random;
+
+	double
+	_uniform()
+	{
+		_random = _random * 1103515245 + 12345;
+		return (double)((_random >> 8) & 0xFFFF) / 65536.0;
+	}
+
+	bool
+	_request(double now)
+	{
+		if (_pendingCount == kMaxSimulatedPrepares) {
+			return false;
+		}
+
+		double start = now + _config.prepareLatency * (1 + _config.prepareJitter * _uniform());
+		if (start < _commandeerFree) {
+			start = _commandeerFree;
+		}
+		_prepareCount++;
+		if (_config.stallEvery != 0 && _prepareCount % _config.stallEvery == 0) {
+			start += _config.stallTime;
+		}
+		_commandeerFree = start + _config.prepareCost;
+
+		const uint32_t slot = (_pendingHead + _pendingCount) % kMaxSimulatedPrepares;
+		_requestedAt[slot]  = now;
+		_preparedAt[slot]   = _commandeerFree;
+		_pendingCount++;
+		return true;
+	}
+
+	static uint64_t
+	_ticks(double seconds)
+	{
+		return (uint64_t)(seconds * 1e9) + 1;
+	}
+
+  public:
+	/**
+	 * Starts over with config, forgetting what the controller learned.
+	 */
+	void
+	init(const DripPrepareSimulationConfig & config)
+	{
+		_config = config;
+		_controller.init(config.policy);
+		_random = config.seed;
+	}
+
+	const DripPrepareController &
+	controller() const
+	{
+		return _controller;
+	}
+
+	/**
+	 * Runs the buffer once.
+	 */
+	DripPrepareSimulationResult
+	run()
+	{
+		DripPrepareSimulationResult result = {};
+		_pendingHead                       = 0;
+		_pendingCount                      = 0;
+		_commandeerFree                    = 0;
+		_prepareCount                      = 0;
+		_controller.restart();
+
+		uint32_t requested = 0;
+		uint32_t prepared  = 0;
+		uint32_t completed = 0;
+		double now         = 0;
+		double aheadTime   = 0;
+		double lastChange  = 0;
+		// When the link finishes the step it is sending, or is free to start
+		// the next one.
+		double linkDone  = 0;
+		bool linkBusy    = false;
+		bool linkStarted = false;
+
+		auto canPrepare = [&](uint32_t ahead) {
+			if (requested == _config.steps) {
+				return false;
+			}
+			if (ahead != 0 && (ahead + 1) * _config.stepBytes >= _config.maxAheadBytes) {
+				return false;
+			}
+			return !_config.adaptive || _controller.canPrepare(ahead);
+		};
+		auto account = [&](double until) {
+			aheadTime += (until - lastChange) * (double)(requested - completed);
+			lastChange = until;
+		};
+
+		// The drip prepare that sets the buffer up.
+		while (canPrepare(requested - completed)) {
+			if (!_request(0)) {
+				result.failed = true;
+				return result;
+			}
+			requested++;
+		}
+		result.maxAhead = requested;
+
+		while (completed < _config.steps) {
+			const bool prepareNext = _pendingCount != 0 && (linkBusy ? _preparedAt[_pendingHead] <= linkDone : true);
+			if (prepareNext) {
+				now = _preparedAt[_pendingHead];
+				_controller.recordPrepared(_ticks(now - _requestedAt[_pendingHead]));
+				_pendingHead = (_pendingHead + 1) % kMaxSimulatedPrepares;
+				_pendingCount--;
+				prepared++;
+			} else if (linkBusy) {
+				now = linkDone;
+				account(now);
+				completed++;
+				linkBusy = false;
+
+				// The next step has not been prepared yet, asked for or not.
+				const bool starved = prepared == completed && completed < _config.steps;
+				if (starved) {
+					result.starved++;
+				}
+				_controller.recordReady(_ticks(now), starved);
+
+				for (uint32_t batch = 0; batch < _config.maxBatch && canPrepare(requested - completed); batch++) {
+					if (!_request(now)) {
+						result.failed = true;
+						return result;
+					}
+					account(now);
+					requested++;
+				}
+				if (requested - completed > result.maxAhead) {
+					result.maxAhead = requested - completed;
+				}
+			} else {
+				// Nothing prepared and nothing asked for, the controller
+				// would have to have refused a prepare with none ahead.
+				result.failed = true;
+				return result;
+			}
+
+			if (!linkBusy && prepared > completed) {
+				if (linkStarted && now > linkDone) {
+					result.waitSeconds += now - linkDone;
+				}
+				const double duration =
+				    (double)_config.stepBytes / _config.linkBytesPerSecond * (1 + _config.linkJitter * _uniform());
+				linkDone    = (now > linkDone ? now : linkDone) + duration;
+				linkBusy    = true;
+				linkStarted = true;
+			}
+		}
+
+		result.seconds    = now;
+		result.meanAhead  = now > 0 ? aheadTime / now : 0;
+		result.finalDepth = _controller.depth();
+		return result;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,315 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace AppleCIOMeshUtils
+{
+
+enum class TraceEventType : uint8_t {
+	Encrypt,
+	Send,
+	Receive,
+	Decrypt,
+	NetWrite,
+	NetRead,
+	// Waiting for the rest of the mesh at the end of a broadcast and gather.
+	Gather,
+	Count,
+};
+
+inline const char *
+trace_event_name(TraceEventType type)
+{
+	switch (type) {
+	case TraceEventType::Encrypt:
+		return "encrypt";
+	case TraceEventType::Send:
+		return "send";
+	case TraceEventType::Receive:
+		return "receive";
+	case TraceEventType::Decrypt:
+		return "decrypt";
+	case TraceEventType::NetWrite:
+		return "netWrite";
+	case TraceEventType::NetRead:
+		return "netRead";
+	case TraceEventType::Gather:
+		return "gather";
+	case TraceEventType::Count:
+		break;
+	}
+	return "unknown";
+}
+
+// Chunk value of events that cover more than a single chunk (e.g. a batch of receives).
+constexpr uint16_t kTraceNoChunk = UINT16_MAX;
+
+struct TraceEvent {
+	// Begin and end time of the event in nanoseconds.
+	uint64_t begin;
+	uint64_t end;
+	uint32_t syncId;
+	uint16_t chunk;
+	uint8_t node;
+	TraceEventType type;
+};
+static_assert(sizeof(TraceEvent) == 24, "TraceEvent should stay small, every thread keeps thousands of them");
+
+// Flight recorder of the events of a single thread. Only the owning thread
+// records, and it never waits: once the buffer is full the oldest events are
+// overwritten, so the buffer always holds the latest events.
+class EventTraceBuffer
+{
+	TraceEvent * _events = nullptr;
+	uint64_t _mask       = 0;
+	// Number of events ever recorded.
+	uint64_t _count = 0;
+	char _name[32]  = {};
+
+	friend class EventTrace;
+
+  public:
+	EventTraceBuffer()                                     = default;
+	EventTraceBuffer(const EventTraceBuffer &)             = delete;
+	EventTraceBuffer & operator=(const EventTraceBuffer &) = delete;
+
+	~EventTraceBuffer()
+	{
+		delete[] _events;
+	}
+
+	void
+	record(TraceEventType type, uint64_t begin, uint64_t end, uint32_t node, uint64_t chunk, uint64_t syncId)
+	{
+		const uint64_t count = __atomic_load_n(&_count, __ATOMIC_RELAXED);
+		TraceEvent & event   = _events[count & _mask];
+		event.begin          = begin;
+		event.end            = end;
+		event.syncId         = (uint32_t)syncId;
+		event.chunk          = chunk < kTraceNoChunk ? (uint16_t)chunk : kTraceNoChunk;
+		event.node           = (uint8_t)node;
+		event.type           = type;
+		__atomic_store_n(&_count, count + 1, __ATOMIC_RELEASE);
+	}
+
+	uint64_t
+	capacity() const
+	{
+		return _mask + 1;
+	}
+
+	uint64_t
+	count() const
+	{
+		return __atomic_load_n(&_count, __ATOMIC_ACQUIRE);
+	}
+
+	const char *
+	name() const
+	{
+		return _name;
+	}
+
+	/**
+	 * Copies the events still in the buffer, oldest first, into events (which
+	 * must have room for capacity() events) and returns how many were copied.
+	 * Can be called while the owning thread records: events that were
+	 * overwritten during the copy are left out.
+	 */
+	size_t
+	snapshot(TraceEvent * events) const
+	{
+		const uint64_t end = count();
+		uint64_t begin     = end > capacity() ? end - capacity() : 0;
+		for (uint64_t i = begin; i < end; i++) {
+			events[i - begin] = _events[i & _mask];
+		}
+
+		// Anything the writer got to while we were copying may be torn,
+		// including the slot of the event it may be recording right now.
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		const uint64_t after    = count() + 1;
+		const uint64_t overrun  = after > capacity() ? after - capacity() : 0;
+		const uint64_t firstOk  = overrun > begin ? overrun : begin;
+		const uint64_t dropHead = firstOk - begin;
+		if (dropHead >= end - begin) {
+			return 0;
+		}
+		memmove(events, events + dropHead, (size_t)(end - firstOk) * sizeof(TraceEvent));
+		return (size_t)(end - firstOk);
+	}
+};
+
+// The event buffers of a fixed set of threads, exportable as a Chrome JSON
+// trace that can be opened in chrome://tracing or the Perfetto UI.
+class EventTrace
+{
+	EventTraceBuffer * _threads = nullptr;
+	uint32_t _threadCount       = 0;
+	uint32_t _processId         = 0;
+
+	EventTrace() = default;
+
+  public:
+	EventTrace(const EventTrace &)             = delete;
+	EventTrace & operator=(const EventTrace &) = delete;
+
+	~EventTrace()
+	{
+		delete[] _threads;
+	}
+
+	/**
+	 * Creates a trace for threadCount threads, each keeping the last
+	 * eventsPerThread (rounded up to a power of two) events. processId
+	 * identifies this trace (e.g. the node id) when traces are merged. Returns
+	 * nullptr if the arguments are invalid or the allocation fails.
+	 */
+	static EventTrace *
+	create(uint32_t threadCount, uint64_t eventsPerThread, uint32_t processId)
+	{
+		if (threadCount == 0 || eventsPerThread == 0 || eventsPerThread > (1ull << 28)) {
+			return nullptr;
+		}
+		uint64_t capacity = 1;
+		while (capacity < eventsPerThread) {
+			capacity <<= 1;
+		}
+
+		EventTrace * trace = new (std::nothrow) EventTrace();
+		if (!trace) {
+			return nullptr;
+		}
+		trace->_threads = new (std::nothrow) EventTraceBuffer[threadCount];
+		if (!trace->_threads) {
+			delete trace;
+			return nullptr;
+		}
+		trace->_threadCount = threadCount;
+		trace->_processId   = processId;
+
+		for (uint32_t i = 0; i < threadCount; i++) {
+			trace->_threads[i]._events = new (std::nothrow) TraceEvent[capacity];
+			if (!trace->_threads[i]._events) {
+				delete trace;
+				return nullptr;
+			}
+			trace->_threads[i]._mask = capacity - 1;
+			snprintf(trace->_threads[i]._name, sizeof(trace->_threads[i]._name), "thread %u", i);
+		}
+		return trace;
+	}
+
+	uint32_t
+	thread_count() const
+	{
+		return _threadCount;
+	}
+
+	// The buffer of thread index. Set its name before the thread starts.
+	EventTraceBuffer *
+	thread(uint32_t index)
+	{
+		return index < _threadCount ? &_threads[index] : nullptr;
+	}
+
+	void
+	set_thread_name(uint32_t index, const char * name)
+	{
+		if (index < _threadCount) {
+			snprintf(_threads[index]._name, sizeof(_threads[index]._name), "%s", name);
+		}
+	}
+
+	/**
+	 * Writes the events of every thread as a Chrome JSON trace, with one
+	 * complete ("X") event per TraceEvent and the node, chunk and sync as its
+	 * args. Returns false if writing fails.
+	 */
+	bool
+	write_chrome_json(FILE * file) const
+	{
+		uint64_t maxCapacity = 0;
+		for (uint32_t i = 0; i < _threadCount; i++) {
+			if (_threads[i].capacity() > maxCapacity) {
+				maxCapacity = _threads[i].capacity();
+			}
+		}
+		TraceEvent * events = new (std::nothrow) TraceEvent[maxCapacity];
+		if (!events) {
+			return false;
+		}
+
+		fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"args\":{\"name\":\"node %u\"}}", _processId,
+		        _processId);
+
+		for (uint32_t tid = 0; tid < _threadCount; tid++) {
+			const EventTraceBuffer & buffer = _threads[tid];
+			fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"", _processId, tid);
+			write_json_string(file, buffer.name());
+			fprintf(file, "\"}}");
+			fprintf(file, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+			        _processId, tid, tid);
+
+			const size_t count = buffer.snapshot(events);
+			for (size_t i = 0; i < count; i++) {
+				const TraceEvent & event = events[i];
+				const uint64_t duration  = event.end > event.begin ? event.end - event.begin : 0;
+				// Chrome traces are in microseconds, keep the nanoseconds as decimals.
+				fprintf(file,
+				        ",\n{\"name\":\"%s\",\"cat\":\"mesh\",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,"
+				        "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"args\":{\"node\":%u,\"sync\":%u",
+				        trace_event_name(event.type), _processId, tid, (unsigned long long)(event.begin / 1000),
+				        (unsigned long long)(event.begin % 1000), (unsigned long long)(duration / 1000),
+				        (unsigned long long)(duration % 1000), event.node, event.syncId);
+				if (event.chunk != kTraceNoChunk) {
+					fprintf(file, ",\"chunk\":%u", event.chunk);
+				}
+				fprintf(file, "}}");
+			}
+		}
+		fprintf(file, "\n]}\n");
+		delete[] events;
+
+		return fflush(file) == 0 && !ferror(file);
+	}
+
+  private:
+	static void
+	write_json_string(FILE * file, const char * string)
+	{
+		for (; *string; string++) {
+			const unsigned char c = (unsigned char)*string;
+			if (c == '"' || c == '\\') {
+				fprintf(file, "\\%c", c);
+			} else if (c < 0x20) {
+				fprintf(file, "\\u%04x", c);
+			} else {
+				fputc(c, file);
+			}
+		}
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,493 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// A value shared between the RX and TX completion paths and the forward loop.
+// Plain builtins so the kext and user space can both use it; an all-zero
+// instance is valid, so it can live in zero-filled action arrays.
+template <typename T> struct ForwardCounter {
+	T _value;
+
+	T
+	load() const
+	{
+		return __atomic_load_n(&_value, __ATOMIC_SEQ_CST);
+	}
+
+	void
+	store(T value)
+	{
+		__atomic_store_n(&_value, value, __ATOMIC_SEQ_CST);
+	}
+
+	T
+	fetch_add(T value)
+	{
+		return __atomic_fetch_add(&_value, value, __ATOMIC_SEQ_CST);
+	}
+
+	T
+	fetch_sub(T value)
+	{
+		return __atomic_fetch_sub(&_value, value, __ATOMIC_SEQ_CST);
+	}
+
+	bool
+	compare_exchange(T & expected, T desired)
+	{
+		return __atomic_compare_exchange_n(&_value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	}
+};
+
+/// Note: flow here means an intermediate TBT command within the full
+/// forwarding chunk.
+enum class ForwardState : uint32_t {
+	// First state that begins the forwarding procedure
+	WaitingForRxStart = 0x1,
+	// Prepare Tx buffers for transfer
+	ForwardStartTxPrepare,
+	// Waiting for Tx to be prepared, only used in chains
+	// when the chain hasn't prepared yet for whatever reason.
+	ForwardWaitingPrepare,
+	// Waiting for the previous TX chunk to be complete.
+	WaitingPreviousTxComplete,
+	// Waiting for TX link to be free
+	WaitingForTxFree,
+	// Forwarder can send 1 flow out of the full block/chunk
+	ForwardTxReadyToFlow,
+	// Forwarder is waiting for a TX flow to complete.
+	ForwardWaitingTxFlowComplete,
+	// Forwarder is waiting for an intermediate RX flow before sending
+	// the next TBT command. This will not be entered the first time,
+	// because the first flow completing kicked off the forwarding.
+	WaitingForRxFlow,
+	// Forwarder is going to prepare or complete the forward action.
+	ForwardPrepareOrComplete,
+};
+
+// The chain continue state when going through the forward state machine.
+enum class ChainContinueState : uint8_t {
+	// We do not know if the chain should continue and don't check because
+	// we are not the last action to complete.
+	Unknown = 0x1,
+	// The chain should stop after this action has completed.
+	StopChain = 0x2,
+	// The chain should continue to the next element after this action has
+	// completed.
+	ContinueChain = 0x3,
+};
+
+// The points of the state machine a port can trace, with what the value
+// passed along means.
+enum class ForwardTrace : uint8_t {
+	// The first RX flow of a chunk arrived.
+	RxReceived,
+	// The TX commands are prepared, the value is 1 if a chain prepared them.
+	Prepared,
+	// The previous action of the chain completed.
+	PreviousActionComplete,
+	// TX commands were submitted, the value is how many.
+	Started,
+	// The submitted TX commands completed, the value is how many of the
+	// chunk's commands are complete.
+	TxFlowComplete,
+	// The chunk was forwarded, the value is a ChainContinueState.
+	Completed,
+};
+
+// Runs forward actions through the forward state machine and prepares the
+// chain groups they belong to, without knowing anything about the commands
+// that move the data. The Port supplies that:
+//
+//   types     Action, Element and Group, with the fields the kext's
+//             ForwardAction, ForwardActionChainElement and
+//             ForwardActionChainGroup have;
+//   constants kNodeCount (actions per element, one carries the others);
+//   hooks     interrupted, requeue, prepareTx, addPrepared, txCommandCount,
+//             sendTx, checkTxCompletion, lookAhead, forwardComplete,
+//             linksPerChannel, queueBytes (how much one link can have
+//             prepared), prepareElementLater, continueChain,
+//             chainFinished, chainStopped, sizePerLink, beginPrepare and
+//             trace.
+//
+// The kext's port drives Thunderbolt commands, ForwardSimulator.h drives a
+// simulated link.
+template <typename Port> class ForwardEngine
+{
+	using Action  = typename Port::Action;
+	using Element = typename Port::Element;
+	using Group   = typename Port::Group;
+
+	static constexpr uint32_t kCarryCount = Port::kNodeCount - 1;
+
+	Port & _port;
+
+	void
+	setCarriedState(Action * action, ForwardState state)
+	{
+		action->state = state;
+		for (uint32_t p = 0; p < kCarryCount; p++) {
+			action->carryPartners[p]->state = state;
+		}
+	}
+
+  public:
+	explicit ForwardEngine(Port & port) : _port(port) {}
+
+	/**
+	 * Runs one action through the state machine as far as it can go without
+	 * waiting. Dedicated can be used to indicate if the action must absolutely
+	 * be completed or if it is safe to stick the action back in the waiting
+	 * queue if it is blocked for whatever reason. CheckAhead can be used to
+	 * check if there are any pending actions that can be dispatched while
+	 * doing slow work. Returns false if the action's memory was interrupted.
+	 */
+	bool
+	step(Action * action, bool dedicated = true, bool checkAhead = false)
+	{
+		if (_port.interrupted(action)) {
+			return false;
+		}
+
+		switch (action->state) {
+		case ForwardState::WaitingForRxStart: {
+			if (action->rxReadyForForward.load() != true) {
+				break;
+			}
+
+			// No longer ready for forward now that we start the forward procedure.
+			action->rxReadyForForward.store(false);
+			for (uint32_t p = 0; p < kCarryCount; p++) {
+				action->carryPartners[p]->rxReadyForForward.store(false);
+			}
+			action->carryRequired.store(true);
+
+			_port.trace(ForwardTrace::RxReceived, action, 0);
+
+			if (action->chainElement != nullptr) {
+				setCarriedState(action, ForwardState::ForwardWaitingPrepare);
+				goto waitingPrepare;
+			}
+
+			// Move the state to ForwardStartPrepare
+			setCarriedState(action, ForwardState::ForwardStartTxPrepare);
+			goto txPrepare;
+		}
+		case ForwardState::ForwardStartTxPrepare: {
+		txPrepare:
+			_port.prepareTx(action);
+			for (uint32_t p = 0; p < kCarryCount; p++) {
+				_port.prepareTx(action->carryPartners[p]);
+			}
+
+			_port.addPrepared(action, Port::kNodeCount);
+			_port.trace(ForwardTrace::Prepared, action, 0);
+
+			setCarriedState(action, ForwardState::WaitingPreviousTxComplete);
+			goto waitingPreviousTxComplete;
+		}
+		case ForwardState::ForwardWaitingPrepare: {
+		waitingPrepare:
+			// If dedicated, we do not stick the action back into the queue.
+			// The dedicated guy has to finish this.
+			bool prepared = action->prepared.load();
+			for (uint32_t p = 0; p < kCarryCount; p++) {
+				prepared &= action->carryPartners[p]->prepared.load();
+			}
+
+			if (!prepared) {
+				_port.requeue(action);
+				break;
+			}
+
+			_port.trace(ForwardTrace::Prepared, action, 1);
+
+			action->prepared.store(false);
+			for (uint32_t p = 0; p < kCarryCount; p++) {
+				action->carryPartners[p]->prepared.store(false);
+			}
+
+			setCarriedState(action, ForwardState::WaitingPreviousTxComplete);
+			goto waitingPreviousTxComplete;
+		}
+		case ForwardState::WaitingPreviousTxComplete: {
+		waitingPreviousTxComplete:
+			// Time to add the partner actions to the queue at this point, we
+			// carried as much as possible.
+			bool expected = true;
+			if (action->carryPartners[0] != nullptr && action->carryRequired.compare_exchange(expected, false)) {
+				for (uint32_t p = 0; p < kCarryCount; p++) {
+					_port.requeue(action->carryPartners[p]);
+				}
+			}
+
+			if (action->previousAction && action->previousActionComplete.load() == false) {
+				// Special: We will return success here, because the commandeer
+				// doesn't need to do be dedicated to this check, the forward loop can
+				// do this while managing the other forward actions.
+				_port.requeue(action);
+				return true;
+			}
+
+			_port.trace(ForwardTrace::PreviousActionComplete, action, 0);
+
+			action->previousActionComplete.store(false);
+			action->state = ForwardState::ForwardTxReadyToFlow;
+
+			goto startTxTransfer;
+		}
+		// Flow loop start -----
+		case ForwardState::ForwardTxReadyToFlow: {
+		startTxTransfer:
+			// Let's see how many descriptors we can submit
+			// There has to be at least one
+			if (action->rxCommandsAvailable.load() < 1) {
+				break;
+			}
+
+			// We are no longer ready for forwarding, after processing this.
+			action->rxReadyForForward.store(false);
+
+			uint8_t submitCount = 0;
+			while (action->rxCommandsAvailable.fetch_sub(1)) {
+				submitCount++;
+			}
+
+			// The above loop will subtract 1 extra from the atomic than needed
+			// because fetch_sub returns the previous value. The loop will not be
+			// entered if the previous value was 0, so submitCount is safe, but
+			// the atomic will be subbed to -1, we need to add 1 to make up for it.
+			action->rxCommandsAvailable.fetch_add(1);
+
+			// Set up txCommandsSubmitted so we know how how many commands need to
+			// complete before we can complete forward or go back to waiting for RX
+			action->txCommandsSubmitted.store(submitCount);
+
+			if (checkAhead) {
+				_port.lookAhead();
+			}
+
+			action->curTxCommand += submitCount;
+			_port.sendTx(action, (uint8_t)(action->curTxCommand - 1));
+			_port.trace(ForwardTrace::Started, action, submitCount);
+
+			action->state = ForwardState::ForwardWaitingTxFlowComplete;
+			_port.requeue(action);
+			break;
+		}
+		case ForwardState::ForwardWaitingTxFlowComplete: {
+			_port.checkTxCompletion(action);
+
+			// We are waiting for all submitted tx commands to complete
+			if (action->txCommandsSubmitted.load() != 0) {
+				_port.requeue(action);
+				break;
+			}
+
+			_port.trace(ForwardTrace::TxFlowComplete, action, (uint64_t)action->txCommandsComplete.load());
+
+			// Everything has been submitted, let's check if txCommandsComplete
+			// is equal to the number of commands in the action
+			if (action->txCommandsComplete.load() == _port.txCommandCount(action)) {
+				// forward has been complete
+				// We are not going to check forward complete, because this is
+				// faster
+				if (action->nextAction) {
+					action->nextAction->previousActionComplete.store(true);
+				}
+
+				action->state = ForwardState::ForwardPrepareOrComplete;
+				goto forwardingComplete;
+			} else {
+				// We need to wait for more RX commands to drip into us
+				action->state = ForwardState::WaitingForRxFlow;
+				goto checkRxAvailable;
+			}
+		}
+		case ForwardState::ForwardPrepareOrComplete: {
+		forwardingComplete:
+			if (dedicated) {
+				_port.requeue(action);
+				break;
+			}
+
+			action->state = ForwardState::WaitingForRxStart;
+
+			// We should check continue forwarding first, so we can move the current
+			// index forward. We only notify forward complete after incase this
+			// completes broadcastAndGather and starts a new forward chain.
+			ChainContinueState chainContinue = ChainContinueState::Unknown;
+
+			if (action->chainElement != nullptr) {
+				// Check if all actions for this chain element have finished
+				//
+				// Always reset complete action count back to 0 if we forward all the
+				// expected actions with this chain element.
+				if (action->chainElement->completeActionCount.fetch_add(1) == (Port::kNodeCount - 1)) {
+					// Check if there are any pending elements for this action's link
+					// If there are, we can queue up a prepare on this element
+					// The commandeer will queue it up.
+					auto linkIdx    = action->chainElement->linkIdx;
+					auto chainGroup = action->chainElement->chainGroup;
+					if (chainGroup->pendingPrepareElements[linkIdx] > 0) {
+						// Find the element that's left. The chainElements in the
+						// group are setup like so:
+						// [link0][link0][link0] ... [link1][link1][link1]
+						// So we can calculate the index to operate on next with
+						// this formula:
+						// ElementsPerLink = TotalCount / numLinksPerChannel
+						// index = (ElementsPerLink * LinkIdx) + (elementsPerLink - pendingPrepare)
+						// ie: if ElementsPerLink = 4, and pendingPrepare=1,
+						// then the index is 4-1 = 3
+						// if pendingPrepare=2, then 4-2 = 2.
+						// for the second link, we can simply offset this by 3+4
+						// or 2+4.
+
+						int elementsPerLink = chainGroup->elementCount / _port.linksPerChannel();
+						int prepareElementIdx =
+						    (elementsPerLink * linkIdx) + (elementsPerLink - (int)chainGroup->pendingPrepareElements[linkIdx]);
+						chainGroup->pendingPrepareElements[linkIdx] -= 1;
+
+						_port.prepareElementLater(chainGroup->elements[prepareElementIdx]);
+					}
+
+					if (_port.continueChain(action->chainElement)) {
+						chainContinue = ChainContinueState::ContinueChain;
+					} else {
+						chainContinue = ChainContinueState::StopChain;
+					}
+					action->chainElement->completeActionCount.store(0);
+				}
+			}
+
+			_port.trace(ForwardTrace::Completed, action, (uint64_t)chainContinue);
+
+			action->rxCommandsAvailable.store(0);
+			action->txCommandsComplete.store(0);
+			action->curTxCommand = 0;
+
+			_port.forwardComplete(action);
+
+			// We already checked if we can continue with the next element in the chain.
+			// We can continue if all the actions for the element have been completed
+			// and if there is a chain element.
+			if (chainContinue != ChainContinueState::ContinueChain) {
+				// Check if we stopped and our partners stopped -- again just in case
+				if (chainContinue == ChainContinueState::StopChain && _port.chainFinished(action->chainElement)) {
+					_port.chainStopped(action->chainElement);
+				}
+
+				break;
+			}
+
+			auto group = action->chainElement->chainGroup;
+
+			// Mark a complete element in the group.
+			group->completeElementCount.fetch_add(1);
+
+			// Check if it is safe to prepare the group
+			if (!group->isGroupFinished()) {
+				break; // break switch
+			}
+
+			// Let's prepare the next group.
+			prepareGroup(group->nextGroup);
+
+			break; // break switch
+		}
+		case ForwardState::WaitingForRxFlow: {
+		checkRxAvailable:
+			// We are still waiting for RX flows to come in. Spin.
+			if (action->rxCommandsAvailable.load() == 0) {
+				_port.requeue(action);
+				break;
+			}
+
+			// we have a rx command available!
+			action->state = ForwardState::ForwardTxReadyToFlow;
+			goto startTxTransfer;
+		}
+			// Flow loop end -----
+		case ForwardState::WaitingForTxFree:
+			break;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Prepares as many elements of a group as fit in each link's queue, the
+	 * rest are prepared as the elements before them complete.
+	 */
+	void
+	prepareGroup(Group * group)
+	{
+		uint64_t preparedBytes[sizeof(group->pendingPrepareElements) / sizeof(group->pendingPrepareElements[0])] = {0};
+		const uint32_t links = _port.linksPerChannel();
+
+		for (uint32_t i = 0; i < links; i++) {
+			group->pendingPrepareElements[i] = group->elementCount / links;
+		}
+
+		group->completeElementCount.store(0);
+
+		// All elements of a group share a size per link.
+		const uint64_t sizePerLink = _port.sizePerLink(group);
+
+		// Here we will be looping through each chunk
+		for (uint32_t i = 0; i < group->elementCount; i++) {
+			auto element = group->elements[i];
+			auto linkIdx = element->linkIdx;
+
+			if (sizePerLink + preparedBytes[linkIdx] >= _port.queueBytes(linkIdx)) {
+				continue;
+			}
+
+			prepareElement(element);
+
+			preparedBytes[linkIdx] += sizePerLink;
+			group->pendingPrepareElements[linkIdx] -= 1;
+		}
+	}
+
+	/**
+	 * Prepares the TX commands of every action of an element ahead of their
+	 * RX.
+	 */
+	void
+	prepareElement(Element * element)
+	{
+		_port.beginPrepare(element);
+
+		for (uint32_t j = 0; j < Port::kNodeCount; j++) {
+			auto action = element->actions[j];
+			_port.prepareTx(action);
+			action->prepared.store(true);
+			_port.trace(ForwardTrace::Prepared, action, 0);
+		}
+
+		element->prepared.store(true);
+		_port.addPrepared(element->actions[0], Port::kNodeCount);
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,780 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include "Common/ChainScheduler.h"
+#include "Common/ForwardEngine.h"
+#include "Common/SlabPool.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// The simulator forwards every chunk to as many outputs as the kext does
+// (kForwardNodeCount in Config.h). A chain group counts its elements in a
+// uint8_t, which bounds the chunks of a chain.
+static constexpr uint32_t kSimForwardNodeCount  = 3;
+static constexpr uint32_t kMaxSimulatedChunks   = 128;
+static constexpr uint32_t kMaxSimulatedCommands = 8;
+static constexpr uint32_t kMaxSimulatedLinks    = 2;
+static constexpr uint32_t kMaxSimulatedChains   = 64;
+
+// A link that moves one transfer at a time, in the order they are submitted,
+// at a fixed rate and delivers each after a fixed latency.
+struct SimulatedLink {
+	double bytesPerSecond;
+	double latency;
+	double busyUntil;
+	double busyTime;
+	uint64_t bytes;
+
+	/**
+	 * Returns when a transfer submitted at now arrives at the other end.
+	 */
+	double
+	transfer(double now, uint64_t size)
+	{
+		const double start    = now > busyUntil ? now : busyUntil;
+		const double duration = (double)size / bytesPerSecond;
+		busyUntil             = start + duration;
+		busyTime += duration;
+		bytes += size;
+		return busyUntil + latency;
+	}
+};
+
+struct ForwardSimulationConfig {
+	// Chunks per chain.
+	uint32_t chunkCount;
+	// TBT commands per chunk and their size, the RX side delivers them one by
+	// one and the forwarder sends them on as they arrive.
+	uint32_t commandsPerChunk;
+	uint64_t commandBytes;
+	// Chained chunks are prepared ahead by their chain group and forwarded
+	// in order, the others prepare when their first command arrives.
+	bool chained;
+	uint32_t linksPerChannel;
+	double rxBytesPerSecond;
+	double txBytesPerSecond;
+	double linkLatency;
+	// What the forward loop spends on one state machine step, on preparing
+	// one TX command and how long the commandeer takes to prepare an element
+	// the engine handed to it.
+	double stepCost;
+	double prepareCost;
+	double prepareLatency;
+	// How many chains are set up, each with its own sender and RX links and
+	// all sharing the TX links. A sync is issued for one chain every
+	// syncInterval, in the order the chains were set up or in reverse, and
+	// its sender starts then. Only one chain runs at a time, the others wait
+	// for their turn as policy decides.
+	uint32_t chainCount;
+	double syncInterval;
+	bool reverseSetup;
+	ChainSchedulingPolicy policy;
+};
+
+// Thunderbolt 4 like links with a forward loop that takes a microsecond per
+// step.
+static constexpr ForwardSimulationConfig kDefaultForwardSimulation = {
+    64, 4, 256 * 1024, true, 1, 5e9, 5e9, 1e-6, 1e-6, 2e-6, 5e-6, 1, 0, false, kChainDeadline,
+};
+
+struct ForwardSimulationResult {
+	// When the last chunk was forwarded to its last output.
+	double seconds;
+	uint64_t bytesForwarded;
+	uint64_t chunksForwarded;
+	uint64_t steps;
+	uint64_t requeues;
+	uint32_t maxQueueDepth;
+	// From a chain's sync being issued to its last chunk reaching its last
+	// output.
+	double maxSyncLatency;
+	double meanSyncLatency;
+	// Every output link sent each chain's chunks in order, and every chain
+	// stopped after its last element.
+	bool ordered;
+	bool chainStopped;
+	// Something did not fit the simulator or the forwarder stalled.
+	bool failed;
+
+	double
+	throughput() const
+	{
+		return seconds > 0 ? (double)bytesForwarded / seconds : 0;
+	}
+};
+
+struct SimForwardElement;
+struct SimForwardGroup;
+
+// The fields the forward engine runs on, plus where the action sits in the
+// simulation.
+struct SimForwardAction {
+	ForwardState state;
+	ForwardCounter<bool> rxReadyForForward;
+	ForwardCounter<bool> prepared;
+	ForwardCounter<int8_t> rxCommandsAvailable;
+	ForwardCounter<int8_t> txCommandsComplete;
+	ForwardCounter<uint8_t> txCommandsSubmitted;
+	uint8_t curTxCommand;
+	SimForwardElement * chainElement;
+	SimForwardAction * carryPartners[kSimForwardNodeCount - 1];
+	ForwardCounter<bool> carryRequired;
+	SimForwardAction * previousAction;
+	SimForwardAction * nextAction;
+	ForwardCounter<bool> previousActionComplete;
+
+	uint32_t index;
+	uint32_t chain;
+	uint32_t chunk;
+	uint32_t output;
+	uint8_t nextTxCommand;
+};
+
+struct SimForwardElement {
+	uint8_t linkIdx;
+	ForwardCounter<bool> prepared;
+	SimForwardAction * actions[kSimForwardNodeCount];
+	ForwardCounter<uint8_t> completeActionCount;
+	SimForwardGroup * chainGroup;
+
+	uint32_t index;
+	uint32_t chain;
+};
+
+struct SimForwardGroup {
+	ForwardCounter<uint32_t> completeElementCount;
+	uint32_t pendingPrepareElements[kMaxSimulatedLinks];
+	SimForwardElement * elements[kMaxSimulatedChunks];
+	uint8_t elementCount;
+	SimForwardGroup * nextGroup;
+
+	bool
+	isGroupFinished()
+	{
+		return completeElementCount.load() == elementCount;
+	}
+};
+
+// Slabs for the simulator's pools, zeroed like the kext's.
+struct SimSlabAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		return (U *)calloc(count, sizeof(U));
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t)
+	{
+		free(memory);
+	}
+};
+
+// A deterministic discrete-event simulation of one forwarding node: chunks
+// arrive command by command over the RX links and the forward engine sends
+// each on to kSimForwardNodeCount outputs over TX links, one per output and
+// RX link. The forward loop is single threaded like the kext's, each step
+// advances the clock by the step cost. Actions and elements come from slab
+// pools that are kept from one run to the next, like the kext keeps its
+// forward actions.
+class ForwardSimulator
+{
+	enum EventType : uint8_t {
+		kRxSend,
+		kRxCommand,
+		kTxComplete,
+		kPrepareElement,
+		kSyncIssue,
+	};
+
+	struct Event {
+		double time;
+		uint64_t sequence;
+		EventType type;
+		uint32_t index;
+		uint32_t command;
+	};
+
+	static constexpr uint32_t kActionsPerSlab  = 64 * kSimForwardNodeCount;
+	static constexpr uint32_t kElementsPerSlab = 64;
+	static constexpr uint32_t kTxLinkCount     = kMaxSimulatedLinks * kSimForwardNodeCount;
+
+	ForwardSimulationConfig _config = {};
+	ForwardSimulationResult _result = {};
+	double _now                     = 0;
+	uint64_t _sequence              = 0;
+	// The events and the forward queue grow as the simulation needs.
+	Event * _events        = nullptr;
+	uint32_t _eventCount   = 0;
+	uint32_t _eventSpace   = 0;
+	SimForwardAction ** _queue = nullptr;
+	uint32_t _queueHead        = 0;
+	uint32_t _queueCount       = 0;
+	uint32_t _queueSpace       = 0;
+	SlabPool<SimForwardAction, kActionsPerSlab, SimSlabAllocator> _actions;
+	SlabPool<SimForwardElement, kElementsPerSlab, SimSlabAllocator> _elements;
+	SimForwardGroup _groups[kMaxSimulatedChains];
+	ForwardChainScheduler<kMaxSimulatedChains> _scheduler;
+	SimulatedLink _rx[kMaxSimulatedChains * kMaxSimulatedLinks];
+	SimulatedLink _tx[kTxLinkCount];
+	int64_t _lastSent[kMaxSimulatedChains * kTxLinkCount];
+	int32_t _chainRemaining[kMaxSimulatedChains];
+	uint64_t _chainCompletedActions[kMaxSimulatedChains];
+	double _syncIssued[kMaxSimulatedChains];
+	int32_t _activeChain       = -1;
+	uint32_t _chainsStopped    = 0;
+	uint64_t _completedActions = 0;
+	bool _stepping             = false;
+
+	static bool
+	earlier(const Event & a, const Event & b)
+	{
+		return a.time < b.time || (a.time == b.time && a.sequence < b.sequence);
+	}
+
+	/**
+	 * Makes room for count entries, keeping the first used entries. Returns
+	 * false if the memory can't be had.
+	 */
+	template <typename T>
+	static bool
+	grow(T ** entries, uint32_t * space, uint32_t used, uint32_t count)
+	{
+		if (count <= *space) {
+			return true;
+		}
+		uint32_t newSpace = *space > 0 ? *space : 256;
+		while (newSpace < count) {
+			newSpace *= 2;
+		}
+		T * newEntries = SimSlabAllocator::allocate<T>(newSpace);
+		if (newEntries == nullptr) {
+			return false;
+		}
+		if (used > 0) {
+			memcpy(newEntries, *entries, used * sizeof(T));
+		}
+		SimSlabAllocator::deallocate(*entries, *space);
+		*entries = newEntries;
+		*space   = newSpace;
+		return true;
+	}
+
+	void
+	schedule(double time, EventType type, uint32_t index, uint32_t command = 0)
+	{
+		if (!grow(&_events, &_eventSpace, _eventCount, _eventCount + 1)) {
+			_result.failed = true;
+			return;
+		}
+		uint32_t i = _eventCount++;
+		_events[i] = {time, _sequence++, type, index, command};
+		while (i > 0 && earlier(_events[i], _events[(i - 1) / 2])) {
+			const Event tmp         = _events[i];
+			_events[i]              = _events[(i - 1) / 2];
+			_events[(i - 1) / 2]    = tmp;
+			i                       = (i - 1) / 2;
+		}
+	}
+
+	Event
+	popEvent()
+	{
+		const Event first = _events[0];
+		_events[0]        = _events[--_eventCount];
+		for (uint32_t i = 0;;) {
+			uint32_t smallest = i;
+			for (uint32_t child = 2 * i + 1; child <= 2 * i + 2 && child < _eventCount; child++) {
+				if (earlier(_events[child], _events[smallest])) {
+					smallest = child;
+				}
+			}
+			if (smallest == i) {
+				break;
+			}
+			const Event tmp    = _events[i];
+			_events[i]         = _events[smallest];
+			_events[smallest]  = tmp;
+			i                  = smallest;
+		}
+		return first;
+	}
+
+	uint32_t
+	linkOfChunk(uint32_t chunk) const
+	{
+		return chunk * _config.linksPerChannel / _config.chunkCount;
+	}
+
+	uint32_t
+	txLink(const SimForwardAction * action) const
+	{
+		return action->output * _config.linksPerChannel + linkOfChunk(action->chunk);
+	}
+
+	SimForwardAction *
+	originalAction(uint32_t chain, uint32_t chunk) const
+	{
+		// The actions were allocated chain by chain and chunk by chunk from an
+		// empty pool, which hands out consecutive indices.
+		return _actions.get((chain * _config.chunkCount + chunk) * kSimForwardNodeCount);
+	}
+
+	void
+	startNextChain()
+	{
+		PendingChainStart start;
+		if (_activeChain >= 0 || !_scheduler.next(&start)) {
+			return;
+		}
+		// What startForwardChain does in the kext.
+		_activeChain                 = (int32_t)start.chain;
+		_chainRemaining[start.chain] = (int32_t)start.elements;
+		ForwardEngine<Port>(_port).prepareGroup(&_groups[start.chain]);
+	}
+
+	void
+	deliver(const Event & event)
+	{
+		switch (event.type) {
+		case kRxSend: {
+			// The sender pushes a chain's chunks as fast as its RX links go, one
+			// command after the other.
+			const uint32_t chain    = event.index / kMaxSimulatedLinks;
+			const uint32_t link     = event.index % kMaxSimulatedLinks;
+			const uint32_t perLink  = _config.chunkCount / _config.linksPerChannel;
+			const uint32_t chunk    = link * perLink + event.command / _config.commandsPerChunk;
+			const uint32_t command  = event.command % _config.commandsPerChunk;
+			const double arrival    = _rx[event.index].transfer(_now, _config.commandBytes);
+			schedule(arrival, kRxCommand, chain * _config.chunkCount + chunk, command);
+			if (event.command + 1 < perLink * _config.commandsPerChunk) {
+				schedule(_rx[event.index].busyUntil, kRxSend, event.index, event.command + 1);
+			}
+			break;
+		}
+		case kRxCommand: {
+			// What markActionRxComplete and flowRxComplete do in the kext.
+			SimForwardAction * action = originalAction(event.index / _config.chunkCount, event.index % _config.chunkCount);
+			if (event.command == 0) {
+				action->rxReadyForForward.store(true);
+			}
+			action->rxCommandsAvailable.fetch_add(1);
+			for (uint32_t p = 0; p < kSimForwardNodeCount - 1; p++) {
+				if (event.command == 0) {
+					action->carryPartners[p]->rxReadyForForward.store(true);
+				}
+				action->carryPartners[p]->rxCommandsAvailable.fetch_add(1);
+			}
+			if (event.command == 0) {
+				requeue(action);
+			}
+			break;
+		}
+		case kTxComplete: {
+			SimForwardAction * action = _actions.get(event.index);
+			action->txCommandsComplete.fetch_add(1);
+			action->txCommandsSubmitted.fetch_sub(1);
+			break;
+		}
+		case kPrepareElement:
+			ForwardEngine<Port>(_port).prepareElement(_elements.get(event.index));
+			break;
+		case kSyncIssue:
+			_syncIssued[event.index] = _now;
+			for (uint32_t link = 0; link < _config.linksPerChannel; link++) {
+				schedule(_now, kRxSend, event.index * kMaxSimulatedLinks + link);
+			}
+			if (_config.chained) {
+				if (!_scheduler.submit(event.index, _config.chunkCount, (uint64_t)(_now * 1e9))) {
+					_result.failed = true;
+				}
+				startNextChain();
+			}
+			break;
+		}
+	}
+
+	bool
+	setup()
+	{
+		_actions.releaseAll();
+		_elements.releaseAll();
+		_scheduler.clear();
+		_scheduler.setPolicy(_config.policy);
+		memset(_groups, 0, sizeof(_groups));
+		for (uint32_t i = 0; i < kMaxSimulatedChains * kMaxSimulatedLinks; i++) {
+			_rx[i] = {_config.rxBytesPerSecond, _config.linkLatency, 0, 0, 0};
+		}
+		for (uint32_t i = 0; i < kTxLinkCount; i++) {
+			_tx[i] = {_config.txBytesPerSecond, _config.linkLatency, 0, 0, 0};
+		}
+		for (uint32_t i = 0; i < kMaxSimulatedChains * kTxLinkCount; i++) {
+			_lastSent[i] = -1;
+		}
+		memset(_chainRemaining, 0, sizeof(_chainRemaining));
+		memset(_chainCompletedActions, 0, sizeof(_chainCompletedActions));
+		memset(_syncIssued, 0, sizeof(_syncIssued));
+
+		for (uint32_t chain = 0; chain < _config.chainCount; chain++) {
+			SimForwardGroup * group = &_groups[chain];
+			group->nextGroup        = group;
+
+			for (uint32_t chunk = 0; chunk < _config.chunkCount; chunk++) {
+				SimForwardAction * original = nullptr;
+				for (uint32_t output = 0; output < kSimForwardNodeCount; output++) {
+					uint32_t index;
+					if (!_actions.allocate(&index)) {
+						return false;
+					}
+					SimForwardAction * action = _actions.get(index);
+					memset(action, 0, sizeof(*action));
+					action->state  = ForwardState::WaitingForRxStart;
+					action->index  = index;
+					action->chain  = chain;
+					action->chunk  = chunk;
+					action->output = output;
+					if (output == 0) {
+						original = action;
+					} else {
+						original->carryPartners[output - 1] = action;
+					}
+				}
+				if (original != originalAction(chain, chunk)) {
+					return false;
+				}
+			}
+
+			if (!_config.chained) {
+				continue;
+			}
+
+			// Elements are grouped link by link like groupChainElements does,
+			// and each link's elements follow each other.
+			for (uint32_t chunk = 0; chunk < _config.chunkCount; chunk++) {
+				uint32_t index;
+				if (!_elements.allocate(&index)) {
+					return false;
+				}
+				SimForwardElement * element = _elements.get(index);
+				memset(element, 0, sizeof(*element));
+				element->index      = index;
+				element->chain      = chain;
+				element->linkIdx    = (uint8_t)linkOfChunk(chunk);
+				element->chainGroup = group;
+				for (uint32_t output = 0; output < kSimForwardNodeCount; output++) {
+					SimForwardAction * action = _actions.get(originalAction(chain, chunk)->index + output);
+					element->actions[output]  = action;
+					action->chainElement      = element;
+					if (chunk > 0 && linkOfChunk(chunk - 1) == element->linkIdx) {
+						action->previousAction             = _actions.get(action->index - kSimForwardNodeCount);
+						action->previousAction->nextAction = action;
+					}
+				}
+				group->elements[group->elementCount++] = element;
+			}
+		}
+
+		for (uint32_t i = 0; i < _config.chainCount; i++) {
+			const uint32_t chain = _config.reverseSetup ? _config.chainCount - 1 - i : i;
+			schedule(i * _config.syncInterval, kSyncIssue, chain);
+		}
+		return true;
+	}
+
+	// The engine's view of the simulation.
+	struct Port {
+		using Action  = SimForwardAction;
+		using Element = SimForwardElement;
+		using Group   = SimForwardGroup;
+
+		static constexpr uint32_t kNodeCount = kSimForwardNodeCount;
+
+		ForwardSimulator * sim;
+
+		bool
+		interrupted(SimForwardAction *)
+		{
+			return false;
+		}
+
+		void
+		requeue(SimForwardAction * action)
+		{
+			sim->_result.requeues++;
+			sim->requeue(action);
+		}
+
+		void
+		prepareTx(SimForwardAction *)
+		{
+			// Chains prepare on the commandeer, that time is in the prepare
+			// latency.
+			if (sim->_stepping) {
+				sim->_now += sim->_config.prepareCost * sim->_config.commandsPerChunk;
+			}
+		}
+
+		void
+		addPrepared(SimForwardAction *, uint32_t)
+		{
+		}
+
+		int8_t
+		txCommandCount(SimForwardAction *)
+		{
+			return (int8_t)sim->_config.commandsPerChunk;
+		}
+
+		void
+		sendTx(SimForwardAction * action, uint8_t command)
+		{
+			// Like the kext, one doorbell sends every command up to this one.
+			const uint32_t link = sim->txLink(action);
+			if (action->nextTxCommand == 0) {
+				int64_t & lastSent = sim->_lastSent[action->chain * kTxLinkCount + link];
+				sim->_result.ordered &= (int64_t)action->chunk > lastSent;
+				lastSent = action->chunk;
+			}
+			for (; action->nextTxCommand <= command; action->nextTxCommand++) {
+				const double done = sim->_tx[link].transfer(sim->_now, sim->_config.commandBytes);
+				sim->schedule(done, kTxComplete, action->index);
+			}
+		}
+
+		void
+		checkTxCompletion(SimForwardAction *)
+		{
+		}
+
+		void
+		lookAhead()
+		{
+		}
+
+		void
+		forwardComplete(SimForwardAction * action)
+		{
+			action->nextTxCommand = 0;
+			sim->_completedActions++;
+			sim->_result.bytesForwarded += sim->_config.commandBytes * sim->_config.commandsPerChunk;
+			if (action->output == kSimForwardNodeCount - 1) {
+				sim->_result.chunksForwarded++;
+			}
+
+			if (++sim->_chainCompletedActions[action->chain] == sim->_config.chunkCount * kSimForwardNodeCount) {
+				const double latency = sim->_now - sim->_syncIssued[action->chain];
+				if (latency > sim->_result.maxSyncLatency) {
+					sim->_result.maxSyncLatency = latency;
+				}
+				sim->_result.meanSyncLatency += latency / sim->_config.chainCount;
+			}
+		}
+
+		uint32_t
+		linksPerChannel()
+		{
+			return sim->_config.linksPerChannel;
+		}
+
+		// What the kext's largest rings hold.
+		uint64_t
+		queueBytes(uint8_t)
+		{
+			return 15 * 1024 * 1024;
+		}
+
+		void
+		prepareElementLater(SimForwardElement * element)
+		{
+			sim->schedule(sim->_now + sim->_config.prepareLatency, kPrepareElement, element->index);
+		}
+
+		bool
+		continueChain(SimForwardElement * element)
+		{
+			return --sim->_chainRemaining[element->chain] > 0;
+		}
+
+		bool
+		chainFinished(SimForwardElement * element)
+		{
+			return sim->_chainRemaining[element->chain] <= 0;
+		}
+
+		void
+		chainStopped(SimForwardElement *)
+		{
+			sim->_chainsStopped++;
+			sim->_activeChain = -1;
+			sim->startNextChain();
+		}
+
+		uint64_t
+		sizePerLink(SimForwardGroup *)
+		{
+			return sim->_config.commandBytes * sim->_config.commandsPerChunk;
+		}
+
+		void
+		beginPrepare(SimForwardElement *)
+		{
+		}
+
+		void
+		trace(ForwardTrace, SimForwardAction *, uint64_t)
+		{
+		}
+	};
+
+	Port _port = {this};
+
+	void
+	requeue(SimForwardAction * action)
+	{
+		if (_queueCount == _queueSpace) {
+			// Grow the ring, unwrapping it into the new space.
+			const uint32_t space        = _queueSpace > 0 ? 2 * _queueSpace : 256;
+			SimForwardAction ** entries = SimSlabAllocator::allocate<SimForwardAction *>(space);
+			if (entries == nullptr) {
+				_result.failed = true;
+				return;
+			}
+			for (uint32_t i = 0; i < _queueCount; i++) {
+				entries[i] = _queue[(_queueHead + i) % _queueSpace];
+			}
+			SimSlabAllocator::deallocate(_queue, _queueSpace);
+			_queue      = entries;
+			_queueSpace = space;
+			_queueHead  = 0;
+		}
+		_queue[(_queueHead + _queueCount++) % _queueSpace] = action;
+		if (_queueCount > _result.maxQueueDepth) {
+			_result.maxQueueDepth = _queueCount;
+		}
+	}
+
+  public:
+	ForwardSimulator() = default;
+
+	~ForwardSimulator()
+	{
+		SimSlabAllocator::deallocate(_events, _eventSpace);
+		SimSlabAllocator::deallocate(_queue, _queueSpace);
+	}
+
+	ForwardSimulator(const ForwardSimulator &)             = delete;
+	ForwardSimulator & operator=(const ForwardSimulator &) = delete;
+
+	/**
+	 * Runs one simulation from scratch. The same config always gives the same
+	 * result.
+	 */
+	ForwardSimulationResult
+	run(const ForwardSimulationConfig & config)
+	{
+		_config           = config;
+		_result           = {};
+		_result.ordered   = true;
+		_now              = 0;
+		_sequence         = 0;
+		_eventCount       = 0;
+		_queueHead        = 0;
+		_queueCount       = 0;
+		_activeChain      = -1;
+		_chainsStopped    = 0;
+		_completedActions = 0;
+		if (config.chunkCount == 0 || config.chunkCount > kMaxSimulatedChunks || config.commandsPerChunk == 0 ||
+		    config.commandsPerChunk > kMaxSimulatedCommands || config.linksPerChannel == 0 ||
+		    config.linksPerChannel > kMaxSimulatedLinks || config.chunkCount % config.linksPerChannel != 0 ||
+		    config.rxBytesPerSecond <= 0 || config.txBytesPerSecond <= 0 || config.chainCount == 0 ||
+		    config.chainCount > kMaxSimulatedChains || config.syncInterval < 0) {
+			_result.failed = true;
+			return _result;
+		}
+
+		if (!setup()) {
+			_result.failed = true;
+			return _result;
+		}
+		ForwardEngine<Port> engine(_port);
+
+		const uint64_t expected = (uint64_t)config.chainCount * config.chunkCount * kSimForwardNodeCount;
+		// Bounds a stalled forwarder, which would otherwise spin on requeues.
+		const uint64_t maxSteps = 10000 * expected * (config.commandsPerChunk + 4);
+		while (_completedActions < expected && !_result.failed) {
+			while (_eventCount > 0 && _events[0].time <= _now) {
+				deliver(popEvent());
+			}
+			if (_queueCount > 0) {
+				SimForwardAction * action = _queue[_queueHead];
+				_queueHead                = (_queueHead + 1) % _queueSpace;
+				_queueCount--;
+				_stepping = true;
+				engine.step(action, false, false);
+				_stepping = false;
+				_now += _config.stepCost;
+				if (++_result.steps > maxSteps) {
+					_result.failed = true;
+				}
+			} else if (_eventCount > 0) {
+				_now = _events[0].time;
+			} else {
+				_result.failed = true;
+			}
+		}
+
+		// The last completions land after the forwarder saw them.
+		double end = _now;
+		for (uint32_t i = 0; i < kTxLinkCount; i++) {
+			if (_tx[i].busyUntil + _config.linkLatency > end && _tx[i].bytes > 0) {
+				end = _tx[i].busyUntil + _config.linkLatency;
+			}
+		}
+		_result.seconds      = end;
+		_result.chainStopped = _chainsStopped == config.chainCount;
+		return _result;
+	}
+
+	/**
+	 * How busy an output link was over the last run.
+	 */
+	double
+	txUtilization(uint32_t output, uint32_t link) const
+	{
+		const SimulatedLink & tx = _tx[output * _config.linksPerChannel + link];
+		return _result.seconds > 0 ? tx.busyTime / _result.seconds : 0;
+	}
+
+	/**
+	 * How many slabs the action pool holds, it only grows when a run needs
+	 * more actions than any run before it.
+	 */
+	uint32_t
+	actionSlabs() const
+	{
+		return _actions.slabCount();
+	}
+};
+
+} // namespace AppleCIOMeshUtils
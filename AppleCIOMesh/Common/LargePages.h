@@ -0,0 +1,209 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <mach/vm_statistics.h>
+#endif
+
+namespace AppleCIOMeshUtils
+{
+
+constexpr size_t kLargePageSize = 2ull * 1024 * 1024;
+
+// The pages a LargePageMapping ended up with.
+enum LargePageKind : uint32_t {
+	// The base pages of the platform (16KB on Apple silicon, 4KB on x86).
+	kLargePageKindBase = 0,
+	// Base pages the kernel was asked to back with huge pages when it can
+	// (Linux transparent huge pages).
+	kLargePageKindTransparent = 1,
+	// Guaranteed 2MB pages (Linux MAP_HUGETLB, Darwin superpages).
+	kLargePageKindHuge = 2,
+};
+
+inline const char *
+large_page_kind_name(LargePageKind kind)
+{
+	switch (kind) {
+	case kLargePageKindBase:
+		return "base pages";
+	case kLargePageKindTransparent:
+		return "transparent huge pages";
+	case kLargePageKindHuge:
+		return "huge pages";
+	}
+	return "unknown pages";
+}
+
+struct LargePageMapping {
+	void * memory;
+	// The size that was mapped, size rounded up to whole pages.
+	size_t size;
+	// The page size the mapping is guaranteed to have: kLargePageSize for huge
+	// pages, the base page size otherwise (transparent huge pages may or may
+	// not be backed by larger pages).
+	size_t pageSize;
+	LargePageKind kind;
+};
+
+/**
+ * Maps size bytes of anonymous read/write memory. If largePages is true it
+ * tries 2MB pages first and falls back to base pages where the platform or the
+ * system configuration has none (e.g. on Apple silicon, or without reserved
+ * hugetlbfs pages on Linux). tag is the VM tag of the memory on Darwin.
+ * Returns false if the memory could not be mapped at all.
+ */
+inline bool
+map_large_pages(size_t size, bool largePages, int tag, LargePageMapping * mapping)
+{
+	const size_t basePageSize = (size_t)getpagesize();
+	const size_t largeSize    = (size + kLargePageSize - 1) & ~(kLargePageSize - 1);
+	void * memory             = MAP_FAILED;
+	(void)tag;
+
+	if (largePages) {
+#if defined(__linux__) && defined(MAP_HUGETLB)
+		memory = mmap(nullptr, largeSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+#elif defined(__APPLE__) && defined(VM_FLAGS_SUPERPAGE_SIZE_2MB)
+		const int superpageTag = tag | VM_FLAGS_SUPERPAGE_SIZE_2MB;
+		memory                 = mmap(nullptr, largeSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, superpageTag, 0);
+#endif
+		if (memory != MAP_FAILED) {
+			*mapping = {memory, largeSize, kLargePageSize, kLargePageKindHuge};
+			return true;
+		}
+	}
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	// Transparent huge pages need 2MB aligned memory, so map an extra 2MB to
+	// align the start and trim the ends.
+	if (largePages) {
+		memory = mmap(nullptr, largeSize + kLargePageSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+		if (memory == MAP_FAILED) {
+			return false;
+		}
+		const uintptr_t start   = (uintptr_t)memory;
+		const uintptr_t aligned = (start + kLargePageSize - 1) & ~(uintptr_t)(kLargePageSize - 1);
+		if (aligned > start) {
+			munmap(memory, aligned - start);
+		}
+		munmap((void *)(aligned + largeSize), start + kLargePageSize - aligned);
+		memory = (void *)aligned;
+		if (madvise(memory, largeSize, MADV_HUGEPAGE) == 0) {
+			*mapping = {memory, largeSize, basePageSize, kLargePageKindTransparent};
+		} else {
+			*mapping = {memory, largeSize, basePageSize, kLargePageKindBase};
+		}
+		return true;
+	}
+#endif
+
+	const size_t baseSize = (size + basePageSize - 1) & ~(basePageSize - 1);
+#if defined(__APPLE__)
+	memory = mmap(nullptr, baseSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, tag, 0);
+#else
+	memory = mmap(nullptr, baseSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+#endif
+	if (memory == MAP_FAILED) {
+		return false;
+	}
+	*mapping = {memory, baseSize, basePageSize, kLargePageKindBase};
+	return true;
+}
+
+inline void
+unmap_large_pages(const LargePageMapping & mapping)
+{
+	munmap(mapping.memory, mapping.size);
+}
+
+struct PrefaultRange {
+	volatile uint8_t * start;
+	size_t size;
+	size_t stride;
+	size_t touched;
+};
+
+inline void *
+prefault_range(void * arg)
+{
+	PrefaultRange * range = (PrefaultRange *)arg;
+	// Write the byte back so memory that is already in use keeps its data.
+	for (size_t offset = 0; offset < range->size; offset += range->stride) {
+		range->start[offset] = range->start[offset];
+		range->touched++;
+	}
+	return nullptr;
+}
+
+/**
+ * Faults in every page of [memory, memory + size) by writing to it, split in
+ * contiguous ranges over up to threadCount threads (the calling thread takes
+ * the first). The ranges only depend on the arguments, so every run faults in
+ * the same pages from the same threads. Returns the number of pages touched.
+ */
+inline size_t
+prefault_parallel(void * memory, size_t size, size_t pageSize, uint32_t threadCount)
+{
+	static constexpr uint32_t kMaxThreads = 16;
+	if (size == 0 || pageSize == 0) {
+		return 0;
+	}
+	const size_t pages = (size + pageSize - 1) / pageSize;
+	if (threadCount == 0) {
+		threadCount = 1;
+	}
+	if (threadCount > kMaxThreads) {
+		threadCount = kMaxThreads;
+	}
+	if (threadCount > pages) {
+		threadCount = (uint32_t)pages;
+	}
+
+	PrefaultRange ranges[kMaxThreads];
+	pthread_t threads[kMaxThreads];
+	bool started[kMaxThreads] = {};
+	const size_t perThread    = (pages + threadCount - 1) / threadCount;
+	for (uint32_t i = 0; i < threadCount; i++) {
+		const size_t start = i * perThread * pageSize;
+		const size_t end   = start + perThread * pageSize < size ? start + perThread * pageSize : size;
+		ranges[i]          = {(volatile uint8_t *)memory + start, end > start ? end - start : 0, pageSize, 0};
+		// Fall back to faulting in the range ourselves if we are out of threads.
+		if (i > 0) {
+			started[i] = pthread_create(&threads[i], nullptr, prefault_range, &ranges[i]) == 0;
+		}
+	}
+
+	size_t touched = 0;
+	for (uint32_t i = 0; i < threadCount; i++) {
+		if (i == 0 || !started[i]) {
+			prefault_range(&ranges[i]);
+		} else {
+			pthread_join(threads[i], nullptr);
+		}
+		touched += ranges[i].touched;
+	}
+	return touched;
+}
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,236 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// A fixed-size, allocation-free, log-linear (HDR style) histogram used to
+// estimate quantiles of a stream of non-negative integer samples.
+//
+// Values below 2^kSubBucketBits are recorded exactly. Above that, each power
+// of two is split into 2^kSubBucketBits linear sub-buckets, which bounds the
+// relative error of any reported quantile to 2^-kSubBucketBits (0.78% for the
+// default of 7 bits). Values at or above 2^kMaxValueBits are clamped into the
+// last bucket and counted as overflows.
+//
+// Recording uses relaxed atomic increments so multiple threads may record
+// into the same histogram. Alternatively, each thread can own a histogram and
+// merge() them together when reporting. Readers may observe a histogram that
+// is being updated; the result is a slightly stale but self-consistent view.
+//
+// This header has no dependencies so it can be shared between the kext and
+// user space. An all-zero instance is a valid empty histogram, so it can be
+// embedded in calloc'ed structures.
+template <uint32_t kSubBucketBits = 7, uint32_t kMaxValueBits = 40> class LogLinearHistogram
+{
+	static_assert(kSubBucketBits >= 1 && kSubBucketBits < kMaxValueBits, "Invalid sub bucket bits");
+	static_assert(kMaxValueBits <= 63, "Values are limited to 63 bits");
+
+  public:
+	static constexpr uint32_t kSubBucketCount = 1u << kSubBucketBits;
+	static constexpr uint32_t kBucketCount    = (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+	static constexpr uint64_t kMaxValue       = (1ull << kMaxValueBits) - 1;
+
+	// Returns the bucket index a value is recorded in.
+	static constexpr uint32_t
+	bucket_for_value(uint64_t value)
+	{
+		if (value > kMaxValue) {
+			value = kMaxValue;
+		}
+		if (value < kSubBucketCount) {
+			return (uint32_t)value;
+		}
+		const uint32_t exponent = 63u - (uint32_t)__builtin_clzll(value);
+		const uint32_t shift    = exponent - kSubBucketBits;
+		const uint32_t mantissa = (uint32_t)(value >> shift) - kSubBucketCount;
+		return (shift + 1) * kSubBucketCount + mantissa;
+	}
+
+	// Returns the smallest value that is recorded in the bucket.
+	static constexpr uint64_t
+	lowest_value_for_bucket(uint32_t bucket)
+	{
+		if (bucket < kSubBucketCount) {
+			return bucket;
+		}
+		const uint32_t shift    = (bucket / kSubBucketCount) - 1;
+		const uint64_t mantissa = (bucket % kSubBucketCount) + kSubBucketCount;
+		return mantissa << shift;
+	}
+
+	// Returns the largest value that is recorded in the bucket.
+	static constexpr uint64_t
+	highest_value_for_bucket(uint32_t bucket)
+	{
+		if (bucket < kSubBucketCount) {
+			return bucket;
+		}
+		const uint32_t shift = (bucket / kSubBucketCount) - 1;
+		return lowest_value_for_bucket(bucket) + (1ull << shift) - 1;
+	}
+
+	void
+	record(uint64_t value)
+	{
+		record(value, 1);
+	}
+
+	void
+	record(uint64_t value, uint64_t count)
+	{
+		if (value > kMaxValue) {
+			__atomic_fetch_add(&_overflows, count, __ATOMIC_RELAXED);
+		}
+		__atomic_fetch_add(&_counts[bucket_for_value(value)], count, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&_sum, value * count, __ATOMIC_RELAXED);
+
+		uint64_t current = __atomic_load_n(&_max, __ATOMIC_RELAXED);
+		while (value > current &&
+		       !__atomic_compare_exchange_n(&_max, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+	}
+
+	// Adds all the samples of another histogram to this one.
+	void
+	merge(const LogLinearHistogram & other)
+	{
+		for (uint32_t i = 0; i < kBucketCount; i++) {
+			const uint64_t count = __atomic_load_n(&other._counts[i], __ATOMIC_RELAXED);
+			if (count != 0) {
+				__atomic_fetch_add(&_counts[i], count, __ATOMIC_RELAXED);
+			}
+		}
+		__atomic_fetch_add(&_overflows, __atomic_load_n(&other._overflows, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+		__atomic_fetch_add(&_sum, __atomic_load_n(&other._sum, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+
+		const uint64_t otherMax = __atomic_load_n(&other._max, __ATOMIC_RELAXED);
+		uint64_t current        = __atomic_load_n(&_max, __ATOMIC_RELAXED);
+		while (otherMax > current &&
+		       !__atomic_compare_exchange_n(&_max, &current, otherMax, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+	}
+
+	// Clears all samples. Not safe against concurrent recorders.
+	void
+	reset()
+	{
+		for (uint32_t i = 0; i < kBucketCount; i++) {
+			_counts[i] = 0;
+		}
+		_overflows = 0;
+		_sum       = 0;
+		_max       = 0;
+	}
+
+	uint64_t
+	count() const
+	{
+		uint64_t total = 0;
+		for (uint32_t i = 0; i < kBucketCount; i++) {
+			total += __atomic_load_n(&_counts[i], __ATOMIC_RELAXED);
+		}
+		return total;
+	}
+
+	uint64_t
+	count_at_bucket(uint32_t bucket) const
+	{
+		return bucket < kBucketCount ? __atomic_load_n(&_counts[bucket], __ATOMIC_RELAXED) : 0;
+	}
+
+	uint64_t
+	overflows() const
+	{
+		return __atomic_load_n(&_overflows, __ATOMIC_RELAXED);
+	}
+
+	uint64_t
+	sum() const
+	{
+		return __atomic_load_n(&_sum, __ATOMIC_RELAXED);
+	}
+
+	uint64_t
+	maximum() const
+	{
+		return __atomic_load_n(&_max, __ATOMIC_RELAXED);
+	}
+
+	uint64_t
+	minimum() const
+	{
+		for (uint32_t i = 0; i < kBucketCount; i++) {
+			if (__atomic_load_n(&_counts[i], __ATOMIC_RELAXED) != 0) {
+				return lowest_value_for_bucket(i);
+			}
+		}
+		return 0;
+	}
+
+	// Returns the estimated value at the quantile q (0.0 - 1.0). The estimate is
+	// the highest value equivalent to the bucket holding the q-th sample, capped
+	// by the largest recorded value. Returns 0 if there are no samples.
+	uint64_t
+	value_at_quantile(double q) const
+	{
+		return value_at_quantile(q, count());
+	}
+
+	// Same as above, for callers that already computed count() and want to look
+	// up several quantiles from one consistent total.
+	uint64_t
+	value_at_quantile(double q, uint64_t total) const
+	{
+		if (total == 0) {
+			return 0;
+		}
+		if (q < 0.0) {
+			q = 0.0;
+		} else if (q > 1.0) {
+			q = 1.0;
+		}
+
+		uint64_t rank = (uint64_t)(q * (double)total + 0.5);
+		if (rank == 0) {
+			rank = 1;
+		} else if (rank > total) {
+			rank = total;
+		}
+
+		uint64_t seen = 0;
+		for (uint32_t i = 0; i < kBucketCount; i++) {
+			seen += __atomic_load_n(&_counts[i], __ATOMIC_RELAXED);
+			if (seen >= rank) {
+				const uint64_t highest = highest_value_for_bucket(i);
+				const uint64_t max     = maximum();
+				return (max != 0 && highest > max) ? max : highest;
+			}
+		}
+		return maximum();
+	}
+
+  private:
+	uint64_t _counts[kBucketCount]{};
+	uint64_t _overflows{0};
+	uint64_t _sum{0};
+	uint64_t _max{0};
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,218 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Nodes in a chassis, and in a partition (the nodes connected with CIO).
+constexpr uint32_t kMeshChassisNodes   = 4;
+constexpr uint32_t kMeshPartitionNodes = 8;
+constexpr uint32_t kMeshLinkCount      = 8;
+
+// What the topology functions return for a node that is not there.
+constexpr uint32_t kMeshNoNode = UINT32_MAX;
+
+// The hardware node (slot in the chassis) at the other end of each acio of a
+// J236 node, by the node's own slot. A node's own slot means the acio is on
+// its A cable, to the node in the same slot of the other chassis. acio 0 and 2
+// are the B cable, 4 to 7 are internal. See AppleCIOMeshHardwarePlatform.cpp.
+constexpr uint8_t kJ236LinkPartners[kMeshChassisNodes][kMeshLinkCount] = {
+    {3, 0, 3, 0, 1, 2, 2, 1},
+    {2, 1, 2, 1, 0, 3, 3, 0},
+    {1, 2, 1, 2, 3, 0, 0, 3},
+    {0, 3, 0, 3, 2, 1, 1, 2},
+};
+
+// A partition is described by a mask of the ranks in it, rank r being the
+// node in slot r % 4 of chassis r / 4. Ranks are partition relative, the
+// extended rank of a node is partitionIdx * 8 + rank.
+//
+// The full hypercube connects every node to the rest of its chassis and to
+// its partner, the node in the same slot of the other chassis. With fewer
+// than 8 nodes the links to missing nodes go unused and some routes take a
+// different relay.
+
+/**
+ * Returns the mask of an ensemble of the first nodeCount ranks, 0 if the
+ * partition can't hold that many.
+ */
+inline uint32_t
+mesh_node_mask(uint32_t nodeCount)
+{
+	if (nodeCount == 0 || nodeCount > kMeshPartitionNodes) {
+		return 0;
+	}
+	return (1u << nodeCount) - 1;
+}
+
+inline bool
+mesh_has_node(uint32_t mask, uint32_t rank)
+{
+	return rank < kMeshPartitionNodes && (mask & (1u << rank)) != 0;
+}
+
+/**
+ * Returns the rank in the same slot of the other chassis.
+ */
+inline uint32_t
+mesh_partner(uint32_t rank)
+{
+	return rank ^ kMeshChassisNodes;
+}
+
+/**
+ * Returns the rank at the other end of rank's link on acio, kMeshNoNode if
+ * that node is not in the mask.
+ */
+inline uint32_t
+mesh_link_partner(uint32_t mask, uint32_t rank, uint32_t acio)
+{
+	if (!mesh_has_node(mask, rank) || acio >= kMeshLinkCount) {
+		return kMeshNoNode;
+	}
+
+	const uint32_t slot    = rank % kMeshChassisNodes;
+	const uint32_t hwNode  = kJ236LinkPartners[slot][acio];
+	const uint32_t partner = hwNode == slot ? mesh_partner(rank) : rank - slot + hwNode;
+	return mesh_has_node(mask, partner) ? partner : kMeshNoNode;
+}
+
+/**
+ * Returns the mask of the acios rank needs a link on.
+ */
+inline uint32_t
+mesh_required_links(uint32_t mask, uint32_t rank)
+{
+	uint32_t links = 0;
+	for (uint32_t acio = 0; acio < kMeshLinkCount; acio++) {
+		if (mesh_link_partner(mask, rank, acio) != kMeshNoNode) {
+			links |= 1u << acio;
+		}
+	}
+	return links;
+}
+
+/**
+ * Returns whether a and b are both in the mask and have links between them.
+ */
+inline bool
+mesh_connected(uint32_t mask, uint32_t a, uint32_t b)
+{
+	if (a == b || !mesh_has_node(mask, a) || !mesh_has_node(mask, b)) {
+		return false;
+	}
+	return a / kMeshChassisNodes == b / kMeshChassisNodes || mesh_partner(a) == b;
+}
+
+/**
+ * Returns the node src's data goes to first on its way to dst, dst if they
+ * are connected, kMeshNoNode if there is no way.
+ *
+ * Like the full hypercube, data crosses to the other chassis through src's
+ * partner, which passes it on within its chassis. Without a partner it goes
+ * to dst's partner in src's chassis, which passes it across. Only a mask
+ * with neither has to go further: through any slot with nodes in both
+ * chassis.
+ */
+inline uint32_t
+mesh_next_hop(uint32_t mask, uint32_t src, uint32_t dst)
+{
+	if (src == dst || !mesh_has_node(mask, src) || !mesh_has_node(mask, dst)) {
+		return kMeshNoNode;
+	}
+	if (mesh_connected(mask, src, dst)) {
+		return dst;
+	}
+	if (mesh_connected(mask, mesh_partner(src), dst)) {
+		return mesh_partner(src);
+	}
+	if (mesh_has_node(mask, mesh_partner(dst))) {
+		return mesh_partner(dst);
+	}
+	const uint32_t srcChassis = src - src % kMeshChassisNodes;
+	for (uint32_t slot = 0; slot < kMeshChassisNodes; slot++) {
+		const uint32_t relay = srcChassis + slot;
+		if (relay != src && mesh_connected(mask, src, relay) && mesh_has_node(mask, mesh_partner(relay))) {
+			return relay;
+		}
+	}
+	return kMeshNoNode;
+}
+
+/**
+ * Returns how many links src's data crosses to get to dst, 0 for src itself
+ * and for a dst it can't get to.
+ */
+inline uint32_t
+mesh_route_hops(uint32_t mask, uint32_t src, uint32_t dst)
+{
+	uint32_t hops = 0;
+	for (uint32_t node = src; node != dst && hops < kMeshPartitionNodes; hops++) {
+		node = mesh_next_hop(mask, node, dst);
+		if (node == kMeshNoNode) {
+			return 0;
+		}
+	}
+	return hops;
+}
+
+/**
+ * Returns whether every node of the mask can get its data to every other.
+ */
+inline bool
+mesh_routable(uint32_t mask)
+{
+	for (uint32_t src = 0; src < kMeshPartitionNodes; src++) {
+		for (uint32_t dst = 0; dst < kMeshPartitionNodes; dst++) {
+			if (src != dst && mesh_has_node(mask, src) && mesh_has_node(mask, dst) && mesh_route_hops(mask, src, dst) == 0) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Returns the mask of the nodes rank passes src's data on to: those the
+ * route from src to them goes through rank and that rank sends to directly.
+ */
+inline uint32_t
+mesh_forward_targets(uint32_t mask, uint32_t rank, uint32_t src)
+{
+	uint32_t targets = 0;
+	for (uint32_t dst = 0; dst < kMeshPartitionNodes; dst++) {
+		if (dst == rank || dst == src || !mesh_has_node(mask, dst) || !mesh_connected(mask, rank, dst)) {
+			continue;
+		}
+		// Walk the route, rank has to be the hop just before dst.
+		uint32_t node = src;
+		uint32_t hops = 0;
+		while (node != kMeshNoNode && node != dst && hops++ < kMeshPartitionNodes) {
+			const uint32_t next = mesh_next_hop(mask, node, dst);
+			if (next == dst && node == rank && node != src) {
+				targets |= 1u << dst;
+			}
+			node = next;
+		}
+	}
+	return targets;
+}
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,256 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <errno.h>
+#include <new>
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Renders the metrics into buffer (size bytes) and stores their length.
+// Returns false if they do not fit.
+using MetricsRenderer = bool (*)(void * context, char * buffer, size_t size, size_t * length);
+
+// Serves metrics over HTTP/1.0 on a Unix domain socket, so a local agent can
+// scrape them, e.g. with curl --unix-socket PATH http://localhost/metrics.
+// One background thread accepts and answers one scrape at a time. Every buffer
+// is allocated up front: a scrape only renders into the response buffer and
+// writes it out, so it never allocates or takes locks shared with the caller.
+class MetricsServer
+{
+	static constexpr size_t kRequestSize = 1024;
+	// A scraper that stalls mid request or response is dropped after this.
+	static constexpr int kSocketTimeoutSec = 1;
+	// How often the server thread checks if it should stop.
+	static constexpr int kPollIntervalMs = 100;
+
+	int _socket = -1;
+	char _path[sizeof(((sockaddr_un *)nullptr)->sun_path)] = {};
+	MetricsRenderer _render = nullptr;
+	void * _context         = nullptr;
+	char * _response        = nullptr;
+	size_t _responseSize    = 0;
+	char _request[kRequestSize];
+	pthread_t _thread;
+	bool _started     = false;
+	bool _stop        = false;
+	uint64_t _scrapes = 0;
+
+	MetricsServer() = default;
+
+  public:
+	MetricsServer(const MetricsServer &)             = delete;
+	MetricsServer & operator=(const MetricsServer &) = delete;
+
+	// Stops serving and removes the socket. A scrape in progress is finished
+	// first.
+	~MetricsServer()
+	{
+		if (_started) {
+			__atomic_store_n(&_stop, true, __ATOMIC_RELEASE);
+			pthread_join(_thread, nullptr);
+		}
+		if (_socket >= 0) {
+			close(_socket);
+			unlink(_path);
+		}
+		delete[] _response;
+	}
+
+	/**
+	 * Listens on a new Unix domain socket at path (replacing a stale one) and
+	 * starts serving. Each response holds up to bufferSize bytes of metrics.
+	 * Returns nullptr and sets error (EINVAL, ENAMETOOLONG, ENOMEM or the
+	 * error from the socket calls) if the server could not be started.
+	 */
+	static MetricsServer *
+	create(const char * path, size_t bufferSize, MetricsRenderer render, void * context, int * error)
+	{
+		if (path == nullptr || render == nullptr || bufferSize == 0) {
+			*error = EINVAL;
+			return nullptr;
+		}
+		MetricsServer * server = new (std::nothrow) MetricsServer();
+		if (server == nullptr) {
+			*error = ENOMEM;
+			return nullptr;
+		}
+		if (snprintf(server->_path, sizeof(server->_path), "%s", path) >= (int)sizeof(server->_path)) {
+			delete server;
+			*error = ENAMETOOLONG;
+			return nullptr;
+		}
+		server->_render  = render;
+		server->_context = context;
+		// Room for the HTTP header in front of the metrics.
+		server->_responseSize = bufferSize + 256;
+		server->_response     = new (std::nothrow) char[server->_responseSize];
+		if (server->_response == nullptr) {
+			delete server;
+			*error = ENOMEM;
+			return nullptr;
+		}
+
+		*error = server->listen_on_path();
+		if (*error == 0) {
+			*error           = pthread_create(&server->_thread, nullptr, serve, server);
+			server->_started = *error == 0;
+		}
+		if (*error != 0) {
+			delete server;
+			return nullptr;
+		}
+		return server;
+	}
+
+	// Number of scrapes answered so far.
+	uint64_t
+	scrapes() const
+	{
+		return __atomic_load_n(&_scrapes, __ATOMIC_RELAXED);
+	}
+
+  private:
+	int
+	listen_on_path()
+	{
+		_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (_socket < 0) {
+			return errno;
+		}
+		sockaddr_un address = {};
+		address.sun_family  = AF_UNIX;
+		memcpy(address.sun_path, _path, sizeof(address.sun_path));
+
+		// A previous process may have left its socket behind.
+		unlink(_path);
+		if (bind(_socket, (sockaddr *)&address, sizeof(address)) != 0 || listen(_socket, 4) != 0) {
+			const int error = errno;
+			close(_socket);
+			_socket = -1;
+			return error;
+		}
+		return 0;
+	}
+
+	static void *
+	serve(void * arg)
+	{
+		MetricsServer * server = (MetricsServer *)arg;
+#if defined(__APPLE__)
+		pthread_setname_np("mesh metrics");
+#endif
+		while (!__atomic_load_n(&server->_stop, __ATOMIC_ACQUIRE)) {
+			pollfd listener = {server->_socket, POLLIN, 0};
+			if (poll(&listener, 1, kPollIntervalMs) <= 0) {
+				continue;
+			}
+			const int client = accept(server->_socket, nullptr, nullptr);
+			if (client < 0) {
+				continue;
+			}
+			server->answer(client);
+			close(client);
+		}
+		return nullptr;
+	}
+
+	void
+	answer(int client)
+	{
+		timeval timeout = {kSocketTimeoutSec, 0};
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#if defined(SO_NOSIGPIPE)
+		const int on = 1;
+		setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+		// Read the request line and headers, we only look at the path.
+		size_t length = 0;
+		while (length < kRequestSize - 1) {
+			const ssize_t received = recv(client, _request + length, kRequestSize - 1 - length, 0);
+			if (received <= 0) {
+				return;
+			}
+			length += (size_t)received;
+			_request[length] = '\0';
+			if (strstr(_request, "\r\n\r\n") || strstr(_request, "\n\n")) {
+				break;
+			}
+		}
+
+		const bool isGet     = strncmp(_request, "GET ", 4) == 0;
+		const char * target  = _request + 4;
+		const bool isMetrics = isGet && (strncmp(target, "/metrics ", 9) == 0 || strncmp(target, "/ ", 2) == 0);
+		if (!isMetrics) {
+			static const char kNotFound[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+			send_all(client, kNotFound, sizeof(kNotFound) - 1);
+			return;
+		}
+
+		// Render after a fixed size header whose length we patch in after.
+		static const char kHeader[] = "HTTP/1.0 200 OK\r\n"
+		                              "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+		                              "Connection: close\r\n"
+		                              "Content-Length: %10zu\r\n\r\n";
+		const int headerLength = snprintf(_response, _responseSize, kHeader, (size_t)0);
+		size_t bodyLength      = 0;
+		if (headerLength < 0 ||
+		    !_render(_context, _response + headerLength, _responseSize - (size_t)headerLength, &bodyLength)) {
+			static const char kTooLarge[] = "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+			send_all(client, kTooLarge, sizeof(kTooLarge) - 1);
+			return;
+		}
+		const char saved = _response[headerLength];
+		snprintf(_response, (size_t)headerLength + 1, kHeader, bodyLength);
+		_response[headerLength] = saved;
+		send_all(client, _response, (size_t)headerLength + bodyLength);
+		__atomic_fetch_add(&_scrapes, 1, __ATOMIC_RELAXED);
+	}
+
+	static void
+	send_all(int client, const char * data, size_t length)
+	{
+#if defined(MSG_NOSIGNAL)
+		const int flags = MSG_NOSIGNAL;
+#else
+		const int flags = 0;
+#endif
+		while (length > 0) {
+			const ssize_t sent = send(client, data, length, flags);
+			if (sent <= 0) {
+				return;
+			}
+			data += sent;
+			length -= (size_t)sent;
+		}
+	}
+};
+
+} // namespace AppleCIOMeshUtils
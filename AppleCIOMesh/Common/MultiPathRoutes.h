@@ -0,0 +1,232 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// A destination two CIO hops away is reached through either node that
+// neighbours both ends, in the ensemble there are two.
+static constexpr uint32_t kMaxRoutesPerDestination = 4;
+
+// Weights are relative to the fastest route of a destination, which gets
+// kRouteWeightScale. A slow route keeps at least kMinRouteWeight, so it still
+// carries the odd chunk and its latency is still measured.
+static constexpr uint32_t kRouteWeightScale = 1024;
+static constexpr uint32_t kMinRouteWeight   = kRouteWeightScale / 16;
+
+// Completion latencies are smoothed over about this many samples.
+static constexpr uint32_t kRouteLatencyShift = 3;
+
+struct MeshRoute {
+	int32_t channel;
+	uint32_t forwarder;
+};
+
+// The routes to every destination, with the channel each goes out on, and the
+// smoothed completion latency of every channel. Chunks for a destination are
+// split across its routes in proportion to their weights, which follow the
+// latencies: a channel that completes twice as slow gets half the chunks.
+//
+// Routes are changed by one thread. Latencies may be recorded from
+// completion callbacks while routes are read; a lost sample only delays the
+// weights a little. An all-zero instance has no routes.
+template <uint32_t kNodeCount, uint32_t kChannelCount> class MultiPathRoutes
+{
+	MeshRoute _routes[kNodeCount][kMaxRoutesPerDestination];
+	uint8_t _routeCount[kNodeCount];
+	uint64_t _latency[kChannelCount];
+
+	uint64_t
+	latencyOf(int32_t channel) const
+	{
+		return __atomic_load_n(&_latency[channel], __ATOMIC_RELAXED);
+	}
+
+  public:
+	void
+	clear()
+	{
+		for (uint32_t node = 0; node < kNodeCount; node++) {
+			_routeCount[node] = 0;
+		}
+		for (uint32_t channel = 0; channel < kChannelCount; channel++) {
+			__atomic_store_n(&_latency[channel], 0, __ATOMIC_RELAXED);
+		}
+	}
+
+	/**
+	 * Adds a route to destination through forwarder on channel. Returns false
+	 * if the destination or channel is out of range or the destination has no
+	 * room for another route. Adding a route twice is fine.
+	 */
+	bool
+	addRoute(uint32_t destination, int32_t channel, uint32_t forwarder)
+	{
+		if (destination >= kNodeCount || channel < 0 || (uint32_t)channel >= kChannelCount) {
+			return false;
+		}
+		for (uint32_t i = 0; i < _routeCount[destination]; i++) {
+			if (_routes[destination][i].channel == channel) {
+				_routes[destination][i].forwarder = forwarder;
+				return true;
+			}
+		}
+		if (_routeCount[destination] == kMaxRoutesPerDestination) {
+			return false;
+		}
+		_routes[destination][_routeCount[destination]++] = {channel, forwarder};
+		return true;
+	}
+
+	/**
+	 * Drops every route that goes out on channel and forgets its latency.
+	 */
+	void
+	removeChannel(int32_t channel)
+	{
+		for (uint32_t node = 0; node < kNodeCount; node++) {
+			uint32_t kept = 0;
+			for (uint32_t i = 0; i < _routeCount[node]; i++) {
+				if (_routes[node][i].channel != channel) {
+					_routes[node][kept++] = _routes[node][i];
+				}
+			}
+			_routeCount[node] = (uint8_t)kept;
+		}
+		if (channel >= 0 && (uint32_t)channel < kChannelCount) {
+			__atomic_store_n(&_latency[channel], 0, __ATOMIC_RELAXED);
+		}
+	}
+
+	uint32_t
+	routeCount(uint32_t destination) const
+	{
+		return destination < kNodeCount ? _routeCount[destination] : 0;
+	}
+
+	const MeshRoute &
+	route(uint32_t destination, uint32_t index) const
+	{
+		return _routes[destination][index];
+	}
+
+	/**
+	 * Folds one completion latency, in any unit as long as it is always the
+	 * same, into the channel's average.
+	 */
+	void
+	recordCompletion(int32_t channel, uint64_t latency)
+	{
+		if (channel < 0 || (uint32_t)channel >= kChannelCount) {
+			return;
+		}
+		const uint64_t average = latencyOf(channel);
+		// The first sample seeds the average, later ones move it by 1/8th of
+		// the difference.
+		const uint64_t updated =
+		    average == 0 ? latency : average - (average >> kRouteLatencyShift) + (latency >> kRouteLatencyShift);
+		__atomic_store_n(&_latency[channel], updated != 0 ? updated : 1, __ATOMIC_RELAXED);
+	}
+
+	uint64_t
+	channelLatency(int32_t channel) const
+	{
+		return channel >= 0 && (uint32_t)channel < kChannelCount ? latencyOf(channel) : 0;
+	}
+
+	/**
+	 * Returns the weight of a route out of kRouteWeightScale. Channels that
+	 * have not completed anything yet are assumed as fast as the fastest.
+	 */
+	uint32_t
+	weight(uint32_t destination, uint32_t index) const
+	{
+		uint64_t fastest = 0;
+		for (uint32_t i = 0; i < _routeCount[destination]; i++) {
+			const uint64_t latency = latencyOf(_routes[destination][i].channel);
+			if (latency != 0 && (fastest == 0 || latency < fastest)) {
+				fastest = latency;
+			}
+		}
+		const uint64_t latency = latencyOf(_routes[destination][index].channel);
+		if (fastest == 0 || latency == 0) {
+			return kRouteWeightScale;
+		}
+		const uint64_t weight = kRouteWeightScale * fastest / latency;
+		return weight > kMinRouteWeight ? (uint32_t)weight : kMinRouteWeight;
+	}
+
+	/**
+	 * Returns the index of the route to take for something that goes one way
+	 * only: a direct route if there is one, otherwise the one with the highest
+	 * weight, the first one on a tie. Skips the route on channel excluded.
+	 * Returns -1 if there is no such route.
+	 */
+	int32_t
+	bestRoute(uint32_t destination, int32_t excluded = -1) const
+	{
+		int32_t best        = -1;
+		bool bestDirect     = false;
+		uint32_t bestWeight = 0;
+		for (uint32_t i = 0; i < routeCount(destination); i++) {
+			const bool direct = _routes[destination][i].forwarder == destination;
+			const uint32_t w  = weight(destination, i);
+			if (_routes[destination][i].channel != excluded &&
+			    (best == -1 || (direct && !bestDirect) || (direct == bestDirect && w > bestWeight))) {
+				best       = (int32_t)i;
+				bestDirect = direct;
+				bestWeight = w;
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * Returns the index of the route chunk goes on. Consecutive chunks are
+	 * spread evenly: any run of chunks splits within a chunk or two of the
+	 * weights. Returns -1 if the destination has no route.
+	 */
+	int32_t
+	routeForChunk(uint32_t destination, uint64_t chunk) const
+	{
+		const uint32_t count = routeCount(destination);
+		if (count <= 1) {
+			return (int32_t)count - 1;
+		}
+		uint32_t weights[kMaxRoutesPerDestination];
+		uint64_t total = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			weights[i] = weight(destination, i);
+			total += weights[i];
+		}
+		// The fractional part of chunk times the golden ratio, a sequence that
+		// fills the weight line evenly whatever the run length.
+		uint64_t position = ((uint64_t)(uint32_t)(chunk * 0x9e3779b9ull) * total) >> 32;
+		for (uint32_t i = 0; i < count; i++) {
+			if (position < weights[i]) {
+				return (int32_t)i;
+			}
+			position -= weights[i];
+		}
+		return (int32_t)count - 1;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,123 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Every node mask a buffer can be set up for. Each has its own keys, derived
+// by every node in it from the mesh crypto key and the mask, so the masks a
+// node derives keys for have to be the same on all nodes.
+//
+// These are the pairs and chassis within a partition, the first 3 to 8 ranks
+// of a partition for the partial hypercubes and whole partitions. Per
+// partition, 0x7, 0x1F, 0x3F and 0x7F are the 3, 5, 6 and 7 node meshes and
+// 0x70 the second chassis of the 7 node mesh.
+constexpr uint64_t kMeshNodeMasks[] = {
+    0x0003,     0x0005,     0x0006,     0x0007,     0x0009,     0x000A,     0x000C,     0x000F,     0x001F,     0x0030,
+    0x003F,     0x0050,     0x0060,     0x0070,     0x007F,     0x0090,     0x00A0,     0x00C0,     0x00F0,     0x00FF,
+    0x0101,     0x0202,     0x0300,     0x0404,     0x0500,     0x0600,     0x0700,     0x0808,     0x0900,     0x0A00,
+    0x0C00,     0x0F00,     0x1010,     0x1F00,     0x2020,     0x3000,     0x3F00,     0x4040,     0x5000,     0x6000,
+    0x7000,     0x7F00,     0x8080,     0x9000,     0xA000,     0xC000,     0xF000,     0xFF00,     0xFFFF,     0x10001,
+    0x10100,    0x20002,    0x20200,    0x30000,    0x40004,    0x40400,    0x50000,    0x60000,    0x70000,    0x80008,
+    0x80800,    0x90000,    0xA0000,    0xC0000,    0xF0000,    0x100010,   0x101000,   0x1F0000,   0x200020,   0x202000,
+    0x300000,   0x3F0000,   0x400040,   0x404000,   0x500000,   0x600000,   0x700000,   0x7F0000,   0x800080,   0x808000,
+    0x900000,   0xA00000,   0xC00000,   0xF00000,   0xFF0000,   0xFF00FF,   0xFFFF00,   0x1000001,  0x1000100,  0x1010000,
+    0x2000002,  0x2000200,  0x2020000,  0x3000000,  0x4000004,  0x4000400,  0x4040000,  0x5000000,  0x6000000,  0x7000000,
+    0x8000008,  0x8000800,  0x8080000,  0x9000000,  0xA000000,  0xC000000,  0xF000000,  0x10000010, 0x10001000, 0x10100000,
+    0x1F000000, 0x20000020, 0x20002000, 0x20200000, 0x30000000, 0x3F000000, 0x40000040, 0x40004000, 0x40400000, 0x50000000,
+    0x60000000, 0x70000000, 0x7F000000, 0x80000080, 0x80008000, 0x80800000, 0x90000000, 0xA0000000, 0xC0000000, 0xF0000000,
+    0xFF000000, 0xFF0000FF, 0xFF00FF00, 0xFFFF0000, 0xFFFFFFFF};
+
+constexpr uint32_t kMeshNodeMaskCount = sizeof(kMeshNodeMasks) / sizeof(kMeshNodeMasks[0]);
+
+/**
+ * Returns whether mask is one of kMeshNodeMasks.
+ */
+inline bool
+mesh_valid_node_mask(uint64_t mask)
+{
+	for (uint64_t nodeMask : kMeshNodeMasks) {
+		if (nodeMask == mask) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Fills masks with the node masks rank is in, up to capacity of them, and
+ * returns how many there are.
+ */
+inline uint32_t
+mesh_key_masks(uint32_t rank, uint64_t * masks, uint32_t capacity)
+{
+	uint32_t count = 0;
+	for (uint64_t mask : kMeshNodeMasks) {
+		if (rank < 64 && (mask & (1ull << rank)) != 0) {
+			if (count < capacity) {
+				masks[count] = mask;
+			}
+			count++;
+		}
+	}
+	return count;
+}
+
+// What a key set is for.
+enum MeshKeyKind : uint32_t {
+	// The buffers of a node mask.
+	kMeshKeyNodeMask = 0,
+	// The all-to-all slices between a pair of nodes. The pair's mask can be
+	// a node mask too (0x3 of a 2 node mesh), so these keys are derived with
+	// labels of their own and never share an IV with the mask's buffers.
+	kMeshKeyPair,
+};
+
+/**
+ * Formats the HKDF info strings the key and the starting IV of a key set are
+ * derived with. Returns false if they don't fit.
+ */
+inline bool
+mesh_key_labels(
+    uint64_t mask, MeshKeyKind kind, char * keyInfo, size_t keyInfoSize, char * ivInfo, size_t ivInfoSize)
+{
+	const char * prefix = kind == kMeshKeyPair ? "all-to-all-" : "";
+	const int keyLength = snprintf(keyInfo, keyInfoSize, "%skey-derivation-%llu", prefix, (unsigned long long)mask);
+	const int ivLength  = snprintf(ivInfo, ivInfoSize, "%sIV-nonce-%llu", prefix, (unsigned long long)mask);
+	return keyLength >= 0 && (size_t)keyLength < keyInfoSize && ivLength >= 0 && (size_t)ivLength < ivInfoSize;
+}
+
+/**
+ * Returns which block of a buffer set up for mask belongs to rank: the number
+ * of nodes of the mask below it.
+ *
+ * For example, in the mask 0b00001100 (2-node mask) the block of rank 2 is 0
+ * and the block of rank 3 is 1.
+ */
+inline uint8_t
+mesh_block_index(uint64_t mask, uint32_t rank)
+{
+	// set all the bits before the rank's bit, all of them past the mask.
+	const uint64_t lowerBits = rank < 64 ? (1ull << rank) - 1 : ~0ull;
+	return (uint8_t)__builtin_popcountll(mask & lowerBits);
+}
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,170 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Writes metrics in the OpenMetrics text format (what Prometheus scrapes) into
+// a buffer owned by the caller. The writer never allocates, so it can run on a
+// scrape thread next to the data path. Output that does not fit is dropped and
+// finish() reports the overflow instead of returning a truncated exposition.
+//
+// Every metric family is started with family() and followed by its samples.
+// Counter families are named without the _total suffix, their samples with it.
+// Label sets are passed preformatted, e.g. peer="3", or nullptr for none.
+class OpenMetricsWriter
+{
+	char * _buffer;
+	size_t _size;
+	size_t _length  = 0;
+	bool _overflown = false;
+
+  public:
+	OpenMetricsWriter(char * buffer, size_t size) : _buffer(buffer), _size(size)
+	{
+	}
+
+	// Writes the TYPE (counter, gauge, histogram, ...), UNIT and HELP lines of
+	// a metric family. unit may be nullptr.
+	void
+	family(const char * name, const char * type, const char * unit, const char * help)
+	{
+		append("# TYPE %s %s\n", name, type);
+		if (unit) {
+			append("# UNIT %s %s\n", name, unit);
+		}
+		append("# HELP %s %s\n", name, help);
+	}
+
+	void
+	sample(const char * name, const char * suffix, const char * labels, uint64_t value)
+	{
+		append_name(name, suffix, labels);
+		append(" %llu\n", (unsigned long long)value);
+	}
+
+	void
+	sample(const char * name, const char * suffix, const char * labels, double value)
+	{
+		append_name(name, suffix, labels);
+		append(" %.9g\n", value);
+	}
+
+	/**
+	 * Writes the samples of a histogram family from a LogLinearHistogram: one
+	 * cumulative _bucket per bound (ascending, in the unit of the recorded
+	 * values), the +Inf bucket, _count and _sum. The values are multiplied by
+	 * scale, e.g. 1e-9 to report nanoseconds in seconds. A bound between two
+	 * histogram buckets counts the whole bucket it falls in, so the counts are
+	 * as accurate as the histogram itself.
+	 */
+	template <typename Histogram>
+	void
+	histogram(const char * name, const char * labels, const Histogram & histogram, const uint64_t * bounds, size_t boundCount,
+	          double scale)
+	{
+		char bucketLabels[128];
+		char bound[32];
+		uint64_t cumulative = 0;
+		uint32_t bucket     = 0;
+		for (size_t i = 0; i < boundCount; i++) {
+			const uint32_t last = Histogram::bucket_for_value(bounds[i]);
+			for (; bucket <= last && bucket < Histogram::kBucketCount; bucket++) {
+				cumulative += histogram.count_at_bucket(bucket);
+			}
+			snprintf(bound, sizeof(bound), "%.9g", (double)bounds[i] * scale);
+			format_bucket_labels(bucketLabels, sizeof(bucketLabels), labels, bound);
+			sample(name, "_bucket", bucketLabels, cumulative);
+		}
+		for (; bucket < Histogram::kBucketCount; bucket++) {
+			cumulative += histogram.count_at_bucket(bucket);
+		}
+		format_bucket_labels(bucketLabels, sizeof(bucketLabels), labels, "+Inf");
+		sample(name, "_bucket", bucketLabels, cumulative);
+		// Use the same total as +Inf, the histogram may be recorded into while
+		// we walk it.
+		sample(name, "_count", labels, cumulative);
+		sample(name, "_sum", labels, (double)histogram.sum() * scale);
+	}
+
+	// Ends the exposition. Returns false if anything did not fit in the buffer.
+	bool
+	finish()
+	{
+		append("# EOF\n");
+		return !_overflown;
+	}
+
+	size_t
+	length() const
+	{
+		return _length;
+	}
+
+	bool
+	overflown() const
+	{
+		return _overflown;
+	}
+
+  private:
+	void
+	append_name(const char * name, const char * suffix, const char * labels)
+	{
+		if (labels && labels[0]) {
+			append("%s%s{%s}", name, suffix, labels);
+		} else {
+			append("%s%s", name, suffix);
+		}
+	}
+
+	static void
+	format_bucket_labels(char * out, size_t size, const char * labels, const char * bound)
+	{
+		const bool hasLabels = labels && labels[0];
+		snprintf(out, size, "%s%sle=\"%s\"", hasLabels ? labels : "", hasLabels ? "," : "", bound);
+	}
+
+	void
+	append(const char * format, ...) __attribute__((format(printf, 2, 3)))
+	{
+		if (_overflown) {
+			return;
+		}
+		va_list args;
+		va_start(args, format);
+		const int written = vsnprintf(_buffer + _length, _size - _length, format, args);
+		va_end(args);
+		if (written < 0 || (size_t)written >= _size - _length) {
+			// Drop whatever did not fit, the exposition is incomplete anyway.
+			if (_length < _size) {
+				_buffer[_length] = '\0';
+			}
+			_overflown = true;
+			return;
+		}
+		_length += (size_t)written;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
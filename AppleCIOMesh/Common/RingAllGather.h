@@ -0,0 +1,243 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Moves one chunk of ciphertext to the next node of the ring, or takes one
+// from the previous node. Returns false if the link failed.
+typedef bool (*RingSendFn)(void * context, const void * data, uint64_t size);
+typedef bool (*RingReceiveFn)(void * context, void * data, uint64_t size);
+
+// Encrypts (seal) or decrypts (open) a chunk of the block of the node with the
+// given rank. Returns false if the chunk does not authenticate.
+typedef bool (*RingCryptFn)(void * context, uint32_t rank, uint32_t chunk, const void * in, void * out, uint64_t size);
+
+struct RingAllGatherOps {
+	RingSendFn send;
+	RingReceiveFn receive;
+	RingCryptFn seal;
+	RingCryptFn open;
+	void * context;
+};
+
+/**
+ * Returns the position in the ring of the node whose block the node at
+ * position sends in a step. In step 0 that is its own block, in the following
+ * steps the block it received in the step before.
+ */
+inline uint32_t
+ring_send_origin(uint32_t nodeCount, uint32_t position, uint32_t step)
+{
+	return (position + nodeCount - step % nodeCount) % nodeCount;
+}
+
+inline uint32_t
+ring_receive_origin(uint32_t nodeCount, uint32_t position, uint32_t step)
+{
+	return ring_send_origin(nodeCount, position, step + 1);
+}
+
+// One node of a ring all-gather (broadcast and gather) over N - 1 steps.
+//
+// The blocks are split in chunks and every chunk is passed on as soon as it
+// arrives, so the steps overlap: the receiver stores the ciphertext of each
+// chunk in the staging buffer and decrypts it into the user buffer, and the
+// sender forwards it from the staging buffer to the next node without
+// decrypting it again. Every block crosses each link of the ring once, unlike
+// the direct gather where the sender of each block pushes it to every node.
+//
+// The user and staging buffers hold the blocks of all the nodes by rank, the
+// node's own block has to be in the user buffer. run() sends from a thread of
+// its own and receives on the calling thread.
+class RingAllGather
+{
+	const uint32_t _nodeCount;
+	const uint32_t _position;
+	const uint32_t * _ring;
+	const uint64_t _blockSize;
+	const uint32_t _chunkCount;
+	uint8_t * _user;
+	uint8_t * _staging;
+	const RingAllGatherOps _ops;
+
+	pthread_mutex_t _lock;
+	pthread_cond_t _progress;
+	// Chunks received so far, in the order they arrive.
+	uint32_t _received;
+	bool _failed;
+
+	static void *
+	sendThread(void * arg)
+	{
+		RingAllGather * ring = (RingAllGather *)arg;
+		return ring->send() ? ring : nullptr;
+	}
+
+	bool
+	failed()
+	{
+		pthread_mutex_lock(&_lock);
+		const bool failed = _failed;
+		pthread_mutex_unlock(&_lock);
+		return failed;
+	}
+
+	void
+	publish_received(uint32_t count)
+	{
+		pthread_mutex_lock(&_lock);
+		_received = count;
+		pthread_cond_signal(&_progress);
+		pthread_mutex_unlock(&_lock);
+	}
+
+	bool
+	wait_received(uint32_t count)
+	{
+		pthread_mutex_lock(&_lock);
+		while (_received < count && !_failed) {
+			pthread_cond_wait(&_progress, &_lock);
+		}
+		const bool received = _received >= count;
+		pthread_mutex_unlock(&_lock);
+		return received;
+	}
+
+  public:
+	RingAllGather(uint32_t nodeCount,
+	              uint32_t position,
+	              const uint32_t * ring,
+	              uint64_t blockSize,
+	              uint32_t chunkCount,
+	              uint8_t * user,
+	              uint8_t * staging,
+	              const RingAllGatherOps & ops)
+	    : _nodeCount(nodeCount), _position(position), _ring(ring), _blockSize(blockSize), _chunkCount(chunkCount), _user(user),
+	      _staging(staging), _ops(ops), _received(0), _failed(false)
+	{
+		pthread_mutex_init(&_lock, nullptr);
+		pthread_cond_init(&_progress, nullptr);
+	}
+
+	~RingAllGather()
+	{
+		pthread_cond_destroy(&_progress);
+		pthread_mutex_destroy(&_lock);
+	}
+
+	RingAllGather(const RingAllGather &)             = delete;
+	RingAllGather & operator=(const RingAllGather &) = delete;
+
+	uint64_t
+	chunk_size() const
+	{
+		return _blockSize / _chunkCount;
+	}
+
+	/**
+	 * Runs the whole all-gather. Returns false if a link or a chunk failed, in
+	 * which case the user buffer is only partially filled.
+	 */
+	bool
+	run()
+	{
+		if (_nodeCount < 2 || _position >= _nodeCount || _chunkCount == 0 || _blockSize % _chunkCount != 0) {
+			return false;
+		}
+		_received = 0;
+		_failed   = false;
+
+		pthread_t sender;
+		if (pthread_create(&sender, nullptr, sendThread, this) != 0) {
+			return false;
+		}
+		const bool received = receive();
+		if (!received) {
+			fail();
+		}
+		void * sent = nullptr;
+		pthread_join(sender, &sent);
+		return received && sent == this;
+	}
+
+	bool
+	send()
+	{
+		const uint64_t chunkSize = chunk_size();
+		const uint32_t rank      = _ring[_position];
+		for (uint32_t chunk = 0; chunk < _chunkCount; chunk++) {
+			const uint64_t offset = rank * _blockSize + chunk * chunkSize;
+			if (failed() || !_ops.seal(_ops.context, rank, chunk, _user + offset, _staging + offset, chunkSize) ||
+			    !_ops.send(_ops.context, _staging + offset, chunkSize)) {
+				return fail();
+			}
+		}
+
+		// The block received in the last step started at the next node.
+		for (uint32_t step = 1; step + 1 < _nodeCount; step++) {
+			const uint32_t origin = _ring[ring_send_origin(_nodeCount, _position, step)];
+			for (uint32_t chunk = 0; chunk < _chunkCount; chunk++) {
+				const uint64_t offset = origin * _blockSize + chunk * chunkSize;
+				if (!wait_received((step - 1) * _chunkCount + chunk + 1) ||
+				    !_ops.send(_ops.context, _staging + offset, chunkSize)) {
+					return fail();
+				}
+			}
+		}
+		return true;
+	}
+
+	bool
+	receive()
+	{
+		const uint64_t chunkSize = chunk_size();
+		for (uint32_t step = 0; step + 1 < _nodeCount; step++) {
+			const uint32_t origin = _ring[ring_receive_origin(_nodeCount, _position, step)];
+			for (uint32_t chunk = 0; chunk < _chunkCount; chunk++) {
+				const uint64_t offset = origin * _blockSize + chunk * chunkSize;
+				if (failed() || !_ops.receive(_ops.context, _staging + offset, chunkSize)) {
+					return false;
+				}
+				// Let the sender forward it while it is decrypted.
+				publish_received(step * _chunkCount + chunk + 1);
+				if (!_ops.open(_ops.context, origin, chunk, _staging + offset, _user + offset, chunkSize)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Stops the other side of the node, e.g. when the links are torn down.
+	bool
+	fail()
+	{
+		pthread_mutex_lock(&_lock);
+		_failed = true;
+		pthread_cond_broadcast(&_progress);
+		pthread_mutex_unlock(&_lock);
+		return false;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
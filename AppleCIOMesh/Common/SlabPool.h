@@ -0,0 +1,258 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// A pool of T that grows a slab of kSlabSize entries at a time, for as long
+// as the allocator has memory, instead of reserving the most it could ever
+// need up front. An entry keeps its index and address for as long as the
+// pool lives, so other code can hold on to either. Released entries are
+// handed out again, lowest index first, before the pool grows.
+//
+// Allocator provides
+//   template <typename U> static U * allocate(uint32_t count);
+//   template <typename U> static void deallocate(U * memory, uint32_t count);
+// and must return zero-filled memory; new slabs are all zeroes.
+//
+// allocate and release are not thread safe. get may be called from any
+// thread for an index that allocate returned, slabs are published before
+// their indices are handed out and are only freed by trim and reset.
+template <typename T, uint32_t kSlabSize, typename Allocator> class SlabPool
+{
+	static_assert(kSlabSize > 0, "The pool needs room for something");
+
+	// The entries in use, 64 per word.
+	static constexpr uint32_t kWordsPerSlab = (kSlabSize + 63) / 64;
+	// Every index has to fit in a uint32_t.
+	static constexpr uint32_t kMaxSlabs = UINT32_MAX / kSlabSize;
+	// The directory of slabs doubles when it is full, starting at this size.
+	static constexpr uint32_t kFirstDirectorySize = 4;
+	// Enough for every directory the first can be doubled into.
+	static constexpr uint32_t kMaxDirectories = 32;
+
+	struct Slab {
+		T * entries;
+		uint64_t used[kWordsPerSlab];
+	};
+
+	Slab * _directory;
+	uint32_t _directorySize;
+	// The directories that were outgrown. get may still be reading one of
+	// them, so they are only freed by reset.
+	Slab * _retired[kMaxDirectories];
+	uint32_t _retiredCount;
+	uint32_t _slabCount;
+	uint32_t _inUse;
+
+	uint64_t &
+	usedWord(uint32_t index) const
+	{
+		return _directory[index / kSlabSize].used[index % kSlabSize / 64];
+	}
+
+	static uint64_t
+	bitOf(uint32_t index)
+	{
+		return 1ull << (index % kSlabSize % 64);
+	}
+
+	// Moves the slabs to a directory twice the size. Readers keep using the
+	// old one until they see the new one.
+	bool
+	growDirectory()
+	{
+		const uint32_t size = _directorySize == 0 ? kFirstDirectorySize : _directorySize * 2;
+		if (_retiredCount == kMaxDirectories || size < _directorySize) {
+			return false;
+		}
+		Slab * directory = Allocator::template allocate<Slab>(size);
+		if (directory == nullptr) {
+			return false;
+		}
+		for (uint32_t slab = 0; slab < _slabCount; slab++) {
+			directory[slab] = _directory[slab];
+		}
+		if (_directory != nullptr) {
+			_retired[_retiredCount++] = _directory;
+		}
+		__atomic_store_n(&_directory, directory, __ATOMIC_RELEASE);
+		_directorySize = size;
+		return true;
+	}
+
+  public:
+	SlabPool() : _directory(nullptr), _directorySize(0), _retired(), _retiredCount(0), _slabCount(0), _inUse(0) {}
+	~SlabPool() { reset(); }
+
+	SlabPool(const SlabPool &)             = delete;
+	SlabPool & operator=(const SlabPool &) = delete;
+
+	/**
+	 * Hands out the lowest free entry, adding a slab if every entry is in use.
+	 * Returns false if a slab (or a bigger directory for it) can't be
+	 * allocated.
+	 */
+	bool
+	allocate(uint32_t * index)
+	{
+		for (uint32_t slab = 0; slab < _slabCount; slab++) {
+			for (uint32_t word = 0; word < kWordsPerSlab; word++) {
+				// The last word of a slab may have fewer than 64 entries.
+				const uint32_t entries = kSlabSize - word * 64 < 64 ? kSlabSize - word * 64 : 64;
+				const uint64_t mask    = entries == 64 ? ~0ull : (1ull << entries) - 1;
+				const uint64_t free    = ~_directory[slab].used[word] & mask;
+				if (free != 0) {
+					const uint32_t bit = (uint32_t)__builtin_ctzll(free);
+					_directory[slab].used[word] |= 1ull << bit;
+					_inUse++;
+					*index = slab * kSlabSize + word * 64 + bit;
+					return true;
+				}
+			}
+		}
+
+		if (_slabCount == kMaxSlabs) {
+			return false;
+		}
+		T * entries = Allocator::template allocate<T>(kSlabSize);
+		if (entries == nullptr) {
+			return false;
+		}
+		if (_slabCount == _directorySize && !growDirectory()) {
+			Allocator::template deallocate<T>(entries, kSlabSize);
+			return false;
+		}
+		for (uint32_t word = 0; word < kWordsPerSlab; word++) {
+			_directory[_slabCount].used[word] = 0;
+		}
+		_directory[_slabCount].used[0] = 1;
+		__atomic_store_n(&_directory[_slabCount].entries, entries, __ATOMIC_RELEASE);
+		*index = _slabCount * kSlabSize;
+		_slabCount++;
+		_inUse++;
+		return true;
+	}
+
+	/**
+	 * Returns an entry to the pool. Its memory is left as is, the next user
+	 * gets it as it was left.
+	 */
+	void
+	release(uint32_t index)
+	{
+		if (isAllocated(index)) {
+			usedWord(index) &= ~bitOf(index);
+			_inUse--;
+		}
+	}
+
+	bool
+	isAllocated(uint32_t index) const
+	{
+		return index < _slabCount * kSlabSize && (usedWord(index) & bitOf(index)) != 0;
+	}
+
+	T *
+	get(uint32_t index) const
+	{
+		Slab * directory = __atomic_load_n(&_directory, __ATOMIC_ACQUIRE);
+		return &__atomic_load_n(&directory[index / kSlabSize].entries, __ATOMIC_ACQUIRE)[index % kSlabSize];
+	}
+
+	/**
+	 * How many entries the slabs allocated so far hold, every index below this
+	 * can be passed to get.
+	 */
+	uint32_t
+	capacity() const
+	{
+		return _slabCount * kSlabSize;
+	}
+
+	uint32_t
+	inUse() const
+	{
+		return _inUse;
+	}
+
+	uint32_t
+	slabCount() const
+	{
+		return _slabCount;
+	}
+
+	/**
+	 * Frees the slabs at the end of the pool that have nothing in use. Nobody
+	 * may be holding entries of those slabs.
+	 */
+	void
+	trim()
+	{
+		while (_slabCount > 0) {
+			for (uint32_t word = 0; word < kWordsPerSlab; word++) {
+				if (_directory[_slabCount - 1].used[word] != 0) {
+					return;
+				}
+			}
+			_slabCount--;
+			Allocator::template deallocate<T>(_directory[_slabCount].entries, kSlabSize);
+			_directory[_slabCount].entries = nullptr;
+		}
+	}
+
+	/**
+	 * Releases every entry but keeps the slabs for the next user.
+	 */
+	void
+	releaseAll()
+	{
+		for (uint32_t slab = 0; slab < _slabCount; slab++) {
+			for (uint32_t word = 0; word < kWordsPerSlab; word++) {
+				_directory[slab].used[word] = 0;
+			}
+		}
+		_inUse = 0;
+	}
+
+	/**
+	 * Releases every entry and frees every slab and directory. Nobody may be
+	 * holding entries of the pool.
+	 */
+	void
+	reset()
+	{
+		releaseAll();
+		trim();
+		uint32_t size = kFirstDirectorySize;
+		for (uint32_t i = 0; i < _retiredCount; i++, size *= 2) {
+			Allocator::template deallocate<Slab>(_retired[i], size);
+			_retired[i] = nullptr;
+		}
+		if (_directory != nullptr) {
+			Allocator::template deallocate<Slab>(_directory, _directorySize);
+		}
+		_directory     = nullptr;
+		_directorySize = 0;
+		_retiredCount  = 0;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
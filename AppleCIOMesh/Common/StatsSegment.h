@@ -0,0 +1,276 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace AppleCIOMeshUtils
+{
+
+constexpr uint32_t kStatsSegmentPeerCount  = 32;
+constexpr uint32_t kStatsSegmentPhaseCount = 6;
+// Bucket i of a StatsSegmentHistogram counts the values in [2^i, 2^(i+1)),
+// bucket 0 also counts 0. The last bucket counts everything above.
+constexpr uint32_t kStatsSegmentHistogramBuckets = 40;
+
+// A coarse histogram of nanosecond times, small enough to publish.
+struct StatsSegmentHistogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[kStatsSegmentHistogramBuckets];
+};
+
+// The stats a process publishes. Every field is a uint64_t so the seqlock can
+// copy the data a word at a time. Times are in nanoseconds.
+struct StatsSegmentData {
+	// Incremented every time the data is published.
+	uint64_t publishCount;
+	// When the data was published, in nsec of a monotonic clock.
+	uint64_t publishTime;
+	uint64_t nodeId;
+	uint64_t syncCount;
+	uint64_t syncTotalTime;
+	uint64_t syncMinTime;
+	uint64_t syncMaxTime;
+	uint64_t encryptCount;
+	uint64_t encryptTotalTime;
+	uint64_t decryptCount;
+	uint64_t decryptTotalTime;
+	uint64_t keyDerivations;
+	uint64_t stragglerMask;
+	uint64_t peerBytesSent[kStatsSegmentPeerCount];
+	uint64_t peerBytesReceived[kStatsSegmentPeerCount];
+	// Syncs each peer took part in, and how late its data was compared to
+	// the median peer (see StragglerDetector).
+	uint64_t peerSyncCount[kStatsSegmentPeerCount];
+	uint64_t peerAverageLateness[kStatsSegmentPeerCount];
+	uint64_t peerP99Lateness[kStatsSegmentPeerCount];
+	StatsSegmentHistogram syncTime;
+	StatsSegmentHistogram phaseTime[kStatsSegmentPhaseCount];
+};
+static_assert(sizeof(StatsSegmentData) % sizeof(uint64_t) == 0, "StatsSegmentData is copied a word at a time");
+
+constexpr char kStatsSegmentMagic[8]   = {'M', 'E', 'S', 'H', 'S', 'T', 'A', 'T'};
+constexpr uint32_t kStatsSegmentVersion = 1;
+
+// The layout of the shared memory segment. The header is written once when
+// the segment is created. The data is protected by a seqlock: the writer
+// makes sequence odd while it updates the data, so a reader that saw the
+// same even sequence before and after copying the data got a consistent copy.
+// Readers never write to the segment and the writer never waits for them.
+//
+// Only ever append fields to StatsSegmentData and bump kStatsSegmentVersion.
+struct StatsSegment {
+	char magic[8];
+	uint32_t version;
+	uint32_t size;
+	// The process publishing the stats, so readers can tell a stale segment.
+	uint32_t pid;
+	uint32_t reserved;
+	alignas(64) uint64_t sequence;
+	StatsSegmentData data;
+};
+
+inline bool
+is_valid_stats_segment(const StatsSegment & segment)
+{
+	return memcmp(segment.magic, kStatsSegmentMagic, sizeof(segment.magic)) == 0 && segment.version == kStatsSegmentVersion &&
+	       segment.size == sizeof(StatsSegment);
+}
+
+// Adds the samples of a LogLinearHistogram into a published histogram.
+template <typename Histogram>
+inline void
+add_to_stats_segment_histogram(StatsSegmentHistogram & out, const Histogram & histogram)
+{
+	for (uint32_t bucket = 0; bucket < Histogram::kBucketCount; bucket++) {
+		const uint64_t count = histogram.count_at_bucket(bucket);
+		if (count == 0) {
+			continue;
+		}
+		// Every histogram bucket lies within one power of two.
+		const uint64_t lowest = Histogram::lowest_value_for_bucket(bucket);
+		uint32_t index        = lowest == 0 ? 0 : 63u - (uint32_t)__builtin_clzll(lowest);
+		if (index >= kStatsSegmentHistogramBuckets) {
+			index = kStatsSegmentHistogramBuckets - 1;
+		}
+		out.buckets[index] += count;
+		out.count += count;
+	}
+	out.sum += histogram.sum();
+	if (histogram.maximum() > out.max) {
+		out.max = histogram.maximum();
+	}
+}
+
+// Returns the estimated value at the quantile q (0.0 - 1.0) of a published
+// histogram: the top of the bucket holding the q-th sample, capped by the
+// largest value. Accurate to within a factor of two.
+inline uint64_t
+stats_segment_quantile(const StatsSegmentHistogram & histogram, double q)
+{
+	if (histogram.count == 0) {
+		return 0;
+	}
+	uint64_t rank = (uint64_t)(q * (double)histogram.count + 0.5);
+	if (rank == 0) {
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < kStatsSegmentHistogramBuckets; i++) {
+		seen += histogram.buckets[i];
+		if (seen >= rank) {
+			const uint64_t top = (2ull << i) - 1;
+			return top < histogram.max ? top : histogram.max;
+		}
+	}
+	return histogram.max;
+}
+
+// Publishes data. There must only be one writer per segment.
+inline void
+publish_stats_segment(StatsSegment * segment, const StatsSegmentData & data)
+{
+	const uint64_t sequence = __atomic_load_n(&segment->sequence, __ATOMIC_RELAXED);
+	__atomic_store_n(&segment->sequence, sequence + 1, __ATOMIC_RELAXED);
+	// The odd sequence must be visible before any of the new data.
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	const uint64_t * from = (const uint64_t *)&data;
+	uint64_t * to         = (uint64_t *)&segment->data;
+	for (size_t i = 0; i < sizeof(StatsSegmentData) / sizeof(uint64_t); i++) {
+		__atomic_store_n(&to[i], from[i], __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&segment->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copies a consistent snapshot of the published data into out. Gives up and
+ * returns false if the writer was in the middle of publishing on each of the
+ * attempts, which only happens if the writer died mid update or publishes
+ * back to back.
+ */
+inline bool
+read_stats_segment(const StatsSegment * segment, StatsSegmentData * out, uint32_t attempts = 1000)
+{
+	const uint64_t * from = (const uint64_t *)&segment->data;
+	uint64_t * to         = (uint64_t *)out;
+	for (uint32_t attempt = 0; attempt < attempts; attempt++) {
+		const uint64_t before = __atomic_load_n(&segment->sequence, __ATOMIC_ACQUIRE);
+		if (before & 1) {
+			sched_yield();
+			continue;
+		}
+		for (size_t i = 0; i < sizeof(StatsSegmentData) / sizeof(uint64_t); i++) {
+			to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+		}
+		// The data must be read before the sequence is checked again.
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&segment->sequence, __ATOMIC_RELAXED) == before) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Creates the POSIX shared memory segment name (e.g. "/meshstats", at most 31
+ * characters on Darwin) for publishing, replacing a stale one, and maps it.
+ * Returns nullptr and sets error if it could not be created.
+ */
+inline StatsSegment *
+create_stats_segment(const char * name, int * error)
+{
+	shm_unlink(name);
+	const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		*error = errno;
+		return nullptr;
+	}
+	if (ftruncate(fd, sizeof(StatsSegment)) != 0) {
+		*error = errno;
+		close(fd);
+		shm_unlink(name);
+		return nullptr;
+	}
+	void * memory = mmap(nullptr, sizeof(StatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED) {
+		*error = errno;
+		shm_unlink(name);
+		return nullptr;
+	}
+
+	StatsSegment * segment = (StatsSegment *)memory;
+	memset(segment, 0, sizeof(StatsSegment));
+	memcpy(segment->magic, kStatsSegmentMagic, sizeof(segment->magic));
+	segment->version = kStatsSegmentVersion;
+	segment->size    = sizeof(StatsSegment);
+	segment->pid     = (uint32_t)getpid();
+	return segment;
+}
+
+/**
+ * Maps the segment name read-only. Returns nullptr and sets error (EPROTO if
+ * it is not a stats segment of this version) if it could not be opened.
+ */
+inline const StatsSegment *
+open_stats_segment(const char * name, int * error)
+{
+	const int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		*error = errno;
+		return nullptr;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(StatsSegment)) {
+		*error = EPROTO;
+		close(fd);
+		return nullptr;
+	}
+	void * memory = mmap(nullptr, sizeof(StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED) {
+		*error = errno;
+		return nullptr;
+	}
+	const StatsSegment * segment = (const StatsSegment *)memory;
+	if (!is_valid_stats_segment(*segment)) {
+		munmap(memory, sizeof(StatsSegment));
+		*error = EPROTO;
+		return nullptr;
+	}
+	return segment;
+}
+
+inline void
+close_stats_segment(const StatsSegment * segment)
+{
+	munmap((void *)segment, sizeof(StatsSegment));
+}
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,243 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include "Common/LogLinearHistogram.h"
+#include <stddef.h>
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Tuning knobs for the StragglerDetector. The defaults flag a peer whose
+// data is, on average, at least 20usec and 25% of the typical arrival time
+// behind the median peer.
+struct StragglerDetectorConfig {
+	// The smoothing factor of the moving averages is 1 / 2^ewmaShift.
+	uint32_t ewmaShift = 4;
+	// Number of syncs a peer has to take part in before it can be flagged.
+	uint32_t warmupSyncs = 32;
+	// Lateness below this (in nsec) is considered noise.
+	uint64_t minLateness = 20 * 1000;
+	// Lateness, as a fraction of the median arrival time, to flag a peer.
+	double flagFraction = 0.25;
+	// A flagged peer is cleared once its lateness drops below this fraction
+	// of the flag threshold. This keeps peers from flapping.
+	double clearFraction = 0.5;
+};
+
+// Attributes the lateness of a sync to the peers the data came from.
+//
+// For every sync, record_sync() is given the time (relative to the start of
+// the sync) at which each peer's data finished arriving. A peer's lateness is
+// how far behind the median peer of that sync it was. Each peer has a
+// histogram of its lateness and an exponentially weighted moving average that
+// drives the detector: a peer that is persistently late compared to the rest
+// is flagged as a straggler until its average lateness recovers.
+//
+// record_sync() must only be called from one thread at a time (the thread
+// finishing the syncs). Every query can be used from any thread.
+template <uint32_t kMaxPeers> class StragglerDetector
+{
+	static_assert(kMaxPeers > 0 && kMaxPeers <= 64, "Peers are tracked in a 64 bit mask");
+
+  public:
+	static constexpr uint32_t kPeerCount = kMaxPeers;
+	using Histogram                      = LogLinearHistogram<7, 34>;
+
+	explicit StragglerDetector(const StragglerDetectorConfig & config = StragglerDetectorConfig()) : _config(config)
+	{
+	}
+
+	// Records one sync. arrivalTimes is indexed by peer and holds the time (in
+	// nsec since the sync started) at which all of that peer's data arrived.
+	// Only peers in peerMask are looked at. Returns the straggler mask after
+	// this sync.
+	uint64_t
+	record_sync(const uint64_t * arrivalTimes, uint64_t peerMask)
+	{
+		uint64_t sorted[kMaxPeers];
+		uint32_t count = 0;
+		for (uint32_t peer = 0; peer < kMaxPeers; peer++) {
+			if (peerMask & (1ull << peer)) {
+				insert_sorted(sorted, count++, arrivalTimes[peer]);
+			}
+		}
+		if (count == 0) {
+			return straggler_mask();
+		}
+
+		const uint64_t median = sorted[(count - 1) / 2];
+		store(_medianEwma, update_ewma(load(_medianEwma), median, _syncs));
+		_syncs++;
+
+		const double medianEwma = (double)load(_medianEwma);
+		const double flagAt     = larger((double)_config.minLateness, medianEwma * _config.flagFraction);
+		const double clearAt    = flagAt * _config.clearFraction;
+		uint64_t mask           = straggler_mask();
+
+		for (uint32_t peer = 0; peer < kMaxPeers; peer++) {
+			if (!(peerMask & (1ull << peer))) {
+				continue;
+			}
+
+			PeerState & state      = _peers[peer];
+			const uint64_t late    = arrivalTimes[peer] > median ? arrivalTimes[peer] - median : 0;
+			const uint64_t samples = load(state.syncs);
+
+			state.lateness.record(late);
+			store(state.latenessEwma, update_ewma(load(state.latenessEwma), late, samples));
+			store(state.syncs, samples + 1);
+			if (arrivalTimes[peer] == sorted[count - 1]) {
+				store(state.lastCount, load(state.lastCount) + 1);
+			}
+
+			const double score = (double)load(state.latenessEwma);
+			const uint64_t bit = 1ull << peer;
+			if (!(mask & bit) && samples + 1 >= _config.warmupSyncs && score > flagAt) {
+				mask |= bit;
+			} else if ((mask & bit) && score < clearAt) {
+				mask &= ~bit;
+			}
+		}
+
+		__atomic_store_n(&_stragglerMask, mask, __ATOMIC_RELAXED);
+		return mask;
+	}
+
+	// Mask of the peers currently flagged as stragglers.
+	uint64_t
+	straggler_mask() const
+	{
+		return __atomic_load_n(&_stragglerMask, __ATOMIC_RELAXED);
+	}
+
+	bool
+	is_straggler(uint32_t peer) const
+	{
+		return peer < kMaxPeers && (straggler_mask() & (1ull << peer)) != 0;
+	}
+
+	// Moving average of how late (in nsec) the peer was compared to the median.
+	uint64_t
+	average_lateness(uint32_t peer) const
+	{
+		return peer < kMaxPeers ? load(_peers[peer].latenessEwma) : 0;
+	}
+
+	// Moving average of the median arrival time (in nsec).
+	uint64_t
+	average_median() const
+	{
+		return load(_medianEwma);
+	}
+
+	// Number of syncs the peer took part in.
+	uint64_t
+	sync_count(uint32_t peer) const
+	{
+		return peer < kMaxPeers ? load(_peers[peer].syncs) : 0;
+	}
+
+	// Number of syncs where the peer was the last one to arrive.
+	uint64_t
+	last_count(uint32_t peer) const
+	{
+		return peer < kMaxPeers ? load(_peers[peer].lastCount) : 0;
+	}
+
+	// Histogram of the peer's lateness (in nsec), or nullptr for invalid peers.
+	const Histogram *
+	lateness(uint32_t peer) const
+	{
+		return peer < kMaxPeers ? &_peers[peer].lateness : nullptr;
+	}
+
+	// Clears all history. Not safe against a concurrent record_sync().
+	void
+	reset()
+	{
+		for (uint32_t peer = 0; peer < kMaxPeers; peer++) {
+			_peers[peer].lateness.reset();
+			store(_peers[peer].latenessEwma, 0);
+			store(_peers[peer].syncs, 0);
+			store(_peers[peer].lastCount, 0);
+		}
+		store(_medianEwma, 0);
+		_syncs = 0;
+		__atomic_store_n(&_stragglerMask, 0, __ATOMIC_RELAXED);
+	}
+
+  private:
+	struct PeerState {
+		Histogram lateness;
+		uint64_t latenessEwma{0};
+		uint64_t syncs{0};
+		uint64_t lastCount{0};
+	};
+
+	static uint64_t
+	load(const uint64_t & value)
+	{
+		return __atomic_load_n(&value, __ATOMIC_RELAXED);
+	}
+
+	static void
+	store(uint64_t & value, uint64_t newValue)
+	{
+		__atomic_store_n(&value, newValue, __ATOMIC_RELAXED);
+	}
+
+	static double
+	larger(double a, double b)
+	{
+		return a > b ? a : b;
+	}
+
+	static void
+	insert_sorted(uint64_t * values, uint32_t count, uint64_t value)
+	{
+		uint32_t i = count;
+		while (i > 0 && values[i - 1] > value) {
+			values[i] = values[i - 1];
+			i--;
+		}
+		values[i] = value;
+	}
+
+	// Adds the (samples + 1)th sample to the moving average. Until there are
+	// 2^ewmaShift samples this is a plain mean so the first few samples do not
+	// dominate the average.
+	uint64_t
+	update_ewma(uint64_t average, uint64_t sample, uint64_t samples) const
+	{
+		const uint64_t window  = 1ull << _config.ewmaShift;
+		const uint64_t divisor = samples + 1 < window ? samples + 1 : window;
+		if (sample >= average) {
+			return average + (sample - average) / divisor;
+		}
+		return average - (average - sample) / divisor;
+	}
+
+	const StragglerDetectorConfig _config;
+	PeerState _peers[kMaxPeers];
+	uint64_t _medianEwma{0};
+	uint64_t _syncs{0};
+	uint64_t _stragglerMask{0};
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,224 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Number of phase times kept per sync. This matches MeshSyncPhaseCount.
+constexpr uint32_t kSyncTracePhaseCount = 6;
+
+// Phase time of a phase that did not happen in the sync.
+constexpr uint32_t kSyncTracePhaseNotDone = UINT32_MAX;
+
+// One sync as stored in the trace ring and in trace files. The layout is the
+// on-disk format (host endianness, which is little endian on every platform
+// we run on), so only ever append fields and bump kSyncTraceVersion.
+struct SyncTraceRecord {
+	// Incremented for every sync traced, including the ones that were dropped
+	// because the ring was full, so gaps show where records were lost.
+	uint64_t sequence;
+	// When the sync finished (CLOCK_UPTIME_RAW nsec).
+	uint64_t endTime;
+	// Duration of the sync in nsec.
+	uint64_t syncTime;
+	uint64_t nodeMask;
+	uint64_t bufferSize;
+	// Time each phase finished, in nsec since the sync started. Saturates just
+	// below kSyncTracePhaseNotDone (~4.3 seconds).
+	uint32_t phaseTime[kSyncTracePhaseCount];
+};
+static_assert(sizeof(SyncTraceRecord) == 64, "SyncTraceRecord is part of the trace file format");
+
+constexpr char kSyncTraceMagic[8]   = {'M', 'E', 'S', 'H', 'S', 'Y', 'N', 'C'};
+constexpr uint32_t kSyncTraceVersion = 1;
+
+// A trace file is this header followed by SyncTraceRecords until the end of
+// the file.
+struct SyncTraceFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t phaseCount;
+	uint32_t nodeId;
+	// When the trace was started (CLOCK_UPTIME_RAW nsec).
+	uint64_t startTime;
+};
+static_assert(sizeof(SyncTraceFileHeader) == 32, "SyncTraceFileHeader is part of the trace file format");
+
+inline SyncTraceFileHeader
+make_sync_trace_header(uint32_t nodeId, uint64_t startTime)
+{
+	SyncTraceFileHeader header;
+	memcpy(header.magic, kSyncTraceMagic, sizeof(header.magic));
+	header.version    = kSyncTraceVersion;
+	header.recordSize = sizeof(SyncTraceRecord);
+	header.phaseCount = kSyncTracePhaseCount;
+	header.nodeId     = nodeId;
+	header.startTime  = startTime;
+	return header;
+}
+
+inline bool
+is_valid_sync_trace_header(const SyncTraceFileHeader & header)
+{
+	return memcmp(header.magic, kSyncTraceMagic, sizeof(header.magic)) == 0 && header.version == kSyncTraceVersion &&
+	       header.recordSize == sizeof(SyncTraceRecord) && header.phaseCount == kSyncTracePhaseCount;
+}
+
+// Converts a phase duration to the value stored in SyncTraceRecord::phaseTime.
+inline uint32_t
+sync_trace_phase_time(uint64_t nanoseconds)
+{
+	return nanoseconds >= kSyncTracePhaseNotDone ? kSyncTracePhaseNotDone - 1 : (uint32_t)nanoseconds;
+}
+
+// A bounded, lock-free ring of SyncTraceRecords. Any number of threads can
+// push() while a single consumer drains it with pop(). When the ring is full
+// new records are dropped (and counted) rather than blocking the producer,
+// which is on the sync path.
+//
+// Every slot carries a sequence number that tells whether it is free for the
+// producer at a given position or holds a record for the consumer, so
+// producers only contend on the head index.
+class SyncTraceRing
+{
+	struct Slot {
+		uint64_t position;
+		SyncTraceRecord record;
+	};
+
+	Slot * const _slots;
+	const uint64_t _mask;
+	alignas(64) uint64_t _head{0};
+	alignas(64) uint64_t _tail{0};
+	alignas(64) uint64_t _sequence{0};
+	uint64_t _dropped{0};
+
+	SyncTraceRing(Slot * slots, uint64_t capacity) : _slots(slots), _mask(capacity - 1)
+	{
+		for (uint64_t i = 0; i < capacity; i++) {
+			_slots[i].position = i;
+		}
+	}
+
+  public:
+	/**
+	 * Creates a ring that holds at least capacity records (rounded up to a power
+	 * of two). Returns nullptr if capacity is 0 or the allocation fails. The
+	 * caller frees the ring with operator delete.
+	 */
+	static SyncTraceRing *
+	create(uint64_t capacity)
+	{
+		if (capacity == 0 || capacity > (1ull << 32)) {
+			return nullptr;
+		}
+		uint64_t rounded = 1;
+		while (rounded < capacity) {
+			rounded <<= 1;
+		}
+
+		Slot * slots = new (std::nothrow) Slot[rounded];
+		if (!slots) {
+			return nullptr;
+		}
+		SyncTraceRing * ring = new (std::nothrow) SyncTraceRing(slots, rounded);
+		if (!ring) {
+			delete[] slots;
+		}
+		return ring;
+	}
+
+	~SyncTraceRing()
+	{
+		delete[] _slots;
+	}
+
+	SyncTraceRing(const SyncTraceRing &)             = delete;
+	SyncTraceRing & operator=(const SyncTraceRing &) = delete;
+
+	uint64_t
+	capacity() const
+	{
+		return _mask + 1;
+	}
+
+	// Number of records that did not fit in the ring.
+	uint64_t
+	dropped() const
+	{
+		return __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+	}
+
+	// Adds a record, assigning its sequence number. Returns false if the ring
+	// was full and the record was dropped.
+	bool
+	push(const SyncTraceRecord & record)
+	{
+		const uint64_t sequence = __atomic_fetch_add(&_sequence, 1, __ATOMIC_RELAXED);
+		uint64_t head           = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+
+		while (true) {
+			Slot & slot           = _slots[head & _mask];
+			const uint64_t offset = __atomic_load_n(&slot.position, __ATOMIC_ACQUIRE);
+			if (offset == head) {
+				// The slot is free, try to claim it.
+				if (__atomic_compare_exchange_n(&_head, &head, head + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+					slot.record          = record;
+					slot.record.sequence = sequence;
+					__atomic_store_n(&slot.position, head + 1, __ATOMIC_RELEASE);
+					return true;
+				}
+				// head was reloaded by the failed exchange.
+			} else if (offset < head) {
+				// The consumer has not freed this slot yet: the ring is full.
+				__atomic_fetch_add(&_dropped, 1, __ATOMIC_RELAXED);
+				return false;
+			} else {
+				// Another producer claimed this position, catch up.
+				head = __atomic_load_n(&_head, __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	// Moves up to maxRecords records, oldest first, into records. Returns the
+	// number of records moved. Only one thread may pop at a time.
+	size_t
+	pop(SyncTraceRecord * records, size_t maxRecords)
+	{
+		size_t count = 0;
+		while (count < maxRecords) {
+			Slot & slot = _slots[_tail & _mask];
+			if (__atomic_load_n(&slot.position, __ATOMIC_ACQUIRE) != _tail + 1) {
+				// Empty, or the producer has not finished writing it.
+				break;
+			}
+			records[count++] = slot.record;
+			__atomic_store_n(&slot.position, _tail + _mask + 1, __ATOMIC_RELEASE);
+			_tail++;
+		}
+		return count;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
@@ -0,0 +1,454 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace AppleCIOMeshUtils
+{
+
+// Usage of a TLSFAllocator, in units.
+struct TLSFAllocatorStats {
+	uint64_t capacity;
+	uint64_t allocated;
+	uint64_t peakAllocated;
+	// Live allocations.
+	uint64_t allocations;
+	uint64_t failedAllocations;
+	uint64_t freeBlocks;
+	uint64_t largestFreeBlock;
+};
+
+// Returns how much of the free space can not be handed out in one allocation:
+// 0 when it is all in one block, approaching 1 when it is scattered in small
+// blocks between allocations.
+inline double
+tlsf_fragmentation(const TLSFAllocatorStats & stats)
+{
+	const uint64_t freeUnits = stats.capacity - stats.allocated;
+	if (freeUnits == 0) {
+		return 0.0;
+	}
+	return 1.0 - (double)stats.largestFreeBlock / (double)freeUnits;
+}
+
+// A two level segregated fit (TLSF) allocator handing out ranges of a space of
+// units, e.g. the pages of a region of memory. Allocating and freeing take
+// constant time: free blocks are kept in lists by size class, found through
+// two levels of bitmaps, and freed blocks are merged with their free
+// neighbours right away.
+//
+// The block headers are kept outside of the space, in tables indexed by unit,
+// so the space itself is never touched (it may be wired or mapped by a
+// driver). Only the entries of the first and last unit of each block are
+// written, so the tables cost little more than their address space.
+//
+// Not thread safe.
+class TLSFAllocator
+{
+  public:
+	static constexpr uint32_t kNone = UINT32_MAX;
+
+  private:
+	// Each power of two of sizes is split into kSecondLevelCount classes, so a
+	// block is at most 1/16th larger than the class it is found in.
+	static constexpr uint32_t kSecondLevelBits  = 4;
+	static constexpr uint32_t kSecondLevelCount = 1u << kSecondLevelBits;
+	static constexpr uint32_t kFirstLevelCount  = 32 - kSecondLevelBits + 1;
+
+	// Indexed by the first unit of the block.
+	struct Block {
+		uint32_t size;
+		uint32_t free;
+		uint32_t previousFree;
+		uint32_t nextFree;
+	};
+
+	const uint32_t _capacity;
+	Block * const _blocks;
+	// Indexed by the last unit of the block, the first unit of the block.
+	uint32_t * const _firstUnit;
+
+	uint32_t _firstLevelMap = 0;
+	uint32_t _secondLevelMap[kFirstLevelCount];
+	uint32_t _freeLists[kFirstLevelCount][kSecondLevelCount];
+
+	uint64_t _allocated         = 0;
+	uint64_t _peakAllocated     = 0;
+	uint64_t _allocations       = 0;
+	uint64_t _failedAllocations = 0;
+	uint64_t _freeBlocks        = 0;
+
+	TLSFAllocator(uint32_t capacity, Block * blocks, uint32_t * firstUnit)
+	    : _capacity(capacity), _blocks(blocks), _firstUnit(firstUnit)
+	{
+		for (uint32_t i = 0; i < kFirstLevelCount; i++) {
+			_secondLevelMap[i] = 0;
+			for (uint32_t j = 0; j < kSecondLevelCount; j++) {
+				_freeLists[i][j] = kNone;
+			}
+		}
+		add_free_block(0, capacity);
+	}
+
+  public:
+	/**
+	 * Creates an allocator of capacity units, all free. Returns nullptr if
+	 * capacity is 0 or the allocation fails. The caller frees the allocator with
+	 * operator delete.
+	 */
+	static TLSFAllocator *
+	create(uint32_t capacity)
+	{
+		if (capacity == 0 || capacity == kNone) {
+			return nullptr;
+		}
+		// Left uninitialized, entries are written before they are read.
+		Block * blocks = new (std::nothrow) Block[capacity];
+		if (!blocks) {
+			return nullptr;
+		}
+		uint32_t * firstUnit = new (std::nothrow) uint32_t[capacity];
+		if (!firstUnit) {
+			delete[] blocks;
+			return nullptr;
+		}
+		TLSFAllocator * allocator = new (std::nothrow) TLSFAllocator(capacity, blocks, firstUnit);
+		if (!allocator) {
+			delete[] firstUnit;
+			delete[] blocks;
+		}
+		return allocator;
+	}
+
+	~TLSFAllocator()
+	{
+		delete[] _firstUnit;
+		delete[] _blocks;
+	}
+
+	TLSFAllocator(const TLSFAllocator &)             = delete;
+	TLSFAllocator & operator=(const TLSFAllocator &) = delete;
+
+	uint32_t
+	capacity() const
+	{
+		return _capacity;
+	}
+
+	/**
+	 * Allocates size units. Returns the first unit of the allocation, or kNone
+	 * if size is 0 or there is no free block large enough.
+	 */
+	uint32_t
+	alloc(uint32_t size)
+	{
+		uint32_t firstLevel, secondLevel;
+		const uint32_t first = size == 0 ? kNone : find_free_block(size, &firstLevel, &secondLevel);
+		if (first == kNone) {
+			_failedAllocations++;
+			return kNone;
+		}
+		remove_free_block(first, firstLevel, secondLevel);
+
+		// Give the rest of the block back.
+		const uint32_t remaining = _blocks[first].size - size;
+		if (remaining > 0) {
+			add_free_block(first + size, remaining);
+		}
+		set_block(first, size, false);
+
+		_allocated += size;
+		_allocations++;
+		if (_allocated > _peakAllocated) {
+			_peakAllocated = _allocated;
+		}
+		return first;
+	}
+
+	/**
+	 * Frees the allocation starting at first, merging it with the free blocks
+	 * around it. first must have been returned by alloc(). Returns the size of
+	 * the allocation, or 0 if it was already freed.
+	 */
+	uint32_t
+	free(uint32_t first)
+	{
+		if (!is_allocated(first)) {
+			return 0;
+		}
+		const uint32_t size = _blocks[first].size;
+		_allocated -= size;
+		_allocations--;
+
+		// A unit that stops being the start of a block gets a size of 0, so
+		// freeing it again is caught by is_allocated().
+		uint32_t start = first;
+		uint32_t end   = first + size;
+		if (end < _capacity && _blocks[end].free) {
+			const uint32_t next = end;
+			end += _blocks[next].size;
+			remove_free_block(next);
+			_blocks[next].size = 0;
+		}
+		if (start > 0) {
+			const uint32_t previous = _firstUnit[start - 1];
+			if (_blocks[previous].free) {
+				start               = previous;
+				_blocks[first].size = 0;
+				remove_free_block(previous);
+			}
+		}
+		add_free_block(start, end - start);
+		return size;
+	}
+
+	// Returns the size of the allocation starting at first (as returned by
+	// alloc()), or 0 if it was freed.
+	uint32_t
+	allocation_size(uint32_t first) const
+	{
+		return is_allocated(first) ? _blocks[first].size : 0;
+	}
+
+	uint64_t
+	allocated() const
+	{
+		return _allocated;
+	}
+
+	/**
+	 * Returns the usage of the allocator. Finding the largest free block walks
+	 * the free list of the largest size class only.
+	 */
+	TLSFAllocatorStats
+	stats() const
+	{
+		TLSFAllocatorStats stats;
+		stats.capacity          = _capacity;
+		stats.allocated         = _allocated;
+		stats.peakAllocated     = _peakAllocated;
+		stats.allocations       = _allocations;
+		stats.failedAllocations = _failedAllocations;
+		stats.freeBlocks        = _freeBlocks;
+		stats.largestFreeBlock  = 0;
+		if (_firstLevelMap != 0) {
+			const uint32_t firstLevel  = 31 - (uint32_t)__builtin_clz(_firstLevelMap);
+			const uint32_t secondLevel = 31 - (uint32_t)__builtin_clz(_secondLevelMap[firstLevel]);
+			for (uint32_t block = _freeLists[firstLevel][secondLevel]; block != kNone; block = _blocks[block].nextFree) {
+				if (_blocks[block].size > stats.largestFreeBlock) {
+					stats.largestFreeBlock = _blocks[block].size;
+				}
+			}
+		}
+		return stats;
+	}
+
+	/**
+	 * Checks that the blocks tile the whole space, that no two free blocks are
+	 * next to each other, and that the free lists and counters match the
+	 * blocks. This walks every block, it is meant for tests.
+	 */
+	bool
+	validate() const
+	{
+		uint64_t allocated = 0, allocations = 0, freeBlocks = 0;
+		bool previousFree  = false;
+		for (uint32_t block = 0; block < _capacity; block += _blocks[block].size) {
+			const Block & b = _blocks[block];
+			if (b.size == 0 || b.size > _capacity - block || _firstUnit[block + b.size - 1] != block) {
+				return false;
+			}
+			if (b.free) {
+				if (previousFree) {
+					return false;
+				}
+				freeBlocks++;
+			} else {
+				allocated += b.size;
+				allocations++;
+			}
+			previousFree = b.free;
+		}
+
+		uint64_t listed = 0;
+		for (uint32_t i = 0; i < kFirstLevelCount; i++) {
+			for (uint32_t j = 0; j < kSecondLevelCount; j++) {
+				const bool mapped = (_firstLevelMap & (1u << i)) && (_secondLevelMap[i] & (1u << j));
+				if (mapped != (_freeLists[i][j] != kNone)) {
+					return false;
+				}
+				uint32_t previous = kNone;
+				for (uint32_t block = _freeLists[i][j]; block != kNone; block = _blocks[block].nextFree) {
+					uint32_t firstLevel, secondLevel;
+					size_class(_blocks[block].size, &firstLevel, &secondLevel);
+					if (!_blocks[block].free || _blocks[block].previousFree != previous || firstLevel != i || secondLevel != j) {
+						return false;
+					}
+					previous = block;
+					listed++;
+				}
+			}
+		}
+		return listed == freeBlocks && freeBlocks == _freeBlocks && allocated == _allocated && allocations == _allocations;
+	}
+
+  private:
+	bool
+	is_allocated(uint32_t first) const
+	{
+		// Also check the entry of the last unit, in case first was the start of
+		// an allocation that was split off a larger free block since.
+		if (first >= _capacity) {
+			return false;
+		}
+		const Block & block = _blocks[first];
+		return !block.free && block.size > 0 && block.size <= _capacity - first && _firstUnit[first + block.size - 1] == first;
+	}
+
+	// The size class holding blocks of size units.
+	static void
+	size_class(uint32_t size, uint32_t * firstLevel, uint32_t * secondLevel)
+	{
+		const uint32_t bit = 31 - (uint32_t)__builtin_clz(size);
+		if (bit < kSecondLevelBits) {
+			*firstLevel  = 0;
+			*secondLevel = size;
+		} else {
+			*firstLevel  = bit - kSecondLevelBits + 1;
+			*secondLevel = (size >> (bit - kSecondLevelBits)) & (kSecondLevelCount - 1);
+		}
+	}
+
+	// Returns the first block of the first non-empty size class from the class
+	// firstLevel, secondLevel up, and that class.
+	uint32_t
+	first_free_block_from(uint32_t * firstLevel, uint32_t * secondLevel) const
+	{
+		uint32_t secondLevelMap = _secondLevelMap[*firstLevel] & (~0u << *secondLevel);
+		if (secondLevelMap == 0) {
+			const uint32_t firstLevelMap = *firstLevel + 1 < kFirstLevelCount ? _firstLevelMap & (~0u << (*firstLevel + 1)) : 0;
+			if (firstLevelMap == 0) {
+				return kNone;
+			}
+			*firstLevel    = (uint32_t)__builtin_ctz(firstLevelMap);
+			secondLevelMap = _secondLevelMap[*firstLevel];
+		}
+		*secondLevel = (uint32_t)__builtin_ctz(secondLevelMap);
+		return _freeLists[*firstLevel][*secondLevel];
+	}
+
+	// Returns a free block of at least size units, and its size class.
+	uint32_t
+	find_free_block(uint32_t size, uint32_t * firstLevel, uint32_t * secondLevel) const
+	{
+		if (size > _capacity) {
+			return kNone;
+		}
+		// Round up to the next size class so every block in the class fits,
+		// which bounds the waste. Near the capacity there may be no next class.
+		uint64_t rounded   = size;
+		const uint32_t bit = 31 - (uint32_t)__builtin_clz(size);
+		if (bit >= kSecondLevelBits) {
+			rounded += (1ull << (bit - kSecondLevelBits)) - 1;
+		}
+		if (rounded > _capacity) {
+			rounded = _capacity;
+		}
+		size_class((uint32_t)rounded, firstLevel, secondLevel);
+		uint32_t block = first_free_block_from(firstLevel, secondLevel);
+		if (block != kNone && _blocks[block].size < size) {
+			// The capped class is the class of size, try the classes above.
+			if (++*secondLevel == kSecondLevelCount) {
+				*secondLevel = 0;
+				++*firstLevel;
+			}
+			block = *firstLevel < kFirstLevelCount ? first_free_block_from(firstLevel, secondLevel) : kNone;
+		}
+		if (block != kNone) {
+			return block;
+		}
+
+		// The larger classes are empty, but the first block of the class of
+		// size itself may still be large enough.
+		size_class(size, firstLevel, secondLevel);
+		block = _freeLists[*firstLevel][*secondLevel];
+		return block != kNone && _blocks[block].size >= size ? block : kNone;
+	}
+
+	void
+	set_block(uint32_t first, uint32_t size, bool free)
+	{
+		_blocks[first].size          = size;
+		_blocks[first].free          = free;
+		_firstUnit[first + size - 1] = first;
+	}
+
+	void
+	add_free_block(uint32_t first, uint32_t size)
+	{
+		uint32_t firstLevel, secondLevel;
+		size_class(size, &firstLevel, &secondLevel);
+		set_block(first, size, true);
+
+		const uint32_t head         = _freeLists[firstLevel][secondLevel];
+		_blocks[first].previousFree = kNone;
+		_blocks[first].nextFree     = head;
+		if (head != kNone) {
+			_blocks[head].previousFree = first;
+		}
+		_freeLists[firstLevel][secondLevel] = first;
+		_firstLevelMap |= 1u << firstLevel;
+		_secondLevelMap[firstLevel] |= 1u << secondLevel;
+		_freeBlocks++;
+	}
+
+	void
+	remove_free_block(uint32_t first)
+	{
+		uint32_t firstLevel, secondLevel;
+		size_class(_blocks[first].size, &firstLevel, &secondLevel);
+		remove_free_block(first, firstLevel, secondLevel);
+	}
+
+	void
+	remove_free_block(uint32_t first, uint32_t firstLevel, uint32_t secondLevel)
+	{
+		Block & block = _blocks[first];
+		if (block.previousFree != kNone) {
+			_blocks[block.previousFree].nextFree = block.nextFree;
+		} else {
+			_freeLists[firstLevel][secondLevel] = block.nextFree;
+		}
+		if (block.nextFree != kNone) {
+			_blocks[block.nextFree].previousFree = block.previousFree;
+		}
+		block.free = false;
+
+		if (_freeLists[firstLevel][secondLevel] == kNone) {
+			_secondLevelMap[firstLevel] &= ~(1u << secondLevel);
+			if (_secondLevelMap[firstLevel] == 0) {
+				_firstLevelMap &= ~(1u << firstLevel);
+			}
+		}
+		_freeBlocks--;
+	}
+};
+
+} // namespace AppleCIOMeshUtils
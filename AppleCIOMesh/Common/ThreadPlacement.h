@@ -0,0 +1,324 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+#pragma once
+
+#include "Common/LargePages.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#include <sched.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/thread_policy.h>
+#endif
+
+namespace AppleCIOMeshUtils
+{
+
+constexpr uint32_t kMaxPlacementCpus    = 256;
+constexpr uint32_t kMaxPlacementDomains = 16;
+// Node ranks that can be configured, this matches kMaxExtendedMeshNodes.
+constexpr uint32_t kMaxPlacementRanks = 32;
+constexpr uint32_t kPlacementAuto     = UINT32_MAX;
+
+struct PlacementCpuSet {
+	uint64_t bits[kMaxPlacementCpus / 64];
+
+	void
+	add(uint32_t cpu)
+	{
+		bits[cpu / 64] |= 1ull << (cpu % 64);
+	}
+
+	bool
+	contains(uint32_t cpu) const
+	{
+		return cpu < kMaxPlacementCpus && (bits[cpu / 64] >> (cpu % 64)) & 1;
+	}
+
+	uint32_t
+	count() const
+	{
+		uint32_t count = 0;
+		for (uint64_t word : bits) {
+			count += (uint32_t)__builtin_popcountll(word);
+		}
+		return count;
+	}
+};
+
+// The CPUs that share memory (a NUMA node) or a cache (a CPU cluster).
+struct PlacementTopology {
+	uint32_t domainCount;
+	PlacementCpuSet cpus[kMaxPlacementDomains];
+};
+
+// Which domain the crypto thread of each node rank runs in.
+struct PlacementConfig {
+	uint32_t domainForRank[kMaxPlacementRanks];
+	// For the ranks that are not listed, kPlacementAuto to spread them.
+	uint32_t defaultDomain;
+};
+
+/**
+ * Parses a Linux CPU list such as "0-3,8,10-11" (as in the cpulist files in
+ * sysfs) into cpus. Returns false if it is malformed or lists a CPU beyond
+ * kMaxPlacementCpus.
+ */
+inline bool
+parse_cpu_list(const char * text, PlacementCpuSet * cpus)
+{
+	memset(cpus, 0, sizeof(*cpus));
+	const char * p = text;
+	while (*p && *p != '\n') {
+		char * end;
+		const unsigned long first = strtoul(p, &end, 10);
+		if (end == p) {
+			return false;
+		}
+		unsigned long last = first;
+		p                  = end;
+		if (*p == '-') {
+			last = strtoul(p + 1, &end, 10);
+			if (end == p + 1) {
+				return false;
+			}
+			p = end;
+		}
+		if (last < first || last >= kMaxPlacementCpus) {
+			return false;
+		}
+		for (unsigned long cpu = first; cpu <= last; cpu++) {
+			cpus->add((uint32_t)cpu);
+		}
+		if (*p == ',') {
+			p++;
+		} else if (*p && *p != '\n') {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Splits cpuCount CPUs in domains of cpusPerDomain consecutive CPUs, e.g. the
+// CPU clusters of a Darwin machine.
+inline void
+make_cluster_topology(uint32_t cpuCount, uint32_t cpusPerDomain, PlacementTopology * topology)
+{
+	memset(topology, 0, sizeof(*topology));
+	if (cpuCount > kMaxPlacementCpus) {
+		cpuCount = kMaxPlacementCpus;
+	}
+	if (cpusPerDomain == 0) {
+		cpusPerDomain = cpuCount;
+	}
+	for (uint32_t cpu = 0; cpu < cpuCount; cpu++) {
+		const uint32_t domain = cpu / cpusPerDomain < kMaxPlacementDomains ? cpu / cpusPerDomain : kMaxPlacementDomains - 1;
+		topology->cpus[domain].add(cpu);
+		if (domain + 1 > topology->domainCount) {
+			topology->domainCount = domain + 1;
+		}
+	}
+}
+
+/**
+ * Reads the NUMA nodes of a Linux machine from sysfs, the way libnuma does.
+ * Returns false if there are none (not Linux, or a kernel without NUMA).
+ */
+inline bool
+read_numa_topology(PlacementTopology * topology, const char * root = "/sys/devices/system/node")
+{
+	memset(topology, 0, sizeof(*topology));
+	// Node numbers can have holes, so look a bit past the last one found.
+	for (uint32_t node = 0; node < 64 && topology->domainCount < kMaxPlacementDomains; node++) {
+		char path[256];
+		snprintf(path, sizeof(path), "%s/node%u/cpulist", root, node);
+		FILE * file = fopen(path, "r");
+		if (file == nullptr) {
+			continue;
+		}
+		char line[1024];
+		const bool read = fgets(line, sizeof(line), file) != nullptr;
+		fclose(file);
+		PlacementCpuSet cpus;
+		// Memory only nodes have no CPUs to run threads on.
+		if (read && parse_cpu_list(line, &cpus) && cpus.count() > 0) {
+			topology->cpus[topology->domainCount++] = cpus;
+		}
+	}
+	return topology->domainCount > 0;
+}
+
+/**
+ * Parses a placement: "auto" to spread the crypto threads evenly over the
+ * domains, or a comma separated list of RANK:DOMAIN, where RANK can be * for
+ * every rank not listed, e.g. "0:0,1:0,2:1,3:1" or "*:0". Returns false if it
+ * is malformed.
+ */
+inline bool
+parse_placement(const char * spec, PlacementConfig * config)
+{
+	for (uint32_t rank = 0; rank < kMaxPlacementRanks; rank++) {
+		config->domainForRank[rank] = kPlacementAuto;
+	}
+	config->defaultDomain = kPlacementAuto;
+	if (strcmp(spec, "auto") == 0) {
+		return true;
+	}
+
+	if (*spec == '\0') {
+		return false;
+	}
+	const char * p = spec;
+	while (*p) {
+		char * end;
+		unsigned long rank = kPlacementAuto;
+		if (*p == '*') {
+			end = (char *)p + 1;
+		} else {
+			rank = strtoul(p, &end, 10);
+			if (end == p || rank >= kMaxPlacementRanks) {
+				return false;
+			}
+		}
+		if (*end != ':') {
+			return false;
+		}
+		p                          = end + 1;
+		const unsigned long domain = strtoul(p, &end, 10);
+		if (end == p || domain >= kMaxPlacementDomains) {
+			return false;
+		}
+		if (rank == kPlacementAuto) {
+			config->defaultDomain = (uint32_t)domain;
+		} else {
+			config->domainForRank[rank] = (uint32_t)domain;
+		}
+		p = end;
+		if (*p == ',' && p[1] != '\0') {
+			p++;
+		} else if (*p) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Returns the domain the crypto thread threadIndex (of threadCount) for the
+ * node rank runs in. Ranks without a domain configured are spread in
+ * contiguous groups, so neighbouring ranks share a domain. A configured domain
+ * the machine does not have wraps around.
+ */
+inline uint32_t
+placement_domain(
+    const PlacementConfig & config, const PlacementTopology & topology, uint32_t rank, uint32_t threadIndex, uint32_t threadCount)
+{
+	if (topology.domainCount == 0) {
+		return 0;
+	}
+	uint32_t domain = rank < kMaxPlacementRanks ? config.domainForRank[rank] : kPlacementAuto;
+	if (domain == kPlacementAuto) {
+		domain = config.defaultDomain;
+	}
+	if (domain == kPlacementAuto) {
+		domain = threadCount > 0 ? (uint32_t)((uint64_t)threadIndex * topology.domainCount / threadCount) : 0;
+	}
+	return domain % topology.domainCount;
+}
+
+/**
+ * Restricts the calling thread to the CPUs of domain. On Linux the thread is
+ * pinned to them, so memory it touches first is allocated on its NUMA node. On
+ * Darwin threads can not be pinned: the threads of a domain get the same
+ * affinity tag, which asks the scheduler to keep them on CPUs sharing a cache
+ * (a hint that Apple silicon ignores). Returns 0 on success or an errno.
+ */
+inline int
+pin_current_thread(const PlacementTopology & topology, uint32_t domain)
+{
+	if (domain >= topology.domainCount) {
+		return EINVAL;
+	}
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (uint32_t cpu = 0; cpu < kMaxPlacementCpus && cpu < CPU_SETSIZE; cpu++) {
+		if (topology.cpus[domain].contains(cpu)) {
+			CPU_SET(cpu, &set);
+		}
+	}
+	return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : errno;
+#elif defined(__APPLE__)
+	thread_affinity_policy_data_t policy = {(integer_t)domain + 1};
+	const kern_return_t result           = thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY,
+	                                                         (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT);
+	return result == KERN_SUCCESS ? 0 : ENOTSUP;
+#else
+	return ENOTSUP;
+#endif
+}
+
+struct FirstTouchRange {
+	const PlacementTopology * topology;
+	uint32_t domain;
+	void * memory;
+	size_t size;
+	size_t pageSize;
+	size_t touched;
+	int pinError;
+};
+
+inline void *
+first_touch_range(void * arg)
+{
+	FirstTouchRange * range = (FirstTouchRange *)arg;
+	range->pinError         = pin_current_thread(*range->topology, range->domain);
+	range->touched          = prefault_parallel(range->memory, range->size, range->pageSize, 1);
+	return nullptr;
+}
+
+/**
+ * Faults in memory from a thread in domain, so on a NUMA machine its pages
+ * are allocated in the memory of the domain (the first touch policy) and stay
+ * there. Data already in the memory is kept. Returns the number of pages
+ * touched, and in pinError whether the thread could be placed in the domain;
+ * the memory is faulted in either way.
+ */
+inline size_t
+first_touch_in_domain(
+    const PlacementTopology & topology, uint32_t domain, void * memory, size_t size, size_t pageSize, int * pinError = nullptr)
+{
+	FirstTouchRange range = {&topology, domain, memory, size, pageSize, 0, 0};
+	pthread_t thread;
+	if (pthread_create(&thread, nullptr, first_touch_range, &range) == 0) {
+		pthread_join(thread, nullptr);
+	} else {
+		range.pinError = EAGAIN;
+		range.touched  = prefault_parallel(memory, size, pageSize, 1);
+	}
+	if (pinError) {
+		*pinError = range.pinError;
+	}
+	return range.touched;
+}
+
+} // namespace AppleCIOMeshUtils
@@ -164,4 +164,8 @@ typedef void (^NodeMessageBlock)(uint32_t node, NSData * message);
 // if the mesh can be activated
 - (BOOL)canActivate:(uint32_t)nodeCount;
 
+// Like canActivate, for a mesh of the nodes whose partition ranks are set in
+// nodeMask, e.g. an ensemble that lost a node.
+- (BOOL)canActivateNodes:(uint32_t)nodeMask;
+
 @end
@@ -1083,6 +1083,23 @@ fail:
 	return NO;
 }
 
+- (BOOL)canActivateNodes:(uint32_t)nodeMask
+{
+	MCUCI::MeshNodeMask mask = (MCUCI::MeshNodeMask)nodeMask;
+
+	require([self open], fail);
+
+	if (IOConnectCallStructMethod(_connection, MCUCI::Method::canActivateNodes, &mask, sizeof(mask), nullptr, 0) !=
+	    kIOReturnSuccess) {
+		return NO;
+	}
+
+	return YES;
+
+fail:
+	return NO;
+}
+
 static MeshUtils::Optional<MeshNet::TcpConnection>
 waitForConnection(AppleCIOMeshConfigServiceRef * service)
 {
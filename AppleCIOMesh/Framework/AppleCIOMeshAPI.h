@@ -25,7 +25,7 @@ __BEGIN_DECLS
 // bumped when there are additions or changes that
 // are not compatible.
 //
-#define MESHAPI_VERSION 222
+#define MESHAPI_VERSION 233
 
 typedef struct MeshHandle MeshHandle_t;
 
@@ -69,6 +69,60 @@ typedef struct MeshExecPlan {
 	uint64_t maxReads;
 } MeshExecPlan_t;
 
+//
+// Phases of a broadcast and gather. Each phase is measured from the start of
+// the sync on this node to the point where the phase finished, in nanoseconds.
+// Chunks that arrive before this node started its sync count as 0.
+//
+typedef enum MeshSyncPhase {
+	// This node's block is encrypted.
+	MeshSyncPhaseEncrypt = 0,
+	// All of this node's CIO sends have been issued.
+	MeshSyncPhaseSendsIssued,
+	// The first chunk from any peer has been received.
+	MeshSyncPhaseFirstChunk,
+	// The last chunk from the slowest peer has been received.
+	MeshSyncPhaseLastChunk,
+	// The last received chunk has been decrypted.
+	MeshSyncPhaseDecrypt,
+	// All sections from network peers have been received.
+	MeshSyncPhaseNetReceive,
+	MeshSyncPhaseCount
+} MeshSyncPhase_t;
+
+// Number of peers (by extended node rank) in a MeshStatsSnapshot.
+#define MESH_STATS_MAX_PEERS 32
+
+//
+// The counters kept by a mesh handle since it was created. Times are in
+// nanoseconds. Each counter is read atomically, but the counters are not
+// consistent with each other while syncs are running.
+//
+typedef struct MeshStatsSnapshot {
+	// The extended node rank of this node.
+	uint32_t nodeId;
+	// Number of syncs, and their total, shortest and longest time.
+	uint64_t syncCount;
+	uint64_t syncTotalTime;
+	uint64_t syncMinTime;
+	uint64_t syncMaxTime;
+	// Chunks encrypted and decrypted, and the time spent on them.
+	uint64_t encryptCount;
+	uint64_t encryptTotalTime;
+	uint64_t decryptCount;
+	uint64_t decryptTotalTime;
+	// Number of key sets (one per node mask this node is part of and one per
+	// all-to-all pair) derived from the mesh crypto key.
+	uint64_t keyDerivations;
+	// See MeshGetStragglerMask.
+	uint64_t stragglerMask;
+	// User data sent to and received from each peer in the syncs and the send
+	// to all transfers. This is the data of each node's own block, not what
+	// was forwarded on behalf of other nodes.
+	uint64_t peerBytesSent[MESH_STATS_MAX_PEERS];
+	uint64_t peerBytesReceived[MESH_STATS_MAX_PEERS];
+} MeshStatsSnapshot_t;
+
 //
 // Creates and returns the ensemble map based
 // on the number of nodes in the ensemble. The
@@ -165,6 +219,16 @@ void MeshReleaseClaim(MeshHandle_t * mh);
 // This function should be called outside the hot path.
 int MeshSetupBuffersHint(MeshHandle_t * mh, uint64_t bufferSize);
 
+//
+// Loads a table of how many chunks to split blocks in by block size and node
+// count, as written by chunktune (see Common/ChunkTable.h), to be used by the
+// buffers set up after it. Every node of the mesh has to load the same table.
+// NULL goes back to the built in chunk sizes. The table can also be loaded
+// when the handle is created with the MESH_CHUNK_TABLE environment variable.
+// Returns 0 on success, EINVAL if the table is malformed, or the error
+// reading it.
+int MeshLoadChunkTable(MeshHandle_t * mh, const char * path);
+
 //
 // Setup an array of buffers for use with the mesh.  Each buffer
 // in the bufferPtrs array should be bufferSize bytes long.  The
@@ -285,9 +349,21 @@ int MeshSetupSendToAllBufferEx(
 //
 int MeshSetupScatterToAllBuffer(MeshHandle_t * mh, uint64_t scatterBufferId, void * scatterBuf, uint64_t scatterBufSize);
 
+//
+// An all-to-all buffer exchanges a distinct slice of sliceSize
+// bytes between every pair of nodes in the nodeMask: slice j of
+// node i's send buffer lands in slot i of node j's receive buffer,
+// where i and j count the nodes of the mask in rank order. Each
+// pair of nodes encrypts its slices with a key of its own. The
+// nodes have to be in the same partition (ENOTSUP otherwise).
+// All nodes in the mask should call this.
+//
+int MeshSetupAllToAllBuffer(MeshHandle_t * mh, uint64_t nodeMask, uint64_t allToAllBufferId, uint64_t sliceSize);
+
 //
 // Use this to release a specific buffer allocated with
-// MeshSetupSendToAllBuffer() or MeshSetupScatterToAllBuffer().
+// MeshSetupSendToAllBuffer(), MeshSetupScatterToAllBuffer() or
+// MeshSetupAllToAllBuffer().
 // DO NOT use this on a buffer create with MeshSetupBuffers()
 //
 int MeshReleaseBuffer(MeshHandle_t * mh, uint64_t bufferId, uint64_t bufferSize);
@@ -331,6 +407,14 @@ int MeshReceiveFromLeader(MeshHandle_t * mh, uint64_t bufferId, void * bufPtr, u
 int MeshReceiveFromLeaderEx(
     MeshHandle_t * mh, uint32_t leaderNodeId, uint64_t bufferId, void * bufPtr, uint64_t bufSize, uint64_t offset);
 
+//
+// Runs an all-to-all exchange on a buffer set up with
+// MeshSetupAllToAllBuffer(). Both sendBuf and recvBuf hold one
+// sliceSize slice per node of the mask. Every node in the mask
+// has to call this for the exchange to complete.
+//
+int MeshAllToAll(MeshHandle_t * mh, uint64_t allToAllBufferId, const void * sendBuf, void * recvBuf);
+
 // MARK: - Barrier
 
 //
@@ -356,8 +440,145 @@ int MeshBarrier(MeshHandle_t * mh);
 //
 uint64_t MeshGetBufferOffsetForNode(MeshHandle_t * mh, MeshBufferState_t * mbs, uint32_t nodeId);
 
-// Logs the stats for all the recent syncs up to numSyncs.
-// The maximum value allowed for numSyncs is 3K
+// Logs the stats for all the recent syncs up to numSyncs followed by the
+// p50/p90/p99/p99.9 sync and sync phase times and the lateness of every peer
+// since the handle was created.
+// The maximum value allowed for numSyncs is 3K, use MeshStartSyncTrace to keep
+// every sync.
 void MeshLogStats(MeshHandle_t * mh, uint64_t numSyncs);
 
+// Looks up the sync time (in nanoseconds) at each of the count percentiles
+// (0.0 - 100.0) and stores it in values. The sync times cover every sync since
+// the handle was created and are accurate to within 1%. Sync times are only
+// recorded while stats logging is enabled (verbosity 1 or higher).
+//
+// Returns 0 on success or EINVAL if any of the arguments are invalid.
+int MeshGetSyncTimePercentiles(MeshHandle_t * mh, const double * percentiles, uint64_t * values, size_t count);
+
+// Logs the sync time and the time of each sync phase at each of the count
+// percentiles (0.0 - 100.0).
+void MeshLogSyncTimePercentiles(MeshHandle_t * mh, const double * percentiles, size_t count);
+
+// Same as MeshGetSyncTimePercentiles but for a single phase of the syncs. A
+// phase that did not happen in a sync (e.g. MeshSyncPhaseNetReceive without
+// network peers) is not recorded for that sync.
+int MeshGetSyncPhasePercentiles(
+    MeshHandle_t * mh, MeshSyncPhase_t phase, const double * percentiles, uint64_t * values, size_t count);
+
+// Returns a mask of the node ranks that are persistently late, i.e. whose data
+// arrives well after the data of the median peer, sync after sync. A node is
+// cleared from the mask once it catches up again.
+uint64_t MeshGetStragglerMask(MeshHandle_t * mh);
+
+// Same as MeshGetSyncTimePercentiles but for how late (in nanoseconds) the data
+// of nodeId arrived compared to the median peer of each sync.
+int MeshGetPeerLatenessPercentiles(
+    MeshHandle_t * mh, uint32_t nodeId, const double * percentiles, uint64_t * values, size_t count);
+
+// Starts writing a record of every sync (its duration, phase times, node mask
+// and buffer size) to the file at path, in the format read by the synctrace
+// tool. The records are buffered in a ring of at least capacity records and
+// written by a background thread. If the thread falls behind and the ring fills
+// up, records are dropped (and counted) instead of slowing down the syncs.
+// Like the other stats, syncs are only traced with verbosity 1 or higher.
+//
+// Tracing can also be started when the handle is created by setting the
+// MESH_SYNC_TRACE environment variable to the path (and optionally
+// MESH_SYNC_TRACE_RECORDS to the capacity).
+//
+// This must not be called while a MeshBroadcastAndGather is in progress.
+//
+// Returns 0 on success, EINVAL if any of the arguments are invalid, EBUSY if
+// the syncs are already being traced, ENOMEM or the error opening the file.
+int MeshStartSyncTrace(MeshHandle_t * mh, const char * path, uint32_t capacity);
+
+// Writes out the remaining records and closes the trace file. This must not
+// be called while a MeshBroadcastAndGather is in progress. Does nothing if
+// the syncs are not being traced.
+void MeshStopSyncTrace(MeshHandle_t * mh);
+
+// Writes the latest data path events of every mesh thread (chunk encrypt,
+// send, receive and decrypt, network reads and writes, and the gather wait of
+// MeshBroadcastAndGather) to the file at path as a Chrome JSON trace, which
+// can be opened in chrome://tracing or the Perfetto UI. Every event is tagged
+// with its node, chunk and sync.
+//
+// The events are only recorded when the MESH_EVENT_TRACE environment variable
+// is set to a path when the handle is created. Each thread then keeps its last
+// 16K events (or MESH_EVENT_TRACE_EVENTS), and they are also written to that
+// path when the handle is destroyed.
+//
+// Returns 0 on success, EINVAL if any of the arguments are invalid, ENOTSUP if
+// the events are not recorded, or the error opening or writing the file.
+int MeshWriteEventTrace(MeshHandle_t * mh, const char * path);
+
+// Copies the stats counters of the handle into snapshot. Like the other stats,
+// syncs are only counted with verbosity 1 or higher.
+//
+// Returns 0 on success or EINVAL if any of the arguments are invalid.
+int MeshGetStatsSnapshot(MeshHandle_t * mh, MeshStatsSnapshot_t * snapshot);
+
+// Writes the stats of the handle to buffer in the OpenMetrics text format (as
+// scraped by Prometheus): the counters of MeshGetStatsSnapshot, and the sync
+// and sync phase time histograms. Nothing is allocated, so this can be called
+// while syncs are running. Stores the length of the text in length.
+//
+// Returns 0 on success, EINVAL if any of the arguments are invalid or ENOSPC
+// if the text does not fit in size bytes. 64KB is enough for any mesh.
+int MeshWriteOpenMetrics(MeshHandle_t * mh, char * buffer, size_t size, size_t * length);
+
+// Starts serving MeshWriteOpenMetrics over HTTP on a Unix domain socket at
+// socketPath, e.g. for curl --unix-socket socketPath http://localhost/metrics.
+// A background thread answers the scrapes into a buffer allocated up front.
+//
+// The server can also be started when the handle is created by setting the
+// MESH_METRICS_SOCKET environment variable to the path. It is stopped when the
+// handle is destroyed.
+//
+// Returns 0 on success, EINVAL if any of the arguments are invalid, EBUSY if
+// the stats are already served, ENOMEM or the error creating the socket.
+int MeshStartMetricsServer(MeshHandle_t * mh, const char * socketPath);
+
+// Stops serving the stats and removes the socket. Does nothing if the stats
+// are not served.
+void MeshStopMetricsServer(MeshHandle_t * mh);
+
+// Publishes the stats of the handle to the POSIX shared memory object name
+// (e.g. "/meshstats.0"), where tools like meshtop can read them without
+// bothering the mesh. A background thread copies the counters, the per-peer
+// lateness and the sync time histograms into the segment every 100ms, so the
+// data path pays nothing beyond the counting it already does. The layout is
+// described in Common/StatsSegment.h.
+//
+// Publishing can also be started when the handle is created by setting the
+// MESH_STATS_SEGMENT environment variable to the name. It is stopped when the
+// handle is destroyed.
+//
+// Returns 0 on success, EINVAL if any of the arguments are invalid (the name
+// must start with a /), EBUSY if the stats are already published, ENOMEM or
+// the error creating the shared memory.
+int MeshStartStatsSegment(MeshHandle_t * mh, const char * name);
+
+// Stops publishing the stats and removes the shared memory object. Does
+// nothing if the stats are not published.
+void MeshStopStatsSegment(MeshHandle_t * mh);
+
+// Places the crypto threads (one per node rank) in CPU domains: the NUMA
+// nodes of the machine where it has them, the CPU clusters otherwise. spec is
+// "auto" to spread the threads evenly over the domains, or a comma separated
+// list of RANK:DOMAIN, where RANK can be * for the ranks not listed, e.g.
+// "0:0,1:0,2:1,3:1" or "*:0". NULL turns placement off again. It takes effect
+// the next time the readers are started and must not be called while they
+// are starting.
+//
+// On NUMA machines each thread is pinned to the CPUs of its domain, so the
+// memory it touches first is local to it. Darwin can not pin threads, the
+// threads of a domain only get the same affinity tag as a hint.
+//
+// Placement can also be set when the handle is created with the
+// MESH_CRYPTO_PLACEMENT environment variable.
+//
+// Returns 0 on success, EINVAL if the spec is malformed, ENOMEM.
+int MeshSetCryptoPlacement(MeshHandle_t * mh, const char * spec);
+
 __END_DECLS
@@ -20,10 +20,12 @@
 #include <atomic>
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
 #include <mach/mach.h>
 #include <mach/mach_time.h>
 #include <mach/mach_vm.h>
 #include <math.h>
+#include <new>
 #include <os/log.h>
 #include <os/signpost_private.h>
 #include <stdio.h>
@@ -47,8 +49,19 @@ extern "C" {
 #include "AppleCIOMeshUserClientInterface.h"
 #include "Arena.h"
 #include "CFPrefsReader.h"
+#include "Common/AllToAll.h"
+#include "Common/ChunkTable.h"
+#include "Common/CollectiveSchedule.h"
 #include "Common/Config.h"
+#include "Common/EventTrace.h"
 #include "Common/Handshake.h"
+#include "Common/MetricsServer.h"
+#include "Common/NodeMasks.h"
+#include "Common/OpenMetrics.h"
+#include "Common/StatsSegment.h"
+#include "Common/SyncTrace.h"
+#include "Common/ThreadPlacement.h"
+#include "MeshStatistics.h"
 #import <AppleCIOMeshConfigSupport/AppleCIOMeshConfigSupport.h>
 #import <AppleCIOMeshSupport/AppleCIOMeshAPI.h>
 #import <AppleCIOMeshSupport/AppleCIOMeshAPIPrivate.h>
@@ -163,45 +176,24 @@ isNodeParticipating(uint32_t nodeRank, uint64_t mask)
 	return (mask & value) != 0;
 }
 
-// Array of all valid node masks
-static const uint64_t all_masks[] = {
-    0x0003,     0x0005,     0x0006,     0x0009,     0x000A,     0x000C,     0x000F,     0x0030,     0x0050,     0x0060,
-    0x0090,     0x00A0,     0x00C0,     0x00F0,     0x00FF,     0x0101,     0x0202,     0x0300,     0x0404,     0x0500,
-    0x0600,     0x0808,     0x0900,     0x0A00,     0x0C00,     0x0F00,     0x1010,     0x2020,     0x3000,     0x4040,
-    0x5000,     0x6000,     0x8080,     0x9000,     0xA000,     0xC000,     0xF000,     0xFF00,     0xFFFF,     0x10001,
-    0x10100,    0x20002,    0x20200,    0x30000,    0x40004,    0x40400,    0x50000,    0x60000,    0x80008,    0x80800,
-    0x90000,    0xA0000,    0xC0000,    0xF0000,    0x100010,   0x101000,   0x200020,   0x202000,   0x300000,   0x400040,
-    0x404000,   0x500000,   0x600000,   0x800080,   0x808000,   0x900000,   0xA00000,   0xC00000,   0xF00000,   0xFF0000,
-    0xFF00FF,   0xFFFF00,   0x1000001,  0x1000100,  0x1010000,  0x2000002,  0x2000200,  0x2020000,  0x3000000,  0x4000004,
-    0x4000400,  0x4040000,  0x5000000,  0x6000000,  0x8000008,  0x8000800,  0x8080000,  0x9000000,  0xA000000,  0xC000000,
-    0xF000000,  0x10000010, 0x10001000, 0x10100000, 0x20000020, 0x20002000, 0x20200000, 0x30000000, 0x40000040, 0x40004000,
-    0x40400000, 0x50000000, 0x60000000, 0x80000080, 0x80008000, 0x80800000, 0x90000000, 0xA0000000, 0xC0000000, 0xF0000000,
-    0xFF000000, 0xFF0000FF, 0xFF00FF00, 0xFFFF0000, 0xFFFFFFFF};
-
-// Returns true if the node mask is valid
-static bool
-isValidNodeMask(uint64_t nodeMask)
-{
-	for (uint64_t mask : all_masks) {
-		if (nodeMask == mask) {
-			return true;
-		}
-	}
-
-	return false;
-}
-
 static void
 populateMasks(MeshHandle_t * mh)
 {
-	static_assert(sizeof(all_masks) / sizeof(all_masks[0]) == MAX_NODE_MASKS, "Invalid mask count");
-
-	for (uint64_t mask : all_masks) {
-		if (!isNodeParticipating(mh->myNodeId, mask)) {
-			continue;
+	static_assert(AppleCIOMeshUtils::kMeshNodeMaskCount == MAX_NODE_MASKS, "Invalid mask count");
+
+	mh->cryptoKeyArray.key_count =
+	    AppleCIOMeshUtils::mesh_key_masks(mh->myNodeId, mh->cryptoKeyArray.node_masks, MAX_NODE_MASKS);
+
+	// All-to-all buffers encrypt every slice with the keys of the pair of nodes
+	// it goes between, one for each other node of the partition.
+	mh->cryptoKeyArray.pair_count = 0;
+	const uint32_t firstRank      = mh->partitionIdx * 8;
+	for (uint32_t rank = firstRank; rank < firstRank + 8 && rank < kMaxExtendedMeshNodes; rank++) {
+		if (rank != mh->myNodeId) {
+			mh->cryptoKeyArray.pair_masks[mh->cryptoKeyArray.pair_count] =
+			    AppleCIOMeshUtils::all_to_all_pair_mask(mh->myNodeId, rank);
+			mh->cryptoKeyArray.pair_count++;
 		}
-		mh->cryptoKeyArray.node_masks[mh->cryptoKeyArray.key_count] = mask;
-		mh->cryptoKeyArray.key_count++;
 	}
 }
 
@@ -273,6 +265,18 @@ lookupKeyFromMask(MeshHandle_t * mh, uint64_t mask)
 	return NULL;
 }
 
+static MeshCryptoKeyState_t *
+lookupPairKey(MeshHandle_t * mh, uint64_t pairMask)
+{
+	for (uint64_t i = 0; i < mh->cryptoKeyArray.pair_count; i++) {
+		if (mh->cryptoKeyArray.pair_masks[i] == pairMask) {
+			return &mh->cryptoKeyArray.pair_keys[i];
+		}
+	}
+
+	return NULL;
+}
+
 /// Gets node assignments from the CIOMesh driver. Caller is responsible for
 /// freeing the output.
 static MeshConnectedNodeInfo *
@@ -331,20 +335,10 @@ getLocalNodeCountFromMask(uint64_t mask, uint8_t partitionIdx)
 }
 
 // Calculates the offset in a buffer corresponding to given nodeRank within a mask.
-// It does that by counting the bits set before the corresponding NodeRank bit in the mask.
-//
-// For example:
-// In the mask 0b00001100 (2-node mask)
-// The buffer offset for nodeRank=2 is 0
-// The buffer offset for nodeRank=3 is 1
 static uint8_t
 getBufferOffsetForNode(uint64_t mask, uint32_t nodeRank)
 {
-	// set all the bits before the nodeRank's bit.
-	uint64_t lowerBits = (1ull << nodeRank) - 1;
-
-	// isolate the relevant bits and then count.
-	return (uint8_t)__builtin_popcountll(mask & lowerBits);
+	return AppleCIOMeshUtils::mesh_block_index(mask, nodeRank);
 }
 
 // Calculates the Section offset (i.e. which section in the buffer) that belongs
@@ -445,108 +439,6 @@ MeshGetInfo(uint32_t * myNodeId, uint32_t * numNodesTotal)
 	return true;
 }
 
-// Populates the ensemble map with the costs of transferring data from nodes
-// within a 4 node chassis.
-static void
-PopulateChassisMap(MeshEnsembleMap_t * map, uint32_t chassisId, uint32_t nodesPerChassis)
-{
-	uint32_t nodeCount  = map->node_count;
-	uint32_t start_node = chassisId * nodesPerChassis;
-
-	// All nodes within a chassis are connected with CIO and require one CIO hop.
-	for (uint32_t srcNode = start_node; srcNode < (start_node + nodesPerChassis); srcNode++) {
-		for (uint32_t dstNode = start_node; dstNode < (start_node + nodesPerChassis); dstNode++) {
-			if (srcNode != dstNode) {
-				map->route_cost[srcNode * nodeCount + dstNode] = CioHop;
-			}
-		}
-	}
-}
-
-// Populates the ensemble map with the costs of transferring data from
-// nodes across chassis connected with CIO.
-static void
-PopulateInterChassisCIOMap(MeshEnsembleMap_t * map, uint32_t chassisId)
-{
-	uint32_t nodesPerChassis = 4;
-	// starting node on chassis 0 or 2
-	uint32_t startNodeSrc = chassisId * nodesPerChassis;
-	// starting node on chassis 1 or 3
-	uint32_t startNodeDst = (chassisId + 1) * nodesPerChassis;
-	uint32_t nodeCount    = map->node_count;
-
-	for (uint32_t srcNode = startNodeSrc; srcNode < (startNodeSrc + nodesPerChassis); srcNode++) {
-		for (uint32_t dstNode = startNodeDst; dstNode < (startNodeDst + nodesPerChassis); dstNode++) {
-			if (srcNode + nodesPerChassis == dstNode) {
-				map->route_cost[srcNode * nodeCount + dstNode] = CioHop;
-				map->route_cost[dstNode * nodeCount + srcNode] = CioHop;
-			} else {
-				map->route_cost[srcNode * nodeCount + dstNode] = 2 * CioHop;
-				map->route_cost[dstNode * nodeCount + srcNode] = 2 * CioHop;
-			}
-		}
-	}
-}
-
-// Populates the ensemble map with the costs of transferring data from nodes
-// across the network, from partition 0 to partition 1.
-static void
-PopulateInterChassisNetworkMap(MeshEnsembleMap_t * map)
-{
-	uint32_t nodesPerEnsemble = 8;
-	uint32_t startNodeSrc     = 0;
-	uint32_t startNodeDst     = 8;
-	uint32_t nodesPerChassis  = 4;
-	uint32_t nodeCount        = map->node_count;
-
-	// nodes from chassis 0 to nodes from partition 1 (chassis 2/3)
-	for (uint32_t srcNode = startNodeSrc; srcNode < nodesPerChassis; srcNode++) {
-		for (uint32_t dstNode = startNodeDst; dstNode < (startNodeDst + nodesPerEnsemble); dstNode++) {
-			if (srcNode + nodesPerEnsemble == dstNode) {
-				// source node has a direct network connection to destination node
-				map->route_cost[srcNode * nodeCount + dstNode] = NetworkHop;
-				map->route_cost[dstNode * nodeCount + srcNode] = NetworkHop;
-			} else if (srcNode + nodesPerEnsemble + nodesPerChassis == dstNode) {
-				// direct network connection to chassis 2 and direct cio connection to chassis 3
-				map->route_cost[srcNode * nodeCount + dstNode] = NetworkHop + CioHop;
-				map->route_cost[dstNode * nodeCount + srcNode] = NetworkHop + CioHop;
-			} else if (dstNode / nodesPerChassis == 2) {
-				// destination node is in chassis 2
-				map->route_cost[srcNode * nodeCount + dstNode] = NetworkHop + CioHop;
-				map->route_cost[dstNode * nodeCount + srcNode] = NetworkHop + CioHop;
-			} else {
-				// destination node is in chassis 3
-				map->route_cost[srcNode * nodeCount + dstNode] = NetworkHop + (2 * CioHop);
-				map->route_cost[dstNode * nodeCount + srcNode] = NetworkHop + (2 * CioHop);
-			}
-		}
-	}
-
-	// nodes from chassis 1 to nodes from partition 1 (chassis 2/3)
-	startNodeSrc += nodesPerChassis;
-	for (uint32_t srcNode = startNodeSrc; srcNode < startNodeSrc + nodesPerChassis; srcNode++) {
-		for (uint32_t dstNode = startNodeDst; dstNode < (startNodeDst + nodesPerEnsemble); dstNode++) {
-			if (srcNode + nodesPerEnsemble == dstNode) {
-				// source node has a direct network connection to destination node
-				map->route_cost[srcNode * nodeCount + dstNode] = NetworkHop;
-				map->route_cost[dstNode * nodeCount + srcNode] = NetworkHop;
-			} else if (srcNode + nodesPerChassis == dstNode) {
-				// direct network connection to chassis 3 and direct cio connection to chassis 2
-				map->route_cost[srcNode * nodeCount + dstNode] = NetworkHop + CioHop;
-				map->route_cost[dstNode * nodeCount + srcNode] = NetworkHop + CioHop;
-			} else if (dstNode / nodesPerChassis == 2) {
-				// destination node is in chassis 2
-				map->route_cost[srcNode * nodeCount + dstNode] = NetworkHop + (2 * CioHop);
-				map->route_cost[dstNode * nodeCount + srcNode] = NetworkHop + (2 * CioHop);
-			} else {
-				// destination node is in chassis 3
-				map->route_cost[srcNode * nodeCount + dstNode] = NetworkHop + CioHop;
-				map->route_cost[dstNode * nodeCount + srcNode] = NetworkHop + CioHop;
-			}
-		}
-	}
-}
-
 extern "C" MeshEnsembleMap_t *
 MeshGetEnsembleMap(uint32_t nodeCount)
 {
@@ -562,26 +454,16 @@ MeshGetEnsembleMap(uint32_t nodeCount)
 		return NULL;
 	}
 
-	if (nodeCount == 2) {
-		PopulateChassisMap(map, 0, 2);
-	} else if (nodeCount == 4) {
-		PopulateChassisMap(map, 0, 4);
-	} else if (nodeCount == 8) {
-		PopulateChassisMap(map, 0, 4);
-		PopulateChassisMap(map, 1, 4);
-		// populate costs for nodes between chassis 0 and 1
-		PopulateInterChassisCIOMap(map, 0);
-	} else if (nodeCount == 16) {
-		PopulateChassisMap(map, 0, 4);
-		PopulateChassisMap(map, 1, 4);
-		PopulateChassisMap(map, 2, 4);
-		PopulateChassisMap(map, 3, 4);
-		// populate costs for routes between chassis 0 and 1
-		PopulateInterChassisCIOMap(map, 0);
-		// populate costs for routes between chassis 2 and 3
-		PopulateInterChassisCIOMap(map, 2);
-		// populate costs for routes needing the network
-		PopulateInterChassisNetworkMap(map);
+	if (nodeCount >= 2 && (nodeCount <= kMaxCIOMeshNodes || nodeCount % 8 == 0) && nodeCount <= kMaxExtendedMeshNodes) {
+		// Any count up to a partition is the first nodeCount ranks of the
+		// hypercube, more is whole partitions, each node reaching the others
+		// through its network peer in their partition.
+		for (uint32_t srcNode = 0; srcNode < nodeCount; srcNode++) {
+			for (uint32_t dstNode = 0; dstNode < nodeCount; dstNode++) {
+				map->route_cost[srcNode * nodeCount + dstNode] =
+				    AppleCIOMeshUtils::ensemble_route_cost(nodeCount, srcNode, dstNode);
+			}
+		}
 	} else {
 		// invalid node count
 		free(map->route_cost);
@@ -630,8 +512,276 @@ MeshGetBufferOffsetForNode(MeshHandle_t * mh [[maybe_unused]], MeshBufferState_t
 	return nodeOffset;
 }
 
+// MARK: - Event Trace
+
+using AppleCIOMeshUtils::EventTraceBuffer;
+using AppleCIOMeshUtils::TraceEventType;
+
+// Each mesh thread records its data path events into its own buffer, so
+// recording never contends. The buffers are exported as a Chrome JSON trace.
+struct MeshEventTrace {
+	AppleCIOMeshUtils::EventTrace * trace;
+	// Where the trace is written when the handle is destroyed.
+	char path[PATH_MAX];
+};
+
+// Event trace buffer of each mesh thread.
+enum MeshTraceThread : uint32_t {
+	MeshTraceThreadBroadcast = 0,
+	// One per local node, see StartReaders_Private.
+	MeshTraceThreadCrypto,
+	MeshTraceThreadNetSend = MeshTraceThreadCrypto + kMaxCIOMeshNodes,
+	MeshTraceThreadNetReceive,
+	MeshTraceThreadNetSendMultiPartition,
+	MeshTraceThreadNetReceiveMultiPartition,
+	MeshTraceThreadCount,
+};
+
+static const uint64_t kDefaultTraceEventsPerThread = 16 * 1024;
+
+// Returns the buffer of the thread, or NULL if the events are not traced.
+static EventTraceBuffer *
+traceThread(MeshHandle_t * mh, uint32_t thread)
+{
+	return mh->stats.eventTrace ? mh->stats.eventTrace->trace->thread(thread) : NULL;
+}
+
+// Only reads the clock when tracing, the data path calls this a lot.
+static inline uint64_t
+traceTime(EventTraceBuffer * trace)
+{
+	return trace ? clock_gettime_nsec_np(CLOCK_UPTIME_RAW) : 0;
+}
+
+static inline void
+traceEvent(EventTraceBuffer * trace,
+           TraceEventType type,
+           uint64_t begin,
+           uint64_t end,
+           uint32_t node,
+           uint64_t chunk,
+           uint64_t syncId)
+{
+	if (trace) {
+		trace->record(type, begin, end, node, chunk, syncId);
+	}
+}
+
+static void
+start_event_trace(MeshHandle_t * mh, uint32_t myNodeId, const char * path, uint64_t eventsPerThread)
+{
+	MeshEventTrace * eventTrace = new (std::nothrow) MeshEventTrace();
+	if (eventTrace == NULL) {
+		return;
+	}
+	eventTrace->trace = AppleCIOMeshUtils::EventTrace::create(MeshTraceThreadCount, eventsPerThread, myNodeId);
+	if (eventTrace->trace == NULL) {
+		MESHLOG_DEFAULT("Failed to allocate %llu trace events per thread\n", eventsPerThread);
+		delete eventTrace;
+		return;
+	}
+	strlcpy(eventTrace->path, path, sizeof(eventTrace->path));
+
+	char name[32];
+	eventTrace->trace->set_thread_name(MeshTraceThreadBroadcast, "broadcast and gather");
+	for (uint32_t i = 0; i < kMaxCIOMeshNodes; i++) {
+		snprintf(name, sizeof(name), "crypto %u", i);
+		eventTrace->trace->set_thread_name(MeshTraceThreadCrypto + i, name);
+	}
+	eventTrace->trace->set_thread_name(MeshTraceThreadNetSend, "net send");
+	eventTrace->trace->set_thread_name(MeshTraceThreadNetReceive, "net receive");
+	eventTrace->trace->set_thread_name(MeshTraceThreadNetSendMultiPartition, "net send multi-partition");
+	eventTrace->trace->set_thread_name(MeshTraceThreadNetReceiveMultiPartition, "net receive multi-partition");
+
+	MESHLOG_DEFAULT("Tracing mesh events to %s, keeping the last %llu events per thread\n", path,
+	                eventTrace->trace->thread(0)->capacity());
+	mh->stats.eventTrace = eventTrace;
+}
+
+static int
+write_event_trace(MeshHandle_t * mh, const char * path)
+{
+	FILE * file = fopen(path, "w");
+	if (file == NULL) {
+		return errno;
+	}
+	bool written = mh->stats.eventTrace->trace->write_chrome_json(file);
+	if (fclose(file) != 0) {
+		written = false;
+	}
+	return written ? 0 : EIO;
+}
+
+static void
+stop_event_trace(MeshHandle_t * mh)
+{
+	MeshEventTrace * eventTrace = mh->stats.eventTrace;
+	if (eventTrace == NULL) {
+		return;
+	}
+
+	int error = write_event_trace(mh, eventTrace->path);
+	if (error) {
+		MESHLOG_DEFAULT("Failed to write the mesh event trace to %s: %s\n", eventTrace->path, strerror(error));
+	}
+	mh->stats.eventTrace = NULL;
+	delete eventTrace->trace;
+	delete eventTrace;
+}
+
+extern "C" int
+MeshWriteEventTrace(MeshHandle_t * mh, const char * path)
+{
+	if (mh == NULL || path == NULL) {
+		return EINVAL;
+	}
+	if (mh->stats.eventTrace == NULL) {
+		return ENOTSUP;
+	}
+	return write_event_trace(mh, path);
+}
+
+// MARK: - Thread Placement
+
+using AppleCIOMeshUtils::PlacementConfig;
+using AppleCIOMeshUtils::PlacementTopology;
+
+struct MeshCryptoPlacement {
+	PlacementTopology topology;
+	PlacementConfig config;
+};
+
+// The NUMA nodes where there are some, the performance CPU clusters otherwise.
+static void
+readPlacementTopology(PlacementTopology * topology)
+{
+	if (AppleCIOMeshUtils::read_numa_topology(topology)) {
+		return;
+	}
+
+	uint32_t cpuCount       = 0;
+	uint32_t cpusPerCluster = 0;
+	size_t size             = sizeof(cpuCount);
+	if (sysctlbyname("hw.perflevel0.logicalcpu", &cpuCount, &size, NULL, 0) != 0) {
+		size = sizeof(cpuCount);
+		sysctlbyname("hw.ncpu", &cpuCount, &size, NULL, 0);
+	}
+	size = sizeof(cpusPerCluster);
+	if (sysctlbyname("hw.perflevel0.cpusperl2", &cpusPerCluster, &size, NULL, 0) != 0) {
+		cpusPerCluster = 0;
+	}
+	AppleCIOMeshUtils::make_cluster_topology(cpuCount > 0 ? cpuCount : 1, cpusPerCluster, topology);
+}
+
+// Picks the domains of the crypto threads before they are started.
+static void
+planCryptoPlacement(MeshHandle_t * mh, uint32_t numThreads)
+{
+	MeshCryptoPlacement * placement = mh->cryptoPlacement;
+	for (uint32_t x = 0; x < numThreads; x++) {
+		CryptoArg_t * cryptoArg = &mh->cryptoThreadArg[x];
+		cryptoArg->placementDomain =
+		    placement ? AppleCIOMeshUtils::placement_domain(placement->config, placement->topology, cryptoArg->whoami_extended, x,
+		                                                    numThreads)
+		              : AppleCIOMeshUtils::kPlacementAuto;
+	}
+}
+
+// Called by each crypto thread as it starts, so the memory it touches first is
+// in its domain. Placement is an optimization, the thread runs wherever it is
+// if it fails.
+static void
+placeCryptoThread(MeshHandle_t * mh, CryptoArg_t * cryptoArg)
+{
+	MeshCryptoPlacement * placement = mh->cryptoPlacement;
+	if (placement == NULL || cryptoArg->placementDomain == AppleCIOMeshUtils::kPlacementAuto) {
+		return;
+	}
+	int error = AppleCIOMeshUtils::pin_current_thread(placement->topology, cryptoArg->placementDomain);
+	if (error) {
+		MESHLOG("Failed to place the crypto thread for node %u in domain %u: %s\n", cryptoArg->whoami_extended,
+		        cryptoArg->placementDomain, strerror(error));
+		return;
+	}
+	MESHLOG("Crypto thread for node %u runs in domain %u of %u (%u CPUs)\n", cryptoArg->whoami_extended,
+	        cryptoArg->placementDomain, placement->topology.domainCount,
+	        placement->topology.cpus[cryptoArg->placementDomain].count());
+}
+
+extern "C" int
+MeshSetCryptoPlacement(MeshHandle_t * mh, const char * spec)
+{
+	if (mh == NULL) {
+		return EINVAL;
+	}
+	if (spec == NULL) {
+		delete mh->cryptoPlacement;
+		mh->cryptoPlacement = NULL;
+		return 0;
+	}
+
+	MeshCryptoPlacement * placement = new (std::nothrow) MeshCryptoPlacement();
+	if (placement == NULL) {
+		return ENOMEM;
+	}
+	if (!AppleCIOMeshUtils::parse_placement(spec, &placement->config)) {
+		delete placement;
+		return EINVAL;
+	}
+	readPlacementTopology(&placement->topology);
+
+	delete mh->cryptoPlacement;
+	mh->cryptoPlacement = placement;
+	MESHLOG_DEFAULT("Crypto threads are placed by \"%s\" over %u domains\n", spec, placement->topology.domainCount);
+	return 0;
+}
+
+// MARK: - Peer Bytes
+
+// Adds bytes sent to or received from peer, as the data path moves them.
+static inline void
+countPeerTransfer(atomic_uint_fast64_t * peerBytes, uint32_t peer, uint64_t bytes)
+{
+	if (peer < kMaxExtendedMeshNodes) {
+		atomic_fetch_add(&peerBytes[peer], bytes);
+	}
+}
+
+// Adds bytes to the count of every node in mask but this one.
+static void
+countPeerBytes(atomic_uint_fast64_t * peerBytes, uint64_t mask, uint32_t myNodeId, uint64_t bytes)
+{
+	for (uint64_t peers = mask & ~(1ull << myNodeId); peers != 0; peers &= peers - 1) {
+		const uint32_t peer = (uint32_t)__builtin_ctzll(peers);
+		if (peer < kMaxExtendedMeshNodes) {
+			atomic_fetch_add(&peerBytes[peer], bytes);
+		}
+	}
+}
+
 // MARK: - Crypto
 
+// Like traceTime, but the crypto stats and the decrypt phase time want it too.
+// Only reads the clock when one of them is on, the crypto loops call this for
+// every chunk.
+static inline uint64_t
+cryptoTime(MeshHandle_t * mh, EventTraceBuffer * trace)
+{
+	return (trace || mh->verbose_level >= LogStats) ? clock_gettime_nsec_np(CLOCK_UPTIME_RAW) : 0;
+}
+
+// Adds one chunk encrypted or decrypted between start and end to the crypto
+// stats, which are only kept when logging stats.
+static inline void
+countCryptoTime(MeshHandle_t * mh, atomic_uint_fast64_t * totalTime, atomic_uint_fast64_t * count, uint64_t start, uint64_t end)
+{
+	if (mh->verbose_level < LogStats) {
+		return;
+	}
+	atomic_fetch_add(totalTime, end - start);
+	atomic_fetch_add(count, 1);
+}
+
 // The tag should be 16 bytes
 static int
 aes_gcm_encrypt_memory(const void * key,
@@ -792,6 +942,36 @@ calcChunkIndex(MeshHandle_t * mh,
 	abort();
 }
 
+// Records when a sync phase finished. Every slot has a single writer and the
+// chunk counters that are updated right after it publish the time to
+// BroadcastAndGather.
+static inline void
+markPhaseTime(atomic_uint_fast64_t * phaseTime, uint64_t time)
+{
+	atomic_store(phaseTime, time);
+}
+
+// Same as above but keeps the first time the phase was marked.
+static inline void
+markFirstPhaseTime(atomic_uint_fast64_t * phaseTime, uint64_t time)
+{
+	if (atomic_load(phaseTime) == 0) {
+		atomic_store(phaseTime, time);
+	}
+}
+
+static void
+resetPhaseTimes(BufferPerformanceStats_t * performance)
+{
+	performance->encryptDoneTime = 0;
+	for (uint32_t i = 0; i < kMaxExtendedMeshNodes; i++) {
+		atomic_store(&performance->firstChunkTime[i], 0);
+		atomic_store(&performance->lastChunkTime[i], 0);
+		atomic_store(&performance->decryptDoneTime[i], 0);
+	}
+	atomic_store(&performance->netReceiveDoneTime, 0);
+}
+
 static void *
 crypto_thread_assigned_receive(void * arg)
 {
@@ -799,12 +979,14 @@ crypto_thread_assigned_receive(void * arg)
 	MeshHandle_t * mh        = (MeshHandle_t *)cryptoArg->mh;
 	uint32_t whoami_extended = cryptoArg->whoami_extended; // which node I am receiving from
 	uint32_t whoami_local    = cryptoArg->whoami_local;
+	EventTraceBuffer * trace = traceThread(mh, MeshTraceThreadCrypto + whoami_local);
 
 	int ret = setThreadPolicy(mh);
 	if (ret == -1) {
 		atomic_fetch_sub(&mh->num_threads, 1);
 		return NULL;
 	}
+	placeCryptoThread(mh, cryptoArg);
 
 	semaphore_wait_signal(mh->threadInitGoSignal, mh->threadInitReadySignal);
 
@@ -965,8 +1147,9 @@ crypto_thread_assigned_receive(void * arg)
 			cryptoUpdateCounter = &mbs->bufferInfo[readIdx].chunkReceiveCount;
 			cryptoUpdateMask    = &mbs->bufferInfo[readIdx].blockReceiveMask;
 
-			char * srcPtr  = (char *)mbs->bufferInfo[readIdx].shadow;
-			char * destPtr = (char *)mbs->bufferInfo[readIdx].bufferPtr;
+			char * srcPtr         = (char *)mbs->bufferInfo[readIdx].shadow;
+			char * destPtr        = (char *)mbs->bufferInfo[readIdx].bufferPtr;
+			const uint64_t syncId = mbs->bufferInfo[readIdx].traceSyncId;
 
 			uint32_t currentIdx = 0;
 			while (numReadRemaining > 0 && atomic_load(&mh->reader_active) > 0) {
@@ -978,6 +1161,8 @@ crypto_thread_assigned_receive(void * arg)
 					break;
 				}
 
+				const uint64_t waitStart = traceTime(trace);
+
 				bool ret = [mh->service waitOnNextBatchIncomingChunkOf:mbs->baseBufferId + (uint64_t)readIdx
 				                                              fromNode:whoami_local
 				                                         withBatchSize:(uint64_t)numReadRemaining
@@ -989,6 +1174,11 @@ crypto_thread_assigned_receive(void * arg)
 					atomic_store(&mh->reader_active, 0);
 					break;
 				}
+				const uint64_t receivedTime            = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+				BufferPerformanceStats_t & performance = mbs->bufferInfo[readIdx].performance;
+				traceEvent(trace, TraceEventType::Receive, waitStart, receivedTime, whoami_extended,
+				           AppleCIOMeshUtils::kTraceNoChunk, syncId);
+
 				// Go through all the offsets received, mark the receive map
 				for (uint64_t i = 0; i < receivedCount; i++) {
 					uint8_t pIdx             = 0;
@@ -996,9 +1186,22 @@ crypto_thread_assigned_receive(void * arg)
 					auto receiveMapChunkIdx  = (chunksPerBlock * pIdx) + chunkIdxWithinBlock;
 					chunkReceiveMap[receiveMapChunkIdx]++;
 
+					// In a single-partition mbs, the buffers we're decrypting are from are the nodes in the same
+					// partition, so we use their extended_nodeId.
+					//
+					// However, in a multi-partition mbs, the buffers we're decrypting are from our local nodes AND
+					// the network connected nodes. So, we determine the nodeId when we calculate the chunkIdx.
+					// see the implementation of calcChunkIndex().
+					const uint32_t targetNodeId = partitionCount == 1 ? whoami_extended : whoami_local + (pIdx * kMaxCIOMeshNodes);
+
+					markFirstPhaseTime(&performance.firstChunkTime[targetNodeId], receivedTime);
+
 					if (chunkReceiveMap[receiveMapChunkIdx] == mh->chunkDivider) {
 						int err = 0;
 
+						markPhaseTime(&performance.lastChunkTime[targetNodeId], receivedTime);
+						countPeerTransfer(mh->stats.peerBytesReceived, targetNodeId, mbs->chunkSize);
+
 						// Decrypt this chunk now that we received the full thing
 						char * src  = &srcPtr[inputBlockOffset[pIdx] + (mbs->chunkSize * chunkIdxWithinBlock)];
 						char * dest = &destPtr[outputBlockOffset[pIdx] + (mbs->userChunkSize * chunkIdxWithinBlock)];
@@ -1008,19 +1211,12 @@ crypto_thread_assigned_receive(void * arg)
 						// unnecessary memcpy of the tags.
 						char * tag = &tags[currentIdx + i][0];
 
-						// In a single-partition mbs, the buffers we're decrypting are from are the nodes in the same
-						// partition, so we use their extended_nodeId.
-						//
-						// However, in a multi-partition mbs, the buffers we're decrypting are from our local nodes AND
-						// the network connected nodes. So, we determine the nodeId when we calculate the chunkIdx.
-						// see the implementation of calcChunkIndex().
-						const uint32_t targetNodeId =
-						    partitionCount == 1 ? whoami_extended : whoami_local + (pIdx * kMaxCIOMeshNodes);
-
 						auto baseIV          = keyState->crypto_node_iv[targetNodeId];
 						auto originalIVCount = baseIV.count;
 						baseIV.count         = originalIVCount + (uint32_t)chunkIdxWithinBlock;
 
+						const uint64_t decryptStart = cryptoTime(mh, trace);
+
 						err = aes_gcm_decrypt_memory(keyState->crypto_key[targetNodeId], keyState->crypto_key_sz, &baseIV, src,
 						                             cryptoSize, dest, tag, kTagSize, targetNodeId, whoami_extended);
 
@@ -1031,6 +1227,12 @@ crypto_thread_assigned_receive(void * arg)
 						}
 
 						if (err == 0) {
+							const uint64_t decryptTime = cryptoTime(mh, trace);
+							markPhaseTime(&performance.decryptDoneTime[targetNodeId], decryptTime);
+							countCryptoTime(mh, &mh->stats.decrypt_total_time, &mh->stats.num_decrypt, decryptStart, decryptTime);
+							traceEvent(trace, TraceEventType::Decrypt, decryptStart, decryptTime, targetNodeId, receiveMapChunkIdx,
+							           syncId);
+
 							uint64_t chunkIdx = (inputBlockOffset[pIdx] + (mbs->chunkSize * receiveMapChunkIdx)) / mbs->chunkSize;
 							atomic_fetch_or(cryptoUpdateMask, (0x1) << chunkIdx);
 							atomic_fetch_add(cryptoUpdateCounter, 1);
@@ -1111,12 +1313,14 @@ crypto_thread_assigned_encrypt(void * arg)
 	MeshHandle_t * mh        = (MeshHandle_t *)cryptoArg->mh;
 	uint32_t whoami_local    = cryptoArg->whoami_local;
 	uint32_t whoami_extended = cryptoArg->whoami_extended;
+	EventTraceBuffer * trace = traceThread(mh, MeshTraceThreadCrypto + whoami_local);
 
 	int ret = setThreadPolicy(mh);
 	if (ret == -1) {
 		atomic_fetch_sub(&mh->num_threads, 1);
 		return NULL;
 	}
+	placeCryptoThread(mh, cryptoArg);
 
 	semaphore_wait_signal(mh->threadInitGoSignal, mh->threadInitReadySignal);
 
@@ -1282,10 +1486,14 @@ crypto_thread_assigned_encrypt(void * arg)
 		srcPtr += (blockOffset * mbs->userBlockSize);
 		destPtr += (blockOffset * mbs->blockSize);
 
+		const uint64_t syncId = mbs->bufferInfo[bufferIdx].traceSyncId;
+
 		for (uint64_t i = 0; i < numWrite; i++) {
 			char * src  = &srcPtr[i * inputCryptoSize];
 			char * dest = &destPtr[i * outputCryptoSize];
 
+			const uint64_t encryptStart = cryptoTime(mh, trace);
+
 			int err = aes_gcm_encrypt_memory(keyState->crypto_key[whoami_extended], keyState->crypto_key_sz,
 			                                 &keyState->crypto_node_iv[whoami_extended], src, inputCryptoSize, dest, tagPtr,
 			                                 kTagSize, whoami_extended);
@@ -1293,6 +1501,10 @@ crypto_thread_assigned_encrypt(void * arg)
 				atomic_fetch_add(&mbs->bufferInfo[bufferIdx].performance.numErrs, 1);
 				break;
 			}
+			const uint64_t encryptEnd = cryptoTime(mh, trace);
+
+			countCryptoTime(mh, &mh->stats.encrypt_total_time, &mh->stats.num_encrypt, encryptStart, encryptEnd);
+			traceEvent(trace, TraceEventType::Encrypt, encryptStart, encryptEnd, whoami_extended, i, syncId);
 
 			char * originalTagPtr = tagPtr;
 
@@ -1345,6 +1557,9 @@ crypto_thread_assigned_encrypt(void * arg)
 
 					for (unsigned i = 0; i < chunksReady; i++) {
 						char * tag = mbs->bufferInfo[bufferIdx].netSectionRxTag[0][(uint32_t)chunksProcessed * mh->chunkDivider];
+
+						const uint64_t decryptStart = cryptoTime(mh, trace);
+
 						auto encryptionError =
 						    aes_gcm_decrypt_memory(keyState->crypto_key[peerNodeId], keyState->crypto_key_sz, receiveIV, srcPtr,
 						                           mbs->userChunkSize, destPtr, (char *)tag, kTagSize, peerNodeId, peerNodeId);
@@ -1354,12 +1569,18 @@ crypto_thread_assigned_encrypt(void * arg)
 							atomic_store(&mh->reader_active, 0);
 							break;
 						}
+						const uint64_t decryptEnd = cryptoTime(mh, trace);
+
+						countCryptoTime(mh, &mh->stats.decrypt_total_time, &mh->stats.num_decrypt, decryptStart, decryptEnd);
+						traceEvent(trace, TraceEventType::Decrypt, decryptStart, decryptEnd, peerNodeId, chunksProcessed, syncId);
 						receiveIV->count++;
 						srcPtr += mbs->chunkSize;
 						destPtr += mbs->userChunkSize;
 						chunksProcessed++;
 					}
 				}
+				markPhaseTime(&mbs->bufferInfo[bufferIdx].performance.decryptDoneTime[peerNodeId],
+				              clock_gettime_nsec_np(CLOCK_UPTIME_RAW));
 				atomic_fetch_add(&mbs->bufferInfo[bufferIdx].net_sections_decrypted, 1);
 			} else {
 				const uint64_t expectedSectionsReady = partitionCount - 1;
@@ -1396,6 +1617,8 @@ crypto_thread_assigned_encrypt(void * arg)
 
 							// printf("%d decrypting for bufferIdx %d, with tag:%llx-%llx.\n", chk, bufferIdx, ((uint64_t *)tag)[0],
 							// ((uint64_t *)tag)[1]);
+							const uint64_t decryptStart = cryptoTime(mh, trace);
+
 							auto err = aes_gcm_decrypt_memory(keyState->crypto_key[peerNodeId], keyState->crypto_key_sz,
 							                                  &keyState->crypto_node_iv[peerNodeId], srcData, mbs->userChunkSize,
 							                                  dstData, tag, kTagSize, peerNodeId, peerNodeId);
@@ -1405,10 +1628,16 @@ crypto_thread_assigned_encrypt(void * arg)
 								atomic_store(&mh->reader_active, 0);
 								break;
 							}
+							const uint64_t decryptEnd = cryptoTime(mh, trace);
+
+							countCryptoTime(mh, &mh->stats.decrypt_total_time, &mh->stats.num_decrypt, decryptStart, decryptEnd);
+							traceEvent(trace, TraceEventType::Decrypt, decryptStart, decryptEnd, peerNodeId, chk, syncId);
 							keyState->crypto_node_iv[peerNodeId].count++;
 							srcData += mbs->chunkSize;
 							dstData += mbs->userChunkSize;
 						}
+						markPhaseTime(&mbs->bufferInfo[bufferIdx].performance.decryptDoneTime[peerNodeId],
+						              clock_gettime_nsec_np(CLOCK_UPTIME_RAW));
 						atomic_fetch_add(&mbs->bufferInfo[bufferIdx].net_sections_decrypted, 1);
 					}
 				}
@@ -1421,22 +1650,24 @@ crypto_thread_assigned_encrypt(void * arg)
 }
 
 static int
-setNodeKeys(MeshHandle_t * mh, size_t meshCryptoKeyStateIdx, const void * key, size_t keysz)
+setNodeKeys(MeshHandle_t * mh,
+            MeshCryptoKeyState_t * keyState,
+            uint64_t node_mask,
+            AppleCIOMeshUtils::MeshKeyKind kind,
+            const void * key,
+            size_t keysz)
 {
-	auto di                         = ccsha384_di();
-	MeshCryptoKeyState_t * keyState = &mh->cryptoKeyArray.keys[meshCryptoKeyStateIdx];
-	const uint64_t node_mask        = mh->cryptoKeyArray.node_masks[meshCryptoKeyStateIdx];
+	auto di = ccsha384_di();
 
 	char info[128];
 	char iv_info[128];
 
-	int info_size    = snprintf(info, sizeof(info), "key-derivation-%llu", node_mask);
-	int iv_info_size = snprintf(iv_info, sizeof(iv_info), "IV-nonce-%llu", node_mask);
-
-	if (info_size < 0 || iv_info_size < 0) {
+	if (!AppleCIOMeshUtils::mesh_key_labels(node_mask, kind, info, sizeof(info), iv_info, sizeof(iv_info))) {
 		MESHLOG_STR("Error while formatting key/IV derivation strings");
 		return -1;
 	}
+	const size_t info_size    = strlen(info);
+	const size_t iv_info_size = strlen(iv_info);
 
 	for (uint32_t i = 0; i < kMaxExtendedMeshNodes; i++) {
 		uint32_t tmp = i;
@@ -1454,6 +1685,7 @@ setNodeKeys(MeshHandle_t * mh, size_t meshCryptoKeyStateIdx, const void * key, s
 		}
 	}
 
+	atomic_fetch_add(&mh->stats.keyDerivations, 1);
 	return 0;
 }
 
@@ -1519,7 +1751,8 @@ connectBuffersToMesh(MeshHandle_t * mh, MeshBufferState_t * mbs, void ** bufferP
 fail:
 	for (i = 0; i < mbs->numBuffers; i++) {
 		if (mbs->bufferInfo[i].shadow != nullptr && mbs->bufferInfo[i].shadow != mbs->bufferInfo[i].bufferPtr) {
-			mach_vm_deallocate(mach_task_self(), (mach_vm_address_t)mbs->bufferInfo[i].shadow, mbs->bufferSize);
+			mh->shadow_arena->dealloc(mbs->bufferInfo[i].shadow);
+			mbs->bufferInfo[i].shadow = nullptr;
 		}
 	}
 	return ENOMEM;
@@ -1527,6 +1760,230 @@ fail:
 
 // MARK: - Statistics
 
+static_assert(AppleCIOMeshUtils::kSyncTracePhaseCount == MeshSyncPhaseCount, "Sync trace records must hold every phase");
+
+// Records the phase in its histogram and returns its time as stored in the
+// sync trace.
+static uint32_t
+record_phase(MeshHandle_t * mh, MeshSyncPhase_t phase, uint64_t startTime, uint64_t endTime)
+{
+	if (endTime == 0) {
+		// This phase did not happen in this sync.
+		return AppleCIOMeshUtils::kSyncTracePhaseNotDone;
+	}
+	// Chunks can arrive before this node started the sync.
+	const uint64_t phaseTime = endTime > startTime ? endTime - startTime : 0;
+	mh->stats.syncPhaseHistograms[phase].record(phaseTime);
+	return AppleCIOMeshUtils::sync_trace_phase_time(phaseTime);
+}
+
+static_assert(MeshStragglerDetector::kPeerCount == kMaxExtendedMeshNodes, "Straggler detector must track every node");
+
+// Attributes the time of this sync to the peers, using when their last chunk
+// arrived.
+static void
+update_straggler_stats(MeshHandle_t * mh, const BufferPerformanceStats_t & performance, uint64_t startTime)
+{
+	uint64_t arrivalTimes[kMaxExtendedMeshNodes];
+	uint64_t peerMask = 0;
+	for (uint32_t i = 0; i < kMaxExtendedMeshNodes; i++) {
+		const uint64_t last = atomic_load(&performance.lastChunkTime[i]);
+		arrivalTimes[i]     = last > startTime ? last - startTime : 0;
+		if (last != 0) {
+			peerMask |= 1ull << i;
+		}
+	}
+
+	const uint64_t previousMask = mh->stats.stragglerDetector->straggler_mask();
+	const uint64_t mask         = mh->stats.stragglerDetector->record_sync(arrivalTimes, peerMask);
+	if (mask == previousMask) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < kMaxExtendedMeshNodes; i++) {
+		const uint64_t bit = 1ull << i;
+		if ((mask & bit) && !(previousMask & bit)) {
+			MESHLOG_DEFAULT("Node %u is a straggler: its data arrives %lluns after the median peer on average\n", i,
+			                mh->stats.stragglerDetector->average_lateness(i));
+		} else if (!(mask & bit) && (previousMask & bit)) {
+			MESHLOG_DEFAULT("Node %u is no longer a straggler\n", i);
+		}
+	}
+}
+
+static void
+update_phase_stats(MeshHandle_t * mh, const BufferPerformanceStats_t & performance, uint32_t phaseTimes[MeshSyncPhaseCount])
+{
+	uint64_t firstChunkTime = 0;
+	uint64_t lastChunkTime  = 0;
+	uint64_t decryptTime    = 0;
+	for (uint32_t i = 0; i < kMaxExtendedMeshNodes; i++) {
+		const uint64_t first   = atomic_load(&performance.firstChunkTime[i]);
+		const uint64_t last    = atomic_load(&performance.lastChunkTime[i]);
+		const uint64_t decrypt = atomic_load(&performance.decryptDoneTime[i]);
+		if (first != 0 && (firstChunkTime == 0 || first < firstChunkTime)) {
+			firstChunkTime = first;
+		}
+		if (last > lastChunkTime) {
+			lastChunkTime = last;
+		}
+		if (decrypt > decryptTime) {
+			decryptTime = decrypt;
+		}
+	}
+
+	const uint64_t startTime = performance.sendStartTime;
+	update_straggler_stats(mh, performance, startTime);
+
+	const uint64_t netReceiveTime = atomic_load(&performance.netReceiveDoneTime);
+	phaseTimes[MeshSyncPhaseEncrypt]     = record_phase(mh, MeshSyncPhaseEncrypt, startTime, performance.encryptDoneTime);
+	phaseTimes[MeshSyncPhaseSendsIssued] = record_phase(mh, MeshSyncPhaseSendsIssued, startTime, performance.sendEndTime);
+	phaseTimes[MeshSyncPhaseFirstChunk]  = record_phase(mh, MeshSyncPhaseFirstChunk, startTime, firstChunkTime);
+	phaseTimes[MeshSyncPhaseLastChunk]   = record_phase(mh, MeshSyncPhaseLastChunk, startTime, lastChunkTime);
+	phaseTimes[MeshSyncPhaseDecrypt]     = record_phase(mh, MeshSyncPhaseDecrypt, startTime, decryptTime);
+	phaseTimes[MeshSyncPhaseNetReceive]  = record_phase(mh, MeshSyncPhaseNetReceive, startTime, netReceiveTime);
+}
+
+// MARK: - Sync Trace
+
+// Streams a record of every sync to a file. update_stats only pushes the
+// records into the ring, the file is written by the flusher thread so the
+// sync path never blocks on I/O.
+struct MeshSyncTrace {
+	AppleCIOMeshUtils::SyncTraceRing * ring;
+	FILE * file;
+	pthread_t flusher;
+	atomic_bool stop;
+	uint64_t written;
+	bool writeFailed;
+};
+
+static const size_t kSyncTraceFlushBatch = 256;
+// ~4MB of records, about 16 seconds of 4K syncs per second if the flusher
+// falls behind.
+static const uint32_t kDefaultSyncTraceRecords = 64 * 1024;
+
+static size_t
+flush_sync_trace(MeshSyncTrace * trace)
+{
+	AppleCIOMeshUtils::SyncTraceRecord records[kSyncTraceFlushBatch];
+	size_t total = 0;
+	size_t count;
+	while ((count = trace->ring->pop(records, kSyncTraceFlushBatch)) > 0) {
+		total += count;
+		if (trace->writeFailed) {
+			// Keep draining so the producers are not stuck with a full ring.
+			continue;
+		}
+		if (fwrite(records, sizeof(records[0]), count, trace->file) != count) {
+			trace->writeFailed = true;
+			continue;
+		}
+		trace->written += count;
+	}
+	return total;
+}
+
+static void *
+sync_trace_flusher(void * arg)
+{
+	MeshSyncTrace * trace = (MeshSyncTrace *)arg;
+	pthread_setname_np("mesh sync trace");
+
+	while (!atomic_load(&trace->stop)) {
+		if (flush_sync_trace(trace) == 0) {
+			usleep(1000);
+		}
+	}
+	// Pick up whatever was pushed before we were stopped.
+	flush_sync_trace(trace);
+	return NULL;
+}
+
+static int
+start_sync_trace(MeshHandle_t * mh, const char * path, uint32_t capacity)
+{
+	if (mh->stats.syncTrace != NULL) {
+		return EBUSY;
+	}
+
+	MeshSyncTrace * trace = new (std::nothrow) MeshSyncTrace();
+	if (trace == NULL) {
+		return ENOMEM;
+	}
+	trace->ring = AppleCIOMeshUtils::SyncTraceRing::create(capacity);
+	if (trace->ring == NULL) {
+		delete trace;
+		return ENOMEM;
+	}
+	trace->file = fopen(path, "wb");
+	if (trace->file == NULL) {
+		const int error = errno;
+		delete trace->ring;
+		delete trace;
+		return error;
+	}
+
+	const AppleCIOMeshUtils::SyncTraceFileHeader header =
+	    AppleCIOMeshUtils::make_sync_trace_header(mh->myNodeId, clock_gettime_nsec_np(CLOCK_UPTIME_RAW));
+	int error = 0;
+	if (fwrite(&header, sizeof(header), 1, trace->file) != 1) {
+		error = EIO;
+	} else {
+		atomic_store(&trace->stop, false);
+		error = pthread_create(&trace->flusher, NULL, sync_trace_flusher, trace);
+	}
+	if (error) {
+		fclose(trace->file);
+		delete trace->ring;
+		delete trace;
+		return error;
+	}
+
+	MESHLOG_DEFAULT("Tracing syncs to %s with room for %llu records\n", path, trace->ring->capacity());
+	mh->stats.syncTrace = trace;
+	return 0;
+}
+
+static void
+stop_sync_trace(MeshHandle_t * mh)
+{
+	MeshSyncTrace * trace = mh->stats.syncTrace;
+	if (trace == NULL) {
+		return;
+	}
+	mh->stats.syncTrace = NULL;
+
+	atomic_store(&trace->stop, true);
+	pthread_join(trace->flusher, NULL);
+	if (fclose(trace->file) != 0) {
+		trace->writeFailed = true;
+	}
+
+	MESHLOG_DEFAULT("Sync trace stopped: %llu records written, %llu dropped%s\n", trace->written, trace->ring->dropped(),
+	                trace->writeFailed ? ", the trace file could not be written" : "");
+	delete trace->ring;
+	delete trace;
+}
+
+extern "C" int
+MeshStartSyncTrace(MeshHandle_t * mh, const char * path, uint32_t capacity)
+{
+	if (mh == NULL || path == NULL || capacity == 0) {
+		return EINVAL;
+	}
+	return start_sync_trace(mh, path, capacity);
+}
+
+extern "C" void
+MeshStopSyncTrace(MeshHandle_t * mh)
+{
+	if (mh == NULL) {
+		return;
+	}
+	stop_sync_trace(mh);
+}
+
 static void
 update_stats(MeshHandle_t * mh, MeshBufferState_t * mbs)
 {
@@ -1570,23 +2027,12 @@ update_stats(MeshHandle_t * mh, MeshBufferState_t * mbs)
 		mh->stats.syncMaxTime = diff;
 	}
 
-	int i;
-	for (i = 0; i < MESH_SYNC_HISTOGRAM_COUNT; i++) {
-		// diff is in nsec so divide by 1000 for usec
-		if ((diff / 1000) <= mh->stats.syncTimeHistogramBins[i]) {
-			mh->stats.syncTimeHistogram[i]++;
-			mbs->stats.syncTimeHistogram[i]++;
-			break;
-		}
-	}
+	mh->stats.syncTimeHistogram->record(diff);
+	mbs->stats.syncTimeHistogram->record(diff);
+	AppleCIOMeshUtils::SyncTraceRecord traceRecord;
+	update_phase_stats(mh, mbs->bufferInfo[mbs->curBufferIdx].performance, traceRecord.phaseTime);
 
-	if (i >= MESH_SYNC_HISTOGRAM_COUNT) {
-		// throw it in the last bin
-		mh->stats.syncTimeHistogram[MESH_SYNC_HISTOGRAM_COUNT - 1]++;
-		mbs->stats.syncTimeHistogram[MESH_SYNC_HISTOGRAM_COUNT - 1]++;
-	}
-	// anything that falls in the last 3 bins counts as "long"
-	if (i >= (MESH_SYNC_HISTOGRAM_COUNT - 3)) {
+	if (diff > mbs->stats.longSyncTime) {
 		os_signpost_event_emit(mh->stats.signpostHandle, mh->stats.longSyncSignpost, "longSync", "iteration %lld syncTime %lld",
 		                       mbs->curIteration, diff);
 
@@ -1615,6 +2061,14 @@ update_stats(MeshHandle_t * mh, MeshBufferState_t * mbs)
 	syncStats.endTime    = endTime;
 	SyncStatsCircularQueue_enqueue(mh->stats.recentSyncs, syncStats);
 
+	if (mh->stats.syncTrace != NULL) {
+		traceRecord.endTime    = endTime;
+		traceRecord.syncTime   = diff;
+		traceRecord.nodeMask   = mbs->nodeMask;
+		traceRecord.bufferSize = mbs->bufferSize;
+		mh->stats.syncTrace->ring->push(traceRecord);
+	}
+
 	// MBS histogram done with MH
 }
 
@@ -1628,13 +2082,477 @@ MeshLogStats(MeshHandle_t * mh, uint64_t numSyncs)
 	const uint64_t startIdx = (mh->stats.recentSyncs.endIndex + RECENT_SYNC_CAPACITY - numSyncs) % RECENT_SYNC_CAPACITY;
 
 	for (uint64_t i = 0; i < numSyncs; i++) {
-		uint64_t index                = startIdx + i;
+		uint64_t index                = (startIdx + i) % RECENT_SYNC_CAPACITY;
 		RecentSyncStats_t & syncStats = mh->stats.recentSyncs.buffer[index];
 		MESHLOG_DEFAULT("Sync %llu, bufferSize: %lld, node mask: 0x%llx, duration: %lluns, timestamp: %llu", i,
 		                syncStats.bufferSize, syncStats.nodeMask, syncStats.syncTime, syncStats.endTime);
 	}
 
 	SyncStatsCircularQueue_clear(mh->stats.recentSyncs);
+
+	static const double kDefaultPercentiles[] = {50.0, 90.0, 99.0, 99.9};
+	MeshLogSyncTimePercentiles(mh, kDefaultPercentiles, sizeof(kDefaultPercentiles) / sizeof(kDefaultPercentiles[0]));
+
+	if (mh->stats.stragglerDetector == NULL) {
+		return;
+	}
+	const MeshStragglerDetector & detector = *mh->stats.stragglerDetector;
+	MESHLOG_DEFAULT("Straggler mask: 0x%llx", detector.straggler_mask());
+	for (uint32_t i = 0; i < kMaxExtendedMeshNodes; i++) {
+		if (detector.sync_count(i) == 0) {
+			continue;
+		}
+		MESHLOG_DEFAULT("    node %u: average lateness %lluns, p99 lateness %lluns, last in %llu/%llu syncs", i,
+		                detector.average_lateness(i), detector.lateness(i)->value_at_quantile(0.99), detector.last_count(i),
+		                detector.sync_count(i));
+	}
+}
+
+static int
+getHistogramPercentiles(const MeshLatencyHistogram * histogram, const double * percentiles, uint64_t * values, size_t count)
+{
+	if (histogram == NULL || (count > 0 && (percentiles == NULL || values == NULL))) {
+		return EINVAL;
+	}
+
+	// Use one total for all the lookups so the values are consistent with each
+	// other while syncs are still being recorded.
+	const uint64_t total = histogram->count();
+	for (size_t i = 0; i < count; i++) {
+		if (percentiles[i] < 0.0 || percentiles[i] > 100.0) {
+			return EINVAL;
+		}
+		values[i] = histogram->value_at_quantile(percentiles[i] / 100.0, total);
+	}
+
+	return 0;
+}
+
+int
+MeshGetSyncTimePercentiles(MeshHandle_t * mh, const double * percentiles, uint64_t * values, size_t count)
+{
+	if (mh == NULL) {
+		return EINVAL;
+	}
+	return getHistogramPercentiles(mh->stats.syncTimeHistogram, percentiles, values, count);
+}
+
+int
+MeshGetSyncPhasePercentiles(MeshHandle_t * mh, MeshSyncPhase_t phase, const double * percentiles, uint64_t * values, size_t count)
+{
+	if (mh == NULL || mh->stats.syncPhaseHistograms == NULL || (uint32_t)phase >= MeshSyncPhaseCount) {
+		return EINVAL;
+	}
+	return getHistogramPercentiles(&mh->stats.syncPhaseHistograms[phase], percentiles, values, count);
+}
+
+uint64_t
+MeshGetStragglerMask(MeshHandle_t * mh)
+{
+	if (mh == NULL || mh->stats.stragglerDetector == NULL) {
+		return 0;
+	}
+	return mh->stats.stragglerDetector->straggler_mask();
+}
+
+int
+MeshGetPeerLatenessPercentiles(MeshHandle_t * mh, uint32_t nodeId, const double * percentiles, uint64_t * values, size_t count)
+{
+	if (mh == NULL || mh->stats.stragglerDetector == NULL || nodeId >= kMaxExtendedMeshNodes) {
+		return EINVAL;
+	}
+	return getHistogramPercentiles(mh->stats.stragglerDetector->lateness(nodeId), percentiles, values, count);
+}
+
+void
+MeshLogSyncTimePercentiles(MeshHandle_t * mh, const double * percentiles, size_t count)
+{
+	if (mh->stats.syncTimeHistogram == NULL) {
+		return;
+	}
+
+	const MeshSyncTimeHistogram & histogram = *mh->stats.syncTimeHistogram;
+	const uint64_t total                    = histogram.count();
+	MESHLOG_DEFAULT("Sync time percentiles over %llu syncs (max %lluns):", total, histogram.maximum());
+	for (size_t i = 0; i < count; i++) {
+		MESHLOG_DEFAULT("    p%g: %lluns", percentiles[i], histogram.value_at_quantile(percentiles[i] / 100.0, total));
+	}
+
+	if (mh->stats.syncPhaseHistograms == NULL) {
+		return;
+	}
+
+	static const char * const phaseNames[MeshSyncPhaseCount] = {"encrypt",   "sends issued", "first chunk",
+	                                                            "last chunk", "decrypt",      "net receive"};
+	for (int phase = 0; phase < MeshSyncPhaseCount; phase++) {
+		const MeshSyncTimeHistogram & phaseHistogram = mh->stats.syncPhaseHistograms[phase];
+		const uint64_t phaseTotal                    = phaseHistogram.count();
+		if (phaseTotal == 0) {
+			continue;
+		}
+		MESHLOG_DEFAULT("    %s phase over %llu syncs:", phaseNames[phase], phaseTotal);
+		for (size_t i = 0; i < count; i++) {
+			MESHLOG_DEFAULT("        p%g: %lluns", percentiles[i],
+			                phaseHistogram.value_at_quantile(percentiles[i] / 100.0, phaseTotal));
+		}
+	}
+}
+
+// MARK: - Metrics
+
+using AppleCIOMeshUtils::MetricsServer;
+using AppleCIOMeshUtils::OpenMetricsWriter;
+
+static_assert(MESH_STATS_MAX_PEERS == kMaxExtendedMeshNodes, "Stats snapshots must hold every peer");
+
+struct MeshMetricsServer {
+	MetricsServer * server;
+	char path[PATH_MAX];
+};
+
+// Enough for the histograms and every peer of an extended mesh.
+static const size_t kMetricsBufferSize = 64 * 1024;
+
+// The exported time histograms have buckets from 1usec to 8sec, doubling.
+static const uint64_t kMetricsFirstTimeBound = 1000;
+static const uint32_t kMetricsTimeBoundCount = 24;
+
+static const char * const kSyncPhaseMetricNames[MeshSyncPhaseCount] = {"encrypt",    "sends_issued", "first_chunk",
+                                                                       "last_chunk", "decrypt",      "net_receive"};
+
+extern "C" int
+MeshGetStatsSnapshot(MeshHandle_t * mh, MeshStatsSnapshot_t * snapshot)
+{
+	if (mh == NULL || snapshot == NULL) {
+		return EINVAL;
+	}
+
+	// The sync counters are only written by the thread finishing the syncs, a
+	// snapshot taken meanwhile may see a sync partially counted.
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->nodeId           = mh->myNodeId;
+	snapshot->syncCount        = mh->stats.syncCounter;
+	snapshot->syncTotalTime    = mh->stats.syncTotalTime;
+	snapshot->syncMinTime      = snapshot->syncCount > 0 ? mh->stats.syncMinTime : 0;
+	snapshot->syncMaxTime      = mh->stats.syncMaxTime;
+	snapshot->encryptCount     = atomic_load(&mh->stats.num_encrypt);
+	snapshot->encryptTotalTime = atomic_load(&mh->stats.encrypt_total_time);
+	snapshot->decryptCount     = atomic_load(&mh->stats.num_decrypt);
+	snapshot->decryptTotalTime = atomic_load(&mh->stats.decrypt_total_time);
+	snapshot->keyDerivations   = atomic_load(&mh->stats.keyDerivations);
+	snapshot->stragglerMask    = mh->stats.stragglerDetector ? mh->stats.stragglerDetector->straggler_mask() : 0;
+	for (uint32_t i = 0; i < kMaxExtendedMeshNodes; i++) {
+		snapshot->peerBytesSent[i]     = atomic_load(&mh->stats.peerBytesSent[i]);
+		snapshot->peerBytesReceived[i] = atomic_load(&mh->stats.peerBytesReceived[i]);
+	}
+
+	return 0;
+}
+
+// Writes the stats as OpenMetrics text. Returns false if they do not fit.
+static bool
+write_open_metrics(MeshHandle_t * mh, char * buffer, size_t size, size_t * length)
+{
+	MeshStatsSnapshot_t snapshot;
+	MeshGetStatsSnapshot(mh, &snapshot);
+
+	OpenMetricsWriter writer(buffer, size);
+	char labels[64];
+
+	writer.family("mesh_node", "info", NULL, "The node these metrics are from.");
+	snprintf(labels, sizeof(labels), "node=\"%u\"", snapshot.nodeId);
+	writer.sample("mesh_node", "_info", labels, (uint64_t)1);
+
+	writer.family("mesh_syncs", "counter", NULL, "Broadcast and gathers done.");
+	writer.sample("mesh_syncs", "_total", NULL, snapshot.syncCount);
+	writer.family("mesh_sync_max_seconds", "gauge", "seconds", "Longest broadcast and gather.");
+	writer.sample("mesh_sync_max_seconds", "", NULL, (double)snapshot.syncMaxTime * 1e-9);
+
+	uint64_t timeBounds[kMetricsTimeBoundCount];
+	for (uint32_t i = 0; i < kMetricsTimeBoundCount; i++) {
+		timeBounds[i] = kMetricsFirstTimeBound << i;
+	}
+	if (mh->stats.syncTimeHistogram != NULL) {
+		writer.family("mesh_sync_seconds", "histogram", "seconds", "Time of the broadcast and gathers.");
+		writer.histogram("mesh_sync_seconds", NULL, *mh->stats.syncTimeHistogram, timeBounds, kMetricsTimeBoundCount, 1e-9);
+	}
+	if (mh->stats.syncPhaseHistograms != NULL) {
+		writer.family("mesh_sync_phase_seconds", "histogram", "seconds",
+		              "Time from the start of a broadcast and gather to the end of each of its phases.");
+		for (uint32_t phase = 0; phase < MeshSyncPhaseCount; phase++) {
+			snprintf(labels, sizeof(labels), "phase=\"%s\"", kSyncPhaseMetricNames[phase]);
+			writer.histogram("mesh_sync_phase_seconds", labels, mh->stats.syncPhaseHistograms[phase], timeBounds,
+			                 kMetricsTimeBoundCount, 1e-9);
+		}
+	}
+
+	writer.family("mesh_crypto_encrypted_chunks", "counter", NULL, "Chunks encrypted.");
+	writer.sample("mesh_crypto_encrypted_chunks", "_total", NULL, snapshot.encryptCount);
+	writer.family("mesh_crypto_encrypt_seconds", "counter", "seconds", "Time spent encrypting chunks.");
+	writer.sample("mesh_crypto_encrypt_seconds", "_total", NULL, (double)snapshot.encryptTotalTime * 1e-9);
+	writer.family("mesh_crypto_decrypted_chunks", "counter", NULL, "Chunks decrypted.");
+	writer.sample("mesh_crypto_decrypted_chunks", "_total", NULL, snapshot.decryptCount);
+	writer.family("mesh_crypto_decrypt_seconds", "counter", "seconds", "Time spent decrypting chunks.");
+	writer.sample("mesh_crypto_decrypt_seconds", "_total", NULL, (double)snapshot.decryptTotalTime * 1e-9);
+	writer.family("mesh_crypto_key_derivations", "counter", NULL, "Key sets derived from the mesh crypto key.");
+	writer.sample("mesh_crypto_key_derivations", "_total", NULL, snapshot.keyDerivations);
+
+	// Only peers this node exchanged data with.
+	uint64_t peerMask = 0;
+	for (uint32_t peer = 0; peer < kMaxExtendedMeshNodes; peer++) {
+		if (snapshot.peerBytesSent[peer] != 0 || snapshot.peerBytesReceived[peer] != 0) {
+			peerMask |= 1ull << peer;
+		}
+	}
+	writer.family("mesh_peer_sent_bytes", "counter", "bytes", "Bytes sent to each peer.");
+	for (uint32_t peer = 0; peer < kMaxExtendedMeshNodes; peer++) {
+		if (peerMask & (1ull << peer)) {
+			snprintf(labels, sizeof(labels), "peer=\"%u\"", peer);
+			writer.sample("mesh_peer_sent_bytes", "_total", labels, snapshot.peerBytesSent[peer]);
+		}
+	}
+	writer.family("mesh_peer_received_bytes", "counter", "bytes", "Bytes received from each peer.");
+	for (uint32_t peer = 0; peer < kMaxExtendedMeshNodes; peer++) {
+		if (peerMask & (1ull << peer)) {
+			snprintf(labels, sizeof(labels), "peer=\"%u\"", peer);
+			writer.sample("mesh_peer_received_bytes", "_total", labels, snapshot.peerBytesReceived[peer]);
+		}
+	}
+	writer.family("mesh_peer_straggler", "gauge", NULL, "1 if the data of the peer persistently arrives late.");
+	for (uint32_t peer = 0; peer < kMaxExtendedMeshNodes; peer++) {
+		if (peerMask & (1ull << peer)) {
+			snprintf(labels, sizeof(labels), "peer=\"%u\"", peer);
+			writer.sample("mesh_peer_straggler", "", labels, (uint64_t)((snapshot.stragglerMask >> peer) & 1));
+		}
+	}
+
+	const bool fits = writer.finish();
+	*length         = writer.length();
+	return fits;
+}
+
+extern "C" int
+MeshWriteOpenMetrics(MeshHandle_t * mh, char * buffer, size_t size, size_t * length)
+{
+	if (mh == NULL || buffer == NULL || length == NULL) {
+		return EINVAL;
+	}
+	return write_open_metrics(mh, buffer, size, length) ? 0 : ENOSPC;
+}
+
+static bool
+render_open_metrics(void * context, char * buffer, size_t size, size_t * length)
+{
+	return write_open_metrics((MeshHandle_t *)context, buffer, size, length);
+}
+
+static int
+start_metrics_server(MeshHandle_t * mh, const char * path)
+{
+	if (mh->stats.metricsServer != NULL) {
+		return EBUSY;
+	}
+
+	MeshMetricsServer * metrics = new (std::nothrow) MeshMetricsServer();
+	if (metrics == NULL) {
+		return ENOMEM;
+	}
+	int error       = 0;
+	metrics->server = MetricsServer::create(path, kMetricsBufferSize, render_open_metrics, mh, &error);
+	if (metrics->server == NULL) {
+		delete metrics;
+		return error;
+	}
+	strlcpy(metrics->path, path, sizeof(metrics->path));
+
+	MESHLOG_DEFAULT("Serving mesh metrics on %s\n", path);
+	mh->stats.metricsServer = metrics;
+	return 0;
+}
+
+static void
+stop_metrics_server(MeshHandle_t * mh)
+{
+	MeshMetricsServer * metrics = mh->stats.metricsServer;
+	if (metrics == NULL) {
+		return;
+	}
+	mh->stats.metricsServer = NULL;
+
+	MESHLOG_DEFAULT("Stopped serving mesh metrics on %s after %llu scrapes\n", metrics->path, metrics->server->scrapes());
+	delete metrics->server;
+	delete metrics;
+}
+
+extern "C" int
+MeshStartMetricsServer(MeshHandle_t * mh, const char * socketPath)
+{
+	if (mh == NULL || socketPath == NULL) {
+		return EINVAL;
+	}
+	return start_metrics_server(mh, socketPath);
+}
+
+extern "C" void
+MeshStopMetricsServer(MeshHandle_t * mh)
+{
+	if (mh == NULL) {
+		return;
+	}
+	stop_metrics_server(mh);
+}
+
+// MARK: - Stats Segment
+
+using AppleCIOMeshUtils::StatsSegment;
+using AppleCIOMeshUtils::StatsSegmentData;
+
+static_assert(AppleCIOMeshUtils::kStatsSegmentPeerCount == kMaxExtendedMeshNodes, "Stats segments must hold every peer");
+static_assert(AppleCIOMeshUtils::kStatsSegmentPhaseCount == MeshSyncPhaseCount, "Stats segments must hold every sync phase");
+
+struct MeshStatsPublisher {
+	MeshHandle_t * mh;
+	StatsSegment * segment;
+	char name[PATH_MAX];
+	pthread_t publisher;
+	atomic_bool stop;
+	// Copied into the segment, kept here so publishing does not use the stack.
+	StatsSegmentData data;
+};
+
+// Often enough for a live view, rarely enough to not matter.
+static const useconds_t kStatsPublishInterval = 100 * 1000;
+
+static void
+publish_stats(MeshHandle_t * mh, MeshStatsPublisher * publisher)
+{
+	MeshStatsSnapshot_t snapshot;
+	MeshGetStatsSnapshot(mh, &snapshot);
+
+	StatsSegmentData & data     = publisher->data;
+	const uint64_t publishCount = data.publishCount + 1;
+
+	memset(&data, 0, sizeof(data));
+	data.publishCount     = publishCount;
+	data.publishTime      = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+	data.nodeId           = snapshot.nodeId;
+	data.syncCount        = snapshot.syncCount;
+	data.syncTotalTime    = snapshot.syncTotalTime;
+	data.syncMinTime      = snapshot.syncMinTime;
+	data.syncMaxTime      = snapshot.syncMaxTime;
+	data.encryptCount     = snapshot.encryptCount;
+	data.encryptTotalTime = snapshot.encryptTotalTime;
+	data.decryptCount     = snapshot.decryptCount;
+	data.decryptTotalTime = snapshot.decryptTotalTime;
+	data.keyDerivations   = snapshot.keyDerivations;
+	data.stragglerMask    = snapshot.stragglerMask;
+	memcpy(data.peerBytesSent, snapshot.peerBytesSent, sizeof(data.peerBytesSent));
+	memcpy(data.peerBytesReceived, snapshot.peerBytesReceived, sizeof(data.peerBytesReceived));
+
+	if (mh->stats.stragglerDetector != NULL) {
+		const MeshStragglerDetector & detector = *mh->stats.stragglerDetector;
+		for (uint32_t i = 0; i < kMaxExtendedMeshNodes; i++) {
+			data.peerSyncCount[i]       = detector.sync_count(i);
+			data.peerAverageLateness[i] = detector.average_lateness(i);
+			data.peerP99Lateness[i]     = detector.lateness(i)->value_at_quantile(0.99);
+		}
+	}
+	if (mh->stats.syncTimeHistogram != NULL) {
+		AppleCIOMeshUtils::add_to_stats_segment_histogram(data.syncTime, *mh->stats.syncTimeHistogram);
+	}
+	if (mh->stats.syncPhaseHistograms != NULL) {
+		for (uint32_t phase = 0; phase < MeshSyncPhaseCount; phase++) {
+			AppleCIOMeshUtils::add_to_stats_segment_histogram(data.phaseTime[phase], mh->stats.syncPhaseHistograms[phase]);
+		}
+	}
+
+	AppleCIOMeshUtils::publish_stats_segment(publisher->segment, data);
+}
+
+static void *
+stats_publisher(void * arg)
+{
+	MeshStatsPublisher * publisher = (MeshStatsPublisher *)arg;
+	pthread_setname_np("mesh stats publisher");
+
+	while (!atomic_load(&publisher->stop)) {
+		publish_stats(publisher->mh, publisher);
+		usleep(kStatsPublishInterval);
+	}
+	// Leave the final stats for the readers.
+	publish_stats(publisher->mh, publisher);
+	return NULL;
+}
+
+static int
+start_stats_segment(MeshHandle_t * mh, const char * name)
+{
+	if (mh->stats.statsPublisher != NULL) {
+		return EBUSY;
+	}
+
+	MeshStatsPublisher * publisher = new (std::nothrow) MeshStatsPublisher();
+	if (publisher == NULL) {
+		return ENOMEM;
+	}
+	int error          = 0;
+	publisher->mh      = mh;
+	publisher->segment = AppleCIOMeshUtils::create_stats_segment(name, &error);
+	if (publisher->segment == NULL) {
+		delete publisher;
+		return error;
+	}
+	strlcpy(publisher->name, name, sizeof(publisher->name));
+
+	atomic_store(&publisher->stop, false);
+	error = pthread_create(&publisher->publisher, NULL, stats_publisher, publisher);
+	if (error) {
+		munmap(publisher->segment, sizeof(StatsSegment));
+		shm_unlink(name);
+		delete publisher;
+		return error;
+	}
+
+	MESHLOG_DEFAULT("Publishing mesh stats to shared memory %s\n", name);
+	mh->stats.statsPublisher = publisher;
+	return 0;
+}
+
+static void
+stop_stats_segment(MeshHandle_t * mh)
+{
+	MeshStatsPublisher * publisher = mh->stats.statsPublisher;
+	if (publisher == NULL) {
+		return;
+	}
+	mh->stats.statsPublisher = NULL;
+
+	atomic_store(&publisher->stop, true);
+	pthread_join(publisher->publisher, NULL);
+	// Readers that still have the segment mapped keep it until they unmap it.
+	munmap(publisher->segment, sizeof(StatsSegment));
+	shm_unlink(publisher->name);
+
+	MESHLOG_DEFAULT("Stopped publishing mesh stats to %s after %llu updates\n", publisher->name, publisher->data.publishCount);
+	delete publisher;
+}
+
+extern "C" int
+MeshStartStatsSegment(MeshHandle_t * mh, const char * name)
+{
+	if (mh == NULL || name == NULL || name[0] != '/') {
+		return EINVAL;
+	}
+	return start_stats_segment(mh, name);
+}
+
+extern "C" void
+MeshStopStatsSegment(MeshHandle_t * mh)
+{
+	if (mh == NULL) {
+		return;
+	}
+	stop_stats_segment(mh);
 }
 
 // MARK: - Thread Management
@@ -1648,11 +2566,12 @@ MeshStartReaders(__unused MeshHandle_t * mh)
 static void *
 netSendMultiPartition(void * arg)
 {
-	auto * cryptoArg        = (CryptoArg_t *)arg;
-	auto * mh               = (MeshHandle_t *)cryptoArg->mh;
-	int64_t syncsToDo       = 0;
-	MeshBufferState_t * mbs = nullptr;
-	uint32_t bufferIdx      = 0;
+	auto * cryptoArg         = (CryptoArg_t *)arg;
+	auto * mh                = (MeshHandle_t *)cryptoArg->mh;
+	int64_t syncsToDo        = 0;
+	MeshBufferState_t * mbs  = nullptr;
+	uint32_t bufferIdx       = 0;
+	EventTraceBuffer * trace = traceThread(mh, MeshTraceThreadNetSendMultiPartition);
 
 	while (atomic_load(&mh->reader_active) > 0) {
 		if (syncsToDo == 0) {
@@ -1695,6 +2614,8 @@ netSendMultiPartition(void * arg)
 					}
 				}
 
+				const uint64_t writeStart = traceTime(trace);
+
 				const auto [written, err] = connection.write(sendPtr, mbs->chunkSize);
 				if (written < 0) {
 					MESHLOG("Failed to send payload to network. Error: %s\n", strerror(err));
@@ -1721,6 +2642,10 @@ netSendMultiPartition(void * arg)
 				}
 				// printf("%d - Sent chunk for bufferIdx %d & tag: %llx-%llx\n", i, bufferIdx, ((uint64_t *)tagbits)[0], ((uint64_t
 				// *)tagbits)[1]);
+				traceEvent(trace, TraceEventType::NetWrite, writeStart, traceTime(trace), mh->peerConnectionInfo[0].peerInfo.nodeId,
+				           i, mbs->bufferInfo[bufferIdx].traceSyncId);
+				countPeerTransfer(mh->stats.peerBytesSent, mh->peerConnectionInfo[0].peerInfo.nodeId,
+				                  (uint64_t)written + (uint64_t)tagWritten);
 				sendPtr += mbs->chunkSize;
 				atomic_fetch_add(&mbs->net_broadcast_chunk_count, 1);
 			}
@@ -1740,6 +2665,7 @@ sendToNetworkPeer(void * arg)
 	const uint32_t peerNodeId = mh->peerConnectionInfo[0].peerInfo.nodeId;
 	MeshBufferState_t * mbs   = nullptr;
 	uint32_t bufferIdx        = 0;
+	EventTraceBuffer * trace  = traceThread(mh, MeshTraceThreadNetSend);
 
 	while (atomic_load(&mh->reader_active) > 0) {
 		if (syncsToDo == 0) {
@@ -1782,6 +2708,7 @@ sendToNetworkPeer(void * arg)
 			}
 
 			AppleCIOMeshNet::TcpConnection & connection = mh->peerConnectionInfo[0].tx_connection.value();
+			const uint64_t writeStart                   = traceTime(trace);
 			const auto [written, err]                   = connection.write(sendPtr, mbs->chunkSize);
 			if (written < 0) {
 				MESHLOG("Failed to send payload to network. Error: %s\n", strerror(err));
@@ -1805,6 +2732,9 @@ sendToNetworkPeer(void * arg)
 				atomic_store(&mh->reader_active, 0);
 				break;
 			}
+			traceEvent(trace, TraceEventType::NetWrite, writeStart, traceTime(trace), peerNodeId, i,
+			           mbs->bufferInfo[bufferIdx].traceSyncId);
+			countPeerTransfer(mh->stats.peerBytesSent, peerNodeId, (uint64_t)written + (uint64_t)tagWritten);
 
 			sendPtr += mbs->chunkSize;
 			atomic_fetch_add(&mbs->net_broadcast_chunk_count, 1);
@@ -1821,10 +2751,11 @@ sendToNetworkPeer(void * arg)
 static void *
 netReceiveMultiPartition(void * arg)
 {
-	MeshHandle_t * mh       = (MeshHandle_t *)arg;
-	MeshBufferState_t * mbs = nullptr;
-	int64_t syncsToDo       = 0;
-	uint32_t bufferIdx      = 0;
+	MeshHandle_t * mh        = (MeshHandle_t *)arg;
+	MeshBufferState_t * mbs  = nullptr;
+	int64_t syncsToDo        = 0;
+	uint32_t bufferIdx       = 0;
+	EventTraceBuffer * trace = traceThread(mh, MeshTraceThreadNetReceiveMultiPartition);
 	while (atomic_load(&mh->reader_active) > 0) {
 		if (syncsToDo == 0) {
 			// Wait here for buffers to be assigned.
@@ -1874,6 +2805,7 @@ netReceiveMultiPartition(void * arg)
 			auto bufferOffset      = blockOffset * mbs->blockSize;
 			auto * dst             = shadow + bufferOffset;
 			for (uint64_t chk = 0; chk < chunksPerBlock; chk++) {
+				const uint64_t readStart         = traceTime(trace);
 				const auto [chunkRead, chunkErr] = connection.read(dst, mbs->chunkSize);
 				if (chunkRead < 0) {
 					MESHLOG("Failed to receive payload from network. Error: %s\n", strerror(chunkErr));
@@ -1907,11 +2839,19 @@ netReceiveMultiPartition(void * arg)
 				memcpy(mbs->bufferInfo[bufferIdx].netSectionRxTag[sectionCount][chk * mh->chunkDivider + 1], tagBuffer, kTagSize);
 				dst += mbs->chunkSize;
 
+				const uint64_t receivedTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+				markFirstPhaseTime(&mbs->bufferInfo[bufferIdx].performance.firstChunkTime[peerNodeId], receivedTime);
+				markPhaseTime(&mbs->bufferInfo[bufferIdx].performance.lastChunkTime[peerNodeId], receivedTime);
+				traceEvent(trace, TraceEventType::NetRead, readStart, receivedTime, peerNodeId, chk,
+				           mbs->bufferInfo[bufferIdx].traceSyncId);
+				countPeerTransfer(mh->stats.peerBytesReceived, peerNodeId, (uint64_t)chunkRead + (uint64_t)tagRead);
+
 				uint64_t chunkIdx = (blockOffset + (mbs->chunkSize * chk)) / mbs->chunkSize;
 				atomic_fetch_or(cryptoUpdateMask, (0x1) << chunkIdx);
 				atomic_fetch_add(cryptoUpdateCounter, 1);
 			}
 
+			markPhaseTime(&mbs->bufferInfo[bufferIdx].performance.netReceiveDoneTime, clock_gettime_nsec_np(CLOCK_UPTIME_RAW));
 			atomic_fetch_add(&mbs->bufferInfo[bufferIdx].sectionsReady, 1);
 			// printf("Sections ready is %d for bufferId: %d\n", prev + 1, bufferIdx);
 		}
@@ -1933,6 +2873,7 @@ receiveFromNetworkPeer(void * arg)
 	MeshBufferState_t * mbs         = nullptr;
 	uint32_t bufferIdx              = 0;
 	MeshCryptoKeyState_t * keyState = nullptr;
+	EventTraceBuffer * trace        = traceThread(mh, MeshTraceThreadNetReceive);
 
 	while (atomic_load(&mh->reader_active) > 0) {
 		if (syncsToDo == 0) {
@@ -1980,6 +2921,7 @@ receiveFromNetworkPeer(void * arg)
 		destPtr += outputBlockOffset;
 
 		for (uint32_t i = 0; i < numExpectedReceives; i++) {
+			const uint64_t readStart         = traceTime(trace);
 			const auto [chunkRead, chunkErr] = connection.read(srcPtr, mbs->chunkSize);
 			if (chunkRead < 0) {
 				MESHLOG("Failed to receive payload from network. Error: %s\n", strerror(chunkErr));
@@ -2010,6 +2952,14 @@ receiveFromNetworkPeer(void * arg)
 			// Note: we are using the variables of 'sections' to for 'chunks'.
 			memcpy(mbs->bufferInfo[bufferIdx].netSectionRxTag[0][i * mh->chunkDivider], tag, kTagSize);
 
+			const uint64_t receivedTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+			markFirstPhaseTime(&mbs->bufferInfo[bufferIdx].performance.firstChunkTime[peerNodeId], receivedTime);
+			markPhaseTime(&mbs->bufferInfo[bufferIdx].performance.lastChunkTime[peerNodeId], receivedTime);
+			markPhaseTime(&mbs->bufferInfo[bufferIdx].performance.netReceiveDoneTime, receivedTime);
+			traceEvent(trace, TraceEventType::NetRead, readStart, receivedTime, peerNodeId, i,
+			           mbs->bufferInfo[bufferIdx].traceSyncId);
+			countPeerTransfer(mh->stats.peerBytesReceived, peerNodeId, (uint64_t)chunkRead + (uint64_t)tagRead);
+
 			uint64_t chunkIdx = (inputBlockOffset + (mbs->chunkSize * i)) / mbs->chunkSize;
 			atomic_fetch_or(cryptoUpdateMask, (0x1) << chunkIdx);
 			atomic_fetch_add(cryptoUpdateCounter, 1);
@@ -2055,13 +3005,16 @@ StartReaders_Private(MeshHandle_t * mh)
 	uint8_t numThreads = mh->localNodeCount;
 
 	for (uint32_t x = 0; x < numThreads; x++) {
-		uint32_t nodeIdForThread = x + (mh->partitionIdx * 8);
-
-		atomic_fetch_add(&mh->num_threads, 1);
-
 		mh->cryptoThreadArg[x].mh              = mh;
 		mh->cryptoThreadArg[x].whoami_local    = x;
-		mh->cryptoThreadArg[x].whoami_extended = nodeIdForThread;
+		mh->cryptoThreadArg[x].whoami_extended = x + (mh->partitionIdx * 8);
+	}
+	planCryptoPlacement(mh, numThreads);
+
+	for (uint32_t x = 0; x < numThreads; x++) {
+		uint32_t nodeIdForThread = mh->cryptoThreadArg[x].whoami_extended;
+
+		atomic_fetch_add(&mh->num_threads, 1);
 
 		{
 			pthread_attr_t threadAttributes;
@@ -2178,16 +3131,43 @@ StopReaders_Private(MeshHandle_t * mh)
 	return;
 }
 
+struct MeshChunkTable {
+	AppleCIOMeshUtils::ChunkTable table;
+};
+
+// Frees what the handle keeps on the heap. MeshDestroyHandle and every
+// MeshCreate failure come through here, whatever is added to the handle is
+// freed in this one place.
+static void
+releaseHandleResources(MeshHandle_t * mh)
+{
+	stop_event_trace(mh);
+
+	delete[] mh->peerConnectionInfo;
+	mh->peerConnectionInfo = NULL;
+	delete mh->shadow_arena;
+	mh->shadow_arena = NULL;
+	delete mh->cryptoPlacement;
+	mh->cryptoPlacement = NULL;
+	delete mh->chunkTable;
+	mh->chunkTable = NULL;
+	delete mh->stats.syncTimeHistogram;
+	mh->stats.syncTimeHistogram = NULL;
+	delete[] mh->stats.syncPhaseHistograms;
+	mh->stats.syncPhaseHistograms = NULL;
+	delete mh->stats.stragglerDetector;
+	mh->stats.stragglerDetector = NULL;
+}
+
 extern "C" void
 MeshDestroyHandle(MeshHandle_t * mh)
 {
 	StopReaders_Private(mh);
+	stop_metrics_server(mh);
+	stop_stats_segment(mh);
+	stop_sync_trace(mh);
 
-	if (mh->peerConnectionInfo) {
-		delete[] mh->peerConnectionInfo;
-	}
-
-	delete mh->shadow_arena;
+	releaseHandleResources(mh);
 }
 
 extern "C" bool
@@ -2213,6 +3193,26 @@ destroyThreadSyncGoSignal(MeshHandle_t * mh)
 	semaphore_destroy(mach_task_self(), mh->netSendMultiPartitionGoSignal);
 }
 
+// Undoes MeshCreate up to where it failed, semaphores says if it got as far
+// as creating them.
+static MeshHandle_t *
+failMeshCreate(MeshHandle_t * mh, bool semaphores)
+{
+	if (semaphores) {
+		semaphore_destroy(mach_task_self(), mh->threadInitGoSignal);
+		semaphore_destroy(mach_task_self(), mh->threadInitReadySignal);
+		semaphore_destroy(mach_task_self(), mh->threadSyncWaitSignal);
+		for (int i = 0; i < THREAD_GO_SIGNAL_COUNT; i++) {
+			semaphore_destroy(mach_task_self(), mh->threadLeaderGoSignal[i]);
+		}
+		destroyThreadSyncGoSignal(mh);
+	}
+	releaseHandleResources(mh);
+	free(mh->assignments);
+	free(mh);
+	return NULL;
+}
+
 namespace MeshNet   = AppleCIOMeshNet;
 namespace MeshUtils = AppleCIOMeshUtils;
 
@@ -2434,8 +3434,8 @@ MeshCreate(uint32_t myNodeId, uint32_t nodeCount, uint32_t leaderNodeId, uint8_t
 	AppleCIOMeshServiceRef * service             = nil;
 	AppleCIOMeshConfigServiceRef * configService = nil;
 
-	// only support 4/8 nodes
-	if (nodeCount != 2 && nodeCount != 4 && nodeCount != 8 && nodeCount != 16 && nodeCount != 32) {
+	// 2 to 8 nodes in a partition, or whole partitions
+	if (nodeCount < 2 || (nodeCount > kMaxCIOMeshNodes && nodeCount != 16 && nodeCount != 32)) {
 		return NULL;
 	}
 
@@ -2448,38 +3448,45 @@ MeshCreate(uint32_t myNodeId, uint32_t nodeCount, uint32_t leaderNodeId, uint8_t
 
 	// allocate 10GB of virtual address space.
 	// This requires a special entitlement.
-	mh->shadow_arena = MeshArena::create(10ull * 1024 * 1024 * 1024);
+	// 2MB pages are opt in: where the platform has them (Darwin superpages on
+	// x86, hugetlbfs on Linux) they are allocated up front for the whole arena.
+	const char * largePages = getenv("MESH_SHADOW_LARGE_PAGES");
+	mh->shadow_arena        = MeshArena::create(10ull * 1024 * 1024 * 1024, largePages && atoi(largePages) != 0);
 	if (!mh->shadow_arena) {
 		MESHLOG("Failed to create shadow buffer arena.");
-		free(mh);
-		return nullptr;
+		return failMeshCreate(mh, false);
 	}
+	MESHLOG_DEFAULT("Shadow buffer arena uses %s of %zu bytes\n",
+	                AppleCIOMeshUtils::large_page_kind_name(mh->shadow_arena->page_kind()), mh->shadow_arena->page_size());
 
 	service = getService();
 	if (!service) {
 		MESHLOG_STR("Was not able to get the AppleCIOMeshService.  Either there is no driver or another process is using it.\n");
-		free(mh);
-		return NULL;
+		return failMeshCreate(mh, false);
 	}
 
 	configService = getConfigService();
 	if (!configService) {
 		MESHLOG_STR("No AppleCIOMeshConfigService found. Is the driver installed properly?\n");
-		free(mh);
-		return NULL;
+		return failMeshCreate(mh, false);
 	}
 
 	uint32_t linksPerChannel;
 	if (![configService getHardwareState:&linksPerChannel]) {
 		MESHLOG_STR("could not get links per channel.\n");
-		free(mh);
-		return NULL;
+		return failMeshCreate(mh, false);
 	}
 
 	mh->service           = service;
 	mh->chunkDivider      = linksPerChannel;
 	mh->extendedNodeCount = nodeCount;
 	mh->localNodeCount    = nodeCount > 8 ? 8 : nodeCount;
+
+	// Forwarded sections are handed to the driver a ring at a time, without a
+	// ring every chunk is its own trap.
+	if (![service setupCommandRingWithEntries:kMeshCommandRingEntries tagSize:kTagSize * linksPerChannel]) {
+		MESHLOG_DEFAULT("No command ring, sending a chunk per trap\n");
+	}
 	atomic_store(&mh->startReadChainedBuffers, NULL);
 	atomic_store(&mh->activateChainedBuffers, NULL);
 
@@ -2525,6 +3532,39 @@ MeshCreate(uint32_t myNodeId, uint32_t nodeCount, uint32_t leaderNodeId, uint8_t
 	mh->syncGoIdx = 0;
 	atomic_store(&mh->pendingMBSAssignmentState, NoAssignment);
 
+	mh->stats.syncTimeHistogram   = new (std::nothrow) MeshSyncTimeHistogram();
+	mh->stats.syncPhaseHistograms = new (std::nothrow) MeshSyncTimeHistogram[MeshSyncPhaseCount]();
+	mh->stats.stragglerDetector   = new (std::nothrow) MeshStragglerDetector();
+	if (!mh->stats.syncTimeHistogram || !mh->stats.syncPhaseHistograms || !mh->stats.stragglerDetector) {
+		MESHLOG_STR("Failed to allocate the sync time histograms.\n");
+		return failMeshCreate(mh, true);
+	}
+
+	char * chunkTablePath = getenv("MESH_CHUNK_TABLE");
+	if (chunkTablePath) {
+		int error = MeshLoadChunkTable(mh, chunkTablePath);
+		if (error) {
+			MESHLOG_DEFAULT("Failed to load the chunk table %s: %s\n", chunkTablePath, strerror(error));
+		}
+	}
+
+	// The crypto threads are placed when they start.
+	char * cryptoPlacement = getenv("MESH_CRYPTO_PLACEMENT");
+	if (cryptoPlacement) {
+		int error = MeshSetCryptoPlacement(mh, cryptoPlacement);
+		if (error) {
+			MESHLOG_DEFAULT("Failed to place the crypto threads by \"%s\": %s\n", cryptoPlacement, strerror(error));
+		}
+	}
+
+	// The mesh threads pick up their trace buffers when they start.
+	char * eventTracePath = getenv("MESH_EVENT_TRACE");
+	if (eventTracePath) {
+		char * traceEvents = getenv("MESH_EVENT_TRACE_EVENTS");
+		start_event_trace(mh, myNodeId, eventTracePath,
+		                  traceEvents ? strtoull(traceEvents, NULL, 0) : kDefaultTraceEventsPerThread);
+	}
+
 	mh->stats.syncMinTime                        = 9999999999;
 	mh->stats.syncMinIter                        = -1;
 	mh->stats.signpostHandle                     = os_log_create("com.apple.CIOMesh", "signpost");
@@ -2549,15 +3589,7 @@ MeshCreate(uint32_t myNodeId, uint32_t nodeCount, uint32_t leaderNodeId, uint8_t
 
 	mh->assignments = (NodeAssignment_t *)malloc(sizeof(NodeAssignment_t) * mh->localNodeCount);
 	if (mh->assignments == NULL) {
-		semaphore_destroy(mach_task_self(), mh->threadInitGoSignal);
-		semaphore_destroy(mach_task_self(), mh->threadInitReadySignal);
-		semaphore_destroy(mach_task_self(), mh->threadSyncWaitSignal);
-		for (int i = 0; i < THREAD_GO_SIGNAL_COUNT; i++) {
-			semaphore_destroy(mach_task_self(), mh->threadLeaderGoSignal[i]);
-		}
-		destroyThreadSyncGoSignal(mh);
-		free(mh);
-		return NULL;
+		return failMeshCreate(mh, true);
 	}
 	bool foundSelf = false;
 
@@ -2592,17 +3624,7 @@ MeshCreate(uint32_t myNodeId, uint32_t nodeCount, uint32_t leaderNodeId, uint8_t
 
 	if (!foundSelf) {
 		MESHLOG_STR("Self responsibility is required.\n");
-		semaphore_destroy(mach_task_self(), mh->threadInitGoSignal);
-		semaphore_destroy(mach_task_self(), mh->threadInitReadySignal);
-		semaphore_destroy(mach_task_self(), mh->threadSyncWaitSignal);
-		for (int i = 0; i < THREAD_GO_SIGNAL_COUNT; i++) {
-			semaphore_destroy(mach_task_self(), mh->threadLeaderGoSignal[i]);
-		}
-		destroyThreadSyncGoSignal(mh);
-		delete[] mh->peerConnectionInfo;
-		free(mh->assignments);
-		free(mh);
-		return NULL;
+		return failMeshCreate(mh, true);
 	}
 
 	// We need to syncrhonize before trying to get the key so that,
@@ -2617,16 +3639,7 @@ MeshCreate(uint32_t myNodeId, uint32_t nodeCount, uint32_t leaderNodeId, uint8_t
 			break;
 		} else {
 			MESHLOG_STR("Failed to synchronize mesh.\n");
-			semaphore_destroy(mach_task_self(), mh->threadInitGoSignal);
-			semaphore_destroy(mach_task_self(), mh->threadInitReadySignal);
-			semaphore_destroy(mach_task_self(), mh->threadSyncWaitSignal);
-			for (int i = 0; i < THREAD_GO_SIGNAL_COUNT; i++) {
-				semaphore_destroy(mach_task_self(), mh->threadLeaderGoSignal[i]);
-			}
-			destroyThreadSyncGoSignal(mh);
-			free(mh->assignments);
-			free(mh);
-			return NULL;
+			return failMeshCreate(mh, true);
 		}
 	}
 
@@ -2644,37 +3657,31 @@ MeshCreate(uint32_t myNodeId, uint32_t nodeCount, uint32_t leaderNodeId, uint8_t
 		memcpy(&retrievedKey[0], [retreivedKeyData bytes], rKeyLen);
 		int ret = -1;
 		for (uint64_t i = 0; i < mh->cryptoKeyArray.key_count; i++) {
-			ret = setNodeKeys(mh, i, (const void *)retrievedKey, rKeyLen);
+			ret = setNodeKeys(mh, &mh->cryptoKeyArray.keys[i], mh->cryptoKeyArray.node_masks[i],
+			                  AppleCIOMeshUtils::kMeshKeyNodeMask, (const void *)retrievedKey, rKeyLen);
 			if (ret != 0) {
 				MESHLOG_STR("Failed to generate per node keys\n");
-				semaphore_destroy(mach_task_self(), mh->threadInitGoSignal);
-				semaphore_destroy(mach_task_self(), mh->threadInitReadySignal);
-				semaphore_destroy(mach_task_self(), mh->threadSyncWaitSignal);
-				for (int i = 0; i < THREAD_GO_SIGNAL_COUNT; i++) {
-					semaphore_destroy(mach_task_self(), mh->threadLeaderGoSignal[i]);
-				}
-				destroyThreadSyncGoSignal(mh);
-				free(mh->assignments);
-				free(mh);
-				return NULL;
+				memset_s(retrievedKey, sizeof(retrievedKey), 0, sizeof(retrievedKey));
+				return failMeshCreate(mh, true);
 			} else {
 				mh->cryptoKeyArray.keys[i].crypto_key_sz = rKeyLen;
 			}
 		}
+		for (uint64_t i = 0; i < mh->cryptoKeyArray.pair_count; i++) {
+			ret = setNodeKeys(mh, &mh->cryptoKeyArray.pair_keys[i], mh->cryptoKeyArray.pair_masks[i],
+			                  AppleCIOMeshUtils::kMeshKeyPair, (const void *)retrievedKey, rKeyLen);
+			if (ret != 0) {
+				MESHLOG_STR("Failed to generate all-to-all keys\n");
+				memset_s(retrievedKey, sizeof(retrievedKey), 0, sizeof(retrievedKey));
+				return failMeshCreate(mh, true);
+			}
+			mh->cryptoKeyArray.pair_keys[i].crypto_key_sz = rKeyLen;
+		}
 		memset_s(retrievedKey, sizeof(retrievedKey), 0, sizeof(retrievedKey));
 		MESHLOG("Crypto enabled: retrieved key size %zd flags: 0x%x\n", [retreivedKeyData length], flags);
 	} else {
 		MESHLOG_STR("Failed to get the crypto key or crypto not enabled.\n");
-		semaphore_destroy(mach_task_self(), mh->threadInitGoSignal);
-		semaphore_destroy(mach_task_self(), mh->threadInitReadySignal);
-		semaphore_destroy(mach_task_self(), mh->threadSyncWaitSignal);
-		for (int i = 0; i < THREAD_GO_SIGNAL_COUNT; i++) {
-			semaphore_destroy(mach_task_self(), mh->threadLeaderGoSignal[i]);
-		}
-		destroyThreadSyncGoSignal(mh);
-		free(mh->assignments);
-		free(mh);
-		return NULL;
+		return failMeshCreate(mh, true);
 	}
 
 	mh->leaderNodeId = leaderNodeId;
@@ -2691,36 +3698,41 @@ MeshCreate(uint32_t myNodeId, uint32_t nodeCount, uint32_t leaderNodeId, uint8_t
 	if (establishNetworkConnectivity(mh, configService) < 0) {
 		mh->peerConnectionInfo = nullptr;
 		MESHLOG_STR("Failed to establish network connectivity.\n");
-		semaphore_destroy(mach_task_self(), mh->threadInitGoSignal);
-		semaphore_destroy(mach_task_self(), mh->threadInitReadySignal);
-		semaphore_destroy(mach_task_self(), mh->threadSyncWaitSignal);
-		for (int i = 0; i < THREAD_GO_SIGNAL_COUNT; i++) {
-			semaphore_destroy(mach_task_self(), mh->threadLeaderGoSignal[i]);
-		}
-		destroyThreadSyncGoSignal(mh);
-		delete[] mh->peerConnectionInfo;
-		free(mh->assignments);
-		free(mh);
-		return NULL;
+		return failMeshCreate(mh, true);
 	}
 
 	MESHLOG("My NodeId is %d and the leader is %d\n", mh->myNodeId, mh->leaderNodeId);
 
 	// Start the readers after we are ready to send the mesh handle back
 	if (!StartReaders_Private(mh)) {
-		semaphore_destroy(mach_task_self(), mh->threadInitGoSignal);
-		semaphore_destroy(mach_task_self(), mh->threadInitReadySignal);
-		semaphore_destroy(mach_task_self(), mh->threadSyncWaitSignal);
-		for (int i = 0; i < THREAD_GO_SIGNAL_COUNT; i++) {
-			semaphore_destroy(mach_task_self(), mh->threadLeaderGoSignal[i]);
+		return failMeshCreate(mh, true);
+	}
+
+	// Tracing is best effort, the mesh works without it.
+	char * tracePath = getenv("MESH_SYNC_TRACE");
+	if (tracePath) {
+		char * traceRecords = getenv("MESH_SYNC_TRACE_RECORDS");
+		uint32_t capacity   = traceRecords ? (uint32_t)strtoul(traceRecords, NULL, 0) : kDefaultSyncTraceRecords;
+		int error           = MeshStartSyncTrace(mh, tracePath, capacity);
+		if (error) {
+			MESHLOG_DEFAULT("Failed to start tracing syncs to %s: %s\n", tracePath, strerror(error));
 		}
+	}
 
-		for (int i = 0; i < kMaxCIOMeshNodes; i++) {
-			semaphore_destroy(mach_task_self(), mh->threadSyncGoSignal[i]);
+	char * metricsSocket = getenv("MESH_METRICS_SOCKET");
+	if (metricsSocket) {
+		int error = MeshStartMetricsServer(mh, metricsSocket);
+		if (error) {
+			MESHLOG_DEFAULT("Failed to serve mesh metrics on %s: %s\n", metricsSocket, strerror(error));
+		}
+	}
+
+	char * statsSegment = getenv("MESH_STATS_SEGMENT");
+	if (statsSegment) {
+		int error = MeshStartStatsSegment(mh, statsSegment);
+		if (error) {
+			MESHLOG_DEFAULT("Failed to publish mesh stats to %s: %s\n", statsSegment, strerror(error));
 		}
-		free(mh->assignments);
-		free(mh);
-		return NULL;
 	}
 
 	return mh;
@@ -2760,44 +3772,121 @@ MeshReleaseClaim(__unused MeshHandle_t * mh)
 
 // MARK: - Broadcast and Gather
 
-// Calculates the ideal chunk size for a block size.
+extern "C" int
+MeshLoadChunkTable(MeshHandle_t * mh, const char * path)
+{
+	if (mh == NULL) {
+		return EINVAL;
+	}
+	if (path == NULL) {
+		delete mh->chunkTable;
+		mh->chunkTable = NULL;
+		return 0;
+	}
+
+	MeshChunkTable * chunkTable = new (std::nothrow) MeshChunkTable();
+	if (chunkTable == NULL) {
+		return ENOMEM;
+	}
+	int error = chunkTable->table.load(path);
+	if (error) {
+		delete chunkTable;
+		return error;
+	}
+
+	delete mh->chunkTable;
+	mh->chunkTable = chunkTable;
+	MESHLOG_DEFAULT("Loaded %u chunk sizes from %s\n", chunkTable->table.count(), path);
+	return 0;
+}
+
+// Calculates the ideal chunk size for a block size, from the chunk table if
+// one is loaded and from the defaults otherwise.
 static size_t
-calculateChunkSize(MeshHandle_t * mh, uint64_t blockSize)
-{
-	// Note: The maximum number of chunks per block is 4, this needs to match
-	// MAX_CHUNKS_PER_BLOCK.
-	// Note 2: the values in this if/else block were determined through experiments
-	// looking at performance with llmsim; for smaller block sizes there is too
-	// much overhead per-chunk to make it worth splitting things up; only above
-	// 256k is it worth having up to 4 chunks.
-	size_t chunkSize;
-	if (blockSize <= 128 * 1024) {
-		chunkSize = blockSize;
-	} else if (blockSize <= 256 * 1024) {
-		chunkSize = blockSize / 2;
-	} else {
-		uint8_t divisor = 4;
-		chunkSize       = blockSize / divisor;
-
-		// Note: Chunksize has to be limited to 16MB max, this will further
-		// get split into 2 so each link will send a 8MB chunk. This way
-		// we will never enqueue too much into the NHI rings and the driver
-		// will enqueue an additional chunk when the first chunk has finished.
-		// Let's keep dividing until we get down to 16MB.
-		while (chunkSize > kMaxChunkSize) {
-			divisor *= 2;
-			chunkSize = blockSize / divisor;
-
-			if (divisor == 128) {
-				MESHLOG("Blocksize %lld is too big for CIOMesh. Maybe you want a floppy disk?\n", blockSize);
-				return 0;
-			}
-		}
+calculateChunkSize(MeshHandle_t * mh, uint64_t blockSize, uint32_t nodeCount)
+{
+	uint32_t chunkCount = 0;
+	if (mh->chunkTable) {
+		chunkCount = mh->chunkTable->table.chunk_count(blockSize, nodeCount);
 	}
 
+	// Note: Chunksize has to be limited to 16MB max, this will further
+	// get split into 2 so each link will send a 8MB chunk. This way
+	// we will never enqueue too much into the NHI rings and the driver
+	// will enqueue an additional chunk when the first chunk has finished.
+	// The chunk count keeps doubling until we get down to 16MB.
+	size_t chunkSize = AppleCIOMeshUtils::chunk_size_for_count(blockSize, chunkCount, kMaxChunkSize);
+	if (chunkSize == 0) {
+		MESHLOG("Blocksize %lld is too big for CIOMesh. Maybe you want a floppy disk?\n", blockSize);
+	}
 	return chunkSize;
 }
 
+// Builds the topology of the nodes in nodeMask from the route costs of the
+// ensemble map, node i of the topology is the i-th rank in the mask.
+static bool
+makeCollectiveTopology(MeshHandle_t * mh, uint64_t nodeMask, AppleCIOMeshUtils::CollectiveTopology * topology)
+{
+	MeshEnsembleMap_t * map = MeshGetEnsembleMap(mh->extendedNodeCount);
+	if (map == NULL) {
+		return false;
+	}
+
+	uint32_t ranks[kMaxExtendedMeshNodes];
+	uint32_t count = 0;
+	for (uint32_t rank = 0; rank < mh->extendedNodeCount && rank < kMaxExtendedMeshNodes; rank++) {
+		if (nodeMask & (1ull << rank)) {
+			ranks[count++] = rank;
+		}
+	}
+
+	topology->nodeCount = count;
+	for (uint32_t src = 0; src < count; src++) {
+		for (uint32_t dst = 0; dst < count; dst++) {
+			topology->routeCost[src * count + dst] = MeshGetRouteCostForNodeRank(map, ranks[src], ranks[dst]);
+		}
+	}
+	MeshFreeEnsembleMap(map);
+	return count > 0;
+}
+
+// The collective the data path runs for the nodes of nodeMask. The driver
+// forwards the chunks within a partition directly, and when there is more than
+// a partition the network threads exchange them with the peers. That exchange
+// is what the cost model calls hierarchical, the framework doesn't execute a
+// CollectiveSchedule.
+static AppleCIOMeshUtils::CollectiveAlgorithm
+dataPathCollective(uint64_t nodeMask)
+{
+	return getNodeCountFromMask(nodeMask) > kMaxCIOMeshNodes ? AppleCIOMeshUtils::kCollectiveHierarchical
+	                                                         : AppleCIOMeshUtils::kCollectiveDirect;
+}
+
+// Logs the collective the data path runs for a buffer set against the one the
+// route costs of the ensemble map and the block size favour. Nothing else
+// reads the estimate.
+static void
+logCollectiveEstimate(MeshHandle_t * mh, uint64_t nodeMask, uint64_t blockSize)
+{
+	using namespace AppleCIOMeshUtils;
+
+	const CollectiveAlgorithm algorithm = dataPathCollective(nodeMask);
+	CollectiveTopology * topology       = new (std::nothrow) CollectiveTopology();
+	CollectiveSchedule * schedule       = new (std::nothrow) CollectiveSchedule();
+	if (topology == NULL || schedule == NULL || !makeCollectiveTopology(mh, nodeMask, topology)) {
+		MESHLOG("No route costs for node mask 0x%llx, using the %s collective\n", nodeMask,
+		        collective_algorithm_name(algorithm));
+	} else if (select_collective_algorithm(*topology, blockSize, schedule)) {
+		MESHLOG_DEFAULT("Collective for node mask 0x%llx and %llu byte blocks: %s, the route costs favour %s (%u steps, "
+		                "%.1fus estimated)\n",
+		                nodeMask, blockSize, collective_algorithm_name(algorithm), collective_algorithm_name(schedule->algorithm),
+		                schedule->stepCount, estimate_collective_time(*schedule, *topology, blockSize) * 1e6);
+	}
+
+	delete topology;
+	delete schedule;
+}
+
 extern "C" int
 MeshSetupBuffersEx_Private(MeshHandle_t * mh, MeshBufferSet_t * bufferSets, uint16_t count)
 {
@@ -2838,7 +3927,7 @@ MeshSetupBuffers_Private(MeshHandle_t * mh,
 		return EINVAL;
 	}
 
-	if (!isValidNodeMask(nodeMask)) {
+	if (!AppleCIOMeshUtils::mesh_valid_node_mask(nodeMask)) {
 		MESHLOG("Invalid node mask was passsed in: %llu", nodeMask);
 		return EINVAL;
 	}
@@ -2915,6 +4004,8 @@ MeshSetupBuffers_Private(MeshHandle_t * mh,
 	mbs->maxReads   = 0;
 	mbs->plan       = nullptr;
 
+	logCollectiveEstimate(mh, nodeMask, mbs->blockSize);
+
 	mbs->assignedCryptoState = lookupKeyFromMask(mh, mbs->nodeMask);
 	CHECK(mbs->assignedCryptoState != nullptr, "Invalid nodemask: %llx\n", mbs->nodeMask);
 
@@ -2957,6 +4048,16 @@ MeshSetupBuffers_Private(MeshHandle_t * mh,
 		retVal = ENOMEM;
 		goto fail;
 	}
+	for (uint32_t i = 0; i < mbs->numBuffers; i++) {
+		mbs->bufferInfo[i].traceSyncId = i;
+	}
+
+	mbs->stats.syncTimeHistogram = new (std::nothrow) MeshSyncTimeHistogram();
+	if (mbs->stats.syncTimeHistogram == NULL) {
+		MESHLOG_STR("Could not allocate the sync time histogram\n");
+		retVal = ENOMEM;
+		goto fail;
+	}
 
 	if (connectBuffersToMesh(mh, mbs, bufferPtrs) != 0) {
 		MESHLOG_STR("Failed to allocate all buffers.\n");
@@ -3067,15 +4168,11 @@ MeshSetupBuffers_Private(MeshHandle_t * mh,
 	mh->stats.incomingSize += (((double)mbs->bufferSize / participatingNodeCount) * participatingNodeCount * 8) / kBytesPerGiga;
 	mbs->curBufferIdx = 0;
 
-	// last thing: setup the bins for the histogram.  We calculate the expected min sync
-	// time, add 10 usec and then create bins that grow logarthimically.
-
-	expected_sync_time_us = ceil((((chunkSize * 8) / (double)CIO40_ACTUAL_LINE_RATE) * kUsPerSecond)) + 10;
-	for (int i = 0; i < MESH_SYNC_HISTOGRAM_COUNT; i++) {
-		mh->stats.syncTimeHistogramBins[i]  = (uint64_t)expected_sync_time_us;
-		mbs->stats.syncTimeHistogramBins[i] = (uint64_t)expected_sync_time_us;
-		expected_sync_time_us *= 2;
-	}
+	// last thing: setup the long sync threshold.  We calculate the expected min
+	// sync time, add 10 usec and count anything more than 64x slower than that
+	// as a long sync.
+	expected_sync_time_us   = ceil((((chunkSize * 8) / (double)CIO40_ACTUAL_LINE_RATE) * kUsPerSecond)) + 10;
+	mbs->stats.longSyncTime = (uint64_t)(expected_sync_time_us * 1000) * 64;
 
 	*ret_mbs = mbs;
 
@@ -3087,6 +4184,7 @@ fail:
 	}
 
 	if (mbs) {
+		delete mbs->stats.syncTimeHistogram;
 		free(mbs);
 	}
 
@@ -3118,7 +4216,7 @@ MeshSetupBuffers(MeshHandle_t * mh,
 		        kMeshBufferBlockSizeMultiple);
 	}
 
-	uint64_t chunkSize = calculateChunkSize(mh, blockSize);
+	uint64_t chunkSize = calculateChunkSize(mh, blockSize, mh->extendedNodeCount);
 
 	auto nodeMask          = createAllEnsembleMask(mh);
 	const auto sectionSize = bufferSize; // Legacy API, used with small ensembles (8 or less). No sections needed.
@@ -3142,7 +4240,7 @@ MeshSetupBufferEx(MeshHandle_t * mh, MeshBufferSet_t * bufferSets, uint16_t coun
 
 		bufferSets[i].blockSize   = blockSize;
 		bufferSets[i].sectionSize = sectionSize;
-		bufferSets[i].chunkSize   = calculateChunkSize(mh, blockSize);
+		bufferSets[i].chunkSize   = calculateChunkSize(mh, blockSize, participatingNodeCount);
 	}
 
 	return MeshSetupBuffersEx_Private(mh, bufferSets, count);
@@ -3185,23 +4283,25 @@ MeshReleaseBuffers(MeshHandle_t * mh, MeshBufferState_t * mbs)
 		}
 
 		if (mbs->bufferInfo[i].shadow != mbs->bufferInfo[i].bufferPtr) {
-			mh->shadow_arena->dealloc(mbs->bufferSize);
+			mh->shadow_arena->dealloc(mbs->bufferInfo[i].shadow);
 		}
 	}
 
+	const AppleCIOMeshUtils::TLSFAllocatorStats arenaStats = mh->shadow_arena->stats();
+	MESHLOG("shadow arena: %llu bytes in %llu buffers (peak %llu), %llu free blocks, largest %llu, fragmentation %.2f\n",
+	        arenaStats.allocated, arenaStats.allocations, arenaStats.peakAllocated, arenaStats.freeBlocks,
+	        arenaStats.largestFreeBlock, AppleCIOMeshUtils::tlsf_fragmentation(arenaStats));
+
 	double averageSyncTimeUsec = ((double)mbs->stats.syncTotalTime / (double)mbs->stats.syncCounter) / 1000.0;
 	MESHLOG("mbs performance: averageSyncTime: %8.2f\n", averageSyncTimeUsec);
-	uint64_t base = 0;
-	for (int i = 0; i < MESH_SYNC_HISTOGRAM_COUNT; i++) {
-		if (mbs->stats.syncTimeHistogram[i] != 0) {
-			if (i < MESH_SYNC_HISTOGRAM_COUNT - 1) {
-				MESHLOG("	%6lld - %6lld usec: %lld\n", base, mbs->stats.syncTimeHistogramBins[i],
-				        mbs->stats.syncTimeHistogram[i]);
-			} else {
-				MESHLOG("		   > %6lld usec: %lld\n", base, mbs->stats.syncTimeHistogram[i]);
-			}
-		}
-		base = mbs->stats.syncTimeHistogramBins[i] + 1;
+	const MeshSyncTimeHistogram & histogram = *mbs->stats.syncTimeHistogram;
+	const uint64_t syncCount                = histogram.count();
+	if (syncCount != 0) {
+		MESHLOG("mbs performance: p50 %8.2f p90 %8.2f p99 %8.2f p99.9 %8.2f max %8.2f usec\n",
+		        (double)histogram.value_at_quantile(0.5, syncCount) / 1000.0,
+		        (double)histogram.value_at_quantile(0.9, syncCount) / 1000.0,
+		        (double)histogram.value_at_quantile(0.99, syncCount) / 1000.0,
+		        (double)histogram.value_at_quantile(0.999, syncCount) / 1000.0, (double)histogram.maximum() / 1000.0);
 	}
 	MESHLOG_STR("mbs performance large times: \n");
 	MESHLOG_STR("   ");
@@ -3227,6 +4327,8 @@ MeshReleaseBuffers(MeshHandle_t * mh, MeshBufferState_t * mbs)
 	mbs->bufferSize   = 0;
 	free(mbs->bufferInfo);
 	mbs->bufferInfo = NULL;
+	delete mbs->stats.syncTimeHistogram;
+	mbs->stats.syncTimeHistogram = NULL;
 
 	free(mbs);
 
@@ -3313,6 +4415,7 @@ MeshBroadcastAndGather(MeshHandle_t * mh, MeshBufferState_t * mbs)
 	const uint64_t networkSendCount = p2pMask ? sendCount : sendCount * (partitionCount - 1);
 	const uint8_t cioNodeCount      = getLocalNodeCountFromMask(mbs->nodeMask, mh->partitionIdx);
 	uint8_t myLocalNodeId           = mh->myNodeId % kMaxCIOMeshNodes;
+	EventTraceBuffer * trace        = traceThread(mh, MeshTraceThreadBroadcast);
 
 	atomic_int encryptReady[sendCount];
 	char myTags[sendCount * mh->chunkDivider][kTagSize];
@@ -3397,6 +4500,10 @@ MeshBroadcastAndGather(MeshHandle_t * mh, MeshBufferState_t * mbs)
 		// and prepare
 		uint64_t ongoingOffset = outgoingOffset;
 
+		// Another partition's block has all of its tags already, so its chunks
+		// don't wait on each other and can go on the command ring.
+		const bool queueSends = pIdx != mh->partitionIdx && [mh->service hasCommandRing];
+
 		for (uint64_t i = 0; i < sendCount; i++) {
 			uint64_t nextChunkOffset = ongoingOffset + mbs->chunkSize;
 			uint32_t nextBufferIdx   = bufferIdx;
@@ -3411,6 +4518,9 @@ MeshBroadcastAndGather(MeshHandle_t * mh, MeshBufferState_t * mbs)
 			// Burn for crypto to be ready (only if we are broadcasting our own block)
 			if (pIdx == mh->partitionIdx) {
 				while (atomic_load(&encryptReady[i]) != mh->chunkDivider && atomic_load(&mh->reader_active) > 0) {}
+				if (i == sendCount - 1) {
+					mbs->bufferInfo[bufferIdx].performance.encryptDoneTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+				}
 
 				// Crypto is ready, let's also quickly notify the networking TX thread
 				// it is safe to send out this chunk.
@@ -3449,7 +4559,26 @@ MeshBroadcastAndGather(MeshHandle_t * mh, MeshBufferState_t * mbs)
 					// ((uint64_t *)gcmTag)[1]);
 				}
 
-				if (mbs->syncRemaining == 1 && nextChunkOffset == 0) {
+				const uint64_t sendStart = traceTime(trace);
+				const bool sendOnly      = mbs->syncRemaining == 1 && nextChunkOffset == 0;
+				if (queueSends) {
+					// Same as below, but submitted once the ring is full or the
+					// section is done.
+					if (sendOnly) {
+						ret = [mh->service queueSendAssignedDataChunkFrom:(mbs->baseBufferId + bufferIdx)
+						                                         atOffset:ongoingOffset
+						                                         withTags:gcmTag];
+					} else {
+						ret = [mh->service queueSendAssignedDataChunkFrom:(mbs->baseBufferId + bufferIdx)
+						                                         atOffset:ongoingOffset
+						                                         withTags:gcmTag
+						                  andPrepareAssignedDataChunkFrom:(mbs->baseBufferId + nextBufferIdx)
+						                                         atOffset:AppleCIOMeshUserClientInterface::PrepareFullBuffer];
+					}
+					if (ret != 0 && (i == sendCount - 1 || [mh->service commandRingSpace] == 0)) {
+						ret = [mh->service submitQueuedCommands];
+					}
+				} else if (sendOnly) {
 					// can only do the send for the very last sync.
 					ret = [mh->service sendAssignedDataChunkFrom:(mbs->baseBufferId + bufferIdx)
 					                                    atOffset:ongoingOffset
@@ -3462,6 +4591,8 @@ MeshBroadcastAndGather(MeshHandle_t * mh, MeshBufferState_t * mbs)
 					             andPrepareAssignedDataChunkFrom:(mbs->baseBufferId + nextBufferIdx)
 					                                    atOffset:AppleCIOMeshUserClientInterface::PrepareFullBuffer];
 				}
+				traceEvent(trace, TraceEventType::Send, sendStart, traceTime(trace), mh->myNodeId, i,
+				           mbs->bufferInfo[bufferIdx].traceSyncId);
 
 				if (ret == 0) {
 					MESHLOG("Server interrupted while broadcasting %d at offset %lld (ret %d)\n",
@@ -3475,12 +4606,19 @@ MeshBroadcastAndGather(MeshHandle_t * mh, MeshBufferState_t * mbs)
 			ongoingOffset += mbs->chunkSize;
 		}
 
+		// The section's block went out to every node of the partition.
+		if (cioNodeCount > 1) {
+			countPeerBytes(mh->stats.peerBytesSent, mbs->nodeMask & (0xFFull << (mh->partitionIdx * 8u)), mh->myNodeId,
+			               sendCount * mbs->chunkSize);
+		}
+
 		mbs->bufferInfo[mbs->curBufferIdx].performance.sendEndTime = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
 		atomic_store(&mbs->bufferInfo[bufferIdx].blockSent, 1);
 	} // move to the next partition section
 
 	const uint64_t numExpectedReceives   = (getNodeCountFromMask(mbs->nodeMask) - 1) * sendCount;
 	const auto expectedSectionsDecrypted = p2pMask ? 1 : partitionCount - 1;
+	const uint64_t gatherStart           = traceTime(trace);
 
 	// wait for everything to be done. This is effectively the "all gather"
 	while (true) {
@@ -3495,6 +4633,8 @@ MeshBroadcastAndGather(MeshHandle_t * mh, MeshBufferState_t * mbs)
 		// networkSendCount, numExpectedReceives, atomic_load(&mbs->net_broadcast_chunk_count),
 		// atomic_load(&mbs->bufferInfo[bufferIdx].chunkReceiveCount));
 	}
+	traceEvent(trace, TraceEventType::Gather, gatherStart, traceTime(trace), mh->myNodeId, AppleCIOMeshUtils::kTraceNoChunk,
+	           mbs->bufferInfo[bufferIdx].traceSyncId);
 
 	const uint8_t participatingNodeCount = getNodeCountFromMask(mbs->nodeMask);
 
@@ -3550,6 +4690,8 @@ MeshBroadcastAndGather(MeshHandle_t * mh, MeshBufferState_t * mbs)
 	mbs->bufferInfo[bufferIdx].performance.sendEndTime       = 0;
 	mbs->bufferInfo[bufferIdx].performance.iterId            = 0;
 	mbs->bufferInfo[bufferIdx].performance.numErrs           = 0;
+	resetPhaseTimes(&mbs->bufferInfo[bufferIdx].performance);
+	mbs->bufferInfo[bufferIdx].traceSyncId += mbs->numBuffers;
 
 	ret = 0;
 
@@ -3951,11 +5093,14 @@ MeshReleaseBuffer(MeshHandle_t * mh, uint64_t bufferId, uint64_t bufferSize)
 		*sendToAllBuffer               = *lastBuffer;
 
 		// clear out the last buffer
-		lastBuffer->shadow        = 0;
-		lastBuffer->bufferId      = 0;
-		lastBuffer->chunkSize     = 0;
-		lastBuffer->sendtoallmask = 0;
-		lastBuffer->totalBufSize  = 0;
+		lastBuffer->shadow            = 0;
+		lastBuffer->bufferId          = 0;
+		lastBuffer->chunkSize         = 0;
+		lastBuffer->sendtoallmask     = 0;
+		lastBuffer->totalBufSize      = 0;
+		lastBuffer->allToAllSliceSize = 0;
+		lastBuffer->allToAllPairing   = 0;
+		lastBuffer->allToAllRelayMask = 0;
 	}
 
 	// decrement the size of the array.
@@ -4064,6 +5209,10 @@ MeshSendToAllPeers(MeshHandle_t * mh, const uint64_t sendToAllBufferId, void * s
 		}
 	}
 
+	if (ret) {
+		countPeerBytes(mh->stats.peerBytesSent, sendToAllBuffer->sendtoallmask, mh->myNodeId, sendToAllBufSize);
+	}
+
 #ifdef DEBUG_SIGNPOSTS
 	//		if (mh->verbose_level >= LogSignposts) {
 	//			os_signpost_event_emit(mh->stats.logHandle, mh->stats.cryptoSignpost, "cryptoSenderDec", "sendToAll %llu sz %lld",
@@ -4220,9 +5369,337 @@ MeshReceiveFromLeaderEx(
 			}
 		}
 	}
+
+	if (leaderNodeId < kMaxExtendedMeshNodes) {
+		atomic_fetch_add(&mh->stats.peerBytesReceived[leaderNodeId], bufSize);
+	}
+	return true;
+}
+
+// MARK: - All To All
+
+// What the all-to-all callbacks of a node share. Positions count the nodes of
+// the mask in rank order, the slot of the slice from position src to position
+// dst sits at (src * nodeCount + dst) * chunkSize in the shadow buffer.
+struct AllToAllContext {
+	MeshHandle_t * mh;
+	SendToAllBuffer_t * buffer;
+	uint32_t nodeCount;
+	uint32_t ranks[kMaxCIOMeshNodes];
+	MeshCryptoKeyState_t * keys[kMaxCIOMeshNodes];
+	char sendTags[kMaxCIOMeshNodes][kTagSize];
+	char receiveTags[kMaxCIOMeshNodes][kTagSize];
+};
+
+// Collects the ranks of the nodes in the mask, returns the node count.
+static uint32_t
+getAllToAllRanks(uint64_t nodeMask, uint32_t ranks[kMaxCIOMeshNodes])
+{
+	uint32_t count = 0;
+	for (uint32_t rank = 0; rank < kMaxExtendedMeshNodes && count < kMaxCIOMeshNodes; rank++) {
+		if (isNodeParticipating(rank, nodeMask)) {
+			ranks[count++] = rank;
+		}
+	}
+	return count;
+}
+
+static bool
+allToAllSeal(void * context, uint32_t src, uint32_t dst, const void * in, void * out, uint64_t size)
+{
+	AllToAllContext * ctx           = (AllToAllContext *)context;
+	MeshCryptoKeyState_t * keyState = ctx->keys[dst];
+	const uint32_t rank             = ctx->ranks[src];
+	int err = aes_gcm_encrypt_memory(keyState->crypto_key[rank], keyState->crypto_key_sz, &keyState->crypto_node_iv[rank],
+	                                 (void *)in, size, out, ctx->sendTags[dst], kTagSize, rank);
+	if (err != 0) {
+		os_log_error(OS_LOG_DEFAULT, "Failed to encrypt all-to-all slice for node %u\n", ctx->ranks[dst]);
+		return false;
+	}
+	return true;
+}
+
+static bool
+allToAllOpen(void * context, uint32_t src, uint32_t dst, const void * in, void * out, uint64_t size)
+{
+	AllToAllContext * ctx           = (AllToAllContext *)context;
+	MeshCryptoKeyState_t * keyState = ctx->keys[src];
+	const uint32_t rank             = ctx->ranks[src];
+	int cstat = aes_gcm_decrypt_memory(keyState->crypto_key[rank], keyState->crypto_key_sz, &keyState->crypto_node_iv[rank],
+	                                   (void *)in, size, out, ctx->receiveTags[src], kTagSize, rank, ctx->ranks[dst]);
+	keyState->crypto_node_iv[rank].count++;
+	if (cstat != 0) {
+		os_log_error(OS_LOG_DEFAULT, "decrypt failed: cstat %d; all-to-all slice from node %u\n", cstat, rank);
+		return false;
+	}
+	return true;
+}
+
+static bool
+allToAllSend(void * context, uint32_t peer, const void * data, [[maybe_unused]] uint64_t size)
+{
+	AllToAllContext * ctx = (AllToAllContext *)context;
+	const uint64_t offset = (uint64_t)((const char *)data - (const char *)ctx->buffer->shadow);
+	bool ret              = [ctx->mh->service prepareDataChunkTransferFor:ctx->buffer->bufferId atOffset:offset];
+	if (!ret) {
+		MESHLOG("Failed to prepare outgoing buffer for bufferId %lld : ret=%d\n", ctx->buffer->bufferId, ret);
+		return false;
+	}
+
+	char tag[2][kTagSize];
+	memcpy(&tag[0][0], ctx->sendTags[peer], kTagSize);
+	memcpy(&tag[1][0], ctx->sendTags[peer], kTagSize);
+	ret = [ctx->mh->service sendAssignedDataChunkFrom:ctx->buffer->bufferId atOffset:offset withTags:&tag[0][0]];
+	if (!ret) {
+		MESHLOG("Failed to send all-to-all slice for bufferId %llu at offset %llu: ret=%d\n", ctx->buffer->bufferId, offset,
+		        ret);
+		return false;
+	}
+	return true;
+}
+
+static bool
+allToAllReceive(void * context, uint32_t peer, void * data, [[maybe_unused]] uint64_t size)
+{
+	AllToAllContext * ctx = (AllToAllContext *)context;
+	const uint64_t offset = (uint64_t)((char *)data - (char *)ctx->buffer->shadow);
+	bool ret              = [ctx->mh->service prepareDataChunkTransferFor:ctx->buffer->bufferId atOffset:offset];
+	if (!ret) {
+		MESHLOG("Failed to prepare incoming buffer for bufferId %llu : ret=%d\n", ctx->buffer->bufferId, ret);
+		return false;
+	}
+
+	ret = [ctx->mh->service waitOnSharedMemory:ctx->buffer->bufferId atOffset:offset withTag:ctx->receiveTags[peer]];
+	if (!ret) {
+		MESHLOG("Failed to receive all-to-all slice for bufferId %llu at offset %llu: ret=%d\n", ctx->buffer->bufferId, offset,
+		        ret);
+		return false;
+	}
 	return true;
 }
 
+extern "C" int
+MeshSetupAllToAllBuffer(MeshHandle_t * mh, uint64_t nodeMask, uint64_t allToAllBufferId, uint64_t sliceSize)
+{
+	using namespace AppleCIOMeshUtils;
+
+	if (sliceSize == 0 || sliceSize > kMaxBlockSize || !mesh_valid_node_mask(nodeMask) ||
+	    !isNodeParticipating(mh->myNodeId, nodeMask)) {
+		MESHLOG("Invalid all-to-all buffer: node mask 0x%llx slice size %llu\n", nodeMask, sliceSize);
+		return EINVAL;
+	}
+
+	// The slices only move over CIO, so the nodes have to share a partition.
+	if ((nodeMask & ~(0xFFull << (mh->partitionIdx * 8u))) != 0) {
+		MESHLOG("All-to-all across partitions is not supported, node mask 0x%llx\n", nodeMask);
+		return ENOTSUP;
+	}
+
+	SendToAllBuffersArray_t * sendToAllBuffers = &mh->sendToAllBuffers;
+	if (sendToAllBuffers->arraySize >= MAX_SEND_TO_ALL_BUFFS) {
+		MESHLOG("Already allocated %d send to all buffers, which is the max", MAX_SEND_TO_ALL_BUFFS);
+		return EINVAL;
+	}
+	if (lookupSendToAllBuffer(mh, allToAllBufferId) != nullptr) {
+		MESHLOG("Buffer ID %lld is already in use\n", allToAllBufferId);
+		return EEXIST;
+	}
+
+	uint32_t ranks[kMaxCIOMeshNodes];
+	const uint32_t nodeCount = getAllToAllRanks(nodeMask, ranks);
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		if (ranks[i] != mh->myNodeId && lookupPairKey(mh, all_to_all_pair_mask(mh->myNodeId, ranks[i])) == NULL) {
+			MESHLOG("No key generated for nodes %u and %u\n", mh->myNodeId, ranks[i]);
+			return EINVAL;
+		}
+	}
+
+	CollectiveTopology * topology = new (std::nothrow) CollectiveTopology();
+	CollectiveSchedule * schedule = new (std::nothrow) CollectiveSchedule();
+	if (topology == NULL || schedule == NULL || !makeCollectiveTopology(mh, nodeMask, topology)) {
+		MESHLOG("No route costs for node mask 0x%llx\n", nodeMask);
+		delete topology;
+		delete schedule;
+		return EINVAL;
+	}
+	const AllToAllPairing pairing = select_all_to_all_pairing(*topology, sliceSize, schedule);
+	MESHLOG_DEFAULT("All-to-all for node mask 0x%llx and %llu byte slices: %s pairing\n", nodeMask, sliceSize,
+	                all_to_all_pairing_name(pairing));
+	delete schedule;
+
+	// Every slot is a chunk of whole pages, split evenly between the links.
+	const uint64_t pageSize        = 4096 * (uint64_t)mh->chunkDivider;
+	const uint64_t slotSize        = ((sliceSize + pageSize - 1) / pageSize) * pageSize;
+	const uint64_t totalBufferSize = (uint64_t)nodeCount * nodeCount * slotSize;
+	void * buff                    = malloc(totalBufferSize);
+	if (buff == NULL) {
+		delete topology;
+		return ENOMEM;
+	}
+
+	int64_t singleCommand[MAX_BREAKDOWN_COUNT] = {0};
+	singleCommand[0]                           = (int64_t)slotSize / mh->chunkDivider;
+
+	if (![mh->service allocateSharedMemory:allToAllBufferId
+	                             atAddress:(mach_vm_address_t)buff
+	                                ofSize:totalBufferSize
+	                         withChunkSize:slotSize
+	                        withStrideSkip:0
+	                       withStrideWidth:0
+	                  withCommandBreakdown:singleCommand]) {
+		MESHLOG("AppleCIOMesh: failed to allocate allToAll w/size %lld\n", totalBufferSize);
+		free(buff);
+		delete topology;
+		return ENOMEM;
+	}
+
+	// Every slice crosses one link at a time: its sender sends it to the
+	// first hop of its route, and a relay in between forwards it on to its
+	// receiver, like the forwarders of a send to all buffer. Slices with two
+	// routes are spread so every node relays about as many. Every node picks
+	// the same relays since they only depend on the ensemble map.
+	uint32_t hops[kMaxCollectiveNodes * kMaxCollectiveNodes];
+	collective_balanced_hops(*topology, hops);
+	const uint32_t me          = getBufferOffsetForNode(nodeMask, mh->myNodeId);
+	const uint32_t myLocalRank = mh->myNodeId % 8;
+	uint64_t relayMask         = 0;
+	for (uint32_t src = 0; src < nodeCount; src++) {
+		for (uint32_t dst = 0; dst < nodeCount; dst++) {
+			if (src == dst) {
+				continue;
+			}
+
+			const uint64_t offset     = ((uint64_t)src * nodeCount + dst) * slotSize;
+			const uint32_t hop        = hops[src * nodeCount + dst];
+			const uint32_t srcLocal   = ranks[src] % 8;
+			const uint32_t dstLocal   = ranks[dst] % 8;
+			const uint32_t hopLocal   = ranks[hop] % 8;
+			const uint64_t outputMask = 1ull << hopLocal;
+			if (src == me) {
+				[mh->service assignSharedMemory:allToAllBufferId
+				                       atOffset:offset
+				                         ofSize:slotSize
+				         toOutgoingMeshChannels:outputMask
+				                 withAccessMode:0x2
+				                       fromNode:myLocalRank];
+			} else if (dst == me) {
+				// The slice arrives over the link from the relay.
+				const uint32_t fromLocal = hop == dst ? srcLocal : hopLocal;
+				if (mh->assignments[fromLocal].inputChannel != -1) {
+					[mh->service assignSharedMemory:allToAllBufferId
+					                       atOffset:offset
+					                         ofSize:slotSize
+					          toIncomingMeshChannel:(uint64_t)mh->assignments[fromLocal].inputChannel
+					                 withAccessMode:0x2
+					                       fromNode:srcLocal];
+				}
+			} else if (hop == me && mh->assignments[srcLocal].inputChannel != -1) {
+				relayMask |= 1ull << (src * nodeCount + dst);
+				[mh->service assignSharedMemory:allToAllBufferId
+				                       atOffset:offset
+				                         ofSize:slotSize
+				          toIncomingMeshChannel:(uint64_t)mh->assignments[srcLocal].inputChannel
+				                 withAccessMode:0x2
+				                       fromNode:srcLocal];
+				[mh->service assignSharedMemory:allToAllBufferId
+				                       atOffset:offset
+				                         ofSize:slotSize
+				         toOutgoingMeshChannels:1ull << dstLocal
+				                 withAccessMode:0x2
+				                       fromNode:srcLocal];
+			}
+		}
+	}
+	delete topology;
+
+	// The slots are prepared one at a time, see MeshSetupSendToAllBufferEx.
+	[mh->service overrideRuntimePrepareFor:allToAllBufferId];
+
+	SendToAllBuffer_t * allToAllBuffer = &sendToAllBuffers->sendToAllBuffersArray[sendToAllBuffers->arraySize];
+	allToAllBuffer->shadow             = buff;
+	allToAllBuffer->totalBufSize       = totalBufferSize;
+	allToAllBuffer->chunkSize          = slotSize;
+	allToAllBuffer->numChunks          = (uint64_t)nodeCount * nodeCount;
+	allToAllBuffer->sendtoallmask      = nodeMask;
+	allToAllBuffer->bufferId           = allToAllBufferId;
+	allToAllBuffer->allToAllSliceSize  = sliceSize;
+	allToAllBuffer->allToAllPairing    = pairing;
+	allToAllBuffer->allToAllRelayMask  = relayMask;
+	sendToAllBuffers->arraySize++;
+
+	return 0;
+}
+
+extern "C" int
+MeshAllToAll(MeshHandle_t * mh, uint64_t allToAllBufferId, const void * sendBuf, void * recvBuf)
+{
+	using namespace AppleCIOMeshUtils;
+
+	SendToAllBuffer_t * allToAllBuffer = lookupSendToAllBuffer(mh, allToAllBufferId);
+	if (allToAllBuffer == nullptr || allToAllBuffer->allToAllSliceSize == 0) {
+		MESHLOG("No all-to-all buffer with ID %lld\n", allToAllBufferId);
+		return EINVAL;
+	}
+
+	AllToAllContext * ctx = (AllToAllContext *)calloc(1, sizeof(AllToAllContext));
+	if (ctx == NULL) {
+		return ENOMEM;
+	}
+	ctx->mh                  = mh;
+	ctx->buffer              = allToAllBuffer;
+	ctx->nodeCount           = getAllToAllRanks(allToAllBuffer->sendtoallmask, ctx->ranks);
+	const uint32_t nodeCount = ctx->nodeCount;
+	const uint32_t me        = getBufferOffsetForNode(allToAllBuffer->sendtoallmask, mh->myNodeId);
+	const uint64_t sliceSize = allToAllBuffer->allToAllSliceSize;
+	const uint64_t slotSize  = allToAllBuffer->chunkSize;
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		if (i != me) {
+			ctx->keys[i] = lookupPairKey(mh, all_to_all_pair_mask(mh->myNodeId, ctx->ranks[i]));
+			CHECK(ctx->keys[i] != nullptr, "No key generated for nodes %u and %u. Aborting", mh->myNodeId, ctx->ranks[i]);
+		}
+	}
+
+	// Slices this node relays between two others go through the driver's
+	// forwarder, the node only prepares their slots up front and waits for
+	// them once its own slices are through.
+	int ret = 0;
+	for (uint64_t slot = 0; slot < allToAllBuffer->numChunks; slot++) {
+		if ((allToAllBuffer->allToAllRelayMask & (1ull << slot)) != 0 &&
+		    ![mh->service prepareDataChunkTransferFor:allToAllBufferId atOffset:slot * slotSize]) {
+			MESHLOG("Failed to prepare relayed slot %llu for bufferId %llu\n", slot, allToAllBufferId);
+			ret = EIO;
+		}
+	}
+
+	const AllToAllOps ops = {allToAllSend, allToAllReceive, allToAllSeal, allToAllOpen, ctx};
+	AllToAllExchange exchange(nodeCount, me, (AllToAllPairing)allToAllBuffer->allToAllPairing, sliceSize, slotSize,
+	                          (const uint8_t *)sendBuf, (uint8_t *)recvBuf, (uint8_t *)allToAllBuffer->shadow, ops);
+	if (ret == 0 && !exchange.run()) {
+		ret = EIO;
+	}
+
+	for (uint64_t slot = 0; ret == 0 && slot < allToAllBuffer->numChunks; slot++) {
+		char tag[kTagSize];
+		if ((allToAllBuffer->allToAllRelayMask & (1ull << slot)) != 0 &&
+		    ![mh->service waitOnSharedMemory:allToAllBufferId atOffset:slot * slotSize withTag:tag]) {
+			MESHLOG("Failed to relay slot %llu for bufferId %llu\n", slot, allToAllBufferId);
+			ret = EIO;
+		}
+	}
+
+	if (ret == 0) {
+		for (uint32_t i = 0; i < nodeCount; i++) {
+			if (i != me) {
+				atomic_fetch_add(&mh->stats.peerBytesSent[ctx->ranks[i]], sliceSize);
+				atomic_fetch_add(&mh->stats.peerBytesReceived[ctx->ranks[i]], sliceSize);
+			}
+		}
+	}
+	memset_s(ctx, sizeof(*ctx), 0, sizeof(*ctx));
+	free(ctx);
+	return ret;
+}
+
 // MARK: - Barrier
 
 static void *
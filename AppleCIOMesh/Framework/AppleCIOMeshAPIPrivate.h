@@ -44,7 +44,6 @@
 // It may end up reseting the future timestamp and then spin indefinitely.
 // #define MESH_SKIP_LAST_GATHER_TIMESTAMP
 
-#define MESH_SYNC_HISTOGRAM_COUNT 10
 // Maximum number of subchunks each chunk can be broken down into for
 // forwarding.
 #define MAX_BREAKDOWN_COUNT (8)
@@ -70,7 +69,7 @@
 
 #define LARGE_MAX_COUNTER 100
 
-#define MAX_NODE_MASKS 115
+#define MAX_NODE_MASKS 135
 
 #define MAX_SEND_TO_ALL_BUFFS 8
 
@@ -121,11 +120,30 @@ typedef struct {
 	uint64_t iterId;
 	atomic_int numErrs;
 	atomic_int lastNode;
+
+	// Phase boundaries of the current sync (CLOCK_UPTIME_RAW nsec, 0 if it did
+	// not happen yet). encryptDoneTime is written by BroadcastAndGather. Each
+	// per-node slot only has one writer, the thread receiving from that node,
+	// and it is written before the chunk is counted as received so
+	// BroadcastAndGather sees it once the sync completes.
+	uint64_t encryptDoneTime;
+	atomic_uint_fast64_t firstChunkTime[kMaxExtendedMeshNodes];
+	atomic_uint_fast64_t lastChunkTime[kMaxExtendedMeshNodes];
+	atomic_uint_fast64_t decryptDoneTime[kMaxExtendedMeshNodes];
+	atomic_uint_fast64_t netReceiveDoneTime;
 } BufferPerformanceStats_t;
 
 // forward declare to avoid clobbering whatever is generated from the framework
 struct PeerConnectionInfo;
 class MeshArena;
+struct MeshSyncTimeHistogram;
+struct MeshStragglerDetector;
+struct MeshSyncTrace;
+struct MeshEventTrace;
+struct MeshMetricsServer;
+struct MeshStatsPublisher;
+struct MeshCryptoPlacement;
+struct MeshChunkTable;
 
 /// A CIO Mesh buffer.
 typedef struct CIOBufferInfo {
@@ -169,6 +187,10 @@ typedef struct CIOBufferInfo {
 
 	// Performance statistics for this buffer.
 	BufferPerformanceStats_t performance;
+
+	// The sync (broadcast and gather iteration) this buffer is used for, to tag
+	// the events of the event trace. Advanced by numBuffers after every sync.
+	uint64_t traceSyncId;
 } CIOBufferInfo_t;
 
 // Per sync stats.
@@ -193,8 +215,16 @@ typedef struct MeshStats {
 	int64_t syncMinIter;
 	uint64_t syncMaxTime;
 	uint64_t syncCounter;
-	uint64_t syncTimeHistogram[MESH_SYNC_HISTOGRAM_COUNT];
-	uint64_t syncTimeHistogramBins[MESH_SYNC_HISTOGRAM_COUNT];
+	// Sync times (in nsec) of every sync since the handle was created.
+	MeshSyncTimeHistogram * syncTimeHistogram;
+	// Array of MeshSyncPhaseCount histograms, one per sync phase.
+	MeshSyncTimeHistogram * syncPhaseHistograms;
+	// Per-peer lateness of the syncs, fed from the per-node lastChunkTime.
+	MeshStragglerDetector * stragglerDetector;
+	// Sync trace being written, NULL when the syncs are not traced.
+	MeshSyncTrace * syncTrace;
+	// Data path events of the mesh threads, NULL when they are not traced.
+	MeshEventTrace * eventTrace;
 	uint64_t lastNodeToSyncCount[kMaxCIOMeshNodes]; // who was the last node to sync
 	uint64_t lastLog;
 	double totalIncomingCounter;
@@ -213,6 +243,18 @@ typedef struct MeshStats {
 	atomic_uint_fast64_t num_decrypt;
 	uint64_t cryptoWaitTotal;
 	uint64_t cryptoWaitCount;
+	// Number of per node mask and per pair key sets derived from the mesh
+	// crypto key.
+	atomic_uint_fast64_t keyDerivations;
+
+	// Bytes sent to and received from each peer (by extended node rank),
+	// counted on the data path as they go, whatever the verbosity.
+	atomic_uint_fast64_t peerBytesSent[kMaxExtendedMeshNodes];
+	atomic_uint_fast64_t peerBytesReceived[kMaxExtendedMeshNodes];
+	// Serves the stats to local scrapers, NULL when they are not served.
+	MeshMetricsServer * metricsServer;
+	// Publishes the stats to shared memory, NULL when they are not published.
+	MeshStatsPublisher * statsPublisher;
 
 	os_log_t logHandle;
 	os_log_t signpostHandle;
@@ -229,8 +271,10 @@ typedef struct MeshStats {
 typedef struct MeshBufferStats {
 	uint64_t syncTotalTime;
 	uint64_t syncCounter;
-	uint64_t syncTimeHistogram[MESH_SYNC_HISTOGRAM_COUNT];
-	uint64_t syncTimeHistogramBins[MESH_SYNC_HISTOGRAM_COUNT];
+	// Sync times (in nsec) of every sync done with these buffers.
+	MeshSyncTimeHistogram * syncTimeHistogram;
+	// Syncs slower than this (in nsec) are recorded in largeTimes.
+	uint64_t longSyncTime;
 	uint64_t largeTimes[LARGE_MAX_COUNTER];
 	uint64_t largeTimesIter[LARGE_MAX_COUNTER];
 	uint64_t largeCounter;
@@ -340,6 +384,14 @@ typedef struct SendToAllBuffer {
 	uint64_t chunkSize;
 	uint64_t sendtoallmask;
 	uint64_t bufferId;
+
+	// All-to-all buffers have a chunk for every ordered pair of nodes in the
+	// mask. The slice size is 0 for send to all buffers, the pairing is an
+	// AllToAllPairing and the relay mask has a bit for every chunk this node
+	// forwards between two others.
+	uint64_t allToAllSliceSize;
+	uint32_t allToAllPairing;
+	uint64_t allToAllRelayMask;
 } SendToAllBuffer_t;
 
 // An array of all the send to
@@ -356,6 +408,12 @@ typedef struct MeshCryptoKeyStateArray {
 	uint64_t key_count;
 	uint64_t node_masks[MAX_NODE_MASKS];
 	MeshCryptoKeyState_t keys[MAX_NODE_MASKS];
+
+	// The all-to-all keys of this node and each other node of its partition,
+	// derived apart from the node mask keys (see MeshKeyKind).
+	uint64_t pair_count;
+	uint64_t pair_masks[kMaxCIOMeshNodes];
+	MeshCryptoKeyState_t pair_keys[kMaxCIOMeshNodes];
 } MeshCryptoKeyStateArray_t;
 /// CIO Mesh crypto state.
 typedef struct MeshCryptoState {
@@ -395,6 +453,8 @@ typedef struct {
 	void * mh;
 	uint32_t whoami_local;
 	uint32_t whoami_extended;
+	// The CPU domain the thread runs in, see MeshSetCryptoPlacement.
+	uint32_t placementDomain;
 } CryptoArg_t;
 
 /// Handle to the CIO Mesh.
@@ -534,6 +594,12 @@ typedef struct MeshHandle {
 	// Arena allocator for the shadow buffers
 	MeshArena * shadow_arena;
 
+	// Where the crypto threads run, NULL if they are not placed.
+	MeshCryptoPlacement * cryptoPlacement;
+
+	// The tuned chunk sizes, NULL to use the defaults.
+	MeshChunkTable * chunkTable;
+
 	// The number of expected peer connections.
 	// Used to determine if all expected connections have been established.
 	// atomic_int peerConnectionCount;
@@ -164,6 +164,37 @@ typedef void (^MeshSynchronizedBlock)();
     andPrepareAssignedDataChunkFrom:(uint64_t)prepareBufferId
                            atOffset:(uint64_t)prepareOffset;
 
+// Sets up a command ring with room for entries commands (a power of two)
+// so a sync's sends and prepares can go to the driver in one trap. tagSize
+// is how many bytes of tags every send carries. Returns NO if the driver
+// has no command ring, the per chunk calls above keep working either way.
+- (BOOL)setupCommandRingWithEntries:(uint32_t)entries tagSize:(uint32_t)tagSize;
+
+// Whether setupCommandRingWithEntries has succeeded.
+- (BOOL)hasCommandRing;
+
+// How many more commands can be queued before submitQueuedCommands has to
+// be called.
+- (uint32_t)commandRingSpace;
+
+// Queues what sendAssignedDataChunkFrom:atOffset:withTags: does without
+// calling into the driver. Returns NO if the ring is full.
+- (BOOL)queueSendAssignedDataChunkFrom:(uint64_t)bufferId atOffset:(uint64_t)offset withTags:(char *)tags;
+
+// Queues what
+// sendAssignedDataChunkFrom:atOffset:withTags:andPrepareAssignedDataChunkFrom:atOffset:
+// does without calling into the driver. Returns NO if the ring is full.
+- (BOOL)queueSendAssignedDataChunkFrom:(uint64_t)sendBufferId
+                              atOffset:(uint64_t)sendOffset
+                              withTags:(char *)tags
+       andPrepareAssignedDataChunkFrom:(uint64_t)prepareBufferId
+                              atOffset:(uint64_t)prepareOffset;
+
+// Runs everything queued, in order, with a single trap. Blocks until every
+// command is done. Returns NO if any of them failed, the ones after the
+// failure are not run.
+- (BOOL)submitQueuedCommands;
+
 // Interrupts all waiting (waitOnSharedMemory) threads.
 - (BOOL)interruptWaitingThreads:(uint64_t)bufferId;
 
@@ -18,10 +18,13 @@
 #import <Foundation/Foundation.h>
 #import <IOKit/IOKitLib.h>
 #include <cctype>
+#include <mach/mach.h>
+#include <mach/mach_vm.h>
 #import <os/log.h>
 #include <unordered_map>
 
 #import "AppleCIOMeshUserClientInterface.h"
+#include "Common/CommandRing.h"
 #import <AppleCIOMeshSupport/AppleCIOMeshServiceRef.h>
 
 namespace MUCI = AppleCIOMeshUserClientInterface;
@@ -43,6 +46,14 @@ namespace MUCI = AppleCIOMeshUserClientInterface;
 	IncomingDataChunkBlock _incomingDataChunkBlock;
 	SendCompleteBlock _sendCompleteBlock;
 	MeshSynchronizedBlock _meshSyncBlock;
+
+	// The command ring shared with the driver, see setupCommandRingWithEntries.
+	AppleCIOMeshUtils::CommandRing _commandRing;
+	mach_vm_address_t _commandRingAddress;
+	mach_vm_size_t _commandRingSize;
+	uint32_t _commandTagSize;
+	uint32_t _queuedCommands;
+	AppleCIOMeshUtils::MeshCompletion * _completions;
 }
 
 #pragma mark - Init/deinit
@@ -63,6 +74,12 @@ namespace MUCI = AppleCIOMeshUserClientInterface;
 		_incomingDataChunkBlock = nil;
 		_sendCompleteBlock      = nil;
 		_meshSyncBlock          = nil;
+
+		_commandRingAddress = 0;
+		_commandRingSize    = 0;
+		_commandTagSize     = 0;
+		_queuedCommands     = 0;
+		_completions        = nullptr;
 	}
 
 	return self;
@@ -83,6 +100,7 @@ namespace MUCI = AppleCIOMeshUserClientInterface;
 {
 	[self notifyUnregister];
 	[self close];
+	[self freeCommandRing];
 }
 
 + (instancetype)fromIOService:(io_service_t)service
@@ -157,6 +175,9 @@ namespace MUCI = AppleCIOMeshUserClientInterface;
 
 	IOServiceClose(_connection);
 	_connection = IO_OBJECT_NULL;
+
+	// The driver's mapping of the ring goes away with the connection.
+	[self freeCommandRing];
 }
 
 #pragma mark - Notifications
@@ -732,6 +753,170 @@ fail:
 	return NO;
 }
 
+#pragma mark - Command ring
+
+- (void)freeCommandRing
+{
+	_commandRing.detach();
+	if (_commandRingAddress != 0) {
+		mach_vm_deallocate(mach_task_self(), _commandRingAddress, _commandRingSize);
+		_commandRingAddress = 0;
+		_commandRingSize    = 0;
+	}
+	free(_completions);
+	_completions    = nullptr;
+	_queuedCommands = 0;
+}
+
+- (BOOL)setupCommandRingWithEntries:(uint32_t)entries tagSize:(uint32_t)tagSize
+{
+	MUCI::CommandRing ring;
+	kern_return_t ret;
+	require([self open], fail);
+
+	if ([self hasCommandRing]) {
+		return YES;
+	}
+
+	if (!AppleCIOMeshUtils::CommandRing::validEntries(entries) || tagSize > AppleCIOMeshUtils::kMeshCommandTagBytes) {
+		LogError("invalid command ring of %u entries with %u byte tags\n", entries, tagSize);
+		return NO;
+	}
+
+	_commandRingSize = mach_vm_round_page(AppleCIOMeshUtils::command_ring_size(entries));
+	ret              = mach_vm_allocate(mach_task_self(), &_commandRingAddress, _commandRingSize, VM_FLAGS_ANYWHERE);
+	if (ret != KERN_SUCCESS) {
+		LogError("failed to allocate the command ring %u\n", ret);
+		_commandRingAddress = 0;
+		return NO;
+	}
+
+	_completions = (AppleCIOMeshUtils::MeshCompletion *)calloc(entries, sizeof(AppleCIOMeshUtils::MeshCompletion));
+	if (_completions == nullptr || !_commandRing.init((void *)_commandRingAddress, _commandRingSize, entries)) {
+		LogError("failed to set up the command ring\n");
+		[self freeCommandRing];
+		return NO;
+	}
+
+	ring.address = _commandRingAddress;
+	ring.size    = (int64_t)_commandRingSize;
+	ring.entries = entries;
+
+	ret = IOConnectCallStructMethod(_connection, MUCI::Method::SetupCommandRing, &ring, sizeof(ring), nullptr, 0);
+	if (ret != KERN_SUCCESS) {
+		// Older drivers and VirtMesh don't have a command ring.
+		LogInfo("failed to call SetupCommandRing %u, using a trap per command\n", ret);
+		[self freeCommandRing];
+		return NO;
+	}
+
+	_commandTagSize = tagSize;
+	return YES;
+
+fail:
+	return NO;
+}
+
+- (BOOL)hasCommandRing
+{
+	return _commandRing.isAttached();
+}
+
+- (uint32_t)commandRingSpace
+{
+	return [self hasCommandRing] ? _commandRing.submissionSpace() : 0;
+}
+
+- (BOOL)queueCommand:(const AppleCIOMeshUtils::MeshCommand &)command withTags:(char *)tags
+{
+	AppleCIOMeshUtils::MeshCommand queued = command;
+
+	if (![self hasCommandRing]) {
+		return NO;
+	}
+
+	if (tags != nullptr) {
+		memcpy(queued.tags, tags, _commandTagSize);
+	}
+	queued.userData = _queuedCommands;
+
+	if (_commandRing.submit(&queued, 1) != 1) {
+		return NO;
+	}
+	_queuedCommands++;
+	return YES;
+}
+
+- (BOOL)queueSendAssignedDataChunkFrom:(uint64_t)bufferId atOffset:(uint64_t)offset withTags:(char *)tags
+{
+	AppleCIOMeshUtils::MeshCommand command = {};
+
+	command.op           = AppleCIOMeshUtils::kMeshCommandSend;
+	command.sendBufferId = (MUCI::BufferId)bufferId;
+	command.sendOffset   = (int64_t)offset;
+
+	return [self queueCommand:command withTags:tags];
+}
+
+- (BOOL)queueSendAssignedDataChunkFrom:(uint64_t)sendBufferId
+                              atOffset:(uint64_t)sendOffset
+                              withTags:(char *)tags
+       andPrepareAssignedDataChunkFrom:(uint64_t)prepareBufferId
+                              atOffset:(uint64_t)prepareOffset
+{
+	AppleCIOMeshUtils::MeshCommand command = {};
+
+	command.op              = AppleCIOMeshUtils::kMeshCommandSendAndPrepare;
+	command.sendBufferId    = (MUCI::BufferId)sendBufferId;
+	command.sendOffset      = (int64_t)sendOffset;
+	command.prepareBufferId = (MUCI::BufferId)prepareBufferId;
+	command.prepareOffset   = (int64_t)prepareOffset;
+
+	return [self queueCommand:command withTags:tags];
+}
+
+- (BOOL)submitQueuedCommands
+{
+	kern_return_t ret;
+	uint32_t reaped;
+	BOOL success = YES;
+	require([self open], fail);
+
+	if (_queuedCommands == 0) {
+		return YES;
+	}
+
+	ret = IOConnectTrap0(_connection, MUCI::Trap::SubmitCommands);
+
+	// Whatever happened, every completion is collected so the ring is empty
+	// for the next sync.
+	reaped = _commandRing.reap(_completions, _commandRing.entries());
+	for (uint32_t i = 0; i < reaped; i++) {
+		if (_completions[i].status != KERN_SUCCESS && (_completions[i].flags & AppleCIOMeshUtils::kMeshCompletionSkipped) == 0) {
+			LogError("command %llu of %u failed %d\n", _completions[i].userData, _queuedCommands, _completions[i].status);
+			success = NO;
+		}
+	}
+	_queuedCommands = 0;
+
+	if (_commandRing.inFlight() != 0) {
+		// The driver gave up before taking everything, stale commands would
+		// run with the next sync. Go back to a trap per command.
+		LogError("SubmitCommands left %u commands behind, dropping the command ring\n", _commandRing.inFlight());
+		[self freeCommandRing];
+	}
+
+	if (ret != KERN_SUCCESS) {
+		LogError("failed to call SubmitCommands trap %u\n", ret);
+		return NO;
+	}
+
+	return success;
+
+fail:
+	return NO;
+}
+
 - (BOOL)sendAllAssignedDataFrom:(uint64_t)bufferId withTags:(char *)tags
 {
 	MUCI::BufferId bufferId_ = (MUCI::BufferId)bufferId;
@@ -13,124 +13,184 @@
 // 10/02/2024
 
 #pragma once
+#include "Common/LargePages.h"
+#include "Common/TLSFAllocator.h"
 #include <cstddef>
 #include <mach/vm_statistics.h>
 #include <sys/mman.h>
 
+// Hands out page aligned buffers from one large mmap'd region. Allocations are
+// managed by a TLSFAllocator over the pages of the region, so buffers that are
+// released are reused by later allocations of any size instead of the region
+// only being reset once everything was released.
+//
+// The region can be backed by 2MB pages where the platform has them, which cuts
+// the TLB misses of decrypting and copying large buffers. create() reports the
+// pages it got through page_kind().
+//
+// Memory is mlock'd from the start of the region up to the end of the highest
+// allocation (or further, see lock()). It is faulted in by several threads
+// first, which is much faster than mlock faulting in large ranges on its own.
+// Pages stay locked when they are freed, so reused memory does not fault again.
 class [[gnu::visibility("hidden")]] MeshArena
 {
+	const AppleCIOMeshUtils::LargePageMapping m_mapping;
 	void * const m_memory;
 	const size_t m_capacity;
-	size_t m_allocated                = 0;
-	size_t m_offset                   = 0;
-	size_t m_locked_offset            = 0;
-	size_t m_max_locked_offset        = 0;
-	static constexpr size_t kPageSize = 16ull * 1024;
-	MeshArena(void * memory, size_t capacity) : m_memory(memory), m_capacity(capacity)
+	AppleCIOMeshUtils::TLSFAllocator * const m_pages;
+	size_t m_locked                            = 0;
+	static constexpr size_t kPageSize          = 16ull * 1024;
+	static constexpr uint32_t kPrefaultThreads = 8;
+	MeshArena(const AppleCIOMeshUtils::LargePageMapping & mapping, size_t capacity, AppleCIOMeshUtils::TLSFAllocator * pages)
+	    : m_mapping(mapping), m_memory(mapping.memory), m_capacity(capacity), m_pages(pages)
 	{
 	}
 
+	static size_t
+	pages_for(size_t bytes)
+	{
+		return (bytes + kPageSize - 1) / kPageSize;
+	}
+
+	// Locks the region up to end if it is not already.
+	void
+	lock_to(size_t end)
+	{
+		if (end > m_capacity) {
+			end = m_capacity;
+		}
+		if (end > m_locked) {
+			void * start = (unsigned char *)m_memory + m_locked;
+			AppleCIOMeshUtils::prefault_parallel(start, end - m_locked, m_mapping.pageSize, kPrefaultThreads);
+			mlock(start, end - m_locked);
+			m_locked = end;
+		}
+	}
+
   public:
 	/**
-	 * Creates a new Arena of the specified capacity.
+	 * Creates a new Arena of the specified capacity, backed by 2MB pages if largePages
+	 * is true and the platform has them.
 	 * The caller is responsible of freeing this arena (using operator delete).
 	 * If creation fails, this function returns nullptr.
 	 */
 	static MeshArena *
-	create(size_t capacity)
+	create(size_t capacity, bool largePages)
 	{
 		// Align the capacity on page size
-		capacity      = (capacity + kPageSize - 1) & ~(kPageSize - 1);
-		int fd        = VM_MAKE_TAG(VM_MEMORY_IOSURFACE);
-		auto * memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, fd, 0 /* offset */);
-		if (memory == MAP_FAILED) {
+		capacity = (capacity + kPageSize - 1) & ~(kPageSize - 1);
+		if (capacity == 0 || capacity / kPageSize >= AppleCIOMeshUtils::TLSFAllocator::kNone) {
 			return nullptr;
 		}
-		return new MeshArena{memory, capacity};
+		auto * pages = AppleCIOMeshUtils::TLSFAllocator::create((uint32_t)(capacity / kPageSize));
+		if (pages == nullptr) {
+			return nullptr;
+		}
+		AppleCIOMeshUtils::LargePageMapping mapping;
+		if (!AppleCIOMeshUtils::map_large_pages(capacity, largePages, VM_MAKE_TAG(VM_MEMORY_IOSURFACE), &mapping)) {
+			delete pages;
+			return nullptr;
+		}
+		return new MeshArena{mapping, capacity, pages};
 	}
 
 	~MeshArena()
 	{
 		if (m_memory) {
-			munlock(m_memory, m_max_locked_offset);
-			munmap(m_memory, m_capacity);
+			munlock(m_memory, m_locked);
+			AppleCIOMeshUtils::unmap_large_pages(m_mapping);
 		}
+		delete m_pages;
 	}
 
 	MeshArena(MeshArena const &)             = delete;
 	MeshArena & operator=(MeshArena const &) = delete;
 
 	/**
-	 * Allocates the specified number of bytes in the arena.
-	 * If there is not enough space, this function will return nullptr.
+	 * Allocates the specified number of bytes in the arena, rounded up to whole pages.
+	 * If there is not enough contiguous free space, this function will return nullptr.
 	 */
 	void *
 	alloc(size_t bufferSize)
 	{
-		const auto alignment  = alignof(max_align_t);
-		size_t aligned_offset = (m_offset + alignment - 1) & ~(alignment - 1);
-		if (aligned_offset + bufferSize > m_capacity) {
+		const size_t pages = pages_for(bufferSize);
+		if (pages == 0 || pages > m_pages->capacity()) {
 			return nullptr;
 		}
-		void * result = (unsigned char *)m_memory + aligned_offset;
-		m_offset      = aligned_offset + bufferSize;
-
-		// This is less than what we actually allocated (because alignment adds to it).
-		// However, this is purely to keep track of how much was requested so when dealloc is called
-		// we know when to reset the whole arena.
-		m_allocated += bufferSize;
-		return result;
+		const uint32_t first = m_pages->alloc((uint32_t)pages);
+		if (first == AppleCIOMeshUtils::TLSFAllocator::kNone) {
+			return nullptr;
+		}
+		lock_to((first + pages) * kPageSize);
+		return (unsigned char *)m_memory + first * kPageSize;
 	}
 
 	/**
-	 * Locks the specified size into RAM preventing that memory from being paged to swap.
+	 * Locks enough of the arena into RAM that the specified number of bytes can be
+	 * allocated from locked memory, preventing it from being paged to swap.
 	 * This avoids incurring a page fault when the memory is accessed later.
+	 * Freed memory that is already locked counts towards it.
 	 */
 	void
 	lock(size_t bufferSize)
 	{
-		if (m_locked_offset < m_offset) {
-			// In case alloc is called with a larger number than hint.
-			// Or if alloc is called prior without a corresponding prefault().
-			m_locked_offset = m_offset;
-		}
-		const auto alignment        = alignof(max_align_t);
-		const size_t aligned_offset = (m_locked_offset + alignment - 1) & ~(alignment - 1);
-		if (aligned_offset + bufferSize > m_capacity) {
-			return;
+		const size_t allocated = (size_t)m_pages->allocated() * kPageSize;
+		const size_t free      = m_locked > allocated ? m_locked - allocated : 0;
+		if (free < bufferSize) {
+			lock_to(m_locked + pages_for(bufferSize - free) * kPageSize);
 		}
+	}
 
-		void * mem      = (unsigned char *)m_memory + aligned_offset;
-		m_locked_offset = aligned_offset + bufferSize;
-		if (m_locked_offset > m_max_locked_offset) {
-			m_max_locked_offset = m_locked_offset;
-			mlock(mem, bufferSize);
+	/**
+	 * Returns a buffer returned by alloc to the arena, merging it with the free space
+	 * around it. The order in which you call dealloc does not have to match the order
+	 * of alloc. Returns the number of bytes still allocated.
+	 */
+	size_t
+	dealloc(void * buffer)
+	{
+		const size_t offset = (size_t)((unsigned char *)buffer - (unsigned char *)m_memory);
+		if (buffer >= m_memory && offset < m_capacity && offset % kPageSize == 0) {
+			m_pages->free((uint32_t)(offset / kPageSize));
 		}
+		return (size_t)m_pages->allocated() * kPageSize;
+	}
+
+	/**
+	 * Returns the usage of the arena, in bytes.
+	 */
+	AppleCIOMeshUtils::TLSFAllocatorStats
+	stats() const
+	{
+		AppleCIOMeshUtils::TLSFAllocatorStats stats = m_pages->stats();
+		stats.capacity *= kPageSize;
+		stats.allocated *= kPageSize;
+		stats.peakAllocated *= kPageSize;
+		stats.largestFreeBlock *= kPageSize;
+		return stats;
 	}
 
 	/**
-	 * This function does not actually deallocate the bytes. However, if the number of bytes
-	 * deallocated is equal to the total number of the bytes allocated the arena will reset itself.
-	 * The order in which you call dealloc does not have to match the order of alloc.
-	 *
+	 * Returns the kind of pages the arena got, and their size.
 	 */
+	AppleCIOMeshUtils::LargePageKind
+	page_kind() const
+	{
+		return m_mapping.kind;
+	}
+
 	size_t
-	dealloc(size_t bufferSize)
+	page_size() const
 	{
-		m_allocated -= bufferSize;
-		if (m_allocated == 0) {
-			reset();
-		}
-		return m_allocated;
+		return m_mapping.pageSize;
 	}
 
 	/**
-	 * Clears the arena and resets its size back to zero.
+	 * Returns the number of bytes of the arena locked into RAM.
 	 */
-	void
-	reset()
+	size_t
+	locked() const
 	{
-		m_offset        = 0;
-		m_locked_offset = 0;
+		return m_locked;
 	}
 };
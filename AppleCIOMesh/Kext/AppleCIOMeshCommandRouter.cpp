@@ -44,9 +44,7 @@ AppleCIOMeshCommandRouter::initWithService(AppleCIOMeshService * provider)
 		_channelNodeMap[i] = MCUCI::kUnassignedNode;
 	}
 
-	for (uint32_t i = 0; i < _cioDestinationMap.length(); i++) {
-		_cioDestinationMap[i] = -1;
-	}
+	_routes.clear();
 
 	for (uint32_t i = 0; i < _sourceCIOMap.length(); i++) {
 		_sourceCIOMap[i] = -1;
@@ -66,11 +64,7 @@ AppleCIOMeshCommandRouter::removeChannel(MCUCI::MeshChannelIdx channelIndex)
 {
 	_channelNodeMap[channelIndex] = MCUCI::kUnassignedNode;
 
-	for (int i = 0; i < _cioDestinationMap.size(); i++) {
-		if (_cioDestinationMap[i] == channelIndex) {
-			_cioDestinationMap[i] = -1;
-		}
-	}
+	_routes.removeChannel((int32_t)channelIndex);
 
 	for (int i = 0; i < _sourceCIOMap.size(); i++) {
 		if (_sourceCIOMap[i] == channelIndex) {
@@ -82,9 +76,7 @@ AppleCIOMeshCommandRouter::removeChannel(MCUCI::MeshChannelIdx channelIndex)
 void
 AppleCIOMeshCommandRouter::removeAllChannels()
 {
-	for (int i = 0; i < _cioDestinationMap.size(); i++) {
-		_cioDestinationMap[i] = -1;
-	}
+	_routes.clear();
 
 	for (int i = 0; i < _sourceCIOMap.size(); i++) {
 		_sourceCIOMap[i] = -1;
@@ -110,20 +102,25 @@ AppleCIOMeshCommandRouter::addRouteTo(MCUCI::NodeId receiver, MCUCI::NodeId forw
 			return;
 		}
 
-		_cioDestinationMap[receiver] = (int32_t)cioChannelIdx;
+		if (!_routes.addRoute(receiver, cioChannelIdx, receiver)) {
+			LOG("No room for a direct route to receiver:%d on channel:%d", receiver, cioChannelIdx);
+		}
 		return;
 	}
 
-	// if forwarder != self, then we get the _cioDestinationMap for that forwarder
-	// and set it for this receiver
-	int32_t cioChannelindex = _cioDestinationMap[forwarder];
-	if (cioChannelindex == -1) {
+	// if forwarder != self, then the route to the receiver goes out on the
+	// channel to the forwarder
+	int32_t forwarderRoute = _routes.bestRoute(forwarder);
+	if (forwarderRoute == -1) {
 		LOG("Adding a route through forwarder:%d to receiver:%d before a route to the forwarder has been set.", forwarder,
 		    receiver);
 		return;
 	}
 
-	_cioDestinationMap[receiver] = cioChannelindex;
+	int32_t cioChannelindex = _routes.route(forwarder, (uint32_t)forwarderRoute).channel;
+	if (!_routes.addRoute(receiver, cioChannelindex, forwarder)) {
+		LOG("No room for a route through forwarder:%d to receiver:%d", forwarder, receiver);
+	}
 }
 
 void
@@ -140,7 +137,17 @@ AppleCIOMeshCommandRouter::addSourceNodeCIOChannel(MCUCI::NodeId node, MCUCI::Me
 MCUCI::MeshChannelIdx
 AppleCIOMeshCommandRouter::getCIOChannelForDestination(MCUCI::NodeId destination)
 {
-	return (MCUCI::MeshChannelIdx)_cioDestinationMap[destination];
+	int32_t route = _routes.bestRoute(destination);
+	if (route == -1) {
+		return (MCUCI::MeshChannelIdx)-1;
+	}
+	return (MCUCI::MeshChannelIdx)_routes.route(destination, (uint32_t)route).channel;
+}
+
+void
+AppleCIOMeshCommandRouter::recordChannelCompletion(MCUCI::MeshChannelIdx channelIndex, uint64_t latency)
+{
+	_routes.recordCompletion((int32_t)channelIndex, latency);
 }
 
 MCUCI::MeshChannelIdx
@@ -160,8 +167,8 @@ AppleCIOMeshCommandRouter::getNumNodesInMesh()
 	// Start at 1 for self.
 	uint32_t retVal = 1;
 
-	for (uint32_t i = 0; i < _cioDestinationMap.length(); i++) {
-		if (_cioDestinationMap[i] != -1) {
+	for (uint32_t i = 0; i < kMaxCIOMeshNodes; i++) {
+		if (_routes.routeCount(i) > 0) {
 			retVal++;
 		}
 	}
@@ -18,6 +18,7 @@
 
 #include "AppleCIOMeshUserClientInterface.h"
 #include "Common/Config.h"
+#include "Common/MultiPathRoutes.h"
 #include <libkern/c++/OSBoundedArray.h>
 #include <libkern/c++/OSObject.h>
 
@@ -37,13 +38,21 @@ class AppleCIOMeshCommandRouter : public OSObject
 	void removeChannel(MCUCI::MeshChannelIdx channelIndex);
 	void removeAllChannels();
 
+	/// Adds a route to the receiver, directly or through a forwarder. A receiver
+	/// keeps every route it is given, one per channel.
 	void addRouteTo(MCUCI::NodeId receiver, MCUCI::NodeId forwarder);
 
 	void addSourceNodeCIOChannel(MCUCI::NodeId node, MCUCI::MeshChannelIdx channelIndex);
 
 	/// Returns the CIO Channel to send data out on for a particular destination.
+	/// With several routes it is the direct one, or else the one whose channel
+	/// completes the fastest.
 	MCUCI::MeshChannelIdx getCIOChannelForDestination(MCUCI::NodeId destination);
 
+	/// Records how long a transmit on a channel took to complete, the route
+	/// weights follow these. Safe to call from completion callbacks.
+	void recordChannelCompletion(MCUCI::MeshChannelIdx channelIndex, uint64_t latency);
+
 	/// Returns the CIO channel a node's data is going to come on.
 	MCUCI::MeshChannelIdx getSourceNodeCIOChannel(MCUCI::NodeId sourceNode);
 
@@ -55,13 +64,13 @@ class AppleCIOMeshCommandRouter : public OSObject
 	// Channel -> Node -- this is only needed to create the next maps quickly
 	OSBoundedArray<MCUCI::NodeId, kMaxMeshChannelCount> _channelNodeMap;
 
-	// Node -> Channel Idx
-	// This is the channel a command has to go out on to reach the destination.
+	// Node -> Routes
+	// These are the channels a command can go out on to reach the destination.
 	// Even if the source is not us, we can use this same destination map, because
 	// a farther back source will use the same direct path to the destination.
 	// If the farther back source found a shorter way to the destination, it
 	// wasn't through us.
-	OSBoundedArray<int32_t, kMaxCIOMeshNodes> _cioDestinationMap;
+	AppleCIOMeshUtils::MultiPathRoutes<kMaxCIOMeshNodes, kMaxMeshChannelCount> _routes;
 
 	// Node -> Channel Idx
 	// This is the channel a node's data is coming from. This may not be the same
@@ -115,8 +115,13 @@ const IOExternalMethodDispatch2022 AppleCIOMeshConfigUserClient::_methods[MCUCI:
              &AppleCIOMeshConfigUserClient::getBuffersAllocatedByCrypto, 0, 0, 0, sizeof(uint64_t), false,
              /* no special entitlement */
          },
-     [MCUCI::Method::canActivate] = {
-         &AppleCIOMeshConfigUserClient::canActivate, 0, sizeof(MCUCI::MeshNodeCount), 0, 0, false,
+     [MCUCI::Method::canActivate] =
+         {
+             &AppleCIOMeshConfigUserClient::canActivate, 0, sizeof(MCUCI::MeshNodeCount), 0, 0, false,
+             /* no special entitlement */
+         },
+     [MCUCI::Method::canActivateNodes] = {
+         &AppleCIOMeshConfigUserClient::canActivateNodes, 0, sizeof(MCUCI::MeshNodeMask), 0, 0, false,
          /* no special entitlement */
 
      }};
@@ -697,3 +702,18 @@ AppleCIOMeshConfigUserClient::canActivate(OSObject * target,
 		return kIOReturnNotReady;
 	}
 }
+
+IOReturn
+AppleCIOMeshConfigUserClient::canActivateNodes(OSObject * target,
+                                               __unused void * reference,
+                                               __unused IOExternalMethodArguments * arguments)
+{
+	auto me = OSRequiredCast(AppleCIOMeshConfigUserClient, target);
+	EMAInputExtractor<MCUCI::MeshNodeMask> nodeMask(arguments);
+
+	if (me->_provider->canActivateNodes(nodeMask.get())) {
+		return kIOReturnSuccess;
+	} else {
+		return kIOReturnNotReady;
+	}
+}
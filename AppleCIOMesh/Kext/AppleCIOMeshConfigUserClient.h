@@ -82,6 +82,7 @@ class AppleCIOMeshConfigUserClient final : public IOUserClient2022
 	static IOReturn getCryptoState(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
 	static IOReturn getBuffersAllocatedByCrypto(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
 	static IOReturn canActivate(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
+	static IOReturn canActivateNodes(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
 
 	bool is_task_entitled_to(task_t task, const char * entitlement);
 
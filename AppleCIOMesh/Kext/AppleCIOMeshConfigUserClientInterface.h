@@ -48,6 +48,9 @@ typedef uint32_t MeshChannelIdx;
 /// The number of nodes in the mesh
 typedef uint32_t MeshNodeCount;
 
+/// The nodes in the mesh, bit r set for the node of partition rank r.
+typedef uint32_t MeshNodeMask;
+
 typedef uint32_t EnsembleSize;
 
 /// The chassisID of each node.
@@ -139,6 +142,9 @@ class Method
 		SetEnsembleSize,
 		// Get the size of the ensemble
 		GetEnsembleSize,
+		// Like canActivate, for a mesh of the ranks in a ::MeshNodeMask, e.g.
+		// what is left of an ensemble after a node failed.
+		canActivateNodes,
 
 		NumMethods
 	};
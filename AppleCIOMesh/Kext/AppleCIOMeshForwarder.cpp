@@ -37,20 +37,21 @@ OSDefineMetaClassAndStructors(AppleCIOForwardChain, OSObject);
 void
 ForwardActionChainGroup::addChildElement(ForwardActionChainElement * element)
 {
+	// The group was created with room for every element grouped into it.
+	if (elementCount == elementCapacity) {
+		panic("Too many elements added to chain group: %u\n", elementCount);
+	}
+
 	// As we create the group, the group is ready to prepare
 	// and is finished.
 	elements[elementCount++] = element;
-	atomic_store(&completeElementCount, elementCount);
-
-	if (elementCount > kMaxForwardElementActions) {
-		panic("Too many elemetns added to chain group: %d\n", elementCount);
-	}
+	completeElementCount.store(elementCount);
 }
 
 bool
 ForwardActionChainGroup::isGroupFinished()
 {
-	return atomic_load(&completeElementCount) == elementCount;
+	return completeElementCount.load() == elementCount;
 }
 
 // MARK: - Forward Chain
@@ -81,6 +82,15 @@ AppleCIOForwardChain::initialize(MUCI::ForwardChainId chainId, uint8_t linksPerC
 void
 AppleCIOForwardChain::free()
 {
+	for (uint32_t i = 0; i < _groups.capacity(); i++) {
+		if (_groups.isAllocated(i)) {
+			auto group = _groups.get(i);
+			IODelete(group->elements, ForwardActionChainElement *, group->elementCapacity);
+		}
+	}
+	_forwardChain.reset();
+	_groups.reset();
+	_groupPtrs.reset();
 	super::free();
 }
 
@@ -108,7 +118,7 @@ AppleCIOForwardChain::addStartIndex(uint32_t count)
 	// count is the total number of elements, which are grouped up by
 	// the links * chunksPerBlock.
 
-	auto elementsPerGroup = _groupPtrs[0]->elementCount;
+	auto elementsPerGroup = getGroup(0)->elementCount;
 	elementsPerGroup /= _linksPerChannel;
 
 	_startIdx = (_startIdx + (count / elementsPerGroup)) % _forwardGroupCount;
@@ -117,13 +127,13 @@ AppleCIOForwardChain::addStartIndex(uint32_t count)
 ForwardActionChainElement *
 AppleCIOForwardChain::getElement(uint32_t idx)
 {
-	return &(_forwardChain[idx]);
+	return _forwardChain.get(idx);
 }
 
 ForwardActionChainGroup *
 AppleCIOForwardChain::getGroup(uint32_t idx)
 {
-	return _groupPtrs[idx];
+	return *_groupPtrs.get(idx);
 }
 
 OSBoundedArrayRef<AppleCIOForwardChain *>
@@ -132,34 +142,50 @@ AppleCIOForwardChain::getPartnerChains()
 	return OSBoundedArrayRef<AppleCIOForwardChain *>(_partnerChains);
 }
 
-void
+bool
 AppleCIOForwardChain::setChainGroup(uint32_t idx, ForwardActionChainGroup * group)
 {
-	_groupPtrs[idx]    = group;
-	auto tmp           = idx + 1;
-	_forwardGroupCount = tmp > _forwardGroupCount ? tmp : _forwardGroupCount;
+	// Nothing is released from the index, so it hands out slots in order.
+	uint32_t slot;
+	while (_groupPtrs.inUse() <= idx) {
+		if (!_groupPtrs.allocate(&slot)) {
+			return false;
+		}
+	}
+
+	*_groupPtrs.get(idx) = group;
+	auto tmp             = idx + 1;
+	_forwardGroupCount   = tmp > _forwardGroupCount ? tmp : _forwardGroupCount;
+	return true;
 }
 
 ForwardActionChainElement *
 AppleCIOForwardChain::addToChain(ForwardActionChainElement * tmpElement)
 {
-	auto idx = _forwardChainCount;
-	if (idx + 1 == _forwardChain.length()) {
-		panic("Too many elements in forward chain id:%d.", _chainId);
+	// Elements are never released on their own, so the pool hands them out
+	// in order and an element's index is its place in the chain.
+	uint32_t idx;
+	if (!_forwardChain.allocate(&idx)) {
+		ERROR("No memory for element %u of forward chain id:%d\n", _forwardChainCount, _chainId);
+		return nullptr;
+	}
+	if (idx != _forwardChainCount) {
+		panic("Element %u of forward chain id:%d is out of order.", idx, _chainId);
 	}
 
-	atomic_store(&_forwardChain[idx].completeActionCount, 0);
-	_forwardChain[idx].idx        = _forwardChainCount;
-	_forwardChain[idx].linkIdx    = tmpElement->linkIdx;
-	_forwardChain[idx].provider   = this;
-	_forwardChain[idx].chainGroup = nullptr;
+	auto element = _forwardChain.get(idx);
+	element->completeActionCount.store(0);
+	element->idx        = _forwardChainCount;
+	element->linkIdx    = tmpElement->linkIdx;
+	element->provider   = this;
+	element->chainGroup = nullptr;
 
 	for (int i = 0; i < kForwardNodeCount; i++) {
-		_forwardChain[idx].actions[i] = tmpElement->actions[i];
+		element->actions[i] = tmpElement->actions[i];
 	}
 
 	_forwardChainCount += 1;
-	return &(_forwardChain[idx]);
+	return element;
 }
 
 void
@@ -212,34 +238,56 @@ AppleCIOForwardChain::addPartnerChain(AppleCIOForwardChain * chain)
 }
 
 ForwardActionChainGroup *
-AppleCIOForwardChain::createChainGroup()
+AppleCIOForwardChain::createChainGroup(uint32_t elementCapacity)
 {
 	auto idx = _forwardGroupCount;
-	if (idx + 1 == _groups.length()) {
-		panic("Too many groups in forward chain id:%d.", _chainId);
+
+	ForwardActionChainElement ** elements = nullptr;
+	if (elementCapacity > 0) {
+		elements = IONewZero(ForwardActionChainElement *, elementCapacity);
+		if (elements == nullptr) {
+			ERROR("No memory for %u elements of forward chain id:%d\n", elementCapacity, _chainId);
+			return nullptr;
+		}
+	}
+
+	// Once the group is in the pool, free() releases its elements.
+	uint32_t slot;
+	if (!_groups.allocate(&slot)) {
+		ERROR("No memory for group %u of forward chain id:%d\n", idx, _chainId);
+		IODelete(elements, ForwardActionChainElement *, elementCapacity);
+		return nullptr;
+	}
+
+	auto group             = _groups.get(slot);
+	group->elements        = elements;
+	group->elementCapacity = elementCapacity;
+	group->elementCount    = 0;
+	group->completeElementCount.store(0);
+
+	if (!setChainGroup(idx, group)) {
+		ERROR("No memory to index group %u of forward chain id:%d\n", idx, _chainId);
+		return nullptr;
 	}
 
 	// Set the previous group's next to the new group.
 	if (idx > 0) {
-		_groups[idx - 1].nextGroup = &(_groups[idx]);
+		getGroup(idx - 1)->nextGroup = group;
 	}
 
-	atomic_store(&_groups[idx].completeElementCount, 0);
-	_groups[idx].elementCount = 0;
-
 	// The next group is always [0], when a new chain group is added, this will
 	// be changed to the new chain group.
-	_groups[idx].nextGroup = &(_groups[0]);
-
-	_forwardGroupCount += 1;
+	group->nextGroup = getGroup(0);
 
 	// set the groups on all the partner chains
-	_groupPtrs[idx] = &(_groups[idx]);
 	for (int i = 0; i < _partnerCount; i++) {
-		_partnerChains[i]->setChainGroup(idx, _groupPtrs[idx]);
+		if (!_partnerChains[i]->setChainGroup(idx, group)) {
+			ERROR("No memory to index group %u of forward chain id:%d\n", idx, _partnerChains[i]->getId());
+			return nullptr;
+		}
 	}
 
-	return &(_groups[idx]);
+	return group;
 }
 
 // MARK: - Forwarder
@@ -266,6 +314,10 @@ AppleCIOMeshForwarder::initialize(AppleCIOMeshService * service)
 	atomic_store(&_active, false);
 	atomic_store(&_stopped, true);
 	atomic_store(&_chainActive, false);
+	atomic_store(&_currentActiveChain, (uintptr_t)nullptr);
+
+	_chainLock = IOLockAlloc();
+	GOTO_FAIL_IF_NULL(_chainLock, "Failed to make forward chain lock");
 
 	_workloop = IOWorkLoop::workLoop();
 	GOTO_FAIL_IF_NULL(_workloop, "Failed to make forwarder workloop");
@@ -292,6 +344,11 @@ fail:
 		_workloop = nullptr;
 	}
 
+	if (_chainLock) {
+		IOLockFree(_chainLock);
+		_chainLock = nullptr;
+	}
+
 	return false;
 }
 
@@ -308,14 +365,16 @@ AppleCIOMeshForwarder::free()
 	// Note: we will not free forward chains, they are freed automatically
 	// when all shared memory in the forward chain is freed.
 
-	for (int i = 0; i < kMaxForwardAction; i++) {
-		if (atomic_load(&_forwardActions[i].initialized)) {
-			OSSafeReleaseNULL(_forwardActions[i].txCommand);
-			OSSafeReleaseNULL(_forwardActions[i].rxCommand);
-			OSSafeReleaseNULL(_forwardActions[i].sharedMemory);
-			atomic_store(&_forwardActions[i].initialized, false);
+	for (uint32_t i = 0; i < _forwardActions.capacity(); i++) {
+		auto action = _forwardActions.get(i);
+		if (atomic_load(&action->initialized)) {
+			OSSafeReleaseNULL(action->txCommand);
+			OSSafeReleaseNULL(action->rxCommand);
+			OSSafeReleaseNULL(action->sharedMemory);
+			atomic_store(&action->initialized, false);
 		}
 	}
+	_forwardActions.reset();
 
 	if (_queue) {
 		OSSafeReleaseNULL(_queue);
@@ -329,6 +388,11 @@ AppleCIOMeshForwarder::free()
 
 	OSSafeReleaseNULL(_forwardEventSource);
 
+	if (_chainLock) {
+		IOLockFree(_chainLock);
+		_chainLock = nullptr;
+	}
+
 	super::free();
 }
 
@@ -361,72 +425,71 @@ AppleCIOMeshForwarder::isStopped()
 ForwardAction *
 AppleCIOMeshForwarder::getForwardAction(uint32_t idx)
 {
-	return &(_forwardActions[idx]);
+	return _forwardActions.get(idx);
 }
 
-void
+IOReturn
 AppleCIOMeshForwarder::addForwardingAction(AppleCIOMeshTransmitCommand * transmitCommand,
                                            AppleCIOMeshReceiveCommand * receiveCommand,
                                            MCUCI::NodeId source)
 {
-	int idx;
-	for (idx = 0; idx < _forwardActions.length(); idx++) {
-		if (_forwardActions[idx].sharedMemory == nullptr && _forwardActions[idx].txCommand == nullptr &&
-		    _forwardActions[idx].initialized == false) {
-			break;
-		}
+	// The lowest free action, cleaned up actions are free once more.
+	uint32_t idx;
+	if (!_forwardActions.allocate(&idx)) {
+		ERROR("No memory for forward action %u\n", _forwardActions.capacity());
+		return kIOReturnNoResources;
 	}
-	if (idx >= _forwardActions.length()) {
-		panic("Too many forwards.");
-	}
-
-	_forwardActions[idx].dummy = false;
-	atomic_store(&_forwardActions[idx].initialized, true);
-	_forwardActions[idx].sourceNode = source;
-	atomic_store(&_forwardActions[idx].rxReadyForForward, false);
-	atomic_store(&_forwardActions[idx].prepared, false);
-	atomic_store(&_forwardActions[idx].rxCommandsAvailable, 0);
-	atomic_store(&_forwardActions[idx].txCommandsComplete, 0);
-	atomic_store(&_forwardActions[idx].txCommandsSubmitted, 0);
-
-	_forwardActions[idx].carryPartners[0] = nullptr;
-	_forwardActions[idx].carryPartners[1] = nullptr;
-
-	_forwardActions[idx].curTxCommand = 0;
-	_forwardActions[idx].txCommand    = transmitCommand;
-	_forwardActions[idx].rxCommand    = receiveCommand;
-	_forwardActions[idx].state        = ForwardState::WaitingForRxStart;
-	_forwardActions[idx].chainElement = nullptr;
-	_forwardActions[idx].sharedMemory = transmitCommand->getProvider()->getProvider()->getProvider();
-
-	_forwardActions[idx].txCommand->retain();
-	_forwardActions[idx].rxCommand->retain();
-	_forwardActions[idx].sharedMemory->retain();
-
-	_forwardActions[idx].previousAction = nullptr;
-	_forwardActions[idx].nextAction     = nullptr;
-	atomic_store(&_forwardActions[idx].previousActionComplete, false);
+	ForwardAction * action = _forwardActions.get(idx);
+
+	action->dummy = false;
+	atomic_store(&action->initialized, true);
+	action->sourceNode = source;
+	action->rxReadyForForward.store(false);
+	action->prepared.store(false);
+	action->rxCommandsAvailable.store(0);
+	action->txCommandsComplete.store(0);
+	action->txCommandsSubmitted.store(0);
+
+	action->carryPartners[0] = nullptr;
+	action->carryPartners[1] = nullptr;
+
+	action->curTxCommand = 0;
+	action->txCommand    = transmitCommand;
+	action->rxCommand    = receiveCommand;
+	action->state        = ForwardState::WaitingForRxStart;
+	action->chainElement = nullptr;
+	action->sharedMemory = transmitCommand->getProvider()->getProvider()->getProvider();
+
+	action->txCommand->retain();
+	action->rxCommand->retain();
+	action->sharedMemory->retain();
+
+	action->previousAction = nullptr;
+	action->nextAction     = nullptr;
+	action->previousActionComplete.store(false);
 
 	// Add a forward notify idx that has to be triggered by RX notify
 	transmitCommand->getProvider()->addForwardNotifyIdx((int32_t)idx, this);
 	// Set the transmit command's forward action
-	transmitCommand->setForwardAction(&_forwardActions[idx]);
+	transmitCommand->setForwardAction(action);
 
 	if (idx >= _forwardActionCount) {
 		_forwardActionCount = idx + 1;
 	}
+
+	return kIOReturnSuccess;
 }
 
 void
 AppleCIOMeshForwarder::markActionRxComplete(uint32_t idx)
 {
-	ForwardAction * action = &_forwardActions[idx];
-	atomic_store(&action->rxReadyForForward, true);
-	atomic_fetch_add(&action->rxCommandsAvailable, 1);
+	ForwardAction * action = _forwardActions.get(idx);
+	action->rxReadyForForward.store(true);
+	action->rxCommandsAvailable.fetch_add(1);
 
 	for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-		atomic_store(&action->carryPartners[p]->rxReadyForForward, true);
-		atomic_fetch_add(&action->carryPartners[p]->rxCommandsAvailable, 1);
+		action->carryPartners[p]->rxReadyForForward.store(true);
+		action->carryPartners[p]->rxCommandsAvailable.fetch_add(1);
 	}
 
 	_queue->add((uintptr_t)action);
@@ -435,11 +498,11 @@ AppleCIOMeshForwarder::markActionRxComplete(uint32_t idx)
 void
 AppleCIOMeshForwarder::flowRxComplete(uint32_t idx)
 {
-	ForwardAction * action = &_forwardActions[idx];
-	atomic_fetch_add(&action->rxCommandsAvailable, 1);
+	ForwardAction * action = _forwardActions.get(idx);
+	action->rxCommandsAvailable.fetch_add(1);
 
 	for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-		atomic_fetch_add(&action->carryPartners[p]->rxCommandsAvailable, 1);
+		action->carryPartners[p]->rxCommandsAvailable.fetch_add(1);
 	}
 
 	// That's it, the action is already in the queue and should be waiting for
@@ -449,18 +512,18 @@ AppleCIOMeshForwarder::flowRxComplete(uint32_t idx)
 AppleCIOForwardChain *
 AppleCIOMeshForwarder::createForwardChain(MUCI::ForwardChainId * forwardChainId)
 {
-	int8_t assignedId = -1;
+	int32_t assignedId = -1;
 
 	// Find the first available one and use that id
-	for (uint8_t i = 0; i < _forwardChains.length(); i++) {
+	for (uint32_t i = 0; i < _forwardChains.length(); i++) {
 		if (_forwardChains[i] == nullptr) {
-			*forwardChainId = i;
-			assignedId      = (int8_t)i;
+			*forwardChainId = (MUCI::ForwardChainId)i;
+			assignedId      = (int32_t)i;
 			break;
 		}
 	}
 	if (assignedId == -1) {
-		for (uint8_t i = 0; i < _forwardChains.length(); i++) {
+		for (uint32_t i = 0; i < _forwardChains.length(); i++) {
 			if (_forwardChains[i] == nullptr) {
 				continue;
 			}
@@ -469,12 +532,14 @@ AppleCIOMeshForwarder::createForwardChain(MUCI::ForwardChainId * forwardChainId)
 	}
 
 	if (assignedId == -1) {
-		panic("Too many forward chains created");
+		ERROR("Every forward chain id is in use\n");
+		return nullptr;
 	}
 
 	auto newChain = AppleCIOForwardChain::allocate(*forwardChainId, _service->getLinksPerChannel());
 	if (newChain == nullptr) {
-		panic("Failed to allocate forward chain");
+		ERROR("Failed to allocate forward chain\n");
+		return nullptr;
 	}
 
 	_forwardChains[assignedId] = newChain;
@@ -491,11 +556,13 @@ AppleCIOMeshForwarder::createForwardChain(MUCI::ForwardChainId * forwardChainId)
 void
 AppleCIOMeshForwarder::removeForwardChain(AppleCIOForwardChain * fChain)
 {
-	int8_t assignedId = -1;
-
-	// Find the chain and release it
-	for (uint8_t i = 0; i < _forwardChains.length(); i++) {
+	// Find the chain, drop the starts it has pending and release it
+	for (uint32_t i = 0; i < _forwardChains.length(); i++) {
 		if (_forwardChains[i] == fChain) {
+			IOLockLock(_chainLock);
+			_chainScheduler.removeChain(i);
+			IOLockUnlock(_chainLock);
+
 			OSSafeReleaseNULL(_forwardChains[i]);
 			_forwardChains[i] = nullptr;
 			return;
@@ -503,7 +570,7 @@ AppleCIOMeshForwarder::removeForwardChain(AppleCIOForwardChain * fChain)
 	}
 }
 
-void
+IOReturn
 AppleCIOMeshForwarder::addToForwardChain(MUCI::ForwardChainId forwardChain, MUCI::BufferId buffer, int64_t offset, uint8_t linkIdx)
 {
 	int remaining = kForwardNodeCount;
@@ -514,11 +581,11 @@ AppleCIOMeshForwarder::addToForwardChain(MUCI::ForwardChainId forwardChain, MUCI
 
 	tmpElement.linkIdx = linkIdx;
 
-	for (int i = 0; i < _forwardActionCount && remaining > 0; i++) {
-		if (atomic_load(&_forwardActions[i].initialized) == true &&
-		    _forwardActions[i].txCommand->getDataChunk().bufferId == buffer &&
-		    _forwardActions[i].txCommand->getDataChunk().offset == offset) {
-			tmpElement.actions[cur] = &(_forwardActions[i]);
+	for (uint32_t i = 0; i < _forwardActionCount && remaining > 0; i++) {
+		auto action = _forwardActions.get(i);
+		if (atomic_load(&action->initialized) == true && action->txCommand->getDataChunk().bufferId == buffer &&
+		    action->txCommand->getDataChunk().offset == offset) {
+			tmpElement.actions[cur] = action;
 
 			remaining -= 1;
 			cur += 1;
@@ -536,7 +603,7 @@ AppleCIOMeshForwarder::addToForwardChain(MUCI::ForwardChainId forwardChain, MUCI
 
 	realElement = _forwardChains[forwardChain]->addToChain(&tmpElement);
 	if (realElement == nullptr) {
-		panic("No element created in forward chain");
+		return kIOReturnNoResources;
 	}
 
 	remaining = kForwardNodeCount;
@@ -544,6 +611,8 @@ AppleCIOMeshForwarder::addToForwardChain(MUCI::ForwardChainId forwardChain, MUCI
 	for (int i = 0; i < kForwardNodeCount; i++) {
 		realElement->actions[i]->chainElement = realElement;
 	}
+
+	return kIOReturnSuccess;
 }
 
 static bool
@@ -567,120 +636,161 @@ isOffsetInRange(int64_t offset, MUCI::ForwardChain * forwardChain, uint64_t buff
 	return false;
 }
 
-void
+// The index of the first element of chain from index from on that forwards
+// buffer, the element count if there is none.
+static uint32_t
+nextElementForBuffer(AppleCIOForwardChain * chain, MUCI::BufferId buffer, uint32_t from)
+{
+	for (uint32_t i = from; i < chain->getElementCount(); i++) {
+		if (chain->getElement(i)->actions[0]->txCommand->getDataChunk().bufferId == buffer) {
+			return i;
+		}
+	}
+	return chain->getElementCount();
+}
+
+// Adds the elements of elementChain at the indices where indexChain forwards
+// buffer to group, and links their actions to the actions of the elements
+// before and after them.
+static void
+addElementsToGroup(ForwardActionChainGroup * group,
+                   AppleCIOForwardChain * indexChain,
+                   AppleCIOForwardChain * elementChain,
+                   MUCI::BufferId buffer)
+{
+	const uint32_t end               = indexChain->getElementCount();
+	ForwardActionChainElement * prev = nullptr;
+	for (uint32_t index = nextElementForBuffer(indexChain, buffer, 0); index < end;) {
+		const uint32_t nextIndex = nextElementForBuffer(indexChain, buffer, index + 1);
+		auto cur                 = elementChain->getElement(index);
+		auto next                = nextIndex < end ? elementChain->getElement(nextIndex) : nullptr;
+
+		group->addChildElement(cur);
+
+		cur->chainGroup = group;
+
+		// set the previous/next actions for all the element's actions.
+		for (int forward_i = 0; forward_i < kForwardNodeCount; forward_i++) {
+			cur->actions[forward_i]->previousAction = prev ? prev->actions[forward_i] : nullptr;
+			cur->actions[forward_i]->nextAction     = next ? next->actions[forward_i] : nullptr;
+		}
+
+		prev  = cur;
+		index = nextIndex;
+	}
+}
+
+IOReturn
 AppleCIOMeshForwarder::groupChainElements(MUCI::ForwardChainId forwardChainId,
                                           MUCI::BufferId buffer,
                                           MUCI::ForwardChain * forwardChain,
                                           uint64_t bufferSize)
 {
-	uint32_t sortedIndices[kMaxForwardElementActions];
-	uint8_t indexCount = 0;
-
 	// First lets find our forwardChain and get all the partner chains
 	AppleCIOForwardChain * chain = _forwardChains[forwardChainId];
 	if (chain == nullptr) {
 		panic("Could not find forward chain");
 	}
 
-	// Now get all the indices of elements that fit the buffer + offset range
-	// Just for a single chain, the idea is the partner chains should have the
-	// same indices because we divide data chunks evenly between all chains.
-	for (int i = 0; i < chain->getElementCount(); i++) {
-		auto tmp = chain->getElement((unsigned int)i)->actions[0]->txCommand;
+	// Now count the elements that fit the buffer + offset range. Just for a
+	// single chain, the idea is the partner chains should have the same
+	// indices because we divide data chunks evenly between all chains.
+	uint32_t indexCount = 0;
+	for (uint32_t i = nextElementForBuffer(chain, buffer, 0); i < chain->getElementCount();
+	     i = nextElementForBuffer(chain, buffer, i + 1)) {
+		indexCount++;
+	}
 
-		if (tmp->getDataChunk().bufferId == buffer) {
-			// isOffsetInRange(tmp->getDataChunk().offset, forwardChain, bufferSize)) {
-			sortedIndices[indexCount++] = (uint32_t)i;
+	auto partners       = chain->getPartnerChains();
+	uint32_t chainCount = 1;
+	for (int partner_i = 0; partner_i < partners.length(); partner_i++) {
+		if (partners[partner_i] != nullptr) {
+			chainCount++;
 		}
 	}
 
-	if (indexCount >= kMaxForwardElementActions) {
-		panic("Too many chain elements grouped together: %d", indexCount);
+	// Let's make a new group on this chain with room for the elements of every
+	// chain. We don't have to make it on the primary one because we eventually
+	// go through the ChainElement->chainGroup direct connection.
+	ForwardActionChainGroup * newGroup = chain->createChainGroup(indexCount * chainCount);
+	if (newGroup == nullptr) {
+		return kIOReturnNoResources;
 	}
 
-	// Let's make a new group on this chain. We don't have to make it on the
-	// primary one because we eventually go through the ChainElement->chainGroup
-	// direct connection.
-	ForwardActionChainGroup * newGroup = chain->createChainGroup();
-
-	// Now let's go get all the sorted indices and add them for each partner
-	// chain to the group. Also set each element's chainGroup as the newly
-	// created group.
-	auto partners = chain->getPartnerChains();
+	// Now let's add the elements at those indices for each partner chain to
+	// the group. Also set each element's chainGroup as the newly created group.
 	for (int partner_i = 0; partner_i < partners.length(); partner_i++) {
 		if (partners[partner_i] == nullptr) {
 			continue;
 		}
-
-		for (int index_i = 0; index_i < indexCount; index_i++) {
-			auto cur  = partners[partner_i]->getElement(sortedIndices[index_i]);
-			auto prev = index_i > 0 ? partners[partner_i]->getElement(sortedIndices[index_i - 1]) : nullptr;
-			auto next = index_i < indexCount - 1 ? partners[partner_i]->getElement(sortedIndices[index_i + 1]) : nullptr;
-
-			newGroup->addChildElement(cur);
-
-			cur->chainGroup = newGroup;
-
-			// set the previous/next actions for all the element's actions.
-			for (int forward_i = 0; forward_i < kForwardNodeCount; forward_i++) {
-				cur->actions[forward_i]->previousAction = prev ? prev->actions[forward_i] : nullptr;
-				cur->actions[forward_i]->nextAction     = next ? next->actions[forward_i] : nullptr;
-			}
-		}
+		addElementsToGroup(newGroup, chain, partners[partner_i], buffer);
 	}
 
 	// Repeat the same thing for the current chain too
-	for (int index_i = 0; index_i < indexCount; index_i++) {
-		auto cur  = chain->getElement(sortedIndices[index_i]);
-		auto prev = index_i > 0 ? chain->getElement(sortedIndices[index_i - 1]) : nullptr;
-		auto next = index_i < indexCount - 1 ? chain->getElement(sortedIndices[index_i + 1]) : nullptr;
+	addElementsToGroup(newGroup, chain, chain, buffer);
 
-		newGroup->addChildElement(cur);
-
-		cur->chainGroup = newGroup;
-
-		// set the previous/next actions for all the element's actions.
-		for (int forward_i = 0; forward_i < kForwardNodeCount; forward_i++) {
-			cur->actions[forward_i]->previousAction = prev ? prev->actions[forward_i] : nullptr;
-			cur->actions[forward_i]->nextAction     = next ? next->actions[forward_i] : nullptr;
-		}
-	}
+	return kIOReturnSuccess;
 }
 
-void
+IOReturn
 AppleCIOMeshForwarder::startForwardChain(MUCI::ForwardChainId forwardChainId, uint32_t elements)
 {
+	// Rather than spin here until the active chain stops, queue the start.
+	// Whoever stops the active chain starts the oldest start waiting.
+	IOLockLock(_chainLock);
+	const bool queued = _chainScheduler.submit(forwardChainId, elements, mach_absolute_time());
+	IOLockUnlock(_chainLock);
+
+	if (!queued) {
+		ERROR("Too many forward chain starts pending to start chain %d\n", forwardChainId);
+		return kIOReturnNoResources;
+	}
+
 	atomic_store(&_chainActive, true);
+	_startNextForwardChain();
 
-	uint64_t ctr = 0;
-	while (atomic_load(&_currentActiveChain) != (uintptr_t)nullptr && ctr++ < MAX_LOOPS) {}
+	return kIOReturnSuccess;
+}
 
-	if (ctr >= MAX_LOOPS) {
-		panic("Previous active chain did not stop in time when starting a new forward chain");
-	}
+void
+AppleCIOMeshForwarder::_startNextForwardChain()
+{
+	IOLockLock(_chainLock);
 
-	AppleCIOForwardChain * chain = _forwardChains[forwardChainId];
-	atomic_store(&_currentActiveChain, (uintptr_t)chain);
+	AppleCIOMeshUtils::PendingChainStart start;
+	while (atomic_load(&_currentActiveChain) == (uintptr_t)nullptr && _chainScheduler.next(&start)) {
+		AppleCIOForwardChain * chain = _forwardChains[start.chain];
+		if (chain == nullptr) {
+			continue;
+		}
+		atomic_store(&_currentActiveChain, (uintptr_t)chain);
 
-	auto partners = chain->getPartnerChains();
+		auto partners = chain->getPartnerChains();
 
-	chain->startChain((int32_t)elements);
-	for (int i = 0; i < partners.size(); i++) {
-		if (partners[i] != nullptr) {
-			partners[i]->startChain((int32_t)elements);
+		chain->startChain((int32_t)start.elements);
+		for (int i = 0; i < partners.size(); i++) {
+			if (partners[i] != nullptr) {
+				partners[i]->startChain((int32_t)start.elements);
+			}
 		}
-	}
 
-	auto idx = chain->getStartIndex();
-	_prepareChainGroup(chain->getGroup(idx));
+		auto idx = chain->getStartIndex();
+		_prepareChainGroup(chain->getGroup(idx));
 
-	chain->addStartIndex(elements);
+		chain->addStartIndex(start.elements);
+	}
+
+	IOLockUnlock(_chainLock);
 }
 
 void
 AppleCIOMeshForwarder::stopAllForwardChains()
 {
 	atomic_store(&_chainActive, false);
+
+	IOLockLock(_chainLock);
+	_chainScheduler.clear();
+	IOLockUnlock(_chainLock);
 }
 
 void
@@ -695,21 +805,23 @@ AppleCIOMeshForwarder::cleanupActionsForSharedMemory(AppleCIOMeshSharedMemory *
 {
 	int numCleaned = 0, lastValid = -1, lastCleaned = 0;
 
-	for (int i = 0; i < _forwardActions.length(); i++) {
-		if (atomic_load(&_forwardActions[i].initialized) == false && _forwardActions[i].sharedMemory == memory &&
-		    !_forwardActions[i].dummy) {
-			_service->clearCommandeerForwardHelp(&_forwardActions[i]);
-			OSSafeReleaseNULL(_forwardActions[i].txCommand);
-			_forwardActions[i].txCommand = NULL;
-			OSSafeReleaseNULL(_forwardActions[i].rxCommand);
-			_forwardActions[i].rxCommand = NULL;
-			OSSafeReleaseNULL(_forwardActions[i].sharedMemory);
-			_forwardActions[i].sharedMemory = NULL;
+	// Cleaned up actions go back to the pool, their slabs are kept for the
+	// next buffers.
+	for (uint32_t i = 0; i < _forwardActions.capacity(); i++) {
+		auto action = _forwardActions.get(i);
+		if (atomic_load(&action->initialized) == false && action->sharedMemory == memory && !action->dummy) {
+			_service->clearCommandeerForwardHelp(action);
+			OSSafeReleaseNULL(action->txCommand);
+			action->txCommand = NULL;
+			OSSafeReleaseNULL(action->rxCommand);
+			action->rxCommand = NULL;
+			OSSafeReleaseNULL(action->sharedMemory);
+			action->sharedMemory = NULL;
+			_forwardActions.release(i);
 			numCleaned++;
-			lastCleaned = i;
-		} else if (_forwardActions[i].sharedMemory != nullptr && _forwardActions[i].txCommand != nullptr &&
-		           _forwardActions[i].initialized) {
-			lastValid = i;
+			lastCleaned = (int)i;
+		} else if (action->sharedMemory != nullptr && action->txCommand != nullptr && action->initialized) {
+			lastValid = (int)i;
 		}
 	}
 
@@ -724,332 +836,182 @@ AppleCIOMeshForwarder::safeToForward()
 	atomic_store(&_safeToForward, true);
 }
 
-IOReturn
-AppleCIOMeshForwarder::forwardStateMachine(ForwardAction * action, bool dedicated, bool checkAhead)
-{
-	auto tbtCommands       = action->txCommand->getCommands();
-	auto tbtCommandsLength = action->txCommand->getCommandsLength();
-	auto controllerId      = action->txCommand->getMeshLink()->getController()->getRID();
-
-	if (action->sharedMemory->hasBeenInterrupted()) {
-		return kIOReturnNoMemory;
-	}
-
-	switch (action->state) {
-	case ForwardState::WaitingForRxStart: {
-		if (atomic_load(&action->rxReadyForForward) != true) {
-			break;
-		}
-
-		// No longer ready for forward now that we start the forward procedure.
-		atomic_store(&action->rxReadyForForward, false);
-		for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-			atomic_store(&action->carryPartners[p]->rxReadyForForward, false);
-		}
-		atomic_store(&action->carryRequired, true);
+// MARK: - Forward Port
 
-		FORWARD_RX_RECEIVED_TR(controllerId, action->sourceNode, action->txCommand->getDataChunk().bufferId,
-		                       action->txCommand->getDataChunk().offset);
+// Runs the portable forward engine on the forwarder's Thunderbolt commands
+// and queue.
+struct AppleCIOMeshForwarder::ForwardPort {
+	using Action  = ForwardAction;
+	using Element = ForwardActionChainElement;
+	using Group   = ForwardActionChainGroup;
 
-		if (action->chainElement != nullptr) {
-			action->state = ForwardState::ForwardWaitingPrepare;
-			for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-				action->carryPartners[p]->state = ForwardState::ForwardWaitingPrepare;
-			}
+	static constexpr uint32_t kNodeCount = kForwardNodeCount;
 
-			goto waitingPrepare;
-		}
+	AppleCIOMeshForwarder * forwarder;
 
-		// Move the state to ForwardStartPrepare
-		action->state = ForwardState::ForwardStartTxPrepare;
-		for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-			action->carryPartners[p]->state = ForwardState::ForwardStartTxPrepare;
-		}
+	bool
+	interrupted(ForwardAction * action)
+	{
+		return action->sharedMemory->hasBeenInterrupted();
+	}
 
-		goto txPrepare;
+	void
+	requeue(ForwardAction * action)
+	{
+		forwarder->_queue->add((uintptr_t)action);
 	}
-	case ForwardState::ForwardStartTxPrepare: {
-	txPrepare:
+
+	void
+	prepareTx(ForwardAction * action)
+	{
+		auto tbtCommands       = action->txCommand->getCommands();
+		auto tbtCommandsLength = action->txCommand->getCommandsLength();
 		for (unsigned int j = 0; j < tbtCommandsLength; j++) {
 			action->txCommand->getMeshLink()->prepareTXCommand(action->sourceNode, tbtCommands[j]);
 		}
-
-		for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-			auto partnerTBTCommands = action->carryPartners[p]->txCommand->getCommands();
-			for (unsigned int j = 0; j < tbtCommandsLength; j++) {
-				action->carryPartners[p]->txCommand->getMeshLink()->prepareTXCommand(action->sourceNode, partnerTBTCommands[j]);
-			}
-		}
-
-		action->sharedMemory->addPrepared(kForwardNodeCount);
-
-		FORWARD_PREPARED_TR(controllerId, false, action->txCommand->getDataChunk().bufferId,
-		                    action->txCommand->getDataChunk().offset);
-
-		action->state = ForwardState::WaitingPreviousTxComplete;
-		for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-			action->carryPartners[p]->state = ForwardState::WaitingPreviousTxComplete;
-		}
-
-		goto waitingPreviousTxComplete;
 	}
-	case ForwardState::ForwardWaitingPrepare: {
-	waitingPrepare:
-		// If dedicated, we do not stick the action back into the queue.
-		// The dedicated guy has to finish this.
-		bool prepared = true;
-		prepared &= atomic_load(&action->prepared);
-		for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-			prepared &= atomic_load(&action->carryPartners[p]->prepared);
-		}
-
-		if (!prepared) {
-			_queue->add((uintptr_t)action);
-			break;
-		}
-
-		FORWARD_PREPARED_TR(controllerId, true, action->txCommand->getDataChunk().bufferId,
-		                    action->txCommand->getDataChunk().offset);
-
-		atomic_store(&action->prepared, false);
-		for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-			atomic_store(&action->carryPartners[p]->prepared, false);
-		}
 
-		action->state = ForwardState::WaitingPreviousTxComplete;
-		for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-			action->carryPartners[p]->state = ForwardState::WaitingPreviousTxComplete;
-		}
-
-		goto waitingPreviousTxComplete;
+	void
+	addPrepared(ForwardAction * action, uint32_t count)
+	{
+		action->sharedMemory->addPrepared(count);
 	}
-	case ForwardState::WaitingPreviousTxComplete: {
-	waitingPreviousTxComplete:
-		// Time to add the 2 partner actions to the queue at this point, we
-		// carried as much as possible.
-		bool expected = true;
-		if (action->carryPartners[0] != nullptr && atomic_compare_exchange_strong(&action->carryRequired, &expected, false)) {
-			for (auto p = 0; p < kForwardNodeCount - 1; p++) {
-				_queue->add((uintptr_t)action->carryPartners[p]);
-			}
-		}
-
-		if (action->previousAction && atomic_load(&action->previousActionComplete) == false) {
-			// Special: We will return success here, because the commandeer
-			// doesn't need to do be dedicated to this check, the forward loop can
-			// do this while managing the other forward actions.
-			_queue->add((uintptr_t)action);
-			return kIOReturnSuccess;
-		}
-
-		FORWARD_PREVIOUS_ACTION_COMPLETE_TR(controllerId, action->sourceNode, action->txCommand->getDataChunk().bufferId,
-		                                    action->txCommand->getDataChunk().offset);
 
-		atomic_store(&action->previousActionComplete, false);
-		action->state = ForwardState::ForwardTxReadyToFlow;
-
-		goto startTxTransfer;
+	int8_t
+	txCommandCount(ForwardAction * action)
+	{
+		return (int8_t)action->txCommand->getCommandsLength();
 	}
-	// Flow loop start -----
-	case ForwardState::ForwardTxReadyToFlow: {
-	startTxTransfer:
-		// Let's see how many descriptors we can submit
-		// There has to be at least one
-		if (atomic_load(&action->rxCommandsAvailable) < 1) {
-			break;
-		}
-
-		// We are no longer ready for forwarding, after processing this.
-		atomic_store(&action->rxReadyForForward, false);
-
-		uint8_t submitCount = 0;
-		while (int8_t tmp = atomic_fetch_sub(&action->rxCommandsAvailable, 1)) {
-			submitCount++;
-		}
-
-		// The above loop will subtract 1 extra from the atomic than needed
-		// because fetch_sub returns the previous value. The loop will not be
-		// entered if the previous value was 0, so submitCount is safe, but
-		// the atomic will be subbed to -1, we need to add 1 to make up for it.
-		atomic_fetch_add(&action->rxCommandsAvailable, 1);
-
-		// Set up txCommandsSubmitted so we know how how many commands need to
-		// complete before we can complete forward or go back to waiting for RX
-		atomic_store(&action->txCommandsSubmitted, submitCount);
-
-		if (checkAhead) {
-			ForwardAction * lookAhead = (ForwardAction *)_queue->remove();
-			if (lookAhead == &_dummyDestroySharedMemoryAction) {
-				_queue->add((uintptr_t)lookAhead);
-			} else {
-				if (lookAhead && !_service->commandeerForwardHelp(lookAhead)) {
-					// Commandeer is already helping us, put this back in.
-					_queue->add((uintptr_t)lookAhead);
-				}
-			}
-		}
 
-		action->curTxCommand += submitCount;
-		auto tmp = action->txCommand->getCommands()[action->curTxCommand - 1];
+	void
+	sendTx(ForwardAction * action, uint8_t command)
+	{
+		auto tmp = action->txCommand->getCommands()[command];
+		action->txCommand->stampSendTime();
 		action->txCommand->getMeshLink()->sendData(action->sourceNode, action->txCommand->getDataChunk().offset, tmp);
-
-		FORWARD_STARTED_TR(controllerId, action->txCommand->getDataChunk().bufferId, action->txCommand->getDataChunk().offset,
-		                   submitCount);
-
-		action->state = ForwardState::ForwardWaitingTxFlowComplete;
-		_queue->add((uintptr_t)action);
-		break;
 	}
-	case ForwardState::ForwardWaitingTxFlowComplete: {
-		action->txCommand->getMeshLink()->checkDataTXCompletion();
 
-		// We are waiting for all submitted tx commands to complete
-		if (atomic_load(&action->txCommandsSubmitted) != 0) {
-			_queue->add((uintptr_t)action);
-			break;
-		}
-
-		FORWARD_TX_FLOW_COMPLETE_TR(controllerId, atomic_load(&action->txCommandsComplete),
-		                            action->txCommand->getDataChunk().bufferId, action->txCommand->getDataChunk().offset);
-
-		// Everything has been submitted, let's check if txCommandsComplete
-		// is equal to the number of commands in the action
-		if (atomic_load(&action->txCommandsComplete) == action->txCommand->getCommandsLength()) {
-			// forward has been complete
-			// We are not going to check forward complete, because this is
-			// faster
-			if (action->nextAction) {
-				atomic_store(&action->nextAction->previousActionComplete, true);
-			}
-
-			action->state = ForwardState::ForwardPrepareOrComplete;
-			goto forwardingComplete;
-		} else {
-			// We need to wait for more RX commands to drip into us
-			action->state = ForwardState::WaitingForRxFlow;
-			goto checkRxAvailable;
-		}
+	void
+	checkTxCompletion(ForwardAction * action)
+	{
+		action->txCommand->getMeshLink()->checkDataTXCompletion();
 	}
-	case ForwardState::ForwardPrepareOrComplete: {
-	forwardingComplete:
-		if (dedicated) {
-			_queue->add((uintptr_t)action);
-			break;
-		}
 
-		action->state = ForwardState::WaitingForRxStart;
-
-		// We should check continue forwarding first, so we can move the current
-		// index forward. We only notify forward complete after incase this
-		// completes broadcastAndGather and starts a new forward chain.
-		ChainContinueState chainContinue = ChainContinueState::Unknown;
-
-		if (action->chainElement != nullptr) {
-			// Check if all actions for this chain element have finished
-			//
-			// Always reset complete action count back to 0 if we forward all the
-			// expected actions with this chain element.
-			if (atomic_fetch_add(&action->chainElement->completeActionCount, 1) == (kForwardNodeCount - 1)) {
-				// Check if there are any pending elements for this action's link
-				// If there are, we can queue up a prepare on this element
-				// The commandeer will queue it up.
-				auto linkIdx    = action->chainElement->linkIdx;
-				auto chainGroup = action->chainElement->chainGroup;
-				if (chainGroup->pendingPrepareElements[linkIdx] > 0) {
-					// Find the element that's left. The chainElements in the
-					// group are setup like so:
-					// [link0][link0][link0] ... [link1][link1][link1]
-					// So we can calculate the index to operate on next with
-					// this formula:
-					// ElementsPerLink = TotalCount / numLinksPerChannel
-					// index = (ElementsPerLink * LinkIdx) + (elementsPerLink - pendingPrepare)
-					// ie: if ElementsPerLink = 4, and pendingPrepare=1,
-					// then the index is 4-1 = 3
-					// if pendingPrepare=2, then 4-2 = 2.
-					// for the second link, we can simply offset this by 3+4
-					// or 2+4.
-
-					int elementsPerLink = chainGroup->elementCount / _service->getLinksPerChannel();
-					int prepareElementIdx =
-					    (elementsPerLink * linkIdx) + (elementsPerLink - chainGroup->pendingPrepareElements[linkIdx]);
-					chainGroup->pendingPrepareElements[linkIdx] -= 1;
-
-					auto prepareElement = chainGroup->elements[prepareElementIdx];
-					_service->commandeerPrepareForwardElement(prepareElement);
-				}
-
-				if (action->chainElement->provider->continueForwarding()) {
-					chainContinue = ChainContinueState::ContinueChain;
-				} else {
-					chainContinue = ChainContinueState::StopChain;
-				}
-				atomic_store(&action->chainElement->completeActionCount, 0);
+	void
+	lookAhead()
+	{
+		ForwardAction * lookAhead = (ForwardAction *)forwarder->_queue->remove();
+		if (lookAhead == &forwarder->_dummyDestroySharedMemoryAction) {
+			forwarder->_queue->add((uintptr_t)lookAhead);
+		} else {
+			if (lookAhead && !forwarder->_service->commandeerForwardHelp(lookAhead)) {
+				// Commandeer is already helping us, put this back in.
+				forwarder->_queue->add((uintptr_t)lookAhead);
 			}
 		}
+	}
 
-		FORWARD_COMPLETED_TR(((int)chainContinue << 12) | controllerId,
-		                     action->chainElement == nullptr ? 0 : action->chainElement->provider->getForwardCount(),
-		                     action->txCommand->getDataChunk().bufferId, action->txCommand->getDataChunk().offset);
-
-		atomic_store(&action->rxCommandsAvailable, 0);
-		atomic_store(&action->txCommandsComplete, 0);
-		action->curTxCommand = 0;
-
+	void
+	forwardComplete(ForwardAction * action)
+	{
 		action->txCommand->getProvider()->notifyForwardComplete();
+	}
 
-		// We already checked if we can continue with the next element in the chain.
-		// We can continue if all the actions for the element have been completed
-		// and if there is a chain element.
-		if (chainContinue != ChainContinueState::ContinueChain) {
-			if (chainContinue == ChainContinueState::StopChain) {
-				// Check if we stopped and our partners stopped -- again just in case
-				bool finished = action->chainElement->provider->isFinished();
-				auto partners = action->chainElement->provider->getPartnerChains();
-				for (int t = 0; t < partners.size() && finished; t++) {
-					finished &= partners[t]->isFinished();
-				}
+	uint32_t
+	linksPerChannel()
+	{
+		return forwarder->_service->getLinksPerChannel();
+	}
 
-				if (!finished) {
-					break;
-				}
+	uint64_t
+	queueBytes(uint8_t linkIdx)
+	{
+		return forwarder->_service->getLinkQueueBytes(linkIdx);
+	}
 
-				atomic_store(&_currentActiveChain, (uintptr_t)nullptr);
-			}
+	void
+	prepareElementLater(ForwardActionChainElement * element)
+	{
+		forwarder->_service->commandeerPrepareForwardElement(element);
+	}
 
-			break;
+	bool
+	continueChain(ForwardActionChainElement * element)
+	{
+		return element->provider->continueForwarding();
+	}
+
+	bool
+	chainFinished(ForwardActionChainElement * element)
+	{
+		bool finished = element->provider->isFinished();
+		auto partners = element->provider->getPartnerChains();
+		for (int t = 0; t < partners.size() && finished; t++) {
+			finished &= partners[t]->isFinished();
 		}
+		return finished;
+	}
 
-		auto group = action->chainElement->chainGroup;
+	void
+	chainStopped(ForwardActionChainElement *)
+	{
+		atomic_store(&forwarder->_currentActiveChain, (uintptr_t)nullptr);
+		forwarder->_startNextForwardChain();
+	}
 
-		// Mark a complete element in the group.
-		atomic_fetch_add(&group->completeElementCount, 1);
+	uint64_t
+	sizePerLink(ForwardActionChainGroup * group)
+	{
+		// All Shared memories are the same for actions/elements, grab the first one.
+		// We only need the asignment to get the size per link.
+		return group->elements[0]->actions[0]->sharedMemory->getAssignment(0)->getAssignmentSizePerLink();
+	}
 
-		// Check if it is safe to prepare the group
-		if (!group->isGroupFinished()) {
-			break; // break switch
-		}
+	void
+	beginPrepare(ForwardActionChainElement * element)
+	{
+		// Get the first RXCommand and mark it as forward incomplete
+		element->actions[0]->rxCommand->getProvider()->markTxForwardIncomplete();
+	}
 
-		// Let's prepare the next group.
-		_prepareChainGroup(group->nextGroup);
+	void
+	trace(AppleCIOMeshUtils::ForwardTrace event, ForwardAction * action, uint64_t value)
+	{
+		auto controllerId = action->txCommand->getMeshLink()->getController()->getRID();
+		auto bufferId     = action->txCommand->getDataChunk().bufferId;
+		auto offset       = action->txCommand->getDataChunk().offset;
 
-		break; // break switch
-	}
-	case ForwardState::WaitingForRxFlow: {
-	checkRxAvailable:
-		// We are still waiting for RX flows to come in. Spin.
-		if (atomic_load(&action->rxCommandsAvailable) == 0) {
-			_queue->add((uintptr_t)action);
+		switch (event) {
+		case AppleCIOMeshUtils::ForwardTrace::RxReceived:
+			FORWARD_RX_RECEIVED_TR(controllerId, action->sourceNode, bufferId, offset);
+			break;
+		case AppleCIOMeshUtils::ForwardTrace::Prepared:
+			FORWARD_PREPARED_TR(controllerId, value != 0, bufferId, offset);
+			break;
+		case AppleCIOMeshUtils::ForwardTrace::PreviousActionComplete:
+			FORWARD_PREVIOUS_ACTION_COMPLETE_TR(controllerId, action->sourceNode, bufferId, offset);
+			break;
+		case AppleCIOMeshUtils::ForwardTrace::Started:
+			FORWARD_STARTED_TR(controllerId, bufferId, offset, value);
+			break;
+		case AppleCIOMeshUtils::ForwardTrace::TxFlowComplete:
+			FORWARD_TX_FLOW_COMPLETE_TR(controllerId, value, bufferId, offset);
+			break;
+		case AppleCIOMeshUtils::ForwardTrace::Completed:
+			FORWARD_COMPLETED_TR(((int)value << 12) | controllerId,
+			                     action->chainElement == nullptr ? 0 : action->chainElement->provider->getForwardCount(), bufferId,
+			                     offset);
 			break;
 		}
-
-		// we have a rx command available!
-		action->state = ForwardState::ForwardTxReadyToFlow;
-		goto startTxTransfer;
-	}
-		// Flow loop end -----
 	}
+};
 
-	return kIOReturnSuccess;
+IOReturn
+AppleCIOMeshForwarder::forwardStateMachine(ForwardAction * action, bool dedicated, bool checkAhead)
+{
+	ForwardPort port = {this};
+	AppleCIOMeshUtils::ForwardEngine<ForwardPort> engine(port);
+	return engine.step(action, dedicated, checkAhead) ? kIOReturnSuccess : kIOReturnNoMemory;
 }
 
 IOReturn
@@ -1074,9 +1036,10 @@ AppleCIOMeshForwarder::_forwarderLoop(__unused IOInterruptEventSource * sender,
 			action->sharedMemory->disassociateAllForwardChain();
 
 			// Remove all forward actions associated with this shared memory
-			for (int i = 0; i < _forwardActionCount; i++) {
-				if (atomic_load(&_forwardActions[i].initialized) && _forwardActions[i].sharedMemory == action->sharedMemory) {
-					atomic_store(&_forwardActions[i].initialized, false);
+			for (uint32_t i = 0; i < _forwardActionCount; i++) {
+				auto forwardAction = _forwardActions.get(i);
+				if (atomic_load(&forwardAction->initialized) && forwardAction->sharedMemory == action->sharedMemory) {
+					atomic_store(&forwardAction->initialized, false);
 				}
 			}
 
@@ -1124,59 +1087,13 @@ AppleCIOMeshForwarder::_forwarderLoop(__unused IOInterruptEventSource * sender,
 void
 AppleCIOMeshForwarder::_prepareChainGroup(ForwardActionChainGroup * group)
 {
-	uint64_t preparedBytes[kMaxMeshLinksPerChannel] = {0};
-
-	for (int i = 0; i < _service->getLinksPerChannel(); i++) {
-		group->pendingPrepareElements[i] = group->elementCount / _service->getLinksPerChannel();
-	}
-
-	atomic_store(&group->completeElementCount, 0);
-
-	// All Shared memories are the same for actions/elements, grab the first one.
-	auto sm = group->elements[0]->actions[0]->sharedMemory;
-
-	// We only need the asignment to get the size per link. We can grab the first
-	// one and save the data we need.
-	auto assignmentSizePerLink = sm->getAssignment(0)->getAssignmentSizePerLink();
-
-	// Here we will be looping through each chunk
-	for (int i = 0; i < group->elementCount; i++) {
-		auto element = group->elements[i];
-		auto linkIdx = element->linkIdx;
-
-		if (assignmentSizePerLink + preparedBytes[linkIdx] >= kMaxNHIQueueByteSize) {
-			continue;
-		}
-
-		prepareChainElement(element);
-
-		preparedBytes[linkIdx] += assignmentSizePerLink;
-		group->pendingPrepareElements[linkIdx] -= 1;
-	}
+	ForwardPort port = {this};
+	AppleCIOMeshUtils::ForwardEngine<ForwardPort>(port).prepareGroup(group);
 }
 
 void
 AppleCIOMeshForwarder::prepareChainElement(ForwardActionChainElement * element)
 {
-	auto sm = element->actions[0]->sharedMemory;
-	// Get the first RXCommand and mark it as forward incomplete
-	element->actions[0]->rxCommand->getProvider()->markTxForwardIncomplete();
-
-	for (int j = 0; j < kForwardNodeCount; j++) {
-		auto action            = element->actions[j];
-		auto tbtCommands       = action->txCommand->getCommands();
-		auto tbtCommandsLength = action->txCommand->getCommandsLength();
-
-		for (unsigned int k = 0; k < tbtCommandsLength; k++) {
-			action->txCommand->getMeshLink()->prepareTXCommand(action->sourceNode, tbtCommands[k]);
-		}
-
-		atomic_store(&action->prepared, true);
-		FORWARD_PREPARED_TR(action->txCommand->getMeshLink()->getController()->getRID(), false,
-		                    action->txCommand->getDataChunk().bufferId, action->txCommand->getDataChunk().offset);
-	}
-
-	atomic_store(&element->prepared, true);
-
-	sm->addPrepared(kForwardNodeCount);
+	ForwardPort port = {this};
+	AppleCIOMeshUtils::ForwardEngine<ForwardPort>(port).prepareElement(element);
 }
@@ -27,7 +27,10 @@
 
 #include "AppleCIOMeshPtrQueue.h"
 #include "AppleCIOMeshUserClientInterface.h"
+#include "Common/ChainScheduler.h"
 #include "Common/Config.h"
+#include "Common/ForwardEngine.h"
+#include "Common/SlabPool.h"
 
 namespace MUCI  = AppleCIOMeshUserClientInterface;
 namespace MCUCI = AppleCIOMeshConfigUserClientInterface;
@@ -42,42 +45,27 @@ struct ForwardAction;
 struct ForwardActionChainElement;
 struct ForwardActionChainGroup;
 
-/// Note: flow here means an intermediate TBT command within the full
-/// forwarding chunk.
-enum class ForwardState : uint32_t {
-	// First state that begins the forwarding procedure
-	WaitingForRxStart = 0x1,
-	// Prepare Tx buffers for transfer
-	ForwardStartTxPrepare,
-	// Waiting for Tx to be prepared, only used in chains
-	// when the chain hasn't prepared yet for whatever reason.
-	ForwardWaitingPrepare,
-	// Waiting for the previous TX chunk to be complete.
-	WaitingPreviousTxComplete,
-	// Waiting for TX link to be free
-	WaitingForTxFree,
-	// Forwarder can send 1 flow out of the full block/chunk
-	ForwardTxReadyToFlow,
-	// Forwarder is waiting for a TX flow to complete.
-	ForwardWaitingTxFlowComplete,
-	// Forwarder is waiting for an intermediate RX flow before sending
-	// the next TBT command. This will not be entered the first time,
-	// because the first flow completing kicked off the forwarding.
-	WaitingForRxFlow,
-	// Forwarder is going to prepare or complete the forward action.
-	ForwardPrepareOrComplete,
-};
+using AppleCIOMeshUtils::ChainContinueState;
+using AppleCIOMeshUtils::ForwardChainScheduler;
+using AppleCIOMeshUtils::ForwardCounter;
+using AppleCIOMeshUtils::ForwardState;
+using AppleCIOMeshUtils::SlabPool;
+
+// Zeroed slabs for the forwarder's pools.
+struct ForwarderSlabAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		return IONewZero(U, count);
+	}
 
-// The chain continue state when going through the forward state machine.
-enum class ChainContinueState : uint8_t {
-	// We do not know if the chain should continue and don't check because
-	// we are not the last action to complete.
-	Unknown = 0x1,
-	// The chain should stop after this action has completed.
-	StopChain = 0x2,
-	// The chain should continue to the next element after this action has
-	// completed.
-	ContinueChain = 0x3,
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t count)
+	{
+		IODelete(memory, U, count);
+	}
 };
 
 // This is 1 chunk's forward (there are 3 forwards per chunk)
@@ -86,12 +74,12 @@ typedef struct ForwardAction {
 	_Atomic(bool) initialized;
 
 	MCUCI::NodeId sourceNode;
-	_Atomic(bool) rxReadyForForward;
-	_Atomic(bool) prepared;
+	ForwardCounter<bool> rxReadyForForward;
+	ForwardCounter<bool> prepared;
 
-	_Atomic(int8_t) rxCommandsAvailable;
-	_Atomic(int8_t) txCommandsComplete;
-	_Atomic(uint8_t) txCommandsSubmitted;
+	ForwardCounter<int8_t> rxCommandsAvailable;
+	ForwardCounter<int8_t> txCommandsComplete;
+	ForwardCounter<uint8_t> txCommandsSubmitted;
 
 	uint8_t curTxCommand;
 
@@ -107,7 +95,7 @@ typedef struct ForwardAction {
 	ForwardAction * carryPartners[kForwardNodeCount - 1];
 	// If a carry is still required or has the partner been carried far enough
 	// to do the rest themselves.
-	_Atomic(bool) carryRequired;
+	ForwardCounter<bool> carryRequired;
 
 	// The previous forward action before this action. This will not be
 	// set for non-chain actions and for the first forward action in a
@@ -118,7 +106,7 @@ typedef struct ForwardAction {
 	ForwardAction * nextAction;
 	// If the previous action has been complete. This is only applicable if
 	// previousAction was set.
-	_Atomic(bool) previousActionComplete;
+	ForwardCounter<bool> previousActionComplete;
 } ForwardAction;
 
 // One element within the chain of forward actions. This collects
@@ -132,14 +120,14 @@ typedef struct ForwardActionChainElement {
 	uint8_t linkIdx;
 
 	// If this chain element has been prepared.
-	_Atomic(bool) prepared;
+	ForwardCounter<bool> prepared;
 
 	// All the forward actions associated with this chain
 	// This will be the same buffer/offset but different links
 	ForwardAction * actions[kForwardNodeCount];
 
 	// The number of completed forwards so far.
-	_Atomic(uint8_t) completeActionCount;
+	ForwardCounter<uint8_t> completeActionCount;
 
 	// The chain this element belongs to.
 	AppleCIOForwardChain * provider;
@@ -153,16 +141,18 @@ typedef struct ForwardActionChainElement {
 typedef struct ForwardActionChainGroup {
 	// The number of elements that have been completed. This should be
 	// reset to 0 when this group has been prepared.
-	_Atomic(uint32_t) completeElementCount;
+	ForwardCounter<uint32_t> completeElementCount;
 
 	// The number of elements each link needs to prepare.
 	uint32_t pendingPrepareElements[kMaxMeshLinksPerChannel];
 
-	// Elements that need to be prepared together.
-	ForwardActionChainElement * elements[kMaxForwardElementActions];
+	// Elements that need to be prepared together, allocated for as many as
+	// the group was created for.
+	ForwardActionChainElement ** elements;
+	uint32_t elementCapacity;
 
 	// Number of elements;
-	uint8_t elementCount;
+	uint32_t elementCount;
 
 	// The next group. This group will be prepared after the current group
 	// has been completed;
@@ -176,6 +166,11 @@ typedef struct ForwardActionChainGroup {
 	bool isGroupFinished();
 } ForwardActionChainGroup;
 
+using ForwardActionPool       = SlabPool<ForwardAction, kForwardActionSlabSize, ForwarderSlabAllocator>;
+using ForwardChainElementPool = SlabPool<ForwardActionChainElement, kForwardChainElementSlabSize, ForwarderSlabAllocator>;
+using ForwardChainGroupPool   = SlabPool<ForwardActionChainGroup, kForwardChainGroupSlabSize, ForwarderSlabAllocator>;
+using ForwardChainGroupIndex  = SlabPool<ForwardActionChainGroup *, kForwardChainGroupSlabSize, ForwarderSlabAllocator>;
+
 class AppleCIOForwardChain : public OSObject
 {
 	OSDeclareDefaultStructors(AppleCIOForwardChain);
@@ -194,14 +189,16 @@ class AppleCIOForwardChain : public OSObject
 	ForwardActionChainElement * getElement(uint32_t idx);
 	ForwardActionChainGroup * getGroup(uint32_t idx);
 	OSBoundedArrayRef<AppleCIOForwardChain *> getPartnerChains();
-	void setChainGroup(uint32_t idx, ForwardActionChainGroup * group);
+	// Returns false if there is no memory to index the group.
+	bool setChainGroup(uint32_t idx, ForwardActionChainGroup * group);
 	bool
 	isFinished()
 	{
 		return atomic_load(&_elementForwardCount) == 0;
 	}
 
-	// Returns the real chain element that the actions shoud use
+	// Returns the real chain element that the actions shoud use, nullptr if
+	// there is no memory for it.
 	ForwardActionChainElement * addToChain(ForwardActionChainElement * tmpElement);
 
 	// "Starts" the chain by setting element count
@@ -218,8 +215,9 @@ class AppleCIOForwardChain : public OSObject
 	// stop together.
 	void addPartnerChain(AppleCIOForwardChain * chain);
 
-	// Creates and returns a chain group.
-	ForwardActionChainGroup * createChainGroup();
+	// Creates and returns a chain group with room for elementCapacity
+	// elements, nullptr if there is no memory for it.
+	ForwardActionChainGroup * createChainGroup(uint32_t elementCapacity);
 
 	inline int
 	getForwardCount()
@@ -229,11 +227,14 @@ class AppleCIOForwardChain : public OSObject
 
   private:
 	MUCI::ForwardChainId _chainId;
-	OSBoundedArray<ForwardActionChainElement, kMaxForwardChainElement> _forwardChain;
+	// Elements and groups are allocated a slab at a time as the chain is set
+	// up, a chain only holds memory for the buffers it forwards.
+	ForwardChainElementPool _forwardChain;
 	uint32_t _forwardChainCount;
 
-	OSBoundedArray<ForwardActionChainGroup, kMaxForwardChainGroup> _groups;
-	OSBoundedArray<ForwardActionChainGroup *, kMaxForwardChainGroup> _groupPtrs;
+	ForwardChainGroupPool _groups;
+	// Groups by index, including the ones a partner chain created.
+	ForwardChainGroupIndex _groupPtrs;
 	uint32_t _forwardGroupCount;
 
 	// The nubmer of forward chain elements we have to get through
@@ -265,7 +266,10 @@ class AppleCIOMeshForwarder : public OSObject
 
 	ForwardAction * getForwardAction(uint32_t idx);
 
-	void startForwardChain(MUCI::ForwardChainId forwardChainId, uint32_t iterations);
+	// Starts a forward chain now if no other chain is running, otherwise once
+	// the chains started before it have stopped. The oldest start goes first.
+	// Returns kIOReturnNoResources if too many starts are already waiting.
+	IOReturn startForwardChain(MUCI::ForwardChainId forwardChainId, uint32_t iterations);
 	void stopAllForwardChains();
 	// Marks actions as disabled for shared memory. They have to be cleaned up
 	// eventually with cleanupActionsForSharedMemory. Forwarding will be halted
@@ -279,8 +283,8 @@ class AppleCIOMeshForwarder : public OSObject
 	void cleanupActionsForSharedMemory(AppleCIOMeshSharedMemory * memory);
 
 	// Creates a forwarding action from receive -> transmit for the particular
-	// source.
-	void addForwardingAction(AppleCIOMeshTransmitCommand * transmitCommand,
+	// source. Returns kIOReturnNoResources if there is no memory for it.
+	IOReturn addForwardingAction(AppleCIOMeshTransmitCommand * transmitCommand,
 	                         AppleCIOMeshReceiveCommand * receiveCommand,
 	                         MCUCI::NodeId source);
 
@@ -292,24 +296,28 @@ class AppleCIOMeshForwarder : public OSObject
 	void flowRxComplete(uint32_t idx);
 
 	// Creates a new forward chain. Returns the chain ID associated
-	// with this forward chain.
+	// with this forward chain, nullptr if every ForwardChainId is taken or
+	// the chain can't be allocated.
 	AppleCIOForwardChain * createForwardChain(MUCI::ForwardChainId * forwardChainId);
 
 	// removes a forward chain (used when cleaning up a SharedMemory object)
 	void removeForwardChain(AppleCIOForwardChain * fChain);
 
-	// Adds a forward action to an existing forward chain
-	void addToForwardChain(MUCI::ForwardChainId forwardChain, MUCI::BufferId buffer, int64_t offset, uint8_t linkIdx);
+	// Adds a forward action to an existing forward chain. Returns
+	// kIOReturnNoResources if there is no memory for the chain element.
+	IOReturn addToForwardChain(MUCI::ForwardChainId forwardChain, MUCI::BufferId buffer, int64_t offset, uint8_t linkIdx);
 
 	// Groups all forward chain elements together from start offset to
 	// end offset. This is so they are all prepared together in 1 shot.
-	// This will go through all
-	void groupChainElements(MUCI::ForwardChainId forwardChainId,
+	// This will go through all. Returns kIOReturnNoResources if there is no
+	// memory for the group.
+	IOReturn groupChainElements(MUCI::ForwardChainId forwardChainId,
 	                        MUCI::BufferId buffer,
 	                        MUCI::ForwardChain * forwardChain,
 	                        uint64_t bufferSize);
 
-	// Runs through the forward state machine for a forwarding action
+	// Runs through the forward state machine (see Common/ForwardEngine.h)
+	// for a forwarding action.
 	// Dedicated can be used to indicate if the action must absolutely
 	// be completed or if it is safe to stick the action back in the
 	// waiting queue if it is blocked for whatever reason.
@@ -320,13 +328,21 @@ class AppleCIOMeshForwarder : public OSObject
 	void prepareChainElement(ForwardActionChainElement * element);
 
   private:
+	// Drives the portable forward engine with Thunderbolt commands.
+	struct ForwardPort;
+
 	IOReturn _forwarderLoop(IOInterruptEventSource * sender, int count);
 	void _prepareChainGroup(ForwardActionChainGroup * group);
+	// Starts the next pending chain if none is running, takes _chainLock.
+	void _startNextForwardChain();
 
 	IOInterruptEventSource * _forwardEventSource;
 	IOWorkLoop * _workloop;
 
-	OSBoundedArray<ForwardAction, kMaxForwardAction> _forwardActions;
+	// Actions are allocated a slab at a time and keep their index for as long
+	// as the forwarder lives. Cleaned up actions are reused, lowest index
+	// first, before another slab is allocated.
+	ForwardActionPool _forwardActions;
 	uint32_t _forwardActionCount;
 
 	AppleCIOMeshPtrQueue * _queue;
@@ -343,4 +359,8 @@ class AppleCIOMeshForwarder : public OSObject
 	ForwardAction _dummyDestroySharedMemoryAction;
 
 	_Atomic(uintptr_t) _currentActiveChain;
+
+	// Starts waiting for the active chain to stop, by ForwardChainId.
+	IOLock * _chainLock;
+	ForwardChainScheduler<kMaxForwardChains> _chainScheduler;
 };
@@ -70,6 +70,9 @@ AppleCIOMeshHardwareConfig::populate(uint8_t meshConfiguration)
 	if (meshConfiguration == kJ236Hypercube) {
 		numNodes = 4;
 
+		// Keep in sync with kJ236LinkPartners in Common/MeshTopology.h, which
+		// canActivate and the ensemble routes work from.
+
 		// Node 0
 		nodePartners[0].hardwareNodes[0] = 3; // B
 		nodePartners[0].hardwareNodes[1] = 0; // A
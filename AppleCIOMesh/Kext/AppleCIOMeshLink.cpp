@@ -66,6 +66,9 @@ AppleCIOMeshLink::probe(IOService * provider, __unused SInt32 * probe)
 		return nullptr;
 	}
 
+	// The rings are sized from what this acio's links carried so far.
+	meshService->getPathSizing(acio, _txSizing, _rxSizing);
+
 	OSSafeReleaseNULL(service);
 	return this;
 }
@@ -115,6 +118,8 @@ AppleCIOMeshLink::start(IOService * provider)
 	AppleCIOMeshPath::Configuration dataPathConfig = {
 	    .tbtCredits  = 55,
 	    .tbtPriority = 2,
+	    .txSizing    = _txSizing,
+	    .rxSizing    = _rxSizing,
 	};
 
 	if (!PE_parse_boot_argn(kAppleCIOMeshDataPathCredits, &dataPathConfig.tbtCredits, sizeof(dataPathConfig.tbtCredits))) {
@@ -134,8 +139,17 @@ AppleCIOMeshLink::start(IOService * provider)
 
 		_txDataPaths[i]->start();
 		_rxDataPaths[i]->start();
+
+		uint64_t ringBytes = (uint64_t)_txDataPaths[i]->getRingSize() * kIOThunderboltMaxFrameSize;
+		if (ringBytes < _queueBytes) {
+			_queueBytes = ringBytes;
+		}
+		ringBytes = (uint64_t)_rxDataPaths[i]->getRingSize() * kIOThunderboltMaxFrameSize;
+		if (ringBytes < _queueBytes) {
+			_queueBytes = ringBytes;
+		}
 	}
-	LOG("Finished creating MeshLink on acio%d\n", _tbtController->getRID());
+	LOG("Finished creating MeshLink on acio%d, queueing up to %llu bytes\n", _tbtController->getRID(), _queueBytes);
 
 	serviceMatch         = IOService::serviceMatching("AppleCIOMeshService");
 	_meshServiceNotifier = IOService::addMatchingNotification(gIOPublishNotification, serviceMatch, handler, this);
@@ -356,6 +370,12 @@ AppleCIOMeshLink::getChannel()
 	return _channel;
 }
 
+uint64_t
+AppleCIOMeshLink::getQueueBytes()
+{
+	return _queueBytes;
+}
+
 void
 AppleCIOMeshLink::getChassisId(MCUCI::ChassisId * chassis)
 {
@@ -31,6 +31,7 @@
 
 #include "AppleCIOMeshControlCommand.h"
 #include "AppleCIOMeshUserClientInterface.h"
+#include "Common/CoalescingPolicy.h"
 
 class AppleCIOMeshChannel;
 class AppleCIOMeshControlPath;
@@ -70,6 +71,7 @@ class AppleCIOMeshLink : public IOService
 	AppleCIOMeshControlPath * getControlPath();
 	MCUCI::NodeId getConnectedNodeId();
 	AppleCIOMeshChannel * getChannel();
+	uint64_t getQueueBytes();
 	void getChassisId(MCUCI::ChassisId * chassis);
 	bool hasPendingLinkId();
 	bool getPendingLinkId(LinkIdentificationCommand * cmd);
@@ -123,6 +125,13 @@ class AppleCIOMeshLink : public IOService
 	OSBoundedArray<AppleCIOMeshTxPath *, kNumDataPaths> _txDataPaths;
 	AppleCIOMeshControlPath * _controlPath;
 
+	// How the data path rings are sized, from the mesh service in probe().
+	AppleCIOMeshUtils::RingSizing _txSizing = {kTxRingSize, kTxInterruptStride};
+	AppleCIOMeshUtils::RingSizing _rxSizing = {kRxRingSize, kRxInterruptStride};
+	// How much may be queued on the link at once, what its smallest data path
+	// ring holds.
+	uint64_t _queueBytes = kMaxNHIQueueByteSize;
+
 	IOThunderboltController * _tbtController;
 	IOThunderboltXDomainLink * _xdLink;
 	MCUCI::NodeId _connectedNode;
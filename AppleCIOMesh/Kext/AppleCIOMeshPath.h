@@ -28,6 +28,7 @@
 #include <libkern/c++/OSBoundedArray.h>
 
 #include "AppleCIOMeshUserClientInterface.h"
+#include "Common/CoalescingPolicy.h"
 #include "Common/Config.h"
 
 namespace MUCI  = AppleCIOMeshUserClientInterface;
@@ -44,6 +45,9 @@ class AppleCIOMeshPath : public OSObject
 	struct Configuration {
 		uint8_t tbtCredits;
 		uint8_t tbtPriority;
+		// Data paths only, see Common/CoalescingPolicy.h.
+		AppleCIOMeshUtils::RingSizing txSizing;
+		AppleCIOMeshUtils::RingSizing rxSizing;
 	};
 
 	static AppleCIOMeshPath * withLink(AppleCIOMeshLink * link, Configuration & configuration);
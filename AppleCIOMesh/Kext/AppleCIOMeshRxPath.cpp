@@ -58,10 +58,10 @@ AppleCIOMeshRxPath::initWithLink(AppleCIOMeshLink * link,
 	}
 
 	if (!PE_parse_boot_argn(kAppleCIOMeshRxRingSize, &_rxRingSize, sizeof(_rxRingSize))) {
-		_rxRingSize = kRxRingSize;
+		_rxRingSize = configuration.rxSizing.ringSize;
 	}
 	if (!PE_parse_boot_argn(kAppleCIOMeshRxInterruptStride, &_rxInterruptStride, sizeof(_rxInterruptStride))) {
-		_rxInterruptStride = kRxInterruptStride;
+		_rxInterruptStride = configuration.rxSizing.interruptStride;
 	}
 	if (!PE_parse_boot_argn(kAppleCIOMeshE2EFlowControl, &_e2eFlowControlEnable, sizeof(_e2eFlowControlEnable))) {
 		_e2eFlowControlEnable = kE2EFlowControlEnable;
@@ -251,3 +251,9 @@ AppleCIOMeshRxPath::getQueue()
 {
 	return _queue;
 }
+
+uint32_t
+AppleCIOMeshRxPath::getRingSize()
+{
+	return _rxRingSize;
+}
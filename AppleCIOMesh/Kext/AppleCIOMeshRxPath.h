@@ -44,6 +44,7 @@ class AppleCIOMeshRxPath final : public AppleCIOMeshPath
 	virtual void submitPreparedPartial(IOThunderboltCommand * command, int64_t offset) APPLE_KEXT_OVERRIDE;
 	virtual void checkCompletion() APPLE_KEXT_OVERRIDE;
 	IOThunderboltReceiveQueue * getQueue();
+	uint32_t getRingSize();
 
   private:
 	IOReturn initPath(IOThunderboltHopID sourceTxHopID, IOThunderboltHopID destinationHopID);
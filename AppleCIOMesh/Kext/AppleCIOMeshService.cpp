@@ -54,6 +54,10 @@ OSDefineMetaClassAndStructors(AppleCIOMeshService, IOService);
 #define kThreadStartStopTimeNs (30LL * kNsPerSecond)
 #define kForwardStopTimeNs (5LL * kNsPerMillisecond)
 
+static_assert((uint64_t)kTxRingSize * kIOThunderboltMaxFrameSize >= kMaxChunkSizePerLink &&
+                  (uint64_t)kRxRingSize * kIOThunderboltMaxFrameSize >= kMaxChunkSizePerLink,
+              "The largest rings have to hold a chunk");
+
 bool gSignpostsEnabled;
 
 int gDisableSingleKeyUse = 0;
@@ -140,16 +144,19 @@ AppleCIOMeshService::start(__unused IOService * provider)
 	_commandeerEventSource = IOInterruptEventSource::interruptEventSource(this, commandeerAction);
 	GOTO_FAIL_IF_NULL(_commandeerEventSource, "Failed to make mesh service commanderEventSource\n");
 
-	_commandeerPrepareAssignmentQueue0 = AppleCIOMeshPtrQueue::allocate(kNumBulkPrepare);
-	GOTO_FAIL_IF_NULL(_commandeerPrepareAssignmentQueue0, "Failed to make commandeer prepare assignment queue 0\n");
-	_commandeerPrepareAssignmentQueue1 = AppleCIOMeshPtrQueue::allocate(kNumBulkPrepare);
-	GOTO_FAIL_IF_NULL(_commandeerPrepareAssignmentQueue1, "Failed to make commandeer prepare assignment queue 0\n");
-	_commandeerPendingPrepareQueue0 = AppleCIOMeshPtrQueue::allocate(kNumBulkPrepare);
-	GOTO_FAIL_IF_NULL(_commandeerPendingPrepareQueue0, "Failed to make commandeer pending prepare queue 0\n");
-	_commandeerPendingPrepareQueue1 = AppleCIOMeshPtrQueue::allocate(kNumBulkPrepare);
-	GOTO_FAIL_IF_NULL(_commandeerPendingPrepareQueue1, "Failed to make commandeer pending prepare queue 1\n");
-	_commandeerForwardPrepareQueue = AppleCIOMeshPtrQueue::allocate(kNumBulkPrepare);
-	GOTO_FAIL_IF_NULL(_commandeerForwardPrepareQueue, "Failed to make commandeer forward prepare queue\n");
+	{
+		AppleCIOMeshUtils::CommandeerPolicy policy;
+		policy.busyBatch = kCommandeerBusyBatch;
+		policy.idleBatch = kCommandeerIdleBatch;
+		nanoseconds_to_absolutetime(kCommandeerSpinBeforeParkNs, &policy.spinBeforePark);
+		if (!_commandeerQueue.init(kCommandeerQueueEntries, policy)) {
+			ERROR("Failed to make commandeer work queue\n");
+			goto fail;
+		}
+	}
+
+	_commandeerLock = IOLockAlloc();
+	GOTO_FAIL_IF_NULL(_commandeerLock, "Failed to make commandeer lock\n");
 
 	_commandeerWorkloop->addEventSource(_commandeerEventSource);
 	atomic_store(&_commandeerActive, false);
@@ -202,6 +209,29 @@ AppleCIOMeshService::start(__unused IOService * provider)
 	_linkLock = IOLockAlloc();
 	GOTO_FAIL_IF_NULL(_linkLock, "failed to make link lock");
 
+	{
+		AppleCIOMeshUtils::CoalescingPolicyConfig config;
+		config.frameBytes    = kIOThunderboltMaxFrameSize;
+		config.minRingSize   = kCoalescingMinRingSize;
+		config.chunkBytes    = kMaxChunkSizePerLink;
+		config.minStride     = kCoalescingMinStride;
+		config.maxStride     = kCoalescingMaxStride;
+		config.maxInterrupts = kCoalescingMaxInterrupts;
+		config.switchWindows = kCoalescingSwitchWindows;
+		nanoseconds_to_absolutetime(kCoalescingWindowNs, &config.window);
+		nanoseconds_to_absolutetime(kCoalescingRingCoverNs, &config.ringCover);
+
+		for (uint8_t i = 0; i < _txCoalescing.length(); i++) {
+			config.maxRingSize = kTxRingSize;
+			config.defaults    = {kTxRingSize, kTxInterruptStride};
+			_txCoalescing[i].init(config);
+
+			config.maxRingSize = kRxRingSize;
+			config.defaults    = {kRxRingSize, kRxInterruptStride};
+			_rxCoalescing[i].init(config);
+		}
+	}
+
 	PMinit();
 	provider->joinPMtree(this);
 	registerPrioritySleepWakeInterest(&AppleCIOMeshService::meshPowerStateChangeCallback, this);
@@ -236,6 +266,12 @@ AppleCIOMeshService::start(__unused IOService * provider)
 	return true;
 
 fail:
+	if (_commandeerLock) {
+		IOLockFree(_commandeerLock);
+		_commandeerLock = nullptr;
+	}
+	_commandeerQueue.reset();
+
 	if (_linkLock) {
 		IOLockFree(_linkLock);
 	}
@@ -257,6 +293,7 @@ fail:
 	OSSafeReleaseNULL(_commandQueue);
 	OSSafeReleaseNULL(_userClients);
 	OSSafeReleaseNULL(_configUserClients);
+	_sharedMemoryIndex.reset();
 	OSSafeReleaseNULL(_sharedMemoryRegions);
 
 	if (_meshProtocolListeners) {
@@ -293,6 +330,7 @@ AppleCIOMeshService::stop(__unused IOService * provider)
 	// XXXdbg - should kick all uc's out here
 
 	atomic_store(&_commandeerActivated, false);
+	_wakeCommandeer();
 
 	_controlCommandEventSource->disable();
 
@@ -304,6 +342,7 @@ AppleCIOMeshService::stop(__unused IOService * provider)
 	_forwarder = nullptr;
 
 	// Teardown all shared memory buffers
+	_sharedMemoryIndex.removeAll();
 	for (int i = (int)_sharedMemoryRegions->getCount() - 1; i >= 0; i--) {
 		_sharedMemoryRegions->removeObject((unsigned int)i);
 	}
@@ -330,6 +369,12 @@ AppleCIOMeshService::stop(__unused IOService * provider)
 void
 AppleCIOMeshService::free()
 {
+	if (_commandeerLock) {
+		IOLockFree(_commandeerLock);
+		_commandeerLock = nullptr;
+	}
+	_commandeerQueue.reset();
+
 	if (_linkLock) {
 		IOLockFree(_linkLock);
 	}
@@ -351,6 +396,7 @@ AppleCIOMeshService::free()
 	OSSafeReleaseNULL(_commandQueue);
 	OSSafeReleaseNULL(_userClients);
 	OSSafeReleaseNULL(_configUserClients);
+	_sharedMemoryIndex.reset();
 	OSSafeReleaseNULL(_sharedMemoryRegions);
 
 	if (_meshProtocolListeners) {
@@ -645,6 +691,7 @@ AppleCIOMeshService::unregisterUserClient(AppleCIOMeshUserClient * uc)
 	{
 		atomic_store(&_commandeerActivated, false);
 		_commandeerEventSource->disable();
+		_wakeCommandeer();
 
 		uint64_t start = mach_absolute_time();
 		uint64_t now, limit;
@@ -732,28 +779,17 @@ exit:
 AppleCIOMeshSharedMemory *
 AppleCIOMeshService::getSharedMemory(MUCI::BufferId bufferId)
 {
-	for (unsigned int i = 0; i < _sharedMemoryRegions->getCount(); i++) {
-		auto sm = OSRequiredCast(AppleCIOMeshSharedMemory, _sharedMemoryRegions->getObject(i));
-
-		if (sm->getId() == bufferId) {
-			return sm;
-		}
-	}
-	return nullptr;
+	return _sharedMemoryIndex.find(bufferId);
 }
 
 AppleCIOMeshSharedMemory *
 AppleCIOMeshService::getRetainSharedMemory(MUCI::BufferId bufferId)
 {
-	for (unsigned int i = 0; i < _sharedMemoryRegions->getCount(); i++) {
-		auto sm = OSRequiredCast(AppleCIOMeshSharedMemory, _sharedMemoryRegions->getObject(i));
-
-		if (sm->getId() == bufferId) {
-			sm->retain();
-			return sm;
-		}
+	auto sm = _sharedMemoryIndex.find(bufferId);
+	if (sm != nullptr) {
+		sm->retain();
 	}
-	return nullptr;
+	return sm;
 }
 
 uint32_t
@@ -851,6 +887,36 @@ AppleCIOMeshService::acioDisabled(uint8_t acio)
 	return retval;
 }
 
+void
+AppleCIOMeshService::getPathSizing(uint8_t acio, AppleCIOMeshUtils::RingSizing & txSizing, AppleCIOMeshUtils::RingSizing & rxSizing)
+{
+	txSizing = _txCoalescing[acio].sizing();
+	rxSizing = _rxCoalescing[acio].sizing();
+
+	LOG("acio%d data paths tx ring:%u stride:%u rx ring:%u stride:%u\n", acio, txSizing.ringSize, txSizing.interruptStride,
+	    rxSizing.ringSize, rxSizing.interruptStride);
+}
+
+uint64_t
+AppleCIOMeshService::getLinkQueueBytes(uint8_t channelLinkIdx)
+{
+	// A chunk on a channel link goes out on that link of every channel, so
+	// the smallest of their rings decides.
+	uint64_t queueBytes = kMaxNHIQueueByteSize;
+	for (int meshC = 0; meshC < (int)_meshChannels.length(); meshC++) {
+		if (_meshChannels[meshC] == nullptr) {
+			continue;
+		}
+
+		auto linkIdx = _meshChannels[meshC]->getLinkIndex(channelLinkIdx);
+		if (_meshLinks[linkIdx] != nullptr && _meshLinks[linkIdx]->getQueueBytes() < queueBytes) {
+			queueBytes = _meshLinks[linkIdx]->getQueueBytes();
+		}
+	}
+
+	return queueBytes;
+}
+
 void
 AppleCIOMeshService::populateHardwareConfig()
 {
@@ -896,6 +962,13 @@ AppleCIOMeshService::dumpCommandeerState()
 	    _commandeerSMSend, _commandeerSMSend ? _commandeerSMSend->getId() : (int64_t)0, _commandeerSMSendOffset,
 	    _commandeerSMPrepare, _commandeerSMPrepare ? _commandeerSMPrepare->getId() : (int64_t)0, _commandeerSMPrepareOffset,
 	    _commandeerPrepareDripAssignmentIdx, _commandeerPrepareDripOffsetIdx, _commandeerPrepareDripLinkIdx);
+
+	auto stats = _commandeerQueue.stats();
+	LOG("commandeer queue pushed %llu full %llu popped %llu batches %llu parks %llu wakeups %llu parked %s deferred send %s "
+	    "drip %s\n",
+	    stats.pushed, stats.full, stats.popped, stats.batches, stats.parks, stats.wakeups,
+	    _commandeerQueue.parked() ? "YES" : "NO", _commandeerHasDeferredSend ? "YES" : "NO",
+	    _commandeerHasDeferredDripPrepare ? "YES" : "NO");
 }
 
 bool
@@ -982,6 +1055,16 @@ AppleCIOMeshService::newUserClient(
 	return kIOReturnSuccess;
 }
 
+void
+AppleCIOMeshService::_recordPathTraffic(uint8_t acio, bool transmit, int64_t bytes)
+{
+	auto & policy = transmit ? _txCoalescing[acio] : _rxCoalescing[acio];
+
+	// Lock free, a completion only does more than count when it is the first
+	// to see that a window ended.
+	policy.record(mach_absolute_time(), bytes > 0 ? (uint64_t)bytes : 0);
+}
+
 void
 AppleCIOMeshService::_commandeerLoopPendingCheck(NodeAssignmentMap * nodeMap, uint8_t linkIdx)
 {
@@ -990,36 +1073,67 @@ AppleCIOMeshService::_commandeerLoopPendingCheck(NodeAssignmentMap * nodeMap, ui
 	auto sm     = map->sharedMemory;
 	bool output = false;
 
-	if (atomic_load(&nodeMap->linkCurrentIdx[linkIdx]) != nodeMap->linkAssignCount[linkIdx]) {
-		if (sm->runtimePrepareDisabled()) {
-			// Do not allow runtime preparing while the SM is being prepared, the 2
-			// chunks will overlap and cause a lot of issues, so just prepare
-			// 1 chunk at a time to avoid this issue.
-			// We need to store this in a pending queue to eventually process
-			// the commandeerloop will eventually prepare this.
-			commandeerPendingPrepare(nodeMap, linkIdx);
-		} else {
-			auto idxIdx = atomic_fetch_add(&nodeMap->linkCurrentIdx[linkIdx], 1);
+	if (atomic_load(&nodeMap->linkCurrentIdx[linkIdx]) == nodeMap->linkAssignCount[linkIdx]) {
+		return;
+	}
 
-			// TODO: Fix the subtraction here, we subtract because 1 assignment
-			// has both links' chunks. So if we are in the second link,
-			// we need to go back to the previous index.
+	if (sm->runtimePrepareDisabled()) {
+		// Do not allow runtime preparing while the SM is being prepared, the 2
+		// chunks will overlap and cause a lot of issues, so just prepare
+		// 1 chunk at a time to avoid this issue.
+		// We need to store this in a pending queue to eventually process
+		// the commandeerloop will eventually prepare this.
+		commandeerPendingPrepare(nodeMap, linkIdx);
+		return;
+	}
 
-			if (node == _nodeId) {
-				output = true;
-			}
+	if (node == _nodeId) {
+		output = true;
+	}
 
-			auto assignmentIdx = nodeMap->linkAssignedIdx[linkIdx][idxIdx];
-			if (!output) {
-				assignmentIdx -= linkIdx;
-			}
+	// Keep as many assignments prepared ahead of the link as its drip prepare
+	// controller asks for. That is usually the one that just completed, one
+	// more when the link is going faster or the commandeer slower than it
+	// was, and none when it is going slower.
+	for (uint32_t prepared = 0; prepared < kDripPrepareMaxBatch;) {
+		uint32_t idxIdx = atomic_load(&nodeMap->linkCurrentIdx[linkIdx]);
+		if (idxIdx == nodeMap->linkAssignCount[linkIdx]) {
+			break;
+		}
 
-			auto assignment = sm->getAssignmentIn(map->getAssignmentOffset(assignmentIdx), assignmentIdx);
-			commandeerBulkPrepare(assignment, linkIdx);
+		// TODO: Fix the subtraction here, we subtract because 1 assignment
+		// has both links' chunks. So if we are in the second link,
+		// we need to go back to the previous index.
+		auto assignmentIdx = nodeMap->linkAssignedIdx[linkIdx][idxIdx];
+		if (!output) {
+			assignmentIdx -= linkIdx;
 		}
+
+		auto assignment = sm->getAssignmentIn(map->getAssignmentOffset(assignmentIdx), assignmentIdx);
+		if (!map->canPrepareAhead(node, linkIdx, assignment->getAssignmentSizePerLink(), getLinkQueueBytes(linkIdx))) {
+			break;
+		}
+
+		// The pending prepare and a completion can both get here, only one
+		// of them prepares each assignment.
+		if (!atomic_compare_exchange_strong(&nodeMap->linkCurrentIdx[linkIdx], &idxIdx, idxIdx + 1)) {
+			continue;
+		}
+
+		commandeerBulkPrepare(assignment, nodeMap, linkIdx);
+		prepared++;
 	}
 }
 
+static_assert(kCommandeerBusyBatch <= kCommandeerIdleBatch, "The commandeer pops at most kCommandeerIdleBatch at a time");
+
+// A send or drip prepare running and one more deferred behind it.
+static const uint32_t kCommandeerSlots = 2;
+
+// Pending prepare entries keep the link index in the low bits of the map.
+static const uintptr_t kPendingPrepareLinkMask = alignof(NodeAssignmentMap) - 1;
+static_assert(kMaxMeshLinksPerChannel <= alignof(NodeAssignmentMap), "The link index must fit under the map's alignment");
+
 IOReturn
 AppleCIOMeshService::_commandeerLoop(__unused IOInterruptEventSource * sender, __unused int count)
 {
@@ -1031,9 +1145,22 @@ AppleCIOMeshService::_commandeerLoop(__unused IOInterruptEventSource * sender, _
 	// When exiting from error, the order has to be:
 	// release the buffer, clear the working atomic, goto after.
 	LOG("_commandeerLoop is alive\n");
+	atomic_store(&_commandeerThread, current_thread());
 
+	AppleCIOMeshUtils::CommandeerWork work[kCommandeerIdleBatch];
 	IOReturn retVal = kIOReturnSuccess;
 	while (atomic_load(&_commandeerActivated)) {
+		// A send or drip prepare that came in while the last one was still
+		// going starts as soon as that one is done.
+		if (_commandeerHasDeferredSend && !atomic_load(&_commandeerSendData)) {
+			_commandeerHasDeferredSend = false;
+			_startCommandeerSend(_commandeerDeferredSend);
+		}
+		if (_commandeerHasDeferredDripPrepare && !atomic_load(&_commandeerPrepareData)) {
+			_commandeerHasDeferredDripPrepare = false;
+			_startCommandeerDripPrepare(_commandeerDeferredDripPrepare);
+		}
+
 		// Send Data -- Few infinite loops:
 		// 1) Instead of waiting indefinitely for assignment to be dispatched, we need to
 		// check, send if not fully dispatched, and then if not fully dispatched again
@@ -1047,9 +1174,7 @@ AppleCIOMeshService::_commandeerLoop(__unused IOInterruptEventSource * sender, _
 				if (mach_absolute_time() - _commanderSMSendStart >= _maxWaitTime) {
 					LOG("commandeer send timedOut... offset 0x%llx\n", _commandeerSMSendOffset);
 
-					OSSafeReleaseNULL(_commandeerSMSend);
-					OSSafeReleaseNULL(_commandeerSendUserClient);
-					atomic_store(&_commandeerSendData, false);
+					_finishCommandeerSend();
 					goto afterSend;
 				}
 			}
@@ -1057,9 +1182,7 @@ AppleCIOMeshService::_commandeerLoop(__unused IOInterruptEventSource * sender, _
 			if (_commandeerSMSend->hasBeenInterrupted()) {
 				LOG("commandeer send interrupted... offset 0x%llx\n", _commandeerSMSendOffset);
 
-				OSSafeReleaseNULL(_commandeerSMSend);
-				OSSafeReleaseNULL(_commandeerSendUserClient);
-				atomic_store(&_commandeerSendData, false);
+				_finishCommandeerSend();
 				goto afterSend;
 			}
 
@@ -1076,18 +1199,14 @@ AppleCIOMeshService::_commandeerLoop(__unused IOInterruptEventSource * sender, _
 				COMMANDEER_SEND_TR(_commandeerSMSend->getId(), _commandeerSMSendOffset, COMMANDEER_SEND_META_COMPLETE);
 				_commandeerSendUserClient->commandeerSendComplete();
 
-				OSSafeReleaseNULL(_commandeerSMSend);
-				OSSafeReleaseNULL(_commandeerSendUserClient);
-				atomic_store(&_commandeerSendData, false);
+				_finishCommandeerSend();
 				goto afterSend;
 			}
 
 			if (interrupted) {
 				LOG("commandeer send interrupted... offset 0x%llx\n", _commandeerSMSendOffset);
 
-				OSSafeReleaseNULL(_commandeerSMSend);
-				OSSafeReleaseNULL(_commandeerSendUserClient);
-				atomic_store(&_commandeerSendData, false);
+				_finishCommandeerSend();
 				goto afterSend;
 			}
 		}
@@ -1102,9 +1221,7 @@ AppleCIOMeshService::_commandeerLoop(__unused IOInterruptEventSource * sender, _
 			if (_commandeerSMPrepare->hasBeenInterrupted()) {
 				LOG("bufferId %lld was interrupted.\n", _commandeerSMPrepare->getId());
 
-				OSSafeReleaseNULL(_commandeerPreparePreviousSM);
-				OSSafeReleaseNULL(_commandeerSMPrepare);
-				atomic_store(&_commandeerPrepareData, false);
+				_finishCommandeerDripPrepare();
 				goto afterDripPrepare;
 			}
 
@@ -1125,17 +1242,13 @@ AppleCIOMeshService::_commandeerLoop(__unused IOInterruptEventSource * sender, _
 			}
 
 			if (retVal == kIOReturnSuccess) {
-				OSSafeReleaseNULL(_commandeerPreparePreviousSM);
-				OSSafeReleaseNULL(_commandeerSMPrepare);
-				atomic_store(&_commandeerPrepareData, false);
+				_finishCommandeerDripPrepare();
 				goto afterDripPrepare;
 			} else if (retVal == kIOReturnStillOpen) {
 				if (_commandeerSMPrepare->hasBeenInterrupted()) {
 					LOG("bufferId %lld was interrupted.\n", _commandeerSMPrepare->getId());
 
-					OSSafeReleaseNULL(_commandeerPreparePreviousSM);
-					OSSafeReleaseNULL(_commandeerSMPrepare);
-					atomic_store(&_commandeerPrepareData, false);
+					_finishCommandeerDripPrepare();
 					goto afterDripPrepare;
 				}
 
@@ -1178,49 +1291,29 @@ AppleCIOMeshService::_commandeerLoop(__unused IOInterruptEventSource * sender, _
 
 	afterForward:
 
-		// Bulk Prepare helper for queue 0 -- No infinite loop, just prepare
-		// 1 assignment at a time.
-		AppleCIOMeshAssignment * toPrepareAssignment0 = (AppleCIOMeshAssignment *)_commandeerPrepareAssignmentQueue0->remove();
-		if (toPrepareAssignment0 == nullptr) {
-			goto afterBulkPrepare0;
-		}
-		toPrepareAssignment0->prepare(0x1);
-
-	afterBulkPrepare0:
-
-		// Bulk Prepare helper for queue 0 -- No infinite loop, just prepare
-		// 1 assignment at a time.
-		AppleCIOMeshAssignment * toPrepareAssignment1 = (AppleCIOMeshAssignment *)_commandeerPrepareAssignmentQueue1->remove();
-		if (toPrepareAssignment1 == nullptr) {
-			goto afterBulkPrepare1;
+		// Everything queued -- bulk, pending and forward prepares, none of
+		// them loop. While something above is in progress only a few are
+		// taken so we get back to it quickly.
+		bool busy = atomic_load(&_commandeerSendData) || atomic_load(&_commandeerPrepareData) ||
+		            atomic_load(&_commandeerForwardAction) != 0;
+		uint32_t popped = _commandeerQueue.pop(work, _commandeerQueue.batchLimit(busy));
+		for (uint32_t i = 0; i < popped; i++) {
+			_runCommandeerWork(work[i]);
 		}
-		toPrepareAssignment1->prepare(0x2);
 
-	afterBulkPrepare1:
-		// Pending prepare helper for queue 0 -- no infinite loop
-		NodeAssignmentMap * nodeMap0 = (NodeAssignmentMap *)_commandeerPendingPrepareQueue0->remove();
-		if (nodeMap0) {
-			_commandeerLoopPendingCheck(nodeMap0, 0);
-		}
+		bool pending = atomic_load(&_commandeerPendingPrepares) != 0;
+		_runPendingPrepares();
 
-	afterPendingPrepare0:
-		// Pending prepare helper for queue 1 -- no infinite loop
-		NodeAssignmentMap * nodeMap1 = (NodeAssignmentMap *)_commandeerPendingPrepareQueue1->remove();
-		if (nodeMap1) {
-			_commandeerLoopPendingCheck(nodeMap1, 1);
+		if (_commandeerQueue.shouldPark(!busy && popped == 0 && !pending, mach_absolute_time())) {
+			_parkCommandeer();
 		}
-
-	afterPendingPrepare1:
-		ForwardActionChainElement * chainElement = (ForwardActionChainElement *)_commandeerForwardPrepareQueue->remove();
-		if (chainElement == nullptr) {
-			goto afterForwardPrepare;
-		}
-		_forwarder->prepareChainElement(chainElement);
-
-	afterForwardPrepare:
-		continue;
 	}
 
+	// Nothing runs this work until the next start, by then the buffers it
+	// refers to may be gone. Drop it along with the references it holds.
+	_dropCommandeerWork();
+	atomic_store(&_commandeerThread, (thread_t)nullptr);
+
 	LOG("*** _commandeerLoop going away\n");
 	atomic_store(&_commandeerActive, false);
 	return kIOReturnSuccess;
@@ -1319,6 +1412,15 @@ AppleCIOMeshService::dataSent(void * param, IOReturn status, __unused IOThunderb
 	LINK_DATA_SENT_CALLBACK_TR(transmitCommand->getMeshLink()->getController()->getRID(), transmitCommand->getDataChunk().bufferId,
 	                           transmitCommand->getDataChunk().offset);
 
+	_recordPathTraffic(transmitCommand->getMeshLink()->getController()->getRID(), true, transmitCommand->getDataChunk().size);
+
+	// The route weights follow how fast each channel completes.
+	uint64_t sendLatency = transmitCommand->takeSendLatency();
+	auto channel         = transmitCommand->getMeshLink()->getChannel();
+	if (sendLatency != 0 && channel != nullptr) {
+		_commandRouter->recordChannelCompletion(channel->getChannelIndex(), sendLatency);
+	}
+
 	transmitCommand->getProvider()->getProvider()->getProvider()->removePrepared(1);
 	if (_forwarder) {
 		transmitCommand->getProvider()->notifyTXFlowControl(transmitCommand, _forwarder);
@@ -1340,6 +1442,7 @@ AppleCIOMeshService::dataSent(void * param, IOReturn status, __unused IOThunderb
 			auto outgoingMap = sm->getOutputAssignmentMap();
 			auto nodeMap     = &(outgoingMap->nodeMap[node]);
 
+			outgoingMap->recordLinkCompleted(node, linkIdx, mach_absolute_time());
 			_commandeerLoopPendingCheck(nodeMap, linkIdx);
 		}
 
@@ -1378,6 +1481,8 @@ AppleCIOMeshService::dataReceived(void * param, IOReturn status, __unused IOThun
 		return;
 	}
 
+	_recordPathTraffic(receiveCommand->getMeshLink()->getController()->getRID(), false, receiveCommand->getDataChunk().size);
+
 	receiveCommand->getProvider()->getProvider()->getProvider()->removePrepared(1);
 
 	if (_forwarder) {
@@ -1391,6 +1496,7 @@ AppleCIOMeshService::dataReceived(void * param, IOReturn status, __unused IOThun
 		auto receiveMap = sm->getReceiveAssignmentMap();
 		auto nodeMap    = &(receiveMap->nodeMap[node]);
 
+		receiveMap->recordLinkCompleted(node, linkIdx, mach_absolute_time());
 		_commandeerLoopPendingCheck(nodeMap, linkIdx);
 	}
 
@@ -1911,6 +2017,7 @@ AppleCIOMeshService::_stopThreadsUCGated()
 	// stop.
 	atomic_store(&_commandeerActivated, false);
 	_commandeerEventSource->disable();
+	_wakeCommandeer();
 
 	_forwarder->stopAllForwardChains();
 	_forwarder->stop();
@@ -2073,108 +2180,89 @@ AppleCIOMeshService::canActivate(const MCUCI::MeshNodeCount * nodeCount)
 		return true;
 	}
 
-	bool canActivateMesh           = false;
-	auto armIODeviceEntry          = IORegistryEntry::fromPath("IODeviceTree:/arm-io");
-	OSCollectionIterator * devices = IODTFindMatchingEntries(armIODeviceEntry, kIODTExclusive, 0);
-	OSSafeReleaseNULL(armIODeviceEntry);
-
-	if (devices == NULL) {
+	// Any count up to a full partition, as the first nodeCount ranks of the
+	// hypercube.
+	if (*nodeCount > kMaxCIOMeshNodes) {
+		LOG("Node count %d is more than a partition\n", *nodeCount);
 		return false;
 	}
 
-	devices->reset();
-
-	if (*nodeCount == kMaxCIOMeshNodes) {
-		canActivateMesh = _canActivate8(devices);
-	} else if (*nodeCount == 4) {
-		canActivateMesh = _canActivate4(devices);
-	} else if (*nodeCount == 2) {
-		canActivateMesh = _canActivate2(devices);
-	}
-
-	OSSafeReleaseNULL(devices);
-
-	LOG("canActivate in meshservice returning %d\n", canActivateMesh);
-	return canActivateMesh;
+	const MCUCI::MeshNodeMask nodeMask = AppleCIOMeshUtils::mesh_node_mask(*nodeCount);
+	return canActivateNodes(&nodeMask);
 }
 
 bool
-AppleCIOMeshService::_canActivate8(OSCollectionIterator * devices)
+AppleCIOMeshService::canActivateNodes(const MCUCI::MeshNodeMask * nodeMask)
 {
-	OSString * acioCompatible = OSString::withCString("acio");
-	uint8_t xdomainlinkcount  = 0;
-
-	// For 8 node ensembles, all 8 acio ports should have a thunderbolt link
-	while (auto device = (IORegistryEntry *)devices->getNextObject()) {
-		if (!strncmp(device->getName(), "acio", 4) && device->propertyHasValue("compatible", acioCompatible)) {
-			if (!_checkForXDomainLinkService(device)) {
-				LOG("%s failed to find xdomain link\n.", device->getName());
-				return false;
-			} else {
-				LOG("Found xdomain link for %s\n.", device->getName());
-				xdomainlinkcount += 1;
-			}
-		}
+	if (_meshConfig != kJ236Hypercube) {
+		panic("Only supported for kJ236Hypercube configuration");
 	}
 
-	OSSafeReleaseNULL(acioCompatible);
-
-	LOG("Found %d xdomain links\n.", xdomainlinkcount);
+	LOG("Node mask is 0x%x\n", *nodeMask);
 
-	return xdomainlinkcount == 8;
-}
+	// The ranks have to be of this partition and include this node. The links
+	// to ranks that aren't in the mesh go unused, but every node in it has to
+	// be able to get its data to every other.
+	if (*nodeMask == 0 || (*nodeMask >> AppleCIOMeshUtils::kMeshPartitionNodes) != 0) {
+		LOG("Node mask 0x%x is not of a partition\n", *nodeMask);
+		return false;
+	}
+	if (!AppleCIOMeshUtils::mesh_has_node(*nodeMask, _nodeId)) {
+		LOG("Node %d is not in the node mask 0x%x\n", _nodeId, *nodeMask);
+		return false;
+	}
+	if (*nodeMask == (1u << _nodeId)) {
+		return true;
+	}
+	if (!AppleCIOMeshUtils::mesh_routable(*nodeMask)) {
+		LOG("The nodes of node mask 0x%x are not all connected\n", *nodeMask);
+		return false;
+	}
 
-bool
-AppleCIOMeshService::_canActivate4(OSCollectionIterator * devices)
-{
-	OSString * acioCompatible = OSString::withCString("acio");
-	uint8_t xdomainlinkcount  = 0;
+	const uint32_t requiredLinks = AppleCIOMeshUtils::mesh_required_links(*nodeMask, _nodeId);
 
-	// For 4 node ensembles, all acio ports except 1 and 3 should have an x domain
-	// link.
-	while (auto device = (IORegistryEntry *)devices->getNextObject()) {
-		if (!strncmp(device->getName(), "acio", 4) && device->propertyHasValue("compatible", acioCompatible)) {
-			auto deviceName = device->getName();
-			int acioNumber  = deviceName[4] - '0';
+	bool canActivateMesh           = false;
+	auto armIODeviceEntry          = IORegistryEntry::fromPath("IODeviceTree:/arm-io");
+	OSCollectionIterator * devices = IODTFindMatchingEntries(armIODeviceEntry, kIODTExclusive, 0);
+	OSSafeReleaseNULL(armIODeviceEntry);
 
-			if (acioNumber != 1 && acioNumber != 3) {
-				if (!_checkForXDomainLinkService(device)) {
-					LOG("%s failed to find xdomain link\n.", device->getName());
-					return false;
-				} else {
-					LOG("Found xdomain link for %s\n.", device->getName());
-					xdomainlinkcount += 1;
-				}
-			}
-		}
+	if (devices == NULL) {
+		return false;
 	}
 
-	OSSafeReleaseNULL(acioCompatible);
+	devices->reset();
+	canActivateMesh = _canActivateLinks(devices, requiredLinks);
 
-	LOG("Found %d xdomain links\n.", xdomainlinkcount);
+	OSSafeReleaseNULL(devices);
 
-	return xdomainlinkcount == 6;
+	LOG("canActivate in meshservice returning %d\n", canActivateMesh);
+	return canActivateMesh;
 }
 
 bool
-AppleCIOMeshService::_canActivate2(OSCollectionIterator * devices)
+AppleCIOMeshService::_canActivateLinks(OSCollectionIterator * devices, uint32_t requiredLinks)
 {
 	OSString * acioCompatible = OSString::withCString("acio");
-	uint8_t xdomainlinkcount  = 0;
+	uint32_t xdomainlinks     = 0;
+	bool found                = true;
 
-	// For 2 node ensembles, acio ports 4 and 7 should have an x domain link.
+	// Every acio port with a node of the ensemble at the other end should have
+	// an x domain link. That is all 8 for 8 nodes, all but 1 and 3 (the A cable)
+	// for 4 and 4 and 7 for 2.
 	while (auto device = (IORegistryEntry *)devices->getNextObject()) {
 		if (!strncmp(device->getName(), "acio", 4) && device->propertyHasValue("compatible", acioCompatible)) {
 			auto deviceName = device->getName();
 			int acioNumber  = deviceName[4] - '0';
 
-			if (acioNumber == 4 || acioNumber == 7) {
+			if (acioNumber >= 0 && acioNumber < (int)AppleCIOMeshUtils::kMeshLinkCount &&
+			    (requiredLinks & (1u << acioNumber)) != 0) {
 				if (!_checkForXDomainLinkService(device)) {
 					LOG("%s failed to find xdomain link\n.", device->getName());
-					return false;
+					found = false;
+					break;
 				} else {
 					LOG("Found xdomain link for %s\n.", device->getName());
-					xdomainlinkcount += 1;
+					xdomainlinks |= 1u << acioNumber;
 				}
 			}
 		}
@@ -2182,9 +2270,9 @@ AppleCIOMeshService::_canActivate2(OSCollectionIterator * devices)
 
 	OSSafeReleaseNULL(acioCompatible);
 
-	LOG("Found %d xdomain links\n.", xdomainlinkcount);
+	LOG("Found %d of %d xdomain links\n.", __builtin_popcount(xdomainlinks), __builtin_popcount(requiredLinks));
 
-	return xdomainlinkcount == 2;
+	return found && xdomainlinks == requiredLinks;
 }
 
 bool
@@ -2321,9 +2409,7 @@ AppleCIOMeshService::startForwardChain(const MUCI::ForwardChainId forwardChainId
 		return kIOReturnIOError;
 	}
 
-	_forwarder->startForwardChain(forwardChainId, elements);
-
-	return kIOReturnSuccess;
+	return _forwarder->startForwardChain(forwardChainId, elements);
 }
 
 IOReturn
@@ -2339,57 +2425,116 @@ AppleCIOMeshService::forwarderFinishedClearingMemory()
 	atomic_store(&_forwarderFinishedRelease, true);
 }
 
-void
-AppleCIOMeshService::commandeerSend(
-    AppleCIOMeshSharedMemory * sm, int64_t offset, AppleCIOMeshUserClient * uc, char * tag, size_t tagSz)
+bool
+AppleCIOMeshService::_queueCommandeerWork(const AppleCIOMeshUtils::CommandeerWork & work)
 {
-	uint64_t ctr = 0;
-	while (atomic_load(&_commandeerSendData) && ctr < kMaxCommandeerWaitCount) {
-		// burn, baby burn (because we can't stomp on the work that it's currently doing)
-		ctr++;
-	}
+	uint64_t start = mach_absolute_time();
 
-	if (atomic_load(&_commandeerSendData)) {
-		panic("can't send while sending is going on SMSend bufId %lld / sm bufId %lld SMOffset 0x%llx offset 0x%llx ctr %llu!\n",
-		      _commandeerSMSend ? _commandeerSMSend->getId() : 0, sm->getId(), _commandeerSMSendOffset, offset, ctr);
+	while (!_commandeerQueue.push(work)) {
+		// The commandeer can't wait for itself to make room.
+		if (atomic_load(&_commandeerThread) == current_thread() || !atomic_load(&_commandeerActivated) ||
+		    mach_absolute_time() - start >= _maxWaitTime) {
+			ERROR("commandeer queue is full, dropping work type %d\n", work.type);
+			return false;
+		}
+		_wakeCommandeer();
 	}
 
-	sm->retain();
-	uc->retain();
+	if (_commandeerQueue.needsWake()) {
+		_wakeCommandeer();
+	}
+	return true;
+}
 
-	_commandeerSMSend         = sm;
-	_commandeerSMSendOffset   = offset;
-	_commandeerSendUserClient = uc;
-	_commandeerSendTag        = tag;
-	_commandeerSendTagSz      = tagSz;
-	_commanderSMSendStart     = mach_absolute_time();
-	_commanderSMSendCounter   = 0;
-	atomic_store(&_commandeerSendData, true);
+void
+AppleCIOMeshService::_wakeCommandeer()
+{
+	// Taking the lock means the commandeer is either asleep or has not
+	// checked for work yet.
+	IOLockLock(_commandeerLock);
+	IOLockWakeup(_commandeerLock, &_commandeerQueue, true);
+	IOLockUnlock(_commandeerLock);
 }
 
 void
-AppleCIOMeshService::commandeerDripPrepare(AppleCIOMeshSharedMemory * sm, int64_t offset, AppleCIOMeshSharedMemory * sendingSM)
+AppleCIOMeshService::_parkCommandeer()
 {
-	uint64_t ctr = 0;
-	while (atomic_load(&_commandeerPrepareData) && ctr < kMaxCommandeerWaitCount) {
-		// burn, baby burn (because we can't stomp on the work that it's currently doing)
-		ctr++;
+	AbsoluteTime deadline;
+
+	IOLockLock(_commandeerLock);
+	_commandeerQueue.beginPark();
+	if (_commandeerQueue.empty() && atomic_load(&_commandeerForwardAction) == 0 &&
+	    atomic_load(&_commandeerPendingPrepares) == 0 && atomic_load(&_commandeerActivated)) {
+		// The timeout is only a safety net, every producer wakes us.
+		clock_interval_to_deadline(kCommandeerParkTimeoutMs, kMillisecondScale, &deadline);
+		IOLockSleepDeadline(_commandeerLock, &_commandeerQueue, deadline, THREAD_UNINT);
 	}
+	_commandeerQueue.endPark();
+	IOLockUnlock(_commandeerLock);
+}
 
-	if (atomic_load(&_commandeerPrepareData)) {
-		panic(
-		    "can't prepare while preparing is going on SMPrepare bufId %lld / sm bufId %lld SMOffset 0x%llx offset 0x%llx ctr "
-		    "%llu!\n",
-		    _commandeerSMPrepare ? _commandeerSMPrepare->getId() : 0, sm->getId(), _commandeerSMPrepareOffset, offset, ctr);
+void
+AppleCIOMeshService::_runCommandeerWork(const AppleCIOMeshUtils::CommandeerWork & work)
+{
+	switch (work.type) {
+	case AppleCIOMeshUtils::kCommandeerSend:
+		if (!atomic_load(&_commandeerSendData)) {
+			_startCommandeerSend(work);
+		} else {
+			// commandeerSend lets only one wait behind the running one.
+			_commandeerDeferredSend    = work;
+			_commandeerHasDeferredSend = true;
+		}
+		break;
+	case AppleCIOMeshUtils::kCommandeerDripPrepare:
+		if (!atomic_load(&_commandeerPrepareData)) {
+			_startCommandeerDripPrepare(work);
+		} else {
+			// commandeerDripPrepare lets only one wait behind the running one.
+			_commandeerDeferredDripPrepare    = work;
+			_commandeerHasDeferredDripPrepare = true;
+		}
+		break;
+	case AppleCIOMeshUtils::kCommandeerBulkPrepare: {
+		// Just prepare 1 assignment at a time.
+		((AppleCIOMeshAssignment *)work.object)->prepare(work.link == 0 ? 0x1 : 0x2);
+
+		auto nodeMap = (NodeAssignmentMap *)work.other;
+		atomic_fetch_add(&nodeMap->linkPreparedIdx[work.link], 1);
+		nodeMap->dripController[work.link].recordPrepared(mach_absolute_time() - (uint64_t)work.offset);
+		break;
 	}
+	case AppleCIOMeshUtils::kCommandeerForwardPrepare:
+		_forwarder->prepareChainElement((ForwardActionChainElement *)work.object);
+		break;
+	default:
+		panic("unknown commandeer work type %d\n", work.type);
+	}
+}
 
-	sm->retain();
-	sendingSM->retain();
+void
+AppleCIOMeshService::_startCommandeerSend(const AppleCIOMeshUtils::CommandeerWork & work)
+{
+	// commandeerSend took the references.
+	_commandeerSMSend         = (AppleCIOMeshSharedMemory *)work.object;
+	_commandeerSMSendOffset   = work.offset;
+	_commandeerSendUserClient = (AppleCIOMeshUserClient *)work.owner;
+	memcpy(_commandeerSendTags, work.tags, work.tagSize);
+	_commandeerSendTag      = _commandeerSendTags;
+	_commandeerSendTagSz    = work.tagSize;
+	_commanderSMSendStart   = mach_absolute_time();
+	_commanderSMSendCounter = 0;
+	atomic_store(&_commandeerSendData, true);
+}
 
-	_commandeerSMPrepare                = sm;
-	_commandeerPreparePreviousSM        = sendingSM;
+void
+AppleCIOMeshService::_startCommandeerDripPrepare(const AppleCIOMeshUtils::CommandeerWork & work)
+{
+	// commandeerDripPrepare took the references.
+	_commandeerSMPrepare                = (AppleCIOMeshSharedMemory *)work.object;
+	_commandeerPreparePreviousSM        = (AppleCIOMeshSharedMemory *)work.other;
 	_commandeerPreparePreviousComplete  = false;
-	_commandeerSMPrepareOffset          = offset;
+	_commandeerSMPrepareOffset          = work.offset;
 	_commandeerPrepareDripAssignmentIdx = 0;
 	_commandeerPrepareDripOffsetIdx     = 0;
 	_commandeerPrepareDripLinkIdx       = 0;
@@ -2397,30 +2542,197 @@ AppleCIOMeshService::commandeerDripPrepare(AppleCIOMeshSharedMemory * sm, int64_
 	atomic_store(&_commandeerPrepareData, true);
 }
 
+// Drops the references commandeerSend and commandeerDripPrepare took for work
+// that will never run.
 void
-AppleCIOMeshService::commandeerBulkPrepare(AppleCIOMeshAssignment * assignment, uint8_t linkIdx)
+AppleCIOMeshService::_releaseCommandeerWork(const AppleCIOMeshUtils::CommandeerWork & work)
 {
-	if (linkIdx == 0) {
-		_commandeerPrepareAssignmentQueue0->add((uintptr_t)assignment);
-	} else {
-		_commandeerPrepareAssignmentQueue1->add((uintptr_t)assignment);
+	if (work.type == AppleCIOMeshUtils::kCommandeerSend) {
+		((AppleCIOMeshSharedMemory *)work.object)->release();
+		((AppleCIOMeshUserClient *)work.owner)->release();
+		atomic_fetch_sub(&_commandeerSendsTaken, 1);
+	} else if (work.type == AppleCIOMeshUtils::kCommandeerDripPrepare) {
+		((AppleCIOMeshSharedMemory *)work.object)->release();
+		((AppleCIOMeshSharedMemory *)work.other)->release();
+		atomic_fetch_sub(&_commandeerDripPreparesTaken, 1);
+	}
+}
+
+void
+AppleCIOMeshService::_finishCommandeerSend()
+{
+	OSSafeReleaseNULL(_commandeerSMSend);
+	OSSafeReleaseNULL(_commandeerSendUserClient);
+	atomic_store(&_commandeerSendData, false);
+	atomic_fetch_sub(&_commandeerSendsTaken, 1);
+}
+
+void
+AppleCIOMeshService::_finishCommandeerDripPrepare()
+{
+	OSSafeReleaseNULL(_commandeerPreparePreviousSM);
+	OSSafeReleaseNULL(_commandeerSMPrepare);
+	atomic_store(&_commandeerPrepareData, false);
+	atomic_fetch_sub(&_commandeerDripPreparesTaken, 1);
+}
+
+// Takes one of the slots limit allows, the one running and the one deferred.
+static bool
+takeCommandeerSlot(_Atomic(uint32_t) * taken, uint32_t limit)
+{
+	uint32_t current = atomic_load(taken);
+	do {
+		if (current >= limit) {
+			return false;
+		}
+	} while (!atomic_compare_exchange_weak(taken, &current, current + 1));
+	return true;
+}
+
+void
+AppleCIOMeshService::_dropCommandeerWork()
+{
+	AppleCIOMeshUtils::CommandeerWork work;
+
+	if (atomic_load(&_commandeerSendData)) {
+		_finishCommandeerSend();
+	}
+	if (atomic_load(&_commandeerPrepareData)) {
+		_finishCommandeerDripPrepare();
+	}
+	if (_commandeerHasDeferredSend) {
+		_releaseCommandeerWork(_commandeerDeferredSend);
+		_commandeerHasDeferredSend = false;
+	}
+	if (_commandeerHasDeferredDripPrepare) {
+		_releaseCommandeerWork(_commandeerDeferredDripPrepare);
+		_commandeerHasDeferredDripPrepare = false;
+	}
+
+	while (_commandeerQueue.pop(&work, 1) == 1) {
+		_releaseCommandeerWork(work);
+	}
+
+	// These hold no references, just take them off the list.
+	uintptr_t entry = atomic_exchange(&_commandeerPendingPrepares, (uintptr_t)0);
+	while (entry != 0) {
+		auto nodeMap = (NodeAssignmentMap *)(entry & ~kPendingPrepareLinkMask);
+		auto linkIdx = (uint8_t)(entry & kPendingPrepareLinkMask);
+		entry        = nodeMap->linkPendingNext[linkIdx];
+		atomic_store(&nodeMap->linkPendingPrepare[linkIdx], false);
 	}
 }
 
+IOReturn
+AppleCIOMeshService::commandeerSend(
+    AppleCIOMeshSharedMemory * sm, int64_t offset, AppleCIOMeshUserClient * uc, char * tag, size_t tagSz)
+{
+	AppleCIOMeshUtils::CommandeerWork work = {};
+
+	if (tagSz > sizeof(work.tags)) {
+		ERROR("commandeer send tags are too big %zu\n", tagSz);
+		return kIOReturnBadArgument;
+	}
+	if (!takeCommandeerSlot(&_commandeerSendsTaken, kCommandeerSlots)) {
+		return kIOReturnBusy;
+	}
+
+	sm->retain();
+	uc->retain();
+
+	work.type    = AppleCIOMeshUtils::kCommandeerSend;
+	work.object  = (uintptr_t)sm;
+	work.owner   = (uintptr_t)uc;
+	work.offset  = offset;
+	work.tagSize = (uint32_t)tagSz;
+	memcpy(work.tags, tag, tagSz);
+
+	if (!_queueCommandeerWork(work)) {
+		_releaseCommandeerWork(work);
+		return kIOReturnNoResources;
+	}
+	return kIOReturnSuccess;
+}
+
+IOReturn
+AppleCIOMeshService::commandeerDripPrepare(AppleCIOMeshSharedMemory * sm, int64_t offset, AppleCIOMeshSharedMemory * sendingSM)
+{
+	AppleCIOMeshUtils::CommandeerWork work = {};
+
+	if (!takeCommandeerSlot(&_commandeerDripPreparesTaken, kCommandeerSlots)) {
+		return kIOReturnBusy;
+	}
+
+	sm->retain();
+	sendingSM->retain();
+
+	work.type   = AppleCIOMeshUtils::kCommandeerDripPrepare;
+	work.object = (uintptr_t)sm;
+	work.other  = (uintptr_t)sendingSM;
+	work.offset = offset;
+
+	if (!_queueCommandeerWork(work)) {
+		_releaseCommandeerWork(work);
+		return kIOReturnNoResources;
+	}
+	return kIOReturnSuccess;
+}
+
+void
+AppleCIOMeshService::commandeerBulkPrepare(AppleCIOMeshAssignment * assignment, NodeAssignmentMap * nodeMap, uint8_t linkIdx)
+{
+	AppleCIOMeshUtils::CommandeerWork work = {};
+
+	work.type   = AppleCIOMeshUtils::kCommandeerBulkPrepare;
+	work.object = (uintptr_t)assignment;
+	work.other  = (uintptr_t)nodeMap;
+	work.offset = (int64_t)mach_absolute_time();
+	work.link   = linkIdx;
+	_queueCommandeerWork(work);
+}
+
 void
 AppleCIOMeshService::commandeerPendingPrepare(NodeAssignmentMap * nodeMap, uint8_t linkIdx)
 {
-	if (linkIdx == 0) {
-		_commandeerPendingPrepareQueue0->add((uintptr_t)nodeMap);
-	} else {
-		_commandeerPendingPrepareQueue1->add((uintptr_t)nodeMap);
+	// Already waiting, the commandeer checks it again anyway.
+	if (atomic_exchange(&nodeMap->linkPendingPrepare[linkIdx], true)) {
+		return;
+	}
+
+	uintptr_t entry = (uintptr_t)nodeMap | linkIdx;
+	uintptr_t head  = atomic_load(&_commandeerPendingPrepares);
+	do {
+		nodeMap->linkPendingNext[linkIdx] = head;
+	} while (!atomic_compare_exchange_weak(&_commandeerPendingPrepares, &head, entry));
+
+	if (_commandeerQueue.needsWake()) {
+		_wakeCommandeer();
+	}
+}
+
+void
+AppleCIOMeshService::_runPendingPrepares()
+{
+	// Take the whole list, anything that is still not allowed to prepare puts
+	// itself back for the next time round.
+	uintptr_t entry = atomic_exchange(&_commandeerPendingPrepares, (uintptr_t)0);
+	while (entry != 0) {
+		auto nodeMap = (NodeAssignmentMap *)(entry & ~kPendingPrepareLinkMask);
+		auto linkIdx = (uint8_t)(entry & kPendingPrepareLinkMask);
+		entry        = nodeMap->linkPendingNext[linkIdx];
+		atomic_store(&nodeMap->linkPendingPrepare[linkIdx], false);
+		_commandeerLoopPendingCheck(nodeMap, linkIdx);
 	}
 }
 
 void
 AppleCIOMeshService::commandeerPrepareForwardElement(ForwardActionChainElement * chainElement)
 {
-	_commandeerForwardPrepareQueue->add((uintptr_t)chainElement);
+	AppleCIOMeshUtils::CommandeerWork work = {};
+
+	work.type   = AppleCIOMeshUtils::kCommandeerForwardPrepare;
+	work.object = (uintptr_t)chainElement;
+	_queueCommandeerWork(work);
 }
 
 bool
@@ -2428,7 +2740,13 @@ AppleCIOMeshService::commandeerForwardHelp(ForwardAction * action)
 {
 	uintptr_t expected = 0;
 
-	return atomic_compare_exchange_strong(&_commandeerForwardAction, &expected, (uintptr_t)action);
+	if (!atomic_compare_exchange_strong(&_commandeerForwardAction, &expected, (uintptr_t)action)) {
+		return false;
+	}
+	if (_commandeerQueue.needsWake()) {
+		_wakeCommandeer();
+	}
+	return true;
 }
 
 void
@@ -2595,8 +2913,9 @@ AppleCIOMeshService::_allocateSharedMemoryUCGated(void * sharedMemoryArg, void *
 	const task_t owningTask     = (const task_t)taskArg;
 	AppleCIOMeshUserClient * uc = (AppleCIOMeshUserClient *)ucArg;
 
-	if (memory->bufferId == 0) {
-		LOG("Can't create a buffer with Id zero.\n");
+	// The index keeps 0 and kTombstone for empty and removed slots.
+	if (memory->bufferId == 0 || memory->bufferId == decltype(_sharedMemoryIndex)::kTombstone) {
+		LOG("Can't create a buffer with reserved Id %lld.\n", memory->bufferId);
 		return kIOReturnBadArgument;
 	}
 
@@ -2659,7 +2978,20 @@ AppleCIOMeshService::_allocateSharedMemoryUCGated(void * sharedMemoryArg, void *
 		}
 	}
 
+	// The id was checked above, on the work loop every allocation runs on, so
+	// the index can only fail here for want of a bigger table.
 	_sharedMemoryRegions->setObject(sm);
+	if (!_sharedMemoryIndex.insert(memory->bufferId, sm)) {
+		LOG("Failed to grow the shared memory index for %lld\n", memory->bufferId);
+		_sharedMemoryRegions->removeObject(_sharedMemoryRegions->getCount() - 1);
+		OSSafeReleaseNULL(sm);
+		if (_sharedMemoryRegions->getCount() == 0) {
+			_stopThreadsUCGated();
+		}
+
+		IOLockUnlock(_ucLock);
+		return kIOReturnNoMemory;
+	}
 
 	OSSafeReleaseNULL(sm); // because the array retains it
 
@@ -2731,6 +3063,7 @@ AppleCIOMeshService::_setForwardChainUCGated(void * forwardChainArg, void * forw
 	for (int i = 0; i < _linksPerChannel; i++) {
 		MUCI::ForwardChainId tmp;
 		AppleCIOForwardChain * newChain = _forwarder->createForwardChain(&tmp);
+		RETURN_IF_NULL(newChain, kIOReturnNoResources, "create forward chain for link %d", i);
 
 		for (MUCI::BufferId buffer = forwardChain->startBufferId; buffer <= forwardChain->endBufferId; buffer++) {
 			auto sm = getSharedMemory(buffer);
@@ -2745,7 +3078,8 @@ AppleCIOMeshService::_setForwardChainUCGated(void * forwardChainArg, void * forw
 				for (int64_t offset = sectionStart; offset <= sectionEnd; offset += (sm->getChunkSize() * _linksPerChannel)) {
 					int64_t realOffset = offset + (i * sm->getChunkSize());
 
-					_forwarder->addToForwardChain(tmp, buffer, realOffset, i);
+					IOReturn ret = _forwarder->addToForwardChain(tmp, buffer, realOffset, i);
+					RETURN_IF_FAIL(ret, ret, "add to forward chain");
 				}
 
 				sectionStart = (sectionStart + forwardChain->sectionOffset) % sm->getSize();
@@ -2760,7 +3094,8 @@ AppleCIOMeshService::_setForwardChainUCGated(void * forwardChainArg, void * forw
 				auto startOffset = forwardChain->startOffset + (i * sm->getChunkSize());
 				auto endOffset   = forwardChain->endOffset + (i * sm->getChunkSize());
 
-				_forwarder->groupChainElements(tmp, buffer, forwardChain, sm->getSize());
+				IOReturn ret = _forwarder->groupChainElements(tmp, buffer, forwardChain, sm->getSize());
+				RETURN_IF_FAIL(ret, ret, "group forward chain elements");
 			}
 		}
 
@@ -3126,7 +3461,8 @@ AppleCIOMeshService::_assignOutputMemory(const MUCI::AssignChunks * assignment)
 				auto rxCommand =
 				    sharedMem->getReceiveCommand((uint8_t)txDataCommand->getProvider()->getAssignedInputLink(), offset);
 
-				_addForwardingCommand(txDataCommand, rxCommand, assignedSource);
+				IOReturn ret = _addForwardingCommand(txDataCommand, rxCommand, assignedSource);
+				RETURN_IF_FAIL(ret, ret, "add forwarding command");
 
 				// First, all the TX commands that will be forwarded need to send back
 				// flow control information to the forwarder (except the last one)
@@ -3169,14 +3505,14 @@ AppleCIOMeshService::_dripPrepareBuffer(AppleCIOMeshSharedMemory * sm,
 	return kIOReturnStillOpen;
 }
 
-void
+IOReturn
 AppleCIOMeshService::_addForwardingCommand(AppleCIOMeshTransmitCommand * transmitCommand,
                                            AppleCIOMeshReceiveCommand * receiveCommand,
                                            MCUCI::NodeId sourceNode)
 {
 	assertf(transmitCommand->getMeshLink() != receiveCommand->getMeshLink(), "forwardTX link == forwardRX link");
 
-	_forwarder->addForwardingAction(transmitCommand, receiveCommand, sourceNode);
+	return _forwarder->addForwardingAction(transmitCommand, receiveCommand, sourceNode);
 }
 
 IOService *
@@ -3844,6 +4180,7 @@ AppleCIOMeshService::_freeSharedMemoryUCGated(int64_t bufferId)
 		}
 
 		LOG("deallocating memory region w/bufferId %lld w/retain count %d\n", bufferId, sm->getRetainCount());
+		_sharedMemoryIndex.remove(bufferId);
 		_sharedMemoryRegions->removeObject((unsigned int)i);
 
 		if (_sharedMemoryRegions->getCount() == 0) {
@@ -32,7 +32,11 @@
 #include "AppleCIOMeshHardwarePlatform.h"
 #include "AppleCIOMeshPtrQueue.h"
 #include "AppleCIOMeshUserClientInterface.h"
+#include "Common/BufferIndex.h"
+#include "Common/CoalescingPolicy.h"
+#include "Common/CommandeerQueue.h"
 #include "Common/Config.h"
+#include "Common/MeshTopology.h"
 
 namespace MUCI  = AppleCIOMeshUserClientInterface;
 namespace MCUCI = AppleCIOMeshConfigUserClientInterface;
@@ -54,6 +58,40 @@ struct ForwardAction;
 struct ForwardActionChainElement;
 struct NodeAssignmentMap;
 
+// Zeroed tables for the shared memory index.
+struct SharedMemoryIndexAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		return IONewZero(U, count);
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t count)
+	{
+		IODelete(memory, U, count);
+	}
+};
+
+// Zeroed cells for the commandeer's work queue.
+struct CommandeerQueueAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		return IONewZero(U, count);
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t count)
+	{
+		IODelete(memory, U, count);
+	}
+};
+
 typedef struct {
 	uint64_t key[4];
 } __attribute__((packed)) AppleCIOMeshCryptoKey;
@@ -101,6 +139,8 @@ class AppleCIOMeshService : public IOService
 	bool isActive();
 
 	bool acioDisabled(uint8_t acio);
+	void getPathSizing(uint8_t acio, AppleCIOMeshUtils::RingSizing & txSizing, AppleCIOMeshUtils::RingSizing & rxSizing);
+	uint64_t getLinkQueueBytes(uint8_t channelLinkIdx);
 	void populateHardwareConfig();
 	void populatePartnerMap();
 	void dumpCommandeerState();
@@ -151,9 +191,11 @@ class AppleCIOMeshService : public IOService
 
 	IOReturn setMaxWaitTime(uint64_t maxWaitTime); // in mach_absolute_time() units
 
-	void commandeerSend(AppleCIOMeshSharedMemory * sm, int64_t offset, AppleCIOMeshUserClient * uc, char * tag, size_t tagSz);
-	void commandeerDripPrepare(AppleCIOMeshSharedMemory * sm, int64_t offset, AppleCIOMeshSharedMemory * sendingSM);
-	void commandeerBulkPrepare(AppleCIOMeshAssignment * assignment, uint8_t linkIdx);
+	// Both return kIOReturnBusy when one is running and another already waits
+	// behind it, kIOReturnNoResources when the commandeer can't take the work.
+	IOReturn commandeerSend(AppleCIOMeshSharedMemory * sm, int64_t offset, AppleCIOMeshUserClient * uc, char * tag, size_t tagSz);
+	IOReturn commandeerDripPrepare(AppleCIOMeshSharedMemory * sm, int64_t offset, AppleCIOMeshSharedMemory * sendingSM);
+	void commandeerBulkPrepare(AppleCIOMeshAssignment * assignment, NodeAssignmentMap * nodeMap, uint8_t linkIdx);
 	void commandeerPendingPrepare(NodeAssignmentMap * nodeMap, uint8_t linkIdx);
 	void commandeerPrepareForwardElement(ForwardActionChainElement * chainElement);
 	// Returns if the commandeer is able to do this or not.
@@ -186,6 +228,7 @@ class AppleCIOMeshService : public IOService
 	void setCryptoFlags(MCUCI::CryptoFlags flags);
 	IOReturn getBuffersAllocatedCounter(uint64_t * buffersAllocated);
 	bool canActivate(const MCUCI::MeshNodeCount * nodeCount);
+	bool canActivateNodes(const MCUCI::MeshNodeMask * nodeMask);
 
   private:
 	IOReturn _allocateSharedMemoryUCGated(void * sharedMemoryArg, void * taskArg, void * ucArg);
@@ -236,9 +279,9 @@ class AppleCIOMeshService : public IOService
 	void _requestNodeIdentification(IOTimerEventSource * timer);
 	IOReturn _assignLinkToPartnerNodeGated(AppleCIOMeshLink * link);
 	IOReturn _meshControlCommandHandler(IOInterruptEventSource * sender, int count);
-	void _addForwardingCommand(AppleCIOMeshTransmitCommand * transmitCommand,
-	                           AppleCIOMeshReceiveCommand * receiveCommand,
-	                           MCUCI::NodeId sourceNode);
+	IOReturn _addForwardingCommand(AppleCIOMeshTransmitCommand * transmitCommand,
+	                               AppleCIOMeshReceiveCommand * receiveCommand,
+	                               MCUCI::NodeId sourceNode);
 	IOService * _resolvePHandle(const char * key, const char * className);
 
 	int _freeSharedMemoryUCGated(int64_t bufferId);
@@ -274,6 +317,11 @@ class AppleCIOMeshService : public IOService
 
 	OSBoundedArray<bool, kMaxMeshLinkCount> _meshLinksLocked;
 	OSBoundedArray<AppleCIOMeshLink *, kMaxMeshLinkCount> _meshLinks;
+
+	// What each acio's data paths carried, sizes their rings when the link
+	// is next created. Completions record into them without a lock.
+	OSBoundedArray<AppleCIOMeshUtils::CoalescingPolicy, kMaxMeshLinkCount> _txCoalescing;
+	OSBoundedArray<AppleCIOMeshUtils::CoalescingPolicy, kMaxMeshLinkCount> _rxCoalescing;
 	OSBoundedArray<AppleCIOMeshChannel *, kMaxMeshChannelCount> _meshChannels;
 	uint8_t _channelCount;
 
@@ -287,6 +335,9 @@ class AppleCIOMeshService : public IOService
 	IOWorkLoop * _workloop;
 
 	OSArray * _sharedMemoryRegions;
+	// Finds _sharedMemoryRegions by bufferId without a scan. Updated under
+	// _ucLock, looked up without it.
+	AppleCIOMeshUtils::BufferIndex<AppleCIOMeshSharedMemory, SharedMemoryIndexAllocator> _sharedMemoryIndex;
 
 	MCUCI::NodeId _nodeId;
 	MCUCI::PartitionIdx _partitionIdx;
@@ -307,8 +358,20 @@ class AppleCIOMeshService : public IOService
 	IOLock * _forwarderLock; // taken when a UserClient registers and released when it unregisters
 	_Atomic(bool) _forwarderFinishedRelease;
 
+	void _recordPathTraffic(uint8_t acio, bool transmit, int64_t bytes);
 	void _commandeerLoopPendingCheck(NodeAssignmentMap * nodeMap, uint8_t linkIdx);
 	IOReturn _commandeerLoop(IOInterruptEventSource * sender, int count);
+	bool _queueCommandeerWork(const AppleCIOMeshUtils::CommandeerWork & work);
+	void _wakeCommandeer();
+	void _parkCommandeer();
+	void _runCommandeerWork(const AppleCIOMeshUtils::CommandeerWork & work);
+	void _startCommandeerSend(const AppleCIOMeshUtils::CommandeerWork & work);
+	void _startCommandeerDripPrepare(const AppleCIOMeshUtils::CommandeerWork & work);
+	void _runPendingPrepares();
+	void _finishCommandeerSend();
+	void _finishCommandeerDripPrepare();
+	void _releaseCommandeerWork(const AppleCIOMeshUtils::CommandeerWork & work);
+	void _dropCommandeerWork();
 	IOWorkLoop * _commandeerWorkloop;
 	IOInterruptEventSource * _commandeerEventSource;
 	_Atomic(bool) _commandeerActivated;
@@ -324,6 +387,7 @@ class AppleCIOMeshService : public IOService
 	uint64_t _commanderSMSendStart;
 	char * _commandeerSendTag;
 	size_t _commandeerSendTagSz;
+	char _commandeerSendTags[AppleCIOMeshUtils::kCommandeerTagBytes];
 	uint64_t _commanderSMSendCounter;
 	// Commandeer Drip Prepare
 	AppleCIOMeshSharedMemory * _commandeerSMPrepare;
@@ -335,13 +399,25 @@ class AppleCIOMeshService : public IOService
 	int64_t _commandeerPrepareDripLinkIdx;
 	// Commandeer Forward
 	_Atomic(uintptr_t) _commandeerForwardAction;
-	// Commandeer bulk prepare queue -- this should really be 1 queue
-	// but assignment groups up both link unfortunately.
-	AppleCIOMeshPtrQueue * _commandeerPrepareAssignmentQueue0;
-	AppleCIOMeshPtrQueue * _commandeerPendingPrepareQueue0;
-	AppleCIOMeshPtrQueue * _commandeerPrepareAssignmentQueue1;
-	AppleCIOMeshPtrQueue * _commandeerPendingPrepareQueue1;
-	AppleCIOMeshPtrQueue * _commandeerForwardPrepareQueue;
+	// Everything else the commandeer is asked to do. It parks on
+	// _commandeerLock when the queue is empty and nothing above is going on.
+	AppleCIOMeshUtils::CommandeerQueue<CommandeerQueueAllocator> _commandeerQueue;
+	IOLock * _commandeerLock;
+	_Atomic(thread_t) _commandeerThread;
+	// A send or drip prepare that arrived while the last one was still going.
+	AppleCIOMeshUtils::CommandeerWork _commandeerDeferredSend;
+	AppleCIOMeshUtils::CommandeerWork _commandeerDeferredDripPrepare;
+	bool _commandeerHasDeferredSend;
+	bool _commandeerHasDeferredDripPrepare;
+	// Sends and drip prepares taken by commandeerSend and commandeerDripPrepare
+	// and not finished yet, queued, deferred or running.
+	_Atomic(uint32_t) _commandeerSendsTaken;
+	_Atomic(uint32_t) _commandeerDripPreparesTaken;
+	// Node assignment map links waiting for runtime prepares to be allowed
+	// again, linked through NodeAssignmentMap::linkPendingNext. Each entry is
+	// the map's address with the link index in the low bits. Kept off the
+	// queue so a full queue can't lose them.
+	_Atomic(uintptr_t) _commandeerPendingPrepares;
 
 	AppleCIOMeshHardwareConfig _hardwareConfig;
 	uint8_t _meshConfig;
@@ -363,7 +439,5 @@ class AppleCIOMeshService : public IOService
 	MCUCI::CryptoFlags _userCryptoFlags;
 
 	bool _checkForXDomainLinkService(IORegistryEntry * reg);
-	bool _canActivate2(OSCollectionIterator * devices);
-	bool _canActivate4(OSCollectionIterator * devices);
-	bool _canActivate8(OSCollectionIterator * devices);
+	bool _canActivateLinks(OSCollectionIterator * devices, uint32_t requiredLinks);
 };
@@ -145,6 +145,16 @@ AppleCIOMeshSharedMemory::initialize(AppleCIOMeshService * service,
 		}
 	}
 
+	{
+		AppleCIOMeshUtils::DripPreparePolicy dripPolicy;
+		dripPolicy.minDepth    = kDripPrepareMinDepth;
+		dripPolicy.maxBoost    = kDripPrepareMaxBoost;
+		dripPolicy.calmReadies = kDripPrepareCalmReadies;
+		nanoseconds_to_absolutetime(kDripPrepareIdleGapNs, &dripPolicy.idleGap);
+		_receiveAssignments.initDripPrepare(dripPolicy);
+		_outputAssignments.initDripPrepare(dripPolicy);
+	}
+
 	_forwardChains = OSArray::withCapacity(10);
 	if (_forwardChains == nullptr) {
 		LOG("Failed to allocate _forwardChains\n");
@@ -438,8 +448,9 @@ AppleCIOMeshSharedMemory::createAssignment(int64_t offset, MUCI::MeshDirection d
 
 		if (checkAssignment->getDirection() == MUCI::MeshDirection::In && direction == MUCI::MeshDirection::Out) {
 			// This is a forward
-			if (!_receiveAssignments.startingIdxSet) {
-				_receiveAssignments.startingIdx    = _receiveAssignments.getIdxForOffset(offset);
+			auto idx = _receiveAssignments.getIdxForOffset(offset);
+			if (!_receiveAssignments.startingIdxSet && idx != AppleCIOMeshUtils::kAssignmentNotFound) {
+				_receiveAssignments.startingIdx    = idx;
 				_receiveAssignments.startingIdxSet = true;
 			}
 		} else {
@@ -449,13 +460,12 @@ AppleCIOMeshSharedMemory::createAssignment(int64_t offset, MUCI::MeshDirection d
 		return false;
 	}
 
-	// We need to check for boundaries before allocating
-	// the new object and replacing the old one
-	auto assignmentCount =
-	    direction == MUCI::MeshDirection::In ? _receiveAssignments.assignmentCount : _outputAssignments.assignmentCount;
-	if (assignmentCount >= kMaxAssignmentCount) {
-		ERROR("Maximum number of %s assignments reached (%d)", direction == MUCI::MeshDirection::In ? "input" : "output",
-		      assignmentCount);
+	// We need to make room in the map before allocating the new object and
+	// replacing the old one. Receive has an entry per link.
+	auto assignmentMap = direction == MUCI::MeshDirection::In ? &_receiveAssignments : &_outputAssignments;
+	if (!assignmentMap->reserve(node, direction == MUCI::MeshDirection::In ? _service->getLinksPerChannel() : 1)) {
+		ERROR("Could not grow the %s assignments past %d", direction == MUCI::MeshDirection::In ? "input" : "output",
+		      assignmentMap->assignmentCount);
 		return false;
 	}
 
@@ -467,40 +477,29 @@ AppleCIOMeshSharedMemory::createAssignment(int64_t offset, MUCI::MeshDirection d
 	if (direction == MUCI::MeshDirection::In) {
 		newAssignment->setRXAssignedNode(node);
 
-		_receiveAssignments.assignedNode[_receiveAssignments.assignmentCount]     = node;
-		_receiveAssignments.assignmentOffset[_receiveAssignments.assignmentCount] = offset;
-		_receiveAssignments.assignmentReady[_receiveAssignments.assignmentCount]  = false;
-		_receiveAssignments.linkIdx[_receiveAssignments.assignmentCount]          = 0;
-		_receiveAssignments.addAssignmentForNode(node, _receiveAssignments.assignmentCount);
-		_receiveAssignments.addLinkAssignmentForNode(node, _receiveAssignments.assignmentCount, 0);
-		_receiveAssignments.assignmentCount++;
+		auto idx = _receiveAssignments.addAssignment(offset, node, 0);
+		_receiveAssignments.addAssignmentForNode(node, idx);
+		_receiveAssignments.addLinkAssignmentForNode(node, idx, 0);
 
 		atomic_fetch_add(&_receiveAssignments.remainingAssignments, 1);
 
 		if (_service->getLinksPerChannel() == 2) {
 			// add the second link for receive
-			_receiveAssignments.assignedNode[_receiveAssignments.assignmentCount]     = node;
-			_receiveAssignments.assignmentOffset[_receiveAssignments.assignmentCount] = offset;
-			_receiveAssignments.assignmentReady[_receiveAssignments.assignmentCount]  = false;
-			_receiveAssignments.linkIdx[_receiveAssignments.assignmentCount]          = 1;
-			_receiveAssignments.addAssignmentForNode(node, _receiveAssignments.assignmentCount);
-			_receiveAssignments.addLinkAssignmentForNode(node, _receiveAssignments.assignmentCount, 1);
-			_receiveAssignments.assignmentCount++;
+			idx = _receiveAssignments.addAssignment(offset, node, 1);
+			_receiveAssignments.addAssignmentForNode(node, idx);
+			_receiveAssignments.addLinkAssignmentForNode(node, idx, 1);
 
 			atomic_fetch_add(&_receiveAssignments.remainingAssignments, 1);
 		}
 	} else {
-		_outputAssignments.assignedNode[_outputAssignments.assignmentCount]     = node;
-		_outputAssignments.assignmentOffset[_outputAssignments.assignmentCount] = offset;
-		_outputAssignments.addAssignmentForNode(node, _outputAssignments.assignmentCount);
+		auto idx = _outputAssignments.addAssignment(offset, node, 0);
+		_outputAssignments.addAssignmentForNode(node, idx);
 
-		_outputAssignments.addLinkAssignmentForNode(node, _outputAssignments.assignmentCount, 0);
+		_outputAssignments.addLinkAssignmentForNode(node, idx, 0);
 		if (_service->getLinksPerChannel() == 2) {
-			_outputAssignments.addLinkAssignmentForNode(node, _outputAssignments.assignmentCount, 1);
+			_outputAssignments.addLinkAssignmentForNode(node, idx, 1);
 		}
 
-		_outputAssignments.assignmentCount++;
-
 		atomic_fetch_add(&_outputAssignments.remainingAssignments, 1);
 	}
 
@@ -508,12 +507,14 @@ AppleCIOMeshSharedMemory::createAssignment(int64_t offset, MUCI::MeshDirection d
 	OSSafeReleaseNULL(newAssignment); // because the array retains it
 
 	// Add this assignment for this node, if this node is now going to be
-	// transferring more than the NHI queue size per link, the driver is going
-	// to have to only prepare a partial transfer and then start managing
-	// things a bit more.
+	// transferring more than a link's rings hold, the driver is going to have
+	// to only prepare a partial transfer and then start managing things a bit
+	// more.
 	_sizePerNode[node] += (uint64_t)size;
-	if ((_sizePerNode[node] / _service->getLinksPerChannel()) >= kMaxNHIQueueByteSize) {
-		_requiresRuntimePrepare = true;
+	for (uint8_t link = 0; link < _service->getLinksPerChannel(); link++) {
+		if ((_sizePerNode[node] / _service->getLinksPerChannel()) >= _service->getLinkQueueBytes(link)) {
+			_requiresRuntimePrepare = true;
+		}
 	}
 
 	return true;
@@ -651,8 +652,8 @@ AppleCIOMeshSharedMemory::dripPrepare(int64_t * assignmentIdx, int64_t * offsetI
 	}
 
 	if (requiresRuntimePrepare()) {
-		if (_outputAssignments.nodeMap[outgoingNode].totalPrepared[0] + existingAssignment->getAssignmentSizePerLink() >=
-		    kMaxNHIQueueByteSize) {
+		if (!_outputAssignments.canPrepareAhead(outgoingNode, 0, existingAssignment->getAssignmentSizePerLink(),
+		                                        _service->getLinkQueueBytes(0))) {
 			// We are done early!
 			return true;
 		}
@@ -673,6 +674,7 @@ AppleCIOMeshSharedMemory::dripPrepare(int64_t * assignmentIdx, int64_t * offsetI
 			for (int i = 0; i < kMaxMeshLinksPerChannel; i++) {
 				_outputAssignments.nodeMap[outgoingNode].totalPrepared[i] += existingAssignment->getAssignmentSizePerLink();
 				atomic_fetch_add(&_outputAssignments.nodeMap[outgoingNode].linkCurrentIdx[i], 1);
+				atomic_fetch_add(&_outputAssignments.nodeMap[outgoingNode].linkPreparedIdx[i], 1);
 			}
 		}
 
@@ -885,20 +885,54 @@ AppleCIOMeshAssignment::tmp2()
 
 // MARK: - Assignment Map helper class
 
-void
-AppleCIOMeshAssignmentMap::addAssignmentForNode(MCUCI::NodeId node, uint8_t idx)
+bool
+AppleCIOMeshAssignmentMap::reserve(MCUCI::NodeId node, uint32_t count)
 {
-	nodeMap[node].node                                     = node;
-	nodeMap[node].assignedIdx[nodeMap[node].assignCount++] = idx;
-	nodeMap[node].provider                                 = this;
+	// Everything the next count assignments for node need is allocated up
+	// front, so adding them can't fail halfway through.
+	if (!assignmentOffset.reserve(count) || !offsetIndex.reserve(count) || !assignedNode.reserve(count) ||
+	    !assignmentTag.reserve(count) || !assignmentReady.reserve(count) || !assignmentNotified.reserve(count) ||
+	    !linkIdx.reserve(count) || !nodeMap[node].assignedIdx.reserve(count)) {
+		return false;
+	}
+	for (int i = 0; i < kMaxMeshLinksPerChannel; i++) {
+		if (!nodeMap[node].linkAssignedIdx[i].reserve(count)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint32_t
+AppleCIOMeshAssignmentMap::addAssignment(int64_t offset, MCUCI::NodeId node, uint8_t link)
+{
+	auto idx = assignmentCount;
+
+	assignmentOffset.append(offset);
+	offsetIndex.insert(offset, idx);
+	assignedNode.append(node);
+	assignmentTag.append(AssignmentTag{});
+	assignmentReady.append(false);
+	assignmentNotified.append(false);
+	linkIdx.append(link);
+	assignmentCount++;
+
+	return idx;
 }
 
 void
-AppleCIOMeshAssignmentMap::addLinkAssignmentForNode(MCUCI::NodeId node, uint8_t idx, uint8_t link)
+AppleCIOMeshAssignmentMap::addAssignmentForNode(MCUCI::NodeId node, uint32_t idx)
 {
-	auto tmp = nodeMap[node].linkAssignCount[link];
+	nodeMap[node].node     = node;
+	nodeMap[node].provider = this;
+	nodeMap[node].assignedIdx.append(idx);
+	nodeMap[node].assignCount++;
+}
 
-	nodeMap[node].linkAssignedIdx[link][tmp] = idx;
+void
+AppleCIOMeshAssignmentMap::addLinkAssignmentForNode(MCUCI::NodeId node, uint32_t idx, uint8_t link)
+{
+	nodeMap[node].linkAssignedIdx[link].append(idx);
 	nodeMap[node].linkAssignCount[link] += 1;
 }
 
@@ -910,8 +944,8 @@ AppleCIOMeshAssignmentMap::checkAllReady(bool * interrupted)
 		if (!assignmentReady[i]) {
 			assignmentReady[i] = sharedMemory->checkAssignmentReady(assignmentOffset[i], interrupted);
 			if (assignmentReady[i]) {
-				sharedMemory->readAssignmentTagForLink(assignmentOffset[i], linkIdx[i], &assignmentTag[i][0],
-				                                       sizeof(assignmentTag[i]));
+				sharedMemory->readAssignmentTagForLink(assignmentOffset[i], linkIdx[i], &assignmentTag[i].bytes[0],
+				                                       sizeof(assignmentTag[i].bytes));
 			}
 			retVal &= assignmentReady[i];
 			if (*interrupted) {
@@ -929,8 +963,8 @@ AppleCIOMeshAssignmentMap::checkReady(uint32_t idx, bool * interrupted)
 {
 	assignmentReady[idx] = sharedMemory->checkAssignmentReady(assignmentOffset[idx], interrupted);
 	if (assignmentReady[idx]) {
-		sharedMemory->readAssignmentTagForLink(assignmentOffset[idx], linkIdx[idx], &assignmentTag[idx][0],
-		                                       sizeof(assignmentTag[idx]));
+		sharedMemory->readAssignmentTagForLink(assignmentOffset[idx], linkIdx[idx], &assignmentTag[idx].bytes[0],
+		                                       sizeof(assignmentTag[idx].bytes));
 	}
 
 	return assignmentReady[idx];
@@ -959,21 +993,59 @@ AppleCIOMeshAssignmentMap::reset()
 		for (int j = 0; j < kMaxMeshLinksPerChannel; j++) {
 			atomic_store(&nodeMap[i].linkCurrentIdx[j], 0);
 			nodeMap[i].totalPrepared[j] = 0;
+			atomic_store(&nodeMap[i].linkPreparedIdx[j], 0);
+			atomic_store(&nodeMap[i].linkCompletedIdx[j], 0);
+			nodeMap[i].dripController[j].restart();
 		}
 	}
 	atomic_store(&remainingAssignments, assignmentCount);
 }
 
-uint8_t
-AppleCIOMeshAssignmentMap::getIdxForOffset(int64_t offset)
+void
+AppleCIOMeshAssignmentMap::initDripPrepare(const AppleCIOMeshUtils::DripPreparePolicy & policy)
 {
-	for (uint8_t i = 0; i < assignmentCount; i++) {
-		if (assignmentOffset[i] == offset) {
-			return i;
+	for (int i = 0; i < kMaxCIOMeshNodes; i++) {
+		for (int j = 0; j < kMaxMeshLinksPerChannel; j++) {
+			nodeMap[i].dripController[j].init(policy);
 		}
 	}
+}
 
-	return kMaxAssignmentCount;
+bool
+AppleCIOMeshAssignmentMap::canPrepareAhead(MCUCI::NodeId node, uint8_t link, uint64_t sizePerLink, uint64_t queueBytes)
+{
+	auto & map     = nodeMap[node];
+	uint32_t ahead = atomic_load(&map.linkCurrentIdx[link]) - atomic_load(&map.linkCompletedIdx[link]);
+
+	// With nothing ahead the link would stall, always prepare that one.
+	if (ahead == 0) {
+		return true;
+	}
+
+	// The link's rings cannot take more than this, whatever the controller
+	// would like.
+	if ((ahead + 1) * sizePerLink >= queueBytes) {
+		return false;
+	}
+
+	return map.dripController[link].canPrepare(ahead);
+}
+
+void
+AppleCIOMeshAssignmentMap::recordLinkCompleted(MCUCI::NodeId node, uint8_t link, uint64_t now)
+{
+	auto & map         = nodeMap[node];
+	uint32_t completed = atomic_fetch_add(&map.linkCompletedIdx[link], 1) + 1;
+
+	// The link goes idle until the next assignment has been prepared.
+	bool starved = completed == atomic_load(&map.linkPreparedIdx[link]) && completed != map.linkAssignCount[link];
+	map.dripController[link].recordReady(now, starved);
+}
+
+uint32_t
+AppleCIOMeshAssignmentMap::getIdxForOffset(int64_t offset)
+{
+	return offsetIndex.find(offset);
 }
 
 int64_t
@@ -998,13 +1070,17 @@ AppleCIOMeshAssignmentMap::dump()
 {
 	for (int i = 0; i < 8; i++) {
 		LOG("NodeMap[%d]===\n", i);
-		auto tmp = nodeMap[i];
+		auto & tmp = nodeMap[i];
 		for (int j = 0; j < tmp.assignCount; j++) {
 			LOG("[%d] = %d\n", j, tmp.assignedIdx[j]);
 		}
 		LOG("------\n");
 		for (int l = 0; l < 2; l++) {
-			LOG("link:%d curIdx:%d totalPrepared:%lld\n", l, tmp.linkCurrentIdx[l], tmp.totalPrepared[l]);
+			auto drip = tmp.dripController[l].stats();
+			LOG("link:%d curIdx:%d preparedIdx:%d completedIdx:%d totalPrepared:%lld\n", l, tmp.linkCurrentIdx[l],
+			    tmp.linkPreparedIdx[l], tmp.linkCompletedIdx[l], tmp.totalPrepared[l]);
+			LOG("link:%d drip depth:%u readies:%llu starved:%llu prepares:%llu interval:%llu lead:%llu boost:%u\n", l,
+			    tmp.dripController[l].depth(), drip.readies, drip.starved, drip.prepares, drip.interval, drip.lead, drip.boost);
 			for (int j = 0; j < tmp.linkAssignCount[l]; j++) {
 				auto assignment = sharedMemory->getAssignment(getAssignmentOffset(tmp.linkAssignedIdx[0][j]));
 				LOG("[%d] = %d .. %llx\n", j, tmp.linkAssignedIdx[l][j], assignment->tmp());
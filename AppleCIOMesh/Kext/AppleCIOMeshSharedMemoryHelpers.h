@@ -23,7 +23,9 @@
 #include <libkern/c++/OSObject.h>
 
 #include "AppleCIOMeshUserClientInterface.h"
+#include "Common/AssignmentTable.h"
 #include "Common/Config.h"
+#include "Common/DripPrepareController.h"
 
 namespace MUCI  = AppleCIOMeshUserClientInterface;
 namespace MCUCI = AppleCIOMeshConfigUserClientInterface;
@@ -204,22 +206,58 @@ class AppleCIOMeshAssignment final : public OSObject
 	OSBoundedArray<bool, kMaxMeshLinksPerChannel> _ready;
 };
 
+// Zeroed segments for the assignment maps.
+struct AssignmentMapAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		return IONewZero(U, count);
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t count)
+	{
+		IODelete(memory, U, count);
+	}
+};
+
+// One value per assignment, growing with the map.
+template <typename T>
+using AssignmentColumn =
+    AppleCIOMeshUtils::SegmentedArray<T, kAssignmentSegmentSize, kMaxAssignmentSegments, AssignmentMapAllocator>;
+
+struct AssignmentTag {
+	char bytes[kTagSize];
+};
+
 typedef struct NodeAssignmentMap {
 	AppleCIOMeshAssignmentMap * provider;
 	MCUCI::NodeId node;
 	// All the indices in the assignment map assigned to this node.
-	uint8_t assignedIdx[kMaxAssignmentCount];
+	AssignmentColumn<uint32_t> assignedIdx;
 	// Number of assignments
-	uint8_t assignCount;
+	uint32_t assignCount;
 	// The assigned indices for a link that is going/coming from that node.
-	uint8_t linkAssignedIdx[kMaxMeshLinksPerChannel][kMaxAssignmentCount];
+	AssignmentColumn<uint32_t> linkAssignedIdx[kMaxMeshLinksPerChannel];
 	// Number of assigned assignments to a link going/coming from that node.
-	uint8_t linkAssignCount[kMaxMeshLinksPerChannel];
+	uint32_t linkAssignCount[kMaxMeshLinksPerChannel];
 	// The current index that needs to be prepared for transfer.
 	// This is an index to assignedIdx. This is also per link.
-	_Atomic(uint8_t) linkCurrentIdx[kMaxMeshLinksPerChannel];
+	_Atomic(uint32_t) linkCurrentIdx[kMaxMeshLinksPerChannel];
 	// How much we have prepared for this node so we can stop early.
 	_Atomic(uint64_t) totalPrepared[kMaxMeshLinksPerChannel];
+	// How many of the linkCurrentIdx assignments have been prepared and how
+	// many have completed on the link, per link.
+	_Atomic(uint32_t) linkPreparedIdx[kMaxMeshLinksPerChannel];
+	_Atomic(uint32_t) linkCompletedIdx[kMaxMeshLinksPerChannel];
+	// Sizes how far ahead of each link runtime prepares go.
+	AppleCIOMeshUtils::DripPrepareController dripController[kMaxMeshLinksPerChannel];
+	// Set while the link is on the commandeer's pending prepare list, next is
+	// the entry after it. Only the commandeer clears it.
+	_Atomic(bool) linkPendingPrepare[kMaxMeshLinksPerChannel];
+	uintptr_t linkPendingNext[kMaxMeshLinksPerChannel];
 } NodeAssignmentMap;
 
 typedef struct AppleCIOMeshAssignmentMap {
@@ -230,42 +268,53 @@ typedef struct AppleCIOMeshAssignmentMap {
 
   protected:
 	// The offset of the assignment to use --> do not use this directly.
-	int64_t assignmentOffset[kMaxAssignmentCount];
+	AssignmentColumn<int64_t> assignmentOffset;
+	// The first index for each assignment offset.
+	AppleCIOMeshUtils::OffsetIndex<AssignmentMapAllocator> offsetIndex;
 
   public:
 	// The node assigned for each assignment offset.
-	int64_t assignedNode[kMaxAssignmentCount];
+	AssignmentColumn<int64_t> assignedNode;
 	// The tag for each assignment
-	char assignmentTag[kMaxAssignmentCount][kTagSize];
+	AssignmentColumn<AssignmentTag> assignmentTag;
 	// If the assignment is ready.
-	bool assignmentReady[kMaxAssignmentCount];
+	AssignmentColumn<bool> assignmentReady;
 	// If the assignment ready has been handled.
-	bool assignmentNotified[kMaxAssignmentCount];
+	AssignmentColumn<bool> assignmentNotified;
 	// Node assignments
 	NodeAssignmentMap nodeMap[kMaxCIOMeshNodes];
 
 	// The link for the assignment within the map.
-	uint8_t linkIdx[kMaxAssignmentCount];
+	AssignmentColumn<uint8_t> linkIdx;
 
-	uint8_t assignmentCount;
+	uint32_t assignmentCount;
 	uint8_t linksPerChannel;
-	_Atomic(uint8_t) remainingAssignments;
+	_Atomic(uint32_t) remainingAssignments;
 	_Atomic(bool) allReceiveFinished;
 
 	// The index to start receive interrupt checking in. We want to check
 	// the forward offset first so we can forward the data quickly.
-	uint8_t startingIdx;
+	uint32_t startingIdx;
 	bool startingIdxSet;
 
 	MUCI::MeshDirection direction;
 	AppleCIOMeshSharedMemory * sharedMemory;
 
 	bool checkPrepared();
-	void addAssignmentForNode(MCUCI::NodeId node, uint8_t idx);
-	void addLinkAssignmentForNode(MCUCI::NodeId node, uint8_t idx, uint8_t link);
+	void initDripPrepare(const AppleCIOMeshUtils::DripPreparePolicy & policy);
+	// Whether another assignment of sizePerLink should be prepared ahead of
+	// link for node, under runtime prepare. queueBytes is how much the link
+	// takes at once, see AppleCIOMeshService::getLinkQueueBytes.
+	bool canPrepareAhead(MCUCI::NodeId node, uint8_t link, uint64_t sizePerLink, uint64_t queueBytes);
+	// An assignment prepared for node on link has completed at now.
+	void recordLinkCompleted(MCUCI::NodeId node, uint8_t link, uint64_t now);
+	bool reserve(MCUCI::NodeId node, uint32_t count);
+	uint32_t addAssignment(int64_t offset, MCUCI::NodeId node, uint8_t link);
+	void addAssignmentForNode(MCUCI::NodeId node, uint32_t idx);
+	void addLinkAssignmentForNode(MCUCI::NodeId node, uint32_t idx, uint8_t link);
 	bool checkAllReady(bool * interrupted);
 	bool checkReady(uint32_t idx, bool * interrupted);
-	uint8_t getIdxForOffset(int64_t offset);
+	uint32_t getIdxForOffset(int64_t offset);
 	int64_t getAssignmentOffset(uint32_t idx);
 	void hold();
 	void reset();
@@ -268,6 +268,8 @@ AppleCIOMeshTransmitCommand::initialize(AppleCIOMeshThunderboltCommands * provid
 	_iomd               = iomd;
 	_commandsLength     = sharedMem->getCommandLength();
 
+	atomic_store(&_sendTime, 0);
+
 	for (int i = 0; i < _commands.length(); i++) {
 		_commands[i]     = nullptr;
 		_commandsIOMD[i] = nullptr;
@@ -412,6 +414,7 @@ void
 AppleCIOMeshTransmitCommand::dataOut()
 {
 	_sent = true;
+	stampSendTime();
 }
 
 void
@@ -426,6 +429,19 @@ AppleCIOMeshTransmitCommand::waitingForCompletion()
 	return _sent;
 }
 
+void
+AppleCIOMeshTransmitCommand::stampSendTime()
+{
+	atomic_store(&_sendTime, mach_absolute_time());
+}
+
+uint64_t
+AppleCIOMeshTransmitCommand::takeSendLatency()
+{
+	uint64_t sendTime = atomic_exchange(&_sendTime, 0);
+	return sendTime != 0 ? mach_absolute_time() - sendTime : 0;
+}
+
 ForwardAction *
 AppleCIOMeshTransmitCommand::getForwardAction()
 {
@@ -441,8 +457,8 @@ AppleCIOMeshTransmitCommand::setForwardAction(ForwardAction * forwardAction)
 void
 AppleCIOMeshTransmitCommand::dripForwardComplete()
 {
-	atomic_fetch_add(&_forwardAction->txCommandsComplete, 1);
-	atomic_fetch_sub(&_forwardAction->txCommandsSubmitted, 1);
+	_forwardAction->txCommandsComplete.fetch_add(1);
+	_forwardAction->txCommandsSubmitted.fetch_sub(1);
 }
 
 int
@@ -138,6 +138,12 @@ class AppleCIOMeshTransmitCommand final : public OSObject
 	// to complete on all links before sending back send complete.
 	bool waitingForCompletion();
 
+	// Remembers when data was handed to the link, takeSendLatency returns how
+	// long ago that was in mach_absolute_time() units, once, or 0 if nothing
+	// was sent since.
+	void stampSendTime();
+	uint64_t takeSendLatency();
+
 	ForwardAction * getForwardAction();
 	void setForwardAction(ForwardAction * forwardAction);
 	void dripForwardComplete();
@@ -160,6 +166,7 @@ class AppleCIOMeshTransmitCommand final : public OSObject
 
 	bool _sent;
 	_Atomic(int) _fxCompletedIdx;
+	_Atomic(uint64_t) _sendTime;
 };
 
 // MARK: - Commands+Groups
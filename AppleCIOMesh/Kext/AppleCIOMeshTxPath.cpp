@@ -53,10 +53,10 @@ AppleCIOMeshTxPath::initWithLink(AppleCIOMeshLink * link, Configuration & config
 	}
 
 	if (!PE_parse_boot_argn(kAppleCIOMeshTxRingSize, &_txRingSize, sizeof(_txRingSize))) {
-		_txRingSize = kTxRingSize;
+		_txRingSize = configuration.txSizing.ringSize;
 	}
 	if (!PE_parse_boot_argn(kAppleCIOMeshTxInterruptStride, &_txInterruptStride, sizeof(_txInterruptStride))) {
-		_txInterruptStride = kTxInterruptStride;
+		_txInterruptStride = configuration.txSizing.interruptStride;
 	}
 	if (!PE_parse_boot_argn(kAppleCIOMeshE2EFlowControl, &_e2eFlowControlEnable, sizeof(_e2eFlowControlEnable))) {
 		_e2eFlowControlEnable = kE2EFlowControlEnable;
@@ -288,3 +288,9 @@ AppleCIOMeshTxPath::getQueue()
 {
 	return _queue;
 }
+
+uint32_t
+AppleCIOMeshTxPath::getRingSize()
+{
+	return _txRingSize;
+}
@@ -41,6 +41,7 @@ class AppleCIOMeshTxPath final : public AppleCIOMeshPath
 	virtual void submitPreparedPartial(IOThunderboltCommand * command, int64_t offset) APPLE_KEXT_OVERRIDE;
 	virtual void checkCompletion() APPLE_KEXT_OVERRIDE;
 	IOThunderboltTransmitQueue * getQueue();
+	uint32_t getRingSize();
 
   private:
 	IOReturn initPath();
@@ -131,6 +131,15 @@ const IOExternalMethodDispatch2022 AppleCIOMeshUserClient::_methods[MUCI::Method
             0,
             false,
         },
+    [MUCI::Method::SetupCommandRing] =
+        {
+            &AppleCIOMeshUserClient::setupCommandRing,
+            0,
+            sizeof(MUCI::CommandRing),
+            0,
+            0,
+            false,
+        },
 };
 
 const IOExternalTrap AppleCIOMeshUserClient::_traps[MUCI::Trap::NumTraps] = {
@@ -209,6 +218,11 @@ const IOExternalTrap AppleCIOMeshUserClient::_traps[MUCI::Trap::NumTraps] = {
             NULL,
             (IOTrap)&AppleCIOMeshUserClient::trapStopForwardChain,
         },
+    [MUCI::Trap::SubmitCommands] =
+        {
+            NULL,
+            (IOTrap)&AppleCIOMeshUserClient::trapSubmitCommands,
+        },
 };
 
 bool
@@ -221,6 +235,8 @@ AppleCIOMeshUserClient::initWithTask(task_t owning_task, void * security_token,
 	_owningTask = owning_task;
 	_owningPid  = proc_selfpid();
 	atomic_store(&_hasBeenInterrupted, false);
+	atomic_store(&_commandRingReady, false);
+	atomic_store(&_commandRingBusy, false);
 
 	// initialize the max wait time to the default
 	nanoseconds_to_absolutetime(kMaxWaitTimeInSeconds * kNsPerSecond, &_maxWaitTime);
@@ -282,6 +298,7 @@ AppleCIOMeshUserClient::stop(IOService * provider)
 void
 AppleCIOMeshUserClient::free()
 {
+	freeCommandRing();
 	OSSafeReleaseNULL(_provider);
 
 	if (_notify_lock) {
@@ -412,6 +429,56 @@ AppleCIOMeshUserClient::overrideRuntimePrepare(OSObject * target, __unused void
 	return me->_provider->overrideRuntimePrepare(bufferId.get());
 }
 
+IOReturn
+AppleCIOMeshUserClient::setupCommandRing(OSObject * target, __unused void * reference, IOExternalMethodArguments * arguments)
+{
+	auto me = OSRequiredCast(AppleCIOMeshUserClient, target);
+	EMAInputExtractor<MUCI::CommandRing> ring(arguments);
+
+	if (me->_provider->isShuttingDown()) {
+		LOG("system is shutting down.  go away");
+		return kIOReturnError;
+	}
+
+	// Traps don't go through the user client lock, so a ring that may be in
+	// use is never unmapped or replaced.
+	if (atomic_load(&me->_commandRingReady)) {
+		LOG("A command ring is already set up\n");
+		return kIOReturnBusy;
+	}
+
+	if (!AppleCIOMeshUtils::CommandRing::validEntries(ring->entries) || ring->size <= 0 ||
+	    (uint64_t)ring->size < AppleCIOMeshUtils::command_ring_size(ring->entries) || (ring->address & PAGE_MASK) != 0) {
+		LOG("Invalid command ring of %u entries and 0x%llx bytes\n", ring->entries, ring->size);
+		return kIOReturnBadArgument;
+	}
+
+	me->_commandRingMD = IOMemoryDescriptor::withAddressRange(ring->address, (mach_vm_size_t)ring->size,
+	                                                          kIODirectionOutIn | kIOMemoryKernelUserShared, me->_owningTask);
+	if (me->_commandRingMD == nullptr) {
+		LOG("Failed to allocate the command ring MemoryDescriptor\n");
+		return kIOReturnNoMemory;
+	}
+
+	IOReturn ret = me->_commandRingMD->prepare(kIODirectionInOut);
+	if (ret != kIOReturnSuccess) {
+		LOG("Failed to wire the command ring: 0x%x\n", ret);
+		OSSafeReleaseNULL(me->_commandRingMD);
+		return ret;
+	}
+
+	me->_commandRingMap = me->_commandRingMD->map();
+	if (me->_commandRingMap == nullptr ||
+	    !me->_commandRing.attach((void *)me->_commandRingMap->getVirtualAddress(), (uint64_t)ring->size, ring->entries)) {
+		LOG("Failed to map the command ring\n");
+		me->freeCommandRing();
+		return kIOReturnNoMemory;
+	}
+
+	atomic_store(&me->_commandRingReady, true);
+	return kIOReturnSuccess;
+}
+
 IOReturn
 AppleCIOMeshUserClient::allocateSharedMemory(OSObject * target, __unused void * reference, IOExternalMethodArguments * arguments)
 {
@@ -582,6 +649,18 @@ AppleCIOMeshUserClient::trapWaitSharedMemoryChunk(uintptr_t bufferId_, uintptr_t
 
 IOReturn
 AppleCIOMeshUserClient::trapSendChunk(uintptr_t bufferId_, uintptr_t offset_, uintptr_t tagsPtr)
+{
+	char tag[kMaxMeshLinkCount][kTagSize];
+	if (copyin(tagsPtr, &tag[0][0], kTagSize * _provider->getLinksPerChannel()) != 0) {
+		LOG("could not copy in the user tags!\n");
+		return kIOReturnBadArgument;
+	}
+
+	return sendChunk(bufferId_, offset_, tag);
+}
+
+IOReturn
+AppleCIOMeshUserClient::sendChunk(uintptr_t bufferId_, uintptr_t offset_, char (*tag)[kTagSize])
 {
 	if (_provider->isShuttingDown()) {
 		static int nprint = 0;
@@ -641,16 +720,14 @@ AppleCIOMeshUserClient::trapSendChunk(uintptr_t bufferId_, uintptr_t offset_, ui
 	_preparedBufferId = MUCI::kInvalidBufferId;
 	_preparedOffset   = -1;
 
-	char tag[kMaxMeshLinkCount][kTagSize];
-	if (copyin(tagsPtr, &tag[0][0], kTagSize * _provider->getLinksPerChannel()) != 0) {
-		LOG("could not copy in the user tags!\n");
-		sm->release();
-		return kIOReturnBadArgument;
-	}
-
 	if (usingCommandeer) {
 		atomic_store(&_sendDispatchCount, 0);
-		_provider->commandeerSend(sm, (int64_t)offset_, this, &tag[1][0], kTagSize);
+		// Nothing has been sent yet, so the caller can simply try again.
+		errRet = _provider->commandeerSend(sm, (int64_t)offset_, this, &tag[1][0], kTagSize);
+		if (errRet != kIOReturnSuccess) {
+			sm->release();
+			return errRet;
+		}
 	}
 
 	uint64_t ctr = 0;
@@ -963,7 +1040,7 @@ AppleCIOMeshUserClient::trapPrepareAllChunks(uintptr_t bufferId_, uintptr_t dire
 	assignmentMap->reset();
 	assignmentMap->hold();
 
-	for (uint8_t i = 0; i < assignmentMap->assignmentCount; i++) {
+	for (uint32_t i = 0; i < assignmentMap->assignmentCount; i++) {
 		if (assignmentMap->linkIdx[i] == 0) {
 			auto node                  = assignmentMap->assignedNode[i];
 			auto nodeMap               = &(assignmentMap->nodeMap[node]);
@@ -972,7 +1049,9 @@ AppleCIOMeshUserClient::trapPrepareAllChunks(uintptr_t bufferId_, uintptr_t dire
 			auto linkIdx               = assignmentMap->linkIdx[i];
 			bool prepare               = true;
 
-			if (sm->requiresRuntimePrepare() && (nodeMap->totalPrepared[linkIdx] + assignmentSizePerLink) >= kMaxNHIQueueByteSize) {
+			if (sm->requiresRuntimePrepare() &&
+			    !assignmentMap->canPrepareAhead((MCUCI::NodeId)node, linkIdx, assignmentSizePerLink,
+			                                    _provider->getLinkQueueBytes(linkIdx))) {
 				prepare = false;
 			}
 
@@ -980,6 +1059,7 @@ AppleCIOMeshUserClient::trapPrepareAllChunks(uintptr_t bufferId_, uintptr_t dire
 				for (int l = 0; l < kMaxMeshLinksPerChannel; l++) {
 					nodeMap->totalPrepared[l] += assignmentSizePerLink;
 					atomic_fetch_add(&nodeMap->linkCurrentIdx[l], 1);
+					atomic_fetch_add(&nodeMap->linkPreparedIdx[l], 1);
 				}
 
 				_provider->prepareCommand(sm, assignmentMap->getAssignmentOffset(i));
@@ -1013,6 +1093,19 @@ AppleCIOMeshUserClient::trapPrepareAllChunks(uintptr_t bufferId_, uintptr_t dire
 IOReturn
 AppleCIOMeshUserClient::trapSendAndPrepareChunk(
     uintptr_t sendBufferId_, uintptr_t sendOffset_, uintptr_t prepareBufferId_, uintptr_t prepareOffset_, uintptr_t tagsPtr)
+{
+	char tag[kMaxMeshLinkCount][kTagSize];
+	if (copyin(tagsPtr, &tag[0][0], kTagSize * _provider->getLinksPerChannel()) != 0) {
+		LOG("could not copy in the user tags!\n");
+		return kIOReturnBadArgument;
+	}
+
+	return sendAndPrepareChunk(sendBufferId_, sendOffset_, prepareBufferId_, prepareOffset_, tag);
+}
+
+IOReturn
+AppleCIOMeshUserClient::sendAndPrepareChunk(
+    uintptr_t sendBufferId_, uintptr_t sendOffset_, uintptr_t prepareBufferId_, uintptr_t prepareOffset_, char (*tag)[kTagSize])
 {
 	if (_provider->isShuttingDown()) {
 		static int nprint = 0;
@@ -1085,16 +1178,12 @@ AppleCIOMeshUserClient::trapSendAndPrepareChunk(
 
 	SEND_TR((MUCI::BufferId)sendBufferId_, (int64_t)sendOffset_, SEND_META_CHUNK_PREPARED);
 
-	char tag[kMaxMeshLinkCount][kTagSize];
-	if (copyin(tagsPtr, &tag[0][0], kTagSize * _provider->getLinksPerChannel()) != 0) {
-		LOG("could not copy in the user tags!\n");
-		sendSM->interruptIOThreads();
-		sendSM->release();
-		return kIOReturnBadArgument;
-	}
-
 	if (usingCommandeer) {
-		_provider->commandeerSend(sendSM, (int64_t)sendOffset_, this, &tag[1][0], kTagSize);
+		errRet = _provider->commandeerSend(sendSM, (int64_t)sendOffset_, this, &tag[1][0], kTagSize);
+		if (errRet != kIOReturnSuccess) {
+			sendSM->release();
+			return errRet;
+		}
 	}
 
 	uint64_t ctr = 0;
@@ -1226,7 +1315,17 @@ AppleCIOMeshUserClient::trapSendAndPrepareChunk(
 		preparingSM->getOutputAssignmentMap()->reset();
 		preparingSM->holdOutput();
 
-		_provider->commandeerDripPrepare(preparingSM, (int64_t)prepareOffset_, sendSM);
+		IOReturn prepareRet = _provider->commandeerDripPrepare(preparingSM, (int64_t)prepareOffset_, sendSM);
+		if (prepareRet != kIOReturnSuccess) {
+			// Its output is held and nothing will prepare it, wake anyone
+			// that would wait on it rather than let them time out.
+			_preparedBufferId = MUCI::kInvalidBufferId;
+			_preparedOffset   = -1;
+			preparingSM->interruptIOThreads();
+			OSSafeReleaseNULL(preparingSM);
+			sendSM->release();
+			return prepareRet;
+		}
 
 		OSSafeReleaseNULL(preparingSM);
 	}
@@ -1363,7 +1462,7 @@ AppleCIOMeshUserClient::trapReceiveNext(uintptr_t bufferId_, uintptr_t outReceiv
 				return kIOReturnVMError;
 			}
 
-			err = copyout((int64_t *)&receiveMap->assignmentTag[i][0], outTagPtr_, kTagSize);
+			err = copyout((int64_t *)&receiveMap->assignmentTag[i].bytes[0], outTagPtr_, kTagSize);
 			if (err != 0) {
 				LOG("receiveNext failed to copyOut tag for bufferId %lld\n", (uint64_t)bufferId_);
 				sm->release();
@@ -1397,7 +1496,7 @@ AppleCIOMeshUserClient::trapReceiveNext(uintptr_t bufferId_, uintptr_t outReceiv
 				return kIOReturnVMError;
 			}
 
-			err = copyout((int64_t *)&receiveMap->assignmentTag[i][0], outTagPtr_, kTagSize);
+			err = copyout((int64_t *)&receiveMap->assignmentTag[i].bytes[0], outTagPtr_, kTagSize);
 			if (err != 0) {
 				LOG("receiveNext failed to copyOut tag for bufferId %lld\n", (uint64_t)bufferId_);
 				sm->release();
@@ -1518,7 +1617,7 @@ AppleCIOMeshUserClient::trapReceiveBatch(uintptr_t bufferId_,
 				return kIOReturnVMError;
 			}
 
-			err = copyout((int64_t *)&receiveMap->assignmentTag[i][0], (uintptr_t)receivedTag, kTagSize);
+			err = copyout((int64_t *)&receiveMap->assignmentTag[i].bytes[0], (uintptr_t)receivedTag, kTagSize);
 			if (err != 0) {
 				LOG("receiveBatch failed to copyOut tag\n");
 				sm->release();
@@ -1558,7 +1657,7 @@ AppleCIOMeshUserClient::trapReceiveBatch(uintptr_t bufferId_,
 				return kIOReturnVMError;
 			}
 
-			err = copyout((int64_t *)&receiveMap->assignmentTag[i][0], (uintptr_t)receivedTag, kTagSize);
+			err = copyout((int64_t *)&receiveMap->assignmentTag[i].bytes[0], (uintptr_t)receivedTag, kTagSize);
 			if (err != 0) {
 				LOG("receiveBatch failed to copyOut tag\n");
 				sm->release();
@@ -1635,7 +1734,7 @@ AppleCIOMeshUserClient::trapReceiveBatchForNode(uintptr_t bufferId_,
 	char * receivedTag        = (char *)outReceivedTagsPtr_;
 	int64_t curReceive        = 0;
 
-	uint8_t idx;
+	uint32_t idx;
 	int64_t offset;
 	int err;
 
@@ -1673,7 +1772,7 @@ AppleCIOMeshUserClient::trapReceiveBatchForNode(uintptr_t bufferId_,
 				goto exit;
 			}
 
-			err = copyout((int64_t *)&receiveMap->assignmentTag[idx][0], (uintptr_t)receivedTag, kTagSize);
+			err = copyout((int64_t *)&receiveMap->assignmentTag[idx].bytes[0], (uintptr_t)receivedTag, kTagSize);
 			if (err != 0) {
 				LOG("receiveBatchForNode failed to copyOut tag\n");
 				ret = kIOReturnVMError;
@@ -1704,7 +1803,7 @@ AppleCIOMeshUserClient::trapReceiveBatchForNode(uintptr_t bufferId_,
 				goto exit;
 			}
 
-			err = copyout((int64_t *)&receiveMap->assignmentTag[idx][0], (uintptr_t)receivedTag, kTagSize);
+			err = copyout((int64_t *)&receiveMap->assignmentTag[idx].bytes[0], (uintptr_t)receivedTag, kTagSize);
 			if (err != 0) {
 				LOG("receiveBatch failed to copyOut tag\n");
 				ret = kIOReturnVMError;
@@ -1822,3 +1921,75 @@ AppleCIOMeshUserClient::trapStopForwardChain()
 
 	return _provider->stopForwardChain();
 }
+
+IOReturn
+AppleCIOMeshUserClient::trapSubmitCommands()
+{
+	if (_provider->isShuttingDown()) {
+		LOG("system is shutting down.  go away");
+		return kIOReturnError;
+	}
+
+	if (!atomic_load(&_commandRingReady)) {
+		LOG("No command ring has been set up\n");
+		return kIOReturnNotReady;
+	}
+
+	// Only one thread may drain the ring at a time.
+	bool expected = false;
+	if (!atomic_compare_exchange_strong(&_commandRingBusy, &expected, true)) {
+		LOG("The command ring is already being drained\n");
+		return kIOReturnBusy;
+	}
+
+	AppleCIOMeshUtils::CommandRingDrainResult result = _commandRing.drain(
+	    [this](const AppleCIOMeshUtils::MeshCommand & command) -> int32_t { return executeCommand(command); }, kIOReturnAborted);
+
+	atomic_store(&_commandRingBusy, false);
+
+	if (result.corrupt) {
+		LOG("The command ring's submission tail is out of range\n");
+		return kIOReturnBadArgument;
+	}
+	if (result.status != kIOReturnSuccess) {
+		return result.status;
+	}
+	return result.full ? kIOReturnNoSpace : kIOReturnSuccess;
+}
+
+IOReturn
+AppleCIOMeshUserClient::executeCommand(const AppleCIOMeshUtils::MeshCommand & command)
+{
+	static_assert(kTagSize * kMaxMeshLinksPerChannel <= AppleCIOMeshUtils::kMeshCommandTagBytes,
+	              "A command must have room for the tags of every link in a channel");
+
+	// The command is a copy the ring handed out, user space can't change it
+	// from under us.
+	char tag[kMaxMeshLinkCount][kTagSize];
+	switch (command.op) {
+	case AppleCIOMeshUtils::kMeshCommandSend:
+		memcpy(&tag[0][0], command.tags, kTagSize * _provider->getLinksPerChannel());
+		return sendChunk((uintptr_t)command.sendBufferId, (uintptr_t)command.sendOffset, tag);
+	case AppleCIOMeshUtils::kMeshCommandPrepare:
+		return trapPrepareChunk((uintptr_t)command.prepareBufferId, (uintptr_t)command.prepareOffset);
+	case AppleCIOMeshUtils::kMeshCommandSendAndPrepare:
+		memcpy(&tag[0][0], command.tags, kTagSize * _provider->getLinksPerChannel());
+		return sendAndPrepareChunk((uintptr_t)command.sendBufferId, (uintptr_t)command.sendOffset,
+		                           (uintptr_t)command.prepareBufferId, (uintptr_t)command.prepareOffset, tag);
+	default:
+		LOG("Unknown command op %u\n", command.op);
+		return kIOReturnBadArgument;
+	}
+}
+
+void
+AppleCIOMeshUserClient::freeCommandRing()
+{
+	atomic_store(&_commandRingReady, false);
+	_commandRing.detach();
+	OSSafeReleaseNULL(_commandRingMap);
+	if (_commandRingMD != nullptr) {
+		_commandRingMD->complete(kIODirectionInOut);
+		OSSafeReleaseNULL(_commandRingMD);
+	}
+}
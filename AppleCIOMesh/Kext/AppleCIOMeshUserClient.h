@@ -22,6 +22,7 @@
 #include "AppleCIOMeshSharedMemory.h"
 #include "AppleCIOMeshThunderboltCommands.h"
 #include "AppleCIOMeshUserClientInterface.h"
+#include "Common/CommandRing.h"
 
 namespace MUCI = AppleCIOMeshUserClientInterface;
 
@@ -74,6 +75,7 @@ class AppleCIOMeshUserClient final : public IOUserClient2022
 	static IOReturn setMaxWaitTimeNodeBatch(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
 	static IOReturn meshSynchronize(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
 	static IOReturn overrideRuntimePrepare(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
+	static IOReturn setupCommandRing(OSObject * target, void * reference, IOExternalMethodArguments * arguments);
 
 	// Traps
 	IOReturn trapWaitSharedMemoryChunk(uintptr_t bufferId_, uintptr_t offset_, uintptr_t outTagPtr_);
@@ -103,6 +105,18 @@ class AppleCIOMeshUserClient final : public IOUserClient2022
 	IOReturn trapInterruptReceiveBatch();
 	IOReturn trapStartForwardChain(uintptr_t forwardChainId_, uintptr_t elements_);
 	IOReturn trapStopForwardChain();
+	IOReturn trapSubmitCommands();
+
+	// The traps once their arguments are in the kernel, shared with the
+	// command ring.
+	IOReturn sendChunk(uintptr_t bufferId_, uintptr_t offset_, char (*tag)[kTagSize]);
+	IOReturn sendAndPrepareChunk(uintptr_t sendBufferId_,
+	                             uintptr_t sendOffset_,
+	                             uintptr_t prepareBufferId_,
+	                             uintptr_t prepareOffset_,
+	                             char (*tag)[kTagSize]);
+	IOReturn executeCommand(const AppleCIOMeshUtils::MeshCommand & command);
+	void freeCommandRing();
 
 	static const IOExternalMethodDispatch2022 _methods[MUCI::Method::NumMethods];
 	static const IOExternalTrap _traps[MUCI::Trap::NumTraps];
@@ -132,4 +146,12 @@ class AppleCIOMeshUserClient final : public IOUserClient2022
 	uint64_t _signpostSyncCount;
 
 	uint64_t _receivePrepareTime;
+
+	// Command ring, mapped once by setupCommandRing and only touched by
+	// whoever holds _commandRingBusy.
+	IOMemoryDescriptor * _commandRingMD;
+	IOMemoryMap * _commandRingMap;
+	AppleCIOMeshUtils::CommandRing _commandRing;
+	_Atomic(bool) _commandRingReady;
+	_Atomic(bool) _commandRingBusy;
 };
@@ -86,6 +86,12 @@ class Method
 
 		OverrideRuntimePrepare,
 
+		// Maps the command ring Trap::SubmitCommands works on using
+		// ::CommandRing. The memory has to be laid out as
+		// AppleCIOMeshUtils::CommandRing::init leaves it. A connection has one
+		// ring for as long as it is open, it can't be replaced.
+		SetupCommandRing,
+
 		NumMethods
 	};
 };
@@ -167,6 +173,14 @@ class Trap
 		// point.
 		StopForwardChain,
 
+		// The doorbell of the command ring set with Method::SetupCommandRing.
+		// Takes no arguments. Runs every command submitted so far in order,
+		// each one like the trap it stands for, and posts a completion for it.
+		// Once a command fails the rest are completed as skipped. Blocks until
+		// every command has completed or the completion ring is full, returns
+		// the status of the first command that failed.
+		SubmitCommands,
+
 		NumTraps
 	};
 };
@@ -252,6 +266,16 @@ struct ForwardChain {
 	int64_t sectionCount;
 } __attribute__((packed));
 
+/// The memory the command ring lives in.
+struct CommandRing {
+	// Address of the ring in the caller's task. Must be page aligned.
+	mach_vm_address_t address;
+	// Size of the memory, at least AppleCIOMeshUtils::command_ring_size(entries).
+	int64_t size;
+	// Entries in each of the submission and completion rings, a power of two.
+	uint32_t entries;
+} __attribute__((packed));
+
 struct SetMaxWaitTime {
 	// how many nanoseconds to wait for (0 == forever)
 	uint64_t maxWaitTime;
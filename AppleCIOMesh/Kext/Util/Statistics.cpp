@@ -44,3 +44,34 @@ OnlineDistribution::print(const char * name) const
 		LOG("%s: (%lld uniform across %llu samples)\n", name, minimum(), num_samples());
 	}
 }
+
+void
+OnlineQuantiles::add_sample(SInt64 sample)
+{
+	_histogram.record(sample < 0 ? 0 : static_cast<UInt64>(sample));
+}
+
+void
+OnlineQuantiles::merge(const OnlineQuantiles & other)
+{
+	_histogram.merge(other._histogram);
+}
+
+void
+OnlineQuantiles::reset()
+{
+	_histogram.reset();
+}
+
+void
+OnlineQuantiles::print(const char * name) const
+{
+	const UInt64 total = _histogram.count();
+	if (total == 0) {
+		LOG("%s: no samples\n", name);
+	} else {
+		LOG("%s: (p50=%llu p90=%llu p99=%llu p999=%llu max=%llu num=%llu)\n", name, _histogram.value_at_quantile(0.5, total),
+		    _histogram.value_at_quantile(0.9, total), _histogram.value_at_quantile(0.99, total),
+		    _histogram.value_at_quantile(0.999, total), _histogram.maximum(), total);
+	}
+}
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include "Common/LogLinearHistogram.h"
 #include "SymbolWorkaround.h"
 #include <IOKit/IOLib.h>
 
@@ -74,3 +75,44 @@ class OnlineDistribution
 	double _mean{0};
 	double _intermediate_variance{0};
 };
+
+// Tracks the quantiles of a stream of samples with a fixed-size log-linear
+// histogram. Samples are recorded with relaxed atomics so several threads can
+// share one instance, or keep their own and merge them when reporting.
+class OnlineQuantiles
+{
+  public:
+	using Histogram = AppleCIOMeshUtils::LogLinearHistogram<>;
+
+	UInt64
+	num_samples() const
+	{
+		return _histogram.count();
+	}
+
+	// Returns the estimated sample at quantile q (0.0 - 1.0), within 1% of the
+	// exact value.
+	UInt64
+	quantile(double q) const
+	{
+		return _histogram.value_at_quantile(q);
+	}
+
+	const Histogram &
+	histogram() const
+	{
+		return _histogram;
+	}
+
+	// Negative samples are recorded as 0.
+	void add_sample(SInt64);
+
+	void merge(const OnlineQuantiles & other);
+
+	void reset();
+
+	void print(const char * name) const;
+
+  private:
+	Histogram _histogram;
+};
@@ -0,0 +1,635 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestAllToAll.cpp
+//  AppleCIOMesh
+//
+//  Runs all-to-all exchanges between threads connected with local sockets and
+//  checks every node's slots against the reference, with every pair of nodes
+//  encrypting with a key of its own, for both pairings. It also checks that
+//  every round pairs the nodes up and that the ensemble picks the pairing that
+//  keeps the busiest link the least loaded. The driver path is run too: the
+//  slices staged in each node's shadow buffer and handed over with their tags
+//  by offset, encrypted with the pair keys and IVs the framework derives. No
+//  key and IV is used twice across it and a broadcast of the same nodes, even
+//  where a pair is a node mask too. This test has no platform dependencies
+//  and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestAllToAll.cpp
+//
+
+#include "Common/AllToAll.h"
+#include "Common/CollectiveSchedule.h"
+#include "Common/NodeMasks.h"
+#include <cassert>
+#include <initializer_list>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::AllToAllExchange;
+using AppleCIOMeshUtils::AllToAllOps;
+using AppleCIOMeshUtils::AllToAllPairing;
+using AppleCIOMeshUtils::kAllToAllShift;
+using AppleCIOMeshUtils::kAllToAllXor;
+
+static constexpr uint32_t kMaxNodes = 8;
+
+struct Node {
+	int links[kMaxNodes];
+	uint8_t * input;
+	uint8_t * output;
+	uint8_t * staging;
+	uint32_t node;
+	uint32_t nodeCount;
+	AllToAllPairing pairing;
+	uint64_t sliceSize;
+	uint32_t slicesToFail;
+	bool result;
+};
+
+// Stands in for the key of the pair: either direction of a pair uses the same
+// key, but no two pairs do.
+static uint8_t
+keystream(uint32_t src, uint32_t dst, uint64_t index)
+{
+	const uint64_t pair = AppleCIOMeshUtils::all_to_all_pair_mask(src, dst);
+	return (uint8_t)(pair * 157 + index * 11 + (index >> 8));
+}
+
+static uint8_t
+plaintext(uint32_t src, uint32_t dst, uint64_t index)
+{
+	return (uint8_t)(src * 37 + dst * 5 + index);
+}
+
+static bool
+sendSlice(void * context, uint32_t peer, const void * data, uint64_t size)
+{
+	Node * node = (Node *)context;
+	for (uint64_t sent = 0; sent < size;) {
+		const ssize_t result = write(node->links[peer], (const uint8_t *)data + sent, size - sent);
+		if (result <= 0) {
+			return false;
+		}
+		sent += (uint64_t)result;
+	}
+	return true;
+}
+
+static bool
+receiveSlice(void * context, uint32_t peer, void * data, uint64_t size)
+{
+	Node * node = (Node *)context;
+	if (node->slicesToFail > 0 && --node->slicesToFail == 0) {
+		return false;
+	}
+	for (uint64_t received = 0; received < size;) {
+		const ssize_t result = read(node->links[peer], (uint8_t *)data + received, size - received);
+		if (result <= 0) {
+			return false;
+		}
+		received += (uint64_t)result;
+	}
+	return true;
+}
+
+static bool
+crypt(void * context __attribute__((unused)), uint32_t src, uint32_t dst, const void * in, void * out, uint64_t size)
+{
+	for (uint64_t i = 0; i < size; i++) {
+		((uint8_t *)out)[i] = ((const uint8_t *)in)[i] ^ keystream(src, dst, i);
+	}
+	return true;
+}
+
+static void *
+runNode(void * arg)
+{
+	Node * node           = (Node *)arg;
+	const AllToAllOps ops = {sendSlice, receiveSlice, crypt, crypt, node};
+	AllToAllExchange exchange(node->nodeCount, node->node, node->pairing, node->sliceSize, node->sliceSize, node->input,
+	                          node->output, node->staging, ops);
+	node->result = exchange.run();
+	if (!node->result) {
+		// Tearing the links down stops the peers.
+		for (uint32_t peer = 0; peer < node->nodeCount; peer++) {
+			if (peer != node->node) {
+				shutdown(node->links[peer], SHUT_RDWR);
+			}
+		}
+	}
+	return nullptr;
+}
+
+// Runs one exchange and returns how many nodes succeeded, checking the output
+// of those against the reference.
+static uint32_t
+runExchange(uint32_t nodeCount, AllToAllPairing pairing, uint64_t sliceSize, uint32_t failingNode = kMaxNodes)
+{
+	Node nodes[kMaxNodes] = {};
+	pthread_t threads[kMaxNodes];
+	for (uint32_t a = 0; a < nodeCount; a++) {
+		for (uint32_t b = a + 1; b < nodeCount; b++) {
+			int pair[2];
+			assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+			nodes[a].links[b] = pair[0];
+			nodes[b].links[a] = pair[1];
+		}
+	}
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		Node & node        = nodes[i];
+		node.input         = (uint8_t *)calloc(nodeCount, sliceSize);
+		node.output        = (uint8_t *)calloc(nodeCount, sliceSize);
+		node.staging       = (uint8_t *)calloc(nodeCount * nodeCount, sliceSize);
+		node.node          = i;
+		node.nodeCount     = nodeCount;
+		node.pairing       = pairing;
+		node.sliceSize     = sliceSize;
+		node.slicesToFail  = i == failingNode ? 2 : 0;
+		assert(node.input != nullptr && node.output != nullptr && node.staging != nullptr);
+		for (uint32_t dst = 0; dst < nodeCount; dst++) {
+			for (uint64_t index = 0; index < sliceSize; index++) {
+				node.input[dst * sliceSize + index] = plaintext(i, dst, index);
+			}
+		}
+	}
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		assert(pthread_create(&threads[i], nullptr, runNode, &nodes[i]) == 0);
+	}
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		pthread_join(threads[i], nullptr);
+	}
+
+	const uint8_t * inputs[kMaxNodes];
+	uint8_t * expected[kMaxNodes];
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		inputs[i]   = nodes[i].input;
+		expected[i] = (uint8_t *)calloc(nodeCount, sliceSize);
+		assert(expected[i] != nullptr);
+	}
+	AppleCIOMeshUtils::all_to_all_reference(nodeCount, sliceSize, inputs, expected);
+
+	uint32_t succeeded = 0;
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		Node & node = nodes[i];
+		if (node.result) {
+			succeeded++;
+			assert(memcmp(node.output, expected[i], nodeCount * sliceSize) == 0);
+		}
+		for (uint32_t peer = 0; peer < nodeCount; peer++) {
+			if (peer != i) {
+				close(node.links[peer]);
+			}
+		}
+		free(node.input);
+		free(node.output);
+		free(node.staging);
+		free(expected[i]);
+	}
+	return succeeded;
+}
+
+static void
+testReference()
+{
+	// Slice j of node i lands in slot i of node j.
+	uint8_t in[3][3];
+	uint8_t out[3][3];
+	const uint8_t * inputs[3] = {in[0], in[1], in[2]};
+	uint8_t * outputs[3]      = {out[0], out[1], out[2]};
+	for (uint32_t i = 0; i < 3; i++) {
+		for (uint32_t j = 0; j < 3; j++) {
+			in[i][j] = (uint8_t)(i * 10 + j);
+		}
+	}
+	AppleCIOMeshUtils::all_to_all_reference(3, 1, inputs, outputs);
+	for (uint32_t i = 0; i < 3; i++) {
+		for (uint32_t j = 0; j < 3; j++) {
+			assert(out[j][i] == i * 10 + j);
+		}
+	}
+	printf("validated reference.\n");
+}
+
+static void
+testPairings()
+{
+	for (uint32_t nodeCount = 2; nodeCount <= AppleCIOMeshUtils::kMaxCollectiveNodes; nodeCount++) {
+		for (AllToAllPairing pairing : {kAllToAllShift, kAllToAllXor}) {
+			const bool fits = AppleCIOMeshUtils::all_to_all_pairing_fits(pairing, nodeCount);
+			assert(fits == (pairing == kAllToAllShift || (nodeCount & (nodeCount - 1)) == 0));
+			if (!fits) {
+				continue;
+			}
+			// Every round is a permutation without fixed points and every
+			// ordered pair is served in exactly one round.
+			bool served[AppleCIOMeshUtils::kMaxCollectiveNodes][AppleCIOMeshUtils::kMaxCollectiveNodes] = {};
+			for (uint32_t round = 1; round < nodeCount; round++) {
+				bool receiving[AppleCIOMeshUtils::kMaxCollectiveNodes] = {};
+				for (uint32_t node = 0; node < nodeCount; node++) {
+					const uint32_t peer = AppleCIOMeshUtils::all_to_all_send_peer(pairing, nodeCount, node, round);
+					assert(peer < nodeCount && peer != node && !receiving[peer] && !served[node][peer]);
+					assert(AppleCIOMeshUtils::all_to_all_receive_peer(pairing, nodeCount, peer, round) == node);
+					receiving[peer]    = true;
+					served[node][peer] = true;
+				}
+			}
+		}
+	}
+
+	AppleCIOMeshUtils::CollectiveTopology topology;
+	AppleCIOMeshUtils::CollectiveSchedule schedule;
+	assert(AppleCIOMeshUtils::make_ensemble_topology(6, &topology));
+	assert(!AppleCIOMeshUtils::build_all_to_all_schedule(kAllToAllXor, topology, &schedule));
+	assert(AppleCIOMeshUtils::build_all_to_all_schedule(kAllToAllShift, topology, &schedule));
+	assert(schedule.stepCount == 5);
+	assert(AppleCIOMeshUtils::select_all_to_all_pairing(topology, 1 << 20, &schedule) == kAllToAllShift);
+	printf("validated pairings.\n");
+}
+
+static void
+testHotspots()
+{
+	// In an 8 node partition the shift pairing sends across the chassis in
+	// most rounds, so the cross chassis links carry several slices at once.
+	// The XOR pairing crosses them in one round only, one slice per link.
+	AppleCIOMeshUtils::CollectiveTopology topology;
+	AppleCIOMeshUtils::CollectiveSchedule schedule;
+	assert(AppleCIOMeshUtils::make_ensemble_topology(8, &topology));
+	const uint64_t sliceSize = 1 << 20;
+	assert(AppleCIOMeshUtils::build_all_to_all_schedule(kAllToAllShift, topology, &schedule));
+	const double shift = AppleCIOMeshUtils::estimate_collective_time(schedule, topology, sliceSize);
+	assert(AppleCIOMeshUtils::build_all_to_all_schedule(kAllToAllXor, topology, &schedule));
+	const double xorTime = AppleCIOMeshUtils::estimate_collective_time(schedule, topology, sliceSize);
+	assert(xorTime < shift);
+	assert(AppleCIOMeshUtils::select_all_to_all_pairing(topology, sliceSize, &schedule) == kAllToAllXor);
+	printf("validated hotspots.\n");
+}
+
+static void
+testExchange()
+{
+	for (uint32_t nodeCount = 2; nodeCount <= kMaxNodes; nodeCount++) {
+		for (AllToAllPairing pairing : {kAllToAllShift, kAllToAllXor}) {
+			if (AppleCIOMeshUtils::all_to_all_pairing_fits(pairing, nodeCount)) {
+				assert(runExchange(nodeCount, pairing, 4096) == nodeCount);
+				assert(runExchange(nodeCount, pairing, 1000) == nodeCount);
+			}
+		}
+	}
+
+	// Slices larger than the socket buffers need the sender and the receiver
+	// to run at the same time.
+	assert(runExchange(4, kAllToAllXor, 2 * 1024 * 1024) == 4);
+	assert(runExchange(5, kAllToAllShift, 1024 * 1024) == 5);
+	printf("validated exchange.\n");
+}
+
+static void
+testFailure()
+{
+	assert(runExchange(4, kAllToAllXor, 4096, 1) < 4);
+	assert(runExchange(7, kAllToAllShift, 256 * 1024, 3) < 7);
+
+	// Pairings that do not fit the node count are rejected.
+	Node node             = {};
+	const AllToAllOps ops = {sendSlice, receiveSlice, crypt, crypt, &node};
+	uint8_t buffer[3 * 3 * 16];
+	AllToAllExchange exchange(3, 0, kAllToAllXor, 16, 16, buffer, buffer, buffer, ops);
+	assert(!exchange.run());
+	printf("validated failure.\n");
+}
+
+// MARK: - Driver path
+
+static constexpr uint32_t kTagSize  = 16;
+static constexpr uint64_t kPageSize = 4096;
+
+// Stands in for the HKDF of the framework: the key of a rank in a key set, or
+// the prefix of its IVs.
+static uint64_t
+deriveKey(const char * label, uint32_t rank)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const char * c = label; *c; c++) {
+		hash = (hash ^ (uint8_t)*c) * 0x100000001b3ull;
+	}
+	return (hash ^ rank) * 0x100000001b3ull;
+}
+
+// A key set as setNodeKeys derives it, for the ranks of a partition.
+struct DriverKeySet {
+	uint64_t key[kMaxNodes];
+	uint64_t ivPrefix[kMaxNodes];
+	uint32_t ivCount[kMaxNodes];
+};
+
+static void
+deriveKeySet(uint64_t mask, AppleCIOMeshUtils::MeshKeyKind kind, DriverKeySet * keys)
+{
+	char keyInfo[128];
+	char ivInfo[128];
+	assert(AppleCIOMeshUtils::mesh_key_labels(mask, kind, keyInfo, sizeof(keyInfo), ivInfo, sizeof(ivInfo)));
+	for (uint32_t rank = 0; rank < kMaxNodes; rank++) {
+		keys->key[rank]      = deriveKey(keyInfo, rank);
+		keys->ivPrefix[rank] = deriveKey(ivInfo, rank);
+		keys->ivCount[rank]  = 0;
+	}
+}
+
+// Every key and IV an encryption used, across all the nodes of a test.
+struct NonceLog {
+	pthread_mutex_t lock;
+	uint64_t nonces[1024][3];
+	uint32_t count;
+
+	void
+	record(uint64_t key, uint64_t prefix, uint32_t ivCount)
+	{
+		pthread_mutex_lock(&lock);
+		assert(count < sizeof(nonces) / sizeof(nonces[0]));
+		nonces[count][0] = key;
+		nonces[count][1] = prefix;
+		nonces[count][2] = ivCount;
+		count++;
+		pthread_mutex_unlock(&lock);
+	}
+
+	bool
+	unique() const
+	{
+		for (uint32_t i = 0; i < count; i++) {
+			for (uint32_t j = i + 1; j < count; j++) {
+				if (memcmp(nonces[i], nonces[j], sizeof(nonces[i])) == 0) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+};
+
+// Stands in for AES-GCM: encrypts or decrypts data in place and returns the
+// tag, both depending on the key and the whole IV.
+static uint64_t
+gcm(uint64_t key, uint64_t prefix, uint32_t ivCount, uint8_t * data, uint64_t size, bool encrypt)
+{
+	uint64_t state = (key ^ prefix ^ ((uint64_t)ivCount << 32)) | 1;
+	uint64_t tag   = key;
+	for (uint64_t i = 0; i < size; i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		if (!encrypt) {
+			tag = (tag ^ data[i]) * 0x100000001b3ull;
+		}
+		data[i] ^= (uint8_t)state;
+		if (encrypt) {
+			tag = (tag ^ data[i]) * 0x100000001b3ull;
+		}
+	}
+	return tag;
+}
+
+// The shared memory of every node's all-to-all buffer, as the driver moves it:
+// a send copies the slot at an offset of the sender's shadow buffer to the
+// same offset of the receiver's, with its tag, and a receive waits for it.
+struct Driver {
+	pthread_mutex_t lock;
+	pthread_cond_t arrived;
+	uint32_t nodeCount;
+	uint64_t slotSize;
+	uint8_t * shadow[kMaxNodes];
+	bool landed[kMaxNodes][kMaxNodes * kMaxNodes];
+	char tags[kMaxNodes][kMaxNodes * kMaxNodes][kTagSize];
+};
+
+// What the all-to-all callbacks of a node share, like AllToAllContext.
+struct DriverNode {
+	Driver * driver;
+	NonceLog * log;
+	uint32_t node;
+	uint32_t slicesToFail;
+	DriverKeySet keys[kMaxNodes];
+	char sendTags[kMaxNodes][kTagSize];
+	char receiveTags[kMaxNodes][kTagSize];
+	uint8_t * input;
+	uint8_t * output;
+	bool result;
+};
+
+static bool
+driverSend(void * context, uint32_t peer, const void * data, uint64_t size __attribute__((unused)))
+{
+	DriverNode * node     = (DriverNode *)context;
+	Driver * driver       = node->driver;
+	const uint64_t offset = (uint64_t)((const uint8_t *)data - driver->shadow[node->node]);
+	const uint64_t slot   = offset / driver->slotSize;
+	assert(offset % driver->slotSize == 0 && slot < (uint64_t)driver->nodeCount * driver->nodeCount);
+
+	pthread_mutex_lock(&driver->lock);
+	assert(!driver->landed[peer][slot]);
+	memcpy(driver->shadow[peer] + offset, data, driver->slotSize);
+	memcpy(driver->tags[peer][slot], node->sendTags[peer], kTagSize);
+	driver->landed[peer][slot] = true;
+	pthread_cond_broadcast(&driver->arrived);
+	pthread_mutex_unlock(&driver->lock);
+	return true;
+}
+
+static bool
+driverReceive(void * context, uint32_t peer, void * data, uint64_t size __attribute__((unused)))
+{
+	DriverNode * node     = (DriverNode *)context;
+	Driver * driver       = node->driver;
+	const uint64_t offset = (uint64_t)((uint8_t *)data - driver->shadow[node->node]);
+	const uint64_t slot   = offset / driver->slotSize;
+	if (node->slicesToFail > 0 && --node->slicesToFail == 0) {
+		return false;
+	}
+
+	pthread_mutex_lock(&driver->lock);
+	while (!driver->landed[node->node][slot]) {
+		pthread_cond_wait(&driver->arrived, &driver->lock);
+	}
+	memcpy(node->receiveTags[peer], driver->tags[node->node][slot], kTagSize);
+	pthread_mutex_unlock(&driver->lock);
+	return true;
+}
+
+// Like allToAllSeal, with the key of the pair and the IV of the sender.
+static bool
+driverSeal(void * context, uint32_t src, uint32_t dst, const void * in, void * out, uint64_t size)
+{
+	DriverNode * node      = (DriverNode *)context;
+	DriverKeySet & set     = node->keys[dst];
+	const uint32_t ivCount = set.ivCount[src]++;
+	memcpy(out, in, size);
+	const uint64_t tag = gcm(set.key[src], set.ivPrefix[src], ivCount, (uint8_t *)out, size, true);
+	memset(node->sendTags[dst], 0, kTagSize);
+	memcpy(node->sendTags[dst], &tag, sizeof(tag));
+	node->log->record(set.key[src], set.ivPrefix[src], ivCount);
+	return true;
+}
+
+static bool
+driverOpen(void * context, uint32_t src, uint32_t dst __attribute__((unused)), const void * in, void * out, uint64_t size)
+{
+	DriverNode * node      = (DriverNode *)context;
+	DriverKeySet & set     = node->keys[src];
+	const uint32_t ivCount = set.ivCount[src]++;
+	memcpy(out, in, size);
+	const uint64_t tag = gcm(set.key[src], set.ivPrefix[src], ivCount, (uint8_t *)out, size, false);
+	return memcmp(node->receiveTags[src], &tag, sizeof(tag)) == 0;
+}
+
+static void *
+runDriverNode(void * arg)
+{
+	DriverNode * node        = (DriverNode *)arg;
+	Driver * driver          = node->driver;
+	const AllToAllOps ops    = {driverSend, driverReceive, driverSeal, driverOpen, node};
+	const uint64_t sliceSize = driver->slotSize - kPageSize / 2;
+	AllToAllExchange exchange(driver->nodeCount, node->node, kAllToAllShift, sliceSize, driver->slotSize, node->input,
+	                          node->output, driver->shadow[node->node], ops);
+	node->result = exchange.run();
+	return nullptr;
+}
+
+// Runs an all-to-all of the first nodeCount ranks over the driver path after
+// a broadcast of the same nodes, and returns how many nodes got the reference.
+static uint32_t
+runDriverExchange(uint32_t nodeCount, uint32_t failingNode = kMaxNodes)
+{
+	static Driver driver;
+	static DriverNode nodes[kMaxNodes];
+	static NonceLog log;
+	memset(&driver, 0, sizeof(driver));
+	memset(&nodes, 0, sizeof(nodes));
+	memset(&log, 0, sizeof(log));
+	pthread_mutex_init(&driver.lock, nullptr);
+	pthread_cond_init(&driver.arrived, nullptr);
+	pthread_mutex_init(&log.lock, nullptr);
+
+	// A slice that is not whole pages, the slots are.
+	driver.nodeCount         = nodeCount;
+	driver.slotSize          = 2 * kPageSize;
+	const uint64_t sliceSize = driver.slotSize - kPageSize / 2;
+	const uint64_t mask      = (1ull << nodeCount) - 1;
+
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		DriverNode & node = nodes[i];
+		node.driver       = &driver;
+		node.log          = &log;
+		node.node         = i;
+		node.slicesToFail = i == failingNode ? 2 : 0;
+		driver.shadow[i]  = (uint8_t *)calloc((uint64_t)nodeCount * nodeCount, driver.slotSize);
+		node.input        = (uint8_t *)calloc(nodeCount, sliceSize);
+		node.output       = (uint8_t *)calloc(nodeCount, sliceSize);
+		assert(driver.shadow[i] != nullptr && node.input != nullptr && node.output != nullptr);
+		for (uint32_t dst = 0; dst < nodeCount; dst++) {
+			for (uint64_t index = 0; index < sliceSize; index++) {
+				node.input[dst * sliceSize + index] = plaintext(i, dst, index);
+			}
+		}
+
+		// The broadcast before it encrypts each node's block with the keys of
+		// the node mask, from the first IV of the node.
+		DriverKeySet broadcast;
+		deriveKeySet(mask, AppleCIOMeshUtils::kMeshKeyNodeMask, &broadcast);
+		log.record(broadcast.key[i], broadcast.ivPrefix[i], broadcast.ivCount[i]++);
+
+		// The all-to-all keys of each pair, like populateMasks.
+		for (uint32_t peer = 0; peer < nodeCount; peer++) {
+			if (peer != i) {
+				deriveKeySet(AppleCIOMeshUtils::all_to_all_pair_mask(i, peer), AppleCIOMeshUtils::kMeshKeyPair,
+				             &node.keys[peer]);
+			}
+		}
+	}
+
+	pthread_t threads[kMaxNodes];
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		assert(pthread_create(&threads[i], nullptr, runDriverNode, &nodes[i]) == 0);
+	}
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		pthread_join(threads[i], nullptr);
+	}
+	assert(log.unique());
+
+	const uint8_t * inputs[kMaxNodes];
+	uint8_t * expected[kMaxNodes];
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		inputs[i]   = nodes[i].input;
+		expected[i] = (uint8_t *)calloc(nodeCount, sliceSize);
+		assert(expected[i] != nullptr);
+	}
+	AppleCIOMeshUtils::all_to_all_reference(nodeCount, sliceSize, inputs, expected);
+
+	uint32_t succeeded = 0;
+	for (uint32_t i = 0; i < nodeCount; i++) {
+		if (nodes[i].result) {
+			succeeded++;
+			assert(memcmp(nodes[i].output, expected[i], nodeCount * sliceSize) == 0);
+		}
+		free(driver.shadow[i]);
+		free(nodes[i].input);
+		free(nodes[i].output);
+		free(expected[i]);
+	}
+	pthread_mutex_destroy(&driver.lock);
+	pthread_cond_destroy(&driver.arrived);
+	pthread_mutex_destroy(&log.lock);
+	return succeeded;
+}
+
+static void
+testDriverPath()
+{
+	for (uint32_t nodeCount = 2; nodeCount <= kMaxNodes; nodeCount++) {
+		assert(runDriverExchange(nodeCount) == nodeCount);
+	}
+	// The others still get their slices from a node that fails to receive.
+	assert(runDriverExchange(4, 1) == 3);
+
+	// With the keys of the node mask, the pair of a 2 node mesh would encrypt
+	// its first slice with the key and IV its broadcast block used.
+	DriverKeySet pair;
+	DriverKeySet broadcast;
+	deriveKeySet(0x3, AppleCIOMeshUtils::kMeshKeyPair, &pair);
+	deriveKeySet(0x3, AppleCIOMeshUtils::kMeshKeyNodeMask, &broadcast);
+	for (uint32_t rank = 0; rank < 2; rank++) {
+		assert(pair.key[rank] != broadcast.key[rank] && pair.ivPrefix[rank] != broadcast.ivPrefix[rank]);
+	}
+	printf("validated driver path.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	signal(SIGPIPE, SIG_IGN);
+	testReference();
+	testPairings();
+	testHotspots();
+	testExchange();
+	testFailure();
+	testDriverPath();
+	return 0;
+}
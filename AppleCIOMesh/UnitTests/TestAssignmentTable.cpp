@@ -0,0 +1,221 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestAssignmentTable.cpp
+//  AppleCIOMesh
+//
+//  Checks that assignment columns grow to thousands of entries without moving
+//  the ones already there, that reserve refuses to go past the last segment,
+//  and that the offset index agrees with a linear scan. Also reads a column on
+//  another thread while it is appended to.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestAssignmentTable.cpp
+//
+
+#include "Common/AssignmentTable.h"
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+static int64_t liveAllocations = 0;
+
+struct CountingAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		__atomic_fetch_add(&liveAllocations, 1, __ATOMIC_RELAXED);
+		return (U *)calloc(count, sizeof(U));
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t)
+	{
+		__atomic_fetch_sub(&liveAllocations, 1, __ATOMIC_RELAXED);
+		free(memory);
+	}
+};
+
+using Column = AppleCIOMeshUtils::SegmentedArray<uint32_t, 256, 64, CountingAllocator>;
+using Index  = AppleCIOMeshUtils::OffsetIndex<CountingAllocator>;
+
+static void
+testColumnGrows()
+{
+	{
+		Column column;
+		assert(column.count() == 0);
+		assert(liveAllocations == 0);
+
+		assert(column.append(0));
+		uint32_t * first = &column[0];
+		assert(liveAllocations == 1);
+
+		for (uint32_t i = 1; i < 10000; i++) {
+			assert(column.append(i * 3));
+		}
+		assert(column.count() == 10000);
+		assert(liveAllocations == (10000 + 255) / 256);
+		// Growing never moves an entry.
+		assert(first == &column[0]);
+		for (uint32_t i = 0; i < 10000; i++) {
+			assert(column[i] == i * 3);
+		}
+
+		// Clearing keeps the segments for the next buffer set.
+		const int64_t segments = liveAllocations;
+		column.clear();
+		assert(column.count() == 0);
+		assert(column.append(7));
+		assert(column[0] == 7);
+		assert(liveAllocations == segments);
+
+		column.reset();
+		assert(column.count() == 0);
+		assert(liveAllocations == 0);
+		assert(column.append(9));
+	}
+	assert(liveAllocations == 0);
+
+	printf("validated column grows.\n");
+}
+
+static void
+testColumnLimit()
+{
+	{
+		Column column;
+		assert(!column.reserve(Column::kMaxEntries + 1));
+		assert(column.reserve(Column::kMaxEntries));
+		for (uint32_t i = 0; i < Column::kMaxEntries; i++) {
+			assert(column.append(i));
+		}
+		assert(!column.reserve(1));
+		assert(!column.append(0));
+		assert(column.count() == Column::kMaxEntries);
+		assert(column[Column::kMaxEntries - 1] == Column::kMaxEntries - 1);
+		assert(column.reserve(0));
+	}
+	assert(liveAllocations == 0);
+
+	printf("validated column limit.\n");
+}
+
+static uint32_t
+scan(const std::vector<int64_t> & offsets, int64_t offset)
+{
+	for (size_t i = 0; i < offsets.size(); i++) {
+		if (offsets[i] == offset) {
+			return (uint32_t)i;
+		}
+	}
+	return AppleCIOMeshUtils::kAssignmentNotFound;
+}
+
+static void
+testIndexAgainstScan()
+{
+	{
+		Index index;
+		assert(index.find(0) == AppleCIOMeshUtils::kAssignmentNotFound);
+		assert(!index.insert(-1, 0));
+
+		// Offsets of chunks, each added once per link the way receive
+		// assignments are, with a few gaps that are never assigned.
+		const int64_t kChunkSize = 16384;
+		std::vector<int64_t> offsets;
+		srand(3);
+		for (int64_t chunk = 0; chunk < 8000; chunk++) {
+			if (rand() % 10 == 0) {
+				continue;
+			}
+			const int links = 1 + rand() % 4;
+			for (int link = 0; link < links; link++) {
+				assert(index.reserve(1));
+				assert(index.insert(chunk * kChunkSize, (uint32_t)offsets.size()));
+				offsets.push_back(chunk * kChunkSize);
+			}
+		}
+		assert(offsets.size() > 8000);
+
+		// The first entry for an offset is the one found.
+		for (int64_t chunk = 0; chunk < 8000; chunk++) {
+			assert(index.find(chunk * kChunkSize) == scan(offsets, chunk * kChunkSize));
+			assert(index.find(chunk * kChunkSize + 1) == AppleCIOMeshUtils::kAssignmentNotFound);
+		}
+
+		index.clear();
+		assert(index.count() == 0);
+		assert(index.find(0) == AppleCIOMeshUtils::kAssignmentNotFound);
+		assert(index.insert(0, 5));
+		assert(index.find(0) == 5);
+
+		index.reset();
+		assert(liveAllocations == 0);
+		assert(index.find(0) == AppleCIOMeshUtils::kAssignmentNotFound);
+	}
+	assert(liveAllocations == 0);
+
+	printf("validated index against scan.\n");
+}
+
+static void
+testReaderWhileAppending()
+{
+	const uint32_t kEntries = 16384;
+	{
+		Column column;
+		bool done = false;
+
+		std::thread reader([&] {
+			uint64_t reads = 0;
+			while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE) || reads == 0) {
+				// Everything below count() has been written, whichever
+				// segment it is in.
+				const uint32_t count = column.count();
+				for (uint32_t i = count > 64 ? count - 64 : 0; i < count; i++) {
+					assert(column[i] == i + 1);
+				}
+				reads++;
+			}
+		});
+
+		for (uint32_t i = 0; i < kEntries; i++) {
+			assert(column.append(i + 1));
+		}
+		__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+		reader.join();
+		assert(column.count() == kEntries);
+	}
+	assert(liveAllocations == 0);
+
+	printf("validated reader while appending.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testColumnGrows();
+	testColumnLimit();
+	testIndexAgainstScan();
+	testReaderWhileAppending();
+	return 0;
+}
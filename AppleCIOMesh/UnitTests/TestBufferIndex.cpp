@@ -0,0 +1,239 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestBufferIndex.cpp
+//  AppleCIOMesh
+//
+//  Checks the buffer index against a plain array for thousands of buffers
+//  coming and going, that tombstones are dropped by rebuilding instead of
+//  growing the table, and that retired tables are only freed once no reader
+//  is left. Also runs lock-free readers against a writer on other threads.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestBufferIndex.cpp
+//
+
+#include "Common/BufferIndex.h"
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+static int64_t liveAllocations = 0;
+
+struct CountingAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		__atomic_fetch_add(&liveAllocations, 1, __ATOMIC_RELAXED);
+		return (U *)calloc(count, sizeof(U));
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t)
+	{
+		__atomic_fetch_sub(&liveAllocations, 1, __ATOMIC_RELAXED);
+		free(memory);
+	}
+};
+
+struct Buffer {
+	int64_t id;
+};
+
+using Index = AppleCIOMeshUtils::BufferIndex<Buffer, CountingAllocator>;
+
+static void
+testAgainstArray()
+{
+	const int64_t kBuffers = 4096;
+	std::vector<Buffer> buffers(kBuffers);
+	std::vector<bool> present(kBuffers, false);
+
+	{
+		Index index;
+		assert(index.find(1) == nullptr);
+		assert(index.remove(1) == nullptr);
+
+		for (int64_t i = 0; i < kBuffers; i++) {
+			buffers[(size_t)i].id = i + 1;
+		}
+
+		assert(!index.insert(0, &buffers[0]));
+		assert(!index.insert(Index::kTombstone, &buffers[0]));
+		assert(!index.insert(1, nullptr));
+
+		srand(7);
+		uint32_t live = 0;
+		for (int step = 0; step < 200000; step++) {
+			const int64_t i = rand() % kBuffers;
+			Buffer * b      = &buffers[(size_t)i];
+			if (rand() % 3 != 0) {
+				assert(index.insert(b->id, b) == !present[(size_t)i]);
+				live += present[(size_t)i] ? 0 : 1;
+				present[(size_t)i] = true;
+			} else {
+				assert(index.remove(b->id) == (present[(size_t)i] ? b : nullptr));
+				live -= present[(size_t)i] ? 1 : 0;
+				present[(size_t)i] = false;
+			}
+			assert(index.count() == live);
+
+			const int64_t probe = rand() % kBuffers;
+			assert(index.find(probe + 1) == (present[(size_t)probe] ? &buffers[(size_t)probe] : nullptr));
+		}
+
+		for (int64_t i = 0; i < kBuffers; i++) {
+			assert(index.find(i + 1) == (present[(size_t)i] ? &buffers[(size_t)i] : nullptr));
+		}
+		assert(index.find(kBuffers + 1) == nullptr);
+		// Nobody was reading, so nothing was left retired.
+		assert(!index.hasRetired());
+
+		index.removeAll();
+		assert(index.count() == 0);
+		for (int64_t i = 0; i < kBuffers; i++) {
+			assert(index.find(i + 1) == nullptr);
+		}
+	}
+	assert(liveAllocations == 0);
+
+	printf("validated against array.\n");
+}
+
+static void
+testTombstonesDontGrow()
+{
+	Buffer buffer = {1};
+	Index index;
+
+	// One buffer allocated and freed over and over under new ids, as a
+	// process going through buffer sets does.
+	for (int64_t id = 1; id < 100000; id++) {
+		assert(index.insert(id, &buffer));
+		assert(index.find(id) == &buffer);
+		assert(index.remove(id) == &buffer);
+	}
+	assert(index.capacity() == Index::kMinCapacity);
+	assert(index.rebuilds() > 1000);
+
+	printf("validated tombstones don't grow.\n");
+}
+
+static void
+testRetiredWaitForReaders()
+{
+	std::vector<Buffer> buffers(64);
+	Index index;
+	for (int64_t i = 0; i < 8; i++) {
+		buffers[(size_t)i].id = i + 1;
+		assert(index.insert(i + 1, &buffers[(size_t)i]));
+	}
+
+	// A reader parked inside find keeps every table it could be looking at.
+	index.enterReader();
+	const uint32_t rebuilds = index.rebuilds();
+	for (int64_t i = 8; i < 64; i++) {
+		buffers[(size_t)i].id = i + 1;
+		assert(index.insert(i + 1, &buffers[(size_t)i]));
+	}
+	assert(index.rebuilds() > rebuilds);
+	assert(index.hasRetired());
+
+	index.exitReader();
+	index.reclaim();
+	assert(!index.hasRetired());
+	for (int64_t i = 0; i < 64; i++) {
+		assert(index.find(i + 1) == &buffers[(size_t)i]);
+	}
+
+	printf("validated retired wait for readers.\n");
+}
+
+static void
+testThreads()
+{
+	const int64_t kStable  = 1024;
+	const int64_t kChurned = 4096;
+	std::vector<Buffer> buffers((size_t)(kStable + kChurned));
+	for (size_t i = 0; i < buffers.size(); i++) {
+		buffers[i].id = (int64_t)i + 1;
+	}
+
+	{
+		Index index;
+		for (int64_t i = 0; i < kStable; i++) {
+			assert(index.insert(i + 1, &buffers[(size_t)i]));
+		}
+
+		bool done = false;
+		std::vector<std::thread> readers;
+		for (int r = 0; r < 3; r++) {
+			readers.emplace_back([&, r] {
+				uint64_t lookups = 0;
+				int64_t id       = r;
+				while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+					// The stable buffers must always be found, whatever the
+					// writer is doing to the table around them.
+					id         = (id + 7) % kStable;
+					Buffer * b = index.find(id + 1);
+					assert(b == &buffers[(size_t)id]);
+					assert(b->id == id + 1);
+
+					// A churned one is either there or not, never another.
+					const int64_t churned = kStable + (int64_t)(lookups % kChurned);
+					b                     = index.find(churned + 1);
+					assert(b == nullptr || b == &buffers[(size_t)churned]);
+					lookups++;
+				}
+			});
+		}
+
+		for (int round = 0; round < 20; round++) {
+			for (int64_t i = kStable; i < kStable + kChurned; i++) {
+				assert(index.insert(i + 1, &buffers[(size_t)i]));
+			}
+			for (int64_t i = kStable; i < kStable + kChurned; i++) {
+				assert(index.remove(i + 1) == &buffers[(size_t)i]);
+			}
+		}
+		__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+		for (auto & reader : readers) {
+			reader.join();
+		}
+
+		index.reclaim();
+		assert(!index.hasRetired());
+		assert(index.count() == kStable);
+	}
+	assert(liveAllocations == 0);
+
+	printf("validated threads.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testAgainstArray();
+	testTombstonesDontGrow();
+	testRetiredWaitForReaders();
+	testThreads();
+	return 0;
+}
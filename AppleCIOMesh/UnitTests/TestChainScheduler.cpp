@@ -0,0 +1,236 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestChainScheduler.cpp
+//  AppleCIOMesh
+//
+//  Checks that the slab pool hands out the lowest free entry, grows a slab at
+//  a time until the allocator fails, keeps its entries in place as it grows
+//  and gives slabs back when trimmed, and that the chain scheduler
+//  starts the oldest pending sync first or goes by chain id when asked to.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestChainScheduler.cpp
+//
+
+#include "Common/ChainScheduler.h"
+#include "Common/SlabPool.h"
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <type_traits>
+
+using AppleCIOMeshUtils::ForwardChainScheduler;
+using AppleCIOMeshUtils::kChainDeadline;
+using AppleCIOMeshUtils::kChainDiscoveryOrder;
+using AppleCIOMeshUtils::PendingChainStart;
+using AppleCIOMeshUtils::SlabPool;
+
+struct Entry {
+	uint64_t value;
+};
+
+// Slabs of Entry, everything else the pool allocates is a directory.
+static uint32_t liveSlabs;
+static uint32_t liveDirectories;
+// The allocator fails rather than go past this many live slabs.
+static uint32_t slabLimit = UINT32_MAX;
+
+struct CountingAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		if (std::is_same<U, Entry>::value) {
+			if (liveSlabs == slabLimit) {
+				return nullptr;
+			}
+			liveSlabs++;
+		} else {
+			liveDirectories++;
+		}
+		return (U *)calloc(count, sizeof(U));
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t)
+	{
+		if (std::is_same<U, Entry>::value) {
+			liveSlabs--;
+		} else {
+			liveDirectories--;
+		}
+		free(memory);
+	}
+};
+
+static void
+testSlabPool()
+{
+	{
+		// Slabs that don't fill a bitmap word.
+		SlabPool<Entry, 24, CountingAllocator> pool;
+		const uint32_t kEntries = 4 * 24;
+		uint32_t index;
+		assert(pool.capacity() == 0);
+		for (uint32_t i = 0; i < kEntries; i++) {
+			assert(pool.allocate(&index));
+			assert(index == i);
+			assert(pool.get(index)->value == 0);
+			pool.get(index)->value = i + 1;
+		}
+		// The pool only stops growing when the allocator fails.
+		slabLimit = 4;
+		assert(!pool.allocate(&index));
+		slabLimit = UINT32_MAX;
+		assert(pool.slabCount() == 4);
+		assert(liveSlabs == 4);
+		assert(liveDirectories == 1);
+
+		// Released entries come back lowest first, as they were left.
+		pool.release(70);
+		pool.release(5);
+		pool.release(5);
+		assert(pool.inUse() == kEntries - 2);
+		assert(!pool.isAllocated(5));
+		assert(pool.allocate(&index) && index == 5);
+		assert(pool.get(index)->value == 6);
+		assert(pool.allocate(&index) && index == 70);
+		assert(pool.slabCount() == 4);
+
+		// Only the empty slabs at the end are freed.
+		for (uint32_t i = 24; i < kEntries; i++) {
+			pool.release(i);
+		}
+		pool.allocate(&index);
+		assert(index == 24);
+		pool.trim();
+		assert(pool.slabCount() == 2);
+		assert(pool.capacity() == 48);
+		pool.release(24);
+		pool.trim();
+		assert(pool.slabCount() == 1);
+		assert(liveSlabs == 1);
+
+		// Releasing everything keeps the slabs around.
+		pool.releaseAll();
+		assert(pool.inUse() == 0);
+		assert(pool.slabCount() == 1);
+		assert(pool.allocate(&index) && index == 0);
+	}
+	assert(liveSlabs == 0 && liveDirectories == 0);
+
+	{
+		// Entries stay where they are as the directory of slabs doubles.
+		SlabPool<Entry, 24, CountingAllocator> pool;
+		uint32_t index;
+		assert(pool.allocate(&index) && index == 0);
+		Entry * first = pool.get(0);
+		first->value  = 1;
+		for (uint32_t i = 1; i < 100 * 24; i++) {
+			assert(pool.allocate(&index) && index == i);
+			pool.get(index)->value = i + 1;
+		}
+		assert(pool.slabCount() == 100 && liveSlabs == 100);
+		// 4, 8, 16, 32, 64 and 128 slabs, the outgrown ones are kept for get.
+		assert(liveDirectories == 6);
+		assert(pool.get(0) == first && first->value == 1);
+		for (uint32_t i = 0; i < 100 * 24; i++) {
+			assert(pool.get(i)->value == i + 1);
+		}
+		pool.reset();
+		assert(pool.capacity() == 0);
+		assert(liveSlabs == 0 && liveDirectories == 0);
+		assert(pool.allocate(&index) && index == 0);
+	}
+	assert(liveSlabs == 0 && liveDirectories == 0);
+
+	{
+		SlabPool<Entry, 128, CountingAllocator> pool;
+		uint32_t index;
+		for (uint32_t i = 0; i < 129; i++) {
+			assert(pool.allocate(&index) && index == i);
+		}
+		assert(pool.slabCount() == 2);
+		pool.release(64);
+		assert(pool.allocate(&index) && index == 64);
+		pool.reset();
+		assert(pool.slabCount() == 0 && pool.inUse() == 0);
+		assert(liveSlabs == 0 && liveDirectories == 0);
+	}
+
+	printf("validated slab pool.\n");
+}
+
+static void
+testScheduler()
+{
+	ForwardChainScheduler<8> scheduler;
+	PendingChainStart start;
+	assert(!scheduler.next(&start));
+
+	// The oldest sync goes first whatever chain it is for.
+	assert(scheduler.submit(5, 16, 100));
+	assert(scheduler.submit(2, 16, 300));
+	assert(scheduler.submit(7, 32, 50));
+	assert(scheduler.submit(1, 16, 300));
+	assert(scheduler.count() == 4);
+	assert(scheduler.next(&start) && start.chain == 7 && start.elements == 32);
+	assert(scheduler.next(&start) && start.chain == 5);
+	// Equal deadlines go in the order they were submitted.
+	assert(scheduler.next(&start) && start.chain == 2);
+	assert(scheduler.next(&start) && start.chain == 1);
+	assert(!scheduler.next(&start));
+
+	// Switching policy reorders what is pending.
+	scheduler.submit(5, 16, 100);
+	scheduler.submit(2, 16, 300);
+	scheduler.submit(5, 16, 400);
+	scheduler.submit(7, 16, 50);
+	scheduler.setPolicy(kChainDiscoveryOrder);
+	assert(scheduler.next(&start) && start.chain == 2);
+	assert(scheduler.next(&start) && start.chain == 5 && start.deadline == 100);
+	scheduler.setPolicy(kChainDeadline);
+	scheduler.submit(3, 16, 10);
+	assert(scheduler.next(&start) && start.chain == 3);
+
+	// A chain that goes away takes its pending starts with it.
+	scheduler.submit(7, 16, 500);
+	assert(scheduler.removeChain(7) == 2);
+	assert(scheduler.removeChain(7) == 0);
+	assert(scheduler.next(&start) && start.chain == 5 && start.deadline == 400);
+	assert(scheduler.count() == 0);
+
+	for (uint32_t i = 0; i < 8; i++) {
+		assert(scheduler.submit(i, 16, 1000 - i));
+	}
+	assert(!scheduler.submit(8, 16, 0));
+	for (uint32_t i = 8; i-- > 0;) {
+		assert(scheduler.next(&start) && start.chain == i);
+	}
+
+	printf("validated scheduler.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testSlabPool();
+	testScheduler();
+	return 0;
+}
@@ -0,0 +1,264 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestChunkTable.cpp
+//  AppleCIOMesh
+//
+//  Checks that the default chunk sizes match the thresholds the mesh always
+//  used, looks up, compacts, stores and parses chunk tables, and tunes chunk
+//  counts against a model of a pipelined sync. This test has no platform
+//  dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestChunkTable.cpp
+//
+
+#include "Common/ChunkTable.h"
+#include <cassert>
+#include <initializer_list>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::ChunkTable;
+
+static constexpr uint64_t kMaxChunkSize = 15 * 1024 * 1024;
+
+// The chunk sizes of the mesh before there were chunk tables.
+static uint64_t
+legacyChunkSize(uint64_t blockSize)
+{
+	if (blockSize <= 128 * 1024) {
+		return blockSize;
+	} else if (blockSize <= 256 * 1024) {
+		return blockSize / 2;
+	}
+	uint8_t divisor    = 4;
+	uint64_t chunkSize = blockSize / divisor;
+	while (chunkSize > kMaxChunkSize) {
+		divisor *= 2;
+		chunkSize = blockSize / divisor;
+		if (divisor == 128) {
+			return 0;
+		}
+	}
+	return chunkSize;
+}
+
+static void
+testDefaults()
+{
+	for (uint64_t blockSize = 128; blockSize <= 2048ull * 1024 * 1024; blockSize += blockSize / 3 + 128) {
+		blockSize -= blockSize % 128;
+		assert(AppleCIOMeshUtils::chunk_size_for_count(blockSize, 0, kMaxChunkSize) == legacyChunkSize(blockSize));
+	}
+	for (uint64_t blockSize : {128ull * 1024, 128ull * 1024 + 128, 256ull * 1024, 256ull * 1024 + 128, 60ull * 1024 * 1024,
+	                           60ull * 1024 * 1024 + 128, 960ull * 1024 * 1024, 1024ull * 1024 * 1024}) {
+		assert(AppleCIOMeshUtils::chunk_size_for_count(blockSize, 0, kMaxChunkSize) == legacyChunkSize(blockSize));
+	}
+
+	// Counts that do not divide the block are halved, counts making too large
+	// chunks doubled.
+	assert(AppleCIOMeshUtils::chunk_size_for_count(96, 64, kMaxChunkSize) == 3);
+	assert(AppleCIOMeshUtils::chunk_size_for_count(96, 4, kMaxChunkSize) == 24);
+	assert(AppleCIOMeshUtils::chunk_size_for_count(64ull * 1024 * 1024, 1, kMaxChunkSize) == 8ull * 1024 * 1024);
+	assert(AppleCIOMeshUtils::chunk_size_for_count(64ull * 1024, 64, kMaxChunkSize) == 1024);
+	// Invalid counts fall back to the default.
+	assert(AppleCIOMeshUtils::chunk_size_for_count(1024ull * 1024, 128, kMaxChunkSize) == 256ull * 1024);
+	printf("validated defaults.\n");
+}
+
+static void
+testLookup()
+{
+	ChunkTable table;
+	assert(table.chunk_count(1024, 8) == 0);
+
+	assert(table.set(8, 256 * 1024, 2));
+	assert(table.set(8, 128 * 1024, 1));
+	assert(table.set(8, 16 * 1024 * 1024, 8));
+	assert(table.set(2, 1024 * 1024, 4));
+	assert(table.set(32, 1024 * 1024, 16));
+	assert(table.count() == 5);
+	// Replacing an entry does not add one.
+	assert(table.set(8, 16 * 1024 * 1024, 4));
+	assert(table.count() == 5);
+	for (uint32_t i = 1; i < table.count(); i++) {
+		const auto & previous = table.entry(i - 1);
+		const auto & entry    = table.entry(i);
+		assert(previous.nodeCount < entry.nodeCount ||
+		       (previous.nodeCount == entry.nodeCount && previous.blockSize < entry.blockSize));
+	}
+
+	for (uint32_t chunkCount : {0u, 3u, 6u, 128u}) {
+		assert(!table.set(8, 1024, chunkCount));
+	}
+	assert(!table.set(0, 1024, 1));
+	assert(!table.set(8, 0, 1));
+
+	// Entries cover the block sizes up to theirs, the largest everything
+	// above.
+	assert(table.chunk_count(1024, 8) == 1);
+	assert(table.chunk_count(128 * 1024, 8) == 1);
+	assert(table.chunk_count(128 * 1024 + 128, 8) == 2);
+	assert(table.chunk_count(256 * 1024, 8) == 2);
+	assert(table.chunk_count(1024 * 1024, 8) == 4);
+	assert(table.chunk_count(1024ull * 1024 * 1024, 8) == 4);
+
+	// Node counts not in the table use the closest, the smaller one on a tie.
+	assert(table.chunk_count(1024, 2) == 4);
+	assert(table.chunk_count(1024, 4) == 4);
+	assert(table.chunk_count(1024, 5) == 4);
+	assert(table.chunk_count(1024, 6) == 1);
+	assert(table.chunk_count(1024, 16) == 1);
+	assert(table.chunk_count(1024, 20) == 1);
+	assert(table.chunk_count(1024, 21) == 16);
+	assert(table.chunk_count(1024, 64) == 16);
+	printf("validated lookup.\n");
+}
+
+static void
+testCompact()
+{
+	ChunkTable table;
+	const uint32_t counts[] = {1, 1, 2, 2, 2, 4, 4};
+	for (uint32_t i = 0; i < 7; i++) {
+		assert(table.set(4, 64ull * 1024 << i, counts[i]));
+		assert(table.set(8, 64ull * 1024 << i, 2));
+	}
+	ChunkTable compacted = table;
+	compacted.compact();
+	assert(compacted.count() == 4);
+	for (uint32_t nodeCount : {4u, 8u}) {
+		for (uint64_t blockSize = 1024; blockSize <= 64ull * 1024 * 1024; blockSize *= 2) {
+			assert(compacted.chunk_count(blockSize, nodeCount) == table.chunk_count(blockSize, nodeCount));
+		}
+	}
+	printf("validated compact.\n");
+}
+
+static void
+testText()
+{
+	ChunkTable table;
+	assert(table.parse("# nodes block-size chunks\n"
+	                   "8 131072 1\n"
+	                   "\n"
+	                   "  8   262144 2   # comment\n"
+	                   "2 1048576 4"));
+	assert(table.count() == 3);
+	assert(table.chunk_count(200 * 1024, 8) == 2);
+	assert(table.chunk_count(1024, 2) == 4);
+	assert(table.parse(""));
+	assert(table.count() == 0);
+
+	for (const char * bad : {"8 131072", "8 131072 1 1", "8 131072 3", "x 1 1", "8 131072 1\n8 1 x"}) {
+		assert(table.set(8, 1024, 1));
+		assert(!table.parse(bad));
+		assert(table.count() == 0);
+	}
+
+	// What is saved loads back the same.
+	for (uint32_t i = 0; i < 20; i++) {
+		assert(table.set(2 + i % 3, 1000 + 128 * i, 1u << (i % 7)));
+	}
+	char path[] = "/tmp/TestChunkTable.XXXXXX";
+	const int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+	assert(table.save(path) == 0);
+	ChunkTable loaded;
+	assert(loaded.load(path) == 0);
+	assert(loaded.count() == table.count());
+	for (uint32_t i = 0; i < table.count(); i++) {
+		assert(loaded.entry(i).nodeCount == table.entry(i).nodeCount);
+		assert(loaded.entry(i).blockSize == table.entry(i).blockSize);
+		assert(loaded.entry(i).chunkCount == table.entry(i).chunkCount);
+	}
+	unlink(path);
+	assert(loaded.load(path) == ENOENT);
+	printf("validated text.\n");
+}
+
+// A sync where each chunk is encrypted, sent and decrypted in a pipeline: the
+// stages overlap better with more chunks, but every chunk costs overhead.
+struct Model {
+	double overheadPerChunk;
+	double bytesPerSecond;
+	uint32_t calls;
+	double noise;
+};
+
+static double
+modelSync(void * context, uint32_t nodeCount, uint64_t blockSize, uint32_t chunkCount)
+{
+	Model * model          = (Model *)context;
+	const double stage     = (double)blockSize / chunkCount / model->bytesPerSecond + model->overheadPerChunk;
+	const double pipelined = stage * (chunkCount + 2) * (nodeCount - 1);
+	// Every third measurement is an outlier the median has to ignore.
+	return pipelined * (++model->calls % 3 == 0 ? 1 + model->noise : 1);
+}
+
+static double
+unusable(void *, uint32_t, uint64_t, uint32_t chunkCount)
+{
+	return chunkCount == 2 ? -1 : (double)chunkCount;
+}
+
+static void
+testTune()
+{
+	// With overhead o and bandwidth b the best count is about
+	// sqrt(2 * blockSize / (b * o)).
+	Model model = {10e-6, 10e9, 0, 5};
+	for (uint64_t blockSize : {64ull * 1024, 1024ull * 1024, 16ull * 1024 * 1024}) {
+		uint32_t best   = 0;
+		double bestTime = 0;
+		for (uint32_t chunkCount = 1; chunkCount <= 64; chunkCount *= 2) {
+			const double stage = (double)blockSize / chunkCount / model.bytesPerSecond + model.overheadPerChunk;
+			if (best == 0 || stage * (chunkCount + 2) < bestTime) {
+				best     = chunkCount;
+				bestTime = stage * (chunkCount + 2);
+			}
+		}
+		assert(AppleCIOMeshUtils::tune_chunk_count(modelSync, &model, 8, blockSize, 64, 5, 0) == best);
+	}
+
+	// More chunks have to be better than the best so far by the minimum
+	// improvement: here n chunks take (n + 2) / n of the time of the transfer.
+	Model flat = {1, 1e12, 0, 0};
+	assert(AppleCIOMeshUtils::tune_chunk_count(modelSync, &flat, 2, 1024, 64, 1, 0) == 1);
+	Model even = {0, 1024, 0, 0};
+	assert(AppleCIOMeshUtils::tune_chunk_count(modelSync, &even, 2, 1024, 64, 1, 0) == 64);
+	assert(AppleCIOMeshUtils::tune_chunk_count(modelSync, &even, 2, 1024, 64, 1, 0.2) == 16);
+	assert(AppleCIOMeshUtils::tune_chunk_count(modelSync, &even, 2, 1024, 64, 1, 0.4) == 4);
+	assert(AppleCIOMeshUtils::tune_chunk_count(modelSync, &even, 2, 1024, 64, 1, 0.7) == 1);
+	assert(AppleCIOMeshUtils::tune_chunk_count(modelSync, &even, 2, 1024, 8, 1, 0) == 8);
+
+	// Counts that can not be measured or do not divide the block are skipped.
+	assert(AppleCIOMeshUtils::tune_chunk_count(unusable, nullptr, 2, 1024, 64, 3, 0) == 1);
+	assert(AppleCIOMeshUtils::tune_chunk_count(modelSync, &even, 2, 24, 64, 1, 0) == 8);
+	printf("validated tune.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testDefaults();
+	testLookup();
+	testCompact();
+	testText();
+	testTune();
+	return 0;
+}
@@ -0,0 +1,363 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestCoalescingPolicy.cpp
+//  AppleCIOMesh
+//
+//  Feeds the coalescing policy synthetic traffic traces: small sync sized
+//  messages, back to back bulk sends and a flood of single frames. Checks the
+//  ring size and interrupt stride it settles on, that it only switches after
+//  the new sizing held for a while, and replays each trace to check the
+//  sizing beats the fixed 4096/128 on interrupts or on completion latency.
+//  Checks a ring never shrinks below the largest chunk put on it. Then reads
+//  the sizing from a second thread while the first records, and records the
+//  sync profile from several threads at once.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestCoalescingPolicy.cpp
+//
+
+#include "Common/CoalescingPolicy.h"
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+
+using AppleCIOMeshUtils::CoalescingPolicy;
+using AppleCIOMeshUtils::CoalescingPolicyConfig;
+using AppleCIOMeshUtils::CoalescingReplay;
+using AppleCIOMeshUtils::RingSizing;
+
+static constexpr uint32_t kFrame     = 4096;
+static constexpr uint64_t kWindow    = 1'000'000;
+static constexpr uint64_t kFlush     = 1'000'000;
+static constexpr RingSizing kDefault = {4096, 128};
+
+// No chunks go on these rings, so they may shrink all the way.
+static constexpr CoalescingPolicyConfig kConfig = {kFrame, 256, 4096, 0, 1, 512, kWindow, 50, 2 * kWindow, 4, kDefault};
+
+// A trace of count messages of bytes, one every gap nsec from start.
+struct Trace {
+	uint64_t start;
+	uint64_t gap;
+	uint64_t bytes;
+	uint32_t count;
+};
+
+static uint64_t
+feed(CoalescingPolicy & policy, const Trace & trace)
+{
+	uint64_t now = trace.start;
+	for (uint32_t i = 0; i < trace.count; i++) {
+		policy.record(now, trace.bytes);
+		now += trace.gap;
+	}
+	return now;
+}
+
+static CoalescingReplay
+replay(const Trace & trace, const RingSizing & sizing)
+{
+	CoalescingReplay replay;
+	replay.init(kFrame, sizing, kFlush);
+	uint64_t now = trace.start;
+	for (uint32_t i = 0; i < trace.count; i++) {
+		replay.message(now, trace.bytes);
+		now += trace.gap;
+	}
+	replay.finish();
+	return replay;
+}
+
+static void
+testReplay()
+{
+	// Messages a stride long interrupt once each and never wait.
+	CoalescingReplay exact = replay({1000, 100, 4 * kFrame, 100}, {256, 4});
+	assert(exact.messages() == 100);
+	assert(exact.interrupts() == 100);
+	assert(exact.waitTotal() == 0);
+
+	// Two frame messages on a stride of four: every other one waits for the
+	// next, and the last for the flush.
+	CoalescingReplay half = replay({1000, 100, 2 * kFrame, 11}, {256, 4});
+	assert(half.interrupts() == 5 + 1);
+	assert(half.waitTotal() == 5 * 100 + kFlush);
+	assert(half.waitMax() == kFlush);
+
+	// A stride no message fills flushes every kFlush.
+	CoalescingReplay flushed = replay({1000, 100'000, kFrame, 20}, kDefault);
+	assert(flushed.interrupts() == 2);
+	assert(flushed.waitMax() == kFlush);
+
+	printf("validated replay.\n");
+}
+
+static void
+testDefaultsUntilTraffic()
+{
+	CoalescingPolicy policy;
+	policy.init(kConfig);
+	assert(policy.sizing() == kDefault);
+
+	for (uint64_t now = 1; now < 100 * kWindow; now += kWindow / 3) {
+		policy.advance(now);
+	}
+	assert(policy.sizing() == kDefault);
+	assert(policy.stats().windows == 0);
+
+	// A few windows of traffic are not enough to switch.
+	feed(policy, {100 * kWindow, 100'000, 16 * 1024, 30});
+	assert(policy.sizing() == kDefault);
+	assert(policy.stats().windows >= 2 && policy.stats().changes == 0);
+
+	printf("validated defaults until traffic.\n");
+}
+
+static void
+testLatencyProfile()
+{
+	// 16KB sync blocks every 100us.
+	const Trace trace = {kWindow, 100'000, 16 * 1024, 1000};
+	CoalescingPolicy policy;
+	policy.init(kConfig);
+	feed(policy, trace);
+
+	const RingSizing sizing = policy.sizing();
+	assert(sizing.interruptStride == 4);
+	assert(sizing.ringSize == 256);
+	assert(!policy.stats().bulk);
+	assert(policy.stats().changes == 1);
+
+	// The fixed stride sits on every block until the flush.
+	CoalescingReplay fixed    = replay(trace, kDefault);
+	CoalescingReplay adaptive = replay(trace, sizing);
+	assert(adaptive.waitTotal() == 0);
+	assert(fixed.waitTotal() > trace.count * kFlush / 2);
+	assert(adaptive.interrupts() == trace.count);
+
+	printf("validated latency profile.\n");
+}
+
+static void
+testBulkProfile()
+{
+	// 4MB sends back to back at about 5GB/s.
+	const Trace trace = {kWindow, 800'000, 4 * 1024 * 1024, 200};
+	CoalescingPolicy policy;
+	policy.init(kConfig);
+	feed(policy, trace);
+
+	const RingSizing sizing = policy.sizing();
+	assert(sizing.ringSize == 4096);
+	assert(sizing.interruptStride == 512);
+
+	CoalescingReplay fixed    = replay(trace, kDefault);
+	CoalescingReplay adaptive = replay(trace, sizing);
+	assert(adaptive.waitTotal() == 0 && fixed.waitTotal() == 0);
+	assert(adaptive.interrupts() * 4 == fixed.interrupts());
+
+	printf("validated bulk profile.\n");
+}
+
+static void
+testFloodGoesBulk()
+{
+	// Single frames every 2us would be 500 interrupts a window at a stride
+	// of one.
+	const Trace trace = {kWindow, 2'000, kFrame, 20'000};
+	CoalescingPolicy policy;
+	policy.init(kConfig);
+	feed(policy, trace);
+
+	assert(policy.stats().bulk);
+	const RingSizing sizing = policy.sizing();
+	assert(sizing.interruptStride == 16);
+	assert(sizing.ringSize == 1024);
+
+	// Within budget, and way fewer waits than the fixed stride.
+	const uint64_t windows    = trace.count * trace.gap / kWindow;
+	CoalescingReplay fixed    = replay(trace, kDefault);
+	CoalescingReplay adaptive = replay(trace, sizing);
+	assert(adaptive.interrupts() <= windows * kConfig.maxInterrupts);
+	assert(adaptive.waitTotal() * 4 < fixed.waitTotal());
+
+	// Once the flood is over and only sync blocks are left it goes back to a
+	// latency stride.
+	feed(policy, {trace.start + trace.count * trace.gap, 100'000, 16 * 1024, 2000});
+	assert(!policy.stats().bulk);
+	assert(policy.sizing().interruptStride == 4);
+
+	printf("validated flood goes bulk.\n");
+}
+
+static void
+testHysteresis()
+{
+	CoalescingPolicy policy;
+	policy.init(kConfig);
+
+	// Settle on the sync profile, then alternate single windows of a flood
+	// with it. No flood lasts long enough to switch.
+	uint64_t now = feed(policy, {kWindow, 100'000, 16 * 1024, 1000});
+	assert(policy.stats().changes == 1);
+	const RingSizing settled = policy.sizing();
+
+	for (uint32_t i = 0; i < 50; i++) {
+		now = feed(policy, {now, 2'000, kFrame, 500});
+		now = feed(policy, {now, 100'000, 16 * 1024, 30});
+	}
+	assert(!policy.stats().bulk);
+	assert(policy.stats().changes == 1);
+	assert(policy.sizing() == settled);
+
+	// Idle time in between is not traffic.
+	const uint64_t windows = policy.stats().windows;
+	now                    = feed(policy, {now + 1000 * kWindow, 100'000, 16 * 1024, 5});
+	assert(policy.stats().windows <= windows + 2);
+
+	printf("validated hysteresis.\n");
+}
+
+static void
+testRingHoldsChunk()
+{
+	// The sync profile shrinks the ring to 256 frames, a 2MB chunk would no
+	// longer fit on it.
+	const Trace trace   = {kWindow, 100'000, 16 * 1024, 1000};
+	const uint64_t kBuf = 2 * 1024 * 1024;
+	CoalescingPolicy shrunk;
+	shrunk.init(kConfig);
+	feed(shrunk, trace);
+	assert(shrunk.sizing().ringSize == 256);
+	assert(shrunk.sizing().ringSize * (uint64_t)kFrame < kBuf);
+
+	// Saying chunks that big go on it keeps the ring big enough, the stride
+	// still follows the traffic.
+	CoalescingPolicyConfig config = kConfig;
+	config.chunkBytes             = kBuf;
+	CoalescingPolicy held;
+	held.init(config);
+	feed(held, trace);
+	assert(held.sizing().ringSize == 512);
+	assert(held.sizing().interruptStride == 4);
+	assert(held.sizing().ringSize * (uint64_t)kFrame >= kBuf);
+
+	// Rounded up to a power of two.
+	config.chunkBytes = kBuf + kFrame;
+	held.init(config);
+	feed(held, trace);
+	assert(held.sizing().ringSize == 1024);
+
+	// The kext's chunks are at most 7.5MB per link, half the largest ring.
+	// The link's queue budget then follows the smaller ring.
+	held.init(AppleCIOMeshUtils::kDefaultCoalescingPolicy);
+	const uint64_t now = feed(held, trace);
+	assert(held.sizing().ringSize == 2048);
+	assert(held.sizing().ringSize * (uint64_t)kFrame >= AppleCIOMeshUtils::kDefaultCoalescingPolicy.chunkBytes);
+
+	// Bulk traffic still grows it to the largest ring.
+	feed(held, {now, 2'000, 16 * kFrame, 20'000});
+	assert(held.sizing().ringSize == 4096);
+
+	// More than the largest ring holds is capped at it.
+	config.chunkBytes = 64 * 1024 * 1024;
+	held.init(config);
+	feed(held, {kWindow, 2'000, kFrame, 20'000});
+	assert(held.sizing().ringSize == config.maxRingSize);
+
+	printf("validated ring holds chunk.\n");
+}
+
+static void
+testTwoThreads()
+{
+	CoalescingPolicy policy;
+	policy.init(kConfig);
+	bool done = false;
+
+	// Completions record on one thread while the link reads the sizing on
+	// another.
+	std::thread link([&] {
+		uint64_t reads = 0;
+		while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE) || reads == 0) {
+			const RingSizing sizing = policy.sizing();
+			assert(sizing.ringSize >= kConfig.minRingSize && sizing.ringSize <= kConfig.maxRingSize);
+			assert(sizing.interruptStride <= sizing.ringSize / 4);
+			reads++;
+		}
+	});
+
+	uint64_t now = kWindow;
+	for (uint32_t i = 0; i < 100; i++) {
+		now = feed(policy, {now, 2'000, kFrame, 1000});
+		now = feed(policy, {now, 100'000, 16 * 1024, 100});
+	}
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	link.join();
+
+	assert(policy.stats().messages == 100 * 1100);
+
+	printf("validated two threads.\n");
+}
+
+static void
+testConcurrentRecorders()
+{
+	// Completions on both links' workloops record into the same policy. A
+	// sync block lands every 100us between them.
+	static constexpr uint32_t kThreads = 4;
+	static constexpr uint32_t kEach    = 2500;
+	CoalescingPolicy policy;
+	policy.init(kConfig);
+	uint64_t clock = kWindow;
+
+	std::thread recorders[kThreads];
+	for (std::thread & recorder : recorders) {
+		recorder = std::thread([&] {
+			for (uint32_t i = 0; i < kEach; i++) {
+				policy.record(__atomic_fetch_add(&clock, 100'000, __ATOMIC_RELAXED), 16 * 1024);
+			}
+		});
+	}
+	for (std::thread & recorder : recorders) {
+		recorder.join();
+	}
+
+	const AppleCIOMeshUtils::CoalescingStats stats = policy.stats();
+	assert(stats.messages == kThreads * kEach);
+	assert(stats.bytes == kThreads * kEach * 16 * 1024);
+	assert(stats.windows > 0 && !stats.bulk);
+	assert(policy.sizing().interruptStride == 4);
+	assert(policy.sizing().ringSize == 256);
+
+	printf("validated concurrent recorders.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testReplay();
+	testDefaultsUntilTraffic();
+	testLatencyProfile();
+	testBulkProfile();
+	testFloodGoesBulk();
+	testHysteresis();
+	testRingHoldsChunk();
+	testTwoThreads();
+	testConcurrentRecorders();
+	return 0;
+}
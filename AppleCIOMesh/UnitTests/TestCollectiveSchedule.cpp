@@ -0,0 +1,277 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestCollectiveSchedule.cpp
+//  AppleCIOMesh
+//
+//  Checks that the portable route costs match the ensemble map, that every
+//  collective algorithm delivers every block to every node, and that the
+//  hierarchical exchange is picked where it keeps the network links from
+//  saturating. This test has no platform dependencies and can be built on
+//  Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestCollectiveSchedule.cpp
+//
+
+#include "Common/CollectiveSchedule.h"
+#include <cassert>
+#include <initializer_list>
+#include <stdint.h>
+#include <stdio.h>
+
+using namespace AppleCIOMeshUtils;
+
+static CollectiveTopology topology;
+static CollectiveSchedule schedule;
+
+// How MeshGetEnsembleMap fills in the costs for 2, 4, 8 and 16 nodes.
+static void
+legacyChassis(uint32_t * cost, uint32_t nodeCount, uint32_t chassisId, uint32_t nodesPerChassis)
+{
+	const uint32_t start = chassisId * nodesPerChassis;
+	for (uint32_t src = start; src < start + nodesPerChassis; src++) {
+		for (uint32_t dst = start; dst < start + nodesPerChassis; dst++) {
+			if (src != dst) {
+				cost[src * nodeCount + dst] = kCollectiveCioHop;
+			}
+		}
+	}
+}
+
+static void
+legacyInterChassis(uint32_t * cost, uint32_t nodeCount, uint32_t chassisId)
+{
+	const uint32_t startSrc = chassisId * 4, startDst = (chassisId + 1) * 4;
+	for (uint32_t src = startSrc; src < startSrc + 4; src++) {
+		for (uint32_t dst = startDst; dst < startDst + 4; dst++) {
+			const uint32_t hops = src + 4 == dst ? 1 : 2;
+			cost[src * nodeCount + dst] = cost[dst * nodeCount + src] = hops * kCollectiveCioHop;
+		}
+	}
+}
+
+static void
+legacyNetwork(uint32_t * cost, uint32_t nodeCount)
+{
+	for (uint32_t src = 0; src < 8; src++) {
+		for (uint32_t dst = 8; dst < 16; dst++) {
+			uint32_t hops;
+			if (src + 8 == dst) {
+				hops = 0;
+			} else if (src < 4) {
+				hops = (src + 12 == dst || dst / 4 == 2) ? 1 : 2;
+			} else {
+				hops = (src + 4 == dst || dst / 4 == 3) ? 1 : 2;
+			}
+			cost[src * nodeCount + dst] = cost[dst * nodeCount + src] = kCollectiveNetworkHop + hops * kCollectiveCioHop;
+		}
+	}
+}
+
+static void
+testRouteCosts()
+{
+	for (uint32_t nodeCount : {2u, 4u, 8u, 16u}) {
+		uint32_t legacy[16 * 16] = {};
+		if (nodeCount <= 4) {
+			legacyChassis(legacy, nodeCount, 0, nodeCount);
+		} else {
+			for (uint32_t chassis = 0; chassis < nodeCount / 4; chassis++) {
+				legacyChassis(legacy, nodeCount, chassis, 4);
+			}
+			for (uint32_t chassis = 0; chassis < nodeCount / 4; chassis += 2) {
+				legacyInterChassis(legacy, nodeCount, chassis);
+			}
+			if (nodeCount == 16) {
+				legacyNetwork(legacy, nodeCount);
+			}
+		}
+		for (uint32_t src = 0; src < nodeCount; src++) {
+			for (uint32_t dst = 0; dst < nodeCount; dst++) {
+				assert(ensemble_route_cost(nodeCount, src, dst) == legacy[src * nodeCount + dst]);
+			}
+		}
+	}
+
+	// 32 nodes: four partitions, each node has a peer in every other one.
+	for (uint32_t src = 0; src < 32; src++) {
+		for (uint32_t dst = 0; dst < 32; dst++) {
+			const uint32_t cost = ensemble_route_cost(32, src, dst);
+			assert(cost == ensemble_route_cost(32, dst, src));
+			if (src / 8 == dst / 8) {
+				assert(cost == ensemble_route_cost(16, src % 8, dst % 8));
+			} else {
+				assert(cost >= kCollectiveNetworkHop && cost <= kCollectiveNetworkHop + 2 * kCollectiveCioHop);
+				assert((cost == kCollectiveNetworkHop) == (src % 8 == dst % 8));
+			}
+		}
+	}
+	assert(ensemble_route_cost(32, 32, 0) == 0);
+	printf("validated RouteCosts.\n");
+}
+
+static void
+testNames()
+{
+	for (uint32_t i = 0; i < kCollectiveAlgorithmCount; i++) {
+		CollectiveAlgorithm algorithm = kCollectiveAlgorithmCount;
+		assert(parse_collective_algorithm(collective_algorithm_name((CollectiveAlgorithm)i), &algorithm));
+		assert(algorithm == (CollectiveAlgorithm)i);
+	}
+	CollectiveAlgorithm algorithm = kCollectiveRing;
+	assert(!parse_collective_algorithm("auto", &algorithm));
+	assert(!parse_collective_algorithm("", &algorithm));
+	assert(algorithm == kCollectiveRing);
+	printf("validated names.\n");
+}
+
+static void
+testSchedules()
+{
+	for (uint32_t nodeCount = 2; nodeCount <= kMaxCollectiveNodes; nodeCount++) {
+		assert(make_ensemble_topology(nodeCount, &topology));
+		for (uint32_t i = 0; i < kCollectiveAlgorithmCount; i++) {
+			const CollectiveAlgorithm algorithm = (CollectiveAlgorithm)i;
+			const bool built                    = build_collective_schedule(algorithm, topology, &schedule);
+			if (algorithm == kCollectiveDirect || algorithm == kCollectiveRing) {
+				assert(built);
+			}
+			if (algorithm == kCollectiveRecursiveDoubling) {
+				assert(built == ((nodeCount & (nodeCount - 1)) == 0));
+			}
+			if (algorithm == kCollectiveHierarchical && (nodeCount <= 4 || nodeCount % 8 == 0)) {
+				assert(built);
+			}
+			if (built) {
+				assert(schedule.algorithm == algorithm);
+				assert(schedule.nodeCount == nodeCount);
+				assert(validate_collective_schedule(schedule));
+			}
+		}
+	}
+	assert(!make_ensemble_topology(0, &topology));
+	assert(!make_ensemble_topology(kMaxCollectiveNodes + 1, &topology));
+
+	// A schedule that sends a block before the sender has it is rejected.
+	assert(make_ensemble_topology(4, &topology));
+	assert(build_collective_schedule(kCollectiveRing, topology, &schedule));
+	schedule.transfers[0].blocks = 0xe;
+	assert(!validate_collective_schedule(schedule));
+	printf("validated schedules.\n");
+}
+
+static void
+testHierarchical()
+{
+	for (uint32_t nodeCount : {16u, 24u, 32u}) {
+		assert(make_ensemble_topology(nodeCount, &topology));
+		assert(build_collective_schedule(kCollectiveHierarchical, topology, &schedule));
+		assert(schedule.stepCount == 3);
+
+		// Only the node's own block crosses the network, and only to its peers.
+		uint32_t networkOut[kMaxCollectiveNodes] = {};
+		for (uint32_t t = 0; t < schedule.stepEnd[schedule.stepCount - 1]; t++) {
+			const CollectiveTransfer & transfer = schedule.transfers[t];
+			const uint32_t cost                 = topology.cost(transfer.src, transfer.dst);
+			if (cost >= kCollectiveNetworkHop) {
+				assert(cost == kCollectiveNetworkHop);
+				assert(transfer.blocks == 1ull << transfer.src);
+				networkOut[transfer.src]++;
+			} else {
+				assert(cost == kCollectiveCioHop);
+			}
+		}
+		for (uint32_t node = 0; node < nodeCount; node++) {
+			assert(networkOut[node] == nodeCount / kCollectivePartitionNodes - 1);
+		}
+	}
+	printf("validated hierarchical.\n");
+}
+
+static void
+testNextHop()
+{
+	assert(make_ensemble_topology(32, &topology));
+	for (uint32_t src = 0; src < 32; src++) {
+		for (uint32_t dst = 0; dst < 32; dst++) {
+			if (src == dst) {
+				continue;
+			}
+			// Every route is walked in single hops that add up to its cost.
+			uint32_t at = src, total = 0, hops = 0;
+			while (at != dst) {
+				const uint32_t next = collective_next_hop(topology, at, dst);
+				const uint32_t cost = topology.cost(at, next);
+				assert(cost == kCollectiveCioHop || cost == kCollectiveNetworkHop);
+				total += cost;
+				at = next;
+				assert(++hops <= 3);
+			}
+			assert(total == topology.cost(src, dst));
+		}
+	}
+	printf("validated NextHop.\n");
+}
+
+static void
+testSelect()
+{
+	// Within a chassis every node is a neighbour, sending directly is best.
+	assert(make_ensemble_topology(4, &topology));
+	assert(select_collective_algorithm(topology, 1 << 20, &schedule));
+	assert(schedule.algorithm == kCollectiveDirect);
+
+	// Across partitions sending directly funnels every block for a partition
+	// through one network peer, the hierarchical exchange sends one.
+	for (uint32_t nodeCount : {16u, 32u}) {
+		assert(make_ensemble_topology(nodeCount, &topology));
+		for (uint64_t blockSize : {4096ull, 1ull << 20, 16ull << 20}) {
+			assert(select_collective_algorithm(topology, blockSize, &schedule));
+			assert(schedule.algorithm == kCollectiveHierarchical);
+			assert(validate_collective_schedule(schedule));
+		}
+		assert(build_collective_schedule(kCollectiveDirect, topology, &schedule));
+		const double direct = estimate_collective_time(schedule, topology, 16 << 20);
+		assert(build_collective_schedule(kCollectiveHierarchical, topology, &schedule));
+		const double hierarchical = estimate_collective_time(schedule, topology, 16 << 20);
+		assert(hierarchical * 1.5 < direct);
+	}
+
+	// With a fast enough network the choice follows the model.
+	CollectiveLinkModel fastNetwork = kDefaultCollectiveLinkModel;
+	fastNetwork.networkBytesPerSecond *= 100;
+	fastNetwork.networkLatency = fastNetwork.cioHopLatency;
+	assert(make_ensemble_topology(16, &topology));
+	assert(select_collective_algorithm(topology, 16 << 20, &schedule, fastNetwork));
+	const double chosen = estimate_collective_time(schedule, topology, 16 << 20, fastNetwork);
+	for (uint32_t i = 0; i < kCollectiveAlgorithmCount; i++) {
+		static CollectiveSchedule other;
+		if (build_collective_schedule((CollectiveAlgorithm)i, topology, &other)) {
+			assert(chosen <= estimate_collective_time(other, topology, 16 << 20, fastNetwork));
+		}
+	}
+	printf("validated select.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testRouteCosts();
+	testNames();
+	testSchedules();
+	testHierarchical();
+	testNextHop();
+	testSelect();
+	return 0;
+}
@@ -0,0 +1,300 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestCommandRing.cpp
+//  AppleCIOMesh
+//
+//  Checks that commands go through the command ring in order across
+//  wrap-around, that a failed command skips the rest of its submission, that
+//  a full completion ring leaves commands submitted and that the driver side
+//  refuses indices that make no sense. Also runs a submitter and a driver on
+//  two threads.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestCommandRing.cpp
+//
+
+#include "Common/CommandRing.h"
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+using AppleCIOMeshUtils::command_ring_size;
+using AppleCIOMeshUtils::CommandRing;
+using AppleCIOMeshUtils::CommandRingDrainResult;
+using AppleCIOMeshUtils::CommandRingHeader;
+using AppleCIOMeshUtils::kMeshCommandPrepare;
+using AppleCIOMeshUtils::kMeshCommandSend;
+using AppleCIOMeshUtils::kMeshCommandSendAndPrepare;
+using AppleCIOMeshUtils::kMeshCompletionSkipped;
+using AppleCIOMeshUtils::MeshCommand;
+using AppleCIOMeshUtils::MeshCompletion;
+
+static const int32_t kSkipped = -2;
+
+static MeshCommand
+makeCommand(uint64_t userData, uint8_t op)
+{
+	MeshCommand command = {};
+	command.userData    = userData;
+	command.op          = op;
+	command.sendOffset  = (int64_t)userData * 4096;
+	command.tags[0]     = (char)userData;
+	return command;
+}
+
+static void
+testLayout()
+{
+	uint64_t memory[1024];
+	CommandRing user, driver;
+
+	assert(!CommandRing::validEntries(0));
+	assert(!CommandRing::validEntries(12));
+	assert(CommandRing::validEntries(16));
+	assert(!user.init(memory, command_ring_size(16) - 1, 16));
+	assert(!user.init(memory, sizeof(memory), 6));
+	assert(user.init(memory, sizeof(memory), 16));
+	CommandRingHeader * header = (CommandRingHeader *)(void *)memory;
+	assert(header->entries == 16);
+	assert(driver.attach(memory, sizeof(memory), 16));
+	assert(user.submissionSpace() == 16);
+	assert(driver.completionSpace() == 16);
+
+	printf("validated layout.\n");
+}
+
+static void
+testWrapAround()
+{
+	uint64_t memory[512];
+	CommandRing user, driver;
+	assert(user.init(memory, sizeof(memory), 4));
+	assert(driver.attach(memory, sizeof(memory), 4));
+
+	uint64_t next = 0, expected = 0;
+	for (uint32_t round = 0; round < 10; round++) {
+		MeshCommand commands[3];
+		for (uint32_t i = 0; i < 3; i++) {
+			commands[i] = makeCommand(next + i, kMeshCommandSendAndPrepare);
+		}
+		assert(user.submit(commands, 3) == 3);
+		next += 3;
+		assert(user.inFlight() == 3);
+
+		uint64_t seen             = expected;
+		CommandRingDrainResult rc = driver.drain(
+		    [&](const MeshCommand & command) -> int32_t {
+			    assert(command.userData == seen);
+			    assert(command.sendOffset == (int64_t)seen * 4096);
+			    assert(command.tags[0] == (char)seen);
+			    seen++;
+			    return 0;
+		    },
+		    kSkipped);
+		assert(rc.completed == 3 && rc.status == 0 && !rc.full && !rc.corrupt);
+		assert(user.inFlight() == 0);
+
+		MeshCompletion completions[4];
+		assert(user.reap(completions, 4) == 3);
+		for (uint32_t i = 0; i < 3; i++) {
+			assert(completions[i].userData == expected + i);
+			assert(completions[i].status == 0 && completions[i].flags == 0);
+		}
+		expected += 3;
+	}
+
+	// A ring only takes what fits.
+	MeshCommand commands[6];
+	for (uint32_t i = 0; i < 6; i++) {
+		commands[i] = makeCommand(i, kMeshCommandSend);
+	}
+	assert(user.submit(commands, 6) == 4);
+	assert(user.submissionSpace() == 0);
+
+	printf("validated wrap around.\n");
+}
+
+static void
+testFailureSkipsTheRest()
+{
+	uint64_t memory[512];
+	CommandRing user, driver;
+	assert(user.init(memory, sizeof(memory), 8));
+	assert(driver.attach(memory, sizeof(memory), 8));
+
+	MeshCommand commands[5];
+	for (uint32_t i = 0; i < 5; i++) {
+		commands[i] = makeCommand(i, i % 2 ? kMeshCommandPrepare : kMeshCommandSend);
+	}
+	assert(user.submit(commands, 5) == 5);
+
+	uint32_t executed         = 0;
+	CommandRingDrainResult rc = driver.drain(
+	    [&](const MeshCommand & command) -> int32_t {
+		    executed++;
+		    return command.userData == 2 ? 7 : 0;
+	    },
+	    kSkipped);
+	assert(executed == 3);
+	assert(rc.completed == 5 && rc.status == 7);
+
+	MeshCompletion completions[8];
+	assert(user.reap(completions, 8) == 5);
+	assert(completions[1].status == 0 && completions[1].flags == 0);
+	assert(completions[2].status == 7 && completions[2].flags == 0);
+	assert(completions[3].status == kSkipped && completions[3].flags == kMeshCompletionSkipped);
+	assert(completions[4].status == kSkipped && completions[4].flags == kMeshCompletionSkipped);
+
+	// The next submission starts over.
+	assert(user.submit(commands, 1) == 1);
+	rc = driver.drain([](const MeshCommand &) -> int32_t { return 0; }, kSkipped);
+	assert(rc.completed == 1 && rc.status == 0);
+
+	printf("validated failure skips the rest.\n");
+}
+
+static void
+testFullCompletionRing()
+{
+	uint64_t memory[512];
+	CommandRing user, driver;
+	assert(user.init(memory, sizeof(memory), 4));
+	assert(driver.attach(memory, sizeof(memory), 4));
+
+	MeshCommand commands[4];
+	for (uint32_t i = 0; i < 4; i++) {
+		commands[i] = makeCommand(i, kMeshCommandSend);
+	}
+	assert(user.submit(commands, 4) == 4);
+	CommandRingDrainResult rc = driver.drain([](const MeshCommand &) -> int32_t { return 0; }, kSkipped);
+	assert(rc.completed == 4);
+
+	// Nothing reaped, so the next submission can't complete.
+	assert(user.submissionSpace() == 4);
+	assert(user.submit(commands, 2) == 2);
+	rc = driver.drain([](const MeshCommand &) -> int32_t { return 0; }, kSkipped);
+	assert(rc.completed == 0 && rc.full);
+
+	MeshCompletion completions[4];
+	assert(user.reap(completions, 1) == 1 && completions[0].userData == 0);
+	rc = driver.drain([](const MeshCommand &) -> int32_t { return 0; }, kSkipped);
+	assert(rc.completed == 1 && rc.full);
+	assert(user.reap(completions, 4) == 4);
+	rc = driver.drain([](const MeshCommand &) -> int32_t { return 0; }, kSkipped);
+	assert(rc.completed == 1 && !rc.full);
+	assert(user.reap(completions, 4) == 1 && completions[0].userData == 1);
+
+	printf("validated full completion ring.\n");
+}
+
+static void
+testCorruptIndices()
+{
+	uint64_t memory[512];
+	CommandRing user, driver;
+	assert(user.init(memory, sizeof(memory), 4));
+	assert(driver.attach(memory, sizeof(memory), 4));
+	CommandRingHeader * header = (CommandRingHeader *)(void *)memory;
+
+	// A tail past the end of the ring is refused outright.
+	header->sqTail = 5;
+	uint32_t executed         = 0;
+	CommandRingDrainResult rc = driver.drain(
+	    [&](const MeshCommand &) -> int32_t {
+		    executed++;
+		    return 0;
+	    },
+	    kSkipped);
+	assert(rc.corrupt && rc.completed == 0 && executed == 0);
+
+	// So is a size in the header that disagrees, the driver goes by its own.
+	header->sqTail  = 2;
+	header->entries = 1024;
+	rc              = driver.drain([](const MeshCommand &) -> int32_t { return 0; }, kSkipped);
+	assert(rc.completed == 2 && !rc.corrupt);
+
+	// A completion head that is ahead of the tail leaves no room.
+	header->cqHead = 100;
+	assert(driver.completionSpace() == 0);
+
+	printf("validated corrupt indices.\n");
+}
+
+static void
+testThreads()
+{
+	static const uint32_t kCommands = 200000;
+	static uint64_t memory[4096];
+	CommandRing user, driver;
+	assert(user.init(memory, sizeof(memory), 64));
+	assert(driver.attach(memory, sizeof(memory), 64));
+
+	bool done = false;
+	std::thread consumer([&] {
+		uint64_t expected = 0;
+		while (expected < kCommands) {
+			CommandRingDrainResult rc = driver.drain(
+			    [&](const MeshCommand & command) -> int32_t {
+				    assert(command.userData == expected);
+				    assert(command.sendOffset == (int64_t)expected * 4096);
+				    expected++;
+				    return 0;
+			    },
+			    kSkipped);
+			assert(!rc.corrupt && rc.status == 0);
+		}
+		__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	});
+
+	uint64_t submitted = 0, reaped = 0;
+	while (reaped < kCommands) {
+		MeshCommand batch[16];
+		uint32_t count = 0;
+		while (count < 16 && submitted + count < kCommands) {
+			batch[count] = makeCommand(submitted + count, kMeshCommandSendAndPrepare);
+			count++;
+		}
+		submitted += user.submit(batch, count);
+
+		MeshCompletion completions[32];
+		uint32_t got = user.reap(completions, 32);
+		for (uint32_t i = 0; i < got; i++) {
+			assert(completions[i].userData == reaped + i);
+			assert(completions[i].status == 0);
+		}
+		reaped += got;
+	}
+	consumer.join();
+	assert(__atomic_load_n(&done, __ATOMIC_ACQUIRE));
+	assert(user.inFlight() == 0);
+
+	printf("validated threads.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testLayout();
+	testWrapAround();
+	testFailureSkipsTheRest();
+	testFullCompletionRing();
+	testCorruptIndices();
+	testThreads();
+	return 0;
+}
@@ -0,0 +1,273 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestCommandeerQueue.cpp
+//  AppleCIOMesh
+//
+//  Checks that the commandeer queue hands work out in order and in batches,
+//  refuses work when full instead of overwriting it, and only says to park
+//  once it has been idle long enough. Also runs producers against a consumer
+//  that parks, a lost wakeup hangs the test.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestCommandeerQueue.cpp
+//
+
+#include "Common/CommandeerQueue.h"
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+using AppleCIOMeshUtils::CommandeerPolicy;
+using AppleCIOMeshUtils::CommandeerStats;
+using AppleCIOMeshUtils::CommandeerWork;
+
+static int64_t liveAllocations = 0;
+
+struct CountingAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		__atomic_fetch_add(&liveAllocations, 1, __ATOMIC_RELAXED);
+		return (U *)calloc(count, sizeof(U));
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t)
+	{
+		__atomic_fetch_sub(&liveAllocations, 1, __ATOMIC_RELAXED);
+		free(memory);
+	}
+};
+
+using Queue = AppleCIOMeshUtils::CommandeerQueue<CountingAllocator>;
+
+static CommandeerPolicy
+makePolicy(uint32_t busyBatch, uint32_t idleBatch, uint64_t spinBeforePark)
+{
+	CommandeerPolicy policy;
+	policy.busyBatch      = busyBatch;
+	policy.idleBatch      = idleBatch;
+	policy.spinBeforePark = spinBeforePark;
+	return policy;
+}
+
+static CommandeerWork
+makeWork(uint8_t type, uintptr_t object, int64_t offset)
+{
+	CommandeerWork work = {};
+	work.type           = type;
+	work.object         = object;
+	work.offset         = offset;
+	return work;
+}
+
+static void
+testOrderAndFull()
+{
+	{
+		Queue queue;
+		assert(!queue.init(3, makePolicy(1, 8, 0)));
+		assert(!queue.init(8, makePolicy(0, 8, 0)));
+		assert(queue.init(8, makePolicy(2, 8, 0)));
+		assert(!queue.init(8, makePolicy(2, 8, 0)));
+		assert(queue.empty());
+
+		CommandeerWork out[8];
+		assert(queue.pop(out, 8) == 0);
+
+		// Many more than fit, so the cells wrap around over and over.
+		uint64_t next = 0;
+		uint64_t seen = 0;
+		for (int round = 0; round < 1000; round++) {
+			const uint32_t pushes = (uint32_t)(round % 11);
+			for (uint32_t i = 0; i < pushes; i++) {
+				CommandeerWork work = makeWork(AppleCIOMeshUtils::kCommandeerBulkPrepare, (uintptr_t)next, (int64_t)next);
+				work.link           = (uint8_t)(next & 1);
+				if (queue.push(work)) {
+					next++;
+				} else {
+					// Refused only when full.
+					assert(next - seen == 8);
+				}
+			}
+
+			const uint32_t popped = queue.pop(out, queue.batchLimit(round % 2 == 0));
+			assert(popped <= (round % 2 == 0 ? 2u : 8u));
+			for (uint32_t i = 0; i < popped; i++) {
+				assert(out[i].object == (uintptr_t)seen);
+				assert(out[i].offset == (int64_t)seen);
+				assert(out[i].link == (uint8_t)(seen & 1));
+				seen++;
+			}
+		}
+		while (uint32_t popped = queue.pop(out, 8)) {
+			seen += popped;
+		}
+		assert(seen == next);
+		assert(queue.empty());
+
+		const CommandeerStats stats = queue.stats();
+		assert(stats.pushed == next);
+		assert(stats.popped == next);
+		assert(stats.full > 0);
+		assert(stats.wakeups == 0);
+	}
+	assert(liveAllocations == 0);
+
+	printf("validated order and full.\n");
+}
+
+static void
+testShouldPark()
+{
+	Queue queue;
+	assert(queue.init(4, makePolicy(1, 4, 100)));
+
+	// Idle starts counting on the first idle pass.
+	assert(!queue.shouldPark(true, 1000));
+	assert(!queue.shouldPark(true, 1099));
+	assert(queue.shouldPark(true, 1100));
+
+	// Any work starts it over.
+	assert(!queue.shouldPark(false, 1101));
+	assert(!queue.shouldPark(true, 1200));
+	assert(!queue.shouldPark(true, 1250));
+	assert(queue.shouldPark(true, 1300));
+
+	// So does parking.
+	queue.beginPark();
+	assert(queue.parked());
+	assert(queue.needsWake());
+	queue.endPark();
+	assert(!queue.parked());
+	assert(!queue.needsWake());
+	assert(!queue.shouldPark(true, 1300));
+	assert(queue.shouldPark(true, 1400));
+
+	const CommandeerStats stats = queue.stats();
+	assert(stats.parks == 1);
+	assert(stats.wakeups == 1);
+
+	// A clock that starts at 0 still works.
+	Queue zero;
+	assert(zero.init(4, makePolicy(1, 4, 10)));
+	assert(!zero.shouldPark(true, 0));
+	assert(!zero.shouldPark(true, 9));
+	assert(zero.shouldPark(true, 10));
+
+	printf("validated should park.\n");
+}
+
+static void
+testProducersAndParkingConsumer()
+{
+	const uint32_t kProducers = 4;
+	const uint64_t kItems     = 50000;
+
+	Queue queue;
+	assert(queue.init(64, makePolicy(4, 16, 0)));
+
+	std::mutex lock;
+	std::condition_variable wakeup;
+	bool done = false;
+
+	auto wake = [&] {
+		std::lock_guard<std::mutex> guard(lock);
+		wakeup.notify_one();
+	};
+
+	std::vector<std::thread> producers;
+	for (uint32_t p = 0; p < kProducers; p++) {
+		producers.emplace_back([&, p] {
+			for (uint64_t i = 0; i < kItems; i++) {
+				const CommandeerWork work = makeWork(AppleCIOMeshUtils::kCommandeerForwardPrepare, p, (int64_t)i);
+				while (!queue.push(work)) {
+					wake();
+					std::this_thread::yield();
+				}
+				if (queue.needsWake()) {
+					wake();
+				}
+				// Bursts with gaps, so the consumer parks now and then.
+				if ((i % 512) == 0) {
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+				}
+			}
+		});
+	}
+
+	std::thread consumer([&] {
+		std::vector<int64_t> last(kProducers, -1);
+		uint64_t total = 0;
+		CommandeerWork out[16];
+
+		while (total < kItems * kProducers) {
+			const uint32_t popped = queue.pop(out, queue.batchLimit(false));
+			for (uint32_t i = 0; i < popped; i++) {
+				// Each producer's work comes out in the order it went in.
+				assert(out[i].offset == last[out[i].object] + 1);
+				last[out[i].object] = out[i].offset;
+			}
+			total += popped;
+
+			if (queue.shouldPark(popped == 0, 1)) {
+				std::unique_lock<std::mutex> guard(lock);
+				queue.beginPark();
+				if (queue.empty() && !done) {
+					// No timeout, a lost wakeup hangs here.
+					wakeup.wait(guard);
+				}
+				queue.endPark();
+			}
+		}
+	});
+
+	for (auto & producer : producers) {
+		producer.join();
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		done = true;
+		wakeup.notify_one();
+	}
+	consumer.join();
+
+	assert(queue.empty());
+	const CommandeerStats stats = queue.stats();
+	assert(stats.pushed == kItems * kProducers);
+	assert(stats.popped == kItems * kProducers);
+	assert(stats.batches <= stats.popped);
+
+	printf("validated producers and parking consumer: %llu parks, %llu wakeups.\n", (unsigned long long)stats.parks,
+	       (unsigned long long)stats.wakeups);
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testOrderAndFull();
+	testShouldPark();
+	testProducersAndParkingConsumer();
+	return 0;
+}
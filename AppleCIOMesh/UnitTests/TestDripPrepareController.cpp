@@ -0,0 +1,281 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestDripPrepareController.cpp
+//  AppleCIOMesh
+//
+//  Checks the depth the drip prepare controller asks for against the arrival
+//  interval and prepare lead it was fed, that starved steps grow it and calm
+//  ones shrink it again, and that idle gaps and restarts don't count as
+//  traffic. Then runs the simulation harness to check the controller keeps
+//  far fewer steps prepared ahead than the NHI queue allows without slowing
+//  the link down, and hammers one controller from two threads.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestDripPrepareController.cpp
+//
+
+#include "Common/DripPrepareSimulator.h"
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+
+using AppleCIOMeshUtils::DripPrepareController;
+using AppleCIOMeshUtils::DripPreparePolicy;
+using AppleCIOMeshUtils::DripPrepareSimulationConfig;
+using AppleCIOMeshUtils::DripPrepareSimulationResult;
+using AppleCIOMeshUtils::DripPrepareSimulator;
+using AppleCIOMeshUtils::kDefaultDripPrepareSimulation;
+using AppleCIOMeshUtils::kDripPrepareUnbounded;
+
+static constexpr DripPreparePolicy kPolicy = {2, 16, 8, 10'000};
+
+// Steps complete every interval ticks and none starve.
+static uint64_t
+feedReadies(DripPrepareController & controller, uint64_t now, uint64_t interval, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		now += interval;
+		controller.recordReady(now, false);
+	}
+	return now;
+}
+
+static void
+testDepthFromRateAndLead()
+{
+	DripPrepareController controller;
+	controller.init(kPolicy);
+
+	// Nothing learned, only the caller's limit applies.
+	assert(controller.depth() == kDripPrepareUnbounded);
+	assert(controller.canPrepare(0));
+	assert(controller.canPrepare(1000));
+
+	// A rate alone is not enough either.
+	uint64_t now = feedReadies(controller, 0, 100, 64);
+	assert(controller.depth() == kDripPrepareUnbounded);
+
+	// With a steady lead the deviation dies down and the depth is what covers
+	// the lead at that rate plus the step on the link.
+	for (int i = 0; i < 64; i++) {
+		controller.recordPrepared(250);
+	}
+	assert(controller.stats().interval == 100);
+	assert(controller.stats().lead == 250);
+	assert(controller.depth() == 1 + 3);
+	assert(controller.canPrepare(0));
+	assert(controller.canPrepare(3));
+	assert(!controller.canPrepare(4));
+
+	// Steps coming twice as fast need twice the cover.
+	now = feedReadies(controller, now, 50, 64);
+	assert(controller.stats().interval == 50);
+	assert(controller.depth() == 1 + 5);
+
+	// A jittery lead asks for more than its mean.
+	for (int i = 0; i < 64; i++) {
+		controller.recordPrepared(i % 2 ? 150 : 350);
+	}
+	assert(controller.depth() > 1 + 5);
+
+	// A lead well under an interval still keeps minDepth.
+	controller.init(kPolicy);
+	feedReadies(controller, 0, 1000, 16);
+	for (int i = 0; i < 64; i++) {
+		controller.recordPrepared(10);
+	}
+	assert(controller.depth() == kPolicy.minDepth);
+
+	printf("validated depth from rate and lead.\n");
+}
+
+static void
+testStarvationBoost()
+{
+	DripPrepareController controller;
+	controller.init(kPolicy);
+	uint64_t now = feedReadies(controller, 0, 100, 16);
+	for (int i = 0; i < 64; i++) {
+		controller.recordPrepared(100);
+	}
+	const uint32_t base = controller.depth();
+	assert(base == 2);
+
+	// Every starved step doubles the boost, up to maxBoost.
+	uint32_t boosts[] = {1, 3, 7, 15, 16, 16};
+	for (uint32_t boost : boosts) {
+		now += 100;
+		controller.recordReady(now, true);
+		assert(controller.stats().boost == boost);
+		assert(controller.depth() == base + boost);
+	}
+	assert(controller.stats().starved == 6);
+
+	// The gap after a starved step is not counted, it was spent waiting.
+	now += 5000;
+	controller.recordReady(now, false);
+	assert(controller.stats().interval == 100);
+
+	// Every calmReadies steps that did not starve take one off.
+	now = feedReadies(controller, now, 100, kPolicy.calmReadies - 2);
+	assert(controller.stats().boost == 16);
+	now = feedReadies(controller, now, 100, 1);
+	assert(controller.stats().boost == 15);
+	now = feedReadies(controller, now, 100, kPolicy.calmReadies * 15);
+	assert(controller.stats().boost == 0);
+	assert(controller.depth() == base);
+
+	// A starved step in between starts the count over.
+	now = feedReadies(controller, now, 100, kPolicy.calmReadies - 1);
+	controller.recordReady(now += 100, true);
+	now = feedReadies(controller, now, 100, kPolicy.calmReadies - 1);
+	assert(controller.stats().boost == 1);
+
+	printf("validated starvation boost.\n");
+}
+
+static void
+testIdleAndRestart()
+{
+	DripPrepareController controller;
+	controller.init(kPolicy);
+	uint64_t now = feedReadies(controller, 0, 100, 16);
+	controller.recordPrepared(300);
+
+	// Longer than idleGap is the buffer not being sent, not a slow link.
+	now += kPolicy.idleGap + 1;
+	controller.recordReady(now, false);
+	assert(controller.stats().interval == 100);
+
+	// Nor is the time between two runs, however short.
+	const uint32_t depth = controller.depth();
+	controller.restart();
+	controller.recordReady(now + 5000, false);
+	assert(controller.stats().interval == 100);
+	assert(controller.depth() == depth);
+
+	// A clock that went backwards is ignored as well.
+	controller.recordReady(now, false);
+	assert(controller.stats().interval == 100);
+	assert(controller.stats().readies == 19);
+	assert(controller.stats().prepares == 1);
+
+	printf("validated idle and restart.\n");
+}
+
+static void
+testSimulation()
+{
+	static DripPrepareSimulator sim;
+
+	// Prepared as far ahead as the NHI queue allows.
+	DripPrepareSimulationConfig config = kDefaultDripPrepareSimulation;
+	config.adaptive                    = false;
+	sim.init(config);
+	DripPrepareSimulationResult fixed = sim.run();
+	assert(!fixed.failed);
+	assert(fixed.starved == 0);
+	assert(fixed.maxAhead == 14);
+
+	// The first run starts out the same, later ones use what it learned.
+	config.adaptive = true;
+	sim.init(config);
+	DripPrepareSimulationResult adaptive = sim.run();
+	assert(!adaptive.failed);
+	assert(adaptive.maxAhead == fixed.maxAhead);
+	for (int run = 0; run < 4; run++) {
+		adaptive = sim.run();
+		assert(!adaptive.failed);
+		assert(adaptive.maxAhead <= fixed.maxAhead / 2);
+		assert(adaptive.meanAhead < fixed.meanAhead / 2);
+		assert(adaptive.starved <= 2);
+		assert(adaptive.seconds < fixed.seconds * 1.01);
+	}
+
+	// Without the commandeer stalls two steps are all it takes.
+	config.stallEvery = 0;
+	sim.init(config);
+	sim.run();
+	adaptive = sim.run();
+	assert(adaptive.starved == 0);
+	assert(adaptive.finalDepth == 2);
+	assert(adaptive.maxAhead == 2);
+
+	// A commandeer too slow for any depth the queue allows: the controller
+	// asks for more than it can have and does no worse than before.
+	config                = kDefaultDripPrepareSimulation;
+	config.stallEvery     = 0;
+	config.adaptive       = false;
+	config.prepareLatency = 2e-3;
+	sim.init(config);
+	fixed = sim.run();
+	config.adaptive = true;
+	sim.init(config);
+	sim.run();
+	adaptive = sim.run();
+	assert(adaptive.finalDepth > fixed.maxAhead);
+	assert(adaptive.seconds <= fixed.seconds * 1.01);
+
+	printf("validated simulation.\n");
+}
+
+static void
+testTwoThreads()
+{
+	DripPrepareController controller;
+	controller.init(kPolicy);
+	bool done = false;
+
+	// Completions on one thread, prepares landing on another, like the
+	// link's completion and the commandeer.
+	std::thread commandeer([&] {
+		uint64_t prepares = 0;
+		while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE) || prepares == 0) {
+			controller.recordPrepared(200 + prepares % 100);
+			assert(controller.depth() >= kPolicy.minDepth);
+			prepares++;
+		}
+	});
+
+	uint64_t now = 0;
+	for (uint32_t i = 0; i < 200000; i++) {
+		now += 100;
+		controller.recordReady(now, i % 1000 == 0);
+		assert(controller.canPrepare(0));
+	}
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	commandeer.join();
+
+	assert(controller.stats().readies == 200000);
+	assert(controller.stats().starved == 200);
+	assert(controller.depth() >= 1 + 2);
+	assert(controller.depth() <= 1 + 6 + kPolicy.maxBoost);
+
+	printf("validated two threads.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testDepthFromRateAndLead();
+	testStarvationBoost();
+	testIdleAndRestart();
+	testSimulation();
+	testTwoThreads();
+	return 0;
+}
@@ -0,0 +1,224 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestEventTrace.cpp
+//  AppleCIOMesh
+//
+//  Records data path events from several threads, checks that the flight
+//  recorder keeps the latest events when it wraps and that snapshots taken
+//  while a thread records are never torn, and exports a Chrome JSON trace.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestEventTrace.cpp
+//
+
+#include "Common/EventTrace.h"
+#include <atomic>
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using AppleCIOMeshUtils::EventTrace;
+using AppleCIOMeshUtils::EventTraceBuffer;
+using AppleCIOMeshUtils::TraceEvent;
+using AppleCIOMeshUtils::TraceEventType;
+
+// Every field of event i is derived from i, so a torn event is detectable.
+static void
+recordEvent(EventTraceBuffer * buffer, uint64_t i)
+{
+	buffer->record((TraceEventType)(i % (uint64_t)TraceEventType::Count), i * 1000, i * 1000 + i % 977, (uint32_t)(i % 8), i % 100,
+	               i);
+}
+
+static bool
+isEvent(const TraceEvent & event, uint64_t i)
+{
+	return event.begin == i * 1000 && event.end == i * 1000 + i % 977 && event.syncId == (uint32_t)i &&
+	       event.chunk == i % 100 && event.node == i % 8 && event.type == (TraceEventType)(i % (uint64_t)TraceEventType::Count);
+}
+
+static void
+testCreate()
+{
+	assert(EventTrace::create(0, 16, 0) == nullptr);
+	assert(EventTrace::create(4, 0, 0) == nullptr);
+
+	EventTrace * trace = EventTrace::create(3, 1000, 2);
+	assert(trace != nullptr);
+	assert(trace->thread_count() == 3);
+	assert(trace->thread(3) == nullptr);
+	for (uint32_t i = 0; i < 3; i++) {
+		EventTraceBuffer * buffer = trace->thread(i);
+		assert(buffer != nullptr);
+		assert(buffer->capacity() == 1024);
+		assert(buffer->count() == 0);
+	}
+	EventTraceBuffer * buffer = trace->thread(1);
+	assert(buffer != nullptr);
+	assert(strcmp(buffer->name(), "thread 1") == 0);
+	trace->set_thread_name(1, "crypto 0");
+	assert(strcmp(buffer->name(), "crypto 0") == 0);
+	delete trace;
+	printf("validated trace creation.\n");
+}
+
+static void
+testWraparound()
+{
+	EventTrace * trace        = EventTrace::create(1, 64, 0);
+	EventTraceBuffer * buffer = trace->thread(0);
+	std::vector<TraceEvent> events(buffer->capacity());
+
+	for (uint64_t i = 0; i < 10; i++) {
+		recordEvent(buffer, i);
+	}
+	assert(buffer->snapshot(events.data()) == 10);
+	for (uint64_t i = 0; i < 10; i++) {
+		assert(isEvent(events[i], i));
+	}
+
+	// Once full, only the latest events are kept, oldest first.
+	for (uint64_t i = 10; i < 1000; i++) {
+		recordEvent(buffer, i);
+	}
+	assert(buffer->count() == 1000);
+	const size_t count = buffer->snapshot(events.data());
+	// The slot the next event goes to is never reported.
+	assert(count == 63);
+	for (size_t i = 0; i < count; i++) {
+		assert(isEvent(events[i], 1000 - count + i));
+	}
+	delete trace;
+	printf("validated wraparound.\n");
+}
+
+static void
+testConcurrentSnapshot(uint32_t threadCount, uint64_t eventsPerThread)
+{
+	EventTrace * trace = EventTrace::create(threadCount, 256, 0);
+	std::atomic<uint32_t> running{threadCount};
+	std::vector<std::thread> threads;
+
+	for (uint32_t t = 0; t < threadCount; t++) {
+		threads.emplace_back([&, t]() {
+			EventTraceBuffer * buffer = trace->thread(t);
+			for (uint64_t i = 0; i < eventsPerThread; i++) {
+				recordEvent(buffer, i);
+				if (i % 64 == 0) {
+					std::this_thread::yield();
+				}
+			}
+			running.fetch_sub(1);
+		});
+	}
+
+	std::vector<TraceEvent> events(256);
+	uint64_t snapshots = 0;
+	while (running.load() != 0) {
+		for (uint32_t t = 0; t < threadCount; t++) {
+			const EventTraceBuffer * buffer = trace->thread(t);
+			assert(buffer != nullptr);
+			const size_t count = buffer->snapshot(events.data());
+			if (count == 0) {
+				continue;
+			}
+			// Snapshots are consecutive events, none of them torn.
+			const uint64_t first = events[0].begin / 1000;
+			for (size_t i = 0; i < count; i++) {
+				assert(isEvent(events[i], first + i));
+			}
+			snapshots++;
+		}
+		std::this_thread::yield();
+	}
+	for (std::thread & thread : threads) {
+		thread.join();
+	}
+
+	for (uint32_t t = 0; t < threadCount; t++) {
+		const EventTraceBuffer * buffer = trace->thread(t);
+		assert(buffer != nullptr);
+		assert(buffer->count() == eventsPerThread);
+		const size_t count = buffer->snapshot(events.data());
+		assert(count == 255);
+		assert(isEvent(events[count - 1], eventsPerThread - 1));
+	}
+	delete trace;
+	printf("validated %u threads recording while snapshotting: %llu snapshots.\n", threadCount, (unsigned long long)snapshots);
+}
+
+static size_t
+countOccurrences(const std::string & haystack, const char * needle)
+{
+	size_t count = 0;
+	for (size_t pos = haystack.find(needle); pos != std::string::npos; pos = haystack.find(needle, pos + 1)) {
+		count++;
+	}
+	return count;
+}
+
+static void
+testChromeJson()
+{
+	EventTrace * trace = EventTrace::create(2, 16, 5);
+	trace->set_thread_name(0, "broadcast");
+	trace->set_thread_name(1, "odd \"name\"");
+	trace->thread(0)->record(TraceEventType::Send, 1500, 2750, 3, 7, 42);
+	trace->thread(0)->record(TraceEventType::Gather, 3000, 3001, 5, AppleCIOMeshUtils::kTraceNoChunk, 42);
+	trace->thread(1)->record(TraceEventType::Decrypt, 2000000, 2000500, 1, 0, 43);
+
+	FILE * file = tmpfile();
+	assert(file != nullptr);
+	assert(trace->write_chrome_json(file));
+	std::string json;
+	rewind(file);
+	char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		json.append(buffer, read);
+	}
+	fclose(file);
+	delete trace;
+
+	assert(json.front() == '{');
+	assert(json.find("]}\n") == json.size() - 3);
+	assert(countOccurrences(json, "\"ph\":\"X\"") == 3);
+	assert(countOccurrences(json, "\"ph\":\"M\"") == 5);
+	assert(json.find("\"args\":{\"name\":\"node 5\"}") != std::string::npos);
+	assert(json.find("\"args\":{\"name\":\"broadcast\"}") != std::string::npos);
+	assert(json.find("\"args\":{\"name\":\"odd \\\"name\\\"\"}") != std::string::npos);
+	assert(json.find("\"name\":\"send\",\"cat\":\"mesh\",\"ph\":\"X\",\"pid\":5,\"tid\":0,\"ts\":1.500,\"dur\":1.250,"
+	                 "\"args\":{\"node\":3,\"sync\":42,\"chunk\":7}}") != std::string::npos);
+	assert(json.find("\"name\":\"gather\",\"cat\":\"mesh\",\"ph\":\"X\",\"pid\":5,\"tid\":0,\"ts\":3.000,\"dur\":0.001,"
+	                 "\"args\":{\"node\":5,\"sync\":42}}") != std::string::npos);
+	assert(json.find("\"name\":\"decrypt\",\"cat\":\"mesh\",\"ph\":\"X\",\"pid\":5,\"tid\":1,\"ts\":2000.000,\"dur\":0.500,") !=
+	       std::string::npos);
+	printf("validated chrome json export.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testCreate();
+	testWraparound();
+	testConcurrentSnapshot(1, 200000);
+	testConcurrentSnapshot(4, 50000);
+	testChromeJson();
+	return 0;
+}
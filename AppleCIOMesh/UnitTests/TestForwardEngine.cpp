@@ -0,0 +1,239 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestForwardEngine.cpp
+//  AppleCIOMesh
+//
+//  Runs the forward state machine against simulated links and checks that
+//  every chunk reaches every output in order, chained or not, that forwarding
+//  keeps up with the links when the forward loop is fast and falls behind when
+//  it is not, that pending chains start oldest sync first and that the
+//  simulation is deterministic. This test has no
+//  platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestForwardEngine.cpp
+//
+
+#include "Common/ForwardSimulator.h"
+#include <cassert>
+#include <initializer_list>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+using AppleCIOMeshUtils::ForwardSimulationConfig;
+using AppleCIOMeshUtils::ForwardSimulationResult;
+using AppleCIOMeshUtils::ForwardSimulator;
+using AppleCIOMeshUtils::kChainDeadline;
+using AppleCIOMeshUtils::kChainDiscoveryOrder;
+using AppleCIOMeshUtils::kDefaultForwardSimulation;
+using AppleCIOMeshUtils::kMaxSimulatedChains;
+using AppleCIOMeshUtils::kMaxSimulatedChunks;
+using AppleCIOMeshUtils::kSimForwardNodeCount;
+
+static ForwardSimulator sim;
+
+static void
+checkForwarded(const ForwardSimulationConfig & config, const ForwardSimulationResult & result)
+{
+	const uint64_t chunkBytes = config.commandBytes * config.commandsPerChunk;
+	const uint64_t chunks     = (uint64_t)config.chunkCount * config.chainCount;
+	assert(!result.failed);
+	assert(result.ordered);
+	assert(result.chunksForwarded == chunks);
+	assert(result.bytesForwarded == chunkBytes * chunks * kSimForwardNodeCount);
+	assert(result.chainStopped == config.chained);
+	assert(result.seconds > 0);
+	assert(result.maxSyncLatency > 0 && result.maxSyncLatency <= result.seconds);
+	assert(result.meanSyncLatency <= result.maxSyncLatency);
+}
+
+static void
+testForwardsEveryChunk()
+{
+	for (bool chained : {true, false}) {
+		for (uint32_t links : {1u, 2u}) {
+			for (uint32_t commands : {1u, 4u, 8u}) {
+				for (uint32_t chunks : {2u, 16u, kMaxSimulatedChunks}) {
+					ForwardSimulationConfig config = kDefaultForwardSimulation;
+					config.chained                 = chained;
+					config.linksPerChannel         = links;
+					config.commandsPerChunk        = commands;
+					config.chunkCount              = chunks;
+					checkForwarded(config, sim.run(config));
+				}
+			}
+		}
+	}
+
+	printf("validated forwards every chunk.\n");
+}
+
+static void
+testThroughput()
+{
+	// With a fast loop the RX link is the bottleneck: every output sends what
+	// arrives at the rate it arrives.
+	ForwardSimulationConfig config = kDefaultForwardSimulation;
+	config.chunkCount              = kMaxSimulatedChunks;
+	config.stepCost                = 1e-8;
+	config.prepareCost             = 1e-8;
+	ForwardSimulationResult result = sim.run(config);
+	checkForwarded(config, result);
+	const double linkBound = config.rxBytesPerSecond * kSimForwardNodeCount;
+	assert(result.throughput() > 0.9 * linkBound);
+	assert(result.throughput() <= linkBound);
+	for (uint32_t output = 0; output < kSimForwardNodeCount; output++) {
+		assert(sim.txUtilization(output, 0) > 0.9);
+	}
+
+	// Two links per channel carry twice as much.
+	config.linksPerChannel             = 2;
+	ForwardSimulationResult twoLinks   = sim.run(config);
+	checkForwarded(config, twoLinks);
+	assert(twoLinks.throughput() > 1.8 * result.throughput());
+
+	// A loop that spends longer per step than a command takes on the wire
+	// can not keep up.
+	config.linksPerChannel           = 1;
+	config.stepCost                  = 1e-3;
+	ForwardSimulationResult slowLoop = sim.run(config);
+	checkForwarded(config, slowLoop);
+	assert(slowLoop.throughput() < 0.5 * result.throughput());
+
+	printf("validated throughput.\n");
+}
+
+static void
+testChainPrepare()
+{
+	// A chain prepares ahead of RX, so slow preparation costs a chain less
+	// than forwarding that prepares when the first command arrives.
+	ForwardSimulationConfig config = kDefaultForwardSimulation;
+	config.prepareCost             = 1e-4;
+	config.prepareLatency          = 1e-6;
+	config.chained                 = true;
+	ForwardSimulationResult chained = sim.run(config);
+	checkForwarded(config, chained);
+	config.chained                    = false;
+	ForwardSimulationResult unchained = sim.run(config);
+	checkForwarded(config, unchained);
+	assert(chained.seconds < unchained.seconds);
+
+	// More chunks than fit in a link's queue are prepared as the ones before
+	// them complete, however long that takes.
+	config.chained        = true;
+	config.chunkCount     = kMaxSimulatedChunks;
+	config.prepareLatency = 1e-3;
+	checkForwarded(config, sim.run(config));
+
+	printf("validated chain prepare.\n");
+}
+
+static void
+testChainScheduling()
+{
+	// Eight chains whose syncs come in about twice as fast as the TX links
+	// drain them, in the reverse of the order the chains were set up.
+	ForwardSimulationConfig config = kDefaultForwardSimulation;
+	config.chunkCount              = 16;
+	config.chainCount              = 8;
+	config.syncInterval            = 2.5e-3;
+	config.reverseSetup            = true;
+	config.policy                  = kChainDeadline;
+	ForwardSimulationResult deadline = sim.run(config);
+	checkForwarded(config, deadline);
+	config.policy                     = kChainDiscoveryOrder;
+	ForwardSimulationResult discovery = sim.run(config);
+	checkForwarded(config, discovery);
+
+	// Both move the same bytes in about the same time, but going by discovery
+	// order keeps picking the newest sync and leaves the oldest one waiting
+	// for every chain after it.
+	assert(deadline.bytesForwarded == discovery.bytesForwarded);
+	assert(deadline.maxSyncLatency < 0.75 * discovery.maxSyncLatency);
+
+	// When syncs come in setup order the two policies agree.
+	config.reverseSetup                 = false;
+	ForwardSimulationResult inOrder     = sim.run(config);
+	config.policy                       = kChainDeadline;
+	ForwardSimulationResult inOrderToo  = sim.run(config);
+	checkForwarded(config, inOrder);
+	assert(inOrder.maxSyncLatency == inOrderToo.maxSyncLatency);
+	assert(inOrder.seconds == inOrderToo.seconds);
+
+	// Unchained chunks do not wait for a chain to start.
+	config.chained = false;
+	checkForwarded(config, sim.run(config));
+
+	// The action pool keeps its slabs for the runs after the largest one.
+	const uint32_t slabs = sim.actionSlabs();
+	assert(slabs > 0);
+	sim.run(kDefaultForwardSimulation);
+	assert(sim.actionSlabs() == slabs);
+
+	printf("validated chain scheduling.\n");
+}
+
+static void
+testDeterministic()
+{
+	ForwardSimulationConfig config = kDefaultForwardSimulation;
+	config.linksPerChannel         = 2;
+	ForwardSimulationResult first  = sim.run(config);
+	sim.run(kDefaultForwardSimulation);
+	ForwardSimulationResult second = sim.run(config);
+	assert(first.seconds == second.seconds);
+	assert(first.steps == second.steps);
+	assert(first.requeues == second.requeues);
+	assert(first.maxQueueDepth == second.maxQueueDepth);
+
+	printf("validated deterministic.\n");
+}
+
+static void
+testBadConfig()
+{
+	ForwardSimulationConfig config = kDefaultForwardSimulation;
+	config.chunkCount              = kMaxSimulatedChunks + 1;
+	assert(sim.run(config).failed);
+	config                  = kDefaultForwardSimulation;
+	config.commandsPerChunk = 0;
+	assert(sim.run(config).failed);
+	config                 = kDefaultForwardSimulation;
+	config.linksPerChannel = 2;
+	config.chunkCount      = 3;
+	assert(sim.run(config).failed);
+	config            = kDefaultForwardSimulation;
+	config.chainCount = 0;
+	assert(sim.run(config).failed);
+	config.chainCount = kMaxSimulatedChains + 1;
+	assert(sim.run(config).failed);
+
+	printf("validated bad config.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testForwardsEveryChunk();
+	testThroughput();
+	testChainPrepare();
+	testChainScheduling();
+	testDeterministic();
+	testBadConfig();
+	return 0;
+}
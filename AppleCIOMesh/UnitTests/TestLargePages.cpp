@@ -0,0 +1,122 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestLargePages.cpp
+//  AppleCIOMesh
+//
+//  Maps memory with and without 2MB pages, checking the pages reported and
+//  falling back to base pages, and faults memory in from several threads,
+//  checking that every page is touched once and data already in the memory is
+//  kept. This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestLargePages.cpp
+//
+
+#include "Common/LargePages.h"
+#include <cassert>
+#include <initializer_list>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::kLargePageSize;
+using AppleCIOMeshUtils::LargePageMapping;
+
+static void
+testMapping()
+{
+	const size_t basePageSize = (size_t)getpagesize();
+
+	LargePageMapping base;
+	assert(AppleCIOMeshUtils::map_large_pages(3 * basePageSize + 1, false, 0, &base));
+	assert(base.kind == AppleCIOMeshUtils::kLargePageKindBase);
+	assert(base.pageSize == basePageSize);
+	assert(base.size == 4 * basePageSize);
+	memset(base.memory, 1, base.size);
+	AppleCIOMeshUtils::unmap_large_pages(base);
+
+	// Whatever the system gives us, the memory is usable and the mapping is
+	// consistent with the kind reported.
+	LargePageMapping large;
+	assert(AppleCIOMeshUtils::map_large_pages(kLargePageSize + 1, true, 0, &large));
+	printf("Got %s of %zu bytes\n", AppleCIOMeshUtils::large_page_kind_name(large.kind), large.pageSize);
+	switch (large.kind) {
+	case AppleCIOMeshUtils::kLargePageKindHuge:
+		assert(large.pageSize == kLargePageSize);
+		assert(large.size == 2 * kLargePageSize);
+		assert((uintptr_t)large.memory % kLargePageSize == 0);
+		break;
+	case AppleCIOMeshUtils::kLargePageKindTransparent:
+		assert(large.pageSize == basePageSize);
+		assert(large.size == 2 * kLargePageSize);
+		assert((uintptr_t)large.memory % kLargePageSize == 0);
+		break;
+	case AppleCIOMeshUtils::kLargePageKindBase:
+		assert(large.pageSize == basePageSize);
+		assert(large.size >= kLargePageSize + 1);
+		break;
+	}
+	memset(large.memory, 1, large.size);
+	AppleCIOMeshUtils::unmap_large_pages(large);
+	printf("validated mapping.\n");
+}
+
+static void
+testPrefault()
+{
+	const size_t basePageSize = (size_t)getpagesize();
+	const size_t pages        = 37;
+
+	LargePageMapping mapping;
+	assert(AppleCIOMeshUtils::map_large_pages(pages * basePageSize, false, 0, &mapping));
+	uint8_t * memory = (uint8_t *)mapping.memory;
+	for (size_t i = 0; i < mapping.size; i++) {
+		memory[i] = (uint8_t)(i * 7);
+	}
+
+	// Any number of threads, including more threads than pages, touches each
+	// page once.
+	for (uint32_t threads : {0u, 1u, 2u, 3u, 8u, 16u, 100u}) {
+		assert(AppleCIOMeshUtils::prefault_parallel(memory, pages * basePageSize, basePageSize, threads) == pages);
+	}
+	// A size that is not a multiple of the page size still touches its last
+	// page.
+	assert(AppleCIOMeshUtils::prefault_parallel(memory, 5 * basePageSize + 1, basePageSize, 4) == 6);
+	assert(AppleCIOMeshUtils::prefault_parallel(memory, 1, basePageSize, 4) == 1);
+	assert(AppleCIOMeshUtils::prefault_parallel(memory, 0, basePageSize, 4) == 0);
+
+	for (size_t i = 0; i < mapping.size; i++) {
+		assert(memory[i] == (uint8_t)(i * 7));
+	}
+	AppleCIOMeshUtils::unmap_large_pages(mapping);
+
+	// Fresh memory reads as zeros once faulted in.
+	assert(AppleCIOMeshUtils::map_large_pages(pages * basePageSize, true, 0, &mapping));
+	assert(AppleCIOMeshUtils::prefault_parallel(mapping.memory, mapping.size, mapping.pageSize, 8) ==
+	       mapping.size / mapping.pageSize);
+	for (size_t i = 0; i < mapping.size; i += basePageSize) {
+		assert(((uint8_t *)mapping.memory)[i] == 0);
+	}
+	AppleCIOMeshUtils::unmap_large_pages(mapping);
+	printf("validated prefault.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testMapping();
+	testPrefault();
+	return 0;
+}
@@ -0,0 +1,230 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestLogLinearHistogram.cpp
+//  AppleCIOMesh
+//
+//  Checks the quantile estimates of the log-linear histogram against the
+//  exact quantiles of the same samples. This test has no platform
+//  dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestLogLinearHistogram.cpp
+//
+
+#include "Common/LogLinearHistogram.h"
+#include "Framework/MeshStatistics.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+using Histogram = AppleCIOMeshUtils::LogLinearHistogram<7, 40>;
+
+static const double kQuantiles[] = {0.0, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999, 0.9999, 1.0};
+
+// Same rank rule as LogLinearHistogram::value_at_quantile.
+static uint64_t
+exactQuantile(const std::vector<uint64_t> & sorted, double q)
+{
+	uint64_t rank = (uint64_t)(q * (double)sorted.size() + 0.5);
+	if (rank == 0) {
+		rank = 1;
+	} else if (rank > sorted.size()) {
+		rank = sorted.size();
+	}
+	return sorted[rank - 1];
+}
+
+static void
+verifyQuantiles(const Histogram & histogram, std::vector<uint64_t> samples, const char * name)
+{
+	std::sort(samples.begin(), samples.end());
+	assert(histogram.count() == samples.size());
+	assert(histogram.maximum() == samples.back());
+
+	for (double q : kQuantiles) {
+		const uint64_t exact    = exactQuantile(samples, q);
+		const uint64_t estimate = histogram.value_at_quantile(q);
+		const double error      = exact == 0 ? (double)estimate : fabs((double)estimate - (double)exact) / (double)exact;
+
+		// The estimate is never below the exact value and never more than one
+		// sub-bucket above it.
+		assert(estimate >= exact);
+		assert(error <= 1.0 / Histogram::kSubBucketCount);
+	}
+	printf("validated quantiles of %s (%zu samples).\n", name, samples.size());
+}
+
+static void
+testBucketBoundaries()
+{
+	for (uint32_t bucket = 0; bucket < Histogram::kBucketCount; bucket++) {
+		const uint64_t low  = Histogram::lowest_value_for_bucket(bucket);
+		const uint64_t high = Histogram::highest_value_for_bucket(bucket);
+		assert(low <= high);
+		assert(Histogram::bucket_for_value(low) == bucket);
+		assert(Histogram::bucket_for_value(high) == bucket);
+		if (bucket + 1 < Histogram::kBucketCount) {
+			assert(Histogram::lowest_value_for_bucket(bucket + 1) == high + 1);
+		}
+	}
+	assert(Histogram::highest_value_for_bucket(Histogram::kBucketCount - 1) == Histogram::kMaxValue);
+	printf("validated bucket boundaries.\n");
+}
+
+static void
+testEmptyAndOverflow()
+{
+	Histogram histogram;
+	assert(histogram.count() == 0);
+	assert(histogram.value_at_quantile(0.5) == 0);
+
+	histogram.record(Histogram::kMaxValue + 12345);
+	assert(histogram.overflows() == 1);
+	assert(histogram.count() == 1);
+	assert(histogram.count_at_bucket(Histogram::kBucketCount - 1) == 1);
+
+	histogram.reset();
+	assert(histogram.count() == 0);
+	assert(histogram.maximum() == 0);
+	printf("validated empty and overflowing histograms.\n");
+}
+
+static void
+testDistributions()
+{
+	std::mt19937_64 rng(0x4349304d455348ull);
+
+	// Sync times in ns, log-normal around 60us.
+	{
+		std::lognormal_distribution<double> dist(log(60000.0), 0.5);
+		std::vector<uint64_t> samples;
+		Histogram histogram;
+		for (int i = 0; i < 1000000; i++) {
+			samples.push_back((uint64_t)dist(rng));
+			histogram.record(samples.back());
+		}
+		verifyQuantiles(histogram, samples, "log-normal");
+	}
+
+	// Bimodal: most syncs are fast but 2% of them wait on a straggler.
+	{
+		std::normal_distribution<double> fast(40000.0, 3000.0);
+		std::normal_distribution<double> slow(2500000.0, 400000.0);
+		std::uniform_real_distribution<double> pick(0.0, 1.0);
+		std::vector<uint64_t> samples;
+		Histogram histogram;
+		for (int i = 0; i < 500000; i++) {
+			const double v = pick(rng) < 0.98 ? fast(rng) : slow(rng);
+			samples.push_back(v < 0 ? 0 : (uint64_t)v);
+			histogram.record(samples.back());
+		}
+		verifyQuantiles(histogram, samples, "bimodal");
+	}
+
+	// Small values are recorded exactly.
+	{
+		std::uniform_int_distribution<uint64_t> dist(0, Histogram::kSubBucketCount - 1);
+		std::vector<uint64_t> samples;
+		Histogram histogram;
+		for (int i = 0; i < 10000; i++) {
+			samples.push_back(dist(rng));
+			histogram.record(samples.back());
+		}
+		std::sort(samples.begin(), samples.end());
+		for (double q : kQuantiles) {
+			assert(histogram.value_at_quantile(q) == exactQuantile(samples, q));
+		}
+		printf("validated exact small values.\n");
+	}
+}
+
+static void
+testMergeAcrossThreads()
+{
+	const int kThreads          = 8;
+	const int kSamplesPerThread = 200000;
+
+	std::vector<Histogram> perThread(kThreads);
+	std::vector<std::vector<uint64_t>> perThreadSamples(kThreads);
+	Histogram shared;
+	std::vector<std::thread> threads;
+
+	for (int t = 0; t < kThreads; t++) {
+		threads.emplace_back([&, t]() {
+			// Give each thread a different latency profile, like a slow peer.
+			std::mt19937_64 rng((uint64_t)t + 1);
+			std::exponential_distribution<double> dist(1.0 / (10000.0 * (t + 1)));
+			for (int i = 0; i < kSamplesPerThread; i++) {
+				const uint64_t v = (uint64_t)dist(rng);
+				perThreadSamples[t].push_back(v);
+				perThread[t].record(v);
+				shared.record(v);
+			}
+		});
+	}
+	for (auto & thread : threads) {
+		thread.join();
+	}
+
+	Histogram merged;
+	std::vector<uint64_t> all;
+	for (int t = 0; t < kThreads; t++) {
+		merged.merge(perThread[t]);
+		all.insert(all.end(), perThreadSamples[t].begin(), perThreadSamples[t].end());
+	}
+
+	for (uint32_t bucket = 0; bucket < Histogram::kBucketCount; bucket++) {
+		assert(merged.count_at_bucket(bucket) == shared.count_at_bucket(bucket));
+	}
+	assert(merged.sum() == shared.sum());
+	assert(merged.maximum() == shared.maximum());
+
+	verifyQuantiles(merged, all, "merged per-thread histograms");
+}
+
+static void
+testSyncTimeRange()
+{
+	// The framework records sync times in nsec and wants 1% accuracy between
+	// 1usec and 10sec.
+	const uint64_t kMinSyncTime = 1000;
+	const uint64_t kMaxSyncTime = 10ull * 1000 * 1000 * 1000;
+	static_assert(MeshSyncTimeHistogram::kMaxValue >= kMaxSyncTime, "Sync time histogram range is too small");
+
+	for (uint64_t v = kMinSyncTime; v <= kMaxSyncTime; v = v * 3 / 2 + 7) {
+		MeshSyncTimeHistogram histogram;
+		histogram.record(v);
+		histogram.record(v + 1);
+		const uint64_t estimate = histogram.value_at_quantile(0.5);
+		assert(estimate >= v);
+		assert((double)(estimate - v) / (double)v <= 0.01);
+	}
+	printf("validated sync time range.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testBucketBoundaries();
+	testEmptyAndOverflow();
+	testDistributions();
+	testMergeAcrossThreads();
+	testSyncTimeRange();
+	return 0;
+}
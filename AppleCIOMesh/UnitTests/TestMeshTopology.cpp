@@ -0,0 +1,284 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestMeshTopology.cpp
+//  AppleCIOMesh
+//
+//  Checks the partial hypercube topology for every node count from 2 to 8:
+//  that the links canActivate asks for are the ones it always did for 2, 4
+//  and 8 nodes and come in cable pairs that both ends agree on, and that the
+//  route costs match the ensemble map. Then runs a broadcast over a loopback
+//  of those links, every node sending its block and passing on the blocks it
+//  forwards, and checks every node ends up with every block exactly once.
+//  Sparse masks, as left by a failed node, are checked the same way.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestMeshTopology.cpp
+//
+
+#include "Common/CollectiveSchedule.h"
+#include "Common/MeshTopology.h"
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+
+using AppleCIOMeshUtils::ensemble_route_cost;
+using AppleCIOMeshUtils::kCollectiveCioHop;
+using AppleCIOMeshUtils::kMeshChassisNodes;
+using AppleCIOMeshUtils::kMeshLinkCount;
+using AppleCIOMeshUtils::kMeshNoNode;
+using AppleCIOMeshUtils::kMeshPartitionNodes;
+using AppleCIOMeshUtils::mesh_connected;
+using AppleCIOMeshUtils::mesh_forward_targets;
+using AppleCIOMeshUtils::mesh_has_node;
+using AppleCIOMeshUtils::mesh_link_partner;
+using AppleCIOMeshUtils::mesh_next_hop;
+using AppleCIOMeshUtils::mesh_node_mask;
+using AppleCIOMeshUtils::mesh_partner;
+using AppleCIOMeshUtils::mesh_required_links;
+using AppleCIOMeshUtils::mesh_routable;
+using AppleCIOMeshUtils::mesh_route_hops;
+
+static uint32_t
+popcount(uint32_t mask)
+{
+	return (uint32_t)__builtin_popcount(mask);
+}
+
+static void
+testRequiredLinks()
+{
+	// What _canActivate2, 4 and 8 used to check.
+	for (uint32_t rank = 0; rank < 2; rank++) {
+		assert(mesh_required_links(mesh_node_mask(2), rank) == ((1u << 4) | (1u << 7)));
+	}
+	for (uint32_t rank = 0; rank < 4; rank++) {
+		assert(mesh_required_links(mesh_node_mask(4), rank) == 0xF5);
+	}
+	for (uint32_t rank = 0; rank < 8; rank++) {
+		assert(mesh_required_links(mesh_node_mask(8), rank) == 0xFF);
+	}
+
+	// A node without its partner leaves the A cable (acio 1 and 3) unused.
+	assert(mesh_required_links(mesh_node_mask(5), 0) == 0xFF);
+	assert(mesh_required_links(mesh_node_mask(5), 1) == 0xF5);
+	assert(mesh_required_links(mesh_node_mask(5), 4) == 0x0A);
+	assert(mesh_required_links(mesh_node_mask(3), 2) == 0x65);
+
+	assert(mesh_node_mask(0) == 0 && mesh_node_mask(kMeshPartitionNodes + 1) == 0);
+	assert(mesh_link_partner(mesh_node_mask(8), 8, 0) == kMeshNoNode);
+	assert(mesh_link_partner(mesh_node_mask(8), 0, kMeshLinkCount) == kMeshNoNode);
+
+	printf("validated required links.\n");
+}
+
+// Both ends of every link agree, and every pair of connected nodes has a
+// cable (two links) between them.
+static void
+checkLinks(uint32_t mask)
+{
+	for (uint32_t rank = 0; rank < kMeshPartitionNodes; rank++) {
+		if (!mesh_has_node(mask, rank)) {
+			assert(mesh_required_links(mask, rank) == 0);
+			continue;
+		}
+
+		uint32_t linksTo[kMeshPartitionNodes] = {};
+		for (uint32_t acio = 0; acio < kMeshLinkCount; acio++) {
+			const uint32_t partner = mesh_link_partner(mask, rank, acio);
+			if (partner == kMeshNoNode) {
+				continue;
+			}
+			assert(partner != rank);
+			assert(mesh_connected(mask, rank, partner));
+			linksTo[partner]++;
+
+			uint32_t back = 0;
+			for (uint32_t theirs = 0; theirs < kMeshLinkCount; theirs++) {
+				back += mesh_link_partner(mask, partner, theirs) == rank;
+			}
+			assert(back == 2);
+		}
+		for (uint32_t other = 0; other < kMeshPartitionNodes; other++) {
+			assert(linksTo[other] == (mesh_connected(mask, rank, other) ? 2u : 0u));
+		}
+	}
+}
+
+// Every node sends its block to the nodes it is connected to, and passes the
+// blocks it forwards on as they arrive. Checks every node gets every block
+// once, over the route the topology says, and returns the forwards done.
+static uint32_t
+loopbackBroadcast(uint32_t mask)
+{
+	struct Delivery {
+		uint8_t from;
+		uint8_t to;
+		uint8_t block;
+		uint8_t hops;
+	};
+	Delivery queue[kMeshPartitionNodes * kMeshPartitionNodes * kMeshPartitionNodes];
+	uint32_t head = 0, tail = 0;
+	uint32_t received[kMeshPartitionNodes][kMeshPartitionNodes] = {};
+	uint32_t forwards = 0;
+
+	for (uint32_t src = 0; src < kMeshPartitionNodes; src++) {
+		for (uint32_t dst = 0; dst < kMeshPartitionNodes; dst++) {
+			if (mesh_connected(mask, src, dst)) {
+				queue[tail++] = {(uint8_t)src, (uint8_t)dst, (uint8_t)src, 1};
+			}
+		}
+	}
+
+	while (head != tail) {
+		const Delivery delivery = queue[head++];
+		assert(mesh_connected(mask, delivery.from, delivery.to));
+		assert(mesh_next_hop(mask, delivery.from, delivery.to) == delivery.to ||
+		       mesh_forward_targets(mask, delivery.from, delivery.block) & (1u << delivery.to));
+		received[delivery.to][delivery.block]++;
+
+		// The hops it took are the hops of its route.
+		if (mesh_next_hop(mask, delivery.block, delivery.to) != kMeshNoNode) {
+			assert(delivery.hops == mesh_route_hops(mask, delivery.block, delivery.to));
+		}
+
+		const uint32_t targets = mesh_forward_targets(mask, delivery.to, delivery.block);
+		for (uint32_t dst = 0; dst < kMeshPartitionNodes; dst++) {
+			if (targets & (1u << dst)) {
+				assert(tail < sizeof(queue) / sizeof(queue[0]));
+				queue[tail++] = {delivery.to, (uint8_t)dst, delivery.block, (uint8_t)(delivery.hops + 1)};
+				forwards++;
+			}
+		}
+	}
+
+	for (uint32_t node = 0; node < kMeshPartitionNodes; node++) {
+		for (uint32_t block = 0; block < kMeshPartitionNodes; block++) {
+			const bool expected = node != block && mesh_has_node(mask, node) && mesh_has_node(mask, block);
+			assert(received[node][block] == (expected ? 1u : 0u));
+		}
+	}
+	return forwards;
+}
+
+static void
+testNodeCounts()
+{
+	for (uint32_t nodeCount = 2; nodeCount <= kMeshPartitionNodes; nodeCount++) {
+		const uint32_t mask = mesh_node_mask(nodeCount);
+		assert(popcount(mask) == nodeCount);
+		assert(mesh_routable(mask));
+		checkLinks(mask);
+
+		// The ensemble map costs are the hops of the routes.
+		for (uint32_t src = 0; src < nodeCount; src++) {
+			for (uint32_t dst = 0; dst < nodeCount; dst++) {
+				const uint32_t hops = mesh_route_hops(mask, src, dst);
+				assert(hops <= 2);
+				assert(hops * kCollectiveCioHop == ensemble_route_cost(nodeCount, src, dst));
+			}
+		}
+
+		// What each node sends, its own block to its neighbours and the
+		// forwards, is what the router waits for. With a partner a node
+		// forwards the partner's block to the rest of its chassis and the
+		// blocks of the chassis nodes without a partner to the partner.
+		uint32_t forwards = 0;
+		for (uint32_t rank = 0; rank < nodeCount; rank++) {
+			const uint32_t chassis = rank - rank % kMeshChassisNodes;
+			uint32_t inChassis     = 0;
+			uint32_t unpartnered   = 0;
+			for (uint32_t other = chassis; other < chassis + kMeshChassisNodes; other++) {
+				if (other != rank && other < nodeCount) {
+					inChassis++;
+					unpartnered += mesh_partner(other) >= nodeCount;
+				}
+			}
+
+			uint32_t sent = 0;
+			for (uint32_t src = 0; src < nodeCount; src++) {
+				sent += popcount(mesh_forward_targets(mask, rank, src));
+			}
+			const bool partnered = mesh_partner(rank) < nodeCount;
+			assert(sent == (partnered ? inChassis + unpartnered : 0));
+			forwards += sent;
+		}
+
+		assert(loopbackBroadcast(mask) == forwards);
+		if (nodeCount <= kMeshChassisNodes) {
+			assert(forwards == 0);
+		}
+	}
+
+	// The full hypercube forwards every partner's block to three nodes.
+	assert(loopbackBroadcast(mesh_node_mask(8)) == 8 * 3);
+
+	printf("validated node counts.\n");
+}
+
+static void
+testSparseMasks()
+{
+	uint32_t routable = 0;
+	for (uint32_t mask = 1; mask < (1u << kMeshPartitionNodes); mask++) {
+		if (popcount(mask) < 2) {
+			continue;
+		}
+		checkLinks(mask);
+		if (!mesh_routable(mask)) {
+			// Only nodes on both chassis with no slot in common are cut off.
+			bool shared = false;
+			for (uint32_t slot = 0; slot < kMeshChassisNodes; slot++) {
+				shared |= mesh_has_node(mask, slot) && mesh_has_node(mask, mesh_partner(slot));
+			}
+			assert(!shared && (mask & 0x0F) != 0 && (mask & 0xF0) != 0);
+			continue;
+		}
+		routable++;
+		loopbackBroadcast(mask);
+	}
+	// Of the 247 masks with two nodes or more, 50 split the chassis that way.
+	assert(routable == 247 - 50);
+
+	// Losing a node of the full hypercube leaves it routable either way.
+	for (uint32_t failed = 0; failed < kMeshPartitionNodes; failed++) {
+		const uint32_t mask = mesh_node_mask(8) & ~(1u << failed);
+		assert(mesh_routable(mask));
+		for (uint32_t src = 0; src < kMeshPartitionNodes; src++) {
+			for (uint32_t dst = 0; dst < kMeshPartitionNodes; dst++) {
+				if (src != dst && mesh_has_node(mask, src) && mesh_has_node(mask, dst)) {
+					assert(mesh_route_hops(mask, src, dst) <= 2);
+				}
+			}
+		}
+	}
+
+	// Neither partner there: through a slot that has both.
+	const uint32_t mask = (1u << 0) | (1u << 2) | (1u << 5) | (1u << 6);
+	assert(mesh_next_hop(mask, 0, 5) == 2);
+	assert(mesh_route_hops(mask, 0, 5) == 3);
+
+	printf("validated sparse masks.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testRequiredLinks();
+	testNodeCounts();
+	testSparseMasks();
+	return 0;
+}
@@ -0,0 +1,239 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+//  TestMultiPathRoutes.cpp
+//  AppleCIOMesh
+//
+//  Checks that chunks are split across the routes to a destination in
+//  proportion to their weights, that the weights follow the completion
+//  latencies of the channels, and that splitting over every cheapest route
+//  evens out the forwarding load of an 8 node partition, per chunk and per
+//  all-to-all slice. This test has no
+//  platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestMultiPathRoutes.cpp
+//
+
+#include "Common/CollectiveSchedule.h"
+#include "Common/MultiPathRoutes.h"
+#include <cassert>
+#include <initializer_list>
+#include <stdint.h>
+#include <stdio.h>
+
+using AppleCIOMeshUtils::CollectiveTopology;
+using AppleCIOMeshUtils::kMaxCollectiveNodes;
+using AppleCIOMeshUtils::kMaxRoutesPerDestination;
+using AppleCIOMeshUtils::kMinRouteWeight;
+using AppleCIOMeshUtils::kRouteWeightScale;
+using AppleCIOMeshUtils::MultiPathRoutes;
+
+using Routes = MultiPathRoutes<8, 4>;
+
+static void
+testRoutes()
+{
+	Routes routes = {};
+	assert(routes.routeCount(5) == 0);
+	assert(routes.bestRoute(5) == -1);
+	assert(routes.routeForChunk(5, 0) == -1);
+
+	assert(routes.addRoute(5, 0, 1));
+	assert(routes.routeForChunk(5, 7) == 0);
+	assert(routes.addRoute(5, 1, 4));
+	// Adding the same channel again only updates the forwarder.
+	assert(routes.addRoute(5, 1, 4));
+	assert(routes.routeCount(5) == 2);
+	assert(routes.route(5, 1).forwarder == 4);
+
+	// Out of range destinations and channels are refused, and so is a fifth
+	// route.
+	assert(!routes.addRoute(8, 0, 1));
+	assert(!routes.addRoute(5, 4, 1));
+	assert(!routes.addRoute(5, -1, 1));
+	assert(routes.addRoute(6, 0, 1) && routes.addRoute(6, 1, 2) && routes.addRoute(6, 2, 3) && routes.addRoute(6, 3, 4));
+	assert(routes.routeCount(6) == kMaxRoutesPerDestination);
+
+	// Without latencies every route is as good, the first wins.
+	assert(routes.bestRoute(5) == 0);
+	assert(routes.bestRoute(5, 0) == 1);
+
+	// Removing a channel drops its routes and keeps the order of the rest.
+	routes.removeChannel(0);
+	assert(routes.routeCount(5) == 1 && routes.route(5, 0).channel == 1);
+	assert(routes.routeCount(6) == 3 && routes.route(6, 0).channel == 1 && routes.route(6, 2).channel == 3);
+	routes.clear();
+	assert(routes.routeCount(6) == 0);
+
+	printf("validated routes.\n");
+}
+
+static void
+testSplit()
+{
+	Routes routes = {};
+	routes.addRoute(5, 0, 1);
+	routes.addRoute(5, 1, 4);
+
+	// Equal weights split any run of chunks in half, give or take one.
+	for (uint32_t start : {0u, 3u, 1000u}) {
+		for (uint32_t run : {2u, 7u, 64u, 1000u}) {
+			uint32_t counts[2] = {};
+			for (uint32_t chunk = start; chunk < start + run; chunk++) {
+				counts[routes.routeForChunk(5, chunk)]++;
+			}
+			const int32_t difference = (int32_t)counts[0] - (int32_t)counts[1];
+			assert(difference >= -2 && difference <= 2);
+		}
+	}
+
+	// A channel that completes three times as slow gets a third of the
+	// weight and a quarter of the chunks.
+	routes.recordCompletion(0, 1000);
+	routes.recordCompletion(1, 3000);
+	assert(routes.weight(5, 0) == kRouteWeightScale);
+	assert(routes.weight(5, 1) == kRouteWeightScale / 3);
+	assert(routes.bestRoute(5) == 0);
+	uint32_t counts[2] = {};
+	for (uint32_t chunk = 0; chunk < 4000; chunk++) {
+		counts[routes.routeForChunk(5, chunk)]++;
+	}
+	assert(counts[1] > 950 && counts[1] < 1050);
+
+	// A very slow channel still carries the odd chunk.
+	routes.clear();
+	routes.addRoute(5, 0, 1);
+	routes.addRoute(5, 1, 4);
+	routes.recordCompletion(0, 1000);
+	routes.recordCompletion(1, 1000000);
+	assert(routes.weight(5, 1) == kMinRouteWeight);
+	counts[0] = counts[1] = 0;
+	for (uint32_t chunk = 0; chunk < 1000; chunk++) {
+		counts[routes.routeForChunk(5, chunk)]++;
+	}
+	assert(counts[1] > 40 && counts[1] < 80);
+
+	printf("validated split.\n");
+}
+
+static void
+testAdapt()
+{
+	Routes routes = {};
+	routes.addRoute(5, 0, 1);
+	routes.addRoute(5, 1, 4);
+	routes.recordCompletion(0, 1000);
+	routes.recordCompletion(1, 1000);
+	assert(routes.weight(5, 1) == kRouteWeightScale);
+
+	// Channel 1 slows down to twice the latency, its average follows within
+	// a few dozen samples and the best route moves away from it when channel
+	// 0 slows down further.
+	for (uint32_t i = 0; i < 64; i++) {
+		routes.recordCompletion(1, 2000);
+	}
+	assert(routes.channelLatency(1) > 1950 && routes.channelLatency(1) <= 2000);
+	assert(routes.weight(5, 1) > kRouteWeightScale / 2 - 16 && routes.weight(5, 1) <= kRouteWeightScale / 2);
+	for (uint32_t i = 0; i < 64; i++) {
+		routes.recordCompletion(0, 4000);
+	}
+	assert(routes.bestRoute(5) == 1);
+	// A direct route wins however slow it is.
+	routes.addRoute(5, 2, 5);
+	routes.recordCompletion(2, 100000);
+	assert(routes.bestRoute(5) == 2);
+	assert(routes.bestRoute(5, 2) == 1);
+	// A zero latency sample never reads as no sample.
+	routes.recordCompletion(3, 0);
+	assert(routes.channelLatency(3) == 1);
+
+	printf("validated adapt.\n");
+}
+
+static void
+testForwardLoads()
+{
+	CollectiveTopology topology;
+	uint64_t single[kMaxCollectiveNodes], multi[kMaxCollectiveNodes];
+	const uint32_t chunks = 64;
+
+	// In an 8 node partition the three nodes of the other chassis at a
+	// different position are two hops away, through the node of either
+	// chassis.
+	assert(AppleCIOMeshUtils::make_ensemble_topology(8, &topology));
+	uint32_t forwarders[kMaxRoutesPerDestination];
+	assert(AppleCIOMeshUtils::collective_forwarders(topology, 0, 4, forwarders) == 1 && forwarders[0] == 4);
+	assert(AppleCIOMeshUtils::collective_forwarders(topology, 0, 5, forwarders) == 2);
+	assert(forwarders[0] == 1 && forwarders[1] == 4);
+	assert(AppleCIOMeshUtils::collective_next_hop(topology, 0, 5) == 1);
+
+	// Taking the first route every time has some nodes forward twice what
+	// others do, splitting evens it out and forwards as much in total.
+	AppleCIOMeshUtils::mesh_forward_loads(topology, chunks, 1, single);
+	AppleCIOMeshUtils::mesh_forward_loads(topology, chunks, kMaxRoutesPerDestination, multi);
+	uint64_t singleMin = UINT64_MAX, singleMax = 0, multiMin = UINT64_MAX, multiMax = 0;
+	uint64_t singleTotal = 0, multiTotal = 0;
+	for (uint32_t node = 0; node < 8; node++) {
+		singleMin = single[node] < singleMin ? single[node] : singleMin;
+		singleMax = single[node] > singleMax ? single[node] : singleMax;
+		multiMin  = multi[node] < multiMin ? multi[node] : multiMin;
+		multiMax  = multi[node] > multiMax ? multi[node] : multiMax;
+		singleTotal += single[node];
+		multiTotal += multi[node];
+	}
+	assert(singleTotal == 8 * 3 * chunks && multiTotal == singleTotal);
+	assert(singleMax >= 2 * singleMin);
+	assert(multiMax - multiMin <= 8);
+
+	// With one transfer per pair the balanced hops have every node relay
+	// three, over a cheapest route.
+	uint32_t hops[kMaxCollectiveNodes * kMaxCollectiveNodes];
+	AppleCIOMeshUtils::collective_balanced_hops(topology, hops);
+	uint32_t relayed[8] = {};
+	for (uint32_t src = 0; src < 8; src++) {
+		for (uint32_t dst = 0; dst < 8; dst++) {
+			const uint32_t hop = hops[src * 8 + dst];
+			if (src == dst || hop == dst) {
+				assert(hop == dst);
+				continue;
+			}
+			assert(topology.cost(src, hop) + topology.cost(hop, dst) == topology.cost(src, dst));
+			relayed[hop]++;
+		}
+	}
+	for (uint32_t node = 0; node < 8; node++) {
+		assert(relayed[node] == 3);
+	}
+
+	// Nodes of one chassis have no one to forward for.
+	assert(AppleCIOMeshUtils::make_ensemble_topology(4, &topology));
+	AppleCIOMeshUtils::mesh_forward_loads(topology, chunks, kMaxRoutesPerDestination, multi);
+	for (uint32_t node = 0; node < 4; node++) {
+		assert(multi[node] == 0);
+	}
+
+	printf("validated forward loads.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testRoutes();
+	testSplit();
+	testAdapt();
+	testForwardLoads();
+	return 0;
+}
@@ -0,0 +1,285 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestNodeMasks.cpp
+//  AppleCIOMesh
+//
+//  Checks the node masks the framework derives keys for: that every node of
+//  a 2 to 8 node mesh has the keys of the mesh's mask in every partition,
+//  and that the key labels of the masks that were there before are
+//  unchanged. Then runs a broadcast and gather on 3 and 6 node meshes (and
+//  every other count) over a loopback of their links. Each node encrypts its
+//  block with the keys of the mask, puts it at its offset in the buffer and
+//  passes on the blocks it forwards still encrypted. Every node then has to
+//  end up with the same, decrypted buffer.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestNodeMasks.cpp
+//
+
+#include "Common/MeshTopology.h"
+#include "Common/NodeMasks.h"
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+using AppleCIOMeshUtils::kMeshChassisNodes;
+using AppleCIOMeshUtils::kMeshKeyNodeMask;
+using AppleCIOMeshUtils::kMeshKeyPair;
+using AppleCIOMeshUtils::kMeshNodeMaskCount;
+using AppleCIOMeshUtils::kMeshNodeMasks;
+using AppleCIOMeshUtils::kMeshPartitionNodes;
+using AppleCIOMeshUtils::mesh_block_index;
+using AppleCIOMeshUtils::mesh_connected;
+using AppleCIOMeshUtils::mesh_forward_targets;
+using AppleCIOMeshUtils::mesh_has_node;
+using AppleCIOMeshUtils::mesh_key_labels;
+using AppleCIOMeshUtils::mesh_key_masks;
+using AppleCIOMeshUtils::mesh_node_mask;
+using AppleCIOMeshUtils::mesh_valid_node_mask;
+
+static constexpr uint32_t kPartitions = 4;
+static constexpr uint32_t kBlockSize  = 256;
+
+static void
+testMaskTable()
+{
+	// The masks there were before, plus 0x7, 0x1F, 0x3F, 0x7F and 0x70 in
+	// each partition.
+	assert(kMeshNodeMaskCount == 115 + 5 * kPartitions);
+	for (uint32_t i = 1; i < kMeshNodeMaskCount; i++) {
+		assert(kMeshNodeMasks[i - 1] < kMeshNodeMasks[i]);
+	}
+
+	for (uint32_t partition = 0; partition < kPartitions; partition++) {
+		for (uint32_t nodeCount = 2; nodeCount <= kMeshPartitionNodes; nodeCount++) {
+			assert(mesh_valid_node_mask((uint64_t)mesh_node_mask(nodeCount) << (partition * 8)));
+		}
+		// Every chassis of a partial mesh.
+		for (uint32_t nodeCount = kMeshChassisNodes + 2; nodeCount <= kMeshPartitionNodes; nodeCount++) {
+			const uint64_t chassis = mesh_node_mask(nodeCount) & ~mesh_node_mask(kMeshChassisNodes);
+			assert(mesh_valid_node_mask(chassis << (partition * 8)));
+		}
+	}
+	assert(mesh_valid_node_mask(0xFFFFFFFF) && mesh_valid_node_mask(0xFF00FF));
+	assert(!mesh_valid_node_mask(0) && !mesh_valid_node_mask(0x1) && !mesh_valid_node_mask(0x11));
+
+	// The labels of the masks that were there before derive the same keys.
+	char key[128];
+	char iv[128];
+	assert(mesh_key_labels(0xFF, kMeshKeyNodeMask, key, sizeof(key), iv, sizeof(iv)));
+	assert(strcmp(key, "key-derivation-255") == 0 && strcmp(iv, "IV-nonce-255") == 0);
+	assert(mesh_key_labels(0x7, kMeshKeyNodeMask, key, sizeof(key), iv, sizeof(iv)));
+	assert(strcmp(key, "key-derivation-7") == 0 && strcmp(iv, "IV-nonce-7") == 0);
+	assert(!mesh_key_labels(0xFF, kMeshKeyNodeMask, key, 8, iv, sizeof(iv)));
+
+	// A pair that is a node mask too gets keys of its own.
+	char pairKey[128];
+	char pairIV[128];
+	assert(mesh_key_labels(0x3, kMeshKeyNodeMask, key, sizeof(key), iv, sizeof(iv)));
+	assert(mesh_key_labels(0x3, kMeshKeyPair, pairKey, sizeof(pairKey), pairIV, sizeof(pairIV)));
+	assert(strcmp(key, pairKey) != 0 && strcmp(iv, pairIV) != 0);
+
+	printf("validated mask table.\n");
+}
+
+static void
+testKeyMasks()
+{
+	for (uint32_t rank = 0; rank < kPartitions * kMeshPartitionNodes; rank++) {
+		uint64_t masks[kMeshNodeMaskCount];
+		const uint32_t count = mesh_key_masks(rank, masks, kMeshNodeMaskCount);
+		assert(count > 0 && count < kMeshNodeMaskCount);
+		for (uint32_t i = 0; i < count; i++) {
+			assert(masks[i] & (1ull << rank));
+		}
+
+		// Every mesh in the partition the node is part of.
+		const uint32_t partitionRank = rank % kMeshPartitionNodes;
+		const uint32_t shift         = (rank / kMeshPartitionNodes) * 8;
+		for (uint32_t nodeCount = partitionRank + 1; nodeCount <= kMeshPartitionNodes; nodeCount++) {
+			if (nodeCount < 2) {
+				continue;
+			}
+			const uint64_t meshMask = (uint64_t)mesh_node_mask(nodeCount) << shift;
+			bool found              = false;
+			for (uint32_t i = 0; i < count; i++) {
+				found |= masks[i] == meshMask;
+			}
+			assert(found);
+		}
+
+		// The count is the same when there's no room for them all.
+		assert(mesh_key_masks(rank, masks, 1) == count);
+	}
+	printf("validated key masks.\n");
+}
+
+// Stands in for the HKDF of the framework: the same label and node give the
+// same key on every node, different ones a different key.
+static uint64_t
+deriveKey(const char * label, uint32_t node)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const char * c = label; *c; c++) {
+		hash = (hash ^ (uint8_t)*c) * 0x100000001b3ull;
+	}
+	return (hash ^ node) * 0x100000001b3ull;
+}
+
+static void
+crypt(uint8_t * data, uint32_t size, uint64_t key)
+{
+	uint64_t state = key | 1;
+	for (uint32_t i = 0; i < size; i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		data[i] ^= (uint8_t)state;
+	}
+}
+
+struct Node {
+	uint64_t keyMasks[kMeshNodeMaskCount];
+	uint32_t keyCount;
+	uint8_t buffer[kMeshPartitionNodes * kBlockSize];
+};
+
+// The key node uses for sender's blocks of a buffer of mask, like
+// lookupKeyFromMask and setNodeKeys. Every node has to have it.
+static uint64_t
+blockKey(const Node & node, uint64_t mask, uint32_t sender)
+{
+	for (uint32_t i = 0; i < node.keyCount; i++) {
+		if (node.keyMasks[i] == mask) {
+			char key[128];
+			char iv[128];
+			assert(mesh_key_labels(mask, kMeshKeyNodeMask, key, sizeof(key), iv, sizeof(iv)));
+			return deriveKey(key, sender) ^ deriveKey(iv, sender);
+		}
+	}
+	assert(!"No key for the mask");
+	return 0;
+}
+
+static uint8_t
+plaintext(uint32_t sender, uint32_t offset)
+{
+	return (uint8_t)(sender * 37 + offset);
+}
+
+// Broadcasts every node's block of a buffer of mask to all the others, and
+// checks they all gather the same buffer.
+static void
+broadcastAndGather(uint32_t mask)
+{
+	static Node nodes[kMeshPartitionNodes];
+	static uint8_t sent[kMeshPartitionNodes][kBlockSize];
+	const uint32_t nodeCount = (uint32_t)__builtin_popcount(mask);
+
+	for (uint32_t rank = 0; rank < kMeshPartitionNodes; rank++) {
+		if (!mesh_has_node(mask, rank)) {
+			continue;
+		}
+		Node & node   = nodes[rank];
+		node.keyCount = mesh_key_masks(rank, node.keyMasks, kMeshNodeMaskCount);
+		memset(node.buffer, 0, sizeof(node.buffer));
+
+		// Its own block goes in as is, the copy it sends is encrypted.
+		uint8_t * block = &node.buffer[mesh_block_index(mask, rank) * kBlockSize];
+		for (uint32_t i = 0; i < kBlockSize; i++) {
+			block[i] = plaintext(rank, i);
+		}
+		memcpy(sent[rank], block, kBlockSize);
+		crypt(sent[rank], kBlockSize, blockKey(node, mask, rank));
+	}
+
+	struct Delivery {
+		uint8_t from;
+		uint8_t to;
+		uint8_t block;
+	};
+	Delivery queue[kMeshPartitionNodes * kMeshPartitionNodes * kMeshPartitionNodes];
+	uint32_t head = 0, tail = 0;
+	for (uint32_t src = 0; src < kMeshPartitionNodes; src++) {
+		for (uint32_t dst = 0; dst < kMeshPartitionNodes; dst++) {
+			if (mesh_connected(mask, src, dst)) {
+				queue[tail++] = {(uint8_t)src, (uint8_t)dst, (uint8_t)src};
+			}
+		}
+	}
+
+	uint32_t received = 0;
+	while (head != tail) {
+		const Delivery delivery = queue[head++];
+		Node & node             = nodes[delivery.to];
+		uint8_t * block         = &node.buffer[mesh_block_index(mask, delivery.block) * kBlockSize];
+		memcpy(block, sent[delivery.block], kBlockSize);
+		crypt(block, kBlockSize, blockKey(node, mask, delivery.block));
+		received++;
+
+		const uint32_t targets = mesh_forward_targets(mask, delivery.to, delivery.block);
+		for (uint32_t dst = 0; dst < kMeshPartitionNodes; dst++) {
+			if (targets & (1u << dst)) {
+				assert(tail < sizeof(queue) / sizeof(queue[0]));
+				queue[tail++] = {delivery.to, (uint8_t)dst, delivery.block};
+			}
+		}
+	}
+	assert(received == nodeCount * (nodeCount - 1));
+
+	for (uint32_t rank = 0; rank < kMeshPartitionNodes; rank++) {
+		if (!mesh_has_node(mask, rank)) {
+			continue;
+		}
+		for (uint32_t sender = 0; sender < kMeshPartitionNodes; sender++) {
+			if (!mesh_has_node(mask, sender)) {
+				continue;
+			}
+			const uint8_t * block = &nodes[rank].buffer[mesh_block_index(mask, sender) * kBlockSize];
+			for (uint32_t i = 0; i < kBlockSize; i++) {
+				assert(block[i] == plaintext(sender, i));
+			}
+		}
+		// Nothing past the blocks of the mesh.
+		for (uint32_t i = nodeCount * kBlockSize; i < sizeof(nodes[rank].buffer); i++) {
+			assert(nodes[rank].buffer[i] == 0);
+		}
+	}
+}
+
+static void
+testBroadcastAndGather()
+{
+	broadcastAndGather(mesh_node_mask(3));
+	broadcastAndGather(mesh_node_mask(6));
+	printf("validated broadcast and gather on 3 and 6 nodes.\n");
+
+	for (uint32_t nodeCount = 2; nodeCount <= kMeshPartitionNodes; nodeCount++) {
+		broadcastAndGather(mesh_node_mask(nodeCount));
+	}
+	// The second chassis of a 7 node mesh on its own.
+	broadcastAndGather(0x70);
+	printf("validated broadcast and gather on 2 to 8 nodes.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testMaskTable();
+	testKeyMasks();
+	testBroadcastAndGather();
+	return 0;
+}
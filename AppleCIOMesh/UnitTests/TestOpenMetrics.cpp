@@ -0,0 +1,309 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestOpenMetrics.cpp
+//  AppleCIOMesh
+//
+//  Writes counters, gauges and histograms in the OpenMetrics text format,
+//  checks the histogram buckets against the recorded values and that output
+//  that does not fit is reported instead of truncated, and scrapes a metrics
+//  server over its Unix domain socket. This test has no platform dependencies
+//  and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestOpenMetrics.cpp
+//
+
+#include "Common/LogLinearHistogram.h"
+#include "Common/MetricsServer.h"
+#include "Common/OpenMetrics.h"
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::MetricsServer;
+using AppleCIOMeshUtils::OpenMetricsWriter;
+using Histogram = AppleCIOMeshUtils::LogLinearHistogram<7, 34>;
+
+static bool
+contains(const char * text, const char * line)
+{
+	return strstr(text, line) != nullptr;
+}
+
+static void
+testCountersAndGauges()
+{
+	char buffer[1024];
+	OpenMetricsWriter writer(buffer, sizeof(buffer));
+	writer.family("mesh_syncs", "counter", nullptr, "Broadcast and gathers done.");
+	writer.sample("mesh_syncs", "_total", nullptr, (uint64_t)42);
+	writer.family("mesh_peer_sent_bytes", "counter", "bytes", "User data sent to each peer.");
+	writer.sample("mesh_peer_sent_bytes", "_total", "peer=\"1\"", (uint64_t)1000);
+	writer.sample("mesh_peer_sent_bytes", "_total", "peer=\"3\"", (uint64_t)18446744073709551615ull);
+	writer.family("mesh_sync_max_seconds", "gauge", "seconds", "Longest broadcast and gather.");
+	writer.sample("mesh_sync_max_seconds", "", "", 0.000125);
+	assert(writer.finish());
+	assert(!writer.overflown());
+	assert(writer.length() == strlen(buffer));
+
+	const char * expected = "# TYPE mesh_syncs counter\n"
+	                        "# HELP mesh_syncs Broadcast and gathers done.\n"
+	                        "mesh_syncs_total 42\n"
+	                        "# TYPE mesh_peer_sent_bytes counter\n"
+	                        "# UNIT mesh_peer_sent_bytes bytes\n"
+	                        "# HELP mesh_peer_sent_bytes User data sent to each peer.\n"
+	                        "mesh_peer_sent_bytes_total{peer=\"1\"} 1000\n"
+	                        "mesh_peer_sent_bytes_total{peer=\"3\"} 18446744073709551615\n"
+	                        "# TYPE mesh_sync_max_seconds gauge\n"
+	                        "# UNIT mesh_sync_max_seconds seconds\n"
+	                        "# HELP mesh_sync_max_seconds Longest broadcast and gather.\n"
+	                        "mesh_sync_max_seconds 0.000125\n"
+	                        "# EOF\n";
+	assert(strcmp(buffer, expected) == 0);
+	printf("validated counters and gauges.\n");
+}
+
+// Returns the value of the sample line starting with prefix.
+static uint64_t
+sampleValue(const char * text, const char * prefix)
+{
+	const char * line = strstr(text, prefix);
+	assert(line != nullptr);
+	return strtoull(line + strlen(prefix), nullptr, 10);
+}
+
+static void
+testHistogram()
+{
+	Histogram * histogram = new Histogram();
+	uint64_t sum          = 0;
+	srand(7);
+	for (int i = 0; i < 100000; i++) {
+		// Spread over 1usec - 100msec.
+		const uint64_t value  = 1000ull << (rand() % 17);
+		const uint64_t jitter = (uint64_t)rand() % value;
+		histogram->record(value + jitter);
+		sum += value + jitter;
+	}
+
+	uint64_t bounds[24];
+	for (uint32_t i = 0; i < 24; i++) {
+		bounds[i] = 1000ull << i;
+	}
+	static char buffer[16 * 1024];
+	OpenMetricsWriter writer(buffer, sizeof(buffer));
+	writer.family("mesh_sync_phase_seconds", "histogram", "seconds", "Phase times.");
+	writer.histogram("mesh_sync_phase_seconds", "phase=\"decrypt\"", *histogram, bounds, 24, 1e-9);
+	assert(writer.finish());
+
+	// Buckets are cumulative and within the histogram's accuracy of the exact
+	// count at each bound.
+	uint64_t previous = 0;
+	char prefix[128];
+	for (uint32_t i = 0; i < 24; i++) {
+		snprintf(prefix, sizeof(prefix), "mesh_sync_phase_seconds_bucket{phase=\"decrypt\",le=\"%.9g\"} ",
+		         (double)bounds[i] * 1e-9);
+		const uint64_t count = sampleValue(buffer, prefix);
+		assert(count >= previous);
+		previous = count;
+
+		uint64_t exactBelow = 0;
+		uint64_t exactAbove = 0;
+		for (uint32_t bucket = 0; bucket < Histogram::kBucketCount; bucket++) {
+			if (Histogram::highest_value_for_bucket(bucket) <= bounds[i]) {
+				exactBelow += histogram->count_at_bucket(bucket);
+			}
+			if (Histogram::lowest_value_for_bucket(bucket) <= bounds[i]) {
+				exactAbove += histogram->count_at_bucket(bucket);
+			}
+		}
+		assert(count >= exactBelow && count <= exactAbove);
+	}
+	assert(sampleValue(buffer, "mesh_sync_phase_seconds_bucket{phase=\"decrypt\",le=\"+Inf\"} ") == 100000);
+	assert(sampleValue(buffer, "mesh_sync_phase_seconds_count{phase=\"decrypt\"} ") == 100000);
+	const char * sumLine = strstr(buffer, "mesh_sync_phase_seconds_sum{phase=\"decrypt\"} ");
+	assert(sumLine != nullptr);
+	const double reportedSum = strtod(sumLine + strlen("mesh_sync_phase_seconds_sum{phase=\"decrypt\"} "), nullptr);
+	assert(reportedSum > (double)sum * 1e-9 * 0.999999 && reportedSum < (double)sum * 1e-9 * 1.000001);
+	assert(contains(buffer, "mesh_sync_phase_seconds_bucket{phase=\"decrypt\",le=\"1e-06\"} "));
+
+	// Without labels only le is set.
+	writer = OpenMetricsWriter(buffer, sizeof(buffer));
+	writer.histogram("mesh_sync_seconds", nullptr, *histogram, bounds, 1, 1e-9);
+	assert(writer.finish());
+	assert(contains(buffer, "mesh_sync_seconds_bucket{le=\"1e-06\"} "));
+	assert(contains(buffer, "mesh_sync_seconds_bucket{le=\"+Inf\"} 100000\n"));
+	assert(contains(buffer, "mesh_sync_seconds_count 100000\n"));
+
+	delete histogram;
+	printf("validated histogram buckets.\n");
+}
+
+static void
+testOverflow()
+{
+	char buffer[64];
+	memset(buffer, 'x', sizeof(buffer));
+	OpenMetricsWriter writer(buffer, sizeof(buffer));
+	writer.family("mesh_syncs", "counter", nullptr, "Broadcast and gathers done.");
+	writer.sample("mesh_syncs", "_total", nullptr, (uint64_t)42);
+	assert(writer.overflown());
+	assert(!writer.finish());
+	// What was written is still a valid C string and never past the buffer.
+	assert(writer.length() < sizeof(buffer));
+	assert(strlen(buffer) == writer.length());
+
+	// An exact fit is not an overflow.
+	char exact[sizeof("# EOF\n")];
+	OpenMetricsWriter exactWriter(exact, sizeof(exact));
+	assert(exactWriter.finish());
+	assert(strcmp(exact, "# EOF\n") == 0);
+
+	OpenMetricsWriter empty(exact, 0);
+	assert(!empty.finish());
+	assert(empty.length() == 0);
+	printf("validated overflow.\n");
+}
+
+struct RenderState {
+	uint64_t renders;
+	size_t bodySize;
+};
+
+static bool
+render(void * context, char * buffer, size_t size, size_t * length)
+{
+	RenderState * state = (RenderState *)context;
+	state->renders++;
+	OpenMetricsWriter writer(buffer, size);
+	writer.family("mesh_syncs", "counter", nullptr, "Broadcast and gathers done.");
+	writer.sample("mesh_syncs", "_total", nullptr, state->renders);
+	// Pad the body to the requested size.
+	while (!writer.overflown() && writer.length() + 16 < state->bodySize) {
+		writer.family("mesh_padding", "gauge", nullptr, "Padding.");
+	}
+	const bool fits = writer.finish();
+	*length         = writer.length();
+	return fits;
+}
+
+// Sends request to the server at path and returns the whole response.
+static std::string
+scrape(const char * path, const char * request)
+{
+	const int client = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert(client >= 0);
+	sockaddr_un address = {};
+	address.sun_family  = AF_UNIX;
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+	assert(connect(client, (sockaddr *)&address, sizeof(address)) == 0);
+	assert(send(client, request, strlen(request), 0) == (ssize_t)strlen(request));
+
+	std::string response;
+	char buffer[4096];
+	ssize_t received;
+	while ((received = recv(client, buffer, sizeof(buffer), 0)) > 0) {
+		response.append(buffer, (size_t)received);
+	}
+	close(client);
+	return response;
+}
+
+static void
+testServer()
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/TestOpenMetrics.%d.sock", (int)getpid());
+	RenderState state = {0, 0};
+	int error         = 0;
+
+	assert(MetricsServer::create(nullptr, 1024, render, &state, &error) == nullptr && error == EINVAL);
+	char longPath[256];
+	memset(longPath, 'a', sizeof(longPath) - 1);
+	longPath[sizeof(longPath) - 1] = '\0';
+	assert(MetricsServer::create(longPath, 1024, render, &state, &error) == nullptr && error == ENAMETOOLONG);
+	assert(MetricsServer::create("/nonexistent/dir/metrics.sock", 1024, render, &state, &error) == nullptr && error != 0);
+
+	MetricsServer * server = MetricsServer::create(path, 4096, render, &state, &error);
+	assert(server != nullptr && error == 0);
+
+	std::string response = scrape(path, "GET /metrics HTTP/1.1\r\nHost: localhost\r\nAccept: */*\r\n\r\n");
+	assert(response.compare(0, 17, "HTTP/1.0 200 OK\r\n") == 0);
+	assert(response.find("Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n") != std::string::npos);
+	const size_t bodyStart = response.find("\r\n\r\n") + 4;
+	const std::string body = response.substr(bodyStart);
+	assert(body == "# TYPE mesh_syncs counter\n# HELP mesh_syncs Broadcast and gathers done.\nmesh_syncs_total 1\n# EOF\n");
+	const size_t lengthAt = response.find("Content-Length:");
+	assert(lengthAt != std::string::npos);
+	assert(strtoul(response.c_str() + lengthAt + strlen("Content-Length:"), nullptr, 10) == body.size());
+
+	// Every scrape renders the current metrics.
+	response = scrape(path, "GET / HTTP/1.0\r\n\r\n");
+	assert(response.find("mesh_syncs_total 2\n") != std::string::npos);
+
+	// A response larger than a socket buffer write.
+	state.bodySize = 4000;
+	response       = scrape(path, "GET /metrics HTTP/1.0\r\n\r\n");
+	assert(response.compare(0, 17, "HTTP/1.0 200 OK\r\n") == 0);
+	assert(response.size() - (response.find("\r\n\r\n") + 4) > 3900);
+	assert(response.compare(response.size() - 6, 6, "# EOF\n") == 0);
+
+	// Metrics that do not fit are an error, not a truncated scrape.
+	state.bodySize = 8000;
+	response       = scrape(path, "GET /metrics HTTP/1.0\r\n\r\n");
+	assert(response.compare(0, 12, "HTTP/1.0 500") == 0);
+	state.bodySize = 0;
+
+	response = scrape(path, "GET /other HTTP/1.0\r\n\r\n");
+	assert(response.compare(0, 12, "HTTP/1.0 404") == 0);
+	response = scrape(path, "POST /metrics HTTP/1.0\r\n\r\n");
+	assert(response.compare(0, 12, "HTTP/1.0 404") == 0);
+	assert(server->scrapes() == 3);
+
+	// Deleting the server removes its socket.
+	delete server;
+	struct stat info;
+	assert(stat(path, &info) != 0);
+
+	// A socket left behind by a previous process is replaced.
+	const int stale     = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address = {};
+	address.sun_family  = AF_UNIX;
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+	assert(bind(stale, (sockaddr *)&address, sizeof(address)) == 0);
+	close(stale);
+	assert(stat(path, &info) == 0);
+	server = MetricsServer::create(path, 4096, render, &state, &error);
+	assert(server != nullptr);
+	assert(scrape(path, "GET /metrics HTTP/1.0\r\n\r\n").find("mesh_syncs_total") != std::string::npos);
+	delete server;
+	printf("validated metrics server.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testCountersAndGauges();
+	testHistogram();
+	testOverflow();
+	testServer();
+	return 0;
+}
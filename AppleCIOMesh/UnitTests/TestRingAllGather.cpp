@@ -0,0 +1,250 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestRingAllGather.cpp
+//  AppleCIOMesh
+//
+//  Runs ring all-gathers between threads connected with local sockets and
+//  checks that every node ends up with every block, decrypted with the key of
+//  the node it came from, for several ring orders and chunk counts, and that a
+//  failed link stops a node instead of hanging it. This test has no platform
+//  dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestRingAllGather.cpp
+//
+
+#include "Common/CollectiveSchedule.h"
+#include "Common/RingAllGather.h"
+#include <cassert>
+#include <initializer_list>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::RingAllGather;
+using AppleCIOMeshUtils::RingAllGatherOps;
+
+static constexpr uint32_t kMaxNodes = 8;
+
+struct Node {
+	int next;
+	int previous;
+	uint8_t * user;
+	uint8_t * staging;
+	uint32_t position;
+	uint32_t nodeCount;
+	const uint32_t * ring;
+	uint64_t blockSize;
+	uint32_t chunkCount;
+	uint32_t chunksToFail;
+	bool result;
+};
+
+static uint8_t
+keystream(uint32_t rank, uint32_t chunk, uint64_t index)
+{
+	return (uint8_t)((rank + 1) * 131 + chunk * 17 + index * 7);
+}
+
+static uint8_t
+plaintext(uint32_t rank, uint64_t index)
+{
+	return (uint8_t)(rank * 29 + index);
+}
+
+static bool
+sendChunk(void * context, const void * data, uint64_t size)
+{
+	Node * node = (Node *)context;
+	for (uint64_t sent = 0; sent < size;) {
+		const ssize_t result = write(node->next, (const uint8_t *)data + sent, size - sent);
+		if (result <= 0) {
+			return false;
+		}
+		sent += (uint64_t)result;
+	}
+	return true;
+}
+
+static bool
+receiveChunk(void * context, void * data, uint64_t size)
+{
+	Node * node = (Node *)context;
+	if (node->chunksToFail > 0 && --node->chunksToFail == 0) {
+		return false;
+	}
+	for (uint64_t received = 0; received < size;) {
+		const ssize_t result = read(node->previous, (uint8_t *)data + received, size - received);
+		if (result <= 0) {
+			return false;
+		}
+		received += (uint64_t)result;
+	}
+	return true;
+}
+
+static bool
+crypt(void * context __attribute__((unused)), uint32_t rank, uint32_t chunk, const void * in, void * out, uint64_t size)
+{
+	for (uint64_t i = 0; i < size; i++) {
+		((uint8_t *)out)[i] = ((const uint8_t *)in)[i] ^ keystream(rank, chunk, i);
+	}
+	return true;
+}
+
+static void *
+runNode(void * arg)
+{
+	Node * node                = (Node *)arg;
+	const RingAllGatherOps ops = {sendChunk, receiveChunk, crypt, crypt, node};
+	RingAllGather ring(node->nodeCount, node->position, node->ring, node->blockSize, node->chunkCount, node->user,
+	                   node->staging, ops);
+	node->result = ring.run();
+	if (!node->result) {
+		// Tearing the links down stops the neighbours.
+		shutdown(node->next, SHUT_RDWR);
+		shutdown(node->previous, SHUT_RDWR);
+	}
+	return nullptr;
+}
+
+// Runs one all-gather over the ring and returns how many nodes succeeded.
+static uint32_t
+runRing(uint32_t nodeCount, const uint32_t * ring, uint64_t blockSize, uint32_t chunkCount, uint32_t failingRank = kMaxNodes)
+{
+	Node nodes[kMaxNodes] = {};
+	pthread_t threads[kMaxNodes];
+	for (uint32_t position = 0; position < nodeCount; position++) {
+		int pair[2];
+		assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+		nodes[position].next                       = pair[0];
+		nodes[(position + 1) % nodeCount].previous = pair[1];
+	}
+	for (uint32_t position = 0; position < nodeCount; position++) {
+		Node & node         = nodes[position];
+		const uint32_t rank = ring[position];
+		node.user           = (uint8_t *)calloc(nodeCount, blockSize);
+		node.staging        = (uint8_t *)calloc(nodeCount, blockSize);
+		node.position       = position;
+		node.nodeCount      = nodeCount;
+		node.ring           = ring;
+		node.blockSize      = blockSize;
+		node.chunkCount     = chunkCount;
+		node.chunksToFail   = rank == failingRank ? 2 : 0;
+		assert(node.user != nullptr && node.staging != nullptr);
+		for (uint64_t i = 0; i < blockSize; i++) {
+			node.user[rank * blockSize + i] = plaintext(rank, i);
+		}
+		assert(pthread_create(&threads[position], nullptr, runNode, &node) == 0);
+	}
+
+	for (uint32_t position = 0; position < nodeCount; position++) {
+		pthread_join(threads[position], nullptr);
+	}
+	uint32_t succeeded = 0;
+	for (uint32_t position = 0; position < nodeCount; position++) {
+		Node & node = nodes[position];
+		if (node.result) {
+			succeeded++;
+			for (uint32_t rank = 0; rank < nodeCount; rank++) {
+				for (uint64_t i = 0; i < blockSize; i++) {
+					assert(node.user[rank * blockSize + i] == plaintext(rank, i));
+				}
+			}
+		}
+		close(node.next);
+		close(node.previous);
+		free(node.user);
+		free(node.staging);
+	}
+	return succeeded;
+}
+
+static void
+testOrigins()
+{
+	// Every node receives every other block exactly once, the one of the
+	// previous node first.
+	for (uint32_t nodeCount = 2; nodeCount <= kMaxNodes; nodeCount++) {
+		for (uint32_t position = 0; position < nodeCount; position++) {
+			bool seen[kMaxNodes] = {};
+			assert(AppleCIOMeshUtils::ring_send_origin(nodeCount, position, 0) == position);
+			assert(AppleCIOMeshUtils::ring_receive_origin(nodeCount, position, 0) == (position + nodeCount - 1) % nodeCount);
+			for (uint32_t step = 0; step + 1 < nodeCount; step++) {
+				const uint32_t origin = AppleCIOMeshUtils::ring_receive_origin(nodeCount, position, step);
+				assert(origin != position && !seen[origin]);
+				seen[origin] = true;
+				// What the previous node sends is what this node receives.
+				assert(AppleCIOMeshUtils::ring_send_origin(nodeCount, (position + nodeCount - 1) % nodeCount, step) == origin);
+			}
+		}
+	}
+	printf("validated origins.\n");
+}
+
+static void
+testGather()
+{
+	const uint32_t identity[kMaxNodes] = {0, 1, 2, 3, 4, 5, 6, 7};
+	for (uint32_t nodeCount = 2; nodeCount <= kMaxNodes; nodeCount++) {
+		for (uint32_t chunkCount : {1u, 4u, 16u}) {
+			assert(runRing(nodeCount, identity, 4096, chunkCount) == nodeCount);
+		}
+	}
+
+	// The ring the ensemble map orders an 8 node partition in.
+	AppleCIOMeshUtils::CollectiveTopology topology;
+	uint32_t ring[AppleCIOMeshUtils::kMaxCollectiveNodes];
+	assert(AppleCIOMeshUtils::make_ensemble_topology(8, &topology));
+	AppleCIOMeshUtils::collective_ring_order(topology, ring);
+	for (uint32_t position = 0; position + 1 < 8; position++) {
+		assert(topology.cost(ring[position], ring[position + 1]) == AppleCIOMeshUtils::kCollectiveCioHop);
+	}
+	assert(runRing(8, ring, 64 * 1024, 8) == 8);
+
+	// Blocks larger than the socket buffers need the sender and the receiver
+	// to run at the same time.
+	assert(runRing(4, identity, 4 * 1024 * 1024, 2) == 4);
+	printf("validated gather.\n");
+}
+
+static void
+testFailure()
+{
+	const uint32_t identity[kMaxNodes] = {0, 1, 2, 3, 4, 5, 6, 7};
+	assert(runRing(4, identity, 4096, 4, 2) < 4);
+	assert(runRing(8, identity, 256 * 1024, 4, 5) < 8);
+
+	// Chunk counts that do not divide the block are rejected.
+	Node node                  = {};
+	const RingAllGatherOps ops = {sendChunk, receiveChunk, crypt, crypt, &node};
+	uint8_t buffer[2 * 100];
+	RingAllGather ring(2, 0, identity, 100, 3, buffer, buffer, ops);
+	assert(!ring.run());
+	printf("validated failure.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	signal(SIGPIPE, SIG_IGN);
+	testOrigins();
+	testGather();
+	testFailure();
+	return 0;
+}
@@ -0,0 +1,311 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestStatsSegment.cpp
+//  AppleCIOMesh
+//
+//  Publishes stats to a shared memory segment while a separate reader process
+//  maps it by name and checks that every snapshot it reads is consistent, the
+//  way meshtop reads a running mesh. Also checks that segments of another
+//  version are rejected and the published histogram quantiles. This test has
+//  no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestStatsSegment.cpp
+//
+
+#include "Common/LogLinearHistogram.h"
+#include "Common/StatsSegment.h"
+#include <cassert>
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::StatsSegment;
+using AppleCIOMeshUtils::StatsSegmentData;
+using AppleCIOMeshUtils::StatsSegmentHistogram;
+using Histogram = AppleCIOMeshUtils::LogLinearHistogram<7, 34>;
+
+static const size_t kDataWords = sizeof(StatsSegmentData) / sizeof(uint64_t);
+
+static void
+segmentName(char * name, size_t size, const char * test)
+{
+	snprintf(name, size, "/test%s.%d", test, (int)getpid());
+}
+
+// Every word of the data is set to value, so a torn copy is easy to spot.
+static void
+fillData(StatsSegmentData * data, uint64_t value)
+{
+	uint64_t * words = (uint64_t *)data;
+	for (size_t i = 0; i < kDataWords; i++) {
+		words[i] = value;
+	}
+}
+
+static bool
+isFilledWith(const StatsSegmentData & data, uint64_t value)
+{
+	const uint64_t * words = (const uint64_t *)&data;
+	for (size_t i = 0; i < kDataWords; i++) {
+		if (words[i] != value) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+testPublishAndRead()
+{
+	char name[64];
+	segmentName(name, sizeof(name), "publish");
+
+	int error              = 0;
+	StatsSegment * segment = AppleCIOMeshUtils::create_stats_segment(name, &error);
+	assert(segment != nullptr);
+	assert(AppleCIOMeshUtils::is_valid_stats_segment(*segment));
+	assert(segment->pid == (uint32_t)getpid());
+	assert(segment->sequence == 0);
+
+	const StatsSegment * reader = AppleCIOMeshUtils::open_stats_segment(name, &error);
+	assert(reader != nullptr);
+	assert(reader != segment);
+
+	// Nothing published yet reads as zeros.
+	StatsSegmentData * data = new StatsSegmentData();
+	fillData(data, 7);
+	assert(AppleCIOMeshUtils::read_stats_segment(reader, data));
+	assert(isFilledWith(*data, 0));
+
+	StatsSegmentData * published = new StatsSegmentData();
+	memset(published, 0, sizeof(*published));
+	published->publishCount           = 1;
+	published->nodeId                 = 3;
+	published->syncCount              = 1000;
+	published->peerBytesSent[5]       = 1 << 20;
+	published->peerAverageLateness[5] = 1234;
+	published->syncTime.count         = 1;
+	AppleCIOMeshUtils::publish_stats_segment(segment, *published);
+	assert(segment->sequence == 2);
+
+	assert(AppleCIOMeshUtils::read_stats_segment(reader, data));
+	assert(memcmp(data, published, sizeof(*data)) == 0);
+
+	// A reader gives up while the writer is (stuck) in the middle of an update.
+	segment->sequence = 3;
+	assert(!AppleCIOMeshUtils::read_stats_segment(reader, data, 10));
+	segment->sequence = 4;
+	assert(AppleCIOMeshUtils::read_stats_segment(reader, data, 10));
+
+	AppleCIOMeshUtils::close_stats_segment(reader);
+	munmap(segment, sizeof(StatsSegment));
+	shm_unlink(name);
+	delete published;
+	delete data;
+	printf("validated publish and read.\n");
+}
+
+static void
+testRejectsOtherSegments()
+{
+	char name[64];
+	segmentName(name, sizeof(name), "reject");
+
+	int error = 0;
+	assert(AppleCIOMeshUtils::open_stats_segment(name, &error) == nullptr);
+	assert(error == ENOENT);
+
+	StatsSegment * segment = AppleCIOMeshUtils::create_stats_segment(name, &error);
+	assert(segment != nullptr);
+
+	segment->version = AppleCIOMeshUtils::kStatsSegmentVersion + 1;
+	error            = 0;
+	assert(AppleCIOMeshUtils::open_stats_segment(name, &error) == nullptr);
+	assert(error == EPROTO);
+
+	segment->version  = AppleCIOMeshUtils::kStatsSegmentVersion;
+	segment->magic[0] = 'X';
+	error             = 0;
+	assert(AppleCIOMeshUtils::open_stats_segment(name, &error) == nullptr);
+	assert(error == EPROTO);
+
+	// Creating the segment again replaces the stale one.
+	munmap(segment, sizeof(StatsSegment));
+	segment = AppleCIOMeshUtils::create_stats_segment(name, &error);
+	assert(segment != nullptr);
+	const StatsSegment * reader = AppleCIOMeshUtils::open_stats_segment(name, &error);
+	assert(reader != nullptr);
+	AppleCIOMeshUtils::close_stats_segment(reader);
+
+	// A segment that is too small is rejected before it is mapped.
+	munmap(segment, sizeof(StatsSegment));
+	shm_unlink(name);
+	const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	assert(fd >= 0);
+	assert(ftruncate(fd, 64) == 0);
+	close(fd);
+	error = 0;
+	assert(AppleCIOMeshUtils::open_stats_segment(name, &error) == nullptr);
+	assert(error == EPROTO);
+	shm_unlink(name);
+	printf("validated reject other segments.\n");
+}
+
+static void
+testHistogram()
+{
+	Histogram * histogram = new Histogram();
+	// 90 syncs of ~10us and 10 of ~1ms.
+	for (uint64_t i = 0; i < 90; i++) {
+		histogram->record(10000 + i);
+	}
+	for (uint64_t i = 0; i < 10; i++) {
+		histogram->record(1000000 + i);
+	}
+	histogram->record(0);
+
+	StatsSegmentHistogram published;
+	memset(&published, 0, sizeof(published));
+	AppleCIOMeshUtils::add_to_stats_segment_histogram(published, *histogram);
+	assert(published.count == 101);
+	assert(published.max == 1000009);
+	assert(published.sum == histogram->sum());
+	assert(published.buckets[0] == 1);
+	// 2^13 <= 10000 < 2^14 and 2^19 <= 1000000 < 2^20.
+	assert(published.buckets[13] == 90);
+	assert(published.buckets[19] == 10);
+
+	// Quantiles are the top of their power of two bucket, capped by the max.
+	assert(AppleCIOMeshUtils::stats_segment_quantile(published, 0.0) == 1);
+	assert(AppleCIOMeshUtils::stats_segment_quantile(published, 0.5) == (1u << 14) - 1);
+	assert(AppleCIOMeshUtils::stats_segment_quantile(published, 0.99) == 1000009);
+	assert(AppleCIOMeshUtils::stats_segment_quantile(published, 1.0) == 1000009);
+
+	// Adding a second histogram accumulates.
+	AppleCIOMeshUtils::add_to_stats_segment_histogram(published, *histogram);
+	assert(published.count == 202);
+	assert(published.buckets[13] == 180);
+
+	StatsSegmentHistogram empty;
+	memset(&empty, 0, sizeof(empty));
+	assert(AppleCIOMeshUtils::stats_segment_quantile(empty, 0.5) == 0);
+	delete histogram;
+	printf("validated histogram.\n");
+}
+
+enum ReaderExit {
+	kReaderPassed       = 0,
+	kReaderOpenFailed   = 1,
+	kReaderReadFailed   = 2,
+	kReaderTornRead     = 3,
+	kReaderWentBackward = 4,
+};
+
+// Runs in the reader process: reads until the last publish is seen.
+static int
+readUntil(const char * name, uint64_t lastPublish)
+{
+	int error                    = 0;
+	const StatsSegment * segment = AppleCIOMeshUtils::open_stats_segment(name, &error);
+	if (segment == nullptr) {
+		return kReaderOpenFailed;
+	}
+
+	StatsSegmentData * data = new StatsSegmentData();
+	uint64_t previous       = 0;
+	uint64_t reads          = 0;
+	uint64_t distinct       = 0;
+	while (previous != lastPublish) {
+		if (!AppleCIOMeshUtils::read_stats_segment(segment, data)) {
+			return kReaderReadFailed;
+		}
+		if (!isFilledWith(*data, data->publishCount)) {
+			return kReaderTornRead;
+		}
+		if (data->publishCount < previous) {
+			return kReaderWentBackward;
+		}
+		if (data->publishCount != previous) {
+			distinct++;
+		}
+		previous = data->publishCount;
+		reads++;
+		sched_yield();
+	}
+	printf("Reader saw %llu of %llu publishes in %llu reads\n", (unsigned long long)distinct, (unsigned long long)lastPublish,
+	       (unsigned long long)reads);
+	fflush(stdout);
+
+	AppleCIOMeshUtils::close_stats_segment(segment);
+	delete data;
+	return kReaderPassed;
+}
+
+static void
+testReaderProcess()
+{
+	char name[64];
+	segmentName(name, sizeof(name), "reader");
+
+	int error              = 0;
+	StatsSegment * segment = AppleCIOMeshUtils::create_stats_segment(name, &error);
+	assert(segment != nullptr);
+
+	const uint64_t kPublishes = 20000;
+	fflush(stdout);
+	const pid_t reader = fork();
+	assert(reader >= 0);
+	if (reader == 0) {
+		_exit(readUntil(name, kPublishes));
+	}
+
+	StatsSegmentData * data = new StatsSegmentData();
+	for (uint64_t i = 1; i <= kPublishes; i++) {
+		fillData(data, i);
+		AppleCIOMeshUtils::publish_stats_segment(segment, *data);
+		// Let the reader run, even on a single CPU.
+		if (i % 4 == 0) {
+			sched_yield();
+		}
+	}
+
+	int status = 0;
+	assert(waitpid(reader, &status, 0) == reader);
+	assert(WIFEXITED(status));
+	if (WEXITSTATUS(status) != kReaderPassed) {
+		fprintf(stderr, "Reader failed with %d\n", WEXITSTATUS(status));
+	}
+	assert(WEXITSTATUS(status) == kReaderPassed);
+
+	munmap(segment, sizeof(StatsSegment));
+	shm_unlink(name);
+	delete data;
+	printf("validated reader process.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testPublishAndRead();
+	testRejectsOtherSegments();
+	testHistogram();
+	testReaderProcess();
+	return 0;
+}
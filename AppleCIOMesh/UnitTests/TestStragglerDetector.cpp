@@ -0,0 +1,167 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestStragglerDetector.cpp
+//  AppleCIOMesh
+//
+//  Feeds the straggler detector with simulated syncs where individual nodes
+//  have an injected delay, and checks that exactly those nodes are flagged.
+//  This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. UnitTests/TestStragglerDetector.cpp
+//
+
+#include "Common/StragglerDetector.h"
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+
+static const uint32_t kMaxPeers = 32;
+using Detector                  = AppleCIOMeshUtils::StragglerDetector<kMaxPeers>;
+
+// Simulates the arrival of every peer's data for one sync of a mesh with
+// nodeCount nodes, as seen from node 0.
+struct SimulatedMesh {
+	uint32_t nodeCount;
+	uint64_t baseArrival;
+	uint64_t delay[kMaxPeers] = {};
+	std::mt19937_64 rng{0x5354524147ull};
+
+	uint64_t
+	peerMask() const
+	{
+		// everyone but ourselves
+		return ((nodeCount == 64 ? ~0ull : (1ull << nodeCount) - 1)) & ~1ull;
+	}
+
+	void
+	sync(Detector & detector)
+	{
+		std::lognormal_distribution<double> jitter(0.0, 0.1);
+		uint64_t arrivals[kMaxPeers] = {};
+		for (uint32_t node = 1; node < nodeCount; node++) {
+			arrivals[node] = (uint64_t)((double)baseArrival * jitter(rng)) + delay[node];
+		}
+		detector.record_sync(arrivals, peerMask());
+	}
+
+	void
+	run(Detector & detector, int syncs)
+	{
+		for (int i = 0; i < syncs; i++) {
+			sync(detector);
+		}
+	}
+};
+
+static void
+testNoStragglers()
+{
+	for (uint32_t nodeCount : {2u, 4u, 8u, 16u, 32u}) {
+		Detector detector;
+		SimulatedMesh mesh{nodeCount, 200 * 1000};
+		mesh.run(detector, 100000);
+		assert(detector.straggler_mask() == 0);
+	}
+	printf("validated no false positives from jitter.\n");
+}
+
+static void
+testSingleStraggler()
+{
+	for (uint32_t nodeCount : {4u, 8u, 16u}) {
+		const uint32_t slowNode = nodeCount - 1;
+		const uint64_t delay    = 150 * 1000;
+
+		Detector detector;
+		SimulatedMesh mesh{nodeCount, 200 * 1000};
+		mesh.delay[slowNode] = delay;
+
+		// Not flagged during the warmup.
+		mesh.run(detector, 10);
+		assert(detector.straggler_mask() == 0);
+
+		mesh.run(detector, 200);
+		assert(detector.straggler_mask() == (1ull << slowNode));
+		assert(detector.is_straggler(slowNode));
+		assert(detector.last_count(slowNode) > 200 * 9 / 10);
+
+		// The lateness histogram tracks the injected delay (within the jitter).
+		const uint64_t p50 = detector.lateness(slowNode)->value_at_quantile(0.5);
+		assert(p50 > delay * 8 / 10 && p50 < delay * 12 / 10);
+		for (uint32_t node = 1; node < slowNode; node++) {
+			assert(detector.average_lateness(node) < delay / 4);
+		}
+
+		// Recovers once the delay goes away.
+		mesh.delay[slowNode] = 0;
+		mesh.run(detector, 200);
+		assert(detector.straggler_mask() == 0);
+	}
+	printf("validated a single injected straggler.\n");
+}
+
+static void
+testMultipleStragglers()
+{
+	Detector detector;
+	SimulatedMesh mesh{16, 300 * 1000};
+	mesh.delay[3]  = 100 * 1000;
+	mesh.delay[11] = 400 * 1000;
+	mesh.run(detector, 500);
+	assert(detector.straggler_mask() == ((1ull << 3) | (1ull << 11)));
+	assert(detector.average_lateness(11) > detector.average_lateness(3));
+	printf("validated multiple stragglers.\n");
+}
+
+static void
+testSpikesAreNotStragglers()
+{
+	// A node that is very late once every 100 syncs is not persistently late.
+	Detector detector;
+	SimulatedMesh mesh{8, 200 * 1000};
+	for (int i = 0; i < 20000; i++) {
+		mesh.delay[5] = (i % 100 == 0) ? 500 * 1000 : 0;
+		mesh.sync(detector);
+		assert(detector.straggler_mask() == 0);
+	}
+	// But the spikes are visible in the tail of its lateness histogram.
+	assert(detector.lateness(5)->value_at_quantile(0.999) >= 400 * 1000);
+	printf("validated occasional spikes are not flagged.\n");
+}
+
+static void
+testSmallDelaysAreNoise()
+{
+	// A consistent 5usec delay on a 200usec sync is below the thresholds.
+	Detector detector;
+	SimulatedMesh mesh{8, 200 * 1000};
+	mesh.delay[2] = 5 * 1000;
+	mesh.run(detector, 5000);
+	assert(detector.straggler_mask() == 0);
+	printf("validated small delays are ignored.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testNoStragglers();
+	testSingleStraggler();
+	testMultipleStragglers();
+	testSpikesAreNotStragglers();
+	testSmallDelaysAreNoise();
+	return 0;
+}
@@ -0,0 +1,226 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestSyncTraceRing.cpp
+//  AppleCIOMesh
+//
+//  Pushes sync trace records from several threads while a consumer drains
+//  the ring, and checks that every record is either delivered exactly once,
+//  in order per producer, or counted as dropped. Also round trips a trace
+//  file. This test has no platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestSyncTraceRing.cpp
+//
+
+#include "Common/SyncTrace.h"
+#include <atomic>
+#include <cassert>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using AppleCIOMeshUtils::SyncTraceRecord;
+using AppleCIOMeshUtils::SyncTraceRing;
+
+static SyncTraceRecord
+makeRecord(uint64_t producer, uint64_t index)
+{
+	SyncTraceRecord record = {};
+	record.nodeMask        = producer;
+	record.bufferSize      = index;
+	record.syncTime        = producer * 1000000 + index;
+	for (uint32_t phase = 0; phase < AppleCIOMeshUtils::kSyncTracePhaseCount; phase++) {
+		record.phaseTime[phase] = (uint32_t)(index + phase);
+	}
+	return record;
+}
+
+static void
+testCreate()
+{
+	assert(SyncTraceRing::create(0) == nullptr);
+
+	SyncTraceRing * ring = SyncTraceRing::create(1000);
+	assert(ring != nullptr);
+	assert(ring->capacity() == 1024);
+	delete ring;
+
+	ring = SyncTraceRing::create(1);
+	assert(ring->capacity() == 1);
+	delete ring;
+	printf("validated ring creation.\n");
+}
+
+static void
+testSingleThreaded()
+{
+	SyncTraceRing * ring = SyncTraceRing::create(8);
+	SyncTraceRecord records[16];
+
+	assert(ring->pop(records, 16) == 0);
+
+	// Fill it up, the ninth record is dropped.
+	for (uint64_t i = 0; i < 9; i++) {
+		assert(ring->push(makeRecord(0, i)) == (i < 8));
+	}
+	assert(ring->dropped() == 1);
+
+	assert(ring->pop(records, 3) == 3);
+	for (uint64_t i = 0; i < 3; i++) {
+		assert(records[i].sequence == i);
+		assert(records[i].bufferSize == i);
+	}
+
+	// Wraps around.
+	for (uint64_t i = 9; i < 12; i++) {
+		assert(ring->push(makeRecord(0, i)));
+	}
+	assert(ring->pop(records, 16) == 8);
+	for (uint64_t i = 0; i < 5; i++) {
+		assert(records[i].sequence == i + 3);
+	}
+	// The sequence skips the dropped record.
+	assert(records[5].sequence == 9);
+	assert(records[7].sequence == 11);
+	assert(records[7].phaseTime[5] == 16);
+	assert(ring->pop(records, 16) == 0);
+	delete ring;
+	printf("validated single threaded push and pop.\n");
+}
+
+static void
+testConcurrent(uint64_t capacity, uint32_t producerCount, uint64_t perProducer, bool yield)
+{
+	SyncTraceRing * ring = SyncTraceRing::create(capacity);
+	std::atomic<uint32_t> producersDone{0};
+	std::vector<uint64_t> pushed(producerCount, 0);
+
+	std::vector<std::thread> producers;
+	for (uint32_t p = 0; p < producerCount; p++) {
+		producers.emplace_back([&, p]() {
+			for (uint64_t i = 0; i < perProducer; i++) {
+				if (ring->push(makeRecord(p, i))) {
+					pushed[p]++;
+				}
+				if (yield) {
+					// Give the consumer a chance to keep up, like syncs would.
+					std::this_thread::yield();
+				}
+			}
+			producersDone++;
+		});
+	}
+
+	std::vector<int64_t> lastIndex(producerCount, -1);
+	std::vector<uint64_t> received(producerCount, 0);
+	std::vector<bool> seenSequence(producerCount * perProducer, false);
+	SyncTraceRecord records[64];
+	while (true) {
+		const bool done    = producersDone.load() == producerCount;
+		const size_t count = ring->pop(records, 64);
+		for (size_t i = 0; i < count; i++) {
+			const SyncTraceRecord & record = records[i];
+			const uint64_t producer        = record.nodeMask;
+			assert(producer < producerCount);
+			// Intact and in order for each producer.
+			assert(record.syncTime == producer * 1000000 + record.bufferSize);
+			assert((int64_t)record.bufferSize > lastIndex[producer]);
+			lastIndex[producer] = (int64_t)record.bufferSize;
+			received[producer]++;
+
+			assert(record.sequence < seenSequence.size());
+			assert(!seenSequence[record.sequence]);
+			seenSequence[record.sequence] = true;
+		}
+		if (count == 0) {
+			if (done) {
+				break;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	for (std::thread & producer : producers) {
+		producer.join();
+	}
+
+	uint64_t totalReceived = 0;
+	for (uint32_t p = 0; p < producerCount; p++) {
+		assert(received[p] == pushed[p]);
+		totalReceived += received[p];
+	}
+	assert(totalReceived + ring->dropped() == producerCount * perProducer);
+	printf("validated %u producers with a %llu record ring: %llu received, %llu dropped.\n", producerCount,
+	       (unsigned long long)capacity, (unsigned long long)totalReceived, (unsigned long long)ring->dropped());
+	delete ring;
+}
+
+static void
+testFileRoundTrip()
+{
+	FILE * file = tmpfile();
+	assert(file != NULL);
+
+	const auto header = AppleCIOMeshUtils::make_sync_trace_header(3, 123456789);
+	assert(AppleCIOMeshUtils::is_valid_sync_trace_header(header));
+	assert(fwrite(&header, sizeof(header), 1, file) == 1);
+
+	SyncTraceRecord written[10];
+	for (uint64_t i = 0; i < 10; i++) {
+		written[i]          = makeRecord(1, i);
+		written[i].sequence = i;
+		written[i].endTime  = 123456789 + i * 1000;
+	}
+	written[4].phaseTime[2] = AppleCIOMeshUtils::kSyncTracePhaseNotDone;
+	assert(fwrite(written, sizeof(written[0]), 10, file) == 10);
+
+	rewind(file);
+	AppleCIOMeshUtils::SyncTraceFileHeader readHeader;
+	assert(fread(&readHeader, sizeof(readHeader), 1, file) == 1);
+	assert(AppleCIOMeshUtils::is_valid_sync_trace_header(readHeader));
+	assert(readHeader.nodeId == 3 && readHeader.startTime == 123456789);
+
+	SyncTraceRecord read[11];
+	assert(fread(read, sizeof(read[0]), 11, file) == 10);
+	assert(memcmp(read, written, sizeof(written)) == 0);
+	fclose(file);
+
+	// Garbage is rejected.
+	readHeader.magic[0] = 'X';
+	assert(!AppleCIOMeshUtils::is_valid_sync_trace_header(readHeader));
+	readHeader         = header;
+	readHeader.version = AppleCIOMeshUtils::kSyncTraceVersion + 1;
+	assert(!AppleCIOMeshUtils::is_valid_sync_trace_header(readHeader));
+
+	assert(AppleCIOMeshUtils::sync_trace_phase_time(5) == 5);
+	assert(AppleCIOMeshUtils::sync_trace_phase_time(1ull << 40) == AppleCIOMeshUtils::kSyncTracePhaseNotDone - 1);
+	printf("validated trace file round trip.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testCreate();
+	testSingleThreaded();
+	// Big enough that nothing should be dropped.
+	testConcurrent(1 << 20, 4, 100000, false);
+	// Small enough that records are dropped.
+	testConcurrent(16, 4, 200000, false);
+	testConcurrent(16, 4, 20000, true);
+	testConcurrent(64, 8, 10000, true);
+	testFileRoundTrip();
+	return 0;
+}
@@ -0,0 +1,320 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestTLSFAllocator.cpp
+//  AppleCIOMesh
+//
+//  Checks splitting and merging of the blocks of the allocator behind
+//  MeshArena, then replays a long running service creating and releasing
+//  buffer sets for changing batch sizes and sequence lengths, checking that
+//  the allocations never overlap, that released space is reused and that the
+//  space is whole again once everything is released. This test has no
+//  platform dependencies and can be built on Linux:
+//    c++ -std=c++17 -O2 -I. UnitTests/TestTLSFAllocator.cpp
+//
+
+#include "Common/TLSFAllocator.h"
+#include <cassert>
+#include <chrono>
+#include <random>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+using AppleCIOMeshUtils::tlsf_fragmentation;
+using AppleCIOMeshUtils::TLSFAllocator;
+using AppleCIOMeshUtils::TLSFAllocatorStats;
+
+static const uint32_t kNone = TLSFAllocator::kNone;
+
+static void
+testSplitAndMerge()
+{
+	TLSFAllocator * allocator = TLSFAllocator::create(100);
+	assert(allocator != nullptr);
+	assert(allocator->validate());
+	assert(allocator->stats().freeBlocks == 1);
+	assert(allocator->stats().largestFreeBlock == 100);
+
+	assert(allocator->alloc(0) == kNone);
+	assert(allocator->alloc(101) == kNone);
+	assert(allocator->stats().failedAllocations == 2);
+
+	const uint32_t a = allocator->alloc(10);
+	const uint32_t b = allocator->alloc(20);
+	const uint32_t c = allocator->alloc(30);
+	assert(a != kNone && b != kNone && c != kNone);
+	assert(allocator->allocation_size(a) == 10);
+	assert(allocator->allocation_size(b) == 20);
+	assert(allocator->validate());
+	TLSFAllocatorStats stats = allocator->stats();
+	assert(stats.allocated == 60);
+	assert(stats.allocations == 3);
+	assert(stats.freeBlocks == 1);
+	assert(stats.largestFreeBlock == 40);
+
+	// Freeing the middle allocation leaves a hole...
+	assert(allocator->free(b) == 20);
+	assert(allocator->validate());
+	stats = allocator->stats();
+	assert(stats.freeBlocks == 2);
+	assert(stats.largestFreeBlock == 40);
+	assert(tlsf_fragmentation(stats) > 0.3 && tlsf_fragmentation(stats) < 0.4);
+
+	// ...that a smaller allocation reuses.
+	const uint32_t d = allocator->alloc(20);
+	assert(d == b);
+	assert(allocator->free(d) == 20);
+
+	// Freeing it again is caught.
+	assert(allocator->free(d) == 0);
+	assert(allocator->allocation_size(d) == 0);
+
+	// Freeing the neighbours merges them into one block.
+	assert(allocator->free(a) == 10);
+	assert(allocator->validate());
+	assert(allocator->stats().freeBlocks == 2);
+	assert(allocator->free(c) == 30);
+	assert(allocator->validate());
+	stats = allocator->stats();
+	assert(stats.allocated == 0);
+	assert(stats.peakAllocated == 60);
+	assert(stats.freeBlocks == 1);
+	assert(stats.largestFreeBlock == 100);
+	assert(tlsf_fragmentation(stats) == 0.0);
+	assert(allocator->free(a) == 0);
+	assert(allocator->free(c) == 0);
+
+	// The whole space can be allocated at once.
+	const uint32_t all = allocator->alloc(100);
+	assert(all == 0);
+	assert(allocator->alloc(1) == kNone);
+	assert(tlsf_fragmentation(allocator->stats()) == 0.0);
+	assert(allocator->free(all) == 100);
+	assert(allocator->validate());
+
+	delete allocator;
+	printf("validated split and merge.\n");
+}
+
+static void
+testSizeClasses()
+{
+	// Every size from 1 to 2^20 is found in a space holding just that size,
+	// and a request never gets a block from a class that may be too small.
+	TLSFAllocator * allocator = TLSFAllocator::create(1 << 20);
+	assert(allocator != nullptr);
+	for (uint32_t size = 1; size <= (1 << 20); size = size < 64 ? size + 1 : size + size / 7) {
+		const uint32_t filler = (1 << 20) - size;
+		const uint32_t before = filler ? allocator->alloc(filler) : kNone;
+		const uint32_t first  = allocator->alloc(size);
+		assert(first != kNone);
+		assert(allocator->allocation_size(first) == size);
+		assert(allocator->validate());
+		allocator->free(first);
+		if (before != kNone) {
+			allocator->free(before);
+		}
+	}
+
+	// A block one unit too small is never handed out.
+	const uint32_t filler = allocator->alloc((1 << 20) - 999);
+	assert(allocator->alloc(1000) == kNone);
+	assert(allocator->alloc(999) != kNone);
+	allocator->free(filler);
+
+	delete allocator;
+	printf("validated size classes.\n");
+}
+
+struct BufferSet {
+	std::vector<uint32_t> buffers;
+	uint32_t size;
+};
+
+// Replays a service that creates buffer sets (MeshSetupBuffers) of a few
+// buffers each, sized by the batch size and sequence length of the requests
+// it serves, and releases them in any order.
+static void
+testServiceReplay()
+{
+	// A 10GB arena of 16KB pages.
+	const uint32_t kPages      = 10 * 1024 * 64;
+	const uint64_t kOperations = 200000;
+	// Keep at most half the arena in use, like a service that sizes its
+	// arena for twice its working set.
+	const uint64_t kMaxLive = kPages / 2;
+
+	TLSFAllocator * allocator = TLSFAllocator::create(kPages);
+	assert(allocator != nullptr);
+
+	// Which buffer set owns each page, to catch overlapping allocations.
+	std::vector<uint32_t> owner(kPages, kNone);
+	std::vector<BufferSet> sets;
+	std::mt19937_64 random(42);
+
+	static const uint32_t kBatchSizes[]      = {1, 2, 4, 8, 16, 32};
+	static const uint32_t kSequenceLengths[] = {128, 512, 1024, 2048, 4096, 8192};
+	static const uint32_t kBufferCounts[]    = {1, 2, 4, 8};
+
+	uint64_t live = 0, created = 0, failed = 0, bumpResets = 0, bumpFailures = 0;
+	uint64_t bumpOffset = 0, maxFreeBlocks = 0;
+	double maxFragmentation = 0.0;
+	uint32_t nextSet        = 0;
+
+	for (uint64_t operation = 0; operation < kOperations; operation++) {
+		const bool create = sets.empty() || (random() % 100 < 55);
+		if (create) {
+			// hidden size 4096 of 16 bit activations, in 16KB pages.
+			const uint32_t batch    = kBatchSizes[random() % 6];
+			const uint32_t sequence = kSequenceLengths[random() % 6];
+			const uint32_t count    = kBufferCounts[random() % 4];
+			const uint64_t bytes    = (uint64_t)batch * sequence * 4096 * 2;
+			const uint32_t size     = (uint32_t)((bytes + 16383) / 16384);
+			if (live + (uint64_t)size * count > kMaxLive) {
+				continue;
+			}
+
+			BufferSet set;
+			set.size = size;
+			for (uint32_t i = 0; i < count; i++) {
+				const uint32_t first = allocator->alloc(size);
+				if (first == kNone) {
+					failed++;
+					break;
+				}
+				for (uint32_t page = first; page < first + size; page++) {
+					assert(owner[page] == kNone);
+					owner[page] = nextSet;
+				}
+				set.buffers.push_back(first);
+				live += size;
+			}
+			nextSet++;
+			created++;
+			sets.push_back(set);
+
+			// What the old bump arena, which only resets once everything is
+			// released, would have done with the same requests.
+			if (bumpOffset + (uint64_t)size * count > kPages) {
+				bumpFailures++;
+			} else {
+				bumpOffset += (uint64_t)size * count;
+			}
+		} else {
+			const size_t index = random() % sets.size();
+			for (uint32_t first : sets[index].buffers) {
+				assert(allocator->free(first) == sets[index].size);
+				for (uint32_t page = first; page < first + sets[index].size; page++) {
+					owner[page] = kNone;
+				}
+				live -= sets[index].size;
+			}
+			sets[index] = sets.back();
+			sets.pop_back();
+			if (sets.empty()) {
+				bumpOffset = 0;
+				bumpResets++;
+			}
+		}
+
+		if (operation % 4096 == 0) {
+			assert(allocator->validate());
+			const TLSFAllocatorStats stats = allocator->stats();
+			assert(stats.allocated == live);
+			if (tlsf_fragmentation(stats) > maxFragmentation) {
+				maxFragmentation = tlsf_fragmentation(stats);
+			}
+			if (stats.freeBlocks > maxFreeBlocks) {
+				maxFreeBlocks = stats.freeBlocks;
+			}
+		}
+	}
+	const TLSFAllocatorStats stats = allocator->stats();
+	printf("Replayed %llu operations, %llu buffer sets: peak %.1f%% of the arena, up to %llu free blocks, fragmentation up to "
+	       "%.2f\n",
+	       (unsigned long long)kOperations, (unsigned long long)created, 100.0 * (double)stats.peakAllocated / kPages,
+	       (unsigned long long)maxFreeBlocks, maxFragmentation);
+	printf("%llu buffers failed to allocate, a bump arena would have failed %llu buffer sets and reset %llu times\n",
+	       (unsigned long long)failed, (unsigned long long)bumpFailures, (unsigned long long)bumpResets);
+	// With half the arena free there is always room.
+	assert(failed == 0);
+	assert(stats.failedAllocations == 0);
+
+	for (const BufferSet & set : sets) {
+		for (uint32_t first : set.buffers) {
+			assert(allocator->free(first) == set.size);
+		}
+	}
+	assert(allocator->validate());
+	const TLSFAllocatorStats empty = allocator->stats();
+	assert(empty.allocated == 0);
+	assert(empty.allocations == 0);
+	assert(empty.freeBlocks == 1);
+	assert(empty.largestFreeBlock == kPages);
+
+	delete allocator;
+	printf("validated service replay.\n");
+}
+
+// Allocating and freeing never walk the free blocks, so they stay cheap with
+// many of them. What grows with the live allocations are the cache misses.
+static void
+testSpeed()
+{
+	const uint32_t kUnits      = 1u << 25;
+	const uint64_t kOperations = 4000000;
+
+	TLSFAllocator * allocator = TLSFAllocator::create(kUnits);
+	assert(allocator != nullptr);
+	std::mt19937_64 random(7);
+
+	for (uint32_t liveCount : {16u, 1024u, 65536u}) {
+		std::vector<uint32_t> live(liveCount, kNone);
+		const auto start = std::chrono::steady_clock::now();
+		for (uint64_t operation = 0; operation < kOperations; operation++) {
+			uint32_t & slot = live[random() % liveCount];
+			if (slot != kNone) {
+				allocator->free(slot);
+			}
+			slot = allocator->alloc(1 + (uint32_t)(random() % 256));
+			assert(slot != kNone);
+		}
+		const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("%u live allocations, %llu free blocks: %.0fns per free and alloc\n", liveCount,
+		       (unsigned long long)allocator->stats().freeBlocks, elapsed * 1e9 / (double)kOperations);
+
+		for (uint32_t first : live) {
+			if (first != kNone) {
+				allocator->free(first);
+			}
+		}
+		assert(allocator->validate());
+		assert(allocator->stats().freeBlocks == 1);
+	}
+
+	delete allocator;
+	printf("validated speed.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testSplitAndMerge();
+	testSizeClasses();
+	testServiceReplay();
+	testSpeed();
+	return 0;
+}
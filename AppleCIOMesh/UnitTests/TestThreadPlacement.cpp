@@ -0,0 +1,238 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+//
+//  TestThreadPlacement.cpp
+//  AppleCIOMesh
+//
+//  Parses CPU lists, NUMA topologies and crypto thread placements, checks
+//  where the threads of each node rank are placed, and pins threads and faults
+//  memory in from them. This test has no platform dependencies and can be
+//  built on Linux:
+//    c++ -std=c++17 -I. -pthread UnitTests/TestThreadPlacement.cpp
+//
+
+#include "Common/ThreadPlacement.h"
+#include <cassert>
+#include <initializer_list>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::kPlacementAuto;
+using AppleCIOMeshUtils::PlacementConfig;
+using AppleCIOMeshUtils::PlacementCpuSet;
+using AppleCIOMeshUtils::PlacementTopology;
+
+static void
+testCpuList()
+{
+	PlacementCpuSet cpus;
+	assert(AppleCIOMeshUtils::parse_cpu_list("0-3,8,10-11\n", &cpus));
+	assert(cpus.count() == 7);
+	for (uint32_t cpu : {0u, 1u, 2u, 3u, 8u, 10u, 11u}) {
+		assert(cpus.contains(cpu));
+	}
+	assert(!cpus.contains(4) && !cpus.contains(9) && !cpus.contains(12));
+
+	assert(AppleCIOMeshUtils::parse_cpu_list("255", &cpus));
+	assert(cpus.count() == 1 && cpus.contains(255));
+	assert(AppleCIOMeshUtils::parse_cpu_list("", &cpus));
+	assert(cpus.count() == 0);
+
+	for (const char * bad : {"x", "1-", "3-1", "0,,1", "256", "0-256", "1 2", "-1"}) {
+		assert(!AppleCIOMeshUtils::parse_cpu_list(bad, &cpus));
+	}
+	printf("validated CpuList.\n");
+}
+
+static void
+writeFile(const char * path, const char * text)
+{
+	FILE * file = fopen(path, "w");
+	assert(file != nullptr);
+	fputs(text, file);
+	fclose(file);
+}
+
+static void
+testNumaTopology()
+{
+	char root[] = "/tmp/TestThreadPlacement.XXXXXX";
+	assert(mkdtemp(root) != nullptr);
+	char path[256];
+
+	PlacementTopology topology;
+	assert(!AppleCIOMeshUtils::read_numa_topology(&topology, root));
+	assert(topology.domainCount == 0);
+
+	// Two nodes with CPUs, with a hole before the second, and a node with
+	// only memory.
+	const char * nodes[][2] = {{"node0", "0-3,8-11\n"}, {"node2", "4-7,12-15\n"}, {"node3", "\n"}};
+	for (auto & node : nodes) {
+		snprintf(path, sizeof(path), "%s/%s", root, node[0]);
+		assert(mkdir(path, 0700) == 0);
+		snprintf(path, sizeof(path), "%s/%s/cpulist", root, node[0]);
+		writeFile(path, node[1]);
+	}
+	assert(AppleCIOMeshUtils::read_numa_topology(&topology, root));
+	assert(topology.domainCount == 2);
+	assert(topology.cpus[0].count() == 8 && topology.cpus[0].contains(0) && topology.cpus[0].contains(11));
+	assert(topology.cpus[1].count() == 8 && topology.cpus[1].contains(4) && topology.cpus[1].contains(15));
+	assert(!topology.cpus[1].contains(8));
+
+	for (auto & node : nodes) {
+		snprintf(path, sizeof(path), "%s/%s/cpulist", root, node[0]);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/%s", root, node[0]);
+		rmdir(path);
+	}
+	rmdir(root);
+
+	// The real machine, if it has NUMA nodes, has at least one CPU in each.
+	if (AppleCIOMeshUtils::read_numa_topology(&topology)) {
+		printf("This machine has %u NUMA nodes\n", topology.domainCount);
+		for (uint32_t domain = 0; domain < topology.domainCount; domain++) {
+			assert(topology.cpus[domain].count() > 0);
+		}
+	}
+	printf("validated NumaTopology.\n");
+}
+
+static void
+testClusterTopology()
+{
+	PlacementTopology topology;
+	AppleCIOMeshUtils::make_cluster_topology(12, 4, &topology);
+	assert(topology.domainCount == 3);
+	for (uint32_t domain = 0; domain < 3; domain++) {
+		assert(topology.cpus[domain].count() == 4);
+		assert(topology.cpus[domain].contains(domain * 4) && topology.cpus[domain].contains(domain * 4 + 3));
+	}
+
+	// A partial last cluster.
+	AppleCIOMeshUtils::make_cluster_topology(10, 4, &topology);
+	assert(topology.domainCount == 3 && topology.cpus[2].count() == 2);
+
+	// Unknown cluster size puts every CPU in one domain.
+	AppleCIOMeshUtils::make_cluster_topology(6, 0, &topology);
+	assert(topology.domainCount == 1 && topology.cpus[0].count() == 6);
+
+	// More clusters than domains end up in the last one.
+	AppleCIOMeshUtils::make_cluster_topology(64, 2, &topology);
+	assert(topology.domainCount == AppleCIOMeshUtils::kMaxPlacementDomains);
+	assert(topology.cpus[AppleCIOMeshUtils::kMaxPlacementDomains - 1].count() == 64 - 2 * 15);
+	printf("validated ClusterTopology.\n");
+}
+
+static void
+testPlacement()
+{
+	PlacementTopology topology;
+	AppleCIOMeshUtils::make_cluster_topology(16, 4, &topology);
+	PlacementConfig config;
+
+	// Auto spreads the threads in contiguous groups.
+	assert(AppleCIOMeshUtils::parse_placement("auto", &config));
+	assert(config.defaultDomain == kPlacementAuto);
+	const uint32_t spread8[] = {0, 0, 1, 1, 2, 2, 3, 3};
+	for (uint32_t x = 0; x < 8; x++) {
+		assert(AppleCIOMeshUtils::placement_domain(config, topology, x, x, 8) == spread8[x]);
+	}
+	const uint32_t spread2[] = {0, 2};
+	for (uint32_t x = 0; x < 2; x++) {
+		assert(AppleCIOMeshUtils::placement_domain(config, topology, x, x, 2) == spread2[x]);
+	}
+	// Ranks of a later partition are placed by their thread, not their rank.
+	for (uint32_t x = 0; x < 8; x++) {
+		assert(AppleCIOMeshUtils::placement_domain(config, topology, x + 16, x, 8) == spread8[x]);
+	}
+
+	// Listed ranks go where they are told, the others use the default.
+	assert(AppleCIOMeshUtils::parse_placement("0:3,1:3,*:1,5:0", &config));
+	assert(AppleCIOMeshUtils::placement_domain(config, topology, 0, 0, 8) == 3);
+	assert(AppleCIOMeshUtils::placement_domain(config, topology, 1, 1, 8) == 3);
+	assert(AppleCIOMeshUtils::placement_domain(config, topology, 5, 5, 8) == 0);
+	for (uint32_t x : {2u, 3u, 4u, 6u, 7u}) {
+		assert(AppleCIOMeshUtils::placement_domain(config, topology, x, x, 8) == 1);
+	}
+
+	// Listed ranks without a default are spread.
+	assert(AppleCIOMeshUtils::parse_placement("7:0", &config));
+	assert(AppleCIOMeshUtils::placement_domain(config, topology, 7, 7, 8) == 0);
+	assert(AppleCIOMeshUtils::placement_domain(config, topology, 6, 6, 8) == 3);
+
+	// Domains the machine does not have wrap around.
+	assert(AppleCIOMeshUtils::parse_placement("*:6", &config));
+	assert(AppleCIOMeshUtils::placement_domain(config, topology, 0, 0, 8) == 2);
+
+	// A machine without domains puts everything in the first.
+	PlacementTopology empty = {};
+	assert(AppleCIOMeshUtils::placement_domain(config, empty, 0, 0, 8) == 0);
+
+	for (const char * bad : {"", "0", "0:", ":1", "a:1", "0:1,", "0:1;1:2", "32:0", "0:16", "**:1", "0:1x"}) {
+		assert(!AppleCIOMeshUtils::parse_placement(bad, &config));
+	}
+	printf("validated placement.\n");
+}
+
+static void
+testPinning()
+{
+	const long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+	PlacementTopology topology;
+	AppleCIOMeshUtils::make_cluster_topology(cpuCount > 0 ? (uint32_t)cpuCount : 1, 1, &topology);
+
+	assert(AppleCIOMeshUtils::pin_current_thread(topology, topology.domainCount) == EINVAL);
+
+	// Pin a thread to each CPU in turn and check it runs there, from a thread
+	// of its own so the test thread is not left pinned.
+	int pinError = 0;
+	for (uint32_t domain = 0; domain < topology.domainCount; domain++) {
+		const size_t pageSize = (size_t)getpagesize();
+		const size_t pages    = 9;
+		uint8_t * memory      = (uint8_t *)malloc(pages * pageSize);
+		assert(memory != nullptr);
+		for (size_t i = 0; i < pages * pageSize; i++) {
+			memory[i] = (uint8_t)(i * 3);
+		}
+		assert(AppleCIOMeshUtils::first_touch_in_domain(topology, domain, memory, pages * pageSize, pageSize, &pinError) ==
+		       pages);
+		for (size_t i = 0; i < pages * pageSize; i++) {
+			assert(memory[i] == (uint8_t)(i * 3));
+		}
+		free(memory);
+#if defined(__linux__)
+		// The CPU may be offline or outside our cpuset, but never invalid.
+		assert(pinError != EINVAL);
+#else
+		(void)pinError;
+#endif
+	}
+	printf("validated pinning.\n");
+}
+
+int
+main(int argc __attribute__((unused)), char ** argv __attribute__((unused)))
+{
+	testCpuList();
+	testNumaTopology();
+	testClusterTopology();
+	testPlacement();
+	testPinning();
+	return 0;
+}
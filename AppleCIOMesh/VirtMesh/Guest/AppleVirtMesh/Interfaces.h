@@ -86,6 +86,7 @@ enum Methods : uint32_t {
 	CanActivate,
 	SetEnsembleSize,
 	GetEnsembleSize,
+	CanActivateNodes,
 	TotalMethods
 };
 
@@ -169,6 +170,7 @@ struct CryptoInfo {
 } __attribute__((packed));
 
 typedef uint32_t MeshNodeCount;
+typedef uint32_t MeshNodeMask;
 typedef uint32_t EnsembleSize;
 typedef struct AppleCIOMeshCryptoKey {
 	uint64_t key[4];
@@ -230,6 +232,7 @@ enum Methods : uint32_t {
 	SetMaxWaitPerNodeBatch,
 	SynchronizeGeneration,
 	OverrideRuntimePrepare,
+	SetupCommandRing,
 	TotalMethods
 };
 
@@ -249,6 +252,7 @@ enum Traps : uint32_t {
 	InterruptReceiveBatch,
 	StartForwardChain,
 	StopForwardChain,
+	SubmitCommands,
 	TotalTraps
 };
 
@@ -310,6 +314,12 @@ struct MaxWaitTime {
 	uint64_t maxWaitTime;
 } __attribute__((packed));
 
+struct CommandRingConfig {
+	mach_vm_address_t address; /* The user space ring address */
+	uint64_t          size;
+	uint32_t          entries;
+} __attribute__((packed));
+
 /* Limited by virtio queue size */
 static constexpr uint64_t kMaxMessageHeaderSize = 1024;
 static constexpr uint64_t kMaxSingleVirtIOTransfer =
@@ -151,13 +151,13 @@ AppleVirtMeshSharedMemory::create_assignment(uint64_t offset, MainClient::MeshDi
 		return kIOReturnBadArgument;
 	}
 
-	auto curr_count = (direction == MainClient::MeshDirection::In) ? _incoming_assignments.count : _outgoing_assignments.count;
-	if (curr_count >= kMaxAssignmentCount) {
+	auto & assignments = (direction == MainClient::MeshDirection::In) ? _incoming_assignments : _outgoing_assignments;
+	if (!assignments.reserve()) {
 		os_log_error(
 		    _logger,
-		    "Maxium number of %s assignements reached [%d]",
+		    "Could not grow the %s assignments past [%d]",
 		    (MainClient::MeshDirection::In == direction) ? "incoming" : "outgoing",
-		    curr_count
+		    assignments.count
 		);
 		return kIOReturnInvalid;
 	}
@@ -170,19 +170,8 @@ AppleVirtMeshSharedMemory::create_assignment(uint64_t offset, MainClient::MeshDi
 
 	if (MainClient::MeshDirection::In == direction) {
 		new_assignment->set_rx_node(node_id);
-		auto curr                          = _incoming_assignments.count;
-		_incoming_assignments.node[curr]   = node_id;
-		_incoming_assignments.offset[curr] = offset;
-		_incoming_assignments.ready[curr]  = false;
-		_incoming_assignments.count++;
-		_incoming_assignments.remaining++;
-	} else {
-		auto curr                          = _outgoing_assignments.count;
-		_outgoing_assignments.node[curr]   = node_id;
-		_outgoing_assignments.offset[curr] = offset;
-		_outgoing_assignments.count++;
-		_outgoing_assignments.remaining++;
 	}
+	assignments.add(offset, node_id);
 
 	_assignments->replaceObject(get_index(offset), new_assignment);
 	/* I think the following line is not needed because we are using OSSharedPtr */
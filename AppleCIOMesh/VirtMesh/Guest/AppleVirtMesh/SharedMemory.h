@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include "Common/AssignmentTable.h"
 #include "VirtMesh/Guest/AppleVirtMesh/Config.h"
 #include "VirtMesh/Guest/AppleVirtMesh/Interfaces.h"
 #include "VirtMesh/Guest/AppleVirtMesh/UserClientMain.h"
@@ -30,7 +31,9 @@
 namespace VirtMesh::Guest::Mesh
 {
 
-static constexpr uint32_t kMaxAssignmentCount = 512;
+/* Assignment maps grow a segment at a time, same as AppleCIOMeshAssignmentMap */
+static constexpr uint32_t kAssignmentSegmentSize = 256;
+static constexpr uint32_t kMaxAssignmentSegments = 64;
 
 class AppleVirtMeshDriver;
 class AppleVirtMeshSharedMemory;
@@ -80,19 +83,65 @@ class AppleVirtMeshAssignment final : public OSObject
 	AppleVirtMeshSharedMemory * _shared_memory;
 };
 
+/* Zeroed segments for AssignmentMap */
+struct AssignmentMapAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		return IONewZero(U, count);
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t count)
+	{
+		IODelete(memory, U, count);
+	}
+};
+
+template <typename T>
+using AssignmentColumn =
+    AppleCIOMeshUtils::SegmentedArray<T, kAssignmentSegmentSize, kMaxAssignmentSegments, AssignmentMapAllocator>;
+
+struct AssignmentTag {
+	char bytes[Config::kTagSize];
+};
+
 struct AssignmentMap {
-	uint64_t             offset[kMaxAssignmentCount];
-	ConfigClient::NodeId node[kMaxAssignmentCount];
-	char                 tag[kMaxAssignmentCount][Config::kTagSize];
-	bool                 ready[kMaxAssignmentCount];
-	bool                 notified[kMaxAssignmentCount];
-	uint32_t             count;
-	atomic_uint          remaining;
-	atomic_bool          all_receive_finished;
+	AssignmentColumn<uint64_t>             offset;
+	AssignmentColumn<ConfigClient::NodeId> node;
+	AssignmentColumn<AssignmentTag>        tag;
+	AssignmentColumn<bool>                 ready;
+	AssignmentColumn<bool>                 notified;
+	uint32_t                               count;
+	atomic_uint                            remaining;
+	atomic_bool                            all_receive_finished;
 
 	MainClient::MeshDirection   direction;
 	AppleVirtMeshSharedMemory * shared_memory;
 
+	/* Allocates room for one more assignment so add() cannot fail halfway */
+	bool
+	reserve()
+	{
+		return offset.reserve(1) && node.reserve(1) && tag.reserve(1) && ready.reserve(1) && notified.reserve(1);
+	}
+
+	uint32_t
+	add(uint64_t assignment_offset, ConfigClient::NodeId assignment_node)
+	{
+		auto curr = count;
+		offset.append(assignment_offset);
+		node.append(assignment_node);
+		tag.append(AssignmentTag{});
+		ready.append(false);
+		notified.append(false);
+		count++;
+		remaining++;
+		return curr;
+	}
+
 	/* TODO: Missing a few fields from AppleCIOMeshAssignmentMap, double check and see if they affect behaviors. */
 };
 
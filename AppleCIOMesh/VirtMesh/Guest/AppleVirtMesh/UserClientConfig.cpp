@@ -70,6 +70,7 @@ const IOExternalMethodDispatch2022 AppleVirtMeshConfigUserClient::sExternalMetho
     DEFINE_METHOD(CanActivate,            can_activate                  , sizeof(MeshNodeCount)      , 0                      , false),
     DEFINE_METHOD(SetEnsembleSize,        set_ensemble_size             , sizeof(EnsembleSize)       , 0                      , false),
     DEFINE_METHOD(GetEnsembleSize,        get_ensemble_size             , sizeof(EnsembleSize)       , sizeof(EnsembleSize)   , false),
+    DEFINE_METHOD(CanActivateNodes,       can_activate_nodes            , sizeof(MeshNodeMask)       , 0                      , false),
 };
 /* clang-format on */
 
@@ -500,6 +501,20 @@ AppleVirtMeshConfigUserClient::can_activate(OSObject * target, void * ref [[mayb
 	});
 }
 
+IOReturn
+AppleVirtMeshConfigUserClient::can_activate_nodes(OSObject * target, void * ref [[maybe_unused]], IOExternalMethodArguments * args)
+{
+	return with_client(target, MeshEnsure::Skip, [&](auto, auto) {
+		auto node_mask = UserClient::EMAInputExtractor<MeshNodeMask>(args);
+		if (0x3 != *node_mask.get()) {
+			os_log_error(_logger, "can_activate_nodes() only supports nodes 0 and 1, but got 0x%x", *node_mask.get());
+			return kIOReturnUnsupported;
+		}
+
+		return kIOReturnSuccess;
+	});
+}
+
 IOReturn
 AppleVirtMeshConfigUserClient::send_control_message(
     OSObject *                  target,
@@ -71,6 +71,7 @@ class AppleVirtMeshConfigUserClient : public AppleVirtMeshBaseUserClient
     static IOReturn can_activate                  (OSObject *,          void * , IOExternalMethodArguments *);
     static IOReturn set_ensemble_size             (OSObject *,          void * , IOExternalMethodArguments *);
     static IOReturn get_ensemble_size             (OSObject *,          void * , IOExternalMethodArguments *);
+    static IOReturn can_activate_nodes            (OSObject *,          void * , IOExternalMethodArguments *);
 	/* clang-format on */
 
 	OSPtr<IOSharedDataQueue> _io_data_queue;
@@ -59,6 +59,7 @@ const IOExternalMethodDispatch2022 AppleVirtMeshMainUserClient::sExternalMethodD
 	DEFINE_METHOD(SetMaxWaitPerNodeBatch  , set_max_wait_per_node_batch , sizeof(MaxWaitTime)        , 0                      , false),
 	DEFINE_METHOD(SynchronizeGeneration   , synchronize_generation      , 0                          , 0                      , false),
 	DEFINE_METHOD(OverrideRuntimePrepare  , override_runtime_prepare    , sizeof(BufferId)           , 0                      , false),
+	DEFINE_METHOD(SetupCommandRing        , setup_command_ring          , sizeof(CommandRingConfig)  , 0                      , false),
 };
 
 const IOExternalTrap AppleVirtMeshMainUserClient::sExternalTrapDispatchTable[MainClient::Traps::TotalTraps] = {
@@ -77,6 +78,7 @@ const IOExternalTrap AppleVirtMeshMainUserClient::sExternalTrapDispatchTable[Mai
 	DEFINE_TRAP(InterruptReceiveBatch       , interrupt_receive_batch       ),
 	DEFINE_TRAP(StartForwardChain           , start_forward_chain           ),
 	DEFINE_TRAP(StopForwardChain            , stop_forward_chain            ),
+	DEFINE_TRAP(SubmitCommands              , submit_commands               ),
 };
 /* clang-format on */
 
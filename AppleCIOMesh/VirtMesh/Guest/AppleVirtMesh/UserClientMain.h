@@ -58,6 +58,7 @@ class AppleVirtMeshMainUserClient : public AppleVirtMeshBaseUserClient
     static IOReturn set_max_wait_per_node_batch (OSObject *, void *, IOExternalMethodArguments *); /* Not used but still implemented just in case */
     static IOReturn synchronize_generation      (OSObject *, void *, IOExternalMethodArguments *);
     static IOReturn override_runtime_prepare    (OSObject *, void *, IOExternalMethodArguments *);
+    static IOReturn setup_command_ring          (OSObject *, void *, IOExternalMethodArguments *) { return kIOReturnUnsupported; } /* The framework falls back to a trap per command */
 	/* clang-format on */
 
 	static const IOExternalTrap sExternalTrapDispatchTable[static_cast<int>(MainClient::Traps::TotalTraps)];
@@ -79,6 +80,7 @@ class AppleVirtMeshMainUserClient : public AppleVirtMeshBaseUserClient
 	IOReturn interrupt_receive_batch       (                                                                                                                                                                                                                             ) { return kIOReturnUnsupported; } /* Not used */
 	IOReturn start_forward_chain           (ut chain_id                  , ut elements                                                                                                                                                                                   );
 	IOReturn stop_forward_chain            (                                                                                                                                                                                                                             );
+	IOReturn submit_commands               (                                                                                                                                                                                                                             ) { return kIOReturnUnsupported; } /* The framework falls back to a trap per command */
 	/* clang-format on */
 
 	/**
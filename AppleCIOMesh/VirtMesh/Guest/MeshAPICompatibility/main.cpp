@@ -90,6 +90,7 @@ main()
 	check_enum(Main, Methods::SetMaxWaitPerNodeBatch, Method::SetMaxWaitPerNodeBatch);
 	check_enum(Main, Methods::SynchronizeGeneration, Method::SynchronizeGeneration);
 	check_enum(Main, Methods::OverrideRuntimePrepare, Method::OverrideRuntimePrepare);
+	check_enum(Main, Methods::SetupCommandRing, Method::SetupCommandRing);
 	check_enum(Main, Methods::TotalMethods, Method::NumMethods);
 
 	check_enum(Main, Traps::WaitSharedMemoryChunk, Trap::WaitSharedMemoryChunk);
@@ -107,9 +108,11 @@ main()
 	check_enum(Main, Traps::InterruptReceiveBatch, Trap::InterruptReceiveBatch);
 	check_enum(Main, Traps::StartForwardChain, Trap::StartForwardChain);
 	check_enum(Main, Traps::StopForwardChain, Trap::StopForwardChain);
+	check_enum(Main, Traps::SubmitCommands, Trap::SubmitCommands);
 	check_enum(Main, Traps::TotalTraps, Trap::NumTraps);
 
 	check_size(Main, SharedMemoryConfig, SharedMemory);
+	check_size(Main, CommandRingConfig, CommandRing);
 	check(Virt::Main::kMaxBufferChunkSize, kMaxChunkSize);
 
 	/* Config APIs */
@@ -135,6 +138,9 @@ main()
 	check_enum(Config, Methods::GetCryptoKey, Method::GetCryptoKey);
 	check_enum(Config, Methods::GetBuffersUsedByKey, Method::GetBuffersUsedByKey);
 	check_enum(Config, Methods::CanActivate, Method::canActivate);
+	check_enum(Config, Methods::SetEnsembleSize, Method::SetEnsembleSize);
+	check_enum(Config, Methods::GetEnsembleSize, Method::GetEnsembleSize);
+	check_enum(Config, Methods::CanActivateNodes, Method::canActivateNodes);
 	check_enum(Config, Methods::TotalMethods, Method::NumMethods);
 
 	check_size(Config, HardwareState, HardwareState);
@@ -147,6 +153,7 @@ main()
 	check_size(Config, CIOConnection, CIOConnection);
 	check_size(Config, CIOConnections, CIOConnections);
 	check_size(Config, MeshNodeCount, MeshNodeCount);
+	check_size(Config, MeshNodeMask, MeshNodeMask);
 	// check_size(Config, AppleCIOMeshCryptoKey, AppleCIOMeshCryptoKey);
 	check_enum(Config, Notification::MeshChannelChange, Notification::MeshChannelChange);
 	check_enum(Config, Notification::TXNodeConnectionChange, Notification::TXNodeConnectionChange);
@@ -0,0 +1,293 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// chunktune - finds how many chunks to split blocks in for each block size
+// and node count, and writes the result as a chunk table for MeshLoadChunkTable
+// (or MESH_CHUNK_TABLE).  each candidate count is measured by gathering a
+// block from every peer over local sockets: a thread per peer encrypts its
+// block a chunk at a time and sends it, and a thread per peer on the receiving
+// side decrypts each chunk into the user buffer as it arrives.  like on the
+// mesh, more chunks overlap the encryption, the transfer and the decryption
+// better but cost more per chunk.
+//
+// it only depends on Common/ChunkTable.h:
+//   c++ -std=c++17 -O2 -I. -pthread chunktune/Main.cpp -o chunktune
+//
+
+#include "Common/ChunkTable.h"
+#include <chrono>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::ChunkTable;
+
+static constexpr uint32_t kMaxNodes = 32;
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-nodes N,...] [-min KB] [-max KB] [-repetitions N] [-improvement PCT] [-o FILE]\n", name);
+	fprintf(stderr, "\t measures the chunk counts for every power of two block size between min and max.\n");
+	fprintf(stderr,
+	        "options: -nodes are the node counts to tune for (default 2,4,8).\n"
+	        "         -min and -max are the smallest and largest block size (default 64KB and 16384KB).\n"
+	        "         -repetitions is the number of times each count is measured (default 5).\n"
+	        "         -improvement is how much faster more chunks have to be to be used (default 3%%).\n"
+	        "         -o writes the table to FILE instead of stdout.\n");
+}
+
+static uint64_t
+keystream(uint64_t nonce, size_t index)
+{
+	return (nonce ^ 0x9e3779b97f4a7c15ull) + index * 0xbf58476d1ce4e5b9ull;
+}
+
+struct Peer {
+	int socket;
+	uint8_t * block;
+	uint8_t * user;
+	uint64_t blockSize;
+	uint32_t chunkCount;
+	uint64_t nonce;
+	bool failed;
+};
+
+static void *
+sendBlock(void * arg)
+{
+	Peer * peer            = (Peer *)arg;
+	const uint64_t chunk   = peer->blockSize / peer->chunkCount;
+	uint64_t * ciphertext  = (uint64_t *)malloc(chunk);
+	const uint64_t * clear = (const uint64_t *)peer->block;
+	if (ciphertext == nullptr) {
+		peer->failed = true;
+		shutdown(peer->socket, SHUT_WR);
+		return nullptr;
+	}
+	for (uint32_t c = 0; c < peer->chunkCount && !peer->failed; c++) {
+		const size_t words = chunk / sizeof(uint64_t);
+		for (size_t i = 0; i < words; i++) {
+			ciphertext[i] = clear[c * words + i] ^ keystream(peer->nonce + c, i);
+		}
+		for (uint64_t sent = 0; sent < chunk;) {
+			const ssize_t result = write(peer->socket, (const uint8_t *)ciphertext + sent, chunk - sent);
+			if (result <= 0) {
+				peer->failed = true;
+				break;
+			}
+			sent += (uint64_t)result;
+		}
+	}
+	free(ciphertext);
+	return nullptr;
+}
+
+static void *
+receiveBlock(void * arg)
+{
+	Peer * peer          = (Peer *)arg;
+	const uint64_t chunk = peer->blockSize / peer->chunkCount;
+	uint64_t * received  = (uint64_t *)malloc(chunk);
+	uint64_t * user      = (uint64_t *)peer->user;
+	if (received == nullptr) {
+		peer->failed = true;
+		return nullptr;
+	}
+	for (uint32_t c = 0; c < peer->chunkCount && !peer->failed; c++) {
+		for (uint64_t read_ = 0; read_ < chunk;) {
+			const ssize_t result = read(peer->socket, (uint8_t *)received + read_, chunk - read_);
+			if (result <= 0) {
+				peer->failed = true;
+				break;
+			}
+			read_ += (uint64_t)result;
+		}
+		const size_t words = chunk / sizeof(uint64_t);
+		for (size_t i = 0; i < words; i++) {
+			user[c * words + i] = received[i] ^ keystream(peer->nonce + c, i);
+		}
+	}
+	free(received);
+	return nullptr;
+}
+
+struct Bench {
+	uint8_t * blocks;
+	uint8_t * user;
+	uint64_t maxBlockSize;
+	uint64_t syncs;
+};
+
+// Gathers a block from each of the nodeCount - 1 peers, returns the seconds it
+// took.
+static double
+measureSync(void * context, uint32_t nodeCount, uint64_t blockSize, uint32_t chunkCount)
+{
+	Bench * bench = (Bench *)context;
+	if (blockSize / chunkCount % sizeof(uint64_t) != 0) {
+		return -1;
+	}
+
+	const uint32_t peers = nodeCount - 1;
+	Peer senders[kMaxNodes], receivers[kMaxNodes];
+	pthread_t sendThreads[kMaxNodes], receiveThreads[kMaxNodes];
+	int sockets[kMaxNodes][2];
+	for (uint32_t p = 0; p < peers; p++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets[p]) != 0) {
+			for (uint32_t q = 0; q < p; q++) {
+				close(sockets[q][0]);
+				close(sockets[q][1]);
+			}
+			return -1;
+		}
+		const uint64_t nonce = bench->syncs * kMaxNodes + p;
+		senders[p]   = {sockets[p][0], bench->blocks + p * bench->maxBlockSize, nullptr, blockSize, chunkCount, nonce, false};
+		receivers[p] = {sockets[p][1], nullptr, bench->user + p * bench->maxBlockSize, blockSize, chunkCount, nonce, false};
+	}
+	bench->syncs++;
+
+	auto start  = std::chrono::steady_clock::now();
+	bool failed = false;
+	uint32_t started;
+	for (started = 0; started < peers; started++) {
+		if (pthread_create(&receiveThreads[started], nullptr, receiveBlock, &receivers[started]) != 0) {
+			failed = true;
+			break;
+		}
+		if (pthread_create(&sendThreads[started], nullptr, sendBlock, &senders[started]) != 0) {
+			shutdown(sockets[started][0], SHUT_RDWR);
+			pthread_join(receiveThreads[started], nullptr);
+			failed = true;
+			break;
+		}
+	}
+	for (uint32_t p = 0; p < started; p++) {
+		pthread_join(sendThreads[p], nullptr);
+		pthread_join(receiveThreads[p], nullptr);
+		failed = failed || senders[p].failed || receivers[p].failed;
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (uint32_t p = 0; p < peers; p++) {
+		close(sockets[p][0]);
+		close(sockets[p][1]);
+		failed = failed || memcmp(senders[p].block, receivers[p].user, blockSize) != 0;
+	}
+	return failed ? -1 : seconds;
+}
+
+int
+main(int argc, char ** argv)
+{
+	uint32_t nodeCounts[kMaxNodes] = {2, 4, 8};
+	uint32_t nodeCountCount        = 3;
+	uint64_t minKB                 = 64;
+	uint64_t maxKB                 = 16384;
+	uint32_t repetitions           = 5;
+	double improvement             = 3;
+	const char * outputPath        = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-nodes") == 0 && i + 1 < argc) {
+			nodeCountCount = 0;
+			for (char * p = argv[i + 1]; *p && nodeCountCount < kMaxNodes; p++) {
+				nodeCounts[nodeCountCount++] = (uint32_t)strtoul(p, &p, 0);
+				if (*p != ',') {
+					break;
+				}
+			}
+			i++;
+		} else if (strcmp(argv[i], "-min") == 0 && i + 1 < argc) {
+			minKB = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-max") == 0 && i + 1 < argc) {
+			maxKB = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-repetitions") == 0 && i + 1 < argc) {
+			repetitions = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-improvement") == 0 && i + 1 < argc) {
+			improvement = strtod(argv[i + 1], NULL);
+			i++;
+		} else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			outputPath = argv[i + 1];
+			i++;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (minKB == 0 || maxKB < minKB || repetitions == 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+	uint32_t maxNodes = 0;
+	for (uint32_t i = 0; i < nodeCountCount; i++) {
+		if (nodeCounts[i] < 2 || nodeCounts[i] > kMaxNodes) {
+			fprintf(stderr, "Node counts have to be between 2 and %u\n", kMaxNodes);
+			return EX_USAGE;
+		}
+		maxNodes = nodeCounts[i] > maxNodes ? nodeCounts[i] : maxNodes;
+	}
+
+	Bench bench        = {};
+	bench.maxBlockSize = maxKB * 1024;
+	bench.blocks       = (uint8_t *)malloc((maxNodes - 1) * bench.maxBlockSize);
+	bench.user         = (uint8_t *)malloc((maxNodes - 1) * bench.maxBlockSize);
+	if (bench.blocks == nullptr || bench.user == nullptr) {
+		fprintf(stderr, "Failed to allocate %llu bytes\n", 2ull * (maxNodes - 1) * bench.maxBlockSize);
+		return EX_OSERR;
+	}
+	for (uint64_t i = 0; i < (maxNodes - 1) * bench.maxBlockSize; i++) {
+		bench.blocks[i] = (uint8_t)(i * 131 + 7);
+	}
+
+	ChunkTable table;
+	for (uint32_t n = 0; n < nodeCountCount; n++) {
+		for (uint64_t blockSize = minKB * 1024; blockSize <= maxKB * 1024; blockSize *= 2) {
+			const uint32_t chunkCount = AppleCIOMeshUtils::tune_chunk_count(measureSync, &bench, nodeCounts[n], blockSize,
+			                                                                AppleCIOMeshUtils::kMaxChunksPerBlock, repetitions,
+			                                                                improvement / 100);
+			if (chunkCount == 0) {
+				fprintf(stderr, "Failed to measure %u nodes with blocks of %lluKB\n", nodeCounts[n],
+				        (unsigned long long)blockSize / 1024);
+				return EX_OSERR;
+			}
+			fprintf(stderr, "%u nodes, %lluKB blocks: %u chunks (%u by default)\n", nodeCounts[n],
+			        (unsigned long long)blockSize / 1024, chunkCount, AppleCIOMeshUtils::default_chunk_count(blockSize));
+			table.set(nodeCounts[n], blockSize, chunkCount);
+		}
+	}
+	free(bench.blocks);
+	free(bench.user);
+
+	table.compact();
+	const int error = outputPath ? table.save(outputPath) : table.write(stdout);
+	if (error) {
+		fprintf(stderr, "Failed to write the chunk table: %s\n", strerror(error));
+		return EX_CANTCREAT;
+	}
+	return 0;
+}
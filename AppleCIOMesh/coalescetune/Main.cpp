@@ -0,0 +1,226 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// coalescetune - replays a recorded trace through the coalescing policy and
+// reports the ring size and interrupt stride it settles on, and what that
+// sizing and the fixed 4096/128 each cost on the trace: interrupts and how
+// long completions sat on the ring before an interrupt picked them up.
+//
+// the trace is either a sync trace (MeshStartSyncTrace or MESH_SYNC_TRACE),
+// where every sync counts as one message of the buffer's share per node on
+// each link, or text with one "nsec bytes" message per line.
+//
+// it only depends on the Common headers so traces can be looked at on any
+// machine:
+//   c++ -std=c++17 -I. coalescetune/Main.cpp -o coalescetune
+//
+
+#include "Common/CoalescingPolicy.h"
+#include "Common/SyncTrace.h"
+#include <algorithm>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <vector>
+
+using AppleCIOMeshUtils::CoalescingPolicy;
+using AppleCIOMeshUtils::CoalescingPolicyConfig;
+using AppleCIOMeshUtils::CoalescingReplay;
+using AppleCIOMeshUtils::CoalescingStats;
+using AppleCIOMeshUtils::kDefaultCoalescingPolicy;
+using AppleCIOMeshUtils::RingSizing;
+using AppleCIOMeshUtils::SyncTraceFileHeader;
+using AppleCIOMeshUtils::SyncTraceRecord;
+
+struct Message {
+	uint64_t time;
+	uint64_t bytes;
+};
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-text] [-window us] [-budget N] [-cover us] [-switch N] [-flush us] [-chunk KB] TRACE\n", name);
+	fprintf(stderr, "\t replays TRACE through the coalescing policy and compares its sizing with the fixed one.\n");
+	fprintf(stderr,
+	        "options: -text reads TRACE as lines of \"nsec bytes\" instead of a sync trace.\n"
+	        "         -window is how long the policy looks at traffic at a time (default 1000us).\n"
+	        "         -budget is how many interrupts a window may take (default 50).\n"
+	        "         -cover is how much traffic the ring should hold (default 2000us).\n"
+	        "         -switch is how many windows a new sizing has to hold for (default 8).\n"
+	        "         -flush is how long a completion waits at most for an interrupt (default 1000us).\n"
+	        "         -chunk is the largest transfer put on the ring, it never gets smaller (default 7680KB).\n");
+}
+
+static bool
+readSyncTrace(const char * path, std::vector<Message> & messages)
+{
+	FILE * file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	SyncTraceFileHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || !AppleCIOMeshUtils::is_valid_sync_trace_header(header)) {
+		fprintf(stderr, "%s is not a sync trace (or is from an incompatible version)\n", path);
+		fclose(file);
+		return false;
+	}
+
+	SyncTraceRecord record;
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		const uint64_t nodes = (uint64_t)__builtin_popcountll(record.nodeMask);
+		messages.push_back({record.endTime, nodes > 1 ? record.bufferSize / nodes : record.bufferSize});
+	}
+	bool ok = !ferror(file);
+	if (!ok) {
+		fprintf(stderr, "error reading %s: %s\n", path, strerror(errno));
+	}
+	fclose(file);
+	return ok;
+}
+
+static bool
+readTextTrace(const char * path, std::vector<Message> & messages)
+{
+	FILE * file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	char line[256];
+	uint32_t lineNumber = 0;
+	bool ok             = true;
+	while (ok && fgets(line, sizeof(line), file) != NULL) {
+		lineNumber++;
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		unsigned long long time, bytes;
+		if (sscanf(line, "%llu %llu", &time, &bytes) != 2) {
+			fprintf(stderr, "%s:%u: expected \"nsec bytes\"\n", path, lineNumber);
+			ok = false;
+		} else {
+			messages.push_back({time, bytes});
+		}
+	}
+	ok = ok && !ferror(file);
+	if (file != stdin) {
+		fclose(file);
+	}
+	return ok;
+}
+
+static void
+printReplay(const char * name, const RingSizing & sizing, const CoalescingReplay & replay, double seconds)
+{
+	const double meanWait = replay.messages() != 0 ? (double)replay.waitTotal() / (double)replay.messages() : 0;
+	printf("%8s %6u %6u %12llu %12.0f %10.1f %10.1f\n", name, sizing.ringSize, sizing.interruptStride,
+	       (unsigned long long)replay.interrupts(), seconds > 0 ? (double)replay.interrupts() / seconds : 0, meanWait / 1e3,
+	       (double)replay.waitMax() / 1e3);
+}
+
+int
+main(int argc, char ** argv)
+{
+	CoalescingPolicyConfig config = kDefaultCoalescingPolicy;
+	uint64_t flush                = 1'000'000;
+	bool text                     = false;
+	const char * path             = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-text") == 0) {
+			text = true;
+		} else if (strcmp(argv[i], "-window") == 0 && i + 1 < argc) {
+			config.window = strtoull(argv[i + 1], NULL, 0) * 1000;
+			i++;
+		} else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+			config.maxInterrupts = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-cover") == 0 && i + 1 < argc) {
+			config.ringCover = strtoull(argv[i + 1], NULL, 0) * 1000;
+			i++;
+		} else if (strcmp(argv[i], "-switch") == 0 && i + 1 < argc) {
+			config.switchWindows = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-chunk") == 0 && i + 1 < argc) {
+			config.chunkBytes = strtoull(argv[i + 1], NULL, 0) * 1024;
+			i++;
+		} else if (strcmp(argv[i], "-flush") == 0 && i + 1 < argc) {
+			flush = strtoull(argv[i + 1], NULL, 0) * 1000;
+			i++;
+		} else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		} else if (path == NULL) {
+			path = argv[i];
+		} else {
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (path == NULL || config.window == 0 || config.maxInterrupts == 0 || config.switchWindows == 0 || flush == 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	std::vector<Message> messages;
+	if (!(text ? readTextTrace(path, messages) : readSyncTrace(path, messages))) {
+		return EX_DATAERR;
+	}
+	if (messages.empty()) {
+		fprintf(stderr, "%s has no messages\n", path);
+		return EX_DATAERR;
+	}
+	std::stable_sort(messages.begin(), messages.end(), [](const Message & a, const Message & b) { return a.time < b.time; });
+
+	static CoalescingPolicy policy;
+	policy.init(config);
+	for (const Message & message : messages) {
+		policy.record(message.time, message.bytes);
+	}
+	policy.advance(messages.back().time + config.window);
+
+	const CoalescingStats stats = policy.stats();
+	const double seconds        = (double)(messages.back().time - messages.front().time) / 1e9;
+	printf("%llu messages, %llu bytes over %.3f s, %llu windows with traffic\n", (unsigned long long)stats.messages,
+	       (unsigned long long)stats.bytes, seconds, (unsigned long long)stats.windows);
+	printf("policy: %s, %llu frames per window, %llu sizing changes\n\n", stats.bulk ? "bulk" : "latency",
+	       (unsigned long long)stats.frameRate, (unsigned long long)stats.changes);
+
+	printf("%8s %6s %6s %12s %12s %10s %10s\n", "sizing", "ring", "stride", "interrupts", "per sec", "wait us", "max us");
+	const RingSizing sizings[] = {config.defaults, policy.sizing()};
+	const char * names[]       = {"fixed", "policy"};
+	for (uint32_t i = 0; i < 2; i++) {
+		CoalescingReplay replay;
+		replay.init(config.frameBytes, sizings[i], flush);
+		for (const Message & message : messages) {
+			replay.message(message.time, message.bytes);
+		}
+		replay.finish();
+		printReplay(names[i], sizings[i], replay, seconds);
+	}
+
+	return EX_OK;
+}
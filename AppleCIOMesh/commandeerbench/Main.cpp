@@ -0,0 +1,284 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// commandeerbench - puts synthetic load on the commandeer's work queue and
+// compares a commandeer that polls forever, as it used to, with one that
+// parks once the queue has been empty for -spin.  -producers threads each
+// queue work at -rate items a second with random gaps, and every item costs
+// the commandeer -work.  for every rate up to -rate, in powers of ten, it
+// prints how long items waited to be picked up and how much of a cpu the
+// commandeer burned doing it.
+//
+// it only depends on Common/CommandeerQueue.h and Common/LogLinearHistogram.h:
+//   c++ -std=c++17 -O2 -I. -pthread commandeerbench/Main.cpp -o commandeerbench
+//
+
+#include "Common/CommandeerQueue.h"
+#include "Common/LogLinearHistogram.h"
+#include <chrono>
+#include <condition_variable>
+#include <math.h>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+using AppleCIOMeshUtils::CommandeerPolicy;
+using AppleCIOMeshUtils::CommandeerWork;
+using Clock     = std::chrono::steady_clock;
+using Histogram = AppleCIOMeshUtils::LogLinearHistogram<>;
+
+struct BenchAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		return (U *)calloc(count, sizeof(U));
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t)
+	{
+		free(memory);
+	}
+};
+
+using Queue = AppleCIOMeshUtils::CommandeerQueue<BenchAllocator>;
+
+static const uint32_t kQueueEntries = 2048;
+static const uint32_t kBatch        = 32;
+
+struct Options {
+	uint32_t producers;
+	uint64_t rate;
+	uint64_t workNs;
+	uint64_t spinNs;
+	uint64_t milliseconds;
+};
+
+struct Result {
+	uint64_t items;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t max;
+	double cpu;
+	uint64_t parks;
+};
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-producers N] [-rate N] [-work ns] [-spin ns] [-ms N]\n", name);
+	fprintf(stderr, "\t times the commandeer polling and parking for every power of ten rate up to N.\n");
+	fprintf(stderr,
+	        "options: -producers is how many threads queue work (default 2).\n"
+	        "         -rate is the most items a second each producer queues (default 100000).\n"
+	        "         -work is what the commandeer spends on one item (default 1000ns).\n"
+	        "         -spin is how long the commandeer stays idle before parking (default 50000ns).\n"
+	        "         -ms is how long each row runs (default 500).\n");
+}
+
+static uint64_t
+nowNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static uint64_t
+threadCpuNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1'000'000'000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void
+spinFor(uint64_t ns)
+{
+	const uint64_t end = nowNs() + ns;
+	while (nowNs() < end) {
+	}
+}
+
+static Result
+run(const Options & options, uint64_t rate, bool park)
+{
+	Queue queue;
+	CommandeerPolicy policy;
+	policy.busyBatch      = kBatch;
+	policy.idleBatch      = kBatch;
+	policy.spinBeforePark = park ? options.spinNs : UINT64_MAX;
+	if (!queue.init(kQueueEntries, policy)) {
+		fprintf(stderr, "Could not set up the queue\n");
+		exit(EX_SOFTWARE);
+	}
+
+	std::mutex lock;
+	std::condition_variable wakeup;
+	bool done = false;
+	auto wake = [&] {
+		std::lock_guard<std::mutex> guard(lock);
+		wakeup.notify_one();
+	};
+
+	Histogram latency;
+	Result result = {};
+	uint64_t pushed = 0;
+
+	std::thread commandeer([&] {
+		const uint64_t cpuStart  = threadCpuNs();
+		const uint64_t wallStart = nowNs();
+		CommandeerWork work[kBatch];
+
+		for (;;) {
+			const uint32_t popped = queue.pop(work, queue.batchLimit(false));
+			for (uint32_t i = 0; i < popped; i++) {
+				latency.record(nowNs() - (uint64_t)work[i].offset);
+				spinFor(options.workNs);
+			}
+			result.items += popped;
+
+			if (popped == 0 && __atomic_load_n(&done, __ATOMIC_ACQUIRE) && queue.empty()) {
+				break;
+			}
+			if (queue.shouldPark(popped == 0, nowNs())) {
+				std::unique_lock<std::mutex> guard(lock);
+				queue.beginPark();
+				if (queue.empty() && !done) {
+					wakeup.wait(guard);
+				}
+				queue.endPark();
+			}
+		}
+
+		result.cpu = (double)(threadCpuNs() - cpuStart) / (double)(nowNs() - wallStart);
+	});
+
+	std::vector<std::thread> producers;
+	const uint64_t end = nowNs() + options.milliseconds * 1'000'000ull;
+	for (uint32_t p = 0; p < options.producers; p++) {
+		producers.emplace_back([&, p] {
+			uint64_t state = 0x9E3779B97F4A7C15ull * (p + 1);
+			uint64_t next  = nowNs();
+			while (next < end) {
+				// Exponential gaps, the load arrives in clumps as it does
+				// when a sync starts.
+				state ^= state << 13;
+				state ^= state >> 7;
+				state ^= state << 17;
+				const double uniform = ((double)(state >> 11) + 1.0) / 9007199254740993.0;
+				next += (uint64_t)(-log(uniform) * 1e9 / (double)rate);
+
+				const uint64_t now = nowNs();
+				if (next > now + 50'000) {
+					std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+				} else {
+					while (nowNs() < next) {
+					}
+				}
+
+				CommandeerWork work = {};
+				work.type           = AppleCIOMeshUtils::kCommandeerBulkPrepare;
+				work.offset         = (int64_t)nowNs();
+				while (!queue.push(work)) {
+					wake();
+					std::this_thread::yield();
+				}
+				if (queue.needsWake()) {
+					wake();
+				}
+				__atomic_fetch_add(&pushed, 1, __ATOMIC_RELAXED);
+			}
+		});
+	}
+
+	for (auto & producer : producers) {
+		producer.join();
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+		wakeup.notify_one();
+	}
+	commandeer.join();
+
+	if (result.items != pushed) {
+		fprintf(stderr, "%llu items queued but %llu run\n", (unsigned long long)pushed, (unsigned long long)result.items);
+		exit(EX_SOFTWARE);
+	}
+	result.p50   = latency.value_at_quantile(0.50);
+	result.p99   = latency.value_at_quantile(0.99);
+	result.max   = latency.maximum();
+	result.parks = queue.stats().parks;
+	return result;
+}
+
+int
+main(int argc, char ** argv)
+{
+	Options options;
+	options.producers    = 2;
+	options.rate         = 100000;
+	options.workNs       = 1000;
+	options.spinNs       = 50000;
+	options.milliseconds = 500;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-producers") == 0 && i + 1 < argc) {
+			options.producers = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-rate") == 0 && i + 1 < argc) {
+			options.rate = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-work") == 0 && i + 1 < argc) {
+			options.workNs = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-spin") == 0 && i + 1 < argc) {
+			options.spinNs = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-ms") == 0 && i + 1 < argc) {
+			options.milliseconds = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (options.producers == 0 || options.rate == 0 || options.milliseconds == 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	printf("%6s %10s %9s %10s %10s %10s %6s %8s\n", "mode", "rate/s", "items", "p50 us", "p99 us", "max us", "cpu%", "parks");
+	for (uint64_t rate = 10; rate <= options.rate; rate *= 10) {
+		for (int park = 0; park < 2; park++) {
+			const Result r = run(options, rate, park != 0);
+			printf("%6s %10llu %9llu %10.1f %10.1f %10.1f %5.1f%% %8llu\n", park ? "park" : "poll",
+			       (unsigned long long)(rate * options.producers), (unsigned long long)r.items, r.p50 / 1000.0, r.p99 / 1000.0,
+			       r.max / 1000.0, r.cpu * 100.0, (unsigned long long)r.parks);
+		}
+	}
+	return EX_OK;
+}
@@ -0,0 +1,140 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// dripsim - runs one link of a runtime prepared buffer against a simulated
+// commandeer and compares preparing as far ahead as the NHI queue allows
+// with letting the drip prepare controller size the depth.  for every power
+// of two step size up to -size it runs the buffer -runs times, so the
+// controller can learn from the earlier runs like it does for a buffer that
+// is sent over and over, and reports the last run.  the simulation is
+// deterministic, so the numbers only move when the controller or the costs
+// do.
+//
+// it only depends on the Common headers DripPrepareSimulator.h pulls in:
+//   c++ -std=c++17 -O2 -I. dripsim/Main.cpp -o dripsim
+//
+
+#include "Common/DripPrepareSimulator.h"
+#include <initializer_list>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+using AppleCIOMeshUtils::DripPrepareSimulationConfig;
+using AppleCIOMeshUtils::DripPrepareSimulationResult;
+using AppleCIOMeshUtils::DripPrepareSimulator;
+using AppleCIOMeshUtils::kDefaultDripPrepareSimulation;
+using AppleCIOMeshUtils::kDripPrepareUnbounded;
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-bytes MB] [-size KB] [-link MB/s] [-latency us] [-cost us] [-stall us] [-every N] [-runs N]\n", name);
+	fprintf(stderr, "\t simulates a buffer for every power of two step size from 128KB up to -size.\n");
+	fprintf(stderr,
+	        "options: -bytes is what the link sends per run (default 512MB).\n"
+	        "         -size is the largest step, an assignment's chunks on the link (default 4096KB).\n"
+	        "         -link is the link rate (default 5000MB/s).\n"
+	        "         -latency is how long the commandeer takes to get to a prepare (default 20us).\n"
+	        "         -cost is what one prepare costs (default 10us).\n"
+	        "         -stall is how long the commandeer is busy elsewhere now and then (default 500us).\n"
+	        "         -every is how many prepares there are between those stalls, 0 for none (default 64).\n"
+	        "         -runs is how many times the buffer runs before the one reported (default 4).\n");
+}
+
+int
+main(int argc, char ** argv)
+{
+	DripPrepareSimulationConfig config = kDefaultDripPrepareSimulation;
+	uint64_t bytes                     = 512ull * 1024 * 1024;
+	uint64_t maxStep                   = 4096ull * 1024;
+	uint32_t runs                      = 4;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-bytes") == 0 && i + 1 < argc) {
+			bytes = strtoull(argv[i + 1], NULL, 0) * 1024 * 1024;
+			i++;
+		} else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+			maxStep = strtoull(argv[i + 1], NULL, 0) * 1024;
+			i++;
+		} else if (strcmp(argv[i], "-link") == 0 && i + 1 < argc) {
+			config.linkBytesPerSecond = strtod(argv[i + 1], NULL) * 1e6;
+			i++;
+		} else if (strcmp(argv[i], "-latency") == 0 && i + 1 < argc) {
+			config.prepareLatency = strtod(argv[i + 1], NULL) * 1e-6;
+			i++;
+		} else if (strcmp(argv[i], "-cost") == 0 && i + 1 < argc) {
+			config.prepareCost = strtod(argv[i + 1], NULL) * 1e-6;
+			i++;
+		} else if (strcmp(argv[i], "-stall") == 0 && i + 1 < argc) {
+			config.stallTime = strtod(argv[i + 1], NULL) * 1e-6;
+			i++;
+		} else if (strcmp(argv[i], "-every") == 0 && i + 1 < argc) {
+			config.stallEvery = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-runs") == 0 && i + 1 < argc) {
+			runs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (maxStep < 128 * 1024 || maxStep >= config.maxAheadBytes || bytes < maxStep || bytes / (128 * 1024) > UINT32_MAX ||
+	    config.linkBytesPerSecond <= 0 || config.prepareLatency < 0 || config.prepareCost < 0 || config.stallTime < 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	static DripPrepareSimulator sim;
+	printf("%8s %8s %10s %8s %7s %9s %10s %5s %5s\n", "step KB", "mode", "time us", "GB/s", "starved", "wait us",
+	       "ahead MB", "max", "depth");
+	for (uint64_t step = 128 * 1024; step <= maxStep; step *= 2) {
+		for (bool adaptive : {false, true}) {
+			config.steps     = (uint32_t)(bytes / step);
+			config.stepBytes = step;
+			config.adaptive  = adaptive;
+			sim.init(config);
+
+			DripPrepareSimulationResult result = sim.run();
+			for (uint32_t run = 0; run < runs && !result.failed; run++) {
+				result = sim.run();
+			}
+			if (result.failed) {
+				printf("%8llu %8s failed\n", (unsigned long long)(step / 1024), adaptive ? "adaptive" : "fixed");
+				return EX_SOFTWARE;
+			}
+
+			char depth[16];
+			if (adaptive && result.finalDepth != kDripPrepareUnbounded) {
+				snprintf(depth, sizeof(depth), "%u", result.finalDepth);
+			} else {
+				snprintf(depth, sizeof(depth), "-");
+			}
+			const double throughput = (double)config.steps * (double)step / result.seconds;
+			printf("%8llu %8s %10.1f %8.2f %7llu %9.1f %10.2f %5u %5s\n", (unsigned long long)(step / 1024),
+			       adaptive ? "adaptive" : "fixed", result.seconds * 1e6, throughput / 1e9, (unsigned long long)result.starved,
+			       result.waitSeconds * 1e6, result.meanAheadBytes(step) / (1024 * 1024), result.maxAhead, depth);
+		}
+	}
+
+	return EX_OK;
+}
@@ -86,8 +86,8 @@ public protocol Backend {
 	/// Returns the number of buffers used.
 	func getBuffersUsed() throws -> Int
 
-	/// Checks if the mesh can be activated
-	func canActivate(nodeCount: Int) throws -> Bool
+	/// Checks if the mesh of the nodes with these ranks can be activated
+	func canActivate(nodeRanks: [Int]) throws -> Bool
 
 	func getEnsembleSize() throws -> UInt32
 
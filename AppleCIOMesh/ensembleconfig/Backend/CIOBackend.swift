@@ -161,8 +161,10 @@ public final class CIOBackend: Backend {
 		Int(self.meshService.getBuffersUsedForCryptoKey())
 	}
 
-	public func canActivate(nodeCount: Int) throws -> Bool {
-		Bool(self.meshService.canActivate(UInt32(nodeCount)))
+	public func canActivate(nodeRanks: [Int]) throws -> Bool {
+		// The driver takes the ranks in the partition.
+		let nodeMask = nodeRanks.reduce(UInt32(0)) { $0 | (UInt32(1) << UInt32($1 % 8)) }
+		return Bool(self.meshService.canActivateNodes(nodeMask))
 	}
 
 	public func addHostname(hostname: String, node: Int) throws -> Bool {
@@ -422,7 +422,7 @@ public final class SocketBackend: Backend {
 		throw "Not implemented on Socket"
 	}
 
-	public func canActivate(nodeCount: Int) throws -> Bool {
+	public func canActivate(nodeRanks: [Int]) throws -> Bool {
 		throw "Not implemented on Socket"
 	}
 
@@ -59,6 +59,12 @@ public final class Router8Hypercube: Router {
 		(self.nodeRank % 8) == (node % 8)
 	}
 
+	/// The node in the same slot of the other chassis of the partition, at the
+	/// other end of the A cable.
+	private func chassisPartner(_ node: Int) -> Int {
+		node ^ 4
+	}
+
 	public var configuration: RouterConfiguration {
 		self._configuration
 	}
@@ -69,11 +75,12 @@ public final class Router8Hypercube: Router {
 
 	public var allInnerChassisDiscovered: Bool {
 		let currentChassis = self._configuration.node.chassisID
-		let inChassisDiscoveredNodes = self.ensembleNodes.values.filter {
-			$0.inChassis && $0.rxEstablished && $0.txEstablished
+		let inChassisNodes = self.ensembleNodes.values.filter { $0.inChassis }
+		let inChassisDiscoveredNodes = inChassisNodes.filter {
+			$0.rxEstablished && $0.txEstablished
 		}
 
-		return inChassisDiscoveredNodes.count == 4
+		return inChassisDiscoveredNodes.count == inChassisNodes.count
 	}
 
 	public var partnerNodeDiscovered: Bool {
@@ -101,12 +108,14 @@ public final class Router8Hypercube: Router {
 		self.forwardedPartnerToChassis = false
 		self.expectedNetworkConnections = configuration.ensemble.partitionCount - 1
 
-		guard configuration.ensemble.nodeCount == 8 ||
+		// Up to a partition of nodes are ranks of the hypercube, not only the
+		// first ones once a node has failed. More have to be whole partitions.
+		guard (2...8).contains(configuration.ensemble.nodeCount) ||
 			configuration.ensemble.nodeCount == 16 ||
 			configuration.ensemble.nodeCount == 32 else {
 			throw """
 				Invalid number of nodes in ensemble configuration:
-				\(configuration.ensemble.nodeCount). Expected to be a multiple of 8."
+				\(configuration.ensemble.nodeCount). Expected 2 to 8 or a multiple of 8."
 				"""
 		}
 
@@ -142,6 +151,20 @@ public final class Router8Hypercube: Router {
 				}
 			}
 		}
+
+		// Every other node of the partition sends to us once, directly or
+		// forwarded. We send to the nodes we have links to, and with a partner
+		// forward its data to the rest of the chassis and the data of the
+		// chassis nodes without a partner to it.
+		let innerChassisNodes = self.ensembleNodes.values.filter { $0.inChassis && $0.node != self.nodeRank }
+		let hasPartner = self.ensembleNodes[self.chassisPartner(self.nodeRank)] != nil
+		let unpartneredNodes = innerChassisNodes.filter { self.ensembleNodes[self.chassisPartner($0.node)] == nil }
+
+		self.expectedRxConnections = self.ensembleNodes.count - 1
+		self.expectedTxConnections = innerChassisNodes.count
+		if hasPartner {
+			self.expectedTxConnections += 1 + innerChassisNodes.count + unpartneredNodes.count
+		}
 	}
 
 	public func networkConnectionChange(
@@ -319,7 +342,8 @@ public final class Router8Hypercube: Router {
 		// Inner chassis and partner node discovered, forward the partner
 		// node to all the inner chassis nodes
 		let innerChassisNodes = self.ensembleNodes.values.filter { $0.inChassis && $0.node != self.nodeRank }
-		guard let partnerNode = self.partnerNode else {
+		guard let partnerNode = self.partnerNode,
+		      let partnerCIOChannel = self.transferMap[partnerNode]?.inputChannel else {
 			fatalError("""
 				Partner node not set when trying to make TX connections. This is a
 				logic error
@@ -348,6 +372,27 @@ public final class Router8Hypercube: Router {
 				self.configuration.delegate.ensembleFailed()
 				return
 			}
+
+			// Nothing in the other chassis has a link to a node without a
+			// partner, so its data goes across through us.
+			if self.ensembleNodes[self.chassisPartner(innerChassisNode.node)] != nil {
+				continue
+			}
+
+			do {
+				try self.configuration.backend.establishTXConnection(
+					node: innerChassisNode.node,
+					cioChannelIndex: partnerCIOChannel)
+			} catch {
+				print("""
+					Failed to forward \(innerChassisNode.node)'s data to
+					\(partnerNode) on CIO\(partnerCIOChannel)
+					""")
+				self.ensembleFailed = true
+
+				self.configuration.delegate.ensembleFailed()
+				return
+			}
 		}
 	}
 
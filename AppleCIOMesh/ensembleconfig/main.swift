@@ -295,7 +295,6 @@ class Agent {
 		}
 
 		let routerConfig = RouterConfiguration(backend: backend, node: currentNodeConfig, ensemble: ensembleConfig, delegate: self)
-		var nodeCount = 8
 
 		switch ensembleConfig.nodeCount {
 		case 1:
@@ -303,11 +302,16 @@ class Agent {
 
 		case 2:
 			self.router = try Router2(configuration: routerConfig)
-			nodeCount = 2
 
 		case 4:
 			self.router = try Router4(configuration: routerConfig)
-			nodeCount = 4
+
+		case 3, 5, 6, 7:
+			// A partial hypercube, the links to the missing nodes go unused.
+			guard self.hypercubeMode else {
+				throw "Unsupported ensemble size without hypercube mode: \(ensembleConfig.nodeCount)"
+			}
+			self.router = try Router8Hypercube(configuration: routerConfig)
 
 		case 8:
 			fallthrough
@@ -321,13 +325,16 @@ class Agent {
 			} else {
 				self.router = try Router8(configuration: routerConfig)
 			}
-			nodeCount = 8
 
 		default:
 			throw "Unsupported ensemble size: \(ensembleConfig.nodeCount)"
 		}
 
-		let canActivateMesh = try backend.canActivate(nodeCount: nodeCount)
+		// The ranks of this node's partition in the ensemble, which need not be
+		// the first ones when it has lost a node.
+		let partition = nodeRank / ensembleConfig.nodePerPartition
+		let partitionRanks = ensembleConfig.nodes.map(\.rank).filter { $0 / ensembleConfig.nodePerPartition == partition }
+		let canActivateMesh = try backend.canActivate(nodeRanks: partitionRanks)
 
 		if canActivateMesh {
 			print("Safe to activate mesh")
@@ -0,0 +1,173 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// forwardbench - runs the kext's forward state machine against simulated
+// links and reports what a forwarding node would sustain.  chunks arrive a
+// TBT command at a time and every chunk goes out to three outputs, chained
+// (prepared ahead by their chain group and sent in order) or prepared when
+// their first command arrives.  with -chains it also sets up that many
+// chains, issues their syncs newest chain first and compares starting the
+// oldest pending sync first with starting them in chain order.  the
+// simulation is deterministic, so the
+// numbers only move when the engine or the costs do, which makes it usable
+// as a regression check on Linux.
+//
+// it only depends on the Common headers ForwardSimulator.h pulls in:
+//   c++ -std=c++17 -O2 -I. forwardbench/Main.cpp -o forwardbench
+//
+
+#include "Common/ForwardSimulator.h"
+#include <initializer_list>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+using AppleCIOMeshUtils::ForwardSimulationConfig;
+using AppleCIOMeshUtils::ForwardSimulationResult;
+using AppleCIOMeshUtils::ForwardSimulator;
+using AppleCIOMeshUtils::kChainDeadline;
+using AppleCIOMeshUtils::kChainDiscoveryOrder;
+using AppleCIOMeshUtils::kDefaultForwardSimulation;
+using AppleCIOMeshUtils::kMaxSimulatedChains;
+using AppleCIOMeshUtils::kMaxSimulatedChunks;
+using AppleCIOMeshUtils::kMaxSimulatedCommands;
+using AppleCIOMeshUtils::kSimForwardNodeCount;
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-chunks N] [-commands N] [-size KB] [-links N] [-link MB/s] [-step us] [-prepare us]\n", name);
+	fprintf(stderr, "\t    [-chains N] [-interval us]\n");
+	fprintf(stderr, "\t simulates forwarding for every power of two chunk count up to N, chained and not.\n");
+	fprintf(stderr,
+	        "options: -chunks is the largest chunk count (default 64, at most %u).\n"
+	        "         -commands is the TBT commands per chunk (default 4, at most %u).\n"
+	        "         -size is the size of one TBT command (default 256KB).\n"
+	        "         -links is the links per channel (default 1).\n"
+	        "         -link is the rate of every RX and TX link (default 5000MB/s).\n"
+	        "         -step is what the forward loop spends on one state machine step (default 1us).\n"
+	        "         -prepare is what preparing one TX command costs (default 1us).\n"
+	        "         -chains is how many chains of N chunks take turns (default 1, at most %u).\n"
+	        "         -interval is the time between two chains' syncs (default 1000us).\n",
+	        kMaxSimulatedChunks, kMaxSimulatedCommands, kMaxSimulatedChains);
+}
+
+int
+main(int argc, char ** argv)
+{
+	ForwardSimulationConfig config = kDefaultForwardSimulation;
+	uint32_t maxChunks             = config.chunkCount;
+	uint32_t chains                = 1;
+	double interval                = 1e-3;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-chunks") == 0 && i + 1 < argc) {
+			maxChunks = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-commands") == 0 && i + 1 < argc) {
+			config.commandsPerChunk = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+			config.commandBytes = strtoull(argv[i + 1], NULL, 0) * 1024;
+			i++;
+		} else if (strcmp(argv[i], "-links") == 0 && i + 1 < argc) {
+			config.linksPerChannel = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-link") == 0 && i + 1 < argc) {
+			config.rxBytesPerSecond = strtod(argv[i + 1], NULL) * 1e6;
+			config.txBytesPerSecond = config.rxBytesPerSecond;
+			i++;
+		} else if (strcmp(argv[i], "-step") == 0 && i + 1 < argc) {
+			config.stepCost = strtod(argv[i + 1], NULL) * 1e-6;
+			i++;
+		} else if (strcmp(argv[i], "-prepare") == 0 && i + 1 < argc) {
+			config.prepareCost = strtod(argv[i + 1], NULL) * 1e-6;
+			i++;
+		} else if (strcmp(argv[i], "-chains") == 0 && i + 1 < argc) {
+			chains = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-interval") == 0 && i + 1 < argc) {
+			interval = strtod(argv[i + 1], NULL) * 1e-6;
+			i++;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (maxChunks < config.linksPerChannel || maxChunks > kMaxSimulatedChunks || config.commandsPerChunk == 0 ||
+	    config.commandsPerChunk > kMaxSimulatedCommands || config.commandBytes == 0 || config.linksPerChannel == 0 ||
+	    config.rxBytesPerSecond <= 0 || config.stepCost < 0 || config.prepareCost < 0 || chains == 0 ||
+	    chains > kMaxSimulatedChains || interval < 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	static ForwardSimulator sim;
+	printf("%6s %7s %10s %9s %8s %8s %5s %6s\n", "chunks", "chained", "time us", "out GB/s", "steps", "requeues", "queue",
+	       "tx use");
+	for (uint32_t chunks = config.linksPerChannel; chunks <= maxChunks; chunks *= 2) {
+		for (bool chained : {true, false}) {
+			config.chunkCount              = chunks;
+			config.chained                 = chained;
+			ForwardSimulationResult result = sim.run(config);
+			if (result.failed || !result.ordered || result.chunksForwarded != chunks) {
+				fprintf(stderr, "Forwarding %u chunks %s failed\n", chunks, chained ? "chained" : "unchained");
+				return EX_SOFTWARE;
+			}
+
+			double utilization = 0;
+			for (uint32_t output = 0; output < kSimForwardNodeCount; output++) {
+				for (uint32_t link = 0; link < config.linksPerChannel; link++) {
+					utilization += sim.txUtilization(output, link);
+				}
+			}
+			utilization /= kSimForwardNodeCount * config.linksPerChannel;
+
+			printf("%6u %7s %10.1f %9.2f %8llu %8llu %5u %5.0f%%\n", chunks, chained ? "yes" : "no", result.seconds * 1e6,
+			       result.throughput() / 1e9, (unsigned long long)result.steps, (unsigned long long)result.requeues,
+			       result.maxQueueDepth, utilization * 100);
+		}
+	}
+
+	if (chains == 1) {
+		return EX_OK;
+	}
+
+	// Syncs issued newest chain first, the worst case for going by chain order.
+	config.chunkCount   = maxChunks;
+	config.chained      = true;
+	config.chainCount   = chains;
+	config.syncInterval = interval;
+	config.reverseSetup = true;
+	printf("\n%6s %9s %10s %12s %13s\n", "chains", "policy", "time us", "max sync us", "mean sync us");
+	for (auto policy : {kChainDeadline, kChainDiscoveryOrder}) {
+		config.policy                  = policy;
+		ForwardSimulationResult result = sim.run(config);
+		if (result.failed || !result.ordered || !result.chainStopped) {
+			fprintf(stderr, "Forwarding %u chains failed\n", chains);
+			return EX_SOFTWARE;
+		}
+		printf("%6u %9s %10.1f %12.1f %13.1f\n", chains, policy == kChainDeadline ? "deadline" : "discovery",
+		       result.seconds * 1e6, result.maxSyncLatency * 1e6, result.meanSyncLatency * 1e6);
+	}
+
+	return EX_OK;
+}
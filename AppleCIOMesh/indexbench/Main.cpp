@@ -0,0 +1,198 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// indexbench - compares finding a shared memory buffer by scanning every
+// buffer, as the driver used to, with the buffer index.  buffers are objects
+// of their own, as the driver's are, so the scan pays for a pointer chase
+// per buffer it walks past.  every power of two buffer count up to -buffers
+// is timed with random lookups, optionally with -readers threads looking up
+// at the same time.
+//
+// it only depends on Common/BufferIndex.h:
+//   c++ -std=c++17 -O2 -I. -pthread indexbench/Main.cpp -o indexbench
+//
+
+#include "Common/BufferIndex.h"
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Buffer {
+	int64_t id;
+	char state[120];
+};
+
+struct BenchAllocator {
+	template <typename U>
+	static U *
+	allocate(uint32_t count)
+	{
+		return (U *)calloc(count, sizeof(U));
+	}
+
+	template <typename U>
+	static void
+	deallocate(U * memory, uint32_t)
+	{
+		free(memory);
+	}
+};
+
+using Index = AppleCIOMeshUtils::BufferIndex<Buffer, BenchAllocator>;
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-buffers N] [-lookups N] [-readers N]\n", name);
+	fprintf(stderr, "\t times lookups for every power of two buffer count up to N, scanning and indexed.\n");
+	fprintf(stderr,
+	        "options: -buffers is the most buffers allocated (default 4096).\n"
+	        "         -lookups is how many lookups each row is averaged over (default 1000000).\n"
+	        "         -readers is how many threads look up at once (default 1).\n");
+}
+
+static Buffer *
+scan(Buffer * const * buffers, uint32_t count, int64_t id)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		if (buffers[i]->id == id) {
+			return buffers[i];
+		}
+	}
+	return nullptr;
+}
+
+// Runs lookup on every reader thread and returns the ns per lookup.
+template <typename Lookup>
+static double
+timeLookups(uint32_t readers, uint32_t lookups, uint32_t count, Lookup lookup)
+{
+	std::vector<std::thread> threads;
+	uint64_t missing = 0;
+
+	const Clock::time_point start = Clock::now();
+	for (uint32_t r = 0; r < readers; r++) {
+		threads.emplace_back([&, r] {
+			uint64_t state = 0x9E3779B97F4A7C15ull * (r + 1);
+			for (uint32_t i = 0; i < lookups; i++) {
+				state ^= state << 13;
+				state ^= state >> 7;
+				state ^= state << 17;
+				const int64_t id = (int64_t)(state % count) + 1;
+				if (lookup(id) == nullptr) {
+					__atomic_fetch_add(&missing, 1, __ATOMIC_RELAXED);
+				}
+			}
+		});
+	}
+	for (auto & thread : threads) {
+		thread.join();
+	}
+	const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+	if (missing != 0) {
+		fprintf(stderr, "%llu lookups missed\n", (unsigned long long)missing);
+		exit(EX_SOFTWARE);
+	}
+	return ns / lookups;
+}
+
+int
+main(int argc, char ** argv)
+{
+	uint32_t maxBuffers = 4096;
+	uint32_t lookups    = 1000000;
+	uint32_t readers    = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-buffers") == 0 && i + 1 < argc) {
+			maxBuffers = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-lookups") == 0 && i + 1 < argc) {
+			lookups = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-readers") == 0 && i + 1 < argc) {
+			readers = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (maxBuffers == 0 || maxBuffers > Index::kMaxCapacity / 2 || lookups == 0 || readers == 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	// Allocated one at a time and in a shuffled order, so the scan doesn't
+	// walk memory in order.
+	std::vector<Buffer *> buffers(maxBuffers);
+	for (uint32_t i = 0; i < maxBuffers; i++) {
+		buffers[i]     = new Buffer();
+		buffers[i]->id = i + 1;
+	}
+	srand(1);
+	for (uint32_t i = maxBuffers - 1; i > 0; i--) {
+		const uint32_t j = (uint32_t)rand() % (i + 1);
+		Buffer * swap    = buffers[i];
+		buffers[i]       = buffers[j];
+		buffers[j]       = swap;
+	}
+	std::vector<Buffer *> byId(maxBuffers);
+	for (uint32_t i = 0; i < maxBuffers; i++) {
+		byId[(size_t)buffers[i]->id - 1] = buffers[i];
+	}
+
+	printf("%8s %10s %10s %8s %9s\n", "buffers", "scan ns", "index ns", "speedup", "capacity");
+	for (uint32_t count = 1; count <= maxBuffers; count *= 2) {
+		// The first count ids, in allocation order.
+		std::vector<Buffer *> allocated;
+		Index index;
+		for (uint32_t i = 0; i < maxBuffers; i++) {
+			if (buffers[i]->id <= count) {
+				allocated.push_back(buffers[i]);
+				if (!index.insert(buffers[i]->id, buffers[i])) {
+					fprintf(stderr, "Could not index buffer %lld\n", (long long)buffers[i]->id);
+					return EX_SOFTWARE;
+				}
+			}
+		}
+
+		const double scanned =
+		    timeLookups(readers, lookups, count, [&](int64_t id) { return scan(allocated.data(), count, id); });
+		const double indexed = timeLookups(readers, lookups, count, [&](int64_t id) {
+			Buffer * b = index.find(id);
+			return b == byId[(size_t)id - 1] ? b : nullptr;
+		});
+
+		printf("%8u %10.1f %10.1f %7.2fx %9u\n", count, scanned, indexed, scanned / indexed, index.capacity());
+	}
+
+	for (Buffer * b : buffers) {
+		delete b;
+	}
+	return EX_OK;
+}
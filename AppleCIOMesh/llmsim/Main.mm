@@ -68,7 +68,13 @@ usage(char * name)
 	fprintf(stderr, "\t%s [-bsize N] [-delay usec] [-minchunk X] [-maxiter N] [-testloop L] [-noverify] [-exitonerr]\n", name);
 	fprintf(stderr,
 	        "options: set environment variable MESH_CRYPTO=1 to enable encryption\n"
-	        "         env var MESH_VERBOSE=1 for extremely verbose logging.\n");
+	        "         env var MESH_VERBOSE=1 for extremely verbose logging.\n"
+	        "         env var MESH_EVENT_TRACE=FILE writes a Chrome trace of the mesh threads to FILE on exit.\n"
+	        "         env var MESH_METRICS_SOCKET=PATH serves OpenMetrics stats over HTTP on the Unix socket PATH.\n"
+	        "         env var MESH_STATS_SEGMENT=/NAME publishes live stats to shared memory for meshtop.\n"
+	        "         env var MESH_SHADOW_LARGE_PAGES=1 backs the shadow buffers with 2MB pages where available.\n"
+	        "         env var MESH_CRYPTO_PLACEMENT=auto|RANK:DOMAIN,... places the crypto threads in NUMA nodes or clusters.\n"
+	        "         env var MESH_CHUNK_TABLE=FILE uses the chunk sizes tuned by chunktune.\n");
 }
 
 uint64_t
@@ -128,18 +134,13 @@ log_stats(MeshHandle_t * mh, MeshBufferState_t * mbs, bool forced)
 		mh->stats.averageIncomingCounter = 0;
 		mh->stats.averageOutgoingCounter = 0;
 
-		printf("Sync Time Histogram:\n");
-		uint64_t base = 0;
-		for (int i = 0; i < MESH_SYNC_HISTOGRAM_COUNT; i++) {
-			if (mh->stats.syncTimeHistogram[i] != 0) {
-				if (i < MESH_SYNC_HISTOGRAM_COUNT - 1) {
-					printf("    %6lld - %6lld usec: %lld\n", base, mh->stats.syncTimeHistogramBins[i],
-					       mh->stats.syncTimeHistogram[i]);
-				} else {
-					printf("           > %6lld usec: %lld\n", base, mh->stats.syncTimeHistogram[i]);
-				}
+		static const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+		uint64_t syncTimes[sizeof(percentiles) / sizeof(percentiles[0])];
+		if (MeshGetSyncTimePercentiles(mh, percentiles, syncTimes, sizeof(percentiles) / sizeof(percentiles[0])) == 0) {
+			printf("Sync Time Percentiles:\n");
+			for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+				printf("    p%-6g %8.2f usec\n", percentiles[i], (double)syncTimes[i] / 1000.0);
 			}
-			base = mh->stats.syncTimeHistogramBins[i] + 1;
 		}
 	}
 }
@@ -0,0 +1,196 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// meshtop - shows the live stats published by MeshStartStatsSegment (or with
+// MESH_STATS_SEGMENT set): the sync rate and percentiles, and the throughput
+// and lateness of every peer.  it only reads the shared memory, so it can be
+// left running next to a mesh without slowing it down.
+//
+// it only depends on Common/StatsSegment.h:
+//   c++ -std=c++17 -I. meshtop/Main.cpp -o meshtop
+//
+
+#include "Common/StatsSegment.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::kStatsSegmentPeerCount;
+using AppleCIOMeshUtils::kStatsSegmentPhaseCount;
+using AppleCIOMeshUtils::StatsSegment;
+using AppleCIOMeshUtils::StatsSegmentData;
+using AppleCIOMeshUtils::stats_segment_quantile;
+
+// In MeshSyncPhase_t order.
+static const char * kPhaseNames[kStatsSegmentPhaseCount] = {
+    "encrypt", "sendsIssued", "firstChunk", "lastChunk", "decrypt", "netReceive",
+};
+
+static volatile sig_atomic_t gStop = 0;
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-n NAME] [-i MSEC] [-once]\n", name);
+	fprintf(stderr, "\t shows the live mesh stats published to the shared memory NAME (default /meshstats).\n");
+	fprintf(stderr,
+	        "options: -i refreshes every MSEC milliseconds (default 1000).\n"
+	        "         -once prints the stats once, without rates, and exits.\n");
+}
+
+static void
+handleSignal(int)
+{
+	gStop = 1;
+}
+
+static double
+usec(uint64_t nsec)
+{
+	return (double)nsec / 1000.0;
+}
+
+static void
+printStats(const StatsSegment * segment, const StatsSegmentData & now, const StatsSegmentData * before, bool clear)
+{
+	// Rates are over the time between the two publishes we read.
+	double seconds = 0.0;
+	if (before && now.publishTime > before->publishTime) {
+		seconds = (double)(now.publishTime - before->publishTime) * 1e-9;
+	}
+
+	if (clear) {
+		printf("\033[H\033[2J");
+	}
+	printf("node %llu (pid %u), published %llu times\n", (unsigned long long)now.nodeId, segment->pid,
+	       (unsigned long long)now.publishCount);
+
+	printf("\nsyncs: %llu", (unsigned long long)now.syncCount);
+	if (seconds > 0.0) {
+		printf(", %.1f/sec", (double)(now.syncCount - before->syncCount) / seconds);
+	}
+	if (now.syncCount > 0) {
+		printf(", avg %.1fus, min %.1fus, max %.1fus", usec(now.syncTotalTime / now.syncCount), usec(now.syncMinTime),
+		       usec(now.syncMaxTime));
+	}
+	printf("\n");
+	printf("%-12s %10s %10s %10s\n", "", "p50 (us)", "p99 (us)", "max (us)");
+	printf("%-12s %10.1f %10.1f %10.1f\n", "sync", usec(stats_segment_quantile(now.syncTime, 0.5)),
+	       usec(stats_segment_quantile(now.syncTime, 0.99)), usec(now.syncTime.max));
+	for (uint32_t phase = 0; phase < kStatsSegmentPhaseCount; phase++) {
+		const AppleCIOMeshUtils::StatsSegmentHistogram & histogram = now.phaseTime[phase];
+		if (histogram.count == 0) {
+			continue;
+		}
+		printf("%-12s %10.1f %10.1f %10.1f\n", kPhaseNames[phase], usec(stats_segment_quantile(histogram, 0.5)),
+		       usec(stats_segment_quantile(histogram, 0.99)), usec(histogram.max));
+	}
+
+	printf("\ncrypto: %llu chunks encrypted", (unsigned long long)now.encryptCount);
+	if (now.encryptCount > 0) {
+		printf(" (avg %.1fus)", usec(now.encryptTotalTime / now.encryptCount));
+	}
+	printf(", %llu decrypted", (unsigned long long)now.decryptCount);
+	if (now.decryptCount > 0) {
+		printf(" (avg %.1fus)", usec(now.decryptTotalTime / now.decryptCount));
+	}
+	printf(", %llu key derivations\n", (unsigned long long)now.keyDerivations);
+
+	printf("\n%-5s %12s %12s %12s %14s %14s %s\n", "peer", "syncs", "sent MB/s", "recv MB/s", "avg late (us)", "p99 late (us)",
+	       "");
+	for (uint32_t peer = 0; peer < kStatsSegmentPeerCount; peer++) {
+		if (now.peerSyncCount[peer] == 0 && now.peerBytesSent[peer] == 0 && now.peerBytesReceived[peer] == 0) {
+			continue;
+		}
+		double sent     = 0.0;
+		double received = 0.0;
+		if (seconds > 0.0) {
+			sent     = (double)(now.peerBytesSent[peer] - before->peerBytesSent[peer]) / seconds / 1e6;
+			received = (double)(now.peerBytesReceived[peer] - before->peerBytesReceived[peer]) / seconds / 1e6;
+		}
+		printf("%-5u %12llu %12.1f %12.1f %14.1f %14.1f %s\n", peer, (unsigned long long)now.peerSyncCount[peer], sent, received,
+		       usec(now.peerAverageLateness[peer]), usec(now.peerP99Lateness[peer]),
+		       (now.stragglerMask >> peer) & 1 ? "STRAGGLER" : "");
+	}
+	fflush(stdout);
+}
+
+int
+main(int argc, char ** argv)
+{
+	const char * name   = "/meshstats";
+	uint32_t intervalMs = 1000;
+	bool once           = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			name = argv[i + 1];
+			i++;
+		} else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+			intervalMs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-once") == 0) {
+			once = true;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (intervalMs == 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	int error                    = 0;
+	const StatsSegment * segment = AppleCIOMeshUtils::open_stats_segment(name, &error);
+	if (segment == NULL) {
+		fprintf(stderr, "Failed to open the stats segment %s: %s\n", name,
+		        error == EPROTO ? "not a stats segment of this version" : strerror(error));
+		return EX_NOINPUT;
+	}
+
+	signal(SIGINT, handleSignal);
+	signal(SIGTERM, handleSignal);
+
+	StatsSegmentData data[2];
+	bool haveBefore = false;
+	int current     = 0;
+	while (!gStop) {
+		if (!AppleCIOMeshUtils::read_stats_segment(segment, &data[current])) {
+			fprintf(stderr, "The stats segment %s is not being updated consistently\n", name);
+			AppleCIOMeshUtils::close_stats_segment(segment);
+			return EX_DATAERR;
+		}
+		printStats(segment, data[current], haveBefore ? &data[1 - current] : NULL, !once);
+		if (once) {
+			break;
+		}
+		haveBefore = true;
+		current    = 1 - current;
+		usleep(intervalMs * 1000);
+	}
+
+	AppleCIOMeshUtils::close_stats_segment(segment);
+	return 0;
+}
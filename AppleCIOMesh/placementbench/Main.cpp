@@ -0,0 +1,164 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// placementbench - measures how fast a thread copies a shadow buffer into a
+// user buffer depending on where the thread runs and where the shadow buffer
+// was first touched (see MeshSetCryptoPlacement).  it prints a matrix of the
+// copy bandwidth for every pair of thread and memory domain: on a NUMA machine
+// the diagonal is local memory and the rest is remote.  the domains are the
+// NUMA nodes of the machine, or with -cluster N groups of N CPUs.
+//
+// it only depends on Common/ThreadPlacement.h:
+//   c++ -std=c++17 -O2 -I. -pthread placementbench/Main.cpp -o placementbench
+//
+
+#include "Common/ThreadPlacement.h"
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::LargePageMapping;
+using AppleCIOMeshUtils::PlacementTopology;
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-size MB] [-iterations N] [-cluster N]\n", name);
+	fprintf(stderr, "\t compares the copy bandwidth of threads and memory in the same and in different domains.\n");
+	fprintf(stderr,
+	        "options: -size is the size of the buffer copied (default 256MB).\n"
+	        "         -iterations is the number of times the buffer is copied (default 5).\n"
+	        "         -cluster uses domains of N CPUs instead of the NUMA nodes.\n");
+}
+
+struct CopyRun {
+	const PlacementTopology * topology;
+	uint32_t domain;
+	const void * from;
+	size_t size;
+	uint32_t iterations;
+	double seconds;
+	int pinError;
+};
+
+static void *
+copyInDomain(void * arg)
+{
+	CopyRun * run = (CopyRun *)arg;
+	run->pinError = AppleCIOMeshUtils::pin_current_thread(*run->topology, run->domain);
+
+	// The user buffer belongs to the thread, so it is local to it.
+	LargePageMapping user;
+	if (!AppleCIOMeshUtils::map_large_pages(run->size, false, 0, &user)) {
+		run->seconds = 0;
+		return nullptr;
+	}
+	memset(user.memory, 0, run->size);
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t iteration = 0; iteration < run->iterations; iteration++) {
+		memcpy(user.memory, run->from, run->size);
+	}
+	run->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	AppleCIOMeshUtils::unmap_large_pages(user);
+	return nullptr;
+}
+
+int
+main(int argc, char ** argv)
+{
+	size_t sizeMB           = 256;
+	uint32_t iterations     = 5;
+	uint32_t cpusPerCluster = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+			sizeMB = (size_t)strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-iterations") == 0 && i + 1 < argc) {
+			iterations = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-cluster") == 0 && i + 1 < argc) {
+			cpusPerCluster = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (sizeMB == 0 || iterations == 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	PlacementTopology topology;
+	const long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpusPerCluster > 0) {
+		AppleCIOMeshUtils::make_cluster_topology(cpuCount > 0 ? (uint32_t)cpuCount : 1, cpusPerCluster, &topology);
+		printf("%u domains of %u CPUs\n", topology.domainCount, cpusPerCluster);
+	} else if (AppleCIOMeshUtils::read_numa_topology(&topology)) {
+		printf("%u NUMA nodes\n", topology.domainCount);
+	} else {
+		AppleCIOMeshUtils::make_cluster_topology(cpuCount > 0 ? (uint32_t)cpuCount : 1, 0, &topology);
+		printf("No NUMA nodes, all CPUs are in one domain\n");
+	}
+
+	const size_t size = sizeMB * 1024 * 1024;
+	printf("GB/s copying %zuMB, thread domain down, memory domain across\n", sizeMB);
+	printf("      ");
+	for (uint32_t memoryDomain = 0; memoryDomain < topology.domainCount; memoryDomain++) {
+		printf("%8u", memoryDomain);
+	}
+	printf("\n");
+
+	bool pinned = true;
+	for (uint32_t threadDomain = 0; threadDomain < topology.domainCount; threadDomain++) {
+		printf("%6u", threadDomain);
+		for (uint32_t memoryDomain = 0; memoryDomain < topology.domainCount; memoryDomain++) {
+			LargePageMapping shadow;
+			if (!AppleCIOMeshUtils::map_large_pages(size, false, 0, &shadow)) {
+				fprintf(stderr, "Failed to map %zu bytes\n", size);
+				return EX_OSERR;
+			}
+			int pinError = 0;
+			AppleCIOMeshUtils::first_touch_in_domain(topology, memoryDomain, shadow.memory, size, shadow.pageSize, &pinError);
+
+			CopyRun run = {&topology, threadDomain, shadow.memory, size, iterations, 0, 0};
+			pthread_t thread;
+			if (pthread_create(&thread, nullptr, copyInDomain, &run) != 0) {
+				fprintf(stderr, "Failed to start the copy thread\n");
+				return EX_OSERR;
+			}
+			pthread_join(thread, nullptr);
+			AppleCIOMeshUtils::unmap_large_pages(shadow);
+
+			pinned = pinned && pinError == 0 && run.pinError == 0;
+			printf("%8.2f", run.seconds > 0 ? (double)size * iterations / run.seconds / 1e9 : 0.0);
+		}
+		printf("\n");
+	}
+	if (!pinned) {
+		printf("Threads could not be pinned to their domain, placement is only a hint here.\n");
+	}
+	return 0;
+}
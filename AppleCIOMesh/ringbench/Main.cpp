@@ -0,0 +1,442 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// ringbench - compares the ring all-gather with the direct broadcast and
+// gather the mesh runs today, over local sockets between threads that stand
+// in for the nodes.  in the direct gather every node encrypts its block a
+// chunk at a time and sends each chunk to every peer, and a thread per peer
+// decrypts what arrives.  in the ring every node only talks to its neighbours
+// and forwards the ciphertext of each chunk as soon as it has it.  -link caps
+// the rate of every link, like the CIO links of a partition, the sockets are
+// only limited by memory bandwidth otherwise.
+//
+// it only depends on Common/ChunkTable.h, Common/CollectiveSchedule.h and
+// Common/RingAllGather.h:
+//   c++ -std=c++17 -O2 -I. -pthread ringbench/Main.cpp -o ringbench
+//
+
+#include "Common/ChunkTable.h"
+#include "Common/CollectiveSchedule.h"
+#include "Common/RingAllGather.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sysexits.h>
+#include <thread>
+#include <unistd.h>
+
+using AppleCIOMeshUtils::RingAllGather;
+using AppleCIOMeshUtils::RingAllGatherOps;
+using Clock = std::chrono::steady_clock;
+
+static constexpr uint32_t kMaxNodes = 16;
+static constexpr uint32_t kMaxSyncs = 64;
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-nodes N,...] [-min KB] [-max KB] [-chunks N] [-link MB/s] [-syncs N]\n", name);
+	fprintf(stderr, "\t times direct and ring all-gathers for every power of two block size between min and max.\n");
+	fprintf(stderr,
+	        "options: -nodes are the node counts to run (default 2,4,8).\n"
+	        "         -min and -max are the smallest and largest block size (default 64KB and 4096KB).\n"
+	        "         -chunks splits every block in N chunks (default: the mesh's chunk count for the block size).\n"
+	        "         -link caps every link at MB/s (default: no cap).\n"
+	        "         -syncs is the number of syncs each median is taken over (default 5).\n");
+}
+
+static uint64_t
+keystream(uint32_t rank, uint32_t chunk, size_t index)
+{
+	return ((uint64_t)rank << 32 | chunk) * 0x9e3779b97f4a7c15ull + index * 0xbf58476d1ce4e5b9ull;
+}
+
+static bool
+crypt(void * context __attribute__((unused)), uint32_t rank, uint32_t chunk, const void * in, void * out, uint64_t size)
+{
+	const uint64_t * from = (const uint64_t *)in;
+	uint64_t * to         = (uint64_t *)out;
+	for (size_t i = 0; i < size / sizeof(uint64_t); i++) {
+		to[i] = from[i] ^ keystream(rank, chunk, i);
+	}
+	return true;
+}
+
+// One direction of a link between two nodes, paced to bytesPerSecond if set.
+struct Link {
+	int socket;
+	double bytesPerSecond;
+	uint64_t sent;
+	Clock::time_point start;
+};
+
+static bool
+sendPaced(Link * link, const void * data, uint64_t size)
+{
+	for (uint64_t sent = 0; sent < size;) {
+		const ssize_t result = write(link->socket, (const uint8_t *)data + sent, size - sent);
+		if (result <= 0) {
+			return false;
+		}
+		sent += (uint64_t)result;
+	}
+	link->sent += size;
+	if (link->bytesPerSecond > 0) {
+		const auto due = link->start + std::chrono::duration_cast<Clock::duration>(
+		                                   std::chrono::duration<double>(link->sent / link->bytesPerSecond));
+		std::this_thread::sleep_until(due);
+	}
+	return true;
+}
+
+static bool
+receiveAll(int socket, void * data, uint64_t size)
+{
+	for (uint64_t received = 0; received < size;) {
+		const ssize_t result = read(socket, (uint8_t *)data + received, size - received);
+		if (result <= 0) {
+			return false;
+		}
+		received += (uint64_t)result;
+	}
+	return true;
+}
+
+struct Node;
+
+struct Peer {
+	Node * node;
+	uint32_t peer;
+};
+
+struct Node {
+	uint32_t rank;
+	uint32_t position;
+	uint32_t nodeCount;
+	const uint32_t * ring;
+	uint64_t blockSize;
+	uint32_t chunkCount;
+	uint8_t * user;
+	uint8_t * staging;
+	// To and from every peer by rank, only the neighbours are used by the ring.
+	Link out[kMaxNodes];
+	int in[kMaxNodes];
+	Peer peers[kMaxNodes];
+	std::atomic<uint32_t> sealed;
+	std::atomic<bool> failed;
+};
+
+static bool
+ringSend(void * context, const void * data, uint64_t size)
+{
+	Node * node = (Node *)context;
+	return sendPaced(&node->out[node->ring[(node->position + 1) % node->nodeCount]], data, size);
+}
+
+static bool
+ringReceive(void * context, void * data, uint64_t size)
+{
+	Node * node = (Node *)context;
+	return receiveAll(node->in[node->ring[(node->position + node->nodeCount - 1) % node->nodeCount]], data, size);
+}
+
+static void *
+runRing(void * arg)
+{
+	Node * node                = (Node *)arg;
+	const RingAllGatherOps ops = {ringSend, ringReceive, crypt, crypt, node};
+	RingAllGather ring(node->nodeCount, node->position, node->ring, node->blockSize, node->chunkCount, node->user,
+	                   node->staging, ops);
+	node->failed = !ring.run();
+	return nullptr;
+}
+
+// Sends each chunk of the node's block to one peer as soon as it is sealed.
+static void *
+sendDirect(void * arg)
+{
+	Peer * peer          = (Peer *)arg;
+	Node * node          = peer->node;
+	const uint64_t chunk = node->blockSize / node->chunkCount;
+	for (uint32_t c = 0; c < node->chunkCount && !node->failed; c++) {
+		while (node->sealed.load(std::memory_order_acquire) <= c) {
+			sched_yield();
+		}
+		if (!sendPaced(&node->out[peer->peer], node->staging + node->rank * node->blockSize + c * chunk, chunk)) {
+			node->failed = true;
+		}
+	}
+	return nullptr;
+}
+
+static void *
+receiveDirect(void * arg)
+{
+	Peer * peer           = (Peer *)arg;
+	Node * node           = peer->node;
+	const uint64_t chunk  = node->blockSize / node->chunkCount;
+	const uint64_t offset = peer->peer * node->blockSize;
+	for (uint32_t c = 0; c < node->chunkCount && !node->failed; c++) {
+		if (!receiveAll(node->in[peer->peer], node->staging + offset + c * chunk, chunk)) {
+			node->failed = true;
+			break;
+		}
+		crypt(nullptr, peer->peer, c, node->staging + offset + c * chunk, node->user + offset + c * chunk, chunk);
+	}
+	return nullptr;
+}
+
+static void *
+runDirect(void * arg)
+{
+	Node * node = (Node *)arg;
+	pthread_t senders[kMaxNodes], receivers[kMaxNodes];
+	for (uint32_t peer = 0; peer < node->nodeCount; peer++) {
+		if (peer == node->rank) {
+			continue;
+		}
+		node->peers[peer] = {node, peer};
+		if (pthread_create(&senders[peer], nullptr, sendDirect, &node->peers[peer]) != 0 ||
+		    pthread_create(&receivers[peer], nullptr, receiveDirect, &node->peers[peer]) != 0) {
+			fprintf(stderr, "Failed to start the threads of node %u\n", node->rank);
+			exit(EX_OSERR);
+		}
+	}
+
+	const uint64_t chunk  = node->blockSize / node->chunkCount;
+	const uint64_t offset = node->rank * node->blockSize;
+	for (uint32_t c = 0; c < node->chunkCount; c++) {
+		crypt(nullptr, node->rank, c, node->user + offset + c * chunk, node->staging + offset + c * chunk, chunk);
+		node->sealed.store(c + 1, std::memory_order_release);
+	}
+
+	for (uint32_t peer = 0; peer < node->nodeCount; peer++) {
+		if (peer != node->rank) {
+			pthread_join(senders[peer], nullptr);
+			pthread_join(receivers[peer], nullptr);
+		}
+	}
+	return nullptr;
+}
+
+struct Bench {
+	Node nodes[kMaxNodes];
+	uint32_t ring[AppleCIOMeshUtils::kMaxCollectiveNodes];
+	uint64_t maxBlockSize;
+	double linkBytesPerSecond;
+};
+
+// Runs one all-gather with every node on a thread of its own and returns the
+// seconds it took, or -1 if a node failed or ended up with the wrong blocks.
+static double
+measureSync(Bench * bench, bool ring, uint32_t nodeCount, uint64_t blockSize, uint32_t chunkCount)
+{
+	int sockets[kMaxNodes][kMaxNodes][2];
+	for (uint32_t from = 0; from < nodeCount; from++) {
+		for (uint32_t to = 0; to < nodeCount; to++) {
+			if (from != to && socketpair(AF_UNIX, SOCK_STREAM, 0, sockets[from][to]) != 0) {
+				fprintf(stderr, "Failed to connect the nodes: %s\n", strerror(errno));
+				exit(EX_OSERR);
+			}
+		}
+	}
+
+	const Clock::time_point start = Clock::now();
+	for (uint32_t position = 0; position < nodeCount; position++) {
+		const uint32_t rank = bench->ring[position];
+		Node & node         = bench->nodes[rank];
+		node.rank           = rank;
+		node.position       = position;
+		node.nodeCount      = nodeCount;
+		node.ring           = bench->ring;
+		node.blockSize      = blockSize;
+		node.chunkCount     = chunkCount;
+		node.sealed         = 0;
+		node.failed         = false;
+		for (uint32_t peer = 0; peer < nodeCount; peer++) {
+			if (peer != rank) {
+				node.out[peer] = {sockets[rank][peer][0], bench->linkBytesPerSecond, 0, start};
+				node.in[peer]  = sockets[peer][rank][1];
+			}
+		}
+		memset(node.user, 0, nodeCount * blockSize);
+		for (uint64_t i = 0; i < blockSize; i++) {
+			node.user[rank * blockSize + i] = (uint8_t)(rank * 131 + i);
+		}
+	}
+
+	pthread_t threads[kMaxNodes];
+	for (uint32_t rank = 0; rank < nodeCount; rank++) {
+		if (pthread_create(&threads[rank], nullptr, ring ? runRing : runDirect, &bench->nodes[rank]) != 0) {
+			fprintf(stderr, "Failed to start node %u\n", rank);
+			exit(EX_OSERR);
+		}
+	}
+	for (uint32_t rank = 0; rank < nodeCount; rank++) {
+		pthread_join(threads[rank], nullptr);
+	}
+	const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	bool failed = false;
+	for (uint32_t rank = 0; rank < nodeCount; rank++) {
+		const Node & node = bench->nodes[rank];
+		failed            = failed || node.failed;
+		for (uint32_t origin = 0; origin < nodeCount && !failed; origin++) {
+			for (uint64_t i = 0; i < blockSize; i++) {
+				if (node.user[origin * blockSize + i] != (uint8_t)(origin * 131 + i)) {
+					failed = true;
+					break;
+				}
+			}
+		}
+		for (uint32_t peer = 0; peer < nodeCount; peer++) {
+			if (peer != rank) {
+				close(sockets[rank][peer][0]);
+				close(sockets[rank][peer][1]);
+			}
+		}
+	}
+	return failed ? -1 : seconds;
+}
+
+static double
+medianSync(Bench * bench, bool ring, uint32_t nodeCount, uint64_t blockSize, uint32_t chunkCount, uint32_t syncs)
+{
+	double seconds[kMaxSyncs];
+	for (uint32_t i = 0; i < syncs; i++) {
+		seconds[i] = measureSync(bench, ring, nodeCount, blockSize, chunkCount);
+		if (seconds[i] < 0) {
+			return -1;
+		}
+	}
+	std::sort(seconds, seconds + syncs);
+	return seconds[syncs / 2];
+}
+
+int
+main(int argc, char ** argv)
+{
+	uint32_t nodeCounts[kMaxNodes] = {2, 4, 8};
+	uint32_t nodeCountCount        = 3;
+	uint64_t minKB                 = 64;
+	uint64_t maxKB                 = 4096;
+	uint32_t chunks                = 0;
+	double linkMBps                = 0;
+	uint32_t syncs                 = 5;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-nodes") == 0 && i + 1 < argc) {
+			nodeCountCount = 0;
+			for (char * p = argv[i + 1]; *p && nodeCountCount < kMaxNodes; p++) {
+				nodeCounts[nodeCountCount++] = (uint32_t)strtoul(p, &p, 0);
+				if (*p != ',') {
+					break;
+				}
+			}
+			i++;
+		} else if (strcmp(argv[i], "-min") == 0 && i + 1 < argc) {
+			minKB = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-max") == 0 && i + 1 < argc) {
+			maxKB = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-chunks") == 0 && i + 1 < argc) {
+			chunks = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-link") == 0 && i + 1 < argc) {
+			linkMBps = strtod(argv[i + 1], NULL);
+			i++;
+		} else if (strcmp(argv[i], "-syncs") == 0 && i + 1 < argc) {
+			syncs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (minKB == 0 || maxKB < minKB || syncs == 0 || syncs > kMaxSyncs || linkMBps < 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+	uint32_t maxNodes = 0;
+	for (uint32_t i = 0; i < nodeCountCount; i++) {
+		if (nodeCounts[i] < 2 || nodeCounts[i] > kMaxNodes) {
+			fprintf(stderr, "Node counts have to be between 2 and %u\n", kMaxNodes);
+			return EX_USAGE;
+		}
+		maxNodes = nodeCounts[i] > maxNodes ? nodeCounts[i] : maxNodes;
+	}
+
+	// A peer that fails closes its sockets, which must not kill the bench.
+	signal(SIGPIPE, SIG_IGN);
+
+	static Bench bench;
+	bench.maxBlockSize       = maxKB * 1024;
+	bench.linkBytesPerSecond = linkMBps * 1e6;
+	for (uint32_t rank = 0; rank < maxNodes; rank++) {
+		bench.nodes[rank].user    = (uint8_t *)malloc(maxNodes * bench.maxBlockSize);
+		bench.nodes[rank].staging = (uint8_t *)malloc(maxNodes * bench.maxBlockSize);
+		if (bench.nodes[rank].user == nullptr || bench.nodes[rank].staging == nullptr) {
+			fprintf(stderr, "Failed to allocate %llu bytes\n", 2ull * maxNodes * maxNodes * bench.maxBlockSize);
+			return EX_OSERR;
+		}
+	}
+
+	printf("%5s %10s %6s %11s %11s %7s\n", "nodes", "block KB", "chunks", "direct ms", "ring ms", "speedup");
+	for (uint32_t n = 0; n < nodeCountCount; n++) {
+		// The ring the mesh would use, so neighbours are one CIO hop apart.
+		AppleCIOMeshUtils::CollectiveTopology topology;
+		if (!AppleCIOMeshUtils::make_ensemble_topology(nodeCounts[n], &topology)) {
+			return EX_SOFTWARE;
+		}
+		AppleCIOMeshUtils::collective_ring_order(topology, bench.ring);
+
+		for (uint64_t blockSize = minKB * 1024; blockSize <= maxKB * 1024; blockSize *= 2) {
+			const uint32_t chunkCount = chunks ? chunks : AppleCIOMeshUtils::default_chunk_count(blockSize);
+			if (blockSize % chunkCount != 0 || blockSize / chunkCount % sizeof(uint64_t) != 0) {
+				fprintf(stderr, "%u chunks do not divide %lluKB blocks\n", chunkCount, (unsigned long long)blockSize / 1024);
+				return EX_USAGE;
+			}
+			const double direct = medianSync(&bench, false, nodeCounts[n], blockSize, chunkCount, syncs);
+			const double ring   = medianSync(&bench, true, nodeCounts[n], blockSize, chunkCount, syncs);
+			if (direct < 0 || ring < 0) {
+				fprintf(stderr, "The %s gather of %u nodes with %lluKB blocks failed\n", direct < 0 ? "direct" : "ring",
+				        nodeCounts[n], (unsigned long long)blockSize / 1024);
+				return EX_SOFTWARE;
+			}
+			printf("%5u %10llu %6u %11.3f %11.3f %6.2fx\n", nodeCounts[n], (unsigned long long)blockSize / 1024, chunkCount,
+			       direct * 1e3, ring * 1e3, direct / ring);
+		}
+	}
+
+	for (uint32_t rank = 0; rank < maxNodes; rank++) {
+		free(bench.nodes[rank].user);
+		free(bench.nodes[rank].staging);
+	}
+	return 0;
+}
@@ -0,0 +1,176 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// shadowbench - measures how fast shadow buffers are faulted in and how fast
+// chunks are decrypted out of them into a user buffer, with the shadow memory
+// on base pages and on 2MB pages (see MESH_SHADOW_LARGE_PAGES).  the
+// decryption is stood in for by xor'ing a keystream, which like the real one
+// reads every byte of the shadow buffer and writes every byte of the user
+// buffer, in the order the chunks arrive from the peers.
+//
+// it only depends on Common/LargePages.h:
+//   c++ -std=c++17 -O2 -I. -pthread shadowbench/Main.cpp -o shadowbench
+//
+
+#include "Common/LargePages.h"
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+using AppleCIOMeshUtils::LargePageMapping;
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-size MB] [-chunk KB] [-threads N] [-iterations N]\n", name);
+	fprintf(stderr, "\t compares prefault and decrypt plus copy throughput of base and 2MB pages.\n");
+	fprintf(stderr,
+	        "options: -size is the size of the buffer (default 512MB).\n"
+	        "         -chunk is the size of the chunks decrypted (default 1024KB).\n"
+	        "         -threads is the number of threads faulting in the buffer (default 8).\n"
+	        "         -iterations is the number of times the buffer is decrypted (default 10).\n");
+}
+
+static double
+secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint64_t
+mix(uint64_t value)
+{
+	// splitmix64
+	value += 0x9e3779b97f4a7c15ull;
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+	return value ^ (value >> 31);
+}
+
+static void
+decryptChunk(const uint64_t * from, uint64_t * to, size_t words, uint64_t nonce)
+{
+	const uint64_t key = mix(nonce);
+	for (size_t i = 0; i < words; i++) {
+		to[i] = from[i] ^ (key + i * 0x9e3779b97f4a7c15ull);
+	}
+}
+
+static bool
+runMode(bool largePages, size_t size, size_t chunkSize, uint32_t threads, uint32_t iterations)
+{
+	LargePageMapping shadow;
+	if (!AppleCIOMeshUtils::map_large_pages(size, largePages, 0, &shadow)) {
+		fprintf(stderr, "Failed to map %zu bytes\n", size);
+		return false;
+	}
+	printf("%s: got %s of %zu bytes\n", largePages ? "2MB pages" : "base pages",
+	       AppleCIOMeshUtils::large_page_kind_name(shadow.kind), shadow.pageSize);
+
+	auto start = std::chrono::steady_clock::now();
+	AppleCIOMeshUtils::prefault_parallel(shadow.memory, size, shadow.pageSize, threads);
+	const double prefaultTime = secondsSince(start);
+
+	// A second buffer to compare against faulting in from a single thread.
+	LargePageMapping single;
+	if (!AppleCIOMeshUtils::map_large_pages(size, largePages, 0, &single)) {
+		fprintf(stderr, "Failed to map %zu bytes\n", size);
+		AppleCIOMeshUtils::unmap_large_pages(shadow);
+		return false;
+	}
+	start = std::chrono::steady_clock::now();
+	AppleCIOMeshUtils::prefault_parallel(single.memory, size, single.pageSize, 1);
+	const double singleTime = secondsSince(start);
+	AppleCIOMeshUtils::unmap_large_pages(single);
+
+	printf("  prefault: %.2f GB/s with %u threads, %.2f GB/s with 1\n", (double)size / prefaultTime / 1e9, threads,
+	       (double)size / singleTime / 1e9);
+
+	// The user buffer is always on base pages, like the buffers of the app.
+	LargePageMapping user;
+	if (!AppleCIOMeshUtils::map_large_pages(size, false, 0, &user)) {
+		fprintf(stderr, "Failed to map %zu bytes\n", size);
+		AppleCIOMeshUtils::unmap_large_pages(shadow);
+		return false;
+	}
+	memset(shadow.memory, 0x5a, size);
+	memset(user.memory, 0, size);
+
+	// Chunks come in from every peer in turn, so walk them in a fixed
+	// interleaved order rather than front to back.
+	const size_t chunks = size / chunkSize;
+	const size_t stride = chunks > 7 && chunks % 7 != 0 ? 7 : 1;
+	start               = std::chrono::steady_clock::now();
+	for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+		for (size_t i = 0; i < chunks; i++) {
+			const size_t chunk = (i * stride) % chunks;
+			const size_t words = chunkSize / sizeof(uint64_t);
+			decryptChunk((const uint64_t *)shadow.memory + chunk * words, (uint64_t *)user.memory + chunk * words, words,
+			             iteration * chunks + chunk);
+		}
+	}
+	const double decryptTime = secondsSince(start);
+	printf("  decrypt plus copy: %.2f GB/s\n", (double)(chunks * chunkSize) * iterations / decryptTime / 1e9);
+
+	AppleCIOMeshUtils::unmap_large_pages(user);
+	AppleCIOMeshUtils::unmap_large_pages(shadow);
+	return true;
+}
+
+int
+main(int argc, char ** argv)
+{
+	size_t sizeMB       = 512;
+	size_t chunkKB      = 1024;
+	uint32_t threads    = 8;
+	uint32_t iterations = 10;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+			sizeMB = (size_t)strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-chunk") == 0 && i + 1 < argc) {
+			chunkKB = (size_t)strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+			threads = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-iterations") == 0 && i + 1 < argc) {
+			iterations = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (sizeMB == 0 || chunkKB == 0 || chunkKB * 1024 > sizeMB * 1024 * 1024 || iterations == 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	const size_t size      = sizeMB * 1024 * 1024;
+	const size_t chunkSize = chunkKB * 1024;
+	if (!runMode(false, size, chunkSize, threads, iterations) || !runMode(true, size, chunkSize, threads, iterations)) {
+		return EX_OSERR;
+	}
+	return 0;
+}
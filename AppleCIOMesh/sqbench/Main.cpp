@@ -0,0 +1,172 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+
+//
+// sqbench - compares issuing a sync's send and prepare commands a trap at a
+// time with queueing them all on the command ring and ringing the doorbell
+// once.  a trap is stood in for by spinning for -trap, what it costs to cross
+// into the kernel and back, and every command spins for -work on the driver
+// side.  the ring itself is the real one, so what is left over once the
+// crossings are gone is what the ring costs.
+//
+// it only depends on Common/CommandRing.h:
+//   c++ -std=c++17 -O2 -I. sqbench/Main.cpp -o sqbench
+//
+
+#include "Common/CommandRing.h"
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+using AppleCIOMeshUtils::command_ring_size;
+using AppleCIOMeshUtils::CommandRing;
+using AppleCIOMeshUtils::CommandRingDrainResult;
+using AppleCIOMeshUtils::kMaxCommandRingEntries;
+using AppleCIOMeshUtils::kMeshCommandSendAndPrepare;
+using AppleCIOMeshUtils::MeshCommand;
+using AppleCIOMeshUtils::MeshCompletion;
+using Clock = std::chrono::steady_clock;
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-commands N] [-trap ns] [-work ns] [-syncs N]\n", name);
+	fprintf(stderr, "\t times a sync of every power of two command count up to N, a trap per command and batched.\n");
+	fprintf(stderr,
+	        "options: -commands is the most commands in one sync (default 256, at most %u).\n"
+	        "         -trap is what one user/kernel crossing costs (default 1500ns).\n"
+	        "         -work is what the driver spends on one command (default 500ns).\n"
+	        "         -syncs is how many syncs each row is averaged over (default 1000).\n",
+	        kMaxCommandRingEntries);
+}
+
+static void
+spin(uint64_t nanoseconds)
+{
+	const Clock::time_point until = Clock::now() + std::chrono::nanoseconds(nanoseconds);
+	while (Clock::now() < until) {
+	}
+}
+
+static double
+elapsed(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int
+main(int argc, char ** argv)
+{
+	uint32_t maxCommands = 256;
+	uint64_t trapCost    = 1500;
+	uint64_t workCost    = 500;
+	uint32_t syncs       = 1000;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-commands") == 0 && i + 1 < argc) {
+			maxCommands = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-trap") == 0 && i + 1 < argc) {
+			trapCost = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-work") == 0 && i + 1 < argc) {
+			workCost = strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (strcmp(argv[i], "-syncs") == 0 && i + 1 < argc) {
+			syncs = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+			i++;
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+	if (maxCommands == 0 || maxCommands > kMaxCommandRingEntries || syncs == 0) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	uint32_t entries = 1;
+	while (entries < maxCommands) {
+		entries *= 2;
+	}
+	const uint64_t size          = command_ring_size(entries);
+	void * memory                = calloc(1, size);
+	MeshCommand * commands       = (MeshCommand *)calloc(entries, sizeof(MeshCommand));
+	MeshCompletion * completions = (MeshCompletion *)calloc(entries, sizeof(MeshCompletion));
+	if (memory == nullptr || commands == nullptr || completions == nullptr) {
+		fprintf(stderr, "Out of memory\n");
+		return EX_OSERR;
+	}
+
+	CommandRing user, driver;
+	if (!user.init(memory, size, entries) || !driver.attach(memory, size, entries)) {
+		fprintf(stderr, "Could not set up a ring of %u entries\n", entries);
+		return EX_SOFTWARE;
+	}
+
+	auto execute = [&](const MeshCommand &) -> int32_t {
+		spin(workCost);
+		return 0;
+	};
+
+	printf("%8s %12s %12s %8s %10s\n", "commands", "per trap us", "batched us", "speedup", "ring ns");
+	for (uint32_t count = 1; count <= maxCommands; count *= 2) {
+		for (uint32_t i = 0; i < count; i++) {
+			commands[i]          = {};
+			commands[i].userData = i;
+			commands[i].op       = kMeshCommandSendAndPrepare;
+		}
+
+		Clock::time_point start = Clock::now();
+		for (uint32_t sync = 0; sync < syncs; sync++) {
+			for (uint32_t i = 0; i < count; i++) {
+				spin(trapCost);
+				execute(commands[i]);
+			}
+		}
+		const double perTrap = elapsed(start) / syncs;
+
+		start = Clock::now();
+		for (uint32_t sync = 0; sync < syncs; sync++) {
+			if (user.submit(commands, count) != count) {
+				fprintf(stderr, "The ring did not take %u commands\n", count);
+				return EX_SOFTWARE;
+			}
+			spin(trapCost);
+			CommandRingDrainResult result = driver.drain(execute, -1);
+			if (result.completed != count || result.status != 0 || user.reap(completions, count) != count) {
+				fprintf(stderr, "The ring did not complete %u commands\n", count);
+				return EX_SOFTWARE;
+			}
+		}
+		const double batched = elapsed(start) / syncs;
+
+		// What the batch cost beyond one crossing and the work itself.
+		const double ideal = (trapCost + (double)workCost * count) * 1e-9;
+		printf("%8u %12.2f %12.2f %7.2fx %10.0f\n", count, perTrap * 1e6, batched * 1e6, perTrap / batched,
+		       (batched - ideal) * 1e9 / count);
+	}
+
+	free(completions);
+	free(commands);
+	free(memory);
+	return EX_OK;
+}
@@ -0,0 +1,250 @@
+// Copyright © 2025 Apple Inc. All Rights Reserved.
+
+// APPLE INC.
+// PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT
+// PLEASE READ THE FOLLOWING PRIVATE CLOUD COMPUTE SOURCE CODE INTERNAL USE LICENSE AGREEMENT (“AGREEMENT”) CAREFULLY BEFORE DOWNLOADING OR USING THE APPLE SOFTWARE ACCOMPANYING THIS AGREEMENT(AS DEFINED BELOW). BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING TO BE BOUND BY THE TERMS OF THIS AGREEMENT. IF YOU DO NOT AGREE TO THE TERMS OF THIS AGREEMENT, DO NOT DOWNLOAD OR USE THE APPLE SOFTWARE. THESE TERMS AND CONDITIONS CONSTITUTE A LEGAL AGREEMENT BETWEEN YOU AND APPLE.
+// IMPORTANT NOTE: BY DOWNLOADING OR USING THE APPLE SOFTWARE, YOU ARE AGREEING ON YOUR OWN BEHALF AND/OR ON BEHALF OF YOUR COMPANY OR ORGANIZATION TO THE TERMS OF THIS AGREEMENT.
+// 1. As used in this Agreement, the term “Apple Software” collectively means and includes all of the Apple Private Cloud Compute materials provided by Apple here, including but not limited to the Apple Private Cloud Compute software, tools, data, files, frameworks, libraries, documentation, logs and other Apple-created materials. In consideration for your agreement to abide by the following terms, conditioned upon your compliance with these terms and subject to these terms, Apple grants you, for a period of ninety (90) days from the date you download the Apple Software, a limited, non-exclusive, non-sublicensable license under Apple’s copyrights in the Apple Software to download, install, compile and run the Apple Software internally within your organization only on a single Apple-branded computer you own or control, for the sole purpose of verifying the security and privacy characteristics of Apple Private Cloud Compute. This Agreement does not allow the Apple Software to exist on more than one Apple-branded computer at a time, and you may not distribute or make the Apple Software available over a network where it could be used by multiple devices at the same time. You may not, directly or indirectly, redistribute the Apple Software or any portions thereof. The Apple Software is only licensed and intended for use as expressly stated above and may not be used for other purposes or in other contexts without Apple's prior written permission. Except as expressly stated in this notice, no other rights or licenses, express or implied, are granted by Apple herein.
+// 2. The Apple Software is provided by Apple on an "AS IS" basis. APPLE MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS, SYSTEMS, OR SERVICES. APPLE DOES NOT WARRANT THAT THE APPLE SOFTWARE WILL MEET YOUR REQUIREMENTS, THAT THE OPERATION OF THE APPLE SOFTWARE WILL BE UNINTERRUPTED OR ERROR-FREE, THAT DEFECTS IN THE APPLE SOFTWARE WILL BE CORRECTED, OR THAT THE APPLE SOFTWARE WILL BE COMPATIBLE WITH FUTURE APPLE PRODUCTS, SOFTWARE OR SERVICES. NO ORAL OR WRITTEN INFORMATION OR ADVICE GIVEN BY APPLE OR AN APPLE AUTHORIZED REPRESENTATIVE WILL CREATE A WARRANTY.
+// 3. IN NO EVENT SHALL APPLE BE LIABLE FOR ANY DIRECT, SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, COMPILATION OR OPERATION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 4. This Agreement is effective until terminated. Your rights under this Agreement will terminate automatically without notice from Apple if you fail to comply with any term(s) of this Agreement. Upon termination, you agree to cease all use of the Apple Software and destroy all copies, full or partial, of the Apple Software. This Agreement constitutes the entire understanding of the parties with respect to the subject matter contained herein, and supersedes all prior negotiations, representations, or understandings, written or oral. This Agreement will be governed and construed in accordance with the laws of the State of California, without regard to its choice of law rules.
+// You may report security issues about Apple products to product-security@apple.com, as described here: https://www.apple.com/support/security/. Non-security bugs and enhancement requests can be made via https://bugreport.apple.com as described here: https://developer.apple.com/bug-reporting/
+// EA1937
+// 10/02/2024
+
+// Copyright 2021, Apple Inc. All rights reserved.
+//
+// synctrace - decodes the sync traces written by MeshStartSyncTrace (or with
+// MESH_SYNC_TRACE set).  prints the percentiles of the sync and phase times
+// and optionally converts the trace to CSV.
+//
+// it only depends on Common/SyncTrace.h so traces can be looked at on any
+// machine:
+//   c++ -std=c++17 -I. synctrace/Main.cpp -o synctrace
+//
+
+#include "Common/SyncTrace.h"
+#include <algorithm>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <vector>
+
+using AppleCIOMeshUtils::kSyncTracePhaseCount;
+using AppleCIOMeshUtils::kSyncTracePhaseNotDone;
+using AppleCIOMeshUtils::SyncTraceFileHeader;
+using AppleCIOMeshUtils::SyncTraceRecord;
+
+// In MeshSyncPhase_t order.
+static const char * kPhaseNames[kSyncTracePhaseCount] = {
+    "encrypt", "sendsIssued", "firstChunk", "lastChunk", "decrypt", "netReceive",
+};
+
+static const double kPercentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+
+static void
+usage(char * name)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "\t%s [-csv OUTPUT] [-skip N] TRACE\n", name);
+	fprintf(stderr, "\t prints the sync and phase time percentiles of the trace.\n");
+	fprintf(stderr,
+	        "options: -csv writes every sync to OUTPUT as CSV ('-' for stdout).\n"
+	        "         -skip ignores the first N syncs (e.g. warmup) in the percentiles.\n");
+}
+
+static bool
+readTrace(const char * path, SyncTraceFileHeader & header, std::vector<SyncTraceRecord> & records)
+{
+	FILE * file = fopen(path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	if (fread(&header, sizeof(header), 1, file) != 1 || !AppleCIOMeshUtils::is_valid_sync_trace_header(header)) {
+		fprintf(stderr, "%s is not a sync trace (or is from an incompatible version)\n", path);
+		fclose(file);
+		return false;
+	}
+
+	SyncTraceRecord record;
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		records.push_back(record);
+	}
+	// A partial record at the end means the process went away mid write.
+	bool ok = !ferror(file);
+	if (!ok) {
+		fprintf(stderr, "error reading %s: %s\n", path, strerror(errno));
+	}
+	fclose(file);
+	return ok;
+}
+
+static bool
+writeCsv(const char * path, const SyncTraceFileHeader & header, const std::vector<SyncTraceRecord> & records)
+{
+	FILE * file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	fprintf(file, "sequence,endTime,syncTime,nodeMask,bufferSize");
+	for (uint32_t phase = 0; phase < kSyncTracePhaseCount; phase++) {
+		fprintf(file, ",%s", kPhaseNames[phase]);
+	}
+	fprintf(file, "\n");
+
+	for (const SyncTraceRecord & record : records) {
+		// Times are relative to the start of the trace, which is easier to plot.
+		const uint64_t endTime = record.endTime > header.startTime ? record.endTime - header.startTime : 0;
+		fprintf(file, "%llu,%llu,%llu,0x%llx,%llu", (unsigned long long)record.sequence, (unsigned long long)endTime,
+		        (unsigned long long)record.syncTime, (unsigned long long)record.nodeMask, (unsigned long long)record.bufferSize);
+		for (uint32_t phase = 0; phase < kSyncTracePhaseCount; phase++) {
+			if (record.phaseTime[phase] == kSyncTracePhaseNotDone) {
+				fprintf(file, ",");
+			} else {
+				fprintf(file, ",%u", record.phaseTime[phase]);
+			}
+		}
+		fprintf(file, "\n");
+	}
+
+	bool ok = !ferror(file);
+	if (file != stdout) {
+		ok = (fclose(file) == 0) && ok;
+	}
+	if (!ok) {
+		fprintf(stderr, "error writing %s\n", path);
+	}
+	return ok;
+}
+
+// Exact percentile (nearest rank) of the sorted values.
+static uint64_t
+percentile(const std::vector<uint64_t> & sorted, double p)
+{
+	size_t rank = (size_t)((p / 100.0) * (double)sorted.size() + 0.5);
+	if (rank == 0) {
+		rank = 1;
+	}
+	if (rank > sorted.size()) {
+		rank = sorted.size();
+	}
+	return sorted[rank - 1];
+}
+
+static void
+printPercentiles(const char * name, std::vector<uint64_t> & values)
+{
+	printf("%-12s %10zu", name, values.size());
+	if (values.empty()) {
+		printf("\n");
+		return;
+	}
+	std::sort(values.begin(), values.end());
+	for (double p : kPercentiles) {
+		printf(" %10.2f", (double)percentile(values, p) / 1000.0);
+	}
+	printf(" %10.2f\n", (double)values.back() / 1000.0);
+}
+
+static void
+printSummary(const SyncTraceFileHeader & header, const std::vector<SyncTraceRecord> & records, size_t skip)
+{
+	uint64_t lost = 0;
+	for (size_t i = 1; i < records.size(); i++) {
+		if (records[i].sequence > records[i - 1].sequence + 1) {
+			lost += records[i].sequence - records[i - 1].sequence - 1;
+		}
+	}
+	if (!records.empty()) {
+		// Syncs dropped before the first record that made it.
+		lost += records[0].sequence;
+	}
+
+	printf("node %u: %zu syncs, %llu dropped\n", header.nodeId, records.size(), (unsigned long long)lost);
+	if (records.size() > 1) {
+		const double seconds = (double)(records.back().endTime - records.front().endTime) / 1e9;
+		printf("%.3f seconds, %.1f syncs per second\n", seconds, seconds > 0 ? (double)(records.size() - 1) / seconds : 0.0);
+	}
+	if (skip >= records.size()) {
+		return;
+	}
+
+	printf("\n%-12s %10s", "usec", "count");
+	for (double p : kPercentiles) {
+		char label[16];
+		snprintf(label, sizeof(label), "p%g", p);
+		printf(" %10s", label);
+	}
+	printf(" %10s\n", "max");
+
+	std::vector<uint64_t> values;
+	values.reserve(records.size() - skip);
+	for (size_t i = skip; i < records.size(); i++) {
+		values.push_back(records[i].syncTime);
+	}
+	printPercentiles("sync", values);
+
+	for (uint32_t phase = 0; phase < kSyncTracePhaseCount; phase++) {
+		values.clear();
+		for (size_t i = skip; i < records.size(); i++) {
+			if (records[i].phaseTime[phase] != kSyncTracePhaseNotDone) {
+				values.push_back(records[i].phaseTime[phase]);
+			}
+		}
+		printPercentiles(kPhaseNames[phase], values);
+	}
+}
+
+int
+main(int argc, char ** argv)
+{
+	const char * csvPath   = NULL;
+	const char * tracePath = NULL;
+	size_t skip            = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-csv") == 0 && i + 1 < argc) {
+			csvPath = argv[i + 1];
+			i++;
+		} else if (strcmp(argv[i], "-skip") == 0 && i + 1 < argc) {
+			skip = (size_t)strtoull(argv[i + 1], NULL, 0);
+			i++;
+		} else if (argv[i][0] != '-' && tracePath == NULL) {
+			tracePath = argv[i];
+		} else {
+			printf("Unknown argument: %s\n", argv[i]);
+			usage(argv[0]);
+			return EX_USAGE;
+		}
+	}
+
+	if (tracePath == NULL) {
+		usage(argv[0]);
+		return EX_USAGE;
+	}
+
+	SyncTraceFileHeader header;
+	std::vector<SyncTraceRecord> records;
+	if (!readTrace(tracePath, header, records)) {
+		return EX_DATAERR;
+	}
+
+	if (csvPath) {
+		if (!writeCsv(csvPath, header, records)) {
+			return EX_IOERR;
+		}
+		if (strcmp(csvPath, "-") == 0) {
+			return 0;
+		}
+	}
+
+	printSummary(header, records, skip);
+	return 0;
+}
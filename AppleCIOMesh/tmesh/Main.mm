@@ -74,7 +74,13 @@ usage(char * name)
 	fprintf(stderr, "\t matrix size, mynodeid and numnodes are all required.  buffer-id is optional.\n");
 	fprintf(stderr,
 	        "options: set environment variable MESH_CRYPTO=1 to enable encryption\n"
-	        "         env var MESH_VERBOSE=1 for extremely verbose logging.\n");
+	        "         env var MESH_VERBOSE=1 for extremely verbose logging.\n"
+	        "         env var MESH_EVENT_TRACE=FILE writes a Chrome trace of the mesh threads to FILE on exit.\n"
+	        "         env var MESH_METRICS_SOCKET=PATH serves OpenMetrics stats over HTTP on the Unix socket PATH.\n"
+	        "         env var MESH_STATS_SEGMENT=/NAME publishes live stats to shared memory for meshtop.\n"
+	        "         env var MESH_SHADOW_LARGE_PAGES=1 backs the shadow buffers with 2MB pages where available.\n"
+	        "         env var MESH_CRYPTO_PLACEMENT=auto|RANK:DOMAIN,... places the crypto threads in NUMA nodes or clusters.\n"
+	        "         env var MESH_CHUNK_TABLE=FILE uses the chunk sizes tuned by chunktune.\n");
 }
 
 uint64_t
@@ -129,18 +135,13 @@ log_stats(MeshHandle_t * mh, MeshBufferState_t * mbs)
 		mh->stats.averageOutgoingCounter = 0;
 		fprintf(stdout, "Average Outgoing Speed: %f Gbps\n", mh->stats.averageOutgoingSpeed);
 
-		printf("Sync Time Histogram:\n");
-		uint64_t base = 0;
-		for (int i = 0; i < MESH_SYNC_HISTOGRAM_COUNT; i++) {
-			if (mh->stats.syncTimeHistogram[i] != 0) {
-				if (i < MESH_SYNC_HISTOGRAM_COUNT - 1) {
-					printf("    %6lld - %6lld usec: %lld\n", base, mh->stats.syncTimeHistogramBins[i],
-					       mh->stats.syncTimeHistogram[i]);
-				} else {
-					printf("           > %6lld usec: %lld\n", base, mh->stats.syncTimeHistogram[i]);
-				}
+		static const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+		uint64_t syncTimes[sizeof(percentiles) / sizeof(percentiles[0])];
+		if (MeshGetSyncTimePercentiles(mh, percentiles, syncTimes, sizeof(percentiles) / sizeof(percentiles[0])) == 0) {
+			printf("Sync Time Percentiles:\n");
+			for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+				printf("    p%-6g %8.2f usec\n", percentiles[i], (double)syncTimes[i] / 1000.0);
 			}
-			base = mh->stats.syncTimeHistogramBins[i] + 1;
 		}
 	}
 }
@@ -148,6 +149,20 @@ log_stats(MeshHandle_t * mh, MeshBufferState_t * mbs)
 MeshHandle_t * global_mh       = NULL; // only for the signal handler
 MeshBufferState_t * global_mbs = NULL;
 
+// tmesh never destroys its handle, so write out the event trace ourselves.
+static void
+writeEventTrace(MeshHandle_t * mh)
+{
+	const char * path = getenv("MESH_EVENT_TRACE");
+	if (path == NULL) {
+		return;
+	}
+	int error = MeshWriteEventTrace(mh, path);
+	if (error) {
+		printf("Failed to write the event trace to %s: %s\n", path, strerror(error));
+	}
+}
+
 void
 tmesh_SigIntHandler(int)
 {
@@ -161,15 +176,8 @@ tmesh_SigIntHandler(int)
 		    global_mh->num_threads);
 
 		MeshStopReaders(global_mh);
+		writeEventTrace(global_mh);
 
-#if 0
-		printf("Sync Time Histogram:\n");
-		uint64_t base=0;
-		for(int i=0; i < MESH_SYNC_HISTOGRAM_COUNT; i++) {
-			printf("    %6lld - %6lld usec: %lld\n", base, global_mh->stats.syncTimeHistogramBins[i],  global_mh->stats.syncTimeHistogram[i]);
-			base = global_mh->stats.syncTimeHistogramBins[i] + 1;
-		}
-#endif
 		//	dump_crypto_state(global_mh);
 	}
 	exit(1);
@@ -640,6 +648,7 @@ main(int argc, char ** argv)
 	if (!MeshStopReaders(mh)) {
 		printf("Failed to stop readers!\n");
 	}
+	writeEventTrace(mh);
 
 	return 0;
 }